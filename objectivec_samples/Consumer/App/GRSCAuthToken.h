@@ -38,6 +38,9 @@
 /** String representing the token. */
 @property(nonatomic, strong, readonly, nullable) NSString *token;
 
+/** The time, in seconds since 1970, at which the token expires. */
+@property(nonatomic, readonly) NSTimeInterval expiration;
+
 /**
  * Checks that the AuthToken is Valid. A valid AuthToken is one that has a token
  * which is not expired.
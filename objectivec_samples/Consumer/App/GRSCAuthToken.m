@@ -15,9 +15,7 @@
 
 #import "GRSCAuthToken.h"
 
-@implementation GRSCAuthToken {
-  NSTimeInterval _expiration;
-}
+@implementation GRSCAuthToken
 
 - (instancetype)initWithToken:(NSString*)token expiration:(NSTimeInterval)expiration {
   self = [super init];
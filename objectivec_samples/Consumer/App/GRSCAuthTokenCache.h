@@ -0,0 +1,124 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "GRSCClock.h"
+
+/**
+ * Callback block definition for a token fetched from the provider.
+ *
+ * @param token The fetched token. It is nil if there's an error fetching the token.
+ * @param expiration The time, in seconds since 1970, at which the token expires.
+ * @param error Error when fetching the token. It is nil if fetching the token succeeds.
+ */
+typedef void (^GRSCAuthTokenFetchHandler)(NSString *_Nullable token, NSTimeInterval expiration,
+                                          NSError *_Nullable error);
+
+/**
+ * Block definition that fetches a new token from the provider and calls @c completion exactly once.
+ *
+ * @param key The key to fetch a token for, such as a trip ID.
+ * @param completion The block to call with the fetched token.
+ */
+typedef void (^GRSCAuthTokenFetcher)(NSString *_Nonnull key,
+                                     GRSCAuthTokenFetchHandler _Nonnull completion);
+
+/**
+ * Callback block definition for a token returned by the cache.
+ *
+ * @param token The token. It is nil if there's an error fetching the token.
+ * @param error Error when fetching the token. It is nil if fetching the token succeeds.
+ */
+typedef void (^GRSCAuthTokenCacheHandler)(NSString *_Nullable token, NSError *_Nullable error);
+
+/**
+ * A thread-safe cache of auth tokens, keyed by the ID the token was issued for.
+ *
+ * Requests for a key that arrive while its token is being fetched wait for that fetch instead of
+ * starting another one. Once only @c refreshAheadFraction of a token's lifetime remains, the next
+ * request still returns the cached token but also starts fetching a new one, so callers only wait
+ * on the network when a token has expired.
+ *
+ * Once more than @c capacity keys are cached, the tokens closest to expiring are evicted first.
+ * Tokens can also be persisted to a file, so that a relaunch within their lifetime doesn't wait for
+ * a token to be fetched. The file is written with complete file protection and excluded from
+ * backups. Tokens are short-lived and fetched again when missing, so they aren't worth keeping in
+ * the Keychain, but they must not outlive the device in a backup.
+ */
+@interface GRSCAuthTokenCache : NSObject
+
+/** The maximum number of tokens held by the cache. */
+@property(nonatomic, readonly) NSUInteger capacity;
+
+/**
+ * The fraction of a token's lifetime, between 0 and 1, that remains when the token is refreshed.
+ * Defaults to 0.2.
+ */
+@property(nonatomic) double refreshAheadFraction;
+
+/** The clock that tokens expire on. */
+@property(nonatomic, readonly, nonnull) id<GRSCClock> clock;
+
+/**
+ * Initializes an instance of this class.
+ *
+ * @param capacity The maximum number of tokens held by the cache.
+ * @param fileURL The file that tokens are persisted to and restored from, or nil to keep tokens in
+ * memory only.
+ * @param clock The clock that tokens expire on.
+ * @param fetcher The block that fetches a new token from the provider.
+ */
+- (nonnull instancetype)initWithCapacity:(NSUInteger)capacity
+                                 fileURL:(nullable NSURL *)fileURL
+                                   clock:(nonnull id<GRSCClock>)clock
+                                 fetcher:(nonnull GRSCAuthTokenFetcher)fetcher
+    NS_DESIGNATED_INITIALIZER;
+
+/**
+ * Initializes an instance of this class whose tokens expire on the system clock.
+ *
+ * @param capacity The maximum number of tokens held by the cache.
+ * @param fileURL The file that tokens are persisted to and restored from, or nil to keep tokens in
+ * memory only.
+ * @param fetcher The block that fetches a new token from the provider.
+ */
+- (nonnull instancetype)initWithCapacity:(NSUInteger)capacity
+                                 fileURL:(nullable NSURL *)fileURL
+                                 fetcher:(nonnull GRSCAuthTokenFetcher)fetcher;
+
+/**
+ * Initializes an instance of this class that keeps a default number of tokens in memory only.
+ *
+ * @param fetcher The block that fetches a new token from the provider.
+ */
+- (nonnull instancetype)initWithFetcher:(nonnull GRSCAuthTokenFetcher)fetcher;
+
+/**
+ * Use @c initWithCapacity:fileURL:clock:fetcher: instead.
+ */
+- (nonnull instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Returns a valid token for the key, fetching one if none is cached.
+ *
+ * @param key The key to return a token for, such as a trip ID.
+ * @param completion The block executed with the token. Cached tokens are delivered before this
+ * method returns.
+ */
+- (void)fetchTokenForKey:(nonnull NSString *)key
+              completion:(nonnull GRSCAuthTokenCacheHandler)completion;
+
+@end
@@ -17,6 +17,8 @@
 
 #import <GoogleRidesharingConsumer/GoogleRidesharingConsumer.h>
 
+#import "GRSCClock.h"
+
 /**
  * An implementation of GRSAuthorization which provides authorization tokens for FleetEngine.
 */
@@ -28,7 +30,16 @@
  *
  * @param session The Session used for NSURLSessionDataTask.
  */
+- (nullable instancetype)initWithURLSession:(nonnull NSURLSession *)session;
+
+/**
+ * Initializes and returns a GRSCAuthTokenProvider object using the provided NSURLSession for
+ * network calls, whose tokens expire on the given clock.
+ *
+ * @param session The Session used for NSURLSessionDataTask.
+ * @param clock The clock that cached tokens expire on.
+ */
 - (nullable instancetype)initWithURLSession:(nonnull NSURLSession *)session
-    NS_DESIGNATED_INITIALIZER;
+                                      clock:(nonnull id<GRSCClock>)clock NS_DESIGNATED_INITIALIZER;
 
 @end
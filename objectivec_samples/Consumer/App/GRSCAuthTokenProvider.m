@@ -15,19 +15,32 @@
 
 #import "GRSCAuthTokenProvider.h"
 
+#import <QuartzCore/QuartzCore.h>
+
 #import "GRSCAuthToken.h"
+#import "GRSCAuthTokenCache.h"
+#import "GRSCProviderMetrics.h"
 #import "GRSCProviderUtils.h"
 
 // Provider token path String.
 static NSString *const kProviderTokenPath = @"token/consumer/";
 
+// Consumer tokens are kept for this many trips, and persisted to this file in the caches directory
+// so that they can be reused after a relaunch.
+static const NSUInteger kTokenCacheCapacity = 16;
+static NSString *const kTokenCacheFileName = @"GRSCAuthTokens.plist";
+
 // Provider response keys.
 static NSString *const kProviderResponseTokenExpirationKey = @"expirationTimestamp";
 static NSString *const kProviderResponseTokenKey = @"jwt";
 
+// HTTP constants.
+static NSString *const kGRSCHTTPMethodGET = @"GET";
+
 // Error descriptions.
 static NSString *const kInvalidAuthorizationContextDescription = @"Invalid Authroization Context.";
 static NSString *const kTokenNotFoundDescription = @"Token not found in response.";
+static NSString *const kTokenProviderReleasedDescription = @"The token provider was released.";
 
 /** Returns expiration timestamp from JSON response. Will return 0 if expiration is invalid. */
 static NSTimeInterval GetExpirationTimestampFromJSONResponse(
@@ -65,6 +78,14 @@ static GRSCAuthToken *_Nullable GetAuthTokenFromJSONResponse(
   return nil;
 }
 
+/** Returns the file that consumer tokens are persisted to between launches. */
+static NSURL *_Nullable GetTokenCacheFileURL(void) {
+  NSURL *cachesURL = [NSFileManager.defaultManager URLsForDirectory:NSCachesDirectory
+                                                          inDomains:NSUserDomainMask]
+                         .firstObject;
+  return [cachesURL URLByAppendingPathComponent:kTokenCacheFileName];
+}
+
 /** Returns the full provider URL with the given tripID appended. */
 static NSURL *_Nullable GetProviderURLWithTripID(NSString *_Nonnull tripID) {
   NSURL *providerURL = GRSCProviderURLWithPath(kProviderTokenPath);
@@ -73,8 +94,7 @@ static NSURL *_Nullable GetProviderURLWithTripID(NSString *_Nonnull tripID) {
 
 @implementation GRSCAuthTokenProvider {
   NSURLSession *_session;
-  GRSCAuthToken *_authToken;
-  NSString *_lastKnownTripID;
+  GRSCAuthTokenCache *_tokenCache;
 }
 
 - (instancetype)init {
@@ -82,9 +102,28 @@ static NSURL *_Nullable GetProviderURLWithTripID(NSString *_Nonnull tripID) {
 }
 
 - (instancetype)initWithURLSession:(NSURLSession *)session {
+  return [self initWithURLSession:session clock:[GRSCSystemClock sharedClock]];
+}
+
+- (instancetype)initWithURLSession:(NSURLSession *)session clock:(id<GRSCClock>)clock {
   self = [super init];
   if (self) {
     _session = session;
+
+    __weak typeof(self) weakSelf = self;
+    _tokenCache = [[GRSCAuthTokenCache alloc]
+        initWithCapacity:kTokenCacheCapacity
+                 fileURL:GetTokenCacheFileURL()
+                   clock:clock
+                 fetcher:^(NSString *tripID, GRSCAuthTokenFetchHandler completion) {
+                   GRSCAuthTokenProvider *strongSelf = weakSelf;
+                   if (!strongSelf) {
+                     // Fail the requests waiting for the token instead of leaving them hanging.
+                     completion(nil, 0, GRSCError(kTokenProviderReleasedDescription));
+                     return;
+                   }
+                   [strongSelf fetchTokenWithTripID:tripID completion:completion];
+                 }];
   }
   return self;
 }
@@ -98,44 +137,66 @@ static NSURL *_Nullable GetProviderURLWithTripID(NSString *_Nonnull tripID) {
     return;
   }
 
-  // Check if a token is cached and is valid.
-  if (_authToken && [_authToken isValid] && _lastKnownTripID &&
-      [_lastKnownTripID isEqualToString:authorizationContext.tripID]) {
-    completion(_authToken.token, nil);
-    return;
-  }
+  [_tokenCache fetchTokenForKey:authorizationContext.tripID completion:completion];
+}
 
-  NSURL *requestURL = GetProviderURLWithTripID(authorizationContext.tripID);
+#pragma mark - Private
+
+/**
+ * Fetches a new consumer token from the provider.
+ *
+ * @param tripID The trip ID to fetch a token for.
+ * @param completion The block executed when the request finishes.
+ */
+- (void)fetchTokenWithTripID:(NSString *)tripID completion:(GRSCAuthTokenFetchHandler)completion {
+  CFTimeInterval startTime = CACurrentMediaTime();
+  NSURL *requestURL = GetProviderURLWithTripID(tripID);
 
   if (!requestURL) {
-    completion(nil, GRSCError(kGRSCInvalidRequestURLDescription));
+    completion(nil, 0, GRSCError(kGRSCInvalidRequestURLDescription));
     return;
   }
 
-  NSURLRequest *request = [NSURLRequest requestWithURL:requestURL];
+  NSURLRequest *request = GRSCProviderRequest(requestURL, kGRSCHTTPMethodGET, nil);
 
   GRSCProviderResponseHandler tokenResponseHandler =
       ^(NSData *data, NSURLResponse *response, NSError *error) {
         if (error) {
-          completion(nil, error);
+          completion(nil, 0, error);
         } else {
-          // Process JSON response.
+          // Process JSON or property list response.
           NSError *JSONError;
           GRSCProviderFieldsDictionary *JSONResponse =
-              GRSCGetDictionaryFromJSONData(data, &JSONError);
+              GRSCGetDictionaryFromResponse(data, response, &JSONError);
 
           if (!JSONResponse || JSONError) {
-            completion(nil, JSONError);
+            completion(nil, 0, JSONError);
           } else {
-            _authToken = GetAuthTokenFromJSONResponse(JSONResponse, &JSONError);
-            _lastKnownTripID = authorizationContext.tripID;
-            completion(_authToken.token, JSONError);
+            GRSCAuthToken *authToken = GetAuthTokenFromJSONResponse(JSONResponse, &JSONError);
+            completion(authToken.token, authToken.expiration, JSONError);
           }
         }
       };
 
-  NSURLSessionDataTask *task = [_session dataTaskWithRequest:request
-                                           completionHandler:tokenResponseHandler];
+  // Token fetches are timed in the shared provider metrics. The completion is called on the
+  // session's delegate queue, so there is no dispatch phase.
+  GRSCProviderMetrics *metrics = [GRSCProviderMetrics sharedMetrics];
+  NSString *callName = NSStringFromSelector(_cmd);
+  CFTimeInterval sendTime = CACurrentMediaTime();
+  [metrics recordDuration:sendTime - startTime
+                  ofPhase:GRSCProviderCallPhaseBuild
+                  forCall:callName];
+  NSURLSessionDataTask *task = GRSCProviderDataTask(
+      _session, request, callName, NO, ^(NSData *data, NSURLResponse *response, NSError *error) {
+        CFTimeInterval responseTime = CACurrentMediaTime();
+        [metrics recordDuration:responseTime - sendTime
+                        ofPhase:GRSCProviderCallPhaseNetwork
+                        forCall:callName];
+        tokenResponseHandler(data, response, error);
+        [metrics recordDuration:CACurrentMediaTime() - responseTime
+                        ofPhase:GRSCProviderCallPhaseDecode
+                        forCall:callName];
+      });
   [task resume];
 }
 
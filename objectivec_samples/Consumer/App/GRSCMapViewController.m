@@ -18,9 +18,11 @@
 #import <GoogleRidesharingConsumer/GoogleRidesharingConsumer.h>
 #import "GRSCBottomPanelView.h"
 #import "GRSCBottomPanelViewConstants.h"
+#import "GRSCClock.h"
 #import "GRSCProviderService.h"
 #import "GRSCStringUtils.h"
 #import "GRSCStyle.h"
+#import "GRSCTripTracer.h"
 #import "GRSCUtils.h"
 #import "GRSCWaypointSelector.h"
 
@@ -43,6 +45,11 @@ static CGFloat const kGMTSCDefaultCameraLongitude = -122.4194;
 // Camera zoom level.
 static CGFloat const kGMTSCDefaultZoomLevel = 13.0;
 
+// Names of the traced steps of a trip's lifecycle, whose latencies tools/stitch_trip_traces.py
+// summarizes.
+static NSString *const kCreateTripSpanName = @"consumer.createTrip";
+static NSString *const kTripStatusSpanName = @"consumer.tripStatus";
+
 /** An enumeration of possible customer states for the mapview. */
 typedef NS_ENUM(NSUInteger, GRSCMapViewCustomerState) {
   /** A state indicating that the mapview has not been initialized. */
@@ -96,11 +103,17 @@ typedef NS_ENUM(NSUInteger, GRSCMapViewCustomerState) {
   GMSMarker *_previousTripDropoffMarker;
   /** Whether the trip being booked is a shared trip. */
   BOOL _isTripShared;
+  /** Records the steps of each trip's lifecycle. */
+  GRSCTripTracer *_tripTracer;
+  /** The clock that the trip flow's timers are scheduled on. */
+  id<GRSCClock> _clock;
 }
 
 - (void)viewDidLoad {
   [super viewDidLoad];
 
+  _clock = [GRSCSystemClock sharedClock];
+
   _mapView = [[GMTCMapView alloc] init];
   _mapView.delegate = self;
   _mapView.translatesAutoresizingMaskIntoConstraints = NO;
@@ -120,6 +133,7 @@ typedef NS_ENUM(NSUInteger, GRSCMapViewCustomerState) {
   [self.view addSubview:_bottomPanel];
   [self setBottomPanelConstrains];
   _providerService = [[GRSCProviderService alloc] init];
+  _tripTracer = _providerService.tripTracer;
 
   // Persist the mapview location to San Francisco.
   [self resetMapViewCamera];
@@ -475,12 +489,17 @@ typedef NS_ENUM(NSUInteger, GRSCMapViewCustomerState) {
   GMTSTerminalLocation *dropoffLocation = _waypointSelector.selectedDropoffLocation;
   NSArray<GMTSTerminalLocation *> *intermediateDestinations =
       _waypointSelector.selectedIntermediateDestinations;
+  // The trip ID is only known once the trip has been created.
+  GRSCTripSpan *span = [_tripTracer startSpanWithName:kCreateTripSpanName tripID:nil];
 
   [_providerService createTripWithPickup:pickupLocation
                 intermediateDestinations:intermediateDestinations
                                  dropoff:dropoffLocation
                             isSharedTrip:_isTripShared
                               completion:^(NSString *_Nullable tripName, NSError *_Nullable error) {
+                                // Trip names end with the trip ID.
+                                span.tripID = tripName.lastPathComponent;
+                                [span end];
                                 if (!error) {
                                   [self setActiveTrip:tripName];
                                 } else {
@@ -575,10 +594,12 @@ typedef NS_ENUM(NSUInteger, GRSCMapViewCustomerState) {
 /** Ends monitoring a completed trip. */
 - (void)endCompletedTrip {
   // End trip monitoring after 5 seconds. Will go back to the initial request ride screen.
-  dispatch_after(  // go/dispatch-after-considered-harmful
-      dispatch_time(DISPATCH_TIME_NOW, 5 * NSEC_PER_SEC), dispatch_get_main_queue(), ^{
-        [self endCurrentTrip];
-      });
+  __weak __typeof(self) weakSelf = self;
+  [_clock scheduleTimerWithInterval:5
+                            repeats:NO
+                              block:^{
+                                [weakSelf endCurrentTrip];
+                              }];
 }
 
 /** Updates the bottom panel to show the details of a completed trip. */
@@ -624,6 +645,10 @@ typedef NS_ENUM(NSUInteger, GRSCMapViewCustomerState) {
 
 /** Called when the current trip status has been updated. */
 - (void)tripModel:(GMTCTripModel *)tripModel didUpdateTripStatus:(enum GMTSTripStatus)tripStatus {
+  NSString *tripID = tripModel.currentTrip.tripID;
+  if (tripID) {
+    [_tripTracer recordEventWithName:kTripStatusSpanName tripID:tripID tripStatus:tripStatus];
+  }
   switch (tripStatus) {
     case GMTSTripStatusComplete:
       [self handleTripCompletion];
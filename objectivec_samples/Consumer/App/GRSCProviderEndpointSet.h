@@ -0,0 +1,95 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#import <Foundation/Foundation.h>
+
+/** A request routed to a provider replica by a @c GRSCProviderEndpointSet. */
+@interface GRSCRoutedProviderRequest : NSObject
+
+/** The request, pointed at the replica it was routed to. */
+@property(nonatomic, copy, readonly, nonnull) NSURLRequest *request;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
+
+@end
+
+/**
+ * A set of provider replicas that requests are spread across, preferring the replicas that are
+ * currently fastest and failing least.
+ *
+ * URLs are built against @c canonicalBaseURL, the first replica, so that caches and request keys
+ * don't depend on which replica serves a request, and are routed to a replica when they are sent.
+ * A routed URL keeps its path relative to the canonical base URL, so replicas may serve the
+ * provider API under different base paths.
+ *
+ * Each request goes to the cheaper of two replicas picked at random ("power of two choices"). A
+ * replica's cost is its exponentially weighted moving average (EWMA) latency, scaled up by the
+ * number of its requests in flight and by its EWMA error rate, so that load shifts away from a
+ * replica as soon as it slows down. A replica that fails @c ejectionFailureCount requests in a row
+ * is ejected for @c ejectionInterval, after which it is given traffic again. If every replica is
+ * ejected, requests are spread across all of them.
+ */
+@interface GRSCProviderEndpointSet : NSObject
+
+/** The base URL that provider URLs are built against. */
+@property(nonatomic, readonly, nonnull) NSURL *canonicalBaseURL;
+
+/** The weight of the most recent request in the EWMA latency and error rate. Defaults to 0.3. */
+@property(nonatomic) double decay;
+
+/** The number of consecutive failures after which a replica is ejected. Defaults to 5. */
+@property(nonatomic) NSUInteger ejectionFailureCount;
+
+/** How long, in seconds, an ejected replica is left without traffic. Defaults to 30 seconds. */
+@property(nonatomic) NSTimeInterval ejectionInterval;
+
+/**
+ * Initializes an instance of this class.
+ *
+ * @param baseURLs The base URLs of the replicas, of which there must be at least one. The first is
+ * the canonical one.
+ */
+- (nonnull instancetype)initWithBaseURLs:(nonnull NSArray<NSURL *> *)baseURLs
+    NS_DESIGNATED_INITIALIZER;
+
+/**
+ * Use @c initWithBaseURLs: instead.
+ */
+- (nonnull instancetype)init NS_UNAVAILABLE;
+
+/** Returns whether the replica with the given base URL is currently ejected. */
+- (BOOL)isBaseURLEjected:(nonnull NSURL *)baseURL;
+
+/**
+ * Picks a replica for a request, and points the request at it.
+ *
+ * @param request The request to route.
+ * @return The routed request, which must be passed to
+ * @c finishRoutedRequest:withResponse:error: once it completes.
+ */
+- (nonnull GRSCRoutedProviderRequest *)routeRequest:(nonnull NSURLRequest *)request;
+
+/**
+ * Records the outcome of a routed request. Requests that were cancelled don't count towards their
+ * replica's latency or error rate.
+ *
+ * @param routedRequest The request returned by @c routeRequest:.
+ * @param response The response to the request, if any.
+ * @param error The error the request failed with, if any.
+ */
+- (void)finishRoutedRequest:(nonnull GRSCRoutedProviderRequest *)routedRequest
+               withResponse:(nullable NSURLResponse *)response
+                      error:(nullable NSError *)error;
+
+@end
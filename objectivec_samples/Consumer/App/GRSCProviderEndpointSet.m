@@ -0,0 +1,227 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#import "GRSCProviderEndpointSet.h"
+
+#import <QuartzCore/QuartzCore.h>
+
+static const double kDefaultDecay = 0.3;
+static const NSUInteger kDefaultEjectionFailureCount = 5;
+static const NSTimeInterval kDefaultEjectionInterval = 30;
+static const double kMinimumSuccessRate = 0.01;
+
+/** The state of one replica. */
+@interface GRSCProviderEndpoint : NSObject
+
+@property(nonatomic, strong, nonnull) NSURL *baseURL;
+/** The EWMA latency, or a negative value until the replica has answered. */
+@property(nonatomic) NSTimeInterval latency;
+@property(nonatomic) double errorRate;
+@property(nonatomic) NSUInteger inFlightCount;
+@property(nonatomic) NSUInteger consecutiveFailureCount;
+@property(nonatomic) CFTimeInterval ejectedUntil;
+/** The cost of sending a request to the replica. A replica that has not answered costs nothing. */
+@property(nonatomic, readonly) double cost;
+
+@end
+
+@implementation GRSCProviderEndpoint
+
+- (double)cost {
+  if (_latency < 0) {
+    return 0;
+  }
+  return _latency * (_inFlightCount + 1) / MAX(1 - _errorRate, kMinimumSuccessRate);
+}
+
+@end
+
+@interface GRSCRoutedProviderRequest ()
+
+@property(nonatomic, strong, nonnull) GRSCProviderEndpoint *endpoint;
+@property(nonatomic) CFTimeInterval startTime;
+
+@end
+
+@implementation GRSCRoutedProviderRequest
+
+- (nonnull instancetype)initWithRequest:(nonnull NSURLRequest *)request
+                               endpoint:(nonnull GRSCProviderEndpoint *)endpoint
+                              startTime:(CFTimeInterval)startTime {
+  self = [super init];
+  if (self) {
+    _request = [request copy];
+    _endpoint = endpoint;
+    _startTime = startTime;
+  }
+  return self;
+}
+
+@end
+
+/** Returns whether a request failed because it was cancelled. */
+static BOOL IsCancellationError(NSError *_Nullable error) {
+  return [error.domain isEqualToString:NSURLErrorDomain] && error.code == NSURLErrorCancelled;
+}
+
+/** Returns the percent-encoded path of a base URL, ending with a slash. */
+static NSString *_Nonnull GetPathPrefix(NSURL *_Nonnull baseURL) {
+  NSString *path = [NSURLComponents componentsWithURL:baseURL
+                              resolvingAgainstBaseURL:YES].percentEncodedPath ?: @"";
+  return [path hasSuffix:@"/"] ? path : [path stringByAppendingString:@"/"];
+}
+
+/**
+ * Moves a path from under the path of @c canonicalBaseURL to under the path of @c baseURL. Paths
+ * outside @c canonicalBaseURL are returned unchanged.
+ */
+static NSString *_Nonnull RebasedPath(NSString *_Nonnull path, NSURL *_Nonnull canonicalBaseURL,
+                                      NSURL *_Nonnull baseURL) {
+  NSString *canonicalPathPrefix = GetPathPrefix(canonicalBaseURL);
+  if (![path hasPrefix:canonicalPathPrefix]) {
+    return path;
+  }
+  return [GetPathPrefix(baseURL)
+      stringByAppendingString:[path substringFromIndex:canonicalPathPrefix.length]];
+}
+
+@implementation GRSCProviderEndpointSet {
+  NSArray<GRSCProviderEndpoint *> *_endpoints;
+}
+
+- (nonnull instancetype)initWithBaseURLs:(nonnull NSArray<NSURL *> *)baseURLs {
+  NSAssert(baseURLs.count, @"An endpoint set needs at least one replica.");
+  self = [super init];
+  if (self) {
+    NSMutableArray<GRSCProviderEndpoint *> *endpoints =
+        [[NSMutableArray alloc] initWithCapacity:baseURLs.count];
+    for (NSURL *baseURL in baseURLs) {
+      GRSCProviderEndpoint *endpoint = [[GRSCProviderEndpoint alloc] init];
+      endpoint.baseURL = baseURL;
+      endpoint.latency = -1;
+      [endpoints addObject:endpoint];
+    }
+    _endpoints = [endpoints copy];
+    _decay = kDefaultDecay;
+    _ejectionFailureCount = kDefaultEjectionFailureCount;
+    _ejectionInterval = kDefaultEjectionInterval;
+  }
+  return self;
+}
+
+- (nonnull NSURL *)canonicalBaseURL {
+  return _endpoints.firstObject.baseURL;
+}
+
+- (BOOL)isBaseURLEjected:(nonnull NSURL *)baseURL {
+  CFTimeInterval now = CACurrentMediaTime();
+  @synchronized(self) {
+    for (GRSCProviderEndpoint *endpoint in _endpoints) {
+      if ([endpoint.baseURL isEqual:baseURL] && endpoint.ejectedUntil > now) {
+        return YES;
+      }
+    }
+    return NO;
+  }
+}
+
+- (nonnull GRSCRoutedProviderRequest *)routeRequest:(nonnull NSURLRequest *)request {
+  CFTimeInterval now = CACurrentMediaTime();
+  GRSCProviderEndpoint *endpoint;
+  @synchronized(self) {
+    endpoint = [self selectEndpointAtTime:now];
+    endpoint.inFlightCount++;
+  }
+
+  NSMutableURLRequest *routedRequest = [request mutableCopy];
+  NSURLComponents *components = [NSURLComponents componentsWithURL:request.URL
+                                           resolvingAgainstBaseURL:YES];
+  if (components) {
+    components.scheme = endpoint.baseURL.scheme;
+    components.host = endpoint.baseURL.host;
+    components.port = endpoint.baseURL.port;
+    components.percentEncodedPath =
+        RebasedPath(components.percentEncodedPath, self.canonicalBaseURL, endpoint.baseURL);
+    routedRequest.URL = components.URL ?: request.URL;
+  }
+  return [[GRSCRoutedProviderRequest alloc] initWithRequest:routedRequest
+                                                   endpoint:endpoint
+                                                  startTime:now];
+}
+
+- (void)finishRoutedRequest:(nonnull GRSCRoutedProviderRequest *)routedRequest
+               withResponse:(nullable NSURLResponse *)response
+                      error:(nullable NSError *)error {
+  CFTimeInterval now = CACurrentMediaTime();
+  GRSCProviderEndpoint *endpoint = routedRequest.endpoint;
+  @synchronized(self) {
+    endpoint.inFlightCount--;
+    if (IsCancellationError(error)) {
+      return;
+    }
+
+    BOOL isFailure = error ? [error.domain isEqualToString:NSURLErrorDomain]
+                           : [(NSHTTPURLResponse *)response statusCode] >= 500;
+    NSTimeInterval latency = now - routedRequest.startTime;
+    endpoint.latency = endpoint.latency < 0
+                           ? latency
+                           : _decay * latency + (1 - _decay) * endpoint.latency;
+    endpoint.errorRate = _decay * (isFailure ? 1 : 0) + (1 - _decay) * endpoint.errorRate;
+    if (!isFailure) {
+      endpoint.consecutiveFailureCount = 0;
+      return;
+    }
+    endpoint.consecutiveFailureCount++;
+    if (endpoint.consecutiveFailureCount >= MAX(_ejectionFailureCount, 1)) {
+      endpoint.ejectedUntil = now + _ejectionInterval;
+      // Give the replica a clean slate once it is given traffic again.
+      endpoint.consecutiveFailureCount = 0;
+      endpoint.errorRate = 0;
+    }
+  }
+}
+
+#pragma mark - Private
+
+/**
+ * Picks the cheaper of two random replicas that aren't ejected. Must be called while synchronized
+ * on self.
+ */
+- (nonnull GRSCProviderEndpoint *)selectEndpointAtTime:(CFTimeInterval)now {
+  NSMutableArray<GRSCProviderEndpoint *> *candidates =
+      [[NSMutableArray alloc] initWithCapacity:_endpoints.count];
+  for (GRSCProviderEndpoint *endpoint in _endpoints) {
+    if (endpoint.ejectedUntil <= now) {
+      [candidates addObject:endpoint];
+    }
+  }
+  if (!candidates.count) {
+    [candidates addObjectsFromArray:_endpoints];
+  }
+  if (candidates.count == 1) {
+    return candidates.firstObject;
+  }
+
+  uint32_t count = (uint32_t)candidates.count;
+  uint32_t firstIndex = arc4random_uniform(count);
+  uint32_t secondIndex = arc4random_uniform(count - 1);
+  if (secondIndex >= firstIndex) {
+    secondIndex++;
+  }
+  GRSCProviderEndpoint *first = candidates[firstIndex];
+  GRSCProviderEndpoint *second = candidates[secondIndex];
+  return first.cost <= second.cost ? first : second;
+}
+
+@end
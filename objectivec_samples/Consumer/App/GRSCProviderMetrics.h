@@ -0,0 +1,171 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#import <Foundation/Foundation.h>
+
+/** A phase of a provider call, which is timed separately. */
+typedef NS_ENUM(NSInteger, GRSCProviderCallPhase) {
+  /** From the call until its request is handed to the network. */
+  GRSCProviderCallPhaseBuild = 0,
+  /** From when the request is handed to the network until its response arrives, with retries. */
+  GRSCProviderCallPhaseNetwork,
+  /** Handling the response, which includes decoding it. */
+  GRSCProviderCallPhaseDecode,
+  /** From when the result of a call is enqueued on the callback queue until its completion runs. */
+  GRSCProviderCallPhaseDispatch,
+};
+
+/**
+ * A histogram of durations, in the style of an HDR histogram.
+ *
+ * Durations are counted in microseconds in log-linear buckets: every power of two is split into 16
+ * buckets, so that percentiles are accurate to within about 3% from a microsecond to several days.
+ * Recording a duration only increments a bucket, and histograms are merged by adding up their
+ * buckets.
+ */
+@interface GRSCLatencyHistogram : NSObject <NSCopying>
+
+/** The number of durations recorded. */
+@property(nonatomic, readonly) uint64_t count;
+
+/** The sum of the durations recorded, in seconds. */
+@property(nonatomic, readonly) NSTimeInterval totalDuration;
+
+/** The longest duration recorded, in seconds. */
+@property(nonatomic, readonly) NSTimeInterval maximumDuration;
+
+/** Records a duration, in seconds. */
+- (void)recordDuration:(NSTimeInterval)duration;
+
+/** Adds the durations recorded by another histogram to this one. */
+- (void)mergeHistogram:(nonnull GRSCLatencyHistogram *)histogram;
+
+/**
+ * Returns the duration, in seconds, that the given percentage of recorded durations are at most, or
+ * 0 if no durations have been recorded.
+ *
+ * @param percentile The percentile, from 0 to 100.
+ */
+- (NSTimeInterval)durationAtPercentile:(double)percentile;
+
+@end
+
+/** The latencies and counters recorded for one provider call. */
+@interface GRSCProviderCallMetrics : NSObject <NSCopying>
+
+/** The number of calls made, which is the number of build phases recorded. */
+@property(nonatomic, readonly) uint64_t callCount;
+
+/** The number of requests sent, including retries and hedges. */
+@property(nonatomic, readonly) uint64_t attemptCount;
+
+/** The number of requests sent as retries or hedges of an earlier request. */
+@property(nonatomic, readonly) uint64_t retryCount;
+
+/** The number of requests that failed without a response. */
+@property(nonatomic, readonly) uint64_t errorCount;
+
+/** The number of conditional requests answered with 304 Not Modified. */
+@property(nonatomic, readonly) uint64_t cacheHitCount;
+
+/** The number of request body bytes sent. */
+@property(nonatomic, readonly) uint64_t bytesSent;
+
+/** The number of response body bytes received. */
+@property(nonatomic, readonly) uint64_t bytesReceived;
+
+/** The number of responses received, keyed by HTTP status code. */
+@property(nonatomic, readonly, nonnull)
+    NSDictionary<NSNumber *, NSNumber *> *statusCodeCounts;
+
+/** Returns the latencies recorded for a phase of the call. */
+- (nonnull GRSCLatencyHistogram *)histogramForPhase:(GRSCProviderCallPhase)phase;
+
+/** Adds the latencies and counters recorded by other metrics to these ones. */
+- (void)mergeMetrics:(nonnull GRSCProviderCallMetrics *)metrics;
+
+@end
+
+@class GRSCProviderMetrics;
+
+/** A destination for provider metrics, such as a log or an analytics backend. */
+@protocol GRSCProviderMetricsSink <NSObject>
+
+/**
+ * Called when metrics are flushed.
+ *
+ * @param metrics The metrics that were flushed.
+ * @param snapshot The metrics recorded since the previous flush, keyed by the name of the call.
+ */
+- (void)providerMetrics:(nonnull GRSCProviderMetrics *)metrics
+       didFlushSnapshot:(nonnull NSDictionary<NSString *, GRSCProviderCallMetrics *> *)snapshot;
+
+@end
+
+/**
+ * Latency histograms and counters for provider calls, keyed by the name of the call.
+ *
+ * Recording is cheap enough to be done on every call: it takes an unfair lock, looks up the call
+ * and increments a few integers, without allocating once the call has been seen. Use @c snapshot to
+ * inspect the metrics, or add a sink and call @c flush to hand them off periodically.
+ */
+@interface GRSCProviderMetrics : NSObject
+
+/** The metrics shared by the provider service and auth token provider. */
++ (nonnull GRSCProviderMetrics *)sharedMetrics;
+
+/** Adds a sink that is handed the metrics on every flush. Sinks are held weakly. */
+- (void)addSink:(nonnull id<GRSCProviderMetricsSink>)sink;
+
+/** Removes a sink added with @c addSink:. */
+- (void)removeSink:(nonnull id<GRSCProviderMetricsSink>)sink;
+
+/** Returns a copy of the metrics recorded since the last flush, keyed by the name of the call. */
+- (nonnull NSDictionary<NSString *, GRSCProviderCallMetrics *> *)snapshot;
+
+/** Hands the metrics recorded since the last flush to the sinks, and starts over. */
+- (void)flush;
+
+/** Records how long a phase of a call took, in seconds. */
+- (void)recordDuration:(NSTimeInterval)duration
+               ofPhase:(GRSCProviderCallPhase)phase
+               forCall:(nonnull NSString *)call;
+
+/**
+ * Records that a request was sent for a call.
+ *
+ * @param request The request that was sent.
+ * @param isRetry Whether the request is a retry or hedge of an earlier request.
+ * @param call The name of the call.
+ */
+- (void)recordAttemptWithRequest:(nonnull NSURLRequest *)request
+                         isRetry:(BOOL)isRetry
+                         forCall:(nonnull NSString *)call;
+
+/**
+ * Records the outcome of a request sent for a call.
+ *
+ * @param response The response to the request, if any.
+ * @param data The response body, if any.
+ * @param error The error the request failed with, if any.
+ * @param request The request that was sent.
+ * @param call The name of the call.
+ */
+- (void)recordResponse:(nullable NSURLResponse *)response
+                  data:(nullable NSData *)data
+                 error:(nullable NSError *)error
+             toRequest:(nonnull NSURLRequest *)request
+               forCall:(nonnull NSString *)call;
+
+@end
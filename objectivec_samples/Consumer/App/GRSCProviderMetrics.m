@@ -0,0 +1,300 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#import "GRSCProviderMetrics.h"
+
+#import <os/lock.h>
+
+// Durations are counted in microseconds. Values below 2^kSubBucketBits each get a bucket, and
+// every larger power of two up to 2^kMaximumValueBits is split into kSubBucketCount buckets.
+enum {
+  kSubBucketBits = 4,
+  kSubBucketCount = 1 << kSubBucketBits,
+  kMaximumValueBits = 40,
+  kBucketCount = kSubBucketCount * (kMaximumValueBits - kSubBucketBits + 1),
+};
+
+static const NSInteger kPhaseCount = GRSCProviderCallPhaseDispatch + 1;
+static const NSInteger kHTTPStatusNotModifiedCode = 304;
+static NSString *const kHTTPIfNoneMatchHeaderField = @"If-None-Match";
+static NSString *const kHTTPIfModifiedSinceHeaderField = @"If-Modified-Since";
+
+/** Returns the bucket that a duration, in microseconds, is counted in. */
+static NSUInteger GetBucketIndex(uint64_t microseconds) {
+  if (microseconds < kSubBucketCount) {
+    return (NSUInteger)microseconds;
+  }
+  microseconds = MIN(microseconds, (1ULL << kMaximumValueBits) - 1);
+  int exponent = 63 - __builtin_clzll(microseconds);
+  uint64_t subBucket = (microseconds >> (exponent - kSubBucketBits)) & (kSubBucketCount - 1);
+  return (NSUInteger)(kSubBucketCount * (exponent - kSubBucketBits + 1) + subBucket);
+}
+
+/** Returns the duration, in microseconds, in the middle of a bucket. */
+static uint64_t GetBucketMidpoint(NSUInteger index) {
+  if (index < kSubBucketCount) {
+    return index;
+  }
+  NSUInteger shift = index / kSubBucketCount - 1;
+  uint64_t lowerBound = (uint64_t)(kSubBucketCount + index % kSubBucketCount) << shift;
+  return lowerBound + ((1ULL << shift) - 1) / 2;
+}
+
+@implementation GRSCLatencyHistogram {
+  uint64_t _bucketCounts[kBucketCount];
+}
+
+- (id)copyWithZone:(nullable NSZone *)zone {
+  GRSCLatencyHistogram *copy = [[GRSCLatencyHistogram alloc] init];
+  [copy mergeHistogram:self];
+  return copy;
+}
+
+- (void)recordDuration:(NSTimeInterval)duration {
+  duration = MAX(duration, 0);
+  // Durations beyond the last bucket are counted in it, so there is no need to convert them.
+  double microseconds = MIN(duration * USEC_PER_SEC, (double)(1ULL << kMaximumValueBits));
+  _bucketCounts[GetBucketIndex((uint64_t)microseconds)]++;
+  _count++;
+  _totalDuration += duration;
+  _maximumDuration = MAX(_maximumDuration, duration);
+}
+
+- (void)mergeHistogram:(nonnull GRSCLatencyHistogram *)histogram {
+  for (NSUInteger i = 0; i < kBucketCount; i++) {
+    _bucketCounts[i] += histogram->_bucketCounts[i];
+  }
+  _count += histogram.count;
+  _totalDuration += histogram.totalDuration;
+  _maximumDuration = MAX(_maximumDuration, histogram.maximumDuration);
+}
+
+- (NSTimeInterval)durationAtPercentile:(double)percentile {
+  if (!_count) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)ceil(MIN(MAX(percentile, 0), 100) / 100 * _count);
+  rank = MAX(rank, 1);
+  uint64_t cumulativeCount = 0;
+  for (NSUInteger i = 0; i < kBucketCount; i++) {
+    cumulativeCount += _bucketCounts[i];
+    if (cumulativeCount >= rank) {
+      NSTimeInterval duration = (NSTimeInterval)GetBucketMidpoint(i) / USEC_PER_SEC;
+      return MIN(duration, _maximumDuration);
+    }
+  }
+  return _maximumDuration;
+}
+
+@end
+
+@interface GRSCProviderCallMetrics ()
+
+/** Records that a request was sent. */
+- (void)recordAttemptWithRequest:(nonnull NSURLRequest *)request isRetry:(BOOL)isRetry;
+
+/** Records the outcome of a request. */
+- (void)recordResponse:(nullable NSURLResponse *)response
+                  data:(nullable NSData *)data
+                 error:(nullable NSError *)error
+             toRequest:(nonnull NSURLRequest *)request;
+
+@end
+
+@implementation GRSCProviderCallMetrics {
+  NSArray<GRSCLatencyHistogram *> *_histograms;
+  NSMutableDictionary<NSNumber *, NSNumber *> *_statusCodeCounts;
+}
+
+- (instancetype)init {
+  self = [super init];
+  if (self) {
+    NSMutableArray<GRSCLatencyHistogram *> *histograms =
+        [[NSMutableArray alloc] initWithCapacity:kPhaseCount];
+    for (NSInteger phase = 0; phase < kPhaseCount; phase++) {
+      [histograms addObject:[[GRSCLatencyHistogram alloc] init]];
+    }
+    _histograms = [histograms copy];
+    _statusCodeCounts = [[NSMutableDictionary alloc] init];
+  }
+  return self;
+}
+
+- (id)copyWithZone:(nullable NSZone *)zone {
+  GRSCProviderCallMetrics *copy = [[GRSCProviderCallMetrics alloc] init];
+  [copy mergeMetrics:self];
+  return copy;
+}
+
+- (uint64_t)callCount {
+  return [self histogramForPhase:GRSCProviderCallPhaseBuild].count;
+}
+
+- (nonnull NSDictionary<NSNumber *, NSNumber *> *)statusCodeCounts {
+  return [_statusCodeCounts copy];
+}
+
+- (nonnull GRSCLatencyHistogram *)histogramForPhase:(GRSCProviderCallPhase)phase {
+  return _histograms[phase];
+}
+
+- (void)mergeMetrics:(nonnull GRSCProviderCallMetrics *)metrics {
+  for (NSInteger phase = 0; phase < kPhaseCount; phase++) {
+    [_histograms[phase] mergeHistogram:metrics->_histograms[phase]];
+  }
+  _attemptCount += metrics.attemptCount;
+  _retryCount += metrics.retryCount;
+  _errorCount += metrics.errorCount;
+  _cacheHitCount += metrics.cacheHitCount;
+  _bytesSent += metrics.bytesSent;
+  _bytesReceived += metrics.bytesReceived;
+  [metrics->_statusCodeCounts
+      enumerateKeysAndObjectsUsingBlock:^(NSNumber *statusCode, NSNumber *count, BOOL *stop) {
+        [self addCount:count.unsignedLongLongValue forStatusCode:statusCode.integerValue];
+      }];
+}
+
+#pragma mark - Recording
+
+- (void)recordAttemptWithRequest:(nonnull NSURLRequest *)request isRetry:(BOOL)isRetry {
+  _attemptCount++;
+  if (isRetry) {
+    _retryCount++;
+  }
+  _bytesSent += request.HTTPBody.length;
+}
+
+- (void)recordResponse:(nullable NSURLResponse *)response
+                  data:(nullable NSData *)data
+                 error:(nullable NSError *)error
+             toRequest:(nonnull NSURLRequest *)request {
+  _bytesReceived += data.length;
+  if (![response isKindOfClass:[NSHTTPURLResponse class]]) {
+    if (error) {
+      _errorCount++;
+    }
+    return;
+  }
+  NSInteger statusCode = ((NSHTTPURLResponse *)response).statusCode;
+  [self addCount:1 forStatusCode:statusCode];
+  if (statusCode == kHTTPStatusNotModifiedCode &&
+      ([request valueForHTTPHeaderField:kHTTPIfNoneMatchHeaderField] ||
+       [request valueForHTTPHeaderField:kHTTPIfModifiedSinceHeaderField])) {
+    _cacheHitCount++;
+  }
+}
+
+- (void)addCount:(uint64_t)count forStatusCode:(NSInteger)statusCode {
+  NSNumber *key = @(statusCode);
+  _statusCodeCounts[key] = @(_statusCodeCounts[key].unsignedLongLongValue + count);
+}
+
+@end
+
+@implementation GRSCProviderMetrics {
+  os_unfair_lock _lock;
+  NSMutableDictionary<NSString *, GRSCProviderCallMetrics *> *_metricsByCall;
+  NSHashTable<id<GRSCProviderMetricsSink>> *_sinks;
+}
+
++ (nonnull GRSCProviderMetrics *)sharedMetrics {
+  static GRSCProviderMetrics *sharedMetrics;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    sharedMetrics = [[GRSCProviderMetrics alloc] init];
+  });
+  return sharedMetrics;
+}
+
+- (instancetype)init {
+  self = [super init];
+  if (self) {
+    _lock = OS_UNFAIR_LOCK_INIT;
+    _metricsByCall = [[NSMutableDictionary alloc] init];
+    _sinks = [NSHashTable weakObjectsHashTable];
+  }
+  return self;
+}
+
+- (void)addSink:(nonnull id<GRSCProviderMetricsSink>)sink {
+  os_unfair_lock_lock(&_lock);
+  [_sinks addObject:sink];
+  os_unfair_lock_unlock(&_lock);
+}
+
+- (void)removeSink:(nonnull id<GRSCProviderMetricsSink>)sink {
+  os_unfair_lock_lock(&_lock);
+  [_sinks removeObject:sink];
+  os_unfair_lock_unlock(&_lock);
+}
+
+- (nonnull NSDictionary<NSString *, GRSCProviderCallMetrics *> *)snapshot {
+  os_unfair_lock_lock(&_lock);
+  NSDictionary<NSString *, GRSCProviderCallMetrics *> *snapshot =
+      [[NSDictionary alloc] initWithDictionary:_metricsByCall copyItems:YES];
+  os_unfair_lock_unlock(&_lock);
+  return snapshot;
+}
+
+- (void)flush {
+  os_unfair_lock_lock(&_lock);
+  NSDictionary<NSString *, GRSCProviderCallMetrics *> *snapshot = [_metricsByCall copy];
+  [_metricsByCall removeAllObjects];
+  NSArray<id<GRSCProviderMetricsSink>> *sinks = _sinks.allObjects;
+  os_unfair_lock_unlock(&_lock);
+
+  for (id<GRSCProviderMetricsSink> sink in sinks) {
+    [sink providerMetrics:self didFlushSnapshot:snapshot];
+  }
+}
+
+- (void)recordDuration:(NSTimeInterval)duration
+               ofPhase:(GRSCProviderCallPhase)phase
+               forCall:(nonnull NSString *)call {
+  os_unfair_lock_lock(&_lock);
+  [[[self metricsForCall:call] histogramForPhase:phase] recordDuration:duration];
+  os_unfair_lock_unlock(&_lock);
+}
+
+- (void)recordAttemptWithRequest:(nonnull NSURLRequest *)request
+                         isRetry:(BOOL)isRetry
+                         forCall:(nonnull NSString *)call {
+  os_unfair_lock_lock(&_lock);
+  [[self metricsForCall:call] recordAttemptWithRequest:request isRetry:isRetry];
+  os_unfair_lock_unlock(&_lock);
+}
+
+- (void)recordResponse:(nullable NSURLResponse *)response
+                  data:(nullable NSData *)data
+                 error:(nullable NSError *)error
+             toRequest:(nonnull NSURLRequest *)request
+               forCall:(nonnull NSString *)call {
+  os_unfair_lock_lock(&_lock);
+  [[self metricsForCall:call] recordResponse:response data:data error:error toRequest:request];
+  os_unfair_lock_unlock(&_lock);
+}
+
+#pragma mark - Private
+
+/** Returns the metrics of a call, adding them if needed. Must be called while holding the lock. */
+- (nonnull GRSCProviderCallMetrics *)metricsForCall:(nonnull NSString *)call {
+  GRSCProviderCallMetrics *metrics = _metricsByCall[call];
+  if (!metrics) {
+    metrics = [[GRSCProviderCallMetrics alloc] init];
+    _metricsByCall[[call copy]] = metrics;
+  }
+  return metrics;
+}
+
+@end
@@ -0,0 +1,369 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#import "GRSCProviderRetryPolicy.h"
+
+#import <QuartzCore/QuartzCore.h>
+
+static const NSUInteger kDefaultMaximumAttempts = 3;
+static const NSTimeInterval kDefaultBaseRetryDelay = 0.1;
+static const NSTimeInterval kDefaultMaximumRetryDelay = 2;
+static const double kDefaultRetryBudgetRatio = 0.2;
+static const double kDefaultMaximumRetryBudget = 10;
+
+/** The number of recent latencies of each hedge key that its hedge delay is computed from. */
+enum { kLatencySampleCapacity = 128 };
+/** The number of latencies of a hedge key that must be observed before its requests are hedged. */
+static const NSUInteger kMinimumLatencySampleCount = 20;
+static const double kHedgeLatencyPercentile = 0.95;
+
+/** Returns whether an attempt failed with a network error that a later attempt may not hit. */
+static BOOL IsRetryableError(NSError *_Nullable error) {
+  if (![error.domain isEqualToString:NSURLErrorDomain]) {
+    return NO;
+  }
+  switch (error.code) {
+    case NSURLErrorTimedOut:
+    case NSURLErrorCannotFindHost:
+    case NSURLErrorCannotConnectToHost:
+    case NSURLErrorNetworkConnectionLost:
+    case NSURLErrorDNSLookupFailed:
+    case NSURLErrorNotConnectedToInternet:
+      return YES;
+    default:
+      return NO;
+  }
+}
+
+/** Returns whether the provider answered with a status that a later attempt may not get. */
+static BOOL IsRetryableResponse(NSURLResponse *_Nullable response) {
+  if (![response isKindOfClass:[NSHTTPURLResponse class]]) {
+    return NO;
+  }
+  switch (((NSHTTPURLResponse *)response).statusCode) {
+    case 408:
+    case 429:
+    case 500:
+    case 502:
+    case 503:
+    case 504:
+      return YES;
+    default:
+      return NO;
+  }
+}
+
+/** Returns whether an attempt was cancelled, such as by a newer request for the same resource. */
+static BOOL IsCancellationError(NSError *_Nullable error) {
+  return [error.domain isEqualToString:NSURLErrorDomain] && error.code == NSURLErrorCancelled;
+}
+
+static int CompareLatencies(const void *lhs, const void *rhs) {
+  NSTimeInterval lhsLatency = *(const NSTimeInterval *)lhs;
+  NSTimeInterval rhsLatency = *(const NSTimeInterval *)rhs;
+  return lhsLatency < rhsLatency ? -1 : lhsLatency > rhsLatency;
+}
+
+/** A ring buffer of the latencies of recent successful attempts with the same hedge key. */
+@interface GRSCProviderLatencySamples : NSObject
+
+/** Records the latency of an attempt, in place of the oldest one once the buffer is full. */
+- (void)recordLatency:(NSTimeInterval)latency;
+
+/** Returns the latency at a percentile, or 0 until enough latencies have been recorded. */
+- (NSTimeInterval)latencyAtPercentile:(double)percentile;
+
+@end
+
+@implementation GRSCProviderLatencySamples {
+  NSTimeInterval _latencies[kLatencySampleCapacity];
+  NSUInteger _count;
+  NSUInteger _nextIndex;
+}
+
+- (void)recordLatency:(NSTimeInterval)latency {
+  _latencies[_nextIndex] = latency;
+  _nextIndex = (_nextIndex + 1) % kLatencySampleCapacity;
+  _count = MIN(_count + 1, (NSUInteger)kLatencySampleCapacity);
+}
+
+- (NSTimeInterval)latencyAtPercentile:(double)percentile {
+  if (_count < kMinimumLatencySampleCount) {
+    return 0;
+  }
+  NSTimeInterval sortedLatencies[kLatencySampleCapacity];
+  memcpy(sortedLatencies, _latencies, _count * sizeof(NSTimeInterval));
+  qsort(sortedLatencies, _count, sizeof(NSTimeInterval), CompareLatencies);
+  return sortedLatencies[(NSUInteger)ceil((_count - 1) * percentile)];
+}
+
+@end
+
+/** A request being retried, along with the state of its attempts in flight. */
+@interface GRSCProviderRetryOperation : NSObject
+
+@property(nonatomic) GRSCProviderRetryMode retryMode;
+@property(nonatomic, copy, nullable) NSString *hedgeKey;
+@property(nonatomic, copy) GRSCProviderRequestAttempt attempt;
+@property(nonatomic, copy) GRSCProviderResponseHandler completionHandler;
+/** The number of attempts started, not counting hedges. */
+@property(nonatomic) NSUInteger attemptCount;
+/** The number of attempts in flight for the current attempt, including its hedge. */
+@property(nonatomic) NSUInteger inFlightCount;
+/** Cancels the attempts in flight for the current attempt, once one of them is used. */
+@property(nonatomic, strong) NSMutableArray<GRSCProviderRequestCancellation> *cancellations;
+/** The failure of an attempt whose hedge is still in flight. */
+@property(nonatomic, strong, nullable) NSData *failureData;
+@property(nonatomic, strong, nullable) NSURLResponse *failureResponse;
+@property(nonatomic, strong, nullable) NSError *failureError;
+@property(nonatomic, getter=isFinished) BOOL finished;
+
+@end
+
+@implementation GRSCProviderRetryOperation
+@end
+
+@implementation GRSCProviderRetryPolicy {
+  double _retryBudget;
+  NSMutableDictionary<NSString *, GRSCProviderLatencySamples *> *_latencySamplesByHedgeKey;
+}
+
+- (instancetype)init {
+  self = [super init];
+  if (self) {
+    _maximumAttempts = kDefaultMaximumAttempts;
+    _baseRetryDelay = kDefaultBaseRetryDelay;
+    _maximumRetryDelay = kDefaultMaximumRetryDelay;
+    _retryBudgetRatio = kDefaultRetryBudgetRatio;
+    _maximumRetryBudget = kDefaultMaximumRetryBudget;
+    _retryBudget = kDefaultMaximumRetryBudget;
+    _latencySamplesByHedgeKey = [[NSMutableDictionary alloc] init];
+  }
+  return self;
+}
+
+- (NSTimeInterval)hedgeDelayForKey:(NSString *)hedgeKey {
+  @synchronized(self) {
+    return [_latencySamplesByHedgeKey[hedgeKey] latencyAtPercentile:kHedgeLatencyPercentile];
+  }
+}
+
+- (GRSCProviderRequestCancellation)
+    performRequestWithRetryMode:(GRSCProviderRetryMode)retryMode
+                       hedgeKey:(nullable NSString *)hedgeKey
+                        attempt:(GRSCProviderRequestAttempt)attempt
+              completionHandler:(GRSCProviderResponseHandler)completionHandler {
+  if (retryMode == GRSCProviderRetryModeNone) {
+    GRSCProviderRequestCancellation cancellation = attempt(YES, completionHandler);
+    return cancellation ?: ^{
+    };
+  }
+
+  @synchronized(self) {
+    _retryBudget = MIN(_retryBudget + _retryBudgetRatio, _maximumRetryBudget);
+  }
+  GRSCProviderRetryOperation *operation = [[GRSCProviderRetryOperation alloc] init];
+  operation.retryMode = retryMode;
+  operation.hedgeKey = hedgeKey;
+  operation.attempt = attempt;
+  operation.completionHandler = completionHandler;
+  [self startAttemptOfOperation:operation];
+  __weak typeof(self) weakSelf = self;
+  return ^{
+    [weakSelf cancelOperation:operation];
+  };
+}
+
+#pragma mark - Private
+
+/**
+ * Cancels an operation along with its attempts in flight and a retry it is waiting to start, and
+ * completes it with an @c NSURLErrorCancelled error.
+ */
+- (void)cancelOperation:(GRSCProviderRetryOperation *)operation {
+  NSArray<GRSCProviderRequestCancellation> *cancellations;
+  @synchronized(operation) {
+    if (operation.isFinished) {
+      return;
+    }
+    operation.finished = YES;
+    cancellations = [operation.cancellations copy];
+    [operation.cancellations removeAllObjects];
+  }
+  for (GRSCProviderRequestCancellation cancellation in cancellations) {
+    cancellation();
+  }
+  NSError *error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil];
+  dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+    operation.completionHandler(nil, nil, error);
+  });
+}
+
+/** Starts the next attempt of an operation, and schedules its hedge if the operation is hedged. */
+- (void)startAttemptOfOperation:(GRSCProviderRetryOperation *)operation {
+  NSUInteger attemptCount;
+  @synchronized(operation) {
+    // The operation may have been cancelled while it waited to retry.
+    if (operation.isFinished) {
+      return;
+    }
+    attemptCount = ++operation.attemptCount;
+    operation.inFlightCount = 1;
+    operation.cancellations = [[NSMutableArray alloc] init];
+    operation.failureData = nil;
+    operation.failureResponse = nil;
+    operation.failureError = nil;
+  }
+  [self sendAttemptOfOperation:operation attemptCount:attemptCount isHedge:NO];
+
+  NSString *hedgeKey = operation.hedgeKey;
+  NSTimeInterval hedgeDelay =
+      operation.retryMode == GRSCProviderRetryModeRetryAndHedge && self.hedgingEnabled && hedgeKey
+          ? [self hedgeDelayForKey:hedgeKey]
+          : 0;
+  if (hedgeDelay <= 0) {
+    return;
+  }
+  dispatch_after(
+      dispatch_time(DISPATCH_TIME_NOW, (int64_t)(hedgeDelay * NSEC_PER_SEC)),
+      dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        @synchronized(operation) {
+          // Only hedge an attempt that is still the only one in flight.
+          if (operation.isFinished || operation.attemptCount != attemptCount ||
+              operation.inFlightCount != 1 || ![self withdrawRetryBudget]) {
+            return;
+          }
+          operation.inFlightCount++;
+        }
+        [self sendAttemptOfOperation:operation attemptCount:attemptCount isHedge:YES];
+      });
+}
+
+- (void)sendAttemptOfOperation:(GRSCProviderRetryOperation *)operation
+                  attemptCount:(NSUInteger)attemptCount
+                       isHedge:(BOOL)isHedge {
+  CFTimeInterval startTime = CACurrentMediaTime();
+  BOOL isFirstAttempt = attemptCount == 1 && !isHedge;
+  GRSCProviderRequestCancellation cancellation =
+      operation.attempt(isFirstAttempt, ^(NSData *data, NSURLResponse *response, NSError *error) {
+        [self finishAttemptOfOperation:operation
+                          attemptCount:attemptCount
+                              duration:CACurrentMediaTime() - startTime
+                                  data:data
+                              response:response
+                                 error:error];
+      });
+  if (!cancellation) {
+    return;
+  }
+  @synchronized(operation) {
+    // The attempt may already have been superseded by the other one.
+    if (!operation.isFinished && operation.attemptCount == attemptCount) {
+      [operation.cancellations addObject:cancellation];
+      return;
+    }
+  }
+  cancellation();
+}
+
+- (void)finishAttemptOfOperation:(GRSCProviderRetryOperation *)operation
+                    attemptCount:(NSUInteger)attemptCount
+                        duration:(CFTimeInterval)duration
+                            data:(nullable NSData *)data
+                        response:(nullable NSURLResponse *)response
+                           error:(nullable NSError *)error {
+  BOOL isRetryable = IsRetryableError(error) || IsRetryableResponse(response);
+  if (!isRetryable && !error && operation.hedgeKey) {
+    [self recordLatency:duration forHedgeKey:operation.hedgeKey];
+  }
+
+  BOOL shouldRetry = NO;
+  NSArray<GRSCProviderRequestCancellation> *cancellations;
+  @synchronized(operation) {
+    // The slower attempt of a hedged pair is ignored.
+    if (operation.isFinished || operation.attemptCount != attemptCount) {
+      return;
+    }
+    operation.inFlightCount--;
+    if ((isRetryable || error) && !IsCancellationError(error)) {
+      // Report a failure that isn't retryable in preference to one that is.
+      if (operation.failureResponse || operation.failureError) {
+        if (!IsRetryableError(operation.failureError) &&
+            !IsRetryableResponse(operation.failureResponse)) {
+          data = operation.failureData;
+          response = operation.failureResponse;
+          error = operation.failureError;
+          isRetryable = NO;
+        }
+      }
+      operation.failureData = data;
+      operation.failureResponse = response;
+      operation.failureError = error;
+      if (operation.inFlightCount > 0) {
+        // Wait for the other attempt in flight.
+        return;
+      }
+    }
+    shouldRetry = isRetryable && operation.attemptCount < _maximumAttempts &&
+                  [self withdrawRetryBudget];
+    operation.finished = !shouldRetry;
+    cancellations = [operation.cancellations copy];
+    [operation.cancellations removeAllObjects];
+  }
+
+  if (!shouldRetry) {
+    // The other attempt in flight, if any, is no longer needed.
+    for (GRSCProviderRequestCancellation cancellation in cancellations) {
+      cancellation();
+    }
+    operation.completionHandler(data, response, error);
+    return;
+  }
+  NSTimeInterval retryDelay = [self retryDelayAfterAttemptCount:attemptCount];
+  dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(retryDelay * NSEC_PER_SEC)),
+                 dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+                   [self startAttemptOfOperation:operation];
+                 });
+}
+
+/** Returns a random delay before the retry that follows the given number of attempts. */
+- (NSTimeInterval)retryDelayAfterAttemptCount:(NSUInteger)attemptCount {
+  NSTimeInterval maximumDelay =
+      MIN(_baseRetryDelay * pow(2, attemptCount - 1), _maximumRetryDelay);
+  return maximumDelay * ((double)arc4random() / UINT32_MAX);
+}
+
+/** Takes a retry out of the retry budget. Returns NO if the budget is exhausted. */
+- (BOOL)withdrawRetryBudget {
+  @synchronized(self) {
+    if (_retryBudget < 1) {
+      return NO;
+    }
+    _retryBudget -= 1;
+    return YES;
+  }
+}
+
+- (void)recordLatency:(NSTimeInterval)latency forHedgeKey:(NSString *)hedgeKey {
+  @synchronized(self) {
+    GRSCProviderLatencySamples *latencySamples = _latencySamplesByHedgeKey[hedgeKey];
+    if (!latencySamples) {
+      latencySamples = [[GRSCProviderLatencySamples alloc] init];
+      _latencySamplesByHedgeKey[hedgeKey] = latencySamples;
+    }
+    [latencySamples recordLatency:latency];
+  }
+}
+
+@end
@@ -17,6 +17,10 @@
 
 #import <GoogleRidesharingConsumer/GoogleRidesharingConsumer.h>
 
+@class GRSCProviderMetrics;
+@class GRSCProviderRetryPolicy;
+@class GRSCTripTracer;
+
 /**
  * Completion handler type definition for the createTripWithPickup process.
  *
@@ -40,6 +44,31 @@ typedef void (^GRSCCancelTripCompletionHandler)(NSError *_Nullable error);
  */
 @interface GRSCProviderService : NSObject
 
+/**
+ * The queue that completion blocks are called on once a response has been decoded. Defaults to the
+ * main queue.
+ */
+@property(nonatomic, nonnull) dispatch_queue_t callbackQueue;
+
+/**
+ * Policy that retries failed provider requests. Trip cancellations are retried, while trip creation
+ * is sent only once since a retry could create a second trip.
+ */
+@property(nonatomic, readonly, nonnull) GRSCProviderRetryPolicy *retryPolicy;
+
+/**
+ * Latency histograms and counters of provider calls, keyed by the name of the call. The build,
+ * network, decode and dispatch phases of every call are timed, and every attempt's bytes and status
+ * code are counted. Defaults to the shared metrics, which the auth token provider also records to.
+ */
+@property(nonatomic, readonly, nonnull) GRSCProviderMetrics *metrics;
+
+/**
+ * Tracer whose trace context is sent with trip cancellations, so that the provider can attribute
+ * them to the step of the trip that made them. Defaults to the shared tracer.
+ */
+@property(nonatomic, readonly, nonnull) GRSCTripTracer *tripTracer;
+
 /**
  * Creates an exclusive single ride trip.
  *
@@ -15,7 +15,12 @@
 
 #import "GRSCProviderService.h"
 
+#import <QuartzCore/QuartzCore.h>
+
+#import "GRSCProviderMetrics.h"
+#import "GRSCProviderRetryPolicy.h"
 #import "GRSCProviderUtils.h"
+#import "GRSCTripTracer.h"
 
 // Provider URL Strings.
 static NSString *const kGRSCProviderCreateTripURLString = @"/trip/new";
@@ -39,8 +44,6 @@ static NSString *const kGRSCTripNameKey = @"name";
 static NSInteger const kGRSCHTTPSuccessCode = 200;
 static NSString *const kGRSCHTTPMethodPOST = @"POST";
 static NSString *const kGRSCHTTPMethodPUT = @"PUT";
-static NSString *const kGRSCHTTPContentTypeHeaderField = @"Content-Type";
-static NSString *const kGRSCHTTPJSONContentType = @"application/json";
 
 // Error descriptions.
 static NSString *const kExpectedFieldsNotFoundErrorDescription =
@@ -76,18 +79,6 @@ static NSArray *_Nonnull GetLocationsArrayFromIntermediateDestinations(
   return locationsArray;
 }
 
-/** Returns a JSON formatted NSURLRequest. */
-static NSURLRequest *_Nonnull GetJSONRequest(NSURL *_Nonnull URL,
-                                             NSDictionary<NSString *, id> *_Nonnull requestBody,
-                                             NSString *_Nonnull method) {
-  NSData *JSONData = [NSJSONSerialization dataWithJSONObject:requestBody options:0 error:nil];
-  NSMutableURLRequest *request = [[NSMutableURLRequest alloc] initWithURL:URL];
-  request.HTTPMethod = method;
-  [request setValue:kGRSCHTTPJSONContentType forHTTPHeaderField:kGRSCHTTPContentTypeHeaderField];
-  request.HTTPBody = JSONData;
-  return request;
-}
-
 /** Returns the update trip status provider URL with the given tripID appended. */
 static NSURL *_Nullable GetProviderUpdateTripStatusURLWithTripID(NSString *_Nonnull tripID) {
   NSURL *providerURL = GRSCProviderURLWithPath(kGRSCProviderUpdateTripStatusURLString);
@@ -106,6 +97,10 @@ static NSURL *_Nullable GetProviderUpdateTripStatusURLWithTripID(NSString *_Nonn
   self = [super init];
   if (self) {
     _session = session;
+    _callbackQueue = dispatch_get_main_queue();
+    _retryPolicy = [[GRSCProviderRetryPolicy alloc] init];
+    _metrics = [GRSCProviderMetrics sharedMetrics];
+    _tripTracer = [GRSCTripTracer sharedTracer];
   }
   return self;
 }
@@ -115,6 +110,7 @@ static NSURL *_Nullable GetProviderUpdateTripStatusURLWithTripID(NSString *_Nonn
                      dropoff:(nonnull GMTSTerminalLocation *)dropoff
                 isSharedTrip:(BOOL)isSharedTrip
                   completion:(nonnull GRSCCreateTripCompletionHandler)completion {
+  CFTimeInterval startTime = CACurrentMediaTime();
   NSURL *requestURL = GRSCProviderURLWithPath(kGRSCProviderCreateTripURLString);
 
   if (!requestURL) {
@@ -138,54 +134,61 @@ static NSURL *_Nullable GetProviderUpdateTripStatusURLWithTripID(NSString *_Nonn
   NSString *tripType = isSharedTrip ? kGRSCTripTypeSharedKey : kGRSCTripTypeExclusiveKey;
   [requestBody setObject:tripType forKey:kGRSCTripTypeKey];
 
-  NSURLRequest *request = GetJSONRequest(requestURL, requestBody, kGRSCHTTPMethodPOST);
+  NSURLRequest *request = GRSCProviderRequest(requestURL, kGRSCHTTPMethodPOST, requestBody);
 
+  // The response is decoded on the session's delegate queue, and only the result is delivered on
+  // the callback queue.
+  dispatch_queue_t callbackQueue = _callbackQueue;
+  GRSCProviderMetrics *metrics = _metrics;
+  NSString *callName = NSStringFromSelector(_cmd);
   GRSCProviderResponseHandler createTripServerResponseHandler =
       ^(NSData *data, NSURLResponse *response, NSError *error) {
-        if (error) {
-          completion(nil, error);
-        } else {
+        CFTimeInterval responseTime = CACurrentMediaTime();
+        NSString *tripNameString;
+        NSError *resultError = error;
+        if (!error) {
           NSError *JSONError;
-          // Process JSON response.
+          // Process JSON or property list response.
           GRSCProviderFieldsDictionary *responseDictionary =
-              GRSCGetDictionaryFromJSONData(data, &JSONError);
-          if (JSONError) {
-            dispatch_async(dispatch_get_main_queue(), ^{
-              completion(nil, JSONError);
-            });
-            return;
-          }
-          if (!responseDictionary) {
-            dispatch_async(dispatch_get_main_queue(), ^{
-              completion(nil, nil);
-            });
-            return;
-          }
+              GRSCGetDictionaryFromResponse(data, response, &JSONError);
           id tripName = responseDictionary[kGRSCTripNameKey];
-          if (!tripName) {
+          if (JSONError) {
+            resultError = JSONError;
+          } else if (!responseDictionary) {
+            resultError = nil;
+          } else if (!tripName) {
             // Could not find tripName or matchID in response
-            completion(nil, GRSCError(kExpectedFieldsNotFoundErrorDescription));
-            return;
+            resultError = GRSCError(kExpectedFieldsNotFoundErrorDescription);
           } else if (![tripName isKindOfClass:[NSString class]]) {
             // Invalid class type for tripName
-            completion(nil, GRSCError(kGRSCUnexpectedJSONClassTypeErrorDescription));
-            return;
+            resultError = GRSCError(kGRSCUnexpectedJSONClassTypeErrorDescription);
           } else {
-            NSString *tripNameString = (NSString *)tripName;
-            dispatch_async(dispatch_get_main_queue(), ^{
-              completion(tripNameString, nil);
-            });
+            tripNameString = (NSString *)tripName;
           }
         }
+        CFTimeInterval decodedTime = CACurrentMediaTime();
+        [metrics recordDuration:decodedTime - responseTime
+                        ofPhase:GRSCProviderCallPhaseDecode
+                        forCall:callName];
+        dispatch_async(callbackQueue, ^{
+          [metrics recordDuration:CACurrentMediaTime() - decodedTime
+                          ofPhase:GRSCProviderCallPhaseDispatch
+                          forCall:callName];
+          completion(tripNameString, resultError);
+        });
       };
 
-  NSURLSessionDataTask *task = [_session dataTaskWithRequest:request
-                                           completionHandler:createTripServerResponseHandler];
-  [task resume];
+  // Trip creation isn't retried, since a retry could create a second trip.
+  [self sendRequest:request
+                forCall:_cmd
+              startTime:startTime
+              retryMode:GRSCProviderRetryModeNone
+      completionHandler:createTripServerResponseHandler];
 }
 
 - (void)cancelTripWithTripID:(nonnull NSString *)tripID
                   completion:(nonnull GRSCCancelTripCompletionHandler)completion {
+  CFTimeInterval startTime = CACurrentMediaTime();
   NSURL *requestURL = GetProviderUpdateTripStatusURLWithTripID(tripID);
 
   if (!requestURL) {
@@ -196,10 +199,17 @@ static NSURL *_Nullable GetProviderUpdateTripStatusURLWithTripID(NSString *_Nonn
   NSDictionary<NSString *, NSString *> *requestBody =
       @{kGRSCStatusKey : kGRSCTripStatusCanceled};
 
-  NSURLRequest *request = GetJSONRequest(requestURL, requestBody, kGRSCHTTPMethodPUT);
+  NSMutableURLRequest *request =
+      [GRSCProviderRequest(requestURL, kGRSCHTTPMethodPUT, requestBody) mutableCopy];
+  [request setValue:[_tripTracer traceHeaderValueForTripID:tripID]
+      forHTTPHeaderField:GRSCTripTraceHeaderField];
 
+  dispatch_queue_t callbackQueue = _callbackQueue;
+  GRSCProviderMetrics *metrics = _metrics;
+  NSString *callName = NSStringFromSelector(_cmd);
   GRSCProviderResponseHandler cancelTripServerResponseHandler =
       ^(NSData *data, NSURLResponse *response, NSError *error) {
+        CFTimeInterval responseTime = CACurrentMediaTime();
         if (!error) {
           // Validate HTTP response status code.
           NSInteger statusCode = [(NSHTTPURLResponse *)response statusCode];
@@ -207,12 +217,68 @@ static NSURL *_Nullable GetProviderUpdateTripStatusURLWithTripID(NSString *_Nonn
             error = GRSCError(kFailedToCancelTripErrorDescription);
           }
         }
-        completion(error);
+        CFTimeInterval decodedTime = CACurrentMediaTime();
+        [metrics recordDuration:decodedTime - responseTime
+                        ofPhase:GRSCProviderCallPhaseDecode
+                        forCall:callName];
+        dispatch_async(callbackQueue, ^{
+          [metrics recordDuration:CACurrentMediaTime() - decodedTime
+                          ofPhase:GRSCProviderCallPhaseDispatch
+                          forCall:callName];
+          completion(error);
+        });
       };
 
-  NSURLSessionDataTask *task = [_session dataTaskWithRequest:request
-                                           completionHandler:cancelTripServerResponseHandler];
-  [task resume];
+  [self sendRequest:request
+                forCall:_cmd
+              startTime:startTime
+              retryMode:GRSCProviderRetryModeRetry
+      completionHandler:cancelTripServerResponseHandler];
+}
+
+#pragma mark - Private
+
+/**
+ * Sends a request to the provider, retrying it as the retry mode allows. The time spent building
+ * the request and waiting for its response is recorded in @c metrics.
+ *
+ * @param request The request to send.
+ * @param call The selector of the provider call making the request.
+ * @param startTime The time at which the call was made, so that building the request is timed.
+ * @param retryMode How the request is retried when it fails.
+ * @param completionHandler The block that handles the response.
+ */
+- (void)sendRequest:(nonnull NSURLRequest *)request
+              forCall:(SEL)call
+            startTime:(CFTimeInterval)startTime
+            retryMode:(GRSCProviderRetryMode)retryMode
+    completionHandler:(nonnull GRSCProviderResponseHandler)completionHandler {
+  NSString *callName = NSStringFromSelector(call);
+  GRSCProviderMetrics *metrics = _metrics;
+  CFTimeInterval sendTime = CACurrentMediaTime();
+  [metrics recordDuration:sendTime - startTime
+                  ofPhase:GRSCProviderCallPhaseBuild
+                  forCall:callName];
+
+  NSURLSession *session = _session;
+  [_retryPolicy
+      performRequestWithRetryMode:retryMode
+                         hedgeKey:callName
+                          attempt:^(BOOL isFirstAttempt,
+                                    GRSCProviderResponseHandler attemptHandler) {
+                            NSURLSessionDataTask *task = GRSCProviderDataTask(
+                                session, request, callName, !isFirstAttempt, attemptHandler);
+                            [task resume];
+                            return ^{
+                              [task cancel];
+                            };
+                          }
+                completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
+                  [metrics recordDuration:CACurrentMediaTime() - sendTime
+                                  ofPhase:GRSCProviderCallPhaseNetwork
+                                  forCall:callName];
+                  completionHandler(data, response, error);
+                }];
 }
 
 @end
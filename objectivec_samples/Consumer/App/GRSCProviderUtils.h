@@ -59,10 +59,51 @@ NSError *_Nonnull GRSCError(NSString *_Nonnull description);
  * Returns an instance of NSURL with the base provider URL and given path. Returns nil if URL is
  * malformed.
  *
+ * The URL points at the canonical provider replica. Requests sent with @c GRSCProviderDataTask are
+ * routed to whichever replica is currently serving best.
+ *
  * @param path The path representing the endpoint on the provider.
  */
 NSURL *_Nullable GRSCProviderURLWithPath(NSString *_Nonnull path);
 
+/**
+ * Returns a data task that sends the given request to one of the provider server replicas, picked
+ * by latency and error rate, and records how the replica answered. The request and its outcome are
+ * also counted under the call in the shared provider metrics.
+ *
+ * @param session The session that creates the task.
+ * @param request The request to send, built with a URL from @c GRSCProviderURLWithPath.
+ * @param call The name of the provider call sending the request.
+ * @param isRetry Whether the request is a retry of an earlier request for the call.
+ * @param completionHandler The block executed when the request finishes.
+ */
+NSURLSessionDataTask *_Nonnull GRSCProviderDataTask(
+    NSURLSession *_Nonnull session, NSURLRequest *_Nonnull request, NSString *_Nonnull call,
+    BOOL isRetry, GRSCProviderResponseHandler _Nonnull completionHandler);
+
+/**
+ * Returns a request to the provider server. The request accepts responses encoded as a binary
+ * property list as well as JSON, and the body is encoded as a binary property list once the
+ * provider has sent a property list response.
+ *
+ * @param URL The URL of the request.
+ * @param method The HTTP method of the request.
+ * @param body The fields sent in the request body, or nil if the request has no body.
+ */
+NSURLRequest *_Nonnull GRSCProviderRequest(NSURL *_Nonnull URL, NSString *_Nonnull method,
+                                           GRSCProviderFieldsDictionary *_Nullable body);
+
+/**
+ * Returns a dictionary from the given provider response, decoded in the format named by the
+ * response's Content-Type. Will return nil if the data is invalid or is not a dictionary.
+ *
+ * @param data The data returned by the provider server.
+ * @param response The response from the provider server.
+ * @param error The error that will be set on failure.
+ */
+GRSCProviderFieldsDictionary *_Nullable GRSCGetDictionaryFromResponse(
+    NSData *_Nonnull data, NSURLResponse *_Nullable response, NSError *_Nullable *_Nullable error);
+
 /**
  * Returns a dictionary from the given data object. Will return nil if the data is invalid or cannot
  * be serialized to a JSON dictionary.
@@ -15,12 +15,33 @@
 
 #import "GRSCProviderUtils.h"
 
+#import <stdatomic.h>
+
+#import "GRSCProviderEndpointSet.h"
+#import "GRSCProviderMetrics.h"
+
 // Provider error defaults.
 static const int kProviderErrorCode = -1;
 static NSString *const kGRSCErrorDomain = @"GRSCErrorDomain";
 
-// Provider URL Strings.
-static NSString *const kGRSCBaseProviderURLString = @"http://localhost:8080";
+// Base URL strings of the provider server replicas. The first one is canonical.
+static NSString *const kGRSCBaseProviderURLStrings[] = {
+    @"http://localhost:8080",
+};
+
+// HTTP constants.
+static NSString *const kGRSCHTTPAcceptHeaderField = @"Accept";
+static NSString *const kGRSCHTTPContentTypeHeaderField = @"Content-Type";
+static NSString *const kGRSCHTTPJSONContentType = @"application/json";
+static NSString *const kGRSCHTTPPropertyListContentType = @"application/x-plist";
+
+// Responses may be encoded as a binary property list, which is smaller and faster to decode than
+// JSON. Providers that only speak JSON ignore the preference.
+static NSString *const kGRSCHTTPAcceptedContentTypes =
+    @"application/x-plist, application/json;q=0.9";
+
+// Whether the provider has sent a property list response, so it can also read one.
+static atomic_bool gProviderAcceptsPropertyList = false;
 
 // Error descriptions.
 NSString *const kGRSCUnexpectedJSONClassTypeErrorDescription =
@@ -34,11 +55,47 @@ NSError *GRSCError(NSString *description) {
   return [NSError errorWithDomain:kGRSCErrorDomain code:kProviderErrorCode userInfo:userInfo];
 }
 
+/** Returns the provider server replicas, which all provider requests are spread across. */
+static GRSCProviderEndpointSet *GetSharedEndpointSet(void) {
+  static GRSCProviderEndpointSet *endpointSet;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    size_t count = sizeof(kGRSCBaseProviderURLStrings) / sizeof(kGRSCBaseProviderURLStrings[0]);
+    NSMutableArray<NSURL *> *baseURLs = [[NSMutableArray alloc] initWithCapacity:count];
+    for (size_t i = 0; i < count; i++) {
+      [baseURLs addObject:[NSURL URLWithString:kGRSCBaseProviderURLStrings[i]]];
+    }
+    endpointSet = [[GRSCProviderEndpointSet alloc] initWithBaseURLs:baseURLs];
+  });
+  return endpointSet;
+}
+
 NSURL *GRSCProviderURLWithPath(NSString *path) {
-  NSURL *baseProviderNSURL = [NSURL URLWithString:kGRSCBaseProviderURLString];
+  NSURL *baseProviderNSURL = GetSharedEndpointSet().canonicalBaseURL;
   return [NSURL URLWithString:path relativeToURL:baseProviderNSURL];
 }
 
+NSURLSessionDataTask *GRSCProviderDataTask(NSURLSession *session, NSURLRequest *request,
+                                           NSString *call, BOOL isRetry,
+                                           GRSCProviderResponseHandler completionHandler) {
+  GRSCProviderEndpointSet *endpointSet = GetSharedEndpointSet();
+  GRSCProviderMetrics *metrics = [GRSCProviderMetrics sharedMetrics];
+  [metrics recordAttemptWithRequest:request isRetry:isRetry forCall:call];
+  GRSCRoutedProviderRequest *routedRequest = [endpointSet routeRequest:request];
+  return [session dataTaskWithRequest:routedRequest.request
+                    completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
+                      [endpointSet finishRoutedRequest:routedRequest
+                                          withResponse:response
+                                                 error:error];
+                      [metrics recordResponse:response
+                                         data:data
+                                        error:error
+                                    toRequest:request
+                                      forCall:call];
+                      completionHandler(data, response, error);
+                    }];
+}
+
 GRSCProviderFieldsDictionary *GRSCGetDictionaryFromJSONData(NSData *data, NSError **error) {
   NSError *JSONParseError;
   id JSONDictionary = [NSJSONSerialization JSONObjectWithData:data
@@ -58,3 +115,54 @@ GRSCProviderFieldsDictionary *GRSCGetDictionaryFromJSONData(NSData *data, NSErro
   }
   return nil;
 }
+
+NSURLRequest *GRSCProviderRequest(NSURL *URL, NSString *method,
+                                  GRSCProviderFieldsDictionary *_Nullable body) {
+  NSMutableURLRequest *request = [[NSMutableURLRequest alloc] initWithURL:URL];
+  request.HTTPMethod = method;
+  [request setValue:kGRSCHTTPAcceptedContentTypes forHTTPHeaderField:kGRSCHTTPAcceptHeaderField];
+  if (!body) {
+    return [request copy];
+  }
+
+  if (atomic_load(&gProviderAcceptsPropertyList)) {
+    request.HTTPBody =
+        [NSPropertyListSerialization dataWithPropertyList:body
+                                                   format:NSPropertyListBinaryFormat_v1_0
+                                                  options:0
+                                                    error:nil];
+    [request setValue:kGRSCHTTPPropertyListContentType
+        forHTTPHeaderField:kGRSCHTTPContentTypeHeaderField];
+  } else {
+    request.HTTPBody = [NSJSONSerialization dataWithJSONObject:body options:0 error:nil];
+    [request setValue:kGRSCHTTPJSONContentType forHTTPHeaderField:kGRSCHTTPContentTypeHeaderField];
+  }
+  return [request copy];
+}
+
+GRSCProviderFieldsDictionary *GRSCGetDictionaryFromResponse(NSData *data, NSURLResponse *response,
+                                                            NSError **error) {
+  if (![response.MIMEType isEqualToString:kGRSCHTTPPropertyListContentType]) {
+    return GRSCGetDictionaryFromJSONData(data, error);
+  }
+
+  atomic_store(&gProviderAcceptsPropertyList, true);
+  NSError *propertyListError;
+  id propertyList = [NSPropertyListSerialization propertyListWithData:data
+                                                              options:NSPropertyListImmutable
+                                                               format:NULL
+                                                                error:&propertyListError];
+  NSError *errorToPropagate;
+  if (propertyListError) {
+    errorToPropagate = propertyListError;
+  } else if (![propertyList isKindOfClass:[NSDictionary class]]) {
+    errorToPropagate = GRSCError(kGRSCUnexpectedJSONClassTypeErrorDescription);
+  } else {
+    return (GRSCProviderFieldsDictionary *)propertyList;
+  }
+
+  if (error) {
+    *error = errorToPropagate;
+  }
+  return nil;
+}
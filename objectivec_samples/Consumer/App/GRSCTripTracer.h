@@ -0,0 +1,121 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#import <Foundation/Foundation.h>
+
+#import <GoogleRidesharingConsumer/GoogleRidesharingConsumer.h>
+
+/**
+ * The HTTP header field that carries the trace context of a trip on provider requests, in the W3C
+ * Trace Context format.
+ */
+extern NSString *const _Nonnull GRSCTripTraceHeaderField;
+
+/** A timed step in the lifecycle of a trip, which is exported by its tracer once it ends. */
+@interface GRSCTripSpan : NSObject
+
+/** The name of the step. */
+@property(nonatomic, copy, readonly, nonnull) NSString *name;
+
+/**
+ * The ID of the trip that the step belongs to. It can be set until the span ends, for steps that
+ * only learn the trip ID along the way, such as creating a trip. Spans that end without a trip ID
+ * are dropped.
+ */
+@property(nonatomic, copy, nullable) NSString *tripID;
+
+/** Identifies the span within the trace of its trip. */
+@property(nonatomic, copy, readonly, nonnull) NSString *spanID;
+
+/** Sets an attribute that is exported with the span. */
+- (void)setAttribute:(nonnull NSString *)value forKey:(nonnull NSString *)key;
+
+/** Sets the "status" attribute to the provider's name of a trip status. */
+- (void)setTripStatus:(GMTSTripStatus)tripStatus;
+
+/** Ends the span and exports it. Ending a span again has no effect. */
+- (void)end;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
+
+@end
+
+/**
+ * Records timestamped spans for the steps of trip lifecycles, keyed by trip ID, and exports them to
+ * a local file.
+ *
+ * Each ended span is appended to the file as one line of JSON, with its start as wall-clock time so
+ * that traces from the driver and consumer apps can be stitched into a timeline per trip by
+ * tools/stitch_trip_traces.py. All spans of a trip share a trace ID derived from the trip ID, so
+ * both apps and the provider agree on it without coordinating.
+ */
+@interface GRSCTripTracer : NSObject
+
+/** The file that spans are appended to, or nil if spans are not exported. */
+@property(nonatomic, readonly, nullable) NSURL *fileURL;
+
+/** Returns the tracer shared by the app, which exports spans to a file in the caches directory. */
++ (nonnull instancetype)sharedTracer;
+
+/**
+ * Initializes an instance of this class.
+ *
+ * @param source The name of the app that the spans are recorded by, such as "consumer".
+ * @param fileURL The file to append spans to, or nil to drop them. The file is started over if it
+ * has grown larger than 8 MB.
+ */
+- (nonnull instancetype)initWithSource:(nonnull NSString *)source
+                               fileURL:(nullable NSURL *)fileURL NS_DESIGNATED_INITIALIZER;
+
+/**
+ * Use @c initWithSource:fileURL: or @c sharedTracer instead.
+ */
+- (nonnull instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Starts a span. It becomes the parent of provider requests for its trip until another span of the
+ * trip is started.
+ *
+ * @param name The name of the step.
+ * @param tripID The ID of the trip, or nil if it is not known yet.
+ */
+- (nonnull GRSCTripSpan *)startSpanWithName:(nonnull NSString *)name
+                                     tripID:(nullable NSString *)tripID;
+
+/**
+ * Records an instantaneous step of a trip.
+ *
+ * @param name The name of the step.
+ * @param tripID The ID of the trip.
+ */
+- (void)recordEventWithName:(nonnull NSString *)name tripID:(nonnull NSString *)tripID;
+
+/**
+ * Records an instantaneous step of a trip that reached the given status.
+ *
+ * @param name The name of the step.
+ * @param tripID The ID of the trip.
+ * @param tripStatus The status of the trip.
+ */
+- (void)recordEventWithName:(nonnull NSString *)name
+                     tripID:(nonnull NSString *)tripID
+                 tripStatus:(GMTSTripStatus)tripStatus;
+
+/**
+ * Returns the value of the @c GRSCTripTraceHeaderField header for a provider request about a trip,
+ * whose parent is the span last started for the trip.
+ */
+- (nonnull NSString *)traceHeaderValueForTripID:(nonnull NSString *)tripID;
+
+@end
@@ -0,0 +1,261 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#import "GRSDAuthTokenCache.h"
+
+static const NSUInteger kDefaultCapacity = 16;
+static const double kDefaultRefreshAheadFraction = 0.2;
+
+// Keys of the tokens persisted to disk.
+static NSString *const kPersistedTokenKey = @"token";
+static NSString *const kPersistedExpirationKey = @"expiration";
+static NSString *const kPersistedRefreshTimeKey = @"refreshTime";
+
+/** The cached token of a key and the requests waiting for it to be fetched. */
+@interface GRSDAuthTokenCacheEntry : NSObject
+
+@property(nonatomic, copy, nullable) NSString *token;
+@property(nonatomic) NSTimeInterval expiration;
+/** The time after which the token is refreshed ahead of its expiration. */
+@property(nonatomic) NSTimeInterval refreshTime;
+/** Completions waiting for the token being fetched, or nil if no fetch is in flight. */
+@property(nonatomic, strong, nullable)
+    NSMutableArray<GRSDAuthTokenCacheHandler> *pendingCompletions;
+
+@end
+
+@implementation GRSDAuthTokenCacheEntry
+@end
+
+@implementation GRSDAuthTokenCache {
+  GRSDAuthTokenFetcher _fetcher;
+  NSMutableDictionary<NSString *, GRSDAuthTokenCacheEntry *> *_entries;
+  NSURL *_fileURL;
+  /** Serializes writes of the persisted tokens. */
+  dispatch_queue_t _fileQueue;
+}
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity
+                         fileURL:(nullable NSURL *)fileURL
+                           clock:(id<GRSDClock>)clock
+                         fetcher:(GRSDAuthTokenFetcher)fetcher {
+  self = [super init];
+  if (self) {
+    _capacity = MAX(capacity, 1);
+    _clock = clock;
+    _fetcher = [fetcher copy];
+    _entries = [[NSMutableDictionary alloc] init];
+    _refreshAheadFraction = kDefaultRefreshAheadFraction;
+    _fileURL = [fileURL copy];
+    if (_fileURL) {
+      _fileQueue = dispatch_queue_create("com.google.DriverSampleApp.AuthTokenCache",
+                                         DISPATCH_QUEUE_SERIAL);
+      [self loadPersistedTokens];
+    }
+  }
+  return self;
+}
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity
+                         fileURL:(nullable NSURL *)fileURL
+                         fetcher:(GRSDAuthTokenFetcher)fetcher {
+  return [self initWithCapacity:capacity
+                        fileURL:fileURL
+                          clock:[GRSDSystemClock sharedClock]
+                        fetcher:fetcher];
+}
+
+- (instancetype)initWithFetcher:(GRSDAuthTokenFetcher)fetcher {
+  return [self initWithCapacity:kDefaultCapacity fileURL:nil fetcher:fetcher];
+}
+
+- (void)fetchTokenForKey:(NSString *)key completion:(GRSDAuthTokenCacheHandler)completion {
+  NSString *cachedToken;
+  BOOL shouldFetch = NO;
+  @synchronized(self) {
+    GRSDAuthTokenCacheEntry *entry = _entries[key];
+    if (!entry) {
+      entry = [[GRSDAuthTokenCacheEntry alloc] init];
+      _entries[key] = entry;
+    }
+
+    NSTimeInterval now = _clock.currentTime;
+    if (entry.token && now < entry.expiration) {
+      cachedToken = entry.token;
+      shouldFetch = !entry.pendingCompletions && now >= entry.refreshTime;
+      if (shouldFetch) {
+        entry.pendingCompletions = [[NSMutableArray alloc] init];
+      }
+    } else {
+      if (!entry.pendingCompletions) {
+        entry.pendingCompletions = [[NSMutableArray alloc] init];
+        shouldFetch = YES;
+      }
+      [entry.pendingCompletions addObject:[completion copy]];
+    }
+  }
+
+  if (cachedToken) {
+    completion(cachedToken, nil);
+  }
+  if (shouldFetch) {
+    [self refreshTokenForKey:key];
+  }
+}
+
+#pragma mark - Private
+
+/** Fetches a new token for the key and delivers it to the requests waiting for it. */
+- (void)refreshTokenForKey:(NSString *)key {
+  NSTimeInterval fetchTime = _clock.currentTime;
+  // Capture self strongly so that waiting requests are always completed.
+  _fetcher(key, ^(NSString *_Nullable token, NSTimeInterval expiration, NSError *_Nullable error) {
+    [self finishRefreshForKey:key
+                    fetchTime:fetchTime
+                        token:token
+                   expiration:expiration
+                        error:error];
+  });
+}
+
+- (void)finishRefreshForKey:(NSString *)key
+                  fetchTime:(NSTimeInterval)fetchTime
+                      token:(nullable NSString *)token
+                 expiration:(NSTimeInterval)expiration
+                      error:(nullable NSError *)error {
+  NSArray<GRSDAuthTokenCacheHandler> *completions;
+  @synchronized(self) {
+    GRSDAuthTokenCacheEntry *entry = _entries[key];
+    completions = [entry.pendingCompletions copy];
+    entry.pendingCompletions = nil;
+    // Keep the current token if the refresh failed, so that it is retried on the next request.
+    if (token && expiration > fetchTime) {
+      entry.token = token;
+      entry.expiration = expiration;
+      entry.refreshTime = expiration - (expiration - fetchTime) * _refreshAheadFraction;
+      [self evictEntriesKeepingKey:key];
+      [self persistTokens];
+    }
+  }
+
+  for (GRSDAuthTokenCacheHandler completion in completions) {
+    completion(token, error);
+  }
+}
+
+/**
+ * Evicts expired tokens, and then the tokens closest to expiring until at most @c capacity remain.
+ * Keys with a fetch in flight and @c keptKey, whose token is being returned, are kept. Must be
+ * called while synchronized on self.
+ */
+- (void)evictEntriesKeepingKey:(nullable NSString *)keptKey {
+  NSTimeInterval now = _clock.currentTime;
+  NSMutableArray<NSString *> *evictableKeys = [[NSMutableArray alloc] init];
+  [_entries enumerateKeysAndObjectsUsingBlock:^(NSString *key, GRSDAuthTokenCacheEntry *entry,
+                                                BOOL *stop) {
+    if (!entry.pendingCompletions && ![key isEqualToString:keptKey]) {
+      [evictableKeys addObject:key];
+    }
+  }];
+  [evictableKeys sortUsingComparator:^NSComparisonResult(NSString *key1, NSString *key2) {
+    NSTimeInterval expiration1 = self->_entries[key1].expiration;
+    NSTimeInterval expiration2 = self->_entries[key2].expiration;
+    if (expiration1 == expiration2) {
+      return NSOrderedSame;
+    }
+    return expiration1 < expiration2 ? NSOrderedAscending : NSOrderedDescending;
+  }];
+
+  for (NSString *key in evictableKeys) {
+    if (_entries.count <= _capacity && _entries[key].expiration > now) {
+      break;
+    }
+    [_entries removeObjectForKey:key];
+  }
+}
+
+/** Restores the unexpired tokens persisted by a previous launch. */
+- (void)loadPersistedTokens {
+  NSData *data = [NSData dataWithContentsOfURL:_fileURL];
+  if (!data) {
+    return;
+  }
+  NSDictionary *persistedTokens = [NSPropertyListSerialization propertyListWithData:data
+                                                                            options:0
+                                                                             format:nil
+                                                                              error:nil];
+  if (![persistedTokens isKindOfClass:[NSDictionary class]]) {
+    return;
+  }
+
+  NSTimeInterval now = _clock.currentTime;
+  [persistedTokens enumerateKeysAndObjectsUsingBlock:^(id key, id persistedToken, BOOL *stop) {
+    if (![key isKindOfClass:[NSString class]] ||
+        ![persistedToken isKindOfClass:[NSDictionary class]]) {
+      return;
+    }
+    NSString *token = persistedToken[kPersistedTokenKey];
+    NSNumber *expiration = persistedToken[kPersistedExpirationKey];
+    NSNumber *refreshTime = persistedToken[kPersistedRefreshTimeKey];
+    if (![token isKindOfClass:[NSString class]] || ![expiration isKindOfClass:[NSNumber class]] ||
+        ![refreshTime isKindOfClass:[NSNumber class]] || expiration.doubleValue <= now) {
+      return;
+    }
+    GRSDAuthTokenCacheEntry *entry = [[GRSDAuthTokenCacheEntry alloc] init];
+    entry.token = token;
+    entry.expiration = expiration.doubleValue;
+    entry.refreshTime = refreshTime.doubleValue;
+    self->_entries[key] = entry;
+  }];
+  [self evictEntriesKeepingKey:nil];
+}
+
+/**
+ * Writes the cached tokens to disk in the background. Must be called while synchronized on self.
+ */
+- (void)persistTokens {
+  if (!_fileURL) {
+    return;
+  }
+  NSMutableDictionary<NSString *, NSDictionary *> *persistedTokens =
+      [[NSMutableDictionary alloc] initWithCapacity:_entries.count];
+  [_entries enumerateKeysAndObjectsUsingBlock:^(NSString *key, GRSDAuthTokenCacheEntry *entry,
+                                                BOOL *stop) {
+    if (entry.token) {
+      persistedTokens[key] = @{
+        kPersistedTokenKey : entry.token,
+        kPersistedExpirationKey : @(entry.expiration),
+        kPersistedRefreshTimeKey : @(entry.refreshTime),
+      };
+    }
+  }];
+
+  NSURL *fileURL = _fileURL;
+  dispatch_async(_fileQueue, ^{
+    NSData *data =
+        [NSPropertyListSerialization dataWithPropertyList:persistedTokens
+                                                   format:NSPropertyListBinaryFormat_v1_0
+                                                  options:0
+                                                    error:nil];
+    if ([data writeToURL:fileURL
+                 options:NSDataWritingAtomic | NSDataWritingFileProtectionComplete
+                   error:nil]) {
+      // The atomic write replaces the file, so its backup exclusion is set again each time.
+      [fileURL setResourceValue:@YES forKey:NSURLIsExcludedFromBackupKey error:nil];
+    }
+  });
+}
+
+@end
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** A timer scheduled on a @c GRSDClock. */
+@protocol GRSDClockTimer <NSObject>
+
+/** Stops the timer from firing again. */
+- (void)invalidate;
+
+@end
+
+/**
+ * The source of the current time and of timers for trip flows and token caches.
+ *
+ * The app uses @c GRSDSystemClock. Classes take the clock as a parameter, so that another clock
+ * can stand in for it.
+ */
+@protocol GRSDClock <NSObject>
+
+/** The current time, in seconds since 1970. */
+@property(nonatomic, readonly) NSTimeInterval currentTime;
+
+/**
+ * Calls @c block on the main queue once @c interval has passed, and then every @c interval if
+ * @c repeats is YES, until the returned timer is invalidated.
+ */
+- (id<GRSDClockTimer>)scheduleTimerWithInterval:(NSTimeInterval)interval
+                                        repeats:(BOOL)repeats
+                                          block:(dispatch_block_t)block;
+
+@end
+
+/** The wall clock. */
+@interface GRSDSystemClock : NSObject <GRSDClock>
+
+/** The clock shared by the app. */
++ (instancetype)sharedClock;
+
+@end
+
+NS_ASSUME_NONNULL_END
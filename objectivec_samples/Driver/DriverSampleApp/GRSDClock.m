@@ -0,0 +1,78 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#import "GRSDClock.h"
+
+/** A timer of the system clock, backed by a dispatch source on the main queue. */
+@interface GRSDSystemClockTimer : NSObject <GRSDClockTimer>
+
+- (instancetype)initWithSource:(dispatch_source_t)source;
+
+@end
+
+@implementation GRSDSystemClockTimer {
+  dispatch_source_t _source;
+}
+
+- (instancetype)initWithSource:(dispatch_source_t)source {
+  self = [super init];
+  if (self) {
+    _source = source;
+  }
+  return self;
+}
+
+- (void)invalidate {
+  dispatch_source_cancel(_source);
+}
+
+@end
+
+@implementation GRSDSystemClock
+
++ (instancetype)sharedClock {
+  static GRSDSystemClock *sharedClock;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    sharedClock = [[GRSDSystemClock alloc] init];
+  });
+  return sharedClock;
+}
+
+- (NSTimeInterval)currentTime {
+  return [[NSDate date] timeIntervalSince1970];
+}
+
+- (id<GRSDClockTimer>)scheduleTimerWithInterval:(NSTimeInterval)interval
+                                        repeats:(BOOL)repeats
+                                          block:(dispatch_block_t)block {
+  dispatch_source_t source =
+      dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_main_queue());
+  int64_t intervalInNanoseconds = (int64_t)(MAX(interval, 0) * NSEC_PER_SEC);
+  dispatch_source_set_timer(source, dispatch_time(DISPATCH_TIME_NOW, intervalInNanoseconds),
+                            repeats ? (uint64_t)intervalInNanoseconds : DISPATCH_TIME_FOREVER,
+                            NSEC_PER_MSEC);
+  // The handler keeps the source alive until it is cancelled, as a run loop does for an NSTimer.
+  dispatch_source_set_event_handler(source, ^{
+    block();
+    if (!repeats) {
+      dispatch_source_cancel(source);
+    }
+  });
+  dispatch_resume(source);
+  return [[GRSDSystemClockTimer alloc] initWithSource:source];
+}
+
+@end
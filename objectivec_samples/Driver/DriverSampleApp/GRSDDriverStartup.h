@@ -0,0 +1,140 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+#import <GoogleRidesharingDriver/GoogleRidesharingDriver.h>
+
+#import "GRSDVehicleModel.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class GRSDProviderService;
+
+/** A stage of driver startup, which is timed separately. */
+typedef NS_ENUM(NSInteger, GRSDDriverStartupStage) {
+  /** Showing the terms and conditions dialog until the driver accepts it. */
+  GRSDDriverStartupStageTerms = 0,
+  /** Resuming the vehicle of the previous launch, or creating a new one. */
+  GRSDDriverStartupStageVehicle,
+  /** Fetching the first driver token for the vehicle. */
+  GRSDDriverStartupStageToken,
+  /** Creating the driver context and vehicle reporter for the vehicle. */
+  GRSDDriverStartupStageDriverContext,
+  /** Reporting the vehicle online, until Fleet Engine acknowledges it. */
+  GRSDDriverStartupStageOnline,
+};
+
+/** Whether a launch resumed the vehicle of a previous launch. */
+typedef NS_ENUM(NSInteger, GRSDDriverStartupLaunch) {
+  /** The vehicle isn't ready yet. */
+  GRSDDriverStartupLaunchUnknown = 0,
+  /** The launch created a new vehicle. */
+  GRSDDriverStartupLaunchCold,
+  /** The launch resumed the vehicle of a previous launch. */
+  GRSDDriverStartupLaunchWarm,
+};
+
+/**
+ * Callback block definition for the vehicle that startup resumes or creates.
+ *
+ * @param vehicleModel The vehicle. It is nil if the vehicle could neither be resumed nor created.
+ * @param matchedTripIDs The trips still matched with a resumed vehicle. It is nil for a new
+ * vehicle.
+ * @param waypoints The waypoints of a resumed vehicle. It is nil for a new vehicle.
+ * @param error The error resuming or creating the vehicle, if any.
+ */
+typedef void (^GRSDDriverStartupVehicleHandler)(GRSDVehicleModel *_Nullable vehicleModel,
+                                                NSArray<NSString *> *_Nullable matchedTripIDs,
+                                                NSArray<GMTSTripWaypoint *> *_Nullable waypoints,
+                                                NSError *_Nullable error);
+
+/**
+ * Brings the driver's vehicle online at launch, reusing the vehicle of the previous launch.
+ *
+ * The vehicle that a launch creates is persisted along with its model, and later launches resume it
+ * with a vehicle fetch instead of creating another one. Resuming or creating the vehicle, and
+ * fetching its first driver token, start as soon as @c prepareVehicle is called and run while the
+ * terms and conditions dialog is shown.
+ *
+ * Each stage of startup is timed from the launch, and the breakdown is logged once the vehicle is
+ * online, along with whether the launch created a vehicle (cold) or resumed one (warm). Must be
+ * used on the main queue.
+ */
+@interface GRSDDriverStartup : NSObject
+
+/** Whether this launch resumed a vehicle, which is unknown until the vehicle is ready. */
+@property(nonatomic, readonly) GRSDDriverStartupLaunch launch;
+
+/** The file that the vehicle is persisted to, or nil to create a vehicle on every launch. */
+@property(nonatomic, readonly, nullable) NSURL *fileURL;
+
+/** When the launch started, in seconds since 1970 on the provider service's clock. */
+@property(nonatomic, readonly) NSTimeInterval launchTime;
+
+/** Returns the file in the application support directory that the app's vehicle is kept in. */
+@property(class, nonatomic, readonly, nullable) NSURL *defaultFileURL;
+
+/**
+ * Initializes an instance of this class, which starts timing the launch.
+ *
+ * @param providerService The provider service that vehicles are resumed and created with, and
+ * whose token cache the first token is fetched into.
+ * @param fileURL The file that the vehicle is persisted to, or nil to create a vehicle on every
+ * launch.
+ */
+- (instancetype)initWithProviderService:(GRSDProviderService *)providerService
+                                fileURL:(nullable NSURL *)fileURL NS_DESIGNATED_INITIALIZER;
+
+/**
+ * Use @c initWithProviderService:fileURL: instead.
+ */
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Starts resuming or creating the vehicle, and fetching its first token, unless that is already
+ * under way or done. Call this as early in the launch as possible.
+ */
+- (void)prepareVehicle;
+
+/**
+ * Calls @c completion once the vehicle is ready, preparing it if it isn't being prepared. If
+ * preparing the vehicle fails, the next call starts over.
+ *
+ * @param completion The block executed on the main queue with the vehicle.
+ */
+- (void)waitForVehicleWithCompletion:(GRSDDriverStartupVehicleHandler)completion;
+
+/**
+ * Persists a change to the vehicle's model, so that later launches resume it.
+ *
+ * @param vehicleModel The updated vehicle model.
+ */
+- (void)persistVehicleModel:(GRSDVehicleModel *)vehicleModel;
+
+/** Records that a stage started. A stage that starts again is timed from its latest start. */
+- (void)beginStage:(GRSDDriverStartupStage)stage;
+
+/**
+ * Records that a stage ended. Ending a stage that hasn't started has no effect. Once the vehicle is
+ * online, the timings of all stages are logged.
+ */
+- (void)endStage:(GRSDDriverStartupStage)stage;
+
+/** Returns a table of when each stage that has ended started and how long it took. */
+- (NSString *)report;
+
+@end
+
+NS_ASSUME_NONNULL_END
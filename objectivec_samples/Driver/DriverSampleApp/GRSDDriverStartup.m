@@ -0,0 +1,281 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#import "GRSDDriverStartup.h"
+
+#import "GRSDProviderService.h"
+
+static NSString *const kVehicleFileName = @"GRSDVehicleSession.plist";
+
+// Keys of the persisted vehicle model.
+static NSString *const kVehicleIDKey = @"vehicleID";
+static NSString *const kMaximumCapacityKey = @"maximumCapacity";
+static NSString *const kSupportedTripTypesKey = @"supportedTripTypes";
+static NSString *const kBackToBackEnabledKey = @"backToBackEnabled";
+
+static const NSInteger kStageCount = GRSDDriverStartupStageOnline + 1;
+
+static NSString *GetStageName(GRSDDriverStartupStage stage) {
+  switch (stage) {
+    case GRSDDriverStartupStageTerms:
+      return @"terms";
+    case GRSDDriverStartupStageVehicle:
+      return @"vehicle";
+    case GRSDDriverStartupStageToken:
+      return @"token";
+    case GRSDDriverStartupStageDriverContext:
+      return @"driverContext";
+    case GRSDDriverStartupStageOnline:
+      return @"online";
+  }
+  return @"unknown";
+}
+
+@implementation GRSDDriverStartup {
+  GRSDProviderService *_providerService;
+  /** Whether the vehicle is being resumed or created. */
+  BOOL _isPreparing;
+  /** The blocks waiting for the vehicle. */
+  NSMutableArray<GRSDDriverStartupVehicleHandler> *_pendingCompletions;
+  GRSDVehicleModel *_vehicleModel;
+  NSArray<NSString *> *_matchedTripIDs;
+  NSArray<GMTSTripWaypoint *> *_waypoints;
+  /** When each stage started and ended, in seconds since the launch, or NAN if it hasn't. */
+  NSTimeInterval _stageStartTimes[kStageCount];
+  NSTimeInterval _stageEndTimes[kStageCount];
+}
+
+- (instancetype)initWithProviderService:(GRSDProviderService *)providerService
+                                fileURL:(nullable NSURL *)fileURL {
+  self = [super init];
+  if (self) {
+    _providerService = providerService;
+    _fileURL = [fileURL copy];
+    _launchTime = providerService.clock.currentTime;
+    _pendingCompletions = [[NSMutableArray alloc] init];
+    for (NSInteger stage = 0; stage < kStageCount; stage++) {
+      _stageStartTimes[stage] = NAN;
+      _stageEndTimes[stage] = NAN;
+    }
+  }
+  return self;
+}
+
++ (nullable NSURL *)defaultFileURL {
+  NSURL *applicationSupportURL =
+      [NSFileManager.defaultManager URLsForDirectory:NSApplicationSupportDirectory
+                                           inDomains:NSUserDomainMask]
+          .firstObject;
+  return [applicationSupportURL URLByAppendingPathComponent:kVehicleFileName];
+}
+
+- (void)prepareVehicle {
+  if (_isPreparing || _vehicleModel) {
+    return;
+  }
+  _isPreparing = YES;
+  [self beginStage:GRSDDriverStartupStageVehicle];
+
+  GRSDVehicleModel *persistedVehicleModel = [self loadVehicleModel];
+  if (!persistedVehicleModel) {
+    [self createVehicle];
+    return;
+  }
+  [self prefetchTokenForVehicleID:persistedVehicleModel.vehicleID];
+  __weak typeof(self) weakSelf = self;
+  [_providerService fetchVehicleWithID:persistedVehicleModel.vehicleID
+                            completion:^(NSArray<NSString *> *_Nullable matchedTripIDs,
+                                         NSArray<GMTSTripWaypoint *> *_Nullable waypoints,
+                                         NSError *_Nullable error) {
+                              [weakSelf handleResumedVehicleModel:persistedVehicleModel
+                                                   matchedTripIDs:matchedTripIDs
+                                                        waypoints:waypoints
+                                                            error:error];
+                            }];
+}
+
+- (void)waitForVehicleWithCompletion:(GRSDDriverStartupVehicleHandler)completion {
+  if (_vehicleModel) {
+    completion(_vehicleModel, _matchedTripIDs, _waypoints, nil);
+    return;
+  }
+  [_pendingCompletions addObject:[completion copy]];
+  [self prepareVehicle];
+}
+
+- (void)persistVehicleModel:(GRSDVehicleModel *)vehicleModel {
+  _vehicleModel = vehicleModel;
+  if (!_fileURL) {
+    return;
+  }
+  NSDictionary<NSString *, id> *dictionary = @{
+    kVehicleIDKey : vehicleModel.vehicleID,
+    kMaximumCapacityKey : @(vehicleModel.maximumCapacity),
+    kSupportedTripTypesKey : @(vehicleModel.supportedTripTypes),
+    kBackToBackEnabledKey : @(vehicleModel.isBackToBackEnabled),
+  };
+  NSData *data = [NSPropertyListSerialization dataWithPropertyList:dictionary
+                                                            format:NSPropertyListBinaryFormat_v1_0
+                                                           options:0
+                                                             error:nil];
+  [NSFileManager.defaultManager createDirectoryAtURL:_fileURL.URLByDeletingLastPathComponent
+                         withIntermediateDirectories:YES
+                                          attributes:nil
+                                               error:nil];
+  [data writeToURL:_fileURL atomically:YES];
+}
+
+- (void)beginStage:(GRSDDriverStartupStage)stage {
+  _stageStartTimes[stage] = _providerService.clock.currentTime - _launchTime;
+}
+
+- (void)endStage:(GRSDDriverStartupStage)stage {
+  if (isnan(_stageStartTimes[stage])) {
+    return;
+  }
+  _stageEndTimes[stage] = _providerService.clock.currentTime - _launchTime;
+  if (stage == GRSDDriverStartupStageOnline) {
+    NSLog(@"Driver startup:\n%@", [self report]);
+  }
+}
+
+- (NSString *)report {
+  NSString *launch = _launch == GRSDDriverStartupLaunchWarm   ? @"warm"
+                     : _launch == GRSDDriverStartupLaunchCold ? @"cold"
+                                                              : @"unknown";
+  NSMutableString *report = [NSMutableString stringWithFormat:@"%@ launch\n", launch];
+  [report appendString:@"stage            start   duration\n"];
+  for (NSInteger stage = 0; stage < kStageCount; stage++) {
+    if (isnan(_stageEndTimes[stage])) {
+      continue;
+    }
+    NSString *name = [GetStageName(stage) stringByPaddingToLength:13
+                                                       withString:@" "
+                                                  startingAtIndex:0];
+    [report appendFormat:@"%@ %5.0f ms  %6.0f ms\n", name, _stageStartTimes[stage] * 1000,
+                         (_stageEndTimes[stage] - _stageStartTimes[stage]) * 1000];
+  }
+  return report;
+}
+
+#pragma mark - Private
+
+- (void)handleResumedVehicleModel:(GRSDVehicleModel *)vehicleModel
+                   matchedTripIDs:(nullable NSArray<NSString *> *)matchedTripIDs
+                        waypoints:(nullable NSArray<GMTSTripWaypoint *> *)waypoints
+                            error:(nullable NSError *)error {
+  if (error) {
+    [self finishWithVehicleModel:nil matchedTripIDs:nil waypoints:nil error:error];
+    return;
+  }
+  if (!matchedTripIDs) {
+    // The provider sends no vehicle if it no longer has this one, so create another one.
+    [self createVehicle];
+    return;
+  }
+  _launch = GRSDDriverStartupLaunchWarm;
+  [self finishWithVehicleModel:vehicleModel
+                matchedTripIDs:matchedTripIDs
+                     waypoints:waypoints ?: @[]
+                         error:nil];
+}
+
+- (void)createVehicle {
+  NSString *vehicleID = [NSString stringWithFormat:@"iOS-%@", [NSUUID UUID].UUIDString];
+  __weak typeof(self) weakSelf = self;
+  // Create a vehicle with b2b support enabled by default.
+  [_providerService
+      createVehicleWithID:vehicleID
+      isBackToBackEnabled:YES
+               completion:^(GRSDVehicleModel *_Nullable vehicleModel, NSError *_Nullable error) {
+                 [weakSelf handleCreatedVehicleModel:vehicleModel error:error];
+               }];
+}
+
+- (void)handleCreatedVehicleModel:(nullable GRSDVehicleModel *)vehicleModel
+                            error:(nullable NSError *)error {
+  if (error || vehicleModel.vehicleID.length == 0) {
+    [self finishWithVehicleModel:nil matchedTripIDs:nil waypoints:nil error:error];
+    return;
+  }
+  [self persistVehicleModel:vehicleModel];
+  [self prefetchTokenForVehicleID:vehicleModel.vehicleID];
+  _launch = GRSDDriverStartupLaunchCold;
+  [self finishWithVehicleModel:vehicleModel matchedTripIDs:nil waypoints:nil error:nil];
+}
+
+/** Hands the vehicle to the waiting blocks, or lets the next wait start over if it failed. */
+- (void)finishWithVehicleModel:(nullable GRSDVehicleModel *)vehicleModel
+                matchedTripIDs:(nullable NSArray<NSString *> *)matchedTripIDs
+                     waypoints:(nullable NSArray<GMTSTripWaypoint *> *)waypoints
+                         error:(nullable NSError *)error {
+  _isPreparing = NO;
+  _vehicleModel = vehicleModel;
+  _matchedTripIDs = [matchedTripIDs copy];
+  _waypoints = [waypoints copy];
+  if (vehicleModel) {
+    [self endStage:GRSDDriverStartupStageVehicle];
+  }
+  NSArray<GRSDDriverStartupVehicleHandler> *completions = [_pendingCompletions copy];
+  [_pendingCompletions removeAllObjects];
+  for (GRSDDriverStartupVehicleHandler completion in completions) {
+    completion(vehicleModel, matchedTripIDs, waypoints, error);
+  }
+}
+
+/**
+ * Fetches the first token of a vehicle in the background. A token that fails to be fetched is
+ * fetched again when the driver context asks for it.
+ */
+- (void)prefetchTokenForVehicleID:(NSString *)vehicleID {
+  [self beginStage:GRSDDriverStartupStageToken];
+  __weak typeof(self) weakSelf = self;
+  [_providerService
+      prefetchTokenForVehicleID:vehicleID
+                     completion:^(NSString *_Nullable token, NSError *_Nullable error) {
+                       if (token) {
+                         [weakSelf endStage:GRSDDriverStartupStageToken];
+                       }
+                     }];
+}
+
+/** Returns the vehicle model persisted by a previous launch. */
+- (nullable GRSDVehicleModel *)loadVehicleModel {
+  NSData *data = _fileURL ? [NSData dataWithContentsOfURL:_fileURL] : nil;
+  if (!data) {
+    return nil;
+  }
+  NSDictionary<NSString *, id> *dictionary =
+      [NSPropertyListSerialization propertyListWithData:data options:0 format:NULL error:nil];
+  if (![dictionary isKindOfClass:[NSDictionary class]]) {
+    return nil;
+  }
+  NSString *vehicleID = dictionary[kVehicleIDKey];
+  NSNumber *maximumCapacity = dictionary[kMaximumCapacityKey];
+  NSNumber *supportedTripTypes = dictionary[kSupportedTripTypesKey];
+  NSNumber *isBackToBackEnabled = dictionary[kBackToBackEnabledKey];
+  if (![vehicleID isKindOfClass:[NSString class]] || vehicleID.length == 0 ||
+      ![maximumCapacity isKindOfClass:[NSNumber class]] ||
+      ![supportedTripTypes isKindOfClass:[NSNumber class]] ||
+      ![isBackToBackEnabled isKindOfClass:[NSNumber class]]) {
+    return nil;
+  }
+  return [[GRSDVehicleModel alloc] initWithVehicleID:vehicleID
+                                     maximumCapacity:maximumCapacity.unsignedIntegerValue
+                                  supportedTripTypes:supportedTripTypes.unsignedIntegerValue
+                                 isBackToBackEnabled:isBackToBackEnabled.boolValue];
+}
+
+@end
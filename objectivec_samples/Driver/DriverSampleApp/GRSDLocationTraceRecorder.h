@@ -0,0 +1,134 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#import <CoreLocation/CoreLocation.h>
+#import <Foundation/Foundation.h>
+#import <GoogleNavigation/GoogleNavigation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** A recorded location. */
+typedef struct {
+  /** The time of the fix, in seconds since 1970. */
+  NSTimeInterval timestamp;
+  CLLocationDegrees latitude;
+  CLLocationDegrees longitude;
+} GRSDTraceFix;
+
+/**
+ * Records the road-snapped locations of a driving session compactly, so that a shift can be audited
+ * or replayed.
+ *
+ * Fixes are simplified as they arrive. A fix is dropped if the trace, rebuilt by interpolating
+ * between the kept fixes at each fix's time, stays within @c tolerance of it. This is the
+ * Douglas-Peucker test, applied to an opening window of the fixes since the last kept one. The
+ * window holds a bounded number of fixes, so each fix takes bounded time.
+ *
+ * Kept fixes are quantized to milliseconds and millionths of a degree, and stored as the zigzag
+ * varint deltas from the fix before them. The deltas go into fixed-size blocks, each starting from
+ * zero so that it can be decoded on its own, which form a ring in fixed memory. When the ring is
+ * full, its sealed blocks are appended to @c fileURL in one write, each prefixed with its varint
+ * length. Without a file, the oldest block is overwritten instead.
+ *
+ * Once a write would take the file past @c maximumFileSize, the file is moved to
+ * @c rotatedFileURL, replacing the one rotated before, and a new file is started. The trace on disk
+ * is therefore bounded at about twice @c maximumFileSize, and always holds the most recent fixes.
+ */
+@interface GRSDLocationTraceRecorder : NSObject <GMSRoadSnappedLocationProviderListener>
+
+/** The file that full blocks are appended to, or nil to overwrite the oldest block instead. */
+@property(nonatomic, readonly, nullable) NSURL *fileURL;
+
+/**
+ * The file that the previous part of the trace is moved to when the file is rotated, or nil
+ * without a file. Its fixes precede those of @c fileURL.
+ */
+@property(nonatomic, readonly, nullable) NSURL *rotatedFileURL;
+
+/** The size, in bytes, past which the file is rotated. Defaults to 16 MB. */
+@property(nonatomic) unsigned long long maximumFileSize;
+
+/** How far, in meters, the rebuilt trace may stray from a dropped fix at the fix's time. */
+@property(nonatomic, readonly) double tolerance;
+
+/** The number of fixes recorded. */
+@property(nonatomic, readonly) NSUInteger recordedFixCount;
+
+/** The number of recorded fixes that were kept by the simplification. */
+@property(nonatomic, readonly) NSUInteger keptFixCount;
+
+/** The number of blocks overwritten because there was no file to spill them to. */
+@property(nonatomic, readonly) NSUInteger droppedBlockCount;
+
+/** Returns the file in the application support directory that the app's trace is appended to. */
++ (nullable NSURL *)defaultFileURL;
+
+/**
+ * Decodes the fixes of a trace file.
+ *
+ * @param data The contents of the file.
+ * @param error Set if the trace ends in the middle of a block or a fix.
+ * @return The fixes, with their coordinates and timestamps, or nil if the trace is truncated.
+ */
++ (nullable NSArray<CLLocation *> *)fixesFromTraceData:(NSData *)data error:(NSError **)error;
+
+/**
+ * Initializes an instance of this class.
+ *
+ * @param fileURL The file to append full blocks to, or nil to overwrite the oldest block instead.
+ * @param tolerance How far, in meters, the rebuilt trace may stray from a dropped fix.
+ * @param maximumWindowCount The most fixes that are considered for dropping at once.
+ * @param blockSize The size of a block of encoded fixes, in bytes. At least 30.
+ * @param blockCount The number of blocks kept in memory. At least 2.
+ */
+- (instancetype)initWithFileURL:(nullable NSURL *)fileURL
+                      tolerance:(double)tolerance
+             maximumWindowCount:(NSUInteger)maximumWindowCount
+                      blockSize:(NSUInteger)blockSize
+                     blockCount:(NSUInteger)blockCount NS_DESIGNATED_INITIALIZER;
+
+/**
+ * Initializes an instance with a tolerance of 2 meters, and 8 blocks of 4 KB in memory.
+ *
+ * @param fileURL The file to append full blocks to, or nil to overwrite the oldest block instead.
+ */
+- (instancetype)initWithFileURL:(nullable NSURL *)fileURL;
+
+/**
+ * Use @c initWithFileURL: instead.
+ */
+- (instancetype)init NS_UNAVAILABLE;
+
+/** Records a fix. */
+- (void)recordFix:(GRSDTraceFix)fix;
+
+/**
+ * Keeps the last recorded fix, and appends the blocks in memory to the file. Called at the end of a
+ * shift, or when the app may be suspended.
+ */
+- (void)flush;
+
+/** Waits until the spilled blocks have been written to the file. */
+- (void)waitUntilSpilled;
+
+/**
+ * Returns the fixes that are still in memory, including the last recorded fix even if it may still
+ * be dropped.
+ */
+- (NSArray<CLLocation *> *)bufferedFixes;
+
+@end
+
+NS_ASSUME_NONNULL_END
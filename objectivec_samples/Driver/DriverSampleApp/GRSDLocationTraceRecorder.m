@@ -0,0 +1,429 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#import "GRSDLocationTraceRecorder.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static NSString *const kLocationTraceFileName = @"LocationTrace.bin";
+static const double kDefaultTolerance = 2;
+static const NSUInteger kDefaultMaximumWindowCount = 64;
+static const NSUInteger kDefaultBlockSize = 4096;
+static const NSUInteger kDefaultBlockCount = 8;
+static const unsigned long long kDefaultMaximumFileSize = 16 << 20;
+/** The most bytes that a fix is encoded in: three 64-bit varints. */
+static const NSUInteger kMaximumEncodedFixSize = 30;
+/** The most bytes that a block length is encoded in. */
+static const NSUInteger kMaximumEncodedLengthSize = 10;
+static const double kMetersPerDegree = 111319.49;
+
+/** A fix in milliseconds and millionths of a degree. */
+typedef struct {
+  int64_t time;
+  int64_t latitude;
+  int64_t longitude;
+} GRSDQuantizedFix;
+
+static const GRSDQuantizedFix kZeroQuantizedFix = {0, 0, 0};
+
+static GRSDQuantizedFix QuantizeFix(GRSDTraceFix fix) {
+  return (GRSDQuantizedFix){
+      .time = (int64_t)llround(fix.timestamp * 1e3),
+      .latitude = (int64_t)llround(fix.latitude * 1e6),
+      .longitude = (int64_t)llround(fix.longitude * 1e6),
+  };
+}
+
+static CLLocation *CreateLocationFromQuantizedFix(GRSDQuantizedFix fix) {
+  CLLocationCoordinate2D coordinate =
+      CLLocationCoordinate2DMake((double)fix.latitude / 1e6, (double)fix.longitude / 1e6);
+  NSDate *timestamp = [NSDate dateWithTimeIntervalSince1970:(double)fix.time / 1e3];
+  return [[CLLocation alloc] initWithCoordinate:coordinate
+                                       altitude:0
+                             horizontalAccuracy:0
+                               verticalAccuracy:-1
+                                      timestamp:timestamp];
+}
+
+/** Maps signed values to unsigned ones, so that small negative deltas have short varints. */
+static uint64_t ZigZag(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t UnZigZag(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/**
+ * Writes a value seven bits at a time, least significant first, with the high bit of each byte set
+ * if more bytes follow. Returns the number of bytes written.
+ */
+static NSUInteger WriteVarint(uint64_t value, uint8_t *bytes) {
+  NSUInteger length = 0;
+  while (value >= 0x80) {
+    bytes[length++] = (uint8_t)value | 0x80;
+    value >>= 7;
+  }
+  bytes[length++] = (uint8_t)value;
+  return length;
+}
+
+/** Reads a varint at *index, and advances it. Returns NO if the bytes end first. */
+static BOOL ReadVarint(const uint8_t *bytes, NSUInteger length, NSUInteger *index,
+                       uint64_t *value) {
+  *value = 0;
+  for (unsigned shift = 0; *index < length && shift < 64; shift += 7) {
+    uint8_t byte = bytes[(*index)++];
+    *value |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return YES;
+    }
+  }
+  return NO;
+}
+
+/** Writes the deltas of a fix from the previous fix. Returns the number of bytes written. */
+static NSUInteger EncodeFix(GRSDQuantizedFix fix, GRSDQuantizedFix previousFix, uint8_t *bytes) {
+  NSUInteger length = WriteVarint(ZigZag(fix.time - previousFix.time), bytes);
+  length += WriteVarint(ZigZag(fix.latitude - previousFix.latitude), bytes + length);
+  length += WriteVarint(ZigZag(fix.longitude - previousFix.longitude), bytes + length);
+  return length;
+}
+
+/** Appends the fixes of a block to an array. Returns NO if the block ends within a fix. */
+static BOOL DecodeBlock(const uint8_t *bytes, NSUInteger length,
+                        NSMutableArray<CLLocation *> *fixes) {
+  GRSDQuantizedFix fix = kZeroQuantizedFix;
+  NSUInteger index = 0;
+  while (index < length) {
+    uint64_t timeDelta, latitudeDelta, longitudeDelta;
+    if (!ReadVarint(bytes, length, &index, &timeDelta) ||
+        !ReadVarint(bytes, length, &index, &latitudeDelta) ||
+        !ReadVarint(bytes, length, &index, &longitudeDelta)) {
+      return NO;
+    }
+    fix.time += UnZigZag(timeDelta);
+    fix.latitude += UnZigZag(latitudeDelta);
+    fix.longitude += UnZigZag(longitudeDelta);
+    [fixes addObject:CreateLocationFromQuantizedFix(fix)];
+  }
+  return YES;
+}
+
+/**
+ * Returns the distance, in meters, between a fix and the point on a segment where the vehicle would
+ * be at the fix's time, moving at a constant speed.
+ */
+static double GetSynchronizedDistance(GRSDTraceFix fix, GRSDTraceFix start, GRSDTraceFix end) {
+  NSTimeInterval duration = end.timestamp - start.timestamp;
+  double fraction =
+      duration > 0 ? fmin(fmax((fix.timestamp - start.timestamp) / duration, 0), 1) : 1;
+  double latitude = start.latitude + (end.latitude - start.latitude) * fraction;
+  double longitude = start.longitude + (end.longitude - start.longitude) * fraction;
+  // Over the length of a window, an equirectangular projection is accurate to well under a
+  // millimeter.
+  double northing = (fix.latitude - latitude) * kMetersPerDegree;
+  double easting =
+      (fix.longitude - longitude) * kMetersPerDegree * cos(start.latitude * M_PI / 180);
+  return sqrt(northing * northing + easting * easting);
+}
+
+@implementation GRSDLocationTraceRecorder {
+  NSUInteger _maximumWindowCount;
+  NSUInteger _blockSize;
+  NSUInteger _blockCount;
+  NSUInteger _recordedFixCount;
+  NSUInteger _keptFixCount;
+  NSUInteger _droppedBlockCount;
+  /** The last kept fix. */
+  GRSDTraceFix _anchor;
+  BOOL _hasAnchor;
+  /** The fixes since the anchor, none of which is kept yet. */
+  GRSDTraceFix *_window;
+  NSUInteger _windowCount;
+  /** The blocks of encoded fixes, _blockSize bytes each. */
+  uint8_t *_ring;
+  /** The number of bytes used in each block. */
+  NSUInteger *_blockLengths;
+  /** The oldest sealed block, which the other sealed blocks and then the open one follow. */
+  NSUInteger _oldestBlock;
+  NSUInteger _sealedBlockCount;
+  /** The fix that the next fix in the open block is encoded relative to. */
+  GRSDQuantizedFix _previousFix;
+  /** Serializes writes to the trace file. */
+  dispatch_queue_t _fileQueue;
+  /** The handle of the trace file, which is opened with the first spilled block. */
+  NSFileHandle *_fileHandle;
+  /** The size of the trace file once @c _fileHandle is open. Only accessed on the file queue. */
+  unsigned long long _fileSize;
+}
+
++ (nullable NSURL *)defaultFileURL {
+  NSURL *applicationSupportURL =
+      [NSFileManager.defaultManager URLsForDirectory:NSApplicationSupportDirectory
+                                           inDomains:NSUserDomainMask]
+          .firstObject;
+  return [applicationSupportURL URLByAppendingPathComponent:kLocationTraceFileName];
+}
+
++ (nullable NSArray<CLLocation *> *)fixesFromTraceData:(NSData *)data error:(NSError **)error {
+  const uint8_t *bytes = data.bytes;
+  NSUInteger length = data.length;
+  NSMutableArray<CLLocation *> *fixes = [[NSMutableArray alloc] init];
+  NSUInteger index = 0;
+  while (index < length) {
+    uint64_t blockLength;
+    if (!ReadVarint(bytes, length, &index, &blockLength) || blockLength > length - index ||
+        !DecodeBlock(bytes + index, (NSUInteger)blockLength, fixes)) {
+      if (error) {
+        *error = [NSError errorWithDomain:NSCocoaErrorDomain
+                                     code:NSFileReadCorruptFileError
+                                 userInfo:@{NSDebugDescriptionErrorKey : @"Truncated trace."}];
+      }
+      return nil;
+    }
+    index += (NSUInteger)blockLength;
+  }
+  return fixes;
+}
+
+- (instancetype)initWithFileURL:(nullable NSURL *)fileURL
+                      tolerance:(double)tolerance
+             maximumWindowCount:(NSUInteger)maximumWindowCount
+                      blockSize:(NSUInteger)blockSize
+                     blockCount:(NSUInteger)blockCount {
+  NSParameterAssert(blockSize >= kMaximumEncodedFixSize && blockCount > 1);
+  self = [super init];
+  if (self) {
+    _fileURL = [fileURL copy];
+    _rotatedFileURL = [_fileURL URLByAppendingPathExtension:@"1"];
+    _maximumFileSize = kDefaultMaximumFileSize;
+    _tolerance = tolerance;
+    _maximumWindowCount = MAX(maximumWindowCount, 1);
+    _blockSize = blockSize;
+    _blockCount = blockCount;
+    _window = malloc(_maximumWindowCount * sizeof(GRSDTraceFix));
+    _ring = malloc(blockSize * blockCount);
+    _blockLengths = calloc(blockCount, sizeof(NSUInteger));
+    _previousFix = kZeroQuantizedFix;
+    _fileQueue = dispatch_queue_create("com.google.DriverSampleApp.LocationTraceRecorder",
+                                       DISPATCH_QUEUE_SERIAL);
+  }
+  return self;
+}
+
+- (instancetype)initWithFileURL:(nullable NSURL *)fileURL {
+  return [self initWithFileURL:fileURL
+                     tolerance:kDefaultTolerance
+            maximumWindowCount:kDefaultMaximumWindowCount
+                     blockSize:kDefaultBlockSize
+                    blockCount:kDefaultBlockCount];
+}
+
+- (void)dealloc {
+  free(_window);
+  free(_ring);
+  free(_blockLengths);
+}
+
+- (NSUInteger)recordedFixCount {
+  @synchronized(self) {
+    return _recordedFixCount;
+  }
+}
+
+- (NSUInteger)keptFixCount {
+  @synchronized(self) {
+    return _keptFixCount;
+  }
+}
+
+- (NSUInteger)droppedBlockCount {
+  @synchronized(self) {
+    return _droppedBlockCount;
+  }
+}
+
+- (void)recordFix:(GRSDTraceFix)fix {
+  @synchronized(self) {
+    _recordedFixCount++;
+    if (!_hasAnchor) {
+      _anchor = fix;
+      _hasAnchor = YES;
+      [self appendFix:fix];
+      return;
+    }
+    // The fixes in the window can be dropped as long as the segment from the anchor to the new fix
+    // passes within the tolerance of each of them. Once it doesn't, the fix before the new one is
+    // kept and becomes the anchor, since the segment to it passed the same test when it was added.
+    BOOL isWithinTolerance = _windowCount < _maximumWindowCount;
+    for (NSUInteger i = 0; isWithinTolerance && i < _windowCount; i++) {
+      isWithinTolerance = GetSynchronizedDistance(_window[i], _anchor, fix) <= _tolerance;
+    }
+    if (!isWithinTolerance) {
+      _anchor = _window[_windowCount - 1];
+      _windowCount = 0;
+      [self appendFix:_anchor];
+    }
+    _window[_windowCount++] = fix;
+  }
+}
+
+- (void)flush {
+  @synchronized(self) {
+    if (_windowCount > 0) {
+      _anchor = _window[_windowCount - 1];
+      _windowCount = 0;
+      [self appendFix:_anchor];
+    }
+    [self sealOpenBlock];
+    if (_fileURL) {
+      [self spillSealedBlocks];
+    }
+  }
+}
+
+- (void)waitUntilSpilled {
+  dispatch_sync(_fileQueue, ^{
+  });
+}
+
+- (NSArray<CLLocation *> *)bufferedFixes {
+  @synchronized(self) {
+    NSMutableArray<CLLocation *> *fixes = [[NSMutableArray alloc] init];
+    for (NSUInteger offset = 0; offset <= _sealedBlockCount; offset++) {
+      NSUInteger block = (_oldestBlock + offset) % _blockCount;
+      // Blocks are only written by this recorder, so they are never truncated.
+      DecodeBlock(_ring + block * _blockSize, _blockLengths[block], fixes);
+    }
+    if (_windowCount > 0) {
+      [fixes addObject:CreateLocationFromQuantizedFix(QuantizeFix(_window[_windowCount - 1]))];
+    }
+    return fixes;
+  }
+}
+
+#pragma mark - GMSRoadSnappedLocationProviderListener
+
+- (void)locationProvider:(GMSRoadSnappedLocationProvider *)locationProvider
+       didUpdateLocation:(CLLocation *)location {
+  [self recordFix:(GRSDTraceFix){
+                      .timestamp = location.timestamp.timeIntervalSince1970,
+                      .latitude = location.coordinate.latitude,
+                      .longitude = location.coordinate.longitude,
+                  }];
+}
+
+#pragma mark - Private
+
+- (NSUInteger)openBlock {
+  return (_oldestBlock + _sealedBlockCount) % _blockCount;
+}
+
+/** Appends a kept fix to the open block, sealing it first if the fix doesn't fit. */
+- (void)appendFix:(GRSDTraceFix)fix {
+  _keptFixCount++;
+  GRSDQuantizedFix quantizedFix = QuantizeFix(fix);
+  uint8_t encodedFix[kMaximumEncodedFixSize];
+  NSUInteger length = EncodeFix(quantizedFix, _previousFix, encodedFix);
+  if (_blockLengths[[self openBlock]] + length > _blockSize) {
+    [self sealOpenBlock];
+    length = EncodeFix(quantizedFix, kZeroQuantizedFix, encodedFix);
+  }
+  NSUInteger block = [self openBlock];
+  memcpy(_ring + block * _blockSize + _blockLengths[block], encodedFix, length);
+  _blockLengths[block] += length;
+  _previousFix = quantizedFix;
+}
+
+/** Seals the open block, if it has any fixes, and makes room for the next one. */
+- (void)sealOpenBlock {
+  if (_blockLengths[[self openBlock]] == 0) {
+    return;
+  }
+  _sealedBlockCount++;
+  _previousFix = kZeroQuantizedFix;
+  if (_sealedBlockCount < _blockCount) {
+    return;
+  }
+  if (_fileURL) {
+    [self spillSealedBlocks];
+  } else {
+    _blockLengths[_oldestBlock] = 0;
+    _oldestBlock = (_oldestBlock + 1) % _blockCount;
+    _sealedBlockCount--;
+    _droppedBlockCount++;
+  }
+}
+
+/** Appends the sealed blocks to the file, each prefixed with its length, and frees them. */
+- (void)spillSealedBlocks {
+  if (_sealedBlockCount == 0) {
+    return;
+  }
+  NSMutableData *data = [[NSMutableData alloc] init];
+  for (NSUInteger offset = 0; offset < _sealedBlockCount; offset++) {
+    NSUInteger block = (_oldestBlock + offset) % _blockCount;
+    uint8_t encodedLength[kMaximumEncodedLengthSize];
+    [data appendBytes:encodedLength length:WriteVarint(_blockLengths[block], encodedLength)];
+    [data appendBytes:_ring + block * _blockSize length:_blockLengths[block]];
+    _blockLengths[block] = 0;
+  }
+  _oldestBlock = (_oldestBlock + _sealedBlockCount) % _blockCount;
+  _sealedBlockCount = 0;
+  unsigned long long maximumFileSize = _maximumFileSize;
+  dispatch_async(_fileQueue, ^{
+    [self rotateFileIfNeededAppendingLength:data.length maximumFileSize:maximumFileSize];
+    if ([[self fileHandle] writeData:data error:nil]) {
+      self->_fileSize += data.length;
+    }
+  });
+}
+
+/**
+ * Moves the trace file to @c rotatedFileURL if appending @c length bytes would take it past
+ * @c maximumFileSize, so that the next write starts a new file. Must be called on the file queue.
+ */
+- (void)rotateFileIfNeededAppendingLength:(NSUInteger)length
+                          maximumFileSize:(unsigned long long)maximumFileSize {
+  if (![self fileHandle] || _fileSize == 0 || _fileSize + length <= maximumFileSize) {
+    return;
+  }
+  [_fileHandle closeAndReturnError:nil];
+  _fileHandle = nil;
+  NSFileManager *fileManager = NSFileManager.defaultManager;
+  [fileManager removeItemAtURL:_rotatedFileURL error:nil];
+  [fileManager moveItemAtURL:_fileURL toURL:_rotatedFileURL error:nil];
+}
+
+/** Returns the handle of the trace file, opening it if needed. Must be called on the file queue. */
+- (nullable NSFileHandle *)fileHandle {
+  if (_fileHandle) {
+    return _fileHandle;
+  }
+  NSFileManager *fileManager = NSFileManager.defaultManager;
+  if (![fileManager fileExistsAtPath:_fileURL.path]) {
+    [fileManager createFileAtPath:_fileURL.path contents:nil attributes:nil];
+  }
+  _fileHandle = [NSFileHandle fileHandleForWritingToURL:_fileURL error:nil];
+  unsigned long long fileSize = 0;
+  [_fileHandle seekToEndReturningOffset:&fileSize error:nil];
+  _fileSize = fileSize;
+  return _fileHandle;
+}
+
+@end
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "GRSDTripModel.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class GRSDNextTripPrefetcher;
+@class GRSDProviderService;
+
+/**
+ * Block definition that fetches a trip and calls @c completion exactly once on the main queue, with
+ * nil if the trip could not be fetched.
+ *
+ * @param tripID The ID of the trip to fetch.
+ * @param completion The block to call with the fetched trip.
+ */
+typedef void (^GRSDNextTripLoader)(NSString *tripID,
+                                   void (^completion)(GRSDTripModel *_Nullable trip));
+
+/** Receives the trips that a @c GRSDNextTripPrefetcher loads. */
+@protocol GRSDNextTripPrefetcherDelegate <NSObject>
+
+/**
+ * Called on the main queue once the next trip is loaded.
+ *
+ * @param prefetcher The prefetcher that loaded the trip.
+ * @param trip The loaded trip.
+ */
+- (void)nextTripPrefetcher:(GRSDNextTripPrefetcher *)prefetcher didLoadTrip:(GRSDTripModel *)trip;
+
+@end
+
+/**
+ * Loads the next back-to-back trip of the vehicle while the current trip is in progress, so that
+ * the driver can start it as soon as the current trip completes.
+ *
+ * Once a next trip is matched, its status and waypoints are fetched in the background, and the
+ * delegate can extend the navigator's route into it. When the current trip completes,
+ * @c handOffTripWithID:completion: hands off the loaded trip once the provider has confirmed that
+ * it is still current, and the app switches to it without waiting for a full fetch or a new route.
+ * Must be used on the main queue.
+ */
+@interface GRSDNextTripPrefetcher : NSObject
+
+/** The next trip, once it is loaded. */
+@property(nonatomic, readonly, nullable) GRSDTripModel *trip;
+
+@property(nonatomic, weak, nullable) id<GRSDNextTripPrefetcherDelegate> delegate;
+
+/**
+ * Initializes an instance of this class.
+ *
+ * @param loader The block that fetches trips.
+ */
+- (instancetype)initWithLoader:(GRSDNextTripLoader)loader NS_DESIGNATED_INITIALIZER;
+
+/**
+ * Initializes an instance that fetches trips with the given provider service.
+ *
+ * @param providerService The service to fetch trips with, which calls back on the main queue.
+ */
+- (instancetype)initWithProviderService:(GRSDProviderService *)providerService;
+
+/**
+ * Use @c initWithProviderService: instead.
+ */
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Starts loading a trip as the next one, unless it is already loaded or being loaded. Loading a
+ * trip that failed to load starts over.
+ *
+ * @param tripID The ID of the next trip.
+ */
+- (void)prefetchTripWithID:(NSString *)tripID;
+
+/**
+ * Hands off the next trip as the current trip completes, if it is the loaded one, and forgets it.
+ *
+ * The loaded trip is fetched again first, so that changes made to it since it was loaded are not
+ * lost. The fetch is a conditional request, which the provider answers without resending the trip
+ * if it hasn't changed. If the trip can't be fetched, the loaded trip is handed off as it is.
+ *
+ * @param tripID The ID of the next trip.
+ * @param completion The block to call on the main queue with the up to date trip.
+ * @return NO if the trip isn't loaded yet, in which case it has to be fetched as usual and
+ * @c completion is not called.
+ */
+- (BOOL)handOffTripWithID:(NSString *)tripID completion:(void (^)(GRSDTripModel *trip))completion;
+
+/** Forgets the next trip, and stops loading it. */
+- (void)cancel;
+
+@end
+
+NS_ASSUME_NONNULL_END
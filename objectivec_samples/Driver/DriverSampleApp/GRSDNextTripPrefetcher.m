@@ -0,0 +1,99 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#import "GRSDNextTripPrefetcher.h"
+
+#import "GRSDProviderService.h"
+
+@implementation GRSDNextTripPrefetcher {
+  GRSDNextTripLoader _loader;
+  /** The ID of the trip being loaded or loaded, or nil if there is none. */
+  NSString *_tripID;
+  /** Incremented for each trip, so that the load of a trip that was replaced is ignored. */
+  NSUInteger _generation;
+}
+
+- (instancetype)initWithLoader:(GRSDNextTripLoader)loader {
+  self = [super init];
+  if (self) {
+    _loader = [loader copy];
+  }
+  return self;
+}
+
+- (instancetype)initWithProviderService:(GRSDProviderService *)providerService {
+  return [self initWithLoader:^(NSString *tripID, void (^completion)(GRSDTripModel *_Nullable)) {
+    [providerService fetchTripWithID:tripID
+                          completion:^(NSString *_Nullable fetchedTripID, GMTSTripStatus tripStatus,
+                                       NSArray<GMTSTripWaypoint *> *_Nullable waypoints,
+                                       NSError *_Nullable error) {
+                            if (error || tripStatus == GMTSTripStatusUnknown) {
+                              completion(nil);
+                              return;
+                            }
+                            completion([[GRSDTripModel alloc] initWithTripID:tripID
+                                                                  tripStatus:tripStatus
+                                                                   waypoints:waypoints ?: @[]]);
+                          }];
+  }];
+}
+
+- (void)prefetchTripWithID:(NSString *)tripID {
+  if ([tripID isEqualToString:_tripID]) {
+    return;
+  }
+  [self cancel];
+  _tripID = [tripID copy];
+  NSUInteger generation = _generation;
+  __weak typeof(self) weakSelf = self;
+  _loader(tripID, ^(GRSDTripModel *_Nullable trip) {
+    [weakSelf finishLoadingTrip:trip generation:generation];
+  });
+}
+
+- (BOOL)handOffTripWithID:(NSString *)tripID completion:(void (^)(GRSDTripModel *trip))completion {
+  GRSDTripModel *loadedTrip = [_trip.tripID isEqualToString:tripID] ? _trip : nil;
+  [self cancel];
+  if (!loadedTrip) {
+    return NO;
+  }
+  _loader(tripID, ^(GRSDTripModel *_Nullable trip) {
+    completion(trip ?: loadedTrip);
+  });
+  return YES;
+}
+
+- (void)cancel {
+  _generation++;
+  _tripID = nil;
+  _trip = nil;
+}
+
+#pragma mark - Private
+
+- (void)finishLoadingTrip:(nullable GRSDTripModel *)trip generation:(NSUInteger)generation {
+  if (generation != _generation) {
+    return;
+  }
+  if (!trip) {
+    // Let the next prefetch retry.
+    _tripID = nil;
+    return;
+  }
+  _trip = trip;
+  [_delegate nextTripPrefetcher:self didLoadTrip:trip];
+}
+
+@end
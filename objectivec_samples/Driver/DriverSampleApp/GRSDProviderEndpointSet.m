@@ -0,0 +1,235 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#import "GRSDProviderEndpointSet.h"
+
+#import <QuartzCore/QuartzCore.h>
+
+static const double kDefaultDecay = 0.3;
+static const NSUInteger kDefaultEjectionFailureCount = 5;
+static const NSTimeInterval kDefaultEjectionInterval = 30;
+static const double kMinimumSuccessRate = 0.01;
+
+/** The state of one replica. */
+@interface GRSDProviderEndpoint : NSObject
+
+@property(nonatomic, strong) NSURL *baseURL;
+/** The EWMA latency, or a negative value until the replica has answered. */
+@property(nonatomic) NSTimeInterval latency;
+@property(nonatomic) double errorRate;
+@property(nonatomic) NSUInteger inFlightCount;
+@property(nonatomic) NSUInteger consecutiveFailureCount;
+@property(nonatomic) CFTimeInterval ejectedUntil;
+/** The cost of sending a request to the replica. A replica that has not answered costs nothing. */
+@property(nonatomic, readonly) double cost;
+
+@end
+
+@implementation GRSDProviderEndpoint
+
+- (double)cost {
+  if (_latency < 0) {
+    return 0;
+  }
+  return _latency * (_inFlightCount + 1) / MAX(1 - _errorRate, kMinimumSuccessRate);
+}
+
+@end
+
+@interface GRSDRoutedProviderRequest ()
+
+@property(nonatomic, strong) GRSDProviderEndpoint *endpoint;
+@property(nonatomic) CFTimeInterval startTime;
+
+@end
+
+@implementation GRSDRoutedProviderRequest
+
+- (instancetype)initWithRequest:(NSURLRequest *)request
+                       longPoll:(BOOL)longPoll
+                       endpoint:(GRSDProviderEndpoint *)endpoint
+                      startTime:(CFTimeInterval)startTime {
+  self = [super init];
+  if (self) {
+    _request = [request copy];
+    _longPoll = longPoll;
+    _endpoint = endpoint;
+    _startTime = startTime;
+  }
+  return self;
+}
+
+@end
+
+/** Returns whether a request failed because it was cancelled. */
+static BOOL IsCancellationError(NSError *_Nullable error) {
+  return [error.domain isEqualToString:NSURLErrorDomain] && error.code == NSURLErrorCancelled;
+}
+
+/** Returns the percent-encoded path of a base URL, ending with a slash. */
+static NSString *GetPathPrefix(NSURL *baseURL) {
+  NSString *path = [NSURLComponents componentsWithURL:baseURL
+                              resolvingAgainstBaseURL:YES].percentEncodedPath ?: @"";
+  return [path hasSuffix:@"/"] ? path : [path stringByAppendingString:@"/"];
+}
+
+/**
+ * Moves a path from under the path of @c canonicalBaseURL to under the path of @c baseURL. Paths
+ * outside @c canonicalBaseURL are returned unchanged.
+ */
+static NSString *RebasedPath(NSString *path, NSURL *canonicalBaseURL, NSURL *baseURL) {
+  NSString *canonicalPathPrefix = GetPathPrefix(canonicalBaseURL);
+  if (![path hasPrefix:canonicalPathPrefix]) {
+    return path;
+  }
+  return [GetPathPrefix(baseURL)
+      stringByAppendingString:[path substringFromIndex:canonicalPathPrefix.length]];
+}
+
+@implementation GRSDProviderEndpointSet {
+  NSArray<GRSDProviderEndpoint *> *_endpoints;
+}
+
+- (instancetype)initWithBaseURLs:(NSArray<NSURL *> *)baseURLs {
+  NSAssert(baseURLs.count, @"An endpoint set needs at least one replica.");
+  self = [super init];
+  if (self) {
+    NSMutableArray<GRSDProviderEndpoint *> *endpoints =
+        [[NSMutableArray alloc] initWithCapacity:baseURLs.count];
+    for (NSURL *baseURL in baseURLs) {
+      GRSDProviderEndpoint *endpoint = [[GRSDProviderEndpoint alloc] init];
+      endpoint.baseURL = baseURL;
+      endpoint.latency = -1;
+      [endpoints addObject:endpoint];
+    }
+    _endpoints = [endpoints copy];
+    _decay = kDefaultDecay;
+    _ejectionFailureCount = kDefaultEjectionFailureCount;
+    _ejectionInterval = kDefaultEjectionInterval;
+  }
+  return self;
+}
+
+- (NSURL *)canonicalBaseURL {
+  return _endpoints.firstObject.baseURL;
+}
+
+- (BOOL)isBaseURLEjected:(NSURL *)baseURL {
+  CFTimeInterval now = CACurrentMediaTime();
+  @synchronized(self) {
+    for (GRSDProviderEndpoint *endpoint in _endpoints) {
+      if ([endpoint.baseURL isEqual:baseURL] && endpoint.ejectedUntil > now) {
+        return YES;
+      }
+    }
+    return NO;
+  }
+}
+
+- (GRSDRoutedProviderRequest *)routeRequest:(NSURLRequest *)request longPoll:(BOOL)longPoll {
+  CFTimeInterval now = CACurrentMediaTime();
+  GRSDProviderEndpoint *endpoint;
+  @synchronized(self) {
+    endpoint = [self selectEndpointAtTime:now];
+    if (!longPoll) {
+      endpoint.inFlightCount++;
+    }
+  }
+
+  NSMutableURLRequest *routedRequest = [request mutableCopy];
+  NSURLComponents *components = [NSURLComponents componentsWithURL:request.URL
+                                           resolvingAgainstBaseURL:YES];
+  if (components) {
+    components.scheme = endpoint.baseURL.scheme;
+    components.host = endpoint.baseURL.host;
+    components.port = endpoint.baseURL.port;
+    components.percentEncodedPath =
+        RebasedPath(components.percentEncodedPath, self.canonicalBaseURL, endpoint.baseURL);
+    routedRequest.URL = components.URL ?: request.URL;
+  }
+  return [[GRSDRoutedProviderRequest alloc] initWithRequest:routedRequest
+                                                   longPoll:longPoll
+                                                   endpoint:endpoint
+                                                  startTime:now];
+}
+
+- (void)finishRoutedRequest:(GRSDRoutedProviderRequest *)routedRequest
+               withResponse:(nullable NSURLResponse *)response
+                      error:(nullable NSError *)error {
+  CFTimeInterval now = CACurrentMediaTime();
+  GRSDProviderEndpoint *endpoint = routedRequest.endpoint;
+  @synchronized(self) {
+    if (!routedRequest.isLongPoll) {
+      endpoint.inFlightCount--;
+    }
+    if (IsCancellationError(error)) {
+      return;
+    }
+
+    BOOL isFailure = error ? [error.domain isEqualToString:NSURLErrorDomain]
+                           : [(NSHTTPURLResponse *)response statusCode] >= 500;
+    if (!routedRequest.isLongPoll) {
+      NSTimeInterval latency = now - routedRequest.startTime;
+      endpoint.latency = endpoint.latency < 0
+                             ? latency
+                             : _decay * latency + (1 - _decay) * endpoint.latency;
+    }
+    endpoint.errorRate = _decay * (isFailure ? 1 : 0) + (1 - _decay) * endpoint.errorRate;
+    if (!isFailure) {
+      endpoint.consecutiveFailureCount = 0;
+      return;
+    }
+    endpoint.consecutiveFailureCount++;
+    if (endpoint.consecutiveFailureCount >= MAX(_ejectionFailureCount, 1)) {
+      endpoint.ejectedUntil = now + _ejectionInterval;
+      // Give the replica a clean slate once it is given traffic again.
+      endpoint.consecutiveFailureCount = 0;
+      endpoint.errorRate = 0;
+    }
+  }
+}
+
+#pragma mark - Private
+
+/**
+ * Picks the cheaper of two random replicas that aren't ejected. Must be called while synchronized
+ * on self.
+ */
+- (GRSDProviderEndpoint *)selectEndpointAtTime:(CFTimeInterval)now {
+  NSMutableArray<GRSDProviderEndpoint *> *candidates =
+      [[NSMutableArray alloc] initWithCapacity:_endpoints.count];
+  for (GRSDProviderEndpoint *endpoint in _endpoints) {
+    if (endpoint.ejectedUntil <= now) {
+      [candidates addObject:endpoint];
+    }
+  }
+  if (!candidates.count) {
+    [candidates addObjectsFromArray:_endpoints];
+  }
+  if (candidates.count == 1) {
+    return candidates.firstObject;
+  }
+
+  uint32_t count = (uint32_t)candidates.count;
+  uint32_t firstIndex = arc4random_uniform(count);
+  uint32_t secondIndex = arc4random_uniform(count - 1);
+  if (secondIndex >= firstIndex) {
+    secondIndex++;
+  }
+  GRSDProviderEndpoint *first = candidates[firstIndex];
+  GRSDProviderEndpoint *second = candidates[secondIndex];
+  return first.cost <= second.cost ? first : second;
+}
+
+@end
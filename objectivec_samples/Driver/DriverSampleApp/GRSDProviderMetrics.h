@@ -0,0 +1,174 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** A phase of a provider call, which is timed separately. */
+typedef NS_ENUM(NSInteger, GRSDProviderCallPhase) {
+  /** From the call until its request is handed to the network. */
+  GRSDProviderCallPhaseBuild = 0,
+  /** From when the request is handed to the network until its response arrives, with retries. */
+  GRSDProviderCallPhaseNetwork,
+  /** Handling the response, which includes decoding it. */
+  GRSDProviderCallPhaseDecode,
+  /** From when the result of a call is enqueued on the callback queue until its completion runs. */
+  GRSDProviderCallPhaseDispatch,
+};
+
+/**
+ * A histogram of durations, in the style of an HDR histogram.
+ *
+ * Durations are counted in microseconds in log-linear buckets: every power of two is split into 16
+ * buckets, so that percentiles are accurate to within about 3% from a microsecond to several days.
+ * Recording a duration only increments a bucket, and histograms are merged by adding up their
+ * buckets.
+ */
+@interface GRSDLatencyHistogram : NSObject <NSCopying>
+
+/** The number of durations recorded. */
+@property(nonatomic, readonly) uint64_t count;
+
+/** The sum of the durations recorded, in seconds. */
+@property(nonatomic, readonly) NSTimeInterval totalDuration;
+
+/** The longest duration recorded, in seconds. */
+@property(nonatomic, readonly) NSTimeInterval maximumDuration;
+
+/** Records a duration, in seconds. */
+- (void)recordDuration:(NSTimeInterval)duration;
+
+/** Adds the durations recorded by another histogram to this one. */
+- (void)mergeHistogram:(GRSDLatencyHistogram *)histogram;
+
+/**
+ * Returns the duration, in seconds, that the given percentage of recorded durations are at most, or
+ * 0 if no durations have been recorded.
+ *
+ * @param percentile The percentile, from 0 to 100.
+ */
+- (NSTimeInterval)durationAtPercentile:(double)percentile;
+
+@end
+
+/** The latencies and counters recorded for one provider call. */
+@interface GRSDProviderCallMetrics : NSObject <NSCopying>
+
+/** The number of calls made, which is the number of build phases recorded. */
+@property(nonatomic, readonly) uint64_t callCount;
+
+/** The number of requests sent, including retries and hedges. */
+@property(nonatomic, readonly) uint64_t attemptCount;
+
+/** The number of requests sent as retries or hedges of an earlier request. */
+@property(nonatomic, readonly) uint64_t retryCount;
+
+/** The number of requests that failed without a response. */
+@property(nonatomic, readonly) uint64_t errorCount;
+
+/** The number of conditional requests answered with 304 Not Modified. */
+@property(nonatomic, readonly) uint64_t cacheHitCount;
+
+/** The number of request body bytes sent. */
+@property(nonatomic, readonly) uint64_t bytesSent;
+
+/** The number of response body bytes received. */
+@property(nonatomic, readonly) uint64_t bytesReceived;
+
+/** The number of responses received, keyed by HTTP status code. */
+@property(nonatomic, readonly) NSDictionary<NSNumber *, NSNumber *> *statusCodeCounts;
+
+/** Returns the latencies recorded for a phase of the call. */
+- (GRSDLatencyHistogram *)histogramForPhase:(GRSDProviderCallPhase)phase;
+
+/** Adds the latencies and counters recorded by other metrics to these ones. */
+- (void)mergeMetrics:(GRSDProviderCallMetrics *)metrics;
+
+@end
+
+@class GRSDProviderMetrics;
+
+/** A destination for provider metrics, such as a log or an analytics backend. */
+@protocol GRSDProviderMetricsSink <NSObject>
+
+/**
+ * Called when metrics are flushed.
+ *
+ * @param metrics The metrics that were flushed.
+ * @param snapshot The metrics recorded since the previous flush, keyed by the name of the call.
+ */
+- (void)providerMetrics:(GRSDProviderMetrics *)metrics
+       didFlushSnapshot:(NSDictionary<NSString *, GRSDProviderCallMetrics *> *)snapshot;
+
+@end
+
+/**
+ * Latency histograms and counters for provider calls, keyed by the name of the call.
+ *
+ * Recording is cheap enough to be done on every call: it takes an unfair lock, looks up the call
+ * and increments a few integers, without allocating once the call has been seen. Use @c snapshot to
+ * inspect the metrics, or add a sink and call @c flush to hand them off periodically.
+ */
+@interface GRSDProviderMetrics : NSObject
+
+/** The metrics shared by the provider service and auth token provider. */
++ (GRSDProviderMetrics *)sharedMetrics;
+
+/** Adds a sink that is handed the metrics on every flush. Sinks are held weakly. */
+- (void)addSink:(id<GRSDProviderMetricsSink>)sink;
+
+/** Removes a sink added with @c addSink:. */
+- (void)removeSink:(id<GRSDProviderMetricsSink>)sink;
+
+/** Returns a copy of the metrics recorded since the last flush, keyed by the name of the call. */
+- (NSDictionary<NSString *, GRSDProviderCallMetrics *> *)snapshot;
+
+/** Hands the metrics recorded since the last flush to the sinks, and starts over. */
+- (void)flush;
+
+/** Records how long a phase of a call took, in seconds. */
+- (void)recordDuration:(NSTimeInterval)duration
+               ofPhase:(GRSDProviderCallPhase)phase
+               forCall:(NSString *)call;
+
+/**
+ * Records that a request was sent for a call.
+ *
+ * @param request The request that was sent.
+ * @param isRetry Whether the request is a retry or hedge of an earlier request.
+ * @param call The name of the call.
+ */
+- (void)recordAttemptWithRequest:(NSURLRequest *)request
+                         isRetry:(BOOL)isRetry
+                         forCall:(NSString *)call;
+
+/**
+ * Records the outcome of a request sent for a call.
+ *
+ * @param response The response to the request, if any.
+ * @param data The response body, if any.
+ * @param error The error the request failed with, if any.
+ * @param request The request that was sent.
+ * @param call The name of the call.
+ */
+- (void)recordResponse:(nullable NSURLResponse *)response
+                  data:(nullable NSData *)data
+                 error:(nullable NSError *)error
+             toRequest:(NSURLRequest *)request
+               forCall:(NSString *)call;
+
+@end
+
+NS_ASSUME_NONNULL_END
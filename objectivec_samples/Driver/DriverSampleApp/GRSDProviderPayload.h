@@ -0,0 +1,100 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import <GoogleRidesharingConsumer/GoogleRidesharingConsumer.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * The fields of a provider response that the driver app reads.
+ *
+ * Payloads are decoded by scanning the response bytes once. Waypoints are collected as compact
+ * records and turned into @c GMTSTripWaypoint objects at the end, so no intermediate
+ * @c NSJSONSerialization tree of dictionaries, arrays and numbers is built. Fields that are missing
+ * from the response or of an unexpected type are nil, and unknown fields are skipped. Responses
+ * that nest trips too deeply are rejected.
+ */
+@interface GRSDProviderPayload : NSObject
+
+/** The fully qualified name of the vehicle or trip. */
+@property(nonatomic, readonly, nullable) NSString *name;
+
+/** The provider string representation of the trip status. */
+@property(nonatomic, readonly, nullable) NSString *tripStatus;
+
+/** The IDs of the trips matched with the vehicle. */
+@property(nonatomic, readonly, nullable) NSArray<NSString *> *matchedTripIDs;
+
+/** The remaining waypoints of the vehicle or trip. */
+@property(nonatomic, readonly, nullable) NSArray<GMTSTripWaypoint *> *waypoints;
+
+/** The maximum capacity of the vehicle. */
+@property(nonatomic, readonly, nullable) NSNumber *maximumCapacity;
+
+/** Whether the vehicle is enabled for back-to-back trips, as a boolean number. */
+@property(nonatomic, readonly, nullable) NSNumber *backToBackEnabled;
+
+/** The provider string representations of the trip types supported by the vehicle. */
+@property(nonatomic, readonly, nullable) NSArray<NSString *> *supportedTripTypes;
+
+/** The token in a token response. */
+@property(nonatomic, readonly, nullable) NSString *token;
+
+/** The number of seconds until the token in a token response expires. */
+@property(nonatomic, readonly, nullable) NSNumber *tokenExpiration;
+
+/** The trip object nested in a get trip response. */
+@property(nonatomic, readonly, nullable) GRSDProviderPayload *trip;
+
+/** The trip objects nested in a batch get trips response. */
+@property(nonatomic, readonly, nullable) NSArray<GRSDProviderPayload *> *trips;
+
+/**
+ * Decodes a provider response encoded as JSON. Returns nil and updates the given error object if
+ * the data is not a JSON object.
+ *
+ * Provider responses don't include the leg distances and ETAs of waypoints, so they are estimated
+ * along great-circle legs, with the first waypoint reached at @c currentTime.
+ *
+ * @param data The response data.
+ * @param currentTime The time the response is decoded at, in seconds since 1970.
+ * @param error The error that is set on failure.
+ */
++ (nullable instancetype)payloadWithData:(NSData *)data
+                             currentTime:(NSTimeInterval)currentTime
+                                   error:(NSError **)error;
+
+/**
+ * Decodes a provider response encoded as a binary or XML property list, the compact format that the
+ * provider may choose instead of JSON. Returns nil and updates the given error object if the data
+ * is not a property list dictionary. Waypoint estimates are filled in as by
+ * @c payloadWithData:currentTime:error:.
+ *
+ * @param data The response data.
+ * @param currentTime The time the response is decoded at, in seconds since 1970.
+ * @param error The error that is set on failure.
+ */
++ (nullable instancetype)payloadWithPropertyListData:(NSData *)data
+                                         currentTime:(NSTimeInterval)currentTime
+                                               error:(NSError **)error;
+
+/** Use @c payloadWithData:currentTime:error: instead. */
+- (null_unspecified instancetype)init NS_UNAVAILABLE;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,887 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#import "GRSDProviderPayload.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#import <CoreLocation/CoreLocation.h>
+
+#import "GRSDProviderSchema.h"
+#import "GRSDWaypointGeometry.h"
+
+// JSON data keys used and recognized by the sample provider server.
+static const char kProviderDataKeyName[] = "name";
+static const char kProviderDataKeyTripStatus[] = "tripStatus";
+static const char kProviderDataKeyWaypoints[] = "waypoints";
+static const char kProviderDataKeyLocation[] = "location";
+static const char kProviderDataKeyPoint[] = "point";
+static const char kProviderDataKeyLatitude[] = "latitude";
+static const char kProviderDataKeyLongitude[] = "longitude";
+static const char kProviderDataKeyTripID[] = "tripId";
+static const char kProviderDataKeyTrip[] = "trip";
+static const char kProviderDataKeyTrips[] = "trips";
+static const char kProviderDataKeyWaypointType[] = "waypointType";
+static const char kProviderDataKeyCurrentTripIDs[] = "currentTripsIds";
+static const char kProviderDataKeyBackToBackEnabled[] = "backToBackEnabled";
+static const char kProviderDataKeyMaximumCapacity[] = "maximumCapacity";
+static const char kProviderDataKeySupportedTripTypes[] = "supportedTripTypes";
+static const char kProviderDataKeyToken[] = "jwt";
+static const char kProviderDataKeyTokenExpiration[] = "expirationTimestamp";
+
+// The same keys, for property list responses which are decoded from objects.
+static NSString *const kPropertyListKeyName = @"name";
+static NSString *const kPropertyListKeyTripStatus = @"tripStatus";
+static NSString *const kPropertyListKeyWaypoints = @"waypoints";
+static NSString *const kPropertyListKeyLocation = @"location";
+static NSString *const kPropertyListKeyPoint = @"point";
+static NSString *const kPropertyListKeyLatitude = @"latitude";
+static NSString *const kPropertyListKeyLongitude = @"longitude";
+static NSString *const kPropertyListKeyTripID = @"tripId";
+static NSString *const kPropertyListKeyTrip = @"trip";
+static NSString *const kPropertyListKeyTrips = @"trips";
+static NSString *const kPropertyListKeyWaypointType = @"waypointType";
+static NSString *const kPropertyListKeyCurrentTripIDs = @"currentTripsIds";
+static NSString *const kPropertyListKeyBackToBackEnabled = @"backToBackEnabled";
+static NSString *const kPropertyListKeyMaximumCapacity = @"maximumCapacity";
+static NSString *const kPropertyListKeySupportedTripTypes = @"supportedTripTypes";
+static NSString *const kPropertyListKeyToken = @"jwt";
+static NSString *const kPropertyListKeyTokenExpiration = @"expirationTimestamp";
+
+// Provider responses nest trips in vehicles at most a couple of levels deep, so payloads nested
+// deeper than this are rejected rather than recursed into.
+static const NSUInteger kMaximumPayloadDepth = 8;
+
+// JSON literals.
+static const char kJSONTrue[] = "true";
+static const char kJSONFalse[] = "false";
+static const char kJSONNull[] = "null";
+
+/** The state of a single pass over the bytes of a JSON document. */
+typedef struct {
+  const uint8_t *bytes;
+  NSUInteger length;
+  NSUInteger position;
+  BOOL failed;
+  /** The number of payload objects being scanned, which is bounded by @c kMaximumPayloadDepth. */
+  NSUInteger payloadDepth;
+  /** The time that the ETAs of the scanned waypoints are estimated from, in seconds since 1970. */
+  NSTimeInterval currentTime;
+} GRSDScanner;
+
+/** The type of a JSON value, as told by its first byte. */
+typedef NS_ENUM(NSInteger, GRSDValueType) {
+  GRSDValueTypeInvalid = 0,
+  GRSDValueTypeString,
+  GRSDValueTypeNumber,
+  GRSDValueTypeBool,
+  GRSDValueTypeNull,
+  GRSDValueTypeObject,
+  GRSDValueTypeArray,
+};
+
+/** A string in the scanned document, referenced by the byte range between its quotes. */
+typedef struct {
+  NSRange range;
+  BOOL hasEscapes;
+} GRSDStringToken;
+
+/** A waypoint collected while scanning, before it is turned into a @c GMTSTripWaypoint. */
+typedef struct {
+  double latitude;
+  double longitude;
+  GMTSTripWaypointType waypointType;
+  BOOL hasTripID;
+  GRSDStringToken tripID;
+} GRSDWaypointRecord;
+
+@interface GRSDProviderPayload ()
+
+@property(nonatomic, readwrite, nullable) NSString *name;
+@property(nonatomic, readwrite, nullable) NSString *tripStatus;
+@property(nonatomic, readwrite, nullable) NSArray<NSString *> *matchedTripIDs;
+@property(nonatomic, readwrite, nullable) NSArray<GMTSTripWaypoint *> *waypoints;
+@property(nonatomic, readwrite, nullable) NSNumber *maximumCapacity;
+@property(nonatomic, readwrite, nullable) NSNumber *backToBackEnabled;
+@property(nonatomic, readwrite, nullable) NSArray<NSString *> *supportedTripTypes;
+@property(nonatomic, readwrite, nullable) NSString *token;
+@property(nonatomic, readwrite, nullable) NSNumber *tokenExpiration;
+@property(nonatomic, readwrite, nullable) GRSDProviderPayload *trip;
+@property(nonatomic, readwrite, nullable) NSArray<GRSDProviderPayload *> *trips;
+
+/** Initializes a payload without any fields, which are then filled in by the scanner. */
+- (instancetype)initEmptyPayload NS_DESIGNATED_INITIALIZER;
+
+@end
+
+/** Marks the scan as failed and returns NO. */
+static BOOL Fail(GRSDScanner *scanner) {
+  scanner->failed = YES;
+  return NO;
+}
+
+static void SkipWhitespace(GRSDScanner *scanner) {
+  while (scanner->position < scanner->length) {
+    uint8_t byte = scanner->bytes[scanner->position];
+    if (byte != ' ' && byte != '\n' && byte != '\r' && byte != '\t') {
+      return;
+    }
+    scanner->position++;
+  }
+}
+
+/** Returns the type of the next value after any whitespace, without consuming it. */
+static GRSDValueType PeekValueType(GRSDScanner *scanner) {
+  SkipWhitespace(scanner);
+  if (scanner->position >= scanner->length) {
+    return GRSDValueTypeInvalid;
+  }
+  uint8_t byte = scanner->bytes[scanner->position];
+  switch (byte) {
+    case '"':
+      return GRSDValueTypeString;
+    case '{':
+      return GRSDValueTypeObject;
+    case '[':
+      return GRSDValueTypeArray;
+    case 't':
+    case 'f':
+      return GRSDValueTypeBool;
+    case 'n':
+      return GRSDValueTypeNull;
+    default:
+      return byte == '-' || (byte >= '0' && byte <= '9') ? GRSDValueTypeNumber
+                                                          : GRSDValueTypeInvalid;
+  }
+}
+
+/** Consumes the given byte if it is the next one after any whitespace. */
+static BOOL ConsumeByte(GRSDScanner *scanner, uint8_t byte) {
+  SkipWhitespace(scanner);
+  if (scanner->position < scanner->length && scanner->bytes[scanner->position] == byte) {
+    scanner->position++;
+    return YES;
+  }
+  return NO;
+}
+
+/** Consumes the given literal, such as @c true or @c null, if it is next after any whitespace. */
+static BOOL ConsumeLiteral(GRSDScanner *scanner, const char *literal) {
+  SkipWhitespace(scanner);
+  size_t length = strlen(literal);
+  if (scanner->length - scanner->position >= length &&
+      memcmp(scanner->bytes + scanner->position, literal, length) == 0) {
+    scanner->position += length;
+    return YES;
+  }
+  return NO;
+}
+
+/** Scans a string, recording its range instead of copying it. */
+static BOOL ScanString(GRSDScanner *scanner, GRSDStringToken *token) {
+  if (!ConsumeByte(scanner, '"')) {
+    return Fail(scanner);
+  }
+  NSUInteger start = scanner->position;
+  BOOL hasEscapes = NO;
+  while (scanner->position < scanner->length) {
+    uint8_t byte = scanner->bytes[scanner->position];
+    if (byte == '"') {
+      token->range = NSMakeRange(start, scanner->position - start);
+      token->hasEscapes = hasEscapes;
+      scanner->position++;
+      return YES;
+    }
+    if (byte < 0x20) {
+      return Fail(scanner);
+    }
+    if (byte == '\\') {
+      // Skip the escaped byte so that an escaped quote doesn't end the string.
+      hasEscapes = YES;
+      scanner->position = MIN(scanner->position + 1, scanner->length - 1);
+    }
+    scanner->position++;
+  }
+  return Fail(scanner);
+}
+
+/** Returns whether an unescaped string token has the same bytes as the given C string. */
+static BOOL TokenEqualsString(const GRSDScanner *scanner, GRSDStringToken token,
+                              const char *string) {
+  size_t length = strlen(string);
+  return !token.hasEscapes && token.range.length == length &&
+         memcmp(scanner->bytes + token.range.location, string, length) == 0;
+}
+
+static BOOL TokensEqual(const GRSDScanner *scanner, GRSDStringToken token,
+                        GRSDStringToken otherToken) {
+  return token.hasEscapes == otherToken.hasEscapes &&
+         token.range.length == otherToken.range.length &&
+         memcmp(scanner->bytes + token.range.location, scanner->bytes + otherToken.range.location,
+                token.range.length) == 0;
+}
+
+static NSString *_Nullable StringFromToken(const GRSDScanner *scanner, GRSDStringToken token) {
+  if (!token.hasEscapes) {
+    return [[NSString alloc] initWithBytes:scanner->bytes + token.range.location
+                                    length:token.range.length
+                                  encoding:NSUTF8StringEncoding];
+  }
+  // Escaped strings are rare in provider responses, so let NSJSONSerialization unescape the
+  // quoted literal.
+  NSData *literal = [NSData dataWithBytesNoCopy:(void *)(scanner->bytes + token.range.location - 1)
+                                         length:token.range.length + 2
+                                   freeWhenDone:NO];
+  id value = [NSJSONSerialization JSONObjectWithData:literal
+                                             options:NSJSONReadingFragmentsAllowed
+                                               error:nil];
+  return [value isKindOfClass:[NSString class]] ? value : nil;
+}
+
+static BOOL ScanNumber(GRSDScanner *scanner, double *value) {
+  SkipWhitespace(scanner);
+  NSUInteger start = scanner->position;
+  while (scanner->position < scanner->length) {
+    uint8_t byte = scanner->bytes[scanner->position];
+    if ((byte < '0' || byte > '9') && byte != '-' && byte != '+' && byte != '.' && byte != 'e' &&
+        byte != 'E') {
+      break;
+    }
+    scanner->position++;
+  }
+
+  // Copy the literal to a terminated buffer on the stack since the data isn't terminated.
+  char buffer[64];
+  NSUInteger length = scanner->position - start;
+  if (length == 0 || length >= sizeof(buffer)) {
+    return Fail(scanner);
+  }
+  memcpy(buffer, scanner->bytes + start, length);
+  buffer[length] = '\0';
+  char *end;
+  *value = strtod(buffer, &end);
+  if (end != buffer + length) {
+    return Fail(scanner);
+  }
+  return YES;
+}
+
+static BOOL ScanBool(GRSDScanner *scanner, BOOL *value) {
+  if (ConsumeLiteral(scanner, kJSONTrue)) {
+    *value = YES;
+    return YES;
+  }
+  if (ConsumeLiteral(scanner, kJSONFalse)) {
+    *value = NO;
+    return YES;
+  }
+  return Fail(scanner);
+}
+
+/**
+ * Skips a value of any type. Nested objects and arrays are skipped by tracking their depth, without
+ * validating their members.
+ */
+static BOOL SkipValue(GRSDScanner *scanner) {
+  SkipWhitespace(scanner);
+  if (scanner->position >= scanner->length) {
+    return Fail(scanner);
+  }
+  GRSDStringToken token;
+  uint8_t byte = scanner->bytes[scanner->position];
+  if (byte == '"') {
+    return ScanString(scanner, &token);
+  }
+  if (byte == '{' || byte == '[') {
+    NSUInteger depth = 0;
+    while (scanner->position < scanner->length) {
+      byte = scanner->bytes[scanner->position];
+      if (byte == '"') {
+        if (!ScanString(scanner, &token)) {
+          return NO;
+        }
+        continue;
+      }
+      scanner->position++;
+      if (byte == '{' || byte == '[') {
+        depth++;
+      } else if (byte == '}' || byte == ']') {
+        depth--;
+        if (depth == 0) {
+          return YES;
+        }
+      }
+    }
+    return Fail(scanner);
+  }
+  if (ConsumeLiteral(scanner, kJSONTrue) || ConsumeLiteral(scanner, kJSONFalse) ||
+      ConsumeLiteral(scanner, kJSONNull)) {
+    return YES;
+  }
+  double number;
+  return ScanNumber(scanner, &number);
+}
+
+/**
+ * Advances to the next member of an object whose opening brace has been consumed, and scans its
+ * key. Returns NO once the closing brace is consumed or if the input is malformed.
+ */
+static BOOL NextObjectKey(GRSDScanner *scanner, BOOL *isFirst, GRSDStringToken *key) {
+  if (ConsumeByte(scanner, '}')) {
+    return NO;
+  }
+  if (!*isFirst && !ConsumeByte(scanner, ',')) {
+    return Fail(scanner);
+  }
+  *isFirst = NO;
+  if (!ScanString(scanner, key) || !ConsumeByte(scanner, ':')) {
+    return Fail(scanner);
+  }
+  return YES;
+}
+
+/**
+ * Advances to the next element of an array whose opening bracket has been consumed. Returns NO
+ * once the closing bracket is consumed or if the input is malformed.
+ */
+static BOOL NextArrayElement(GRSDScanner *scanner, BOOL *isFirst) {
+  if (ConsumeByte(scanner, ']')) {
+    return NO;
+  }
+  if (!*isFirst && !ConsumeByte(scanner, ',')) {
+    return Fail(scanner);
+  }
+  *isFirst = NO;
+  return YES;
+}
+
+static BOOL ScanObjectStart(GRSDScanner *scanner) {
+  return ConsumeByte(scanner, '{') || Fail(scanner);
+}
+
+static BOOL ScanArrayStart(GRSDScanner *scanner) {
+  return ConsumeByte(scanner, '[') || Fail(scanner);
+}
+
+static NSArray<NSString *> *_Nullable ScanStringArray(GRSDScanner *scanner) {
+  if (!ScanArrayStart(scanner)) {
+    return nil;
+  }
+  NSMutableArray<NSString *> *strings = [[NSMutableArray alloc] init];
+  BOOL isFirst = YES;
+  GRSDStringToken token;
+  while (NextArrayElement(scanner, &isFirst)) {
+    // Elements that aren't strings are skipped.
+    if (PeekValueType(scanner) != GRSDValueTypeString) {
+      if (!SkipValue(scanner)) {
+        return nil;
+      }
+      continue;
+    }
+    if (!ScanString(scanner, &token)) {
+      return nil;
+    }
+    NSString *string = StringFromToken(scanner, token);
+    if (string) {
+      [strings addObject:string];
+    }
+  }
+  return scanner->failed ? nil : strings;
+}
+
+static GMTSTripWaypointType GetTripWaypointTypeFromToken(const GRSDScanner *scanner,
+                                                         GRSDStringToken token) {
+  if (token.hasEscapes) {
+    return GMTSTripWaypointTypeUnknown;
+  }
+  return GRSDTripWaypointTypeFromProviderBytes(scanner->bytes + token.range.location,
+                                               token.range.length);
+}
+
+static BOOL ScanPoint(GRSDScanner *scanner, GRSDWaypointRecord *record) {
+  if (!ScanObjectStart(scanner)) {
+    return NO;
+  }
+  BOOL isFirst = YES;
+  GRSDStringToken key;
+  while (NextObjectKey(scanner, &isFirst, &key)) {
+    GRSDValueType type = PeekValueType(scanner);
+    BOOL scanned;
+    if (TokenEqualsString(scanner, key, kProviderDataKeyLatitude) && type == GRSDValueTypeNumber) {
+      scanned = ScanNumber(scanner, &record->latitude);
+    } else if (TokenEqualsString(scanner, key, kProviderDataKeyLongitude) &&
+               type == GRSDValueTypeNumber) {
+      scanned = ScanNumber(scanner, &record->longitude);
+    } else {
+      scanned = SkipValue(scanner);
+    }
+    if (!scanned) {
+      return NO;
+    }
+  }
+  return !scanner->failed;
+}
+
+static BOOL ScanLocation(GRSDScanner *scanner, GRSDWaypointRecord *record) {
+  if (!ScanObjectStart(scanner)) {
+    return NO;
+  }
+  BOOL isFirst = YES;
+  GRSDStringToken key;
+  while (NextObjectKey(scanner, &isFirst, &key)) {
+    BOOL scanned = TokenEqualsString(scanner, key, kProviderDataKeyPoint) &&
+                           PeekValueType(scanner) == GRSDValueTypeObject
+                       ? ScanPoint(scanner, record)
+                       : SkipValue(scanner);
+    if (!scanned) {
+      return NO;
+    }
+  }
+  return !scanner->failed;
+}
+
+static BOOL ScanWaypoint(GRSDScanner *scanner, GRSDWaypointRecord *record) {
+  if (!ScanObjectStart(scanner)) {
+    return NO;
+  }
+  BOOL isFirst = YES;
+  GRSDStringToken key;
+  while (NextObjectKey(scanner, &isFirst, &key)) {
+    GRSDValueType type = PeekValueType(scanner);
+    BOOL scanned;
+    if (TokenEqualsString(scanner, key, kProviderDataKeyLocation) && type == GRSDValueTypeObject) {
+      scanned = ScanLocation(scanner, record);
+    } else if (TokenEqualsString(scanner, key, kProviderDataKeyTripID) &&
+               type == GRSDValueTypeString) {
+      scanned = ScanString(scanner, &record->tripID);
+      record->hasTripID = scanned;
+    } else if (TokenEqualsString(scanner, key, kProviderDataKeyWaypointType) &&
+               type == GRSDValueTypeString) {
+      GRSDStringToken waypointType;
+      scanned = ScanString(scanner, &waypointType);
+      if (scanned) {
+        record->waypointType = GetTripWaypointTypeFromToken(scanner, waypointType);
+      }
+    } else {
+      scanned = SkipValue(scanner);
+    }
+    if (!scanned) {
+      return NO;
+    }
+  }
+  return !scanner->failed;
+}
+
+/**
+ * The leg distances and ETAs of a route, which provider responses don't include. The vehicle's
+ * position isn't known while decoding, so the first waypoint is treated as reached at the time of
+ * decoding, and each later one as reached along great-circle legs.
+ */
+typedef struct {
+  double *latitudes;
+  double *longitudes;
+  double *legDistances;
+  NSTimeInterval *ETAs;
+} GRSDRouteEstimates;
+
+/** Allocates the estimates of a route of @c count waypoints, whose coordinates are then set. */
+static GRSDRouteEstimates AllocateRouteEstimates(NSUInteger count) {
+  size_t size = MAX(count, 1) * sizeof(double);
+  return (GRSDRouteEstimates){
+      .latitudes = malloc(size),
+      .longitudes = malloc(size),
+      .legDistances = malloc(size),
+      .ETAs = malloc(size),
+  };
+}
+
+/** Estimates the leg distances and ETAs of a route from its coordinates, in one batched pass. */
+static void EstimateRoute(GRSDRouteEstimates *estimates, NSUInteger count,
+                          NSTimeInterval currentTime) {
+  GRSDComputeLegDistances(estimates->latitudes, estimates->longitudes, count,
+                          estimates->legDistances);
+  GRSDComputeArrivalTimes(estimates->legDistances, count, currentTime, GRSDDefaultSpeedModel,
+                          estimates->ETAs);
+}
+
+static void FreeRouteEstimates(GRSDRouteEstimates *estimates) {
+  free(estimates->latitudes);
+  free(estimates->longitudes);
+  free(estimates->legDistances);
+  free(estimates->ETAs);
+}
+
+/** Creates @c GMTSTripWaypoint objects from the records collected by the scanner. */
+static NSArray<GMTSTripWaypoint *> *GetWaypointsFromRecords(const GRSDScanner *scanner,
+                                                            const GRSDWaypointRecord *records,
+                                                            NSUInteger count) {
+  GRSDRouteEstimates estimates = AllocateRouteEstimates(count);
+  for (NSUInteger i = 0; i < count; i++) {
+    estimates.latitudes[i] = records[i].latitude;
+    estimates.longitudes[i] = records[i].longitude;
+  }
+  EstimateRoute(&estimates, count, scanner->currentTime);
+
+  NSMutableArray<GMTSTripWaypoint *> *waypoints = [[NSMutableArray alloc] initWithCapacity:count];
+  // Consecutive waypoints usually belong to the same trip, so the previous trip ID is reused.
+  NSString *tripID;
+  GRSDStringToken tripIDToken = {{0, 0}, NO};
+  for (NSUInteger i = 0; i < count; i++) {
+    const GRSDWaypointRecord *record = &records[i];
+    if (record->hasTripID && (!tripID || !TokensEqual(scanner, record->tripID, tripIDToken))) {
+      tripID = StringFromToken(scanner, record->tripID);
+      tripIDToken = record->tripID;
+    }
+    GMTSLatLng *latlng = [[GMTSLatLng alloc] initWithLatitude:record->latitude
+                                                    longitude:record->longitude];
+    GMTSTerminalLocation *terminalLocation = [[GMTSTerminalLocation alloc] initWithPoint:latlng
+                                                                                   label:nil
+                                                                             description:nil
+                                                                                 placeID:nil
+                                                                             generatedID:nil
+                                                                           accessPointID:nil];
+    GMTSTripWaypoint *waypoint =
+        [[GMTSTripWaypoint alloc] initWithLocation:terminalLocation
+                                            tripID:record->hasTripID ? tripID : nil
+                                      waypointType:record->waypointType
+                distanceToPreviousWaypointInMeters:estimates.legDistances[i]
+                                               ETA:estimates.ETAs[i]];
+    [waypoints addObject:waypoint];
+  }
+  FreeRouteEstimates(&estimates);
+  return waypoints;
+}
+
+static NSArray<GMTSTripWaypoint *> *_Nullable ScanWaypoints(GRSDScanner *scanner) {
+  if (!ScanArrayStart(scanner)) {
+    return nil;
+  }
+  NSMutableData *records = [[NSMutableData alloc] init];
+  BOOL isFirst = YES;
+  while (NextArrayElement(scanner, &isFirst)) {
+    GRSDWaypointRecord record = {0};
+    record.waypointType = GMTSTripWaypointTypeUnknown;
+    // An element that isn't an object is kept as a waypoint without any fields, as the property
+    // list decoder does.
+    BOOL scanned = PeekValueType(scanner) == GRSDValueTypeObject ? ScanWaypoint(scanner, &record)
+                                                                 : SkipValue(scanner);
+    if (!scanned) {
+      return nil;
+    }
+    [records appendBytes:&record length:sizeof(record)];
+  }
+  if (scanner->failed) {
+    return nil;
+  }
+  return GetWaypointsFromRecords(scanner, records.bytes,
+                                 records.length / sizeof(GRSDWaypointRecord));
+}
+
+static GRSDProviderPayload *_Nullable ScanPayload(GRSDScanner *scanner);
+
+static NSArray<GRSDProviderPayload *> *_Nullable ScanPayloadArray(GRSDScanner *scanner) {
+  if (!ScanArrayStart(scanner)) {
+    return nil;
+  }
+  NSMutableArray<GRSDProviderPayload *> *payloads = [[NSMutableArray alloc] init];
+  BOOL isFirst = YES;
+  while (NextArrayElement(scanner, &isFirst)) {
+    // Elements that aren't objects are skipped.
+    if (PeekValueType(scanner) != GRSDValueTypeObject) {
+      if (!SkipValue(scanner)) {
+        return nil;
+      }
+      continue;
+    }
+    GRSDProviderPayload *payload = ScanPayload(scanner);
+    if (!payload) {
+      return nil;
+    }
+    [payloads addObject:payload];
+  }
+  return scanner->failed ? nil : payloads;
+}
+
+/**
+ * Scans the members of a provider response object whose opening brace has been consumed. Members
+ * that are null or of an unexpected type are treated as missing, as by the property list decoder.
+ */
+static GRSDProviderPayload *_Nullable ScanPayloadMembers(GRSDScanner *scanner) {
+  GRSDProviderPayload *payload = [[GRSDProviderPayload alloc] initEmptyPayload];
+  BOOL isFirst = YES;
+  GRSDStringToken key;
+  GRSDStringToken value;
+  while (NextObjectKey(scanner, &isFirst, &key)) {
+    GRSDValueType type = PeekValueType(scanner);
+    if (type == GRSDValueTypeString) {
+      if (TokenEqualsString(scanner, key, kProviderDataKeyName)) {
+        if (ScanString(scanner, &value)) {
+          payload.name = StringFromToken(scanner, value);
+        }
+      } else if (TokenEqualsString(scanner, key, kProviderDataKeyTripStatus)) {
+        if (ScanString(scanner, &value)) {
+          payload.tripStatus = StringFromToken(scanner, value);
+        }
+      } else if (TokenEqualsString(scanner, key, kProviderDataKeyToken)) {
+        if (ScanString(scanner, &value)) {
+          payload.token = StringFromToken(scanner, value);
+        }
+      } else {
+        SkipValue(scanner);
+      }
+    } else if (type == GRSDValueTypeArray) {
+      if (TokenEqualsString(scanner, key, kProviderDataKeyCurrentTripIDs)) {
+        payload.matchedTripIDs = ScanStringArray(scanner);
+      } else if (TokenEqualsString(scanner, key, kProviderDataKeyWaypoints)) {
+        payload.waypoints = ScanWaypoints(scanner);
+      } else if (TokenEqualsString(scanner, key, kProviderDataKeySupportedTripTypes)) {
+        payload.supportedTripTypes = ScanStringArray(scanner);
+      } else if (TokenEqualsString(scanner, key, kProviderDataKeyTrips)) {
+        payload.trips = ScanPayloadArray(scanner);
+      } else {
+        SkipValue(scanner);
+      }
+    } else if (type == GRSDValueTypeNumber) {
+      double number;
+      if (TokenEqualsString(scanner, key, kProviderDataKeyMaximumCapacity)) {
+        if (ScanNumber(scanner, &number)) {
+          payload.maximumCapacity = @(number);
+        }
+      } else if (TokenEqualsString(scanner, key, kProviderDataKeyTokenExpiration)) {
+        if (ScanNumber(scanner, &number)) {
+          payload.tokenExpiration = @(number);
+        }
+      } else {
+        SkipValue(scanner);
+      }
+    } else if (type == GRSDValueTypeBool &&
+               TokenEqualsString(scanner, key, kProviderDataKeyBackToBackEnabled)) {
+      BOOL backToBackEnabled;
+      if (ScanBool(scanner, &backToBackEnabled)) {
+        payload.backToBackEnabled = @(backToBackEnabled);
+      }
+    } else if (type == GRSDValueTypeObject &&
+               TokenEqualsString(scanner, key, kProviderDataKeyTrip)) {
+      payload.trip = ScanPayload(scanner);
+    } else {
+      SkipValue(scanner);
+    }
+    if (scanner->failed) {
+      return nil;
+    }
+  }
+  return scanner->failed ? nil : payload;
+}
+
+/**
+ * Scans a provider response object. The scan fails if the object is nested in more than
+ * @c kMaximumPayloadDepth payloads, so that a hostile response can't exhaust the stack.
+ */
+static GRSDProviderPayload *_Nullable ScanPayload(GRSDScanner *scanner) {
+  if (scanner->payloadDepth >= kMaximumPayloadDepth) {
+    Fail(scanner);
+    return nil;
+  }
+  if (!ScanObjectStart(scanner)) {
+    return nil;
+  }
+  scanner->payloadDepth++;
+  GRSDProviderPayload *payload = ScanPayloadMembers(scanner);
+  scanner->payloadDepth--;
+  return payload;
+}
+
+/** Returns the given property list object if it is of the given class, and nil otherwise. */
+static id _Nullable GetPropertyListObjectOfClass(id _Nullable object, Class objectClass) {
+  return [object isKindOfClass:objectClass] ? object : nil;
+}
+
+static NSArray<NSString *> *_Nullable GetStringArrayFromPropertyList(id _Nullable object) {
+  NSArray *array = GetPropertyListObjectOfClass(object, [NSArray class]);
+  if (!array) {
+    return nil;
+  }
+  NSMutableArray<NSString *> *strings = [[NSMutableArray alloc] initWithCapacity:array.count];
+  for (id element in array) {
+    NSString *string = GetPropertyListObjectOfClass(element, [NSString class]);
+    if (string) {
+      [strings addObject:string];
+    }
+  }
+  return strings;
+}
+
+/** Returns the point of a waypoint property list, with missing coordinates set to 0. */
+static CLLocationCoordinate2D GetPointFromPropertyList(NSDictionary *_Nullable waypointDictionary) {
+  NSDictionary *locationDictionary = GetPropertyListObjectOfClass(
+      waypointDictionary[kPropertyListKeyLocation], [NSDictionary class]);
+  NSDictionary *pointDictionary = GetPropertyListObjectOfClass(
+      locationDictionary[kPropertyListKeyPoint], [NSDictionary class]);
+  NSNumber *latitude =
+      GetPropertyListObjectOfClass(pointDictionary[kPropertyListKeyLatitude], [NSNumber class]);
+  NSNumber *longitude =
+      GetPropertyListObjectOfClass(pointDictionary[kPropertyListKeyLongitude], [NSNumber class]);
+  return CLLocationCoordinate2DMake(latitude.doubleValue, longitude.doubleValue);
+}
+
+static NSArray<GMTSTripWaypoint *> *_Nullable GetWaypointsFromPropertyList(
+    id _Nullable object, NSTimeInterval currentTime) {
+  NSArray *array = GetPropertyListObjectOfClass(object, [NSArray class]);
+  if (!array) {
+    return nil;
+  }
+  NSUInteger count = array.count;
+  GRSDRouteEstimates estimates = AllocateRouteEstimates(count);
+  for (NSUInteger i = 0; i < count; i++) {
+    CLLocationCoordinate2D point =
+        GetPointFromPropertyList(GetPropertyListObjectOfClass(array[i], [NSDictionary class]));
+    estimates.latitudes[i] = point.latitude;
+    estimates.longitudes[i] = point.longitude;
+  }
+  EstimateRoute(&estimates, count, currentTime);
+
+  NSMutableArray<GMTSTripWaypoint *> *waypoints = [[NSMutableArray alloc] initWithCapacity:count];
+  for (NSUInteger i = 0; i < count; i++) {
+    NSDictionary *waypointDictionary = GetPropertyListObjectOfClass(array[i], [NSDictionary class]);
+    NSString *tripID =
+        GetPropertyListObjectOfClass(waypointDictionary[kPropertyListKeyTripID], [NSString class]);
+    NSString *waypointType = GetPropertyListObjectOfClass(
+        waypointDictionary[kPropertyListKeyWaypointType], [NSString class]);
+    GMTSTripWaypointType type = GRSDTripWaypointTypeFromProviderString(waypointType);
+
+    GMTSLatLng *latlng = [[GMTSLatLng alloc] initWithLatitude:estimates.latitudes[i]
+                                                    longitude:estimates.longitudes[i]];
+    GMTSTerminalLocation *terminalLocation = [[GMTSTerminalLocation alloc] initWithPoint:latlng
+                                                                                   label:nil
+                                                                             description:nil
+                                                                                 placeID:nil
+                                                                             generatedID:nil
+                                                                           accessPointID:nil];
+    GMTSTripWaypoint *waypoint =
+        [[GMTSTripWaypoint alloc] initWithLocation:terminalLocation
+                                            tripID:tripID
+                                      waypointType:type
+                distanceToPreviousWaypointInMeters:estimates.legDistances[i]
+                                               ETA:estimates.ETAs[i]];
+    [waypoints addObject:waypoint];
+  }
+  FreeRouteEstimates(&estimates);
+  return waypoints;
+}
+
+/**
+ * Returns the payload of a property list dictionary, or nil if it isn't one. Payloads nested in
+ * more than @c kMaximumPayloadDepth payloads are ignored, like other unexpected values.
+ */
+static GRSDProviderPayload *_Nullable GetPayloadFromPropertyList(id _Nullable object,
+                                                                 NSTimeInterval currentTime,
+                                                                 NSUInteger depth) {
+  NSDictionary<NSString *, id> *dictionary =
+      GetPropertyListObjectOfClass(object, [NSDictionary class]);
+  if (!dictionary || depth >= kMaximumPayloadDepth) {
+    return nil;
+  }
+  GRSDProviderPayload *payload = [[GRSDProviderPayload alloc] initEmptyPayload];
+  payload.name = GetPropertyListObjectOfClass(dictionary[kPropertyListKeyName], [NSString class]);
+  payload.tripStatus =
+      GetPropertyListObjectOfClass(dictionary[kPropertyListKeyTripStatus], [NSString class]);
+  payload.matchedTripIDs =
+      GetStringArrayFromPropertyList(dictionary[kPropertyListKeyCurrentTripIDs]);
+  payload.waypoints =
+      GetWaypointsFromPropertyList(dictionary[kPropertyListKeyWaypoints], currentTime);
+  payload.maximumCapacity =
+      GetPropertyListObjectOfClass(dictionary[kPropertyListKeyMaximumCapacity], [NSNumber class]);
+  payload.backToBackEnabled =
+      GetPropertyListObjectOfClass(dictionary[kPropertyListKeyBackToBackEnabled], [NSNumber class]);
+  payload.supportedTripTypes =
+      GetStringArrayFromPropertyList(dictionary[kPropertyListKeySupportedTripTypes]);
+  payload.token = GetPropertyListObjectOfClass(dictionary[kPropertyListKeyToken], [NSString class]);
+  payload.tokenExpiration =
+      GetPropertyListObjectOfClass(dictionary[kPropertyListKeyTokenExpiration], [NSNumber class]);
+  payload.trip =
+      GetPayloadFromPropertyList(dictionary[kPropertyListKeyTrip], currentTime, depth + 1);
+
+  NSArray *tripsArray =
+      GetPropertyListObjectOfClass(dictionary[kPropertyListKeyTrips], [NSArray class]);
+  if (tripsArray) {
+    NSMutableArray<GRSDProviderPayload *> *trips = [[NSMutableArray alloc] init];
+    for (id tripObject in tripsArray) {
+      GRSDProviderPayload *trip = GetPayloadFromPropertyList(tripObject, currentTime, depth + 1);
+      if (trip) {
+        [trips addObject:trip];
+      }
+    }
+    payload.trips = trips;
+  }
+  return payload;
+}
+
+@implementation GRSDProviderPayload
+
+- (instancetype)initEmptyPayload {
+  return [super init];
+}
+
++ (nullable instancetype)payloadWithData:(NSData *)data
+                             currentTime:(NSTimeInterval)currentTime
+                                   error:(NSError **)error {
+  GRSDScanner scanner = {
+      .bytes = data.bytes,
+      .length = data.length,
+      .position = 0,
+      .failed = NO,
+      .payloadDepth = 0,
+      .currentTime = currentTime,
+  };
+  GRSDProviderPayload *payload = ScanPayload(&scanner);
+  SkipWhitespace(&scanner);
+  if (payload && scanner.position == scanner.length) {
+    return payload;
+  }
+
+  if (error) {
+    NSString *description =
+        [NSString stringWithFormat:@"Invalid provider response around byte %lu.",
+                                   (unsigned long)scanner.position];
+    *error = [NSError errorWithDomain:NSCocoaErrorDomain
+                                 code:NSPropertyListReadCorruptError
+                             userInfo:@{NSDebugDescriptionErrorKey : description}];
+  }
+  return nil;
+}
+
++ (nullable instancetype)payloadWithPropertyListData:(NSData *)data
+                                         currentTime:(NSTimeInterval)currentTime
+                                               error:(NSError **)error {
+  NSError *propertyListError;
+  id propertyList = [NSPropertyListSerialization propertyListWithData:data
+                                                              options:NSPropertyListImmutable
+                                                               format:NULL
+                                                                error:&propertyListError];
+  GRSDProviderPayload *payload = GetPayloadFromPropertyList(propertyList, currentTime, 0);
+  if (!payload && error) {
+    *error = propertyListError
+                 ?: [NSError errorWithDomain:NSCocoaErrorDomain
+                                        code:NSPropertyListReadCorruptError
+                                    userInfo:@{
+                                      NSDebugDescriptionErrorKey :
+                                          @"Provider response is not a property list dictionary."
+                                    }];
+  }
+  return payload;
+}
+
+@end
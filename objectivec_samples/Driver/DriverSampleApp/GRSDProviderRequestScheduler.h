@@ -0,0 +1,105 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class GRSDProviderEndpointSet;
+
+/** The priority class of a provider request. */
+typedef NS_ENUM(NSInteger, GRSDProviderRequestPriority) {
+  /** A request the driver is waiting on, such as a trip status update. */
+  GRSDProviderRequestPriorityInteractive = 0,
+  /** A request made on behalf of polling or prefetching. */
+  GRSDProviderRequestPriorityBackground,
+};
+
+/** Completion handler of a scheduled request, matching that of @c NSURLSessionDataTask. */
+typedef void (^GRSDProviderRequestCompletionHandler)(NSData *_Nullable data,
+                                                     NSURLResponse *_Nullable response,
+                                                     NSError *_Nullable error);
+
+/**
+ * Block definition that cancels a scheduled request, which then completes with an
+ * @c NSURLErrorCancelled error. Does nothing once the request has completed.
+ */
+typedef void (^GRSDProviderRequestCancellation)(void);
+
+/**
+ * Block definition that starts an operation that sends requests for a resource.
+ *
+ * @param finishOperation The block to call once the operation has finished.
+ * @return A block that cancels the operation.
+ */
+typedef GRSDProviderRequestCancellation _Nonnull (^GRSDProviderOperationStart)(
+    dispatch_block_t finishOperation);
+
+/**
+ * Schedules provider requests so that interactive requests are never held up by background
+ * traffic.
+ *
+ * Interactive requests start as soon as they are scheduled. Background requests are limited to
+ * @c maximumConcurrentBackgroundRequests in flight and wait while any interactive request is in
+ * flight. A request scheduled with a resource key supersedes the pending or in-flight request for
+ * the same key, which then completes with an @c NSURLErrorCancelled error, and so does an operation
+ * that sends several requests for a resource, such as the attempts of a retried request.
+ */
+@interface GRSDProviderRequestScheduler : NSObject
+
+/**
+ * The provider replicas that requests are routed to when they start, or nil to send requests
+ * unchanged.
+ */
+@property(nonatomic, strong, nullable) GRSDProviderEndpointSet *endpointSet;
+
+/** The maximum number of background requests in flight. Defaults to 4. */
+@property(nonatomic) NSUInteger maximumConcurrentBackgroundRequests;
+
+/**
+ * Schedules a request, which is sent once its priority allows it to start.
+ *
+ * @param request The request to send.
+ * @param session The session to send the request with. The completion handler is called on the
+ * session's delegate queue.
+ * @param priority The priority class of the request.
+ * @param resourceKey Identifies the resource the request is for, such as its URL, or nil if the
+ * request should never be superseded.
+ * @param longPoll Whether the provider holds the request open until it has something to report,
+ * so that it doesn't count towards its replica's latency.
+ * @param completionHandler The block executed when the request finishes or is superseded.
+ * @return A block that cancels the request.
+ */
+- (GRSDProviderRequestCancellation)scheduleRequest:(NSURLRequest *)request
+                                         inSession:(NSURLSession *)session
+                                          priority:(GRSDProviderRequestPriority)priority
+                                       resourceKey:(nullable NSString *)resourceKey
+                                          longPoll:(BOOL)longPoll
+                                 completionHandler:
+                                     (GRSDProviderRequestCompletionHandler)completionHandler;
+
+/**
+ * Starts an operation that sends requests for a resource, such as every attempt of a retried and
+ * hedged request, and cancels the operation still running for the same resource key. The requests
+ * of an operation should be scheduled without a resource key of their own.
+ *
+ * @param resourceKey Identifies the resource the operation is for, such as its URL.
+ * @param startOperation The block that starts the operation.
+ */
+- (void)startOperationForResourceKey:(NSString *)resourceKey
+                          usingBlock:(GRSDProviderOperationStart)startOperation;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,267 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#import "GRSDProviderRequestScheduler.h"
+
+#import "GRSDProviderEndpointSet.h"
+
+static const NSUInteger kDefaultMaximumConcurrentBackgroundRequests = 4;
+
+/** A request along with the state needed to start, supersede or complete it. */
+@interface GRSDScheduledProviderRequest : NSObject
+
+@property(nonatomic, copy) NSURLRequest *request;
+@property(nonatomic, strong) NSURLSession *session;
+@property(nonatomic) GRSDProviderRequestPriority priority;
+@property(nonatomic, copy, nullable) NSString *resourceKey;
+@property(nonatomic, getter=isLongPoll) BOOL longPoll;
+@property(nonatomic, copy) GRSDProviderRequestCompletionHandler completionHandler;
+@property(nonatomic, strong, nullable) NSURLSessionDataTask *task;
+@property(nonatomic, getter=isCancelled) BOOL cancelled;
+@property(nonatomic, getter=isFinished) BOOL finished;
+
+@end
+
+@implementation GRSDScheduledProviderRequest
+@end
+
+/** An operation that sends requests for a resource, which a newer one for it supersedes. */
+@interface GRSDSupersedableProviderOperation : NSObject
+
+/** Cancels the operation, or nil until the operation has started. */
+@property(nonatomic, copy, nullable) GRSDProviderRequestCancellation cancellation;
+@property(nonatomic, getter=isCancelled) BOOL cancelled;
+
+@end
+
+@implementation GRSDSupersedableProviderOperation
+@end
+
+@implementation GRSDProviderRequestScheduler {
+  NSUInteger _interactiveRequestCount;
+  NSUInteger _backgroundRequestCount;
+  /** Background requests waiting to start, in the order they were scheduled. */
+  NSMutableArray<GRSDScheduledProviderRequest *> *_pendingBackgroundRequests;
+  /** The most recently scheduled request for each resource key. */
+  NSMutableDictionary<NSString *, GRSDScheduledProviderRequest *> *_requestsByResourceKey;
+  /** The most recently started operation for each resource key. */
+  NSMutableDictionary<NSString *, GRSDSupersedableProviderOperation *> *_operationsByResourceKey;
+}
+
+- (instancetype)init {
+  self = [super init];
+  if (self) {
+    _maximumConcurrentBackgroundRequests = kDefaultMaximumConcurrentBackgroundRequests;
+    _pendingBackgroundRequests = [[NSMutableArray alloc] init];
+    _requestsByResourceKey = [[NSMutableDictionary alloc] init];
+    _operationsByResourceKey = [[NSMutableDictionary alloc] init];
+  }
+  return self;
+}
+
+- (NSUInteger)maximumConcurrentBackgroundRequests {
+  @synchronized(self) {
+    return _maximumConcurrentBackgroundRequests;
+  }
+}
+
+- (void)setMaximumConcurrentBackgroundRequests:(NSUInteger)maximumConcurrentBackgroundRequests {
+  @synchronized(self) {
+    _maximumConcurrentBackgroundRequests = MAX(maximumConcurrentBackgroundRequests, 1);
+    [self startPendingBackgroundRequests];
+  }
+}
+
+- (GRSDProviderRequestCancellation)scheduleRequest:(NSURLRequest *)request
+                                         inSession:(NSURLSession *)session
+                                          priority:(GRSDProviderRequestPriority)priority
+                                       resourceKey:(nullable NSString *)resourceKey
+                                          longPoll:(BOOL)longPoll
+                                 completionHandler:
+                                     (GRSDProviderRequestCompletionHandler)completionHandler {
+  GRSDScheduledProviderRequest *scheduledRequest = [[GRSDScheduledProviderRequest alloc] init];
+  scheduledRequest.request = request;
+  scheduledRequest.session = session;
+  scheduledRequest.priority = priority;
+  scheduledRequest.resourceKey = resourceKey;
+  scheduledRequest.longPoll = longPoll;
+  scheduledRequest.completionHandler = completionHandler;
+
+  GRSDScheduledProviderRequest *supersededRequest;
+  @synchronized(self) {
+    if (resourceKey) {
+      supersededRequest = _requestsByResourceKey[resourceKey];
+      _requestsByResourceKey[resourceKey] = scheduledRequest;
+    }
+    if (priority == GRSDProviderRequestPriorityInteractive) {
+      [self startRequest:scheduledRequest];
+    } else {
+      [_pendingBackgroundRequests addObject:scheduledRequest];
+      [self startPendingBackgroundRequests];
+    }
+  }
+  if (supersededRequest) {
+    [self cancelRequest:supersededRequest];
+  }
+  __weak typeof(self) weakSelf = self;
+  return ^{
+    [weakSelf cancelRequest:scheduledRequest];
+  };
+}
+
+- (void)startOperationForResourceKey:(NSString *)resourceKey
+                          usingBlock:(GRSDProviderOperationStart)startOperation {
+  GRSDSupersedableProviderOperation *operation = [[GRSDSupersedableProviderOperation alloc] init];
+  GRSDSupersedableProviderOperation *supersededOperation;
+  @synchronized(self) {
+    supersededOperation = _operationsByResourceKey[resourceKey];
+    _operationsByResourceKey[resourceKey] = operation;
+  }
+  if (supersededOperation) {
+    [self cancelOperation:supersededOperation];
+  }
+
+  __weak typeof(self) weakSelf = self;
+  GRSDProviderRequestCancellation cancellation = startOperation(^{
+    [weakSelf finishOperation:operation forResourceKey:resourceKey];
+  });
+  BOOL isCancelled;
+  @synchronized(operation) {
+    operation.cancellation = cancellation;
+    isCancelled = operation.isCancelled;
+  }
+  // The operation may have been superseded while it started.
+  if (isCancelled) {
+    cancellation();
+  }
+}
+
+#pragma mark - Private
+
+/** Cancels an operation, or marks it to be cancelled as soon as it has started. */
+- (void)cancelOperation:(GRSDSupersedableProviderOperation *)operation {
+  GRSDProviderRequestCancellation cancellation;
+  @synchronized(operation) {
+    if (operation.isCancelled) {
+      return;
+    }
+    operation.cancelled = YES;
+    cancellation = operation.cancellation;
+  }
+  if (cancellation) {
+    cancellation();
+  }
+}
+
+/** Forgets an operation that has finished unless a newer operation has superseded it. */
+- (void)finishOperation:(GRSDSupersedableProviderOperation *)operation
+         forResourceKey:(NSString *)resourceKey {
+  @synchronized(self) {
+    if (_operationsByResourceKey[resourceKey] == operation) {
+      [_operationsByResourceKey removeObjectForKey:resourceKey];
+    }
+  }
+}
+
+/** Cancels a request, which then completes with an @c NSURLErrorCancelled error. */
+- (void)cancelRequest:(GRSDScheduledProviderRequest *)scheduledRequest {
+  NSURLSessionDataTask *task;
+  @synchronized(self) {
+    if (scheduledRequest.isCancelled || scheduledRequest.isFinished) {
+      return;
+    }
+    scheduledRequest.cancelled = YES;
+    task = scheduledRequest.task;
+    if (!task) {
+      [_pendingBackgroundRequests removeObjectIdenticalTo:scheduledRequest];
+      [self removeResourceKeyOfRequest:scheduledRequest];
+      scheduledRequest.finished = YES;
+    }
+  }
+
+  if (task) {
+    // The task's completion handler reports the cancellation.
+    [task cancel];
+    return;
+  }
+  GRSDProviderRequestCompletionHandler completionHandler = scheduledRequest.completionHandler;
+  NSError *error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil];
+  [scheduledRequest.session.delegateQueue addOperationWithBlock:^{
+    completionHandler(nil, nil, error);
+  }];
+}
+
+/** Starts a request. Must be called while synchronized on @c self. */
+- (void)startRequest:(GRSDScheduledProviderRequest *)scheduledRequest {
+  if (scheduledRequest.priority == GRSDProviderRequestPriorityInteractive) {
+    _interactiveRequestCount++;
+  } else {
+    _backgroundRequestCount++;
+  }
+  GRSDProviderEndpointSet *endpointSet = _endpointSet;
+  GRSDRoutedProviderRequest *routedRequest =
+      [endpointSet routeRequest:scheduledRequest.request longPoll:scheduledRequest.isLongPoll];
+  NSURLSessionDataTask *task = [scheduledRequest.session
+      dataTaskWithRequest:routedRequest ? routedRequest.request : scheduledRequest.request
+        completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
+          if (routedRequest) {
+            [endpointSet finishRoutedRequest:routedRequest withResponse:response error:error];
+          }
+          [self finishRequest:scheduledRequest];
+          scheduledRequest.completionHandler(data, response, error);
+        }];
+  scheduledRequest.task = task;
+  [task resume];
+}
+
+- (void)finishRequest:(GRSDScheduledProviderRequest *)scheduledRequest {
+  @synchronized(self) {
+    if (scheduledRequest.priority == GRSDProviderRequestPriorityInteractive) {
+      _interactiveRequestCount--;
+    } else {
+      _backgroundRequestCount--;
+    }
+    [self removeResourceKeyOfRequest:scheduledRequest];
+    scheduledRequest.task = nil;
+    scheduledRequest.finished = YES;
+    [self startPendingBackgroundRequests];
+  }
+}
+
+/**
+ * Starts pending background requests while no interactive request is in flight and the background
+ * limit allows. Must be called while synchronized on @c self.
+ */
+- (void)startPendingBackgroundRequests {
+  while (_interactiveRequestCount == 0 &&
+         _backgroundRequestCount < _maximumConcurrentBackgroundRequests &&
+         _pendingBackgroundRequests.count > 0) {
+    GRSDScheduledProviderRequest *scheduledRequest = _pendingBackgroundRequests.firstObject;
+    [_pendingBackgroundRequests removeObjectAtIndex:0];
+    [self startRequest:scheduledRequest];
+  }
+}
+
+/**
+ * Forgets the request's resource key unless a newer request has taken it over. Must be called while
+ * synchronized on @c self.
+ */
+- (void)removeResourceKeyOfRequest:(GRSDScheduledProviderRequest *)scheduledRequest {
+  NSString *resourceKey = scheduledRequest.resourceKey;
+  if (resourceKey && _requestsByResourceKey[resourceKey] == scheduledRequest) {
+    [_requestsByResourceKey removeObjectForKey:resourceKey];
+  }
+}
+
+@end
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * A bounded in-memory cache of provider responses, keyed by request URL.
+ *
+ * The cache keeps the validators (ETag and Last-Modified) returned with each response so that later
+ * requests for the same URL can be made conditional. When the provider answers one of those with
+ * 304 Not Modified, the previously received body is reused without downloading it again. Bodies are
+ * cached rather than the models decoded from them, because decoding derives values that are
+ * relative to the time of decoding, such as the waypoints' ETAs, which must be derived again for
+ * the current time. Once the cache is full, the least recently used response is evicted.
+ */
+@interface GRSDProviderResponseCache : NSObject
+
+/** The maximum number of responses held by the cache. */
+@property(nonatomic, readonly) NSUInteger capacity;
+
+/** Number of requests that were made conditional using a cached response. */
+@property(nonatomic, readonly) NSUInteger hitCount;
+
+/** Number of requests sent unconditionally because no response was cached for the URL. */
+@property(nonatomic, readonly) NSUInteger missCount;
+
+/** Number of 304 responses that were served from the cache. */
+@property(nonatomic, readonly) NSUInteger notModifiedCount;
+
+/**
+ * Initializes an instance of this class.
+ *
+ * @param capacity The maximum number of responses held by the cache.
+ */
+- (instancetype)initWithCapacity:(NSUInteger)capacity NS_DESIGNATED_INITIALIZER;
+
+/** Initializes an instance of this class with a default capacity. */
+- (instancetype)init;
+
+/**
+ * Adds the validators of the response cached for the request's URL, if any, so that the provider
+ * can answer with 304 Not Modified.
+ *
+ * @param request The GET request to make conditional.
+ */
+- (void)addValidatorsToRequest:(NSMutableURLRequest *)request;
+
+/**
+ * Returns the body and the response cached for a URL, or nil if it has been evicted. Call this when
+ * the provider answers a conditional request with 304 Not Modified, and decode the body again.
+ *
+ * @param URL The URL of the request.
+ */
+- (nullable NSCachedURLResponse *)cachedResponseForNotModifiedResponseToURL:(NSURL *)URL;
+
+/**
+ * Stores the body of a response, replacing any response previously cached for the URL. Responses
+ * without validators are not cached since they can't be revalidated.
+ *
+ * @param data The body of the response.
+ * @param response The response.
+ * @param URL The URL of the request.
+ */
+- (void)storeData:(NSData *)data forResponse:(NSHTTPURLResponse *)response URL:(NSURL *)URL;
+
+@end
+
+NS_ASSUME_NONNULL_END
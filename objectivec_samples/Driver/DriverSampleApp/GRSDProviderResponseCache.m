@@ -0,0 +1,121 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#import "GRSDProviderResponseCache.h"
+
+static const NSUInteger kDefaultCapacity = 32;
+
+static NSString *const kHTTPETagHeaderField = @"ETag";
+static NSString *const kHTTPLastModifiedHeaderField = @"Last-Modified";
+static NSString *const kHTTPIfNoneMatchHeaderField = @"If-None-Match";
+static NSString *const kHTTPIfModifiedSinceHeaderField = @"If-Modified-Since";
+
+/** A response along with the validators needed to revalidate it. */
+@interface GRSDCachedProviderResponse : NSObject
+
+@property(nonatomic, copy, nullable) NSString *ETag;
+@property(nonatomic, copy, nullable) NSString *lastModified;
+@property(nonatomic, strong) NSCachedURLResponse *response;
+
+@end
+
+@implementation GRSDCachedProviderResponse
+@end
+
+@implementation GRSDProviderResponseCache {
+  NSMutableDictionary<NSURL *, GRSDCachedProviderResponse *> *_responses;
+  /** URLs of the cached responses, from least to most recently used. */
+  NSMutableArray<NSURL *> *_URLsByRecentUse;
+}
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity {
+  self = [super init];
+  if (self) {
+    _capacity = MAX(capacity, 1);
+    _responses = [[NSMutableDictionary alloc] initWithCapacity:_capacity];
+    _URLsByRecentUse = [[NSMutableArray alloc] initWithCapacity:_capacity];
+  }
+  return self;
+}
+
+- (instancetype)init {
+  return [self initWithCapacity:kDefaultCapacity];
+}
+
+- (void)addValidatorsToRequest:(NSMutableURLRequest *)request {
+  @synchronized(self) {
+    GRSDCachedProviderResponse *cachedResponse = _responses[request.URL.absoluteURL];
+    if (!cachedResponse) {
+      _missCount++;
+      return;
+    }
+    _hitCount++;
+    if (cachedResponse.ETag) {
+      [request setValue:cachedResponse.ETag forHTTPHeaderField:kHTTPIfNoneMatchHeaderField];
+    }
+    if (cachedResponse.lastModified) {
+      [request setValue:cachedResponse.lastModified
+          forHTTPHeaderField:kHTTPIfModifiedSinceHeaderField];
+    }
+  }
+}
+
+- (nullable NSCachedURLResponse *)cachedResponseForNotModifiedResponseToURL:(NSURL *)URL {
+  @synchronized(self) {
+    NSURL *key = URL.absoluteURL;
+    GRSDCachedProviderResponse *cachedResponse = _responses[key];
+    if (!cachedResponse) {
+      return nil;
+    }
+    _notModifiedCount++;
+    [self markURLAsMostRecentlyUsed:key];
+    return cachedResponse.response;
+  }
+}
+
+- (void)storeData:(NSData *)data forResponse:(NSHTTPURLResponse *)response URL:(NSURL *)URL {
+  NSString *ETag = response.allHeaderFields[kHTTPETagHeaderField];
+  NSString *lastModified = response.allHeaderFields[kHTTPLastModifiedHeaderField];
+  NSURL *key = URL.absoluteURL;
+  @synchronized(self) {
+    if (!ETag && !lastModified) {
+      [_responses removeObjectForKey:key];
+      [_URLsByRecentUse removeObject:key];
+      return;
+    }
+
+    GRSDCachedProviderResponse *cachedResponse = [[GRSDCachedProviderResponse alloc] init];
+    cachedResponse.ETag = ETag;
+    cachedResponse.lastModified = lastModified;
+    cachedResponse.response = [[NSCachedURLResponse alloc] initWithResponse:response data:data];
+    _responses[key] = cachedResponse;
+    [self markURLAsMostRecentlyUsed:key];
+
+    while (_URLsByRecentUse.count > _capacity) {
+      [_responses removeObjectForKey:_URLsByRecentUse.firstObject];
+      [_URLsByRecentUse removeObjectAtIndex:0];
+    }
+  }
+}
+
+#pragma mark - Private
+
+/** Moves the given URL to the most recently used end of the eviction order. */
+- (void)markURLAsMostRecentlyUsed:(NSURL *)URL {
+  [_URLsByRecentUse removeObject:URL];
+  [_URLsByRecentUse addObject:URL];
+}
+
+@end
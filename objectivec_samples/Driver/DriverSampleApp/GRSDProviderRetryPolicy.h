@@ -0,0 +1,111 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#import <Foundation/Foundation.h>
+
+#import "GRSDProviderRequestScheduler.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** How a provider request is retried when it fails. */
+typedef NS_ENUM(NSInteger, GRSDProviderRetryMode) {
+  /** The request is sent once, such as a request that isn't idempotent. */
+  GRSDProviderRetryModeNone = 0,
+  /** The request is sent again when it fails with a transient error. */
+  GRSDProviderRetryModeRetry,
+  /** The request is retried, and also hedged when it is slower than usual. */
+  GRSDProviderRetryModeRetryAndHedge,
+};
+
+/**
+ * Block definition that sends one attempt at a request and calls @c completionHandler exactly once.
+ * Attempts must not supersede each other; a request that supersedes stale ones should do so as a
+ * whole, with the block that cancels it.
+ *
+ * @param isFirstAttempt Whether this is the first attempt at the request, rather than a retry or a
+ * hedge.
+ * @param completionHandler The block to call when the attempt finishes.
+ * @return A block that cancels the attempt, or nil if it can't be cancelled.
+ */
+typedef GRSDProviderRequestCancellation _Nullable (^GRSDProviderRequestAttempt)(
+    BOOL isFirstAttempt, GRSDProviderRequestCompletionHandler completionHandler);
+
+/**
+ * Retries failed provider requests with jittered exponential backoff, and hedges slow ones.
+ *
+ * A request is retried when it fails with a transient network error, or when the provider answers
+ * with a 408, 429, 500, 502, 503 or 504 status, up to @c maximumAttempts attempts in total. Before
+ * each retry the policy waits for a random delay of up to @c baseRetryDelay, doubled for every
+ * earlier retry and capped at @c maximumRetryDelay, so that clients that failed together don't
+ * retry together.
+ *
+ * Retries and hedges are paid for from a retry budget, which each request adds
+ * @c retryBudgetRatio to, so that they add at most that fraction of extra requests while the
+ * provider is failing instead of multiplying its load.
+ *
+ * A hedged request is sent again once its first attempt has been in flight for longer than the 95th
+ * percentile latency of recent requests with the same hedge key, such as the name of the call,
+ * since calls differ widely in how long they take. The first of the two attempts to succeed is
+ * used, and the other one is cancelled. The request only fails once both attempts have failed.
+ */
+@interface GRSDProviderRetryPolicy : NSObject
+
+/** The maximum number of attempts at a request, including the first one. Defaults to 3. */
+@property(nonatomic) NSUInteger maximumAttempts;
+
+/** The maximum delay, in seconds, before the first retry. Defaults to 0.1 seconds. */
+@property(nonatomic) NSTimeInterval baseRetryDelay;
+
+/** The maximum delay, in seconds, before any retry. Defaults to 2 seconds. */
+@property(nonatomic) NSTimeInterval maximumRetryDelay;
+
+/** The number of retries that each request adds to the retry budget. Defaults to 0.2. */
+@property(nonatomic) double retryBudgetRatio;
+
+/** The maximum number of retries that the retry budget can hold. Defaults to 10. */
+@property(nonatomic) double maximumRetryBudget;
+
+/** Whether requests made with @c GRSDProviderRetryModeRetryAndHedge are hedged. Defaults to NO. */
+@property(nonatomic, getter=isHedgingEnabled) BOOL hedgingEnabled;
+
+/**
+ * Returns the time, in seconds, after which a hedged request with the given hedge key is sent
+ * again. It is the 95th percentile latency of recent successful attempts with that key, or 0 until
+ * enough of them have been observed.
+ */
+- (NSTimeInterval)hedgeDelayForKey:(NSString *)hedgeKey;
+
+/**
+ * Sends a request, retrying and hedging it as the retry mode allows.
+ *
+ * @param retryMode How the request is retried.
+ * @param hedgeKey Identifies the kind of request, such as the name of the call, so that its hedge
+ * delay is computed from the latencies of requests of the same kind. A request without one is never
+ * hedged.
+ * @param attempt The block that sends one attempt at the request.
+ * @param completionHandler The block executed with the result of the attempt that is used, which
+ * for a request that could not be sent is the result of its last attempt.
+ * @return A block that cancels the request as a whole, including a retry that is waiting to start
+ * and every attempt in flight, after which the request completes with an @c NSURLErrorCancelled
+ * error.
+ */
+- (GRSDProviderRequestCancellation)
+    performRequestWithRetryMode:(GRSDProviderRetryMode)retryMode
+                       hedgeKey:(nullable NSString *)hedgeKey
+                        attempt:(GRSDProviderRequestAttempt)attempt
+              completionHandler:(GRSDProviderRequestCompletionHandler)completionHandler;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,133 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Generated by tools/generate_provider_schema.py from tools/provider_schema.json. Do not edit.
+
+#import <Foundation/Foundation.h>
+
+#import <GoogleRidesharingDriver/GoogleRidesharingDriver.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** The trip types a vehicle can support. */
+typedef NS_OPTIONS(NSUInteger, ProviderSupportedTripType) {
+  ProviderSupportedTripTypeNone = 0,
+  ProviderSupportedTripTypeExclusive = (1 << 0),
+  ProviderSupportedTripTypeShared = (1 << 1),
+};
+
+#pragma mark - TripStatus
+
+/**
+ * Returns the @c GMTSTripStatus of a provider string, or @c GMTSTripStatusUnknown if the string is
+ * not known.
+ */
+GMTSTripStatus GRSDTripStatusFromProviderString(NSString *_Nullable string);
+
+/** Returns the provider string of a @c GMTSTripStatus. */
+NSString *GRSDProviderStringFromTripStatus(GMTSTripStatus value);
+
+#pragma mark - WaypointType
+
+/**
+ * Returns the @c GMTSTripWaypointType of a provider string, or @c GMTSTripWaypointTypeUnknown if
+ * the string is not known.
+ */
+GMTSTripWaypointType GRSDTripWaypointTypeFromProviderString(NSString *_Nullable string);
+
+/**
+ * Returns the @c GMTSTripWaypointType of a provider string given as its UTF-8 bytes, without
+ * escapes, or @c GMTSTripWaypointTypeUnknown if the string is not known.
+ */
+GMTSTripWaypointType GRSDTripWaypointTypeFromProviderBytes(const uint8_t *bytes, size_t length);
+
+#pragma mark - TripType
+
+/**
+ * Returns the @c ProviderSupportedTripType named by provider strings. Unknown strings are ignored.
+ */
+ProviderSupportedTripType GRSDSupportedTripTypesFromProviderStrings(
+    NSArray<NSString *> *_Nullable strings);
+
+/** Returns the provider strings of the set @c ProviderSupportedTripType options. */
+NSArray<NSString *> *GRSDProviderStringsFromSupportedTripTypes(ProviderSupportedTripType options);
+
+#pragma mark - URLs
+
+/**
+ * The token of a vehicle.
+ *
+ * Returns the URL of @c token/driver/{vehicleID} relative to @c baseURL, with the parameters
+ * percent-encoded, or nil if it is not valid.
+ */
+NSURL *_Nullable GRSDProviderDriverTokenURL(NSURL *baseURL, NSString *vehicleID);
+
+/**
+ * Creates a vehicle.
+ *
+ * Returns the URL of @c vehicle/new relative to @c baseURL, or nil if it is not valid.
+ */
+NSURL *_Nullable GRSDProviderCreateVehicleURL(NSURL *baseURL);
+
+/**
+ * Gets or updates a vehicle.
+ *
+ * Returns the URL of @c vehicle/{vehicleID} relative to @c baseURL, with the parameters
+ * percent-encoded, or nil if it is not valid.
+ */
+NSURL *_Nullable GRSDProviderVehicleURL(NSURL *baseURL, NSString *vehicleID);
+
+/**
+ * Waits for the matched trips or waypoints of a vehicle to change.
+ *
+ * Returns the URL of @c vehicle/{vehicleID}/events relative to @c baseURL, with the parameters
+ * percent-encoded, or nil if it is not valid.
+ */
+NSURL *_Nullable GRSDProviderVehicleUpdatesURL(NSURL *baseURL, NSString *vehicleID);
+
+/**
+ * Gets or updates a trip.
+ *
+ * Returns the URL of @c trip/{tripID} relative to @c baseURL, with the parameters percent-encoded,
+ * or nil if it is not valid.
+ */
+NSURL *_Nullable GRSDProviderTripURL(NSURL *baseURL, NSString *tripID);
+
+/**
+ * Gets several trips, whose comma-separated IDs are passed in tripIDs.
+ *
+ * Returns the URL of @c trips?tripIds={tripIDs} relative to @c baseURL, with the parameters
+ * percent-encoded, or nil if it is not valid.
+ */
+NSURL *_Nullable GRSDProviderBatchGetTripsURL(NSURL *baseURL, NSString *tripIDs);
+
+#pragma mark - Request bodies
+
+/** The body of a create vehicle request. */
+NSDictionary<NSString *, id> *GRSDProviderCreateVehicleRequestBody(NSString *vehicleID,
+                                                                   BOOL backToBackEnabled);
+
+/** The body of an update vehicle request. */
+NSDictionary<NSString *, id> *GRSDProviderUpdateVehicleRequestBody(
+    NSString *vehicleID,
+    NSInteger maximumCapacity,
+    BOOL backToBackEnabled,
+    ProviderSupportedTripType supportedTripTypes);
+
+/** The body of an update trip request. */
+NSDictionary<NSString *, id> *GRSDProviderUpdateTripRequestBody(
+    GMTSTripStatus status, NSNumber *_Nullable intermediateDestinationIndex);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,232 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Generated by tools/generate_provider_schema.py from tools/provider_schema.json. Do not edit.
+
+#import "GRSDProviderSchema.h"
+
+#import <string.h>
+
+#pragma mark - TripStatus
+
+GMTSTripStatus GRSDTripStatusFromProviderString(NSString *_Nullable string) {
+  static NSDictionary<NSString *, NSNumber *> *valuesByString;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    valuesByString = @{
+      @"NEW" : @(GMTSTripStatusNew),
+      @"ENROUTE_TO_PICKUP" : @(GMTSTripStatusEnrouteToPickup),
+      @"ARRIVED_AT_PICKUP" : @(GMTSTripStatusArrivedAtPickup),
+      @"ENROUTE_TO_INTERMEDIATE_DESTINATION" : @(GMTSTripStatusEnrouteToIntermediateDestination),
+      @"ARRIVED_AT_INTERMEDIATE_DESTINATION" : @(GMTSTripStatusArrivedAtIntermediateDestination),
+      @"ENROUTE_TO_DROPOFF" : @(GMTSTripStatusEnrouteToDropoff),
+      @"COMPLETE" : @(GMTSTripStatusComplete),
+    };
+  });
+  NSNumber *value = string ? valuesByString[(NSString *)string] : nil;
+  return value ? (GMTSTripStatus)value.integerValue : GMTSTripStatusUnknown;
+}
+
+NSString *GRSDProviderStringFromTripStatus(GMTSTripStatus value) {
+  switch (value) {
+    case GMTSTripStatusNew:
+      return @"NEW";
+    case GMTSTripStatusEnrouteToPickup:
+      return @"ENROUTE_TO_PICKUP";
+    case GMTSTripStatusArrivedAtPickup:
+      return @"ARRIVED_AT_PICKUP";
+    case GMTSTripStatusEnrouteToIntermediateDestination:
+      return @"ENROUTE_TO_INTERMEDIATE_DESTINATION";
+    case GMTSTripStatusArrivedAtIntermediateDestination:
+      return @"ARRIVED_AT_INTERMEDIATE_DESTINATION";
+    case GMTSTripStatusEnrouteToDropoff:
+      return @"ENROUTE_TO_DROPOFF";
+    case GMTSTripStatusComplete:
+      return @"COMPLETE";
+    case GMTSTripStatusCanceled:
+      return @"CANCELED";
+    case GMTSTripStatusUnknown:
+      return @"UNKNOWN";
+  }
+}
+
+#pragma mark - WaypointType
+
+GMTSTripWaypointType GRSDTripWaypointTypeFromProviderString(NSString *_Nullable string) {
+  static NSDictionary<NSString *, NSNumber *> *valuesByString;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    valuesByString = @{
+      @"PICKUP_WAYPOINT_TYPE" : @(GMTSTripWaypointTypePickUp),
+      @"DROP_OFF_WAYPOINT_TYPE" : @(GMTSTripWaypointTypeDropOff),
+      @"INTERMEDIATE_DESTINATION_WAYPOINT_TYPE" : @(GMTSTripWaypointTypeIntermediateDestination),
+    };
+  });
+  NSNumber *value = string ? valuesByString[(NSString *)string] : nil;
+  return value ? (GMTSTripWaypointType)value.integerValue : GMTSTripWaypointTypeUnknown;
+}
+
+GMTSTripWaypointType GRSDTripWaypointTypeFromProviderBytes(const uint8_t *bytes, size_t length) {
+  switch (length) {
+    case 20:
+      return memcmp(bytes, "PICKUP_WAYPOINT_TYPE", 20) == 0
+                 ? GMTSTripWaypointTypePickUp
+                 : GMTSTripWaypointTypeUnknown;
+    case 22:
+      return memcmp(bytes, "DROP_OFF_WAYPOINT_TYPE", 22) == 0
+                 ? GMTSTripWaypointTypeDropOff
+                 : GMTSTripWaypointTypeUnknown;
+    case 38:
+      return memcmp(bytes, "INTERMEDIATE_DESTINATION_WAYPOINT_TYPE", 38) == 0
+                 ? GMTSTripWaypointTypeIntermediateDestination
+                 : GMTSTripWaypointTypeUnknown;
+    default:
+      return GMTSTripWaypointTypeUnknown;
+  }
+}
+
+#pragma mark - TripType
+
+ProviderSupportedTripType GRSDSupportedTripTypesFromProviderStrings(
+    NSArray<NSString *> *_Nullable strings) {
+  static NSDictionary<NSString *, NSNumber *> *optionsByString;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    optionsByString = @{
+      @"EXCLUSIVE" : @(ProviderSupportedTripTypeExclusive),
+      @"SHARED" : @(ProviderSupportedTripTypeShared),
+    };
+  });
+  ProviderSupportedTripType options = ProviderSupportedTripTypeNone;
+  for (NSString *string in strings) {
+    options |= optionsByString[string].unsignedIntegerValue;
+  }
+  return options;
+}
+
+NSArray<NSString *> *GRSDProviderStringsFromSupportedTripTypes(ProviderSupportedTripType options) {
+  NSMutableArray<NSString *> *strings = [[NSMutableArray alloc] init];
+  if (options & ProviderSupportedTripTypeExclusive) {
+    [strings addObject:@"EXCLUSIVE"];
+  }
+  if (options & ProviderSupportedTripTypeShared) {
+    [strings addObject:@"SHARED"];
+  }
+  return strings;
+}
+
+#pragma mark - URLs
+
+/** Percent-encodes a parameter of a URL path. */
+static NSString *_Nullable EscapePathParameter(NSString *parameter) {
+  NSCharacterSet *allowedCharacters = [NSCharacterSet URLPathAllowedCharacterSet];
+  return [parameter stringByAddingPercentEncodingWithAllowedCharacters:allowedCharacters];
+}
+
+/** Percent-encodes the value of a URL query item. */
+static NSString *_Nullable EscapeQueryValue(NSString *value) {
+  static NSCharacterSet *allowedCharacters;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    NSMutableCharacterSet *characters =
+        [[NSCharacterSet URLQueryAllowedCharacterSet] mutableCopy];
+    [characters removeCharactersInString:@"&=+"];
+    allowedCharacters = [characters copy];
+  });
+  return [value stringByAddingPercentEncodingWithAllowedCharacters:allowedCharacters];
+}
+
+NSURL *_Nullable GRSDProviderDriverTokenURL(NSURL *baseURL, NSString *vehicleID) {
+  NSString *escapedVehicleID = EscapePathParameter(vehicleID);
+  if (!escapedVehicleID) {
+    return nil;
+  }
+  NSString *path = [NSString stringWithFormat:@"token/driver/%@", escapedVehicleID];
+  return [NSURL URLWithString:path relativeToURL:baseURL];
+}
+
+NSURL *_Nullable GRSDProviderCreateVehicleURL(NSURL *baseURL) {
+  return [NSURL URLWithString:@"vehicle/new" relativeToURL:baseURL];
+}
+
+NSURL *_Nullable GRSDProviderVehicleURL(NSURL *baseURL, NSString *vehicleID) {
+  NSString *escapedVehicleID = EscapePathParameter(vehicleID);
+  if (!escapedVehicleID) {
+    return nil;
+  }
+  NSString *path = [NSString stringWithFormat:@"vehicle/%@", escapedVehicleID];
+  return [NSURL URLWithString:path relativeToURL:baseURL];
+}
+
+NSURL *_Nullable GRSDProviderVehicleUpdatesURL(NSURL *baseURL, NSString *vehicleID) {
+  NSString *escapedVehicleID = EscapePathParameter(vehicleID);
+  if (!escapedVehicleID) {
+    return nil;
+  }
+  NSString *path = [NSString stringWithFormat:@"vehicle/%@/events", escapedVehicleID];
+  return [NSURL URLWithString:path relativeToURL:baseURL];
+}
+
+NSURL *_Nullable GRSDProviderTripURL(NSURL *baseURL, NSString *tripID) {
+  NSString *escapedTripID = EscapePathParameter(tripID);
+  if (!escapedTripID) {
+    return nil;
+  }
+  NSString *path = [NSString stringWithFormat:@"trip/%@", escapedTripID];
+  return [NSURL URLWithString:path relativeToURL:baseURL];
+}
+
+NSURL *_Nullable GRSDProviderBatchGetTripsURL(NSURL *baseURL, NSString *tripIDs) {
+  NSString *escapedTripIDs = EscapeQueryValue(tripIDs);
+  if (!escapedTripIDs) {
+    return nil;
+  }
+  NSString *path = [NSString stringWithFormat:@"trips?tripIds=%@", escapedTripIDs];
+  return [NSURL URLWithString:path relativeToURL:baseURL];
+}
+
+#pragma mark - Request bodies
+
+NSDictionary<NSString *, id> *GRSDProviderCreateVehicleRequestBody(NSString *vehicleID,
+                                                                   BOOL backToBackEnabled) {
+  return @{
+    @"vehicleId" : vehicleID,
+    @"backToBackEnabled" : @(backToBackEnabled),
+  };
+}
+
+NSDictionary<NSString *, id> *GRSDProviderUpdateVehicleRequestBody(
+    NSString *vehicleID,
+    NSInteger maximumCapacity,
+    BOOL backToBackEnabled,
+    ProviderSupportedTripType supportedTripTypes) {
+  return @{
+    @"vehicleId" : vehicleID,
+    @"maximumCapacity" : @(maximumCapacity),
+    @"backToBackEnabled" : @(backToBackEnabled),
+    @"supportedTripTypes" : GRSDProviderStringsFromSupportedTripTypes(supportedTripTypes),
+  };
+}
+
+NSDictionary<NSString *, id> *GRSDProviderUpdateTripRequestBody(
+    GMTSTripStatus status, NSNumber *_Nullable intermediateDestinationIndex) {
+  NSMutableDictionary<NSString *, id> *body = [@{
+    @"status" : GRSDProviderStringFromTripStatus(status),
+  } mutableCopy];
+  if (intermediateDestinationIndex) {
+    body[@"intermediateDestinationIndex"] = intermediateDestinationIndex;
+  }
+  return body;
+}
@@ -18,15 +18,23 @@
 #import <GoogleRidesharingConsumer/GoogleRidesharingConsumer.h>
 #import <GoogleRidesharingDriver/GoogleRidesharingDriver.h>
 
+#import "GRSDClock.h"
+#import "GRSDProviderSchema.h"
+
 NS_ASSUME_NONNULL_BEGIN
 
-/** Enum that represents the possible trip types a vehicle can support. */
-typedef NS_OPTIONS(NSUInteger, ProviderSupportedTripType) {
-  ProviderSupportedTripTypeNone = 0,              // => 00000000
-  ProviderSupportedTripTypeExclusive = (1 << 0),  // => 00000001
-  ProviderSupportedTripTypeShared = (1 << 1)      // => 00000010
-};
+/**
+ * Key of the @c NSNumber in the user info of an error, holding the HTTP status code with which the
+ * provider refused a request.
+ */
+extern NSString *const GRSDProviderHTTPStatusCodeErrorKey;
 
+@class GRSDProviderMetrics;
+@class GRSDProviderRequestScheduler;
+@class GRSDProviderResponseCache;
+@class GRSDProviderRetryPolicy;
+@class GRSDTripModel;
+@class GRSDTripTracer;
 @class GRSDVehicleModel;
 
 /**
@@ -37,6 +45,62 @@ typedef NS_OPTIONS(NSUInteger, ProviderSupportedTripType) {
 /** Session used for NSURLSessionDataTask. Exposed for testing only. */
 @property(nonatomic, strong, nullable) NSURLSession *session;
 
+/** Cache of decoded GET responses, which can be inspected for its hit, miss and 304 counts. */
+@property(nonatomic, readonly) GRSDProviderResponseCache *responseCache;
+
+/**
+ * Scheduler of provider requests. Vehicle and trip fetches are sent as background requests, which
+ * a newer fetch of the same resource supersedes, and all other calls as interactive requests.
+ */
+@property(nonatomic, readonly) GRSDProviderRequestScheduler *requestScheduler;
+
+/**
+ * Policy that retries failed provider requests. Idempotent calls are retried, and vehicle and trip
+ * fetches are also hedged if hedging is enabled. Trip status updates are retried by
+ * @c GRSDTripStatusOutbox instead, and vehicle update long-polls are not retried.
+ */
+@property(nonatomic, readonly) GRSDProviderRetryPolicy *retryPolicy;
+
+/**
+ * Latency histograms and counters of provider calls, keyed by the name of the call. The build,
+ * network, decode and dispatch phases of every call are timed, and every attempt's bytes and status
+ * code are counted. Defaults to the shared metrics.
+ */
+@property(nonatomic, readonly) GRSDProviderMetrics *metrics;
+
+/**
+ * Tracer whose trace context is sent with trip fetches and updates, so that the provider can
+ * attribute them to the step of the trip that made them. Defaults to the shared tracer.
+ */
+@property(nonatomic, readonly) GRSDTripTracer *tripTracer;
+
+/**
+ * The clock that driver tokens expire on, and that the trip flow built on this service schedules
+ * its timers on. Defaults to the system clock.
+ */
+@property(nonatomic, readonly) id<GRSDClock> clock;
+
+/**
+ * The maximum number of trip requests in flight when @c fetchTripsWithIDs:completion: has to fetch
+ * trips one at a time. Defaults to 4.
+ */
+@property(nonatomic) NSUInteger maximumConcurrentTripFetches;
+
+/**
+ * The queue that completion blocks are called on. Defaults to the main queue.
+ *
+ * Responses are received and decoded on a private serial queue, and only the resulting values are
+ * delivered on this queue.
+ */
+@property(nonatomic) dispatch_queue_t callbackQueue;
+
+/**
+ * The total time, in seconds, that handling provider responses has spent on the main thread, keyed
+ * by the name of the provider call. Handling is also recorded as "HandleResponse" signpost
+ * intervals, so it can be compared in Instruments.
+ */
+@property(nonatomic, readonly) NSDictionary<NSString *, NSNumber *> *mainThreadTimeByCall;
+
 /**
  * Callback block definition of creating a vehicle.
  *
@@ -62,6 +126,16 @@ typedef void (^GRSDFetchTripHandler)(NSString *_Nullable tripID, GMTSTripStatus
                                      NSArray<GMTSTripWaypoint *> *_Nullable waypoints,
                                      NSError *_Nullable error);
 
+/**
+ * Callback block definition for fetching the details of several trips.
+ *
+ * @param trips The fetched trips keyed by trip ID. Trips that could not be fetched are omitted.
+ * @param error The first error encountered when fetching the trips. It is nil if all trips were
+ * fetched.
+ */
+typedef void (^GRSDFetchTripsHandler)(NSDictionary<NSString *, GRSDTripModel *> *trips,
+                                      NSError *_Nullable error);
+
 /**
  * Callback block definition of updating a match.
  *
@@ -96,6 +170,16 @@ typedef void (^GRSDFetchVehicleHandler)(NSArray<NSString *> *_Nullable matchedTr
 typedef void (^GRSDUpdateVehicleHandler)(GRSDVehicleModel *_Nullable vehicleModel,
                                          NSError *_Nullable error);
 
+/**
+ * Initializes a provider service whose tokens expire on the given clock.
+ *
+ * @param clock The clock that driver tokens expire on.
+ */
+- (instancetype)initWithClock:(id<GRSDClock>)clock NS_DESIGNATED_INITIALIZER;
+
+/** Initializes a provider service whose tokens expire on the system clock. */
+- (instancetype)init;
+
 /**
  * Creates a new vehicle with the provider.
  *
@@ -124,6 +208,19 @@ typedef void (^GRSDUpdateVehicleHandler)(GRSDVehicleModel *_Nullable vehicleMode
  */
 - (void)fetchTripWithID:(NSString *)tripID completion:(GRSDFetchTripHandler)completion;
 
+/**
+ * Fetches trip details for several trips, such as all trips matched with a back-to-back or shared
+ * pool vehicle.
+ *
+ * Uses the provider's batch endpoint when it is available, and otherwise fetches the trips
+ * concurrently with at most @c maximumConcurrentTripFetches requests in flight.
+ *
+ * @param tripIDs The IDs of the trips to query.
+ * @param completion The block executed once all trips have been fetched.
+ */
+- (void)fetchTripsWithIDs:(NSArray<NSString *> *)tripIDs
+               completion:(GRSDFetchTripsHandler)completion;
+
 /**
  * Fetches a vehicle for the given ID.
  *
@@ -132,6 +229,33 @@ typedef void (^GRSDUpdateVehicleHandler)(GRSDVehicleModel *_Nullable vehicleMode
  */
 - (void)fetchVehicleWithID:(NSString *)vehicleID completion:(GRSDFetchVehicleHandler)completion;
 
+/**
+ * Fetches a driver token for a vehicle before the Driver SDK asks for one, so that the token is
+ * already cached when it does.
+ *
+ * @param vehicleID The ID of the vehicle to fetch a token for.
+ * @param completion The block executed with the token, or with the error fetching it.
+ */
+- (void)prefetchTokenForVehicleID:(NSString *)vehicleID
+                       completion:(void (^)(NSString *_Nullable token,
+                                            NSError *_Nullable error))completion;
+
+/**
+ * Waits for the matched trips or waypoints of a vehicle to change.
+ *
+ * This issues a long-poll request that the provider holds open until the vehicle state differs
+ * from the state last delivered for this vehicle ID, or until the provider's long-poll window
+ * elapses. The first request for a vehicle ID returns the current state immediately.
+ *
+ * @param vehicleID The ID of the vehicle to observe.
+ * @param completion The block executed when the request finishes. Both @c matchedTripIDs and
+ * @c error are nil if the long-poll window elapsed without a change. An error is returned if the
+ * provider does not support vehicle updates, in which case callers should fall back to polling
+ * with @c fetchVehicleWithID:completion:.
+ */
+- (void)waitForVehicleUpdateWithID:(NSString *)vehicleID
+                        completion:(GRSDFetchVehicleHandler)completion;
+
 /**
  * Updates a trip to a new status.
  *
@@ -146,6 +270,24 @@ typedef void (^GRSDUpdateVehicleHandler)(GRSDVehicleModel *_Nullable vehicleMode
     intermediateDestinationIndex:(NSNumber *_Nullable)intermediateDestinationIndex
                       completion:(GRSDUpdateTripHandler)completion;
 
+/**
+ * Updates a trip to a new status. The provider applies requests with the same idempotency key only
+ * once, so an update can be safely sent again when its response was lost.
+ *
+ * @param newTripStatus The new status for the trip.
+ * @param tripID The trip ID associated with the driver.
+ * @param intermediateDestinationIndex The index for the intermediate destination being updated.
+ * It is nil if no intermediate destinations are being updated.
+ * @param idempotencyKey The key identifying this update, or nil to send it without one.
+ * @param completion The block executed when the request finishes. If the provider refuses the
+ * update, the error holds its HTTP status code under @c GRSDProviderHTTPStatusCodeErrorKey.
+ */
+- (void)updateTripWithStatus:(GMTSTripStatus)newTripStatus
+                          tripID:(NSString *)tripID
+    intermediateDestinationIndex:(NSNumber *_Nullable)intermediateDestinationIndex
+                  idempotencyKey:(NSString *_Nullable)idempotencyKey
+                      completion:(GRSDUpdateTripHandler)completion;
+
 @end
 
 NS_ASSUME_NONNULL_END
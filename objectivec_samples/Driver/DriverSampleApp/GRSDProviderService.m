@@ -17,73 +17,67 @@
 
 #import <CoreLocation/CoreLocation.h>
 #import <Foundation/Foundation.h>
-
+#import <QuartzCore/QuartzCore.h>
+#import <os/signpost.h>
+#import <stdatomic.h>
+
+#import "GRSDAuthTokenCache.h"
+#import "GRSDProviderEndpointSet.h"
+#import "GRSDProviderMetrics.h"
+#import "GRSDProviderPayload.h"
+#import "GRSDProviderRequestScheduler.h"
+#import "GRSDProviderResponseCache.h"
+#import "GRSDProviderRetryPolicy.h"
+#import "GRSDProviderSchema.h"
+#import "GRSDTripModel.h"
+#import "GRSDTripTracer.h"
 #import "GRSDVehicleModel.h"
 
 static const int kProviderErrorCode = -1;
 static NSString *const kGRSDErrorDomain = @"GRSDErrorDomain";
 
+NSString *const GRSDProviderHTTPStatusCodeErrorKey = @"GRSDProviderHTTPStatusCode";
+
 // Used by GMTSAuthorization.
 static NSString *const kVehicleServiceToken = @"VehicleServiceToken";
 
-// JSON data keys used and recognized by the sample provider server.
-static NSString *const kProviderDataKeyVehicleID = @"vehicleId";
-static NSString *const kProviderDataKeyName = @"name";
-static NSString *const kProviderDataKeyToken = @"jwt";
-static NSString *const kProviderDataKeyTokenExpiration = @"expirationTimestamp";
-static NSString *const kProviderDataKeyTripStatus = @"tripStatus";
-static NSString *const kProviderDataKeyWaypoints = @"waypoints";
-static NSString *const kProviderDataKeyLocation = @"location";
-static NSString *const kProviderDataKeyPoint = @"point";
-static NSString *const kProviderDataKeyLatitude = @"latitude";
-static NSString *const kProviderDataKeyLongitude = @"longitude";
-static NSString *const kProviderDataKeyTripID = @"tripId";
-static NSString *const kProviderDataKeyStatus = @"status";
-static NSString *const kProviderDataKeyIntermediateDestinationIndex =
-    @"intermediateDestinationIndex";
-static NSString *const kProviderDataKeyTrip = @"trip";
-static NSString *const kProviderDataKeyWaypointType = @"waypointType";
-static NSString *const kProviderDataKeyCurrentTripIDs = @"currentTripsIds";
-static NSString *const kProviderDataKeyBackToBackEnabled = @"backToBackEnabled";
-static NSString *const kProviderDataKeyMaximumCapacity = @"maximumCapacity";
-static NSString *const kProviderDataKeySupportedTripTypes = @"supportedTripTypes";
-
-// The base URL string for the sample provider server.
-static NSString *const kSampleProviderBaseURLString = @"http://localhost:8080/";
-static NSString *const kDriverTokenURLPath = @"token/driver/";
-static NSString *const kCreateVehicleURLPath = @"vehicle/new";
-static NSString *const kGetAvailableTripURLPath = @"trip";
-static NSString *const kUpdateTripStatusURLPath = @"trip/";
-static NSString *const kBaseVehicleURLPath = @"vehicle/";
-
-// Sample provider supported trip states.
-static NSString *const GRSDProviderServiceTripStatusNew = @"NEW";
-static NSString *const GRSDProviderServiceTripStatusEnrouteToPickup = @"ENROUTE_TO_PICKUP";
-static NSString *const GRSDProviderServiceTripStatusArrivedAtPickup = @"ARRIVED_AT_PICKUP";
-static NSString *const GRSDProviderServiceTripStatusEnrouteToIntermediateDestination =
-    @"ENROUTE_TO_INTERMEDIATE_DESTINATION";
-static NSString *const GRSDProviderServiceTripStatusArrivedAtIntermediateDestination =
-    @"ARRIVED_AT_INTERMEDIATE_DESTINATION";
-static NSString *const GRSDProviderServiceTripStatusEnrouteToDropoff = @"ENROUTE_TO_DROPOFF";
-static NSString *const GRSDProviderServiceTripStatusComplete = @"COMPLETE";
-static NSString *const GRSDProviderServiceTripStatusCanceled = @"CANCELED";
-static NSString *const GRSDProviderServiceTripStatusUnknown = @"UNKNOWN";
-
-// Provider waypoint types
-static NSString *const kProviderWaypointTypePickup = @"PICKUP_WAYPOINT_TYPE";
-static NSString *const kProviderWaypointTypeDropoff = @"DROP_OFF_WAYPOINT_TYPE";
-static NSString *const kProviderWaypointTypeIntermediateDestination =
-    @"INTERMEDIATE_DESTINATION_WAYPOINT_TYPE";
-
-// Provider supported trip types.
-static NSString *const kProviderTripTypeExclusive = @"EXCLUSIVE";
-static NSString *const kProviderTripTypeShared = @"SHARED";
+// The base URL strings of the sample provider server replicas, which requests are spread across.
+static NSString *const kSampleProviderBaseURLStrings[] = {
+    @"http://localhost:8080/",
+};
+
+// Default limit of concurrent requests when trips are fetched one at a time.
+static const NSUInteger kDefaultMaximumConcurrentTripFetches = 4;
+
+// Driver tokens are kept for this many vehicles, and persisted to this file in the caches directory
+// so that they can be reused after a relaunch.
+static const NSUInteger kTokenCacheCapacity = 16;
+static NSString *const kTokenCacheFileName = @"GRSDAuthTokens.plist";
+
+// How long a vehicle updates request may stay open. The provider completes long-poll requests
+// before this elapses, so reaching it means the connection was lost.
+static const NSTimeInterval kVehicleUpdatesTimeoutInterval = 60;
 
 // HTTP constants.
 static NSInteger const kHTTPStatusOkCode = 200;
+static NSInteger const kHTTPStatusNotModifiedCode = 304;
+static NSInteger const kHTTPStatusNotFoundCode = 404;
+static NSInteger const kHTTPStatusMethodNotAllowedCode = 405;
+static NSInteger const kHTTPStatusNotImplementedCode = 501;
 static NSString *const kHTTPGETMethod = @"GET";
 static NSString *const kHTTPPOSTMethod = @"POST";
 static NSString *const kHTTPPUTMethod = @"PUT";
+static NSString *const kHTTPETagHeaderField = @"ETag";
+static NSString *const kHTTPIfNoneMatchHeaderField = @"If-None-Match";
+static NSString *const kHTTPIdempotencyKeyHeaderField = @"Idempotency-Key";
+static NSString *const kHTTPAcceptHeaderField = @"Accept";
+static NSString *const kHTTPContentTypeHeaderField = @"Content-Type";
+static NSString *const kHTTPJSONContentType = @"application/json";
+static NSString *const kHTTPPropertyListContentType = @"application/x-plist";
+
+// Responses may be encoded as a binary property list, which is smaller and faster to decode than
+// JSON. Providers that only speak JSON ignore the preference.
+static NSString *const kHTTPAcceptedContentTypes = @"application/x-plist, application/json;q=0.9";
 
 // Error descriptions.
 static NSString *const kInvalidAuthorizationContextDescription =
@@ -97,174 +91,249 @@ static NSString *const kErrorFetchingTripDescription = @"Error fetching trip.";
 static NSString *const kInvalidTripIDDescription = @"Invalid trip ID.";
 static NSString *const kErrorUpdatingTripDescription = @"Error updating trip.";
 static NSString *const kErrorFetchingVehicleDescription = @"Error fetching vehicle.";
+static NSString *const kErrorWaitingForVehicleUpdateDescription =
+    @"Error waiting for vehicle update.";
 static NSString *const kErrorInvalidResponseDescription = @"Invalid response.";
 static NSString *const kErrorUpdatingVehicleDescription = @"Error updating vehicle.";
-
-/** Returns a @c GMTSTripStatus objects from a given string representation. */
-static GMTSTripStatus GetTripStatusFromProviderString(NSString *tripStatus) {
-  if ([tripStatus isEqual:GRSDProviderServiceTripStatusNew]) {
-    return GMTSTripStatusNew;
-  } else if ([tripStatus isEqual:GRSDProviderServiceTripStatusEnrouteToPickup]) {
-    return GMTSTripStatusEnrouteToPickup;
-  } else if ([tripStatus isEqual:GRSDProviderServiceTripStatusArrivedAtPickup]) {
-    return GMTSTripStatusArrivedAtPickup;
-  } else if ([tripStatus isEqual:GRSDProviderServiceTripStatusEnrouteToIntermediateDestination]) {
-    return GMTSTripStatusEnrouteToIntermediateDestination;
-  } else if ([tripStatus isEqual:GRSDProviderServiceTripStatusArrivedAtIntermediateDestination]) {
-    return GMTSTripStatusArrivedAtIntermediateDestination;
-  } else if ([tripStatus isEqual:GRSDProviderServiceTripStatusEnrouteToDropoff]) {
-    return GMTSTripStatusEnrouteToDropoff;
-  } else if ([tripStatus isEqual:GRSDProviderServiceTripStatusComplete]) {
-    return GMTSTripStatusComplete;
-  }
-  return GMTSTripStatusUnknown;
-}
-
-/** Returns the provider string representation of a given @c GMTSTripStatus. */
-static NSString *GetProviderStringFromTripStatus(GMTSTripStatus tripStatus) {
-  switch (tripStatus) {
-    case GMTSTripStatusNew:
-      return GRSDProviderServiceTripStatusNew;
-    case GMTSTripStatusEnrouteToPickup:
-      return GRSDProviderServiceTripStatusEnrouteToPickup;
-    case GMTSTripStatusArrivedAtPickup:
-      return GRSDProviderServiceTripStatusArrivedAtPickup;
-    case GMTSTripStatusEnrouteToIntermediateDestination:
-      return GRSDProviderServiceTripStatusEnrouteToIntermediateDestination;
-    case GMTSTripStatusArrivedAtIntermediateDestination:
-      return GRSDProviderServiceTripStatusArrivedAtIntermediateDestination;
-    case GMTSTripStatusEnrouteToDropoff:
-      return GRSDProviderServiceTripStatusEnrouteToDropoff;
-    case GMTSTripStatusComplete:
-      return GRSDProviderServiceTripStatusComplete;
-    case GMTSTripStatusCanceled:
-      return GRSDProviderServiceTripStatusCanceled;
-    case GMTSTripStatusUnknown:
-      return GRSDProviderServiceTripStatusUnknown;
-  }
-}
+static NSString *const kProviderServiceReleasedDescription =
+    @"The provider service was released.";
 
 /**
- * Generates a JSON request based on the passed in method.
+ * Generates a request with a body based on the passed in method.
  *
  * @param method The method to be used for the request.
  * @param URL The URL to be used for the request.
  * @param payload Payload to be used in the request body.
+ * @param encodeAsPropertyList Whether the body is encoded as a binary property list instead of
+ * JSON. Only set this once the provider has sent a property list response.
  */
-static NSURLRequest *GenerateJSONRequestWithMethod(NSString *method, NSURL *URL,
-                                                   NSDictionary<NSString *, NSString *> *payload) {
-  NSData *JSONData = [NSJSONSerialization dataWithJSONObject:payload options:0 error:nil];
+static NSURLRequest *GenerateRequestWithMethod(NSString *method, NSURL *URL,
+                                               NSDictionary<NSString *, NSString *> *payload,
+                                               BOOL encodeAsPropertyList) {
+  NSData *bodyData;
+  NSString *contentType;
+  if (encodeAsPropertyList) {
+    bodyData = [NSPropertyListSerialization dataWithPropertyList:payload
+                                                          format:NSPropertyListBinaryFormat_v1_0
+                                                         options:0
+                                                           error:nil];
+    contentType = kHTTPPropertyListContentType;
+  } else {
+    bodyData = [NSJSONSerialization dataWithJSONObject:payload options:0 error:nil];
+    contentType = kHTTPJSONContentType;
+  }
   NSMutableURLRequest *request = [[NSMutableURLRequest alloc] initWithURL:URL];
   request.HTTPMethod = method;
-  [request setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
-  request.HTTPBody = JSONData;
+  [request setValue:contentType forHTTPHeaderField:kHTTPContentTypeHeaderField];
+  request.HTTPBody = bodyData;
   return [request copy];
 }
 
+/** Returns the file that driver tokens are persisted to between launches. */
+static NSURL *_Nullable GetTokenCacheFileURL(void) {
+  NSURL *cachesURL = [NSFileManager.defaultManager URLsForDirectory:NSCachesDirectory
+                                                          inDomains:NSUserDomainMask]
+                         .firstObject;
+  return [cachesURL URLByAppendingPathComponent:kTokenCacheFileName];
+}
+
+/** Returns the sample provider server replicas, which all provider services share. */
+static GRSDProviderEndpointSet *GetSharedEndpointSet(void) {
+  static GRSDProviderEndpointSet *endpointSet;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    size_t count = sizeof(kSampleProviderBaseURLStrings) / sizeof(kSampleProviderBaseURLStrings[0]);
+    NSMutableArray<NSURL *> *baseURLs = [[NSMutableArray alloc] initWithCapacity:count];
+    for (size_t i = 0; i < count; i++) {
+      [baseURLs addObject:[NSURL URLWithString:kSampleProviderBaseURLStrings[i]]];
+    }
+    endpointSet = [[GRSDProviderEndpointSet alloc] initWithBaseURLs:baseURLs];
+  });
+  return endpointSet;
+}
+
+/**
+ * Returns the base URL that provider URLs are built against. Requests are routed to a replica when
+ * they are sent.
+ */
+static NSURL *GetCanonicalBaseURL(void) {
+  return GetSharedEndpointSet().canonicalBaseURL;
+}
+
+static NSError *GRSDError(NSInteger errorCode, NSString *description) {
+  NSDictionary<NSErrorUserInfoKey, NSString *> *userInfo = @{
+    NSLocalizedDescriptionKey : description,
+  };
+  return [NSError errorWithDomain:kGRSDErrorDomain code:errorCode userInfo:userInfo];
+}
+
 @implementation GRSDProviderService {
-  NSString *_lastKnownVehicleID;
-  NSTimeInterval _tokenExpiration;
-  NSString *_vehicleServiceToken;
+  GRSDAuthTokenCache *_tokenCache;
+  /** Serial queue that receives network callbacks and decodes responses. */
+  NSOperationQueue *_decodingQueue;
+  /** Main thread time spent handling responses, keyed by the provider call. */
+  NSMutableDictionary<NSString *, NSNumber *> *_mainThreadTimeByCall;
+  /** ETags of the vehicle states last delivered by the vehicle updates endpoint, by vehicle ID. */
+  NSMutableDictionary<NSString *, NSString *> *_vehicleUpdateETags;
+  /** Whether the provider has reported that it has no batch get trips endpoint. */
+  atomic_bool _isBatchGetTripsUnsupported;
+  /** Whether the provider has sent a property list response, so it can also read one. */
+  atomic_bool _providerAcceptsPropertyList;
 }
 
 - (instancetype)init {
+  return [self initWithClock:[GRSDSystemClock sharedClock]];
+}
+
+- (instancetype)initWithClock:(id<GRSDClock>)clock {
   if (self = [super init]) {
     NSURLSessionConfiguration *config = [NSURLSessionConfiguration defaultSessionConfiguration];
+    // Conditional GETs are handled by the response cache, which keeps decoded models rather than
+    // bodies, so bypass the URL loading system's cache.
+    config.URLCache = nil;
+    config.requestCachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+    config.HTTPAdditionalHeaders = @{kHTTPAcceptHeaderField : kHTTPAcceptedContentTypes};
+    // Responses are decoded off the main thread, and only the resulting models are delivered on
+    // the callback queue.
+    _decodingQueue = [[NSOperationQueue alloc] init];
+    _decodingQueue.name = @"com.google.DriverSampleApp.ProviderService";
+    _decodingQueue.maxConcurrentOperationCount = 1;
+    _decodingQueue.qualityOfService = NSQualityOfServiceUserInitiated;
     _session = [NSURLSession sessionWithConfiguration:config
                                              delegate:nil
-                                        delegateQueue:[NSOperationQueue mainQueue]];
+                                        delegateQueue:_decodingQueue];
+    _callbackQueue = dispatch_get_main_queue();
+    _mainThreadTimeByCall = [[NSMutableDictionary alloc] init];
+    _vehicleUpdateETags = [[NSMutableDictionary alloc] init];
+    _responseCache = [[GRSDProviderResponseCache alloc] init];
+    _requestScheduler = [[GRSDProviderRequestScheduler alloc] init];
+    _requestScheduler.endpointSet = GetSharedEndpointSet();
+    _retryPolicy = [[GRSDProviderRetryPolicy alloc] init];
+    _metrics = [GRSDProviderMetrics sharedMetrics];
+    _tripTracer = [GRSDTripTracer sharedTracer];
+    _maximumConcurrentTripFetches = kDefaultMaximumConcurrentTripFetches;
+    _clock = clock;
+
+    __weak typeof(self) weakSelf = self;
+    _tokenCache = [[GRSDAuthTokenCache alloc]
+        initWithCapacity:kTokenCacheCapacity
+                 fileURL:GetTokenCacheFileURL()
+                   clock:clock
+                 fetcher:^(NSString *vehicleID, GRSDAuthTokenFetchHandler completion) {
+                   GRSDProviderService *strongSelf = weakSelf;
+                   if (!strongSelf) {
+                     // Fail the requests waiting for the token instead of leaving them hanging.
+                     completion(nil, 0,
+                                GRSDError(kProviderErrorCode, kProviderServiceReleasedDescription));
+                     return;
+                   }
+                   [strongSelf fetchDriverTokenWithVehicleID:vehicleID completion:completion];
+                 }];
   }
   return self;
 }
 
-/** Creates the token URL to the sample provider server. */
-static NSURL *GenerateDriverTokenURL(NSString *_Nonnull vehicleID) {
-  NSURL *baseURL = [NSURL URLWithString:kSampleProviderBaseURLString];
-  NSURL *driverTokenURL = [NSURL URLWithString:kDriverTokenURLPath relativeToURL:baseURL];
-  return [NSURL URLWithString:vehicleID relativeToURL:driverTokenURL];
-}
-
-/** Generates the create vehicle URL to the sample provider server. */
-static NSURL *GenerateCreateVehicleURL() {
-  NSURL *baseURL = [NSURL URLWithString:kSampleProviderBaseURLString];
-  return [NSURL URLWithString:kCreateVehicleURLPath relativeToURL:baseURL];
-}
-
-/** Creates the fetch trip URL to the sample provider server. */
-static NSURL *GenerateFetchTripURL(NSString *tripID) {
-  NSURL *baseURL = [NSURL URLWithString:kSampleProviderBaseURLString];
-  NSURL *fetchURL = [NSURL URLWithString:kUpdateTripStatusURLPath relativeToURL:baseURL];
-  return [NSURL URLWithString:tripID relativeToURL:fetchURL];
+/** Returns the log that provider calls are recorded to as signpost intervals. */
+static os_log_t GetProviderServiceLog(void) {
+  static os_log_t log;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    log = os_log_create("com.google.DriverSampleApp", "ProviderService");
+  });
+  return log;
 }
 
-/** Creates the update trip status URL to the sample provider server. */
-static NSURL *GenerateUpdateTripStatusURL(NSString *tripID) {
-  NSURL *baseURL = [NSURL URLWithString:kSampleProviderBaseURLString];
-  NSURL *updateTripStatusURL = [NSURL URLWithString:kUpdateTripStatusURLPath relativeToURL:baseURL];
-  return [NSURL URLWithString:tripID relativeToURL:updateTripStatusURL];
+/**
+ * Runs @c block asynchronously on @c queue. The time the block waits for the queue is recorded in
+ * @c metrics as the dispatch phase of @c callName, unless @c callName is nil.
+ */
+static void DispatchCallback(dispatch_queue_t queue, GRSDProviderMetrics *metrics,
+                             NSString *_Nullable callName, dispatch_block_t block) {
+  CFTimeInterval enqueueTime = CACurrentMediaTime();
+  dispatch_async(queue, ^{
+    if (callName) {
+      [metrics recordDuration:CACurrentMediaTime() - enqueueTime
+                      ofPhase:GRSDProviderCallPhaseDispatch
+                      forCall:callName];
+    }
+    block();
+  });
 }
 
-/** Creates the get vehicle URL to the sample provider server. */
-static NSURL *GenerateGetVehicleURL(NSString *vehicleID) {
-  NSURL *baseURL = [NSURL URLWithString:kSampleProviderBaseURLString];
-  NSURL *fetchURL = [NSURL URLWithString:kBaseVehicleURLPath relativeToURL:baseURL];
-  return [NSURL URLWithString:vehicleID relativeToURL:fetchURL];
+// The following return handlers that call the given completion asynchronously on the given queue,
+// so that callers never receive results on the queue that decodes responses. The time each
+// completion waits for the queue is recorded as the dispatch phase of the call, as with
+// DispatchCallback.
+
+static void (^GetVehicleModelHandlerOnQueue(dispatch_queue_t queue, GRSDProviderMetrics *metrics,
+                                            NSString *callName,
+                                            void (^completion)(GRSDVehicleModel *, NSError *)))(
+    GRSDVehicleModel *, NSError *) {
+  return ^(GRSDVehicleModel *_Nullable vehicleModel, NSError *_Nullable error) {
+    DispatchCallback(queue, metrics, callName, ^{
+      completion(vehicleModel, error);
+    });
+  };
 }
 
-/** Generates the update vehicle URL to the sample provider server. */
-static NSURL *GenerateUpdateVehicleURL(NSString *vehicleID) {
-  NSURL *baseURL = [NSURL URLWithString:kSampleProviderBaseURLString];
-  NSURL *vehicleURL = [NSURL URLWithString:kBaseVehicleURLPath relativeToURL:baseURL];
-  return [NSURL URLWithString:vehicleID relativeToURL:vehicleURL];
+static void (^GetStringHandlerOnQueue(dispatch_queue_t queue, GRSDProviderMetrics *metrics,
+                                      NSString *_Nullable callName,
+                                      void (^completion)(NSString *, NSError *)))(NSString *,
+                                                                                  NSError *) {
+  return ^(NSString *_Nullable string, NSError *_Nullable error) {
+    DispatchCallback(queue, metrics, callName, ^{
+      completion(string, error);
+    });
+  };
 }
 
-static NSError *GRSDError(NSInteger errorCode, NSString *description) {
-  NSDictionary<NSErrorUserInfoKey, NSString *> *userInfo = @{
-    NSLocalizedDescriptionKey : description,
+static GRSDFetchTripHandler GetFetchTripHandlerOnQueue(dispatch_queue_t queue,
+                                                       GRSDProviderMetrics *metrics,
+                                                       NSString *callName,
+                                                       GRSDFetchTripHandler completion) {
+  return ^(NSString *_Nullable tripID, GMTSTripStatus tripStatus,
+           NSArray<GMTSTripWaypoint *> *_Nullable waypoints, NSError *_Nullable error) {
+    DispatchCallback(queue, metrics, callName, ^{
+      completion(tripID, tripStatus, waypoints, error);
+    });
   };
-  return [NSError errorWithDomain:kGRSDErrorDomain code:errorCode userInfo:userInfo];
 }
 
-/** Returns a @c GMTSTripWaypointType from it's string representation. */
-static GMTSTripWaypointType GetTripWaypointTypeFromString(NSString *waypointType) {
-  if ([waypointType isEqualToString:kProviderWaypointTypePickup]) {
-    return GMTSTripWaypointTypePickUp;
-  } else if ([waypointType isEqualToString:kProviderWaypointTypeDropoff]) {
-    return GMTSTripWaypointTypeDropOff;
-  } else if ([waypointType isEqualToString:kProviderWaypointTypeIntermediateDestination]) {
-    return GMTSTripWaypointTypeIntermediateDestination;
-  } else {
-    return GMTSTripWaypointTypeUnknown;
-  }
+static GRSDFetchTripsHandler GetFetchTripsHandlerOnQueue(dispatch_queue_t queue,
+                                                         GRSDProviderMetrics *metrics,
+                                                         NSString *callName,
+                                                         GRSDFetchTripsHandler completion) {
+  return ^(NSDictionary<NSString *, GRSDTripModel *> *trips, NSError *_Nullable error) {
+    DispatchCallback(queue, metrics, callName, ^{
+      completion(trips, error);
+    });
+  };
 }
 
-/** Returns a @c ProviderSupportedTripType enum from given JSON response. */
-static ProviderSupportedTripType GetSupportedTripTypesFromJSONResponse(
-    NSDictionary<NSString *, id> *jsonResponse) {
-  ProviderSupportedTripType supportedTripTypes = ProviderSupportedTripTypeNone;
-  NSArray<NSString *> *vehicleSupportedTripTypesArray =
-      jsonResponse[kProviderDataKeySupportedTripTypes];
-  if ([vehicleSupportedTripTypesArray containsObject:kProviderTripTypeExclusive]) {
-    supportedTripTypes |= ProviderSupportedTripTypeExclusive;
-  }
-  if ([vehicleSupportedTripTypesArray containsObject:kProviderTripTypeShared]) {
-    supportedTripTypes |= ProviderSupportedTripTypeShared;
-  }
-  return supportedTripTypes;
+static GRSDFetchVehicleHandler GetFetchVehicleHandlerOnQueue(dispatch_queue_t queue,
+                                                             GRSDProviderMetrics *metrics,
+                                                             NSString *callName,
+                                                             GRSDFetchVehicleHandler completion) {
+  return ^(NSArray<NSString *> *_Nullable matchedTripIDs,
+           NSArray<GMTSTripWaypoint *> *_Nullable waypoints, NSError *_Nullable error) {
+    DispatchCallback(queue, metrics, callName, ^{
+      completion(matchedTripIDs, waypoints, error);
+    });
+  };
 }
 
 /**
- * Returns a @c GRSDVehicleModel from given JSON response. Will return nil if fields are missing
+ * Returns a @c GRSDVehicleModel from given provider payload. Will return nil if fields are missing
  * from response.
  */
-static GRSDVehicleModel *_Nullable GetVehicleModelFromJSONResponse(
-    NSString *vehicleID, NSDictionary<NSString *, id> *jsonResponse) {
-  NSNumber *maximumCapacity = jsonResponse[kProviderDataKeyMaximumCapacity];
-  id isBackToBackEnabledValue = jsonResponse[kProviderDataKeyBackToBackEnabled];
+static GRSDVehicleModel *_Nullable GetVehicleModelFromPayload(NSString *vehicleID,
+                                                              GRSDProviderPayload *payload) {
+  NSNumber *maximumCapacity = payload.maximumCapacity;
+  NSNumber *isBackToBackEnabledValue = payload.backToBackEnabled;
   if (maximumCapacity && isBackToBackEnabledValue) {
     BOOL isBackToBackEnabled = [isBackToBackEnabledValue boolValue];
     ProviderSupportedTripType supportedTripTypes =
-        GetSupportedTripTypesFromJSONResponse(jsonResponse);
+        GRSDSupportedTripTypesFromProviderStrings(payload.supportedTripTypes);
     GRSDVehicleModel *createdVehicleModel =
         [[GRSDVehicleModel alloc] initWithVehicleID:vehicleID
                                     maximumCapacity:maximumCapacity.unsignedIntegerValue
@@ -275,58 +344,29 @@ static GRSDVehicleModel *_Nullable GetVehicleModelFromJSONResponse(
   return nil;
 }
 
-/** Returns the string representations of the given @c ProviderSupportedTripType in an array. */
-static NSArray<NSString *> *GetSupportedTripTypesArray(
-    ProviderSupportedTripType supportedTripTypes) {
-  NSMutableArray<NSString *> *result = [[NSMutableArray alloc] init];
-  if (supportedTripTypes & ProviderSupportedTripTypeExclusive) {
-    [result addObject:kProviderTripTypeExclusive];
-  }
-  if (supportedTripTypes & ProviderSupportedTripTypeShared) {
-    [result addObject:kProviderTripTypeShared];
-  }
-  return result;
-}
-
-/** Returns a dictionary with entries from the given @c GRSDVehicleModel. */
-static NSDictionary<NSString *, id> *GetJSONDictionaryFromVehicleModel(
-    GRSDVehicleModel *vehicleModel) {
-  return @{
-    kProviderDataKeyVehicleID : vehicleModel.vehicleID,
-    kProviderDataKeyMaximumCapacity : @(vehicleModel.maximumCapacity),
-    kProviderDataKeyBackToBackEnabled : @(vehicleModel.isBackToBackEnabled),
-    kProviderDataKeySupportedTripTypes :
-        GetSupportedTripTypesArray(vehicleModel.supportedTripTypes),
-  };
-}
-
 /**
- * Returns a @c GRSDVehicleModel from the given data object. Returns nil and updates the given error
- * object if the data is invalid or cannot be serialized to a JSON dictionary.
+ * Returns a @c GRSDVehicleModel from the given vehicle response. Returns nil and updates the given
+ * error object if the response could not be decoded or is missing fields.
  *
- * @param data The data object containing JSON serializable data.
+ * @param payload The decoded vehicle response, or nil if decoding failed.
+ * @param payloadError The error that occurred when decoding the response.
  * @param error The error that is set on failure.
  */
-static GRSDVehicleModel *_Nullable GetVehicleModelFromResponseData(NSData *data, NSError **error) {
-  NSError *JSONParseError;
-  id JSONResponse = [NSJSONSerialization JSONObjectWithData:data
-                                                    options:kNilOptions
-                                                      error:&JSONParseError];
+static GRSDVehicleModel *_Nullable GetVehicleModelFromResponsePayload(
+    GRSDProviderPayload *_Nullable payload, NSError *_Nullable payloadError, NSError **error) {
   NSError *errorToPropagate;
-  if (JSONParseError) {
-    errorToPropagate = JSONParseError;
-  } else if (![JSONResponse isKindOfClass:[NSDictionary class]]) {
-    errorToPropagate = GRSDError(kProviderErrorCode, kErrorInvalidResponseDescription);
+  if (!payload) {
+    errorToPropagate = payloadError;
   } else {
     // Get vehicle name from response.
-    NSString *vehicleName = JSONResponse[kProviderDataKeyName];
+    NSString *vehicleName = payload.name;
     // Provider returns fully qualified vehicle name in this form:
     // 'providers/providerID/vehicles/vehicleID'. So strip provider ID from it.
     NSString *vehicleID = [vehicleName componentsSeparatedByString:@"/"].lastObject;
     if (!vehicleID) {
       errorToPropagate = GRSDError(kProviderErrorCode, kInvalidVehicleNameDescription);
     } else {
-      GRSDVehicleModel *updatedVehicle = GetVehicleModelFromJSONResponse(vehicleID, JSONResponse);
+      GRSDVehicleModel *updatedVehicle = GetVehicleModelFromPayload(vehicleID, payload);
       if (updatedVehicle) {
         return updatedVehicle;
       } else {
@@ -341,49 +381,192 @@ static GRSDVehicleModel *_Nullable GetVehicleModelFromResponseData(NSData *data,
   return nil;
 }
 
-/** Returns an array of @c GMTSTripWaypoint objects from a given JSON response. */
-static NSArray<GMTSTripWaypoint *> *_Nullable GetTripWaypointsFromJSONResponse(
-    NSDictionary<NSString *, id> *response) {
-  // Note: Relaxed type and parsing error checks here since this is a sample app.
-  NSArray<NSDictionary<NSString *, id> *> *waypointsJSON = response[kProviderDataKeyWaypoints];
-  if (!waypointsJSON) {
+/**
+ * Returns a @c GRSDTripModel from the trip object of a provider response. Returns nil and updates
+ * the given error object if the trip name is missing.
+ *
+ * @param tripPayload The trip object from a provider response.
+ * @param error The error that is set on failure.
+ */
+static GRSDTripModel *_Nullable GetTripModelFromPayload(GRSDProviderPayload *_Nullable tripPayload,
+                                                        NSError **error) {
+  // Get the trip name from trip response.
+  NSString *fullTripName = tripPayload.name;
+  // Provider returns fully qualified trip name in this form:
+  // 'providers/providerID/trips/tripID', so strip trip ID from it.
+  NSString *tripID = [fullTripName componentsSeparatedByString:@"/"].lastObject;
+  if (!tripID) {
+    if (error) {
+      *error = GRSDError(kProviderErrorCode, kInvalidTripIDDescription);
+    }
     return nil;
   }
-  NSMutableArray<GMTSTripWaypoint *> *waypoints = [[NSMutableArray alloc] init];
-  for (NSDictionary<NSString *, id> *waypointJSON in waypointsJSON) {
-    NSString *tripID = waypointJSON[kProviderDataKeyTripID];
-    NSDictionary<NSString *, id> *locationJSON = waypointJSON[kProviderDataKeyLocation];
-    NSDictionary<NSString *, id> *pointJSON = locationJSON[kProviderDataKeyPoint];
-    NSString *waypointTypeString = waypointJSON[kProviderDataKeyWaypointType];
-    NSNumber *latitude = pointJSON[kProviderDataKeyLatitude];
-    NSNumber *longitude = pointJSON[kProviderDataKeyLongitude];
-    GMTSLatLng *latlng = [[GMTSLatLng alloc] initWithLatitude:latitude.doubleValue
-                                                    longitude:longitude.doubleValue];
-    GMTSTerminalLocation *terminalLocation = [[GMTSTerminalLocation alloc] initWithPoint:latlng
-                                                                                   label:nil
-                                                                             description:nil
-                                                                                 placeID:nil
-                                                                             generatedID:nil
-                                                                           accessPointID:nil];
-
-    GMTSTripWaypointType waypointType = GetTripWaypointTypeFromString(waypointTypeString);
-    GMTSTripWaypoint *waypoint = [[GMTSTripWaypoint alloc] initWithLocation:terminalLocation
-                                                                     tripID:tripID
-                                                               waypointType:waypointType
-                                         distanceToPreviousWaypointInMeters:0
-                                                                        ETA:0];
-    [waypoints addObject:waypoint];
-  }
-  return waypoints;
+  GMTSTripStatus tripStatus = GRSDTripStatusFromProviderString(tripPayload.tripStatus);
+  return [[GRSDTripModel alloc] initWithTripID:tripID
+                                    tripStatus:tripStatus
+                                     waypoints:tripPayload.waypoints ?: @[]];
+}
+
+/** Returns whether an HTTP status code means that the provider doesn't implement an endpoint. */
+static BOOL IsUnsupportedEndpointStatusCode(NSInteger statusCode) {
+  return statusCode == kHTTPStatusNotFoundCode || statusCode == kHTTPStatusMethodNotAllowedCode ||
+         statusCode == kHTTPStatusNotImplementedCode;
+}
+
+/**
+ * Decodes a provider response in the format named by its Content-Type, and remembers whether the
+ * provider speaks the property list format.
+ */
+- (nullable GRSDProviderPayload *)payloadWithData:(NSData *)data
+                                         response:(NSURLResponse *)response
+                                            error:(NSError **)error {
+  if ([response.MIMEType isEqualToString:kHTTPPropertyListContentType]) {
+    atomic_store(&_providerAcceptsPropertyList, true);
+    return [GRSDProviderPayload payloadWithPropertyListData:data
+                                                currentTime:_clock.currentTime
+                                                      error:error];
+  }
+  return [GRSDProviderPayload payloadWithData:data currentTime:_clock.currentTime error:error];
+}
+
+- (NSDictionary<NSString *, NSNumber *> *)mainThreadTimeByCall {
+  @synchronized(_mainThreadTimeByCall) {
+    return [_mainThreadTimeByCall copy];
+  }
+}
+
+/**
+ * Schedules a request to the provider. Handling of the response is recorded as a signpost interval
+ * named after the call, and the time it spends on the main thread is added to
+ * @c mainThreadTimeByCall. The latency of each phase of the call and the outcome of each attempt
+ * are recorded in @c metrics.
+ *
+ * @param request The request to send.
+ * @param call The selector of the provider call making the request.
+ * @param startTime The time at which the call was made, so that building the request is timed.
+ * @param priority The priority class of the request.
+ * @param resourceKey The key of the resource the request is for, so that a newer request for it
+ * supersedes this one along with its retries and hedges, or nil if the request should never be
+ * superseded.
+ * @param retryMode How the request is retried when it fails.
+ * @param completionHandler The block that handles the response.
+ */
+- (void)resumeDataTaskWithRequest:(NSURLRequest *)request
+                          forCall:(SEL)call
+                        startTime:(CFTimeInterval)startTime
+                         priority:(GRSDProviderRequestPriority)priority
+                      resourceKey:(nullable NSString *)resourceKey
+                        retryMode:(GRSDProviderRetryMode)retryMode
+                completionHandler:
+                    (void (^)(NSData *, NSURLResponse *, NSError *))completionHandler {
+  [self resumeDataTaskWithRequest:request
+                          forCall:call
+                        startTime:startTime
+                         priority:priority
+                      resourceKey:resourceKey
+                        retryMode:retryMode
+                         longPoll:NO
+                completionHandler:completionHandler];
+}
+
+/**
+ * Schedules a request to the provider, like
+ * @c resumeDataTaskWithRequest:forCall:startTime:priority:resourceKey:retryMode:completionHandler:.
+ * A long-poll, which the provider holds open until it has something to report, doesn't count
+ * towards its replica's latency.
+ */
+- (void)resumeDataTaskWithRequest:(NSURLRequest *)request
+                          forCall:(SEL)call
+                        startTime:(CFTimeInterval)startTime
+                         priority:(GRSDProviderRequestPriority)priority
+                      resourceKey:(nullable NSString *)resourceKey
+                        retryMode:(GRSDProviderRetryMode)retryMode
+                         longPoll:(BOOL)longPoll
+                completionHandler:
+                    (void (^)(NSData *, NSURLResponse *, NSError *))completionHandler {
+  NSString *callName = NSStringFromSelector(call);
+  NSMutableDictionary<NSString *, NSNumber *> *mainThreadTimeByCall = _mainThreadTimeByCall;
+  GRSDProviderMetrics *metrics = _metrics;
+  CFTimeInterval sendTime = CACurrentMediaTime();
+  [metrics recordDuration:sendTime - startTime
+                  ofPhase:GRSDProviderCallPhaseBuild
+                  forCall:callName];
+  void (^handler)(NSData *, NSURLResponse *, NSError *) =
+      ^(NSData *data, NSURLResponse *response, NSError *error) {
+        CFTimeInterval responseTime = CACurrentMediaTime();
+        [metrics recordDuration:responseTime - sendTime
+                        ofPhase:GRSDProviderCallPhaseNetwork
+                        forCall:callName];
+
+        os_log_t log = GetProviderServiceLog();
+        os_signpost_id_t signpostID = os_signpost_id_generate(log);
+        BOOL isMainThread = [NSThread isMainThread];
+        os_signpost_interval_begin(log, signpostID, "HandleResponse", "%{public}@ main thread: %d",
+                                   callName, isMainThread);
+        CFTimeInterval handlingStartTime = CACurrentMediaTime();
+        completionHandler(data, response, error);
+        CFTimeInterval duration = CACurrentMediaTime() - handlingStartTime;
+        os_signpost_interval_end(log, signpostID, "HandleResponse");
+        [metrics recordDuration:duration ofPhase:GRSDProviderCallPhaseDecode forCall:callName];
+
+        if (isMainThread) {
+          @synchronized(mainThreadTimeByCall) {
+            NSTimeInterval totalDuration = mainThreadTimeByCall[callName].doubleValue + duration;
+            mainThreadTimeByCall[callName] = @(totalDuration);
+          }
+        }
+      };
+  GRSDProviderRequestScheduler *requestScheduler = _requestScheduler;
+  GRSDProviderRetryPolicy *retryPolicy = _retryPolicy;
+  NSURLSession *session = self.session;
+  GRSDProviderRequestAttempt attempt =
+      ^(BOOL isFirstAttempt, GRSDProviderRequestCompletionHandler attemptHandler) {
+        [metrics recordAttemptWithRequest:request isRetry:!isFirstAttempt forCall:callName];
+        return [requestScheduler scheduleRequest:request
+                                       inSession:session
+                                        priority:priority
+                                     resourceKey:nil
+                                        longPoll:longPoll
+                               completionHandler:^(NSData *data, NSURLResponse *response,
+                                                   NSError *error) {
+                                 [metrics recordResponse:response
+                                                    data:data
+                                                   error:error
+                                               toRequest:request
+                                                 forCall:callName];
+                                 attemptHandler(data, response, error);
+                               }];
+      };
+  // The request is superseded as a whole, so that a stale request's retries and hedges are
+  // cancelled along with its first attempt.
+  GRSDProviderOperationStart startRequest = ^(dispatch_block_t finishRequest) {
+    return [retryPolicy performRequestWithRetryMode:retryMode
+                                           hedgeKey:callName
+                                            attempt:attempt
+                                  completionHandler:^(NSData *data, NSURLResponse *response,
+                                                      NSError *error) {
+                                    finishRequest();
+                                    handler(data, response, error);
+                                  }];
+  };
+  if (resourceKey) {
+    [requestScheduler startOperationForResourceKey:resourceKey usingBlock:startRequest];
+  } else {
+    startRequest(^{
+    });
+  }
 }
 
 - (void)createVehicleWithID:(NSString *)vehicleID
         isBackToBackEnabled:(BOOL)isBackToBackEnabled
                  completion:(GRSDCreateVehicleWithIDHandler)completion {
+  CFTimeInterval startTime = CACurrentMediaTime();
   if (!completion) {
     NSAssert(NO, @"%s encountered an unexpected nil completion.", __PRETTY_FUNCTION__);
     return;
   }
+  completion = GetVehicleModelHandlerOnQueue(_callbackQueue, _metrics,
+                                             NSStringFromSelector(_cmd), completion);
 
   if (vehicleID.length == 0) {
     NSString *invalidAuthorizationContextDescription =
@@ -401,18 +584,22 @@ static NSArray<GMTSTripWaypoint *> *_Nullable GetTripWaypointsFromJSONResponse(
                                                  completion:completion];
       };
 
-  NSDictionary<NSString *, id> *payload = @{
-    kProviderDataKeyVehicleID : vehicleID,
-    kProviderDataKeyBackToBackEnabled : @(isBackToBackEnabled)
-  };
-  NSURL *requestURL = GenerateCreateVehicleURL();
+  NSDictionary<NSString *, id> *payload =
+      GRSDProviderCreateVehicleRequestBody(vehicleID, isBackToBackEnabled);
+  NSURL *requestURL = GRSDProviderCreateVehicleURL(GetCanonicalBaseURL());
   if (!requestURL) {
     completion(nil, GRSDError(kProviderErrorCode, kInvalidRequestUrlDescription));
     return;
   }
-  NSURLRequest *request = GenerateJSONRequestWithMethod(kHTTPPOSTMethod, requestURL, payload);
-  NSURLSessionDataTask *task = [self.session dataTaskWithRequest:request completionHandler:handler];
-  [task resume];
+  NSURLRequest *request = GenerateRequestWithMethod(kHTTPPOSTMethod, requestURL, payload,
+                                                    atomic_load(&_providerAcceptsPropertyList));
+  [self resumeDataTaskWithRequest:request
+                          forCall:_cmd
+                        startTime:startTime
+                         priority:GRSDProviderRequestPriorityInteractive
+                      resourceKey:nil
+                        retryMode:GRSDProviderRetryModeRetry
+                completionHandler:handler];
 }
 
 - (void)handleCreateVehicleWithIDResponseWithData:(NSData *)data
@@ -428,18 +615,26 @@ static NSArray<GMTSTripWaypoint *> *_Nullable GetTripWaypointsFromJSONResponse(
   if (statusCode != kHTTPStatusOkCode) {
     completion(nil, GRSDError(kProviderErrorCode, kErrorCreatingVehicleDescription));
   } else {
+    NSError *payloadError;
+    GRSDProviderPayload *payload = [self payloadWithData:data
+                                                response:response
+                                                   error:&payloadError];
     NSError *processResponseError;
-    GRSDVehicleModel *vehicleModel = GetVehicleModelFromResponseData(data, &processResponseError);
+    GRSDVehicleModel *vehicleModel =
+        GetVehicleModelFromResponsePayload(payload, payloadError, &processResponseError);
     completion(vehicleModel, processResponseError);
   }
 }
 
 - (void)updateVehicleWithModel:(GRSDVehicleModel *)vehicleModel
                     completion:(GRSDUpdateVehicleHandler)completion {
+  CFTimeInterval startTime = CACurrentMediaTime();
   if (!completion) {
     NSAssert(NO, @"%s encountered an unexpected nil completion.", __PRETTY_FUNCTION__);
     return;
   }
+  completion = GetVehicleModelHandlerOnQueue(_callbackQueue, _metrics,
+                                             NSStringFromSelector(_cmd), completion);
   if (!vehicleModel) {
     NSString *invalidVehicleModelErrorDescription =
         @"Encountered an unexpected invalid parameter (vehicleModel).";
@@ -455,15 +650,23 @@ static NSArray<GMTSTripWaypoint *> *_Nullable GetTripWaypointsFromJSONResponse(
                                                 error:error
                                            completion:completion];
       };
-  NSDictionary<NSString *, id> *payload = GetJSONDictionaryFromVehicleModel(vehicleModel);
-  NSURL *requestURL = GenerateUpdateVehicleURL(vehicleModel.vehicleID);
+  NSDictionary<NSString *, id> *payload = GRSDProviderUpdateVehicleRequestBody(
+      vehicleModel.vehicleID, (NSInteger)vehicleModel.maximumCapacity,
+      vehicleModel.isBackToBackEnabled, vehicleModel.supportedTripTypes);
+  NSURL *requestURL = GRSDProviderVehicleURL(GetCanonicalBaseURL(), vehicleModel.vehicleID);
   if (!requestURL) {
     completion(nil, GRSDError(kProviderErrorCode, kInvalidRequestUrlDescription));
     return;
   }
-  NSURLRequest *request = GenerateJSONRequestWithMethod(kHTTPPUTMethod, requestURL, payload);
-  NSURLSessionDataTask *task = [self.session dataTaskWithRequest:request completionHandler:handler];
-  [task resume];
+  NSURLRequest *request = GenerateRequestWithMethod(kHTTPPUTMethod, requestURL, payload,
+                                                    atomic_load(&_providerAcceptsPropertyList));
+  [self resumeDataTaskWithRequest:request
+                          forCall:_cmd
+                        startTime:startTime
+                         priority:GRSDProviderRequestPriorityInteractive
+                      resourceKey:nil
+                        retryMode:GRSDProviderRetryModeRetry
+                completionHandler:handler];
 }
 
 - (void)handleUpdateVehicleResponseWithData:(NSData *)data
@@ -479,8 +682,11 @@ static NSArray<GMTSTripWaypoint *> *_Nullable GetTripWaypointsFromJSONResponse(
     completion(nil, GRSDError(kProviderErrorCode, kErrorUpdatingVehicleDescription));
     return;
   }
+  NSError *payloadError;
+  GRSDProviderPayload *payload = [self payloadWithData:data response:response error:&payloadError];
   NSError *processResponseError;
-  GRSDVehicleModel *vehicleModel = GetVehicleModelFromResponseData(data, &processResponseError);
+  GRSDVehicleModel *vehicleModel =
+      GetVehicleModelFromResponsePayload(payload, payloadError, &processResponseError);
   completion(vehicleModel, processResponseError);
 }
 
@@ -489,6 +695,18 @@ static NSArray<GMTSTripWaypoint *> *_Nullable GetTripWaypointsFromJSONResponse(
     NSAssert(NO, @"%s encountered an unexpected nil completion.", __PRETTY_FUNCTION__);
     return;
   }
+  // The request is made, and its phases recorded, by requestTripWithID:completion:.
+  NSString *callName = NSStringFromSelector(@selector(requestTripWithID:completion:));
+  completion = GetFetchTripHandlerOnQueue(_callbackQueue, _metrics, callName, completion);
+  [self requestTripWithID:tripID completion:completion];
+}
+
+/**
+ * Fetches trip details for the given trip ID, calling @c completion on the decoding queue unless
+ * the request could not be made.
+ */
+- (void)requestTripWithID:(NSString *)tripID completion:(GRSDFetchTripHandler)completion {
+  CFTimeInterval startTime = CACurrentMediaTime();
   if (tripID.length == 0) {
     NSString *kTripIDMissingDescription = @"Encountered an unexpected invalid parameter (tripID).";
     completion(nil, GMTSTripStatusUnknown, nil,
@@ -496,32 +714,41 @@ static NSArray<GMTSTripWaypoint *> *_Nullable GetTripWaypointsFromJSONResponse(
     return;
   }
 
+  NSURL *requestURL = GRSDProviderTripURL(GetCanonicalBaseURL(), tripID);
+  if (!requestURL) {
+    completion(nil, GMTSTripStatusUnknown, nil,
+               GRSDError(kProviderErrorCode, kInvalidRequestUrlDescription));
+    return;
+  }
+
   __weak typeof(self) weakSelf = self;
   void (^handler)(NSData *, NSURLResponse *, NSError *) =
       ^(NSData *data, NSURLResponse *response, NSError *error) {
         [weakSelf handleFetchTripResponseWithData:data
                                          response:response
                                             error:error
+                                       requestURL:requestURL
                                        completion:completion];
       };
 
-  NSURL *requestURL = GenerateFetchTripURL(tripID);
-  if (!requestURL) {
-    completion(nil, GMTSTripStatusUnknown, nil,
-               GRSDError(kProviderErrorCode, kInvalidRequestUrlDescription));
-    return;
-  }
-
   NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:requestURL];
   request.HTTPMethod = kHTTPGETMethod;
-  NSURLSessionDataTask *task = [self.session dataTaskWithRequest:request completionHandler:handler];
-
-  [task resume];
+  [request setValue:[_tripTracer traceHeaderValueForTripID:tripID]
+      forHTTPHeaderField:GRSDTripTraceHeaderField];
+  [_responseCache addValidatorsToRequest:request];
+  [self resumeDataTaskWithRequest:request
+                          forCall:_cmd
+                        startTime:startTime
+                         priority:GRSDProviderRequestPriorityBackground
+                      resourceKey:requestURL.absoluteString
+                        retryMode:GRSDProviderRetryModeRetryAndHedge
+                completionHandler:handler];
 }
 
 - (void)handleFetchTripResponseWithData:(NSData *)data
                                response:(NSURLResponse *)response
                                   error:(NSError *)error
+                             requestURL:(NSURL *)requestURL
                              completion:(GRSDFetchTripHandler)completion {
   if (error) {
     completion(nil, GMTSTripStatusUnknown, nil, error);
@@ -529,6 +756,15 @@ static NSArray<GMTSTripWaypoint *> *_Nullable GetTripWaypointsFromJSONResponse(
   }
 
   NSInteger statusCode = [(NSHTTPURLResponse *)response statusCode];
+  BOOL isNotModified = statusCode == kHTTPStatusNotModifiedCode;
+  if (isNotModified) {
+    // Decode the cached body again, so that the ETAs derived from it are of the current time.
+    NSCachedURLResponse *cachedResponse =
+        [_responseCache cachedResponseForNotModifiedResponseToURL:requestURL];
+    data = cachedResponse.data;
+    response = cachedResponse.response;
+    statusCode = cachedResponse ? kHTTPStatusOkCode : statusCode;
+  }
   if (statusCode != kHTTPStatusOkCode) {
     completion(nil, GMTSTripStatusUnknown, nil,
                GRSDError(kProviderErrorCode, kErrorFetchingTripDescription));
@@ -540,43 +776,195 @@ static NSArray<GMTSTripWaypoint *> *_Nullable GetTripWaypointsFromJSONResponse(
     return;
   }
 
-  // Write response to JSON object.
-  NSError *jsonParseError;
-  NSDictionary<NSString *, id> *jsonResponse =
-      [NSJSONSerialization JSONObjectWithData:data options:kNilOptions error:&jsonParseError];
-  if (jsonParseError) {
-    completion(nil, GMTSTripStatusUnknown, nil, jsonParseError);
+  // Decode the response.
+  NSError *payloadError;
+  GRSDProviderPayload *payload = [self payloadWithData:data response:response error:&payloadError];
+  if (!payload) {
+    completion(nil, GMTSTripStatusUnknown, nil, payloadError);
     return;
   }
 
   // Get all the trip info from response.
-  NSDictionary<NSString *, id> *tripResponse = jsonResponse[kProviderDataKeyTrip];
+  NSError *tripError;
+  GRSDTripModel *trip = GetTripModelFromPayload(payload.trip, &tripError);
+  if (!trip) {
+    completion(nil, GMTSTripStatusUnknown, nil, tripError);
+    return;
+  }
 
-  // Get the trip name from trip response.
-  NSString *fullTripName = tripResponse[kProviderDataKeyName];
-  // Provider returns fully qualified trip name in this form:
-  // 'providers/providerID/trips/tripID', so strip trip ID from it.
-  NSString *tripID = [fullTripName componentsSeparatedByString:@"/"].lastObject;
-  if (!tripID) {
-    completion(nil, GMTSTripStatusUnknown, nil,
-               GRSDError(kProviderErrorCode, kInvalidTripIDDescription));
+  if (!isNotModified) {
+    [_responseCache storeData:data forResponse:(NSHTTPURLResponse *)response URL:requestURL];
+  }
+  completion(trip.tripID, trip.tripStatus, trip.waypoints, nil);
+}
+
+- (void)fetchTripsWithIDs:(NSArray<NSString *> *)tripIDs
+               completion:(GRSDFetchTripsHandler)completion {
+  CFTimeInterval startTime = CACurrentMediaTime();
+  if (!completion) {
+    NSAssert(NO, @"%s encountered an unexpected nil completion.", __PRETTY_FUNCTION__);
+    return;
+  }
+  completion = GetFetchTripsHandlerOnQueue(_callbackQueue, _metrics,
+                                           NSStringFromSelector(_cmd), completion);
+
+  NSArray<NSString *> *uniqueTripIDs = [NSOrderedSet orderedSetWithArray:tripIDs].array;
+  if (uniqueTripIDs.count == 0) {
+    completion(@{}, nil);
+    return;
+  }
+  NSURL *requestURL = GRSDProviderBatchGetTripsURL(
+      GetCanonicalBaseURL(), [uniqueTripIDs componentsJoinedByString:@","]);
+  if (uniqueTripIDs.count == 1 || atomic_load(&_isBatchGetTripsUnsupported) || !requestURL) {
+    [self fetchTripsIndividuallyWithIDs:uniqueTripIDs completion:completion];
     return;
   }
-  NSString *tripStatusString = tripResponse[kProviderDataKeyTripStatus];
-  GMTSTripStatus tripStatus = GetTripStatusFromProviderString(tripStatusString);
-  NSArray<GMTSTripWaypoint *> *waypoints = GetTripWaypointsFromJSONResponse(tripResponse);
 
-  completion(tripID, tripStatus, [waypoints copy], nil);
+  __weak typeof(self) weakSelf = self;
+  void (^handler)(NSData *, NSURLResponse *, NSError *) =
+      ^(NSData *data, NSURLResponse *response, NSError *error) {
+        [weakSelf handleBatchGetTripsResponseWithData:data
+                                             response:response
+                                                error:error
+                                              tripIDs:uniqueTripIDs
+                                           completion:completion];
+      };
+
+  NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:requestURL];
+  request.HTTPMethod = kHTTPGETMethod;
+  // A request carries a single trace context, so a batch is traced as part of its first trip.
+  [request setValue:[_tripTracer traceHeaderValueForTripID:uniqueTripIDs.firstObject]
+      forHTTPHeaderField:GRSDTripTraceHeaderField];
+  [self resumeDataTaskWithRequest:request
+                          forCall:_cmd
+                        startTime:startTime
+                         priority:GRSDProviderRequestPriorityBackground
+                      resourceKey:requestURL.absoluteString
+                        retryMode:GRSDProviderRetryModeRetryAndHedge
+                completionHandler:handler];
+}
+
+- (void)handleBatchGetTripsResponseWithData:(NSData *)data
+                                   response:(NSURLResponse *)response
+                                      error:(NSError *)error
+                                    tripIDs:(NSArray<NSString *> *)tripIDs
+                                 completion:(GRSDFetchTripsHandler)completion {
+  if (error) {
+    completion(@{}, error);
+    return;
+  }
+
+  NSInteger statusCode = [(NSHTTPURLResponse *)response statusCode];
+  if (IsUnsupportedEndpointStatusCode(statusCode)) {
+    // Remember that the provider has no batch endpoint and fetch one trip per request instead.
+    atomic_store(&_isBatchGetTripsUnsupported, true);
+    [self fetchTripsIndividuallyWithIDs:tripIDs completion:completion];
+    return;
+  }
+  if (statusCode != kHTTPStatusOkCode) {
+    completion(@{}, GRSDError(kProviderErrorCode, kErrorFetchingTripDescription));
+    return;
+  }
+
+  NSError *payloadError;
+  GRSDProviderPayload *payload = [self payloadWithData:data response:response error:&payloadError];
+  if (!payload) {
+    completion(@{}, payloadError);
+    return;
+  }
+
+  NSMutableDictionary<NSString *, GRSDTripModel *> *trips = [[NSMutableDictionary alloc] init];
+  NSError *firstError;
+  for (GRSDProviderPayload *tripPayload in payload.trips) {
+    NSError *tripError;
+    GRSDTripModel *trip = GetTripModelFromPayload(tripPayload, &tripError);
+    if (trip) {
+      trips[trip.tripID] = trip;
+    } else if (!firstError) {
+      firstError = tripError;
+    }
+  }
+  completion(trips, firstError);
+}
+
+/**
+ * Fetches each trip with its own request, keeping at most @c maximumConcurrentTripFetches
+ * requests in flight.
+ */
+- (void)fetchTripsIndividuallyWithIDs:(NSArray<NSString *> *)tripIDs
+                           completion:(GRSDFetchTripsHandler)completion {
+  NSMutableArray<NSString *> *queuedTripIDs = [tripIDs mutableCopy];
+  NSMutableDictionary<NSString *, GRSDTripModel *> *trips = [[NSMutableDictionary alloc] init];
+  __block NSUInteger outstandingFetchCount = tripIDs.count;
+  __block NSError *firstError;
+
+  // The block refers to itself to start the next queued fetch; the cycle is broken once the last
+  // fetch completes.
+  __weak typeof(self) weakSelf = self;
+  __block void (^fetchNextTrip)(void) = ^{
+    NSString *tripID = queuedTripIDs.firstObject;
+    if (!tripID) {
+      return;
+    }
+    [queuedTripIDs removeObjectAtIndex:0];
+    GRSDFetchTripHandler tripHandler =
+        ^(NSString *_Nullable fetchedTripID, GMTSTripStatus tripStatus,
+          NSArray<GMTSTripWaypoint *> *_Nullable waypoints, NSError *_Nullable error) {
+          if (fetchedTripID) {
+            trips[fetchedTripID] = [[GRSDTripModel alloc] initWithTripID:fetchedTripID
+                                                              tripStatus:tripStatus
+                                                               waypoints:waypoints ?: @[]];
+          } else if (error && !firstError) {
+            firstError = error;
+          }
+          outstandingFetchCount--;
+          if (outstandingFetchCount == 0) {
+            fetchNextTrip = nil;
+            completion(trips, firstError);
+          } else {
+            fetchNextTrip();
+          }
+        };
+    GRSDProviderService *strongSelf = weakSelf;
+    if (strongSelf) {
+      [strongSelf requestTripWithID:tripID completion:tripHandler];
+    } else {
+      tripHandler(nil, GMTSTripStatusUnknown, nil, nil);
+    }
+  };
+
+  // Start the fetches on the decoding queue, where the trip handlers also run.
+  NSUInteger concurrentFetchCount = MIN(MAX(_maximumConcurrentTripFetches, 1), tripIDs.count);
+  [_decodingQueue addOperationWithBlock:^{
+    for (NSUInteger i = 0; i < concurrentFetchCount; i++) {
+      fetchNextTrip();
+    }
+  }];
+}
+
+- (void)updateTripWithStatus:(GMTSTripStatus)newStatus
+                          tripID:(NSString *)tripID
+    intermediateDestinationIndex:(nullable NSNumber *)intermediateDestinationIndex
+                      completion:(GRSDUpdateTripHandler)completion {
+  [self updateTripWithStatus:newStatus
+                            tripID:tripID
+      intermediateDestinationIndex:intermediateDestinationIndex
+                    idempotencyKey:nil
+                        completion:completion];
 }
 
 - (void)updateTripWithStatus:(GMTSTripStatus)newStatus
                           tripID:(NSString *)tripID
-    intermediateDestinationIndex:(NSNumber *)intermediateDestinationIndex
+    intermediateDestinationIndex:(nullable NSNumber *)intermediateDestinationIndex
+                  idempotencyKey:(nullable NSString *)idempotencyKey
                       completion:(GRSDUpdateTripHandler)completion {
+  CFTimeInterval startTime = CACurrentMediaTime();
   if (!completion) {
     NSAssert(NO, @"%s encountered an unexpected nil completion.", __PRETTY_FUNCTION__);
     return;
   }
+  completion =
+      GetStringHandlerOnQueue(_callbackQueue, _metrics, NSStringFromSelector(_cmd), completion);
 
   if (tripID.length == 0 || newStatus == GMTSTripStatusUnknown) {
     NSString *kUnexpectedNilParamDescription = @"Encountered an unexpected invalid parameter.";
@@ -591,16 +979,22 @@ static NSArray<GMTSTripWaypoint *> *_Nullable GetTripWaypointsFromJSONResponse(
                                              error:error
                                         completion:completion];
       };
-  NSMutableDictionary<NSString *, id> *payload = [[NSMutableDictionary alloc] init];
-  [payload setObject:GetProviderStringFromTripStatus(newStatus) forKey:kProviderDataKeyStatus];
-  if (intermediateDestinationIndex) {
-    [payload setObject:intermediateDestinationIndex
-                forKey:kProviderDataKeyIntermediateDestinationIndex];
-  }
-  NSURL *requestURL = GenerateUpdateTripStatusURL(tripID);
-  NSURLRequest *request = GenerateJSONRequestWithMethod(@"PUT", requestURL, payload);
-  NSURLSessionDataTask *task = [self.session dataTaskWithRequest:request completionHandler:handler];
-  [task resume];
+  NSDictionary<NSString *, id> *payload =
+      GRSDProviderUpdateTripRequestBody(newStatus, intermediateDestinationIndex);
+  NSURL *requestURL = GRSDProviderTripURL(GetCanonicalBaseURL(), tripID);
+  NSMutableURLRequest *request =
+      [GenerateRequestWithMethod(@"PUT", requestURL, payload,
+                                 atomic_load(&_providerAcceptsPropertyList)) mutableCopy];
+  [request setValue:idempotencyKey forHTTPHeaderField:kHTTPIdempotencyKeyHeaderField];
+  [request setValue:[_tripTracer traceHeaderValueForTripID:tripID]
+      forHTTPHeaderField:GRSDTripTraceHeaderField];
+  [self resumeDataTaskWithRequest:request
+                          forCall:_cmd
+                        startTime:startTime
+                         priority:GRSDProviderRequestPriorityInteractive
+                      resourceKey:nil
+                        retryMode:GRSDProviderRetryModeNone
+                completionHandler:handler];
 }
 
 - (void)handleUpdateTripResponseWithData:(NSData *)data
@@ -613,21 +1007,26 @@ static NSArray<GMTSTripWaypoint *> *_Nullable GetTripWaypointsFromJSONResponse(
   }
   NSInteger statusCode = [(NSHTTPURLResponse *)response statusCode];
   if (statusCode != kHTTPStatusOkCode) {
-    completion(nil, GRSDError(kProviderErrorCode, kErrorUpdatingTripDescription));
+    NSDictionary<NSErrorUserInfoKey, id> *userInfo = @{
+      NSLocalizedDescriptionKey : kErrorUpdatingTripDescription,
+      GRSDProviderHTTPStatusCodeErrorKey : @(statusCode),
+    };
+    completion(nil, [NSError errorWithDomain:kGRSDErrorDomain
+                                        code:kProviderErrorCode
+                                    userInfo:userInfo]);
     return;
   }
 
-  // Write response to JSON object.
-  NSError *jsonParseError;
-  NSDictionary<NSString *, id> *jsonResponse =
-      [NSJSONSerialization JSONObjectWithData:data options:kNilOptions error:&jsonParseError];
-  if (jsonParseError) {
-    completion(nil, jsonParseError);
+  // Decode the response.
+  NSError *payloadError;
+  GRSDProviderPayload *payload = [self payloadWithData:data response:response error:&payloadError];
+  if (!payload) {
+    completion(nil, payloadError);
     return;
   }
 
   // Get the trip name from response.
-  NSString *fullTripName = jsonResponse[kProviderDataKeyName];
+  NSString *fullTripName = payload.name;
   // Provider returns fully qualified trip name in this form:
   // 'providers/providerID/trips/name', so strip trip name from it.
   NSString *tripID = [fullTripName componentsSeparatedByString:@"/"].lastObject;
@@ -640,10 +1039,13 @@ static NSArray<GMTSTripWaypoint *> *_Nullable GetTripWaypointsFromJSONResponse(
 
 - (void)fetchVehicleWithID:(NSString *)vehicleID
                 completion:(nonnull GRSDFetchVehicleHandler)completion {
+  CFTimeInterval startTime = CACurrentMediaTime();
   if (!completion) {
     NSAssert(NO, @"%s encountered an unexpected nil completion.", __PRETTY_FUNCTION__);
     return;
   }
+  completion = GetFetchVehicleHandlerOnQueue(_callbackQueue, _metrics,
+                                             NSStringFromSelector(_cmd), completion);
   if (!vehicleID || vehicleID.length == 0) {
     NSString *kVehicleIDMissingDescription =
         @"Encountered an unexpected invalid parameter (vehicleID).";
@@ -651,31 +1053,42 @@ static NSArray<GMTSTripWaypoint *> *_Nullable GetTripWaypointsFromJSONResponse(
     return;
   }
 
+  NSURL *requestURL = GRSDProviderVehicleURL(GetCanonicalBaseURL(), vehicleID);
+  if (!requestURL) {
+    completion(nil, nil, GRSDError(kProviderErrorCode, kInvalidRequestUrlDescription));
+    return;
+  }
+
   __weak typeof(self) weakSelf = self;
   void (^handler)(NSData *, NSURLResponse *, NSError *) =
       ^(NSData *data, NSURLResponse *response, NSError *error) {
         [weakSelf handleFetchVehicleResponseWithData:data
                                             response:response
                                                error:error
+                                          requestURL:requestURL
                                           completion:completion];
       };
 
-  NSURL *requestURL = GenerateGetVehicleURL(vehicleID);
-  if (!requestURL) {
-    completion(nil, nil, GRSDError(kProviderErrorCode, kInvalidRequestUrlDescription));
-    return;
-  }
-
   NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:requestURL];
   request.HTTPMethod = kHTTPGETMethod;
-  NSURLSessionDataTask *task = [self.session dataTaskWithRequest:request
-                                               completionHandler:handler];
-  [task resume];
+  [_responseCache addValidatorsToRequest:request];
+  [self resumeDataTaskWithRequest:request
+                          forCall:_cmd
+                        startTime:startTime
+                         priority:GRSDProviderRequestPriorityBackground
+                      resourceKey:requestURL.absoluteString
+                        retryMode:GRSDProviderRetryModeRetryAndHedge
+                completionHandler:handler];
 }
 
+/**
+ * Handles a response containing a vehicle. The response is cached for conditional requests to
+ * @c requestURL, unless it is nil.
+ */
 - (void)handleFetchVehicleResponseWithData:(NSData *)data
                                   response:(NSURLResponse *)response
                                      error:(NSError *)error
+                                requestURL:(nullable NSURL *)requestURL
                                 completion:(GRSDFetchVehicleHandler)completion {
   if (error) {
     completion(nil, nil, error);
@@ -683,6 +1096,15 @@ static NSArray<GMTSTripWaypoint *> *_Nullable GetTripWaypointsFromJSONResponse(
   }
 
   NSInteger statusCode = [(NSHTTPURLResponse *)response statusCode];
+  BOOL isNotModified = statusCode == kHTTPStatusNotModifiedCode && requestURL;
+  if (isNotModified) {
+    // Decode the cached body again, so that the ETAs derived from it are of the current time.
+    NSCachedURLResponse *cachedResponse =
+        [_responseCache cachedResponseForNotModifiedResponseToURL:requestURL];
+    data = cachedResponse.data;
+    response = cachedResponse.response;
+    statusCode = cachedResponse ? kHTTPStatusOkCode : statusCode;
+  }
   if (statusCode != kHTTPStatusOkCode) {
     completion(nil, nil, GRSDError(kProviderErrorCode, kErrorFetchingVehicleDescription));
     return;
@@ -694,20 +1116,120 @@ static NSArray<GMTSTripWaypoint *> *_Nullable GetTripWaypointsFromJSONResponse(
     return;
   }
 
-  // Write response to JSON object.
-  NSError *jsonParseError;
-  NSDictionary<NSString *, id> *jsonResponse =
-      [NSJSONSerialization JSONObjectWithData:data options:kNilOptions error:&jsonParseError];
-  if (jsonParseError) {
-    completion(nil, nil, jsonParseError);
+  // Decode the response.
+  NSError *payloadError;
+  GRSDProviderPayload *payload = [self payloadWithData:data response:response error:&payloadError];
+  if (!payload) {
+    completion(nil, nil, payloadError);
     return;
   }
 
-  NSArray *currentTripIDs = jsonResponse[kProviderDataKeyCurrentTripIDs];
-  NSArray<GMTSTripWaypoint *> *waypoints = GetTripWaypointsFromJSONResponse(jsonResponse);
+  NSArray<NSString *> *currentTripIDs = payload.matchedTripIDs;
+  NSArray<GMTSTripWaypoint *> *waypoints = payload.waypoints;
+  if (requestURL && !isNotModified) {
+    [_responseCache storeData:data forResponse:(NSHTTPURLResponse *)response URL:requestURL];
+  }
   completion(currentTripIDs, waypoints, nil);
 }
 
+- (void)waitForVehicleUpdateWithID:(NSString *)vehicleID
+                        completion:(GRSDFetchVehicleHandler)completion {
+  CFTimeInterval startTime = CACurrentMediaTime();
+  if (!completion) {
+    NSAssert(NO, @"%s encountered an unexpected nil completion.", __PRETTY_FUNCTION__);
+    return;
+  }
+  completion = GetFetchVehicleHandlerOnQueue(_callbackQueue, _metrics,
+                                             NSStringFromSelector(_cmd), completion);
+  if (vehicleID.length == 0) {
+    NSString *kVehicleIDMissingDescription =
+        @"Encountered an unexpected invalid parameter (vehicleID).";
+    completion(nil, nil, GRSDError(kProviderErrorCode, kVehicleIDMissingDescription));
+    return;
+  }
+
+  __weak typeof(self) weakSelf = self;
+  void (^handler)(NSData *, NSURLResponse *, NSError *) =
+      ^(NSData *data, NSURLResponse *response, NSError *error) {
+        [weakSelf handleVehicleUpdateResponseWithData:data
+                                             response:response
+                                                error:error
+                                            vehicleID:vehicleID
+                                           completion:completion];
+      };
+
+  NSURL *requestURL = GRSDProviderVehicleUpdatesURL(GetCanonicalBaseURL(), vehicleID);
+  if (!requestURL) {
+    completion(nil, nil, GRSDError(kProviderErrorCode, kInvalidRequestUrlDescription));
+    return;
+  }
+
+  NSMutableURLRequest *request =
+      [NSMutableURLRequest requestWithURL:requestURL
+                              cachePolicy:NSURLRequestReloadIgnoringLocalCacheData
+                          timeoutInterval:kVehicleUpdatesTimeoutInterval];
+  request.HTTPMethod = kHTTPGETMethod;
+  // The provider holds the request open until the vehicle state no longer matches this tag.
+  NSString *lastDeliveredETag;
+  @synchronized(_vehicleUpdateETags) {
+    lastDeliveredETag = _vehicleUpdateETags[vehicleID];
+  }
+  if (lastDeliveredETag) {
+    [request setValue:lastDeliveredETag forHTTPHeaderField:kHTTPIfNoneMatchHeaderField];
+  }
+  [self resumeDataTaskWithRequest:request
+                          forCall:_cmd
+                        startTime:startTime
+                         priority:GRSDProviderRequestPriorityBackground
+                      resourceKey:requestURL.absoluteString
+                        retryMode:GRSDProviderRetryModeNone
+                         longPoll:YES
+                completionHandler:handler];
+}
+
+- (void)handleVehicleUpdateResponseWithData:(NSData *)data
+                                   response:(NSURLResponse *)response
+                                      error:(NSError *)error
+                                  vehicleID:(NSString *)vehicleID
+                                 completion:(GRSDFetchVehicleHandler)completion {
+  if (error) {
+    completion(nil, nil, error);
+    return;
+  }
+
+  NSHTTPURLResponse *HTTPResponse = (NSHTTPURLResponse *)response;
+  if (HTTPResponse.statusCode == kHTTPStatusNotModifiedCode) {
+    // The long-poll window elapsed without a change.
+    completion(nil, nil, nil);
+    return;
+  }
+  if (HTTPResponse.statusCode != kHTTPStatusOkCode) {
+    completion(nil, nil, GRSDError(kProviderErrorCode, kErrorWaitingForVehicleUpdateDescription));
+    return;
+  }
+
+  // Unlike a fetch, an empty body here means the vehicle can't be observed, so don't treat it as
+  // "no change" and have the caller immediately re-issue the request.
+  if (data.length == 0) {
+    completion(nil, nil, GRSDError(kProviderErrorCode, kErrorWaitingForVehicleUpdateDescription));
+    return;
+  }
+
+  NSString *ETag = HTTPResponse.allHeaderFields[kHTTPETagHeaderField];
+  @synchronized(_vehicleUpdateETags) {
+    if (ETag) {
+      _vehicleUpdateETags[vehicleID] = ETag;
+    } else {
+      [_vehicleUpdateETags removeObjectForKey:vehicleID];
+    }
+  }
+  [self handleFetchVehicleResponseWithData:data
+                                  response:response
+                                     error:nil
+                                requestURL:nil
+                                completion:completion];
+}
+
 #pragma mark - GMTDAuthorization
 
 - (void)fetchTokenWithContext:(nullable GMTDAuthorizationContext *)authorizationContext
@@ -726,31 +1248,31 @@ static NSArray<GMTSTripWaypoint *> *_Nullable GetTripWaypointsFromJSONResponse(
     return;
   }
 
-  // Clear cached tokens if vehicle ID has changed.
-  if (![_lastKnownVehicleID isEqual:vehicleID]) {
-    _tokenExpiration = 0.0;
-    _vehicleServiceToken = nil;
-  }
-  _lastKnownVehicleID = vehicleID;
-
-  // Clear cached tokens if they have expired.
-  if ([[NSDate date] timeIntervalSince1970] > _tokenExpiration) {
-    _vehicleServiceToken = nil;
-  }
+  // Tokens are mostly served by the cache rather than by a provider call, so their dispatch isn't
+  // recorded.
+  [_tokenCache fetchTokenForKey:vehicleID
+                     completion:GetStringHandlerOnQueue(_callbackQueue, _metrics, nil, completion)];
+}
 
-  // Use cached token if found.
-  if (_vehicleServiceToken) {
-    NSString *cachedToken = _vehicleServiceToken;
-    dispatch_async(dispatch_get_main_queue(), ^{
-      completion(cachedToken, nil);
-    });
-    return;
-  }
+- (void)prefetchTokenForVehicleID:(NSString *)vehicleID
+                       completion:(void (^)(NSString *_Nullable token,
+                                            NSError *_Nullable error))completion {
+  [_tokenCache fetchTokenForKey:vehicleID
+                     completion:GetStringHandlerOnQueue(_callbackQueue, _metrics, nil, completion)];
+}
 
-  // Fetch new token if there's not a cached one.
-  NSURL *requestURL = GenerateDriverTokenURL(vehicleID);
+/**
+ * Fetches a new driver token from the provider.
+ *
+ * @param vehicleID The vehicle ID to fetch a token for.
+ * @param completion The block executed when the request finishes.
+ */
+- (void)fetchDriverTokenWithVehicleID:(NSString *)vehicleID
+                           completion:(GRSDAuthTokenFetchHandler)completion {
+  CFTimeInterval startTime = CACurrentMediaTime();
+  NSURL *requestURL = GRSDProviderDriverTokenURL(GetCanonicalBaseURL(), vehicleID);
   if (!requestURL) {
-    completion(nil, GRSDError(kProviderErrorCode, kInvalidRequestUrlDescription));
+    completion(nil, 0, GRSDError(kProviderErrorCode, kInvalidRequestUrlDescription));
     return;
   }
 
@@ -765,44 +1287,49 @@ static NSArray<GMTSTripWaypoint *> *_Nullable GetTripWaypointsFromJSONResponse(
 
   NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:requestURL];
   request.HTTPMethod = kHTTPGETMethod;
-  NSURLSessionDataTask *task = [self.session dataTaskWithRequest:request
-                                               completionHandler:tokenResponseHandler];
-  [task resume];
+  [self resumeDataTaskWithRequest:request
+                          forCall:_cmd
+                        startTime:startTime
+                         priority:GRSDProviderRequestPriorityInteractive
+                      resourceKey:nil
+                        retryMode:GRSDProviderRetryModeRetry
+                completionHandler:tokenResponseHandler];
 }
 
 - (void)handleTokenResponseData:(NSData *)data
                        response:(NSURLResponse *)response
                           error:(NSError *)error
-                     completion:(nonnull GMTDAuthTokenFetchCompletionHandler)completion {
+                     completion:(GRSDAuthTokenFetchHandler)completion {
   if (error) {
-    completion(nil, error);
+    completion(nil, 0, error);
   } else {
-    // Write response to JSON object.
-    NSError *jsonParseError;
-    NSDictionary<NSString *, id> *jsonResponse =
-        [NSJSONSerialization JSONObjectWithData:data options:kNilOptions error:&jsonParseError];
-    if (jsonParseError) {
-      completion(nil, jsonParseError);
+    // Decode the response.
+    NSError *payloadError;
+    GRSDProviderPayload *payload = [self payloadWithData:data
+                                                response:response
+                                                   error:&payloadError];
+    if (!payload) {
+      completion(nil, 0, payloadError);
       return;
     }
 
     // Get token from response.
-    NSString *token = jsonResponse[kProviderDataKeyToken];
+    NSString *token = payload.token;
     if ([token length] == 0) {
       NSString *invalidTokenDescription = @"No valid token returned in response.";
-      completion(nil, GRSDError(kProviderErrorCode, invalidTokenDescription));
+      completion(nil, 0, GRSDError(kProviderErrorCode, invalidTokenDescription));
       return;
     }
 
-    // Save token and expiration date for caching purposes.
-    _vehicleServiceToken = token;
-    NSNumber *expirationData = jsonResponse[kProviderDataKeyTokenExpiration];
+    // Tokens without an expiration are returned but not cached.
+    NSTimeInterval expiration = 0;
+    NSNumber *expirationData = payload.tokenExpiration;
     if (expirationData) {
       NSTimeInterval expirationTime = ((NSNumber *)expirationData).doubleValue;
-      _tokenExpiration = [[NSDate date] timeIntervalSince1970] + expirationTime;
+      expiration = _clock.currentTime + expirationTime;
     }
 
-    completion(token, nil);
+    completion(token, expiration, nil);
   }
 }
 
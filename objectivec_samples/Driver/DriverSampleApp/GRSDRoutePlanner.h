@@ -0,0 +1,106 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import <GoogleNavigation/GoogleNavigation.h>
+#import <GoogleRidesharingDriver/GoogleRidesharingDriver.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** The navigation calls that @c GRSDRoutePlanner makes, which @c GMSNavigator implements. */
+@protocol GRSDRouteNavigator <NSObject>
+
+- (void)setDestinations:(NSArray<GMSNavigationWaypoint *> *)destinations
+               callback:(GMSRouteStatusCallback)callback;
+
+- (nullable GMSNavigationWaypoint *)continueToNextDestination;
+
+- (void)clearDestinations;
+
+@end
+
+@interface GMSNavigator (GRSDRouteNavigator) <GRSDRouteNavigator>
+@end
+
+/**
+ * Plans the navigator's route through the remaining waypoints of the matched trips.
+ *
+ * The navigator is given up to @c maximumDestinationCount waypoints at a time, so that one route is
+ * computed for several stops instead of one per stop. When a stop is reached the navigator
+ * continues along the route it already has, and a new route is only computed once the planned
+ * waypoints run out or the remaining waypoints no longer start with them.
+ */
+@interface GRSDRoutePlanner : NSObject
+
+/** The navigator that routes are planned for, which is nil until navigation is enabled. */
+@property(nonatomic, weak, nullable) id<GRSDRouteNavigator> navigator;
+
+/** The maximum number of waypoints the navigator is given at a time. Defaults to 5. */
+@property(nonatomic, readonly) NSUInteger maximumDestinationCount;
+
+/** The waypoints that the navigator's destinations lead to, in order. */
+@property(nonatomic, readonly) NSArray<GMTSTripWaypoint *> *plannedWaypoints;
+
+/** The number of routes that have been computed. */
+@property(nonatomic, readonly) NSUInteger routeComputationCount;
+
+/**
+ * Initializes an instance of this class.
+ *
+ * @param maximumDestinationCount The maximum number of waypoints the navigator is given at a time.
+ */
+- (instancetype)initWithMaximumDestinationCount:(NSUInteger)maximumDestinationCount
+    NS_DESIGNATED_INITIALIZER;
+
+/**
+ * Routes the navigator to the first of the remaining waypoints, and through as many of the next
+ * ones as it is given at a time.
+ *
+ * @param waypoints The remaining waypoints, in the order they are visited.
+ * @param completion The block to call once with the status of the route when it is ready, which is
+ * right away if the navigator's route still leads through the first waypoints. It is called with
+ * @c GMSRouteStatusCanceled if the route is superseded or cleared before then, and with
+ * @c GMSRouteStatusWaypointError if a waypoint has no location.
+ */
+- (void)planRouteThroughWaypoints:(NSArray<GMTSTripWaypoint *> *)waypoints
+                       completion:(GMSRouteStatusCallback)completion;
+
+/**
+ * Routes the navigator through as many of the remaining waypoints as it is given at a time, even if
+ * its route already leads to the first of them.
+ *
+ * Used when waypoints are appended past the end of the planned route, such as those of the next
+ * back-to-back trip, so that the legs to them are computed before the driver needs them. A new
+ * route is only computed if the planned one stops short of them.
+ *
+ * @param waypoints The remaining waypoints, in the order they are visited.
+ * @param completion The block to call with the status of the route once it is ready.
+ */
+- (void)extendRouteThroughWaypoints:(NSArray<GMTSTripWaypoint *> *)waypoints
+                         completion:(GMSRouteStatusCallback)completion;
+
+/**
+ * Continues along the planned route once the navigator arrives at its first waypoint, without
+ * computing a new route.
+ */
+- (void)didArrive;
+
+/** Clears the navigator's route, cancelling the route being computed. */
+- (void)clearRoute;
+
+@end
+
+NS_ASSUME_NONNULL_END
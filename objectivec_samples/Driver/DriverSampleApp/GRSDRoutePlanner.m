@@ -0,0 +1,184 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#import "GRSDRoutePlanner.h"
+
+#import "GRSDWaypointStore.h"
+
+/** The number of waypoints the navigator is given at a time by default. */
+static const NSUInteger kDefaultMaximumDestinationCount = 5;
+
+/** Returns whether @c waypoints start with the same waypoints as @c prefix. */
+static BOOL WaypointsStartWithWaypoints(NSArray<GMTSTripWaypoint *> *waypoints,
+                                        NSArray<GMTSTripWaypoint *> *prefix) {
+  if (prefix.count > waypoints.count) {
+    return NO;
+  }
+  NSArray<GMTSTripWaypoint *> *head = [waypoints subarrayWithRange:NSMakeRange(0, prefix.count)];
+  return [GRSDWaypointDiff diffFromWaypoints:head toWaypoints:prefix].empty;
+}
+
+@implementation GMSNavigator (GRSDRouteNavigator)
+@end
+
+@implementation GRSDRoutePlanner {
+  NSMutableArray<GMTSTripWaypoint *> *_plannedWaypoints;
+  /** The completions waiting for the route being computed, or nil if it is ready. */
+  NSMutableArray<GMSRouteStatusCallback> *_pendingCompletions;
+  /** Incremented for each route, so that the callback of a superseded route is ignored. */
+  NSUInteger _routeGeneration;
+}
+
+- (instancetype)init {
+  return [self initWithMaximumDestinationCount:kDefaultMaximumDestinationCount];
+}
+
+- (instancetype)initWithMaximumDestinationCount:(NSUInteger)maximumDestinationCount {
+  self = [super init];
+  if (self) {
+    _maximumDestinationCount = MAX(maximumDestinationCount, 1);
+    _plannedWaypoints = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+- (NSArray<GMTSTripWaypoint *> *)plannedWaypoints {
+  return [_plannedWaypoints copy];
+}
+
+- (void)planRouteThroughWaypoints:(NSArray<GMTSTripWaypoint *> *)waypoints
+                       completion:(GMSRouteStatusCallback)completion {
+  [self planRouteThroughWaypoints:waypoints minimumPlannedCount:1 completion:completion];
+}
+
+- (void)extendRouteThroughWaypoints:(NSArray<GMTSTripWaypoint *> *)waypoints
+                         completion:(GMSRouteStatusCallback)completion {
+  [self planRouteThroughWaypoints:waypoints
+              minimumPlannedCount:MIN(waypoints.count, _maximumDestinationCount)
+                       completion:completion];
+}
+
+/**
+ * Routes the navigator through the remaining waypoints, unless its route already leads through the
+ * first of them and through at least @c minimumPlannedCount waypoints.
+ */
+- (void)planRouteThroughWaypoints:(NSArray<GMTSTripWaypoint *> *)waypoints
+              minimumPlannedCount:(NSUInteger)minimumPlannedCount
+                       completion:(GMSRouteStatusCallback)completion {
+  id<GRSDRouteNavigator> navigator = _navigator;
+  if (!navigator) {
+    completion(GMSRouteStatusCanceled);
+    return;
+  }
+  if (!waypoints.count) {
+    completion(GMSRouteStatusNoWaypointsError);
+    return;
+  }
+
+  if (!_pendingCompletions && _plannedWaypoints.count > 1 &&
+      !WaypointsStartWithWaypoints(waypoints, _plannedWaypoints) &&
+      WaypointsStartWithWaypoints(
+          waypoints, [_plannedWaypoints
+                         subarrayWithRange:NSMakeRange(1, _plannedWaypoints.count - 1)])) {
+    // The first planned waypoint was reached without the navigator arriving at it.
+    [_plannedWaypoints removeObjectAtIndex:0];
+    [navigator continueToNextDestination];
+  }
+  if (_plannedWaypoints.count >= minimumPlannedCount &&
+      WaypointsStartWithWaypoints(waypoints, _plannedWaypoints)) {
+    if (_pendingCompletions) {
+      [_pendingCompletions addObject:completion];
+    } else {
+      completion(GMSRouteStatusOK);
+    }
+    return;
+  }
+
+  NSArray<GMTSTripWaypoint *> *destinations =
+      [waypoints subarrayWithRange:NSMakeRange(0, MIN(waypoints.count, _maximumDestinationCount))];
+  NSMutableArray<GMSNavigationWaypoint *> *navigationWaypoints =
+      [NSMutableArray arrayWithCapacity:destinations.count];
+  for (GMTSTripWaypoint *waypoint in destinations) {
+    GMSNavigationWaypoint *navigationWaypoint =
+        waypoint.location.point
+            ? [[GMSNavigationWaypoint alloc] initWithLocation:waypoint.location.point.coordinate
+                                                        title:@""]
+            : nil;
+    if (!navigationWaypoint) {
+      completion(GMSRouteStatusWaypointError);
+      return;
+    }
+    [navigationWaypoints addObject:navigationWaypoint];
+  }
+
+  // A route that is extended still leads through the waypoints that the route being computed was
+  // waited for. Any other route being computed is superseded.
+  BOOL isExtendingRoute = WaypointsStartWithWaypoints(destinations, _plannedWaypoints);
+  NSArray<GMSRouteStatusCallback> *supersededCompletions =
+      isExtendingRoute ? @[] : (_pendingCompletions ?: @[]);
+  NSMutableArray<GMSRouteStatusCallback> *pendingCompletions =
+      _pendingCompletions && isExtendingRoute ? _pendingCompletions
+                                              : [[NSMutableArray alloc] init];
+  [pendingCompletions addObject:completion];
+  NSUInteger generation = ++_routeGeneration;
+  [_plannedWaypoints setArray:destinations];
+  _pendingCompletions = pendingCompletions;
+  _routeComputationCount++;
+  __weak typeof(self) weakSelf = self;
+  [navigator setDestinations:navigationWaypoints
+                    callback:^(GMSRouteStatus routeStatus) {
+                      [weakSelf handleRouteStatus:routeStatus forGeneration:generation];
+                    }];
+  for (GMSRouteStatusCallback supersededCompletion in supersededCompletions) {
+    supersededCompletion(GMSRouteStatusCanceled);
+  }
+}
+
+- (void)handleRouteStatus:(GMSRouteStatus)routeStatus forGeneration:(NSUInteger)generation {
+  if (generation != _routeGeneration) {
+    return;
+  }
+  if (routeStatus != GMSRouteStatusOK) {
+    [_plannedWaypoints removeAllObjects];
+  }
+  NSArray<GMSRouteStatusCallback> *completions = _pendingCompletions;
+  _pendingCompletions = nil;
+  for (GMSRouteStatusCallback completion in completions) {
+    completion(routeStatus);
+  }
+}
+
+- (void)didArrive {
+  if (_pendingCompletions || !_plannedWaypoints.count) {
+    return;
+  }
+  [_plannedWaypoints removeObjectAtIndex:0];
+  if (_plannedWaypoints.count) {
+    [_navigator continueToNextDestination];
+  }
+}
+
+- (void)clearRoute {
+  NSArray<GMSRouteStatusCallback> *cancelledCompletions = _pendingCompletions;
+  _routeGeneration++;
+  [_plannedWaypoints removeAllObjects];
+  _pendingCompletions = nil;
+  [_navigator clearDestinations];
+  for (GMSRouteStatusCallback cancelledCompletion in cancelledCompletions) {
+    cancelledCompletion(GMSRouteStatusCanceled);
+  }
+}
+
+@end
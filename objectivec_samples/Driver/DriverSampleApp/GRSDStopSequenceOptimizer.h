@@ -0,0 +1,73 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#import <Foundation/Foundation.h>
+
+#import <GoogleRidesharingDriver/GoogleRidesharingDriver.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** A proposed order for the remaining stops of a vehicle's matched trips. */
+@interface GRSDStopSequenceProposal : NSObject
+
+/** The stops in the proposed order. */
+@property(nonatomic, readonly) NSArray<GMTSTripWaypoint *> *waypoints;
+
+/** The length of the route in the proposed order, in meters. */
+@property(nonatomic, readonly) double distance;
+
+/** The length of the route in the original order, in meters. */
+@property(nonatomic, readonly) double originalDistance;
+
+/** Whether the proposed order differs from the original one. */
+@property(nonatomic, readonly, getter=isReordered) BOOL reordered;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@end
+
+/**
+ * Proposes a shorter order for the remaining stops of a vehicle's matched trips.
+ *
+ * The provider decides the order in which a shared or back-to-back vehicle visits its stops, and
+ * the driver app follows it. The optimizer looks for a shorter order that the provider could
+ * adopt. Each trip's stops keep their order, so pickups stay before intermediate destinations and
+ * dropoffs, and the vehicle never carries more than @c maximumCapacity trips at once. The first
+ * stop stays first, since the vehicle is already heading to it.
+ *
+ * Stops are inserted trip by trip at their cheapest feasible position, and the order is then
+ * improved by moving one stop at a time until no move shortens it or @c timeBudget runs out. Legs
+ * are measured as great-circle distances.
+ */
+@interface GRSDStopSequenceOptimizer : NSObject
+
+/** The most trips the vehicle can carry at once. */
+@property(nonatomic, readonly) NSUInteger maximumCapacity;
+
+/** How long the local search may run for, after the stops are inserted. Defaults to 50 ms. */
+@property(nonatomic) NSTimeInterval timeBudget;
+
+- (instancetype)initWithMaximumCapacity:(NSUInteger)maximumCapacity NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Returns the shortest order found for the stops. The original order is kept if no shorter
+ * feasible order is found.
+ */
+- (GRSDStopSequenceProposal *)proposalForWaypoints:(NSArray<GMTSTripWaypoint *> *)waypoints;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,435 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#import "GRSDStopSequenceOptimizer.h"
+
+#import <CoreLocation/CoreLocation.h>
+#include <math.h>
+
+static const NSTimeInterval kDefaultTimeBudget = 0.05;
+static const double kEarthRadiusInMeters = 6371008.8;
+/** The smallest saving, in meters, for which a stop is moved. */
+static const double kMinimumSaving = 1e-6;
+
+/** The stops to order, the constraints on their order, and the order being improved. */
+typedef struct {
+  NSUInteger count;
+  NSUInteger capacity;
+  /** The previous stop of each stop's trip, or -1 for its first stop. */
+  NSInteger *predecessors;
+  /** The next stop of each stop's trip, or -1 for its last stop. */
+  NSInteger *successors;
+  /** How many trips the vehicle carries more after each stop. */
+  NSInteger *loadDeltas;
+  /** The number of trips on board before the first stop, whose pickups are behind the vehicle. */
+  NSInteger initialLoad;
+  /** The distance between every two stops, in meters, row by row. */
+  double *distances;
+  /** The order being improved, of which the first orderCount stops are placed. */
+  NSUInteger *order;
+  NSUInteger orderCount;
+  /** The position of each placed stop in the order. */
+  NSUInteger *positions;
+  /** The number of trips on board after each position of the order. */
+  NSInteger *loads;
+} GRSDStopSequenceSearch;
+
+/** Returns the great-circle distance between two coordinates, in meters. */
+static double GreatCircleDistance(CLLocationCoordinate2D from, CLLocationCoordinate2D to) {
+  double degreesToRadians = M_PI / 180;
+  double latitudeDelta = (to.latitude - from.latitude) * degreesToRadians;
+  double longitudeDelta = (to.longitude - from.longitude) * degreesToRadians;
+  double a = pow(sin(latitudeDelta / 2), 2) + cos(from.latitude * degreesToRadians) *
+                                                   cos(to.latitude * degreesToRadians) *
+                                                   pow(sin(longitudeDelta / 2), 2);
+  return 2 * kEarthRadiusInMeters * asin(fmin(1, sqrt(a)));
+}
+
+static double Distance(const GRSDStopSequenceSearch *search, NSUInteger from, NSUInteger to) {
+  return search->distances[from * search->count + to];
+}
+
+static double RouteDistance(const GRSDStopSequenceSearch *search, const NSUInteger *order,
+                            NSUInteger count) {
+  double distance = 0;
+  for (NSUInteger position = 1; position < count; position++) {
+    distance += Distance(search, order[position - 1], order[position]);
+  }
+  return distance;
+}
+
+/** Returns whether an order visits every trip's stops in order without exceeding the capacity. */
+static BOOL IsFeasible(const GRSDStopSequenceSearch *search, const NSUInteger *order) {
+  BOOL *isVisited = calloc(MAX(search->count, 1), sizeof(BOOL));
+  BOOL isFeasible = YES;
+  NSInteger load = search->initialLoad;
+  for (NSUInteger position = 0; position < search->count && isFeasible; position++) {
+    NSUInteger stop = order[position];
+    NSInteger predecessor = search->predecessors[stop];
+    load += search->loadDeltas[stop];
+    isFeasible = (predecessor < 0 || isVisited[predecessor]) &&
+                 (search->loadDeltas[stop] <= 0 || load <= (NSInteger)search->capacity);
+    isVisited[stop] = YES;
+  }
+  free(isVisited);
+  return isFeasible;
+}
+
+static void UpdatePositionsAndLoads(GRSDStopSequenceSearch *search) {
+  NSInteger load = search->initialLoad;
+  for (NSUInteger position = 0; position < search->orderCount; position++) {
+    NSUInteger stop = search->order[position];
+    search->positions[stop] = position;
+    load += search->loadDeltas[stop];
+    search->loads[position] = load;
+  }
+}
+
+/** Places a stop before the given position of the order. */
+static void InsertStop(GRSDStopSequenceSearch *search, NSUInteger stop, NSUInteger position) {
+  memmove(&search->order[position + 1], &search->order[position],
+          (search->orderCount - position) * sizeof(NSUInteger));
+  search->order[position] = stop;
+  search->orderCount++;
+}
+
+static void RemoveStop(GRSDStopSequenceSearch *search, NSUInteger position) {
+  memmove(&search->order[position], &search->order[position + 1],
+          (search->orderCount - position - 1) * sizeof(NSUInteger));
+  search->orderCount--;
+}
+
+/** Returns how much inserting a stop before the given position lengthens the order. */
+static double InsertionCost(const GRSDStopSequenceSearch *search, NSUInteger stop,
+                            NSUInteger position) {
+  NSUInteger previous = search->order[position - 1];
+  if (position == search->orderCount) {
+    return Distance(search, previous, stop);
+  }
+  NSUInteger next = search->order[position];
+  return Distance(search, previous, stop) + Distance(search, stop, next) -
+         Distance(search, previous, next);
+}
+
+/**
+ * Returns whether inserting a stop before the given position keeps the loads within capacity,
+ * counting a pickup's load up to the end of the order.
+ */
+static BOOL CanInsert(const GRSDStopSequenceSearch *search, NSUInteger stop, NSUInteger position) {
+  NSInteger delta = search->loadDeltas[stop];
+  if (delta <= 0) {
+    return YES;
+  }
+  for (NSUInteger loadPosition = position - 1; loadPosition < search->orderCount; loadPosition++) {
+    if (search->loads[loadPosition] + delta > (NSInteger)search->capacity) {
+      return NO;
+    }
+  }
+  return YES;
+}
+
+/**
+ * Returns whether moving a stop keeps the loads within capacity. Only the loads between its old and
+ * new positions change.
+ */
+static BOOL CanMove(const GRSDStopSequenceSearch *search, NSUInteger stop, NSUInteger position,
+                    NSUInteger newPosition) {
+  NSInteger delta = search->loadDeltas[stop];
+  NSInteger capacity = (NSInteger)search->capacity;
+  if (newPosition < position) {
+    // The stops it now precedes carry its load change earlier.
+    for (NSUInteger loadPosition = newPosition - 1; delta > 0 && loadPosition < position;
+         loadPosition++) {
+      if (search->loads[loadPosition] + delta > capacity) {
+        return NO;
+      }
+    }
+  } else {
+    // The stops it now follows no longer carry its load change.
+    for (NSUInteger loadPosition = position + 1; delta < 0 && loadPosition <= newPosition;
+         loadPosition++) {
+      if (search->loads[loadPosition] - delta > capacity) {
+        return NO;
+      }
+    }
+  }
+  return YES;
+}
+
+/**
+ * Builds an order by inserting each trip's stops, in turn, where they lengthen the route least.
+ *
+ * A trip's stops are inserted one after another, so a pickup is placed while its trip's dropoff is
+ * still missing. Its load is counted up to the end of the order until then, which keeps every
+ * partial order feasible once its trips are complete.
+ */
+static void InsertStops(GRSDStopSequenceSearch *search, NSArray<NSArray<NSNumber *> *> *tripStops) {
+  search->order[0] = 0;
+  search->orderCount = 1;
+  UpdatePositionsAndLoads(search);
+  for (NSArray<NSNumber *> *stops in tripStops) {
+    for (NSNumber *stopNumber in stops) {
+      NSUInteger stop = stopNumber.unsignedIntegerValue;
+      if (stop == 0) {
+        continue;
+      }
+      NSInteger predecessor = search->predecessors[stop];
+      NSUInteger earliest = predecessor >= 0 ? MAX(search->positions[predecessor] + 1, 1) : 1;
+      NSUInteger bestPosition = search->orderCount;
+      double bestCost = INFINITY;
+      for (NSUInteger position = earliest; position <= search->orderCount; position++) {
+        if (!CanInsert(search, stop, position)) {
+          continue;
+        }
+        double cost = InsertionCost(search, stop, position);
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestPosition = position;
+        }
+      }
+      InsertStop(search, stop, bestPosition);
+      UpdatePositionsAndLoads(search);
+    }
+  }
+}
+
+/** Moves a stop to the feasible position that shortens the route most. Returns whether it moved. */
+static BOOL RelocateStop(GRSDStopSequenceSearch *search, NSUInteger stop) {
+  NSUInteger position = search->positions[stop];
+  NSUInteger *order = search->order;
+  double removalGain = Distance(search, order[position - 1], stop);
+  if (position + 1 < search->orderCount) {
+    removalGain += Distance(search, stop, order[position + 1]) -
+                   Distance(search, order[position - 1], order[position + 1]);
+  }
+  // Positions once the stop is removed, between the stop's neighbors in its trip.
+  NSInteger predecessor = search->predecessors[stop];
+  NSInteger successor = search->successors[stop];
+  NSUInteger earliest = 1;
+  if (predecessor >= 0) {
+    NSUInteger predecessorPosition = search->positions[predecessor];
+    earliest = MAX(predecessorPosition < position ? predecessorPosition + 1 : predecessorPosition,
+                   1);
+  }
+  NSUInteger latest = search->orderCount - 1;
+  if (successor >= 0) {
+    NSUInteger successorPosition = search->positions[successor];
+    latest = successorPosition < position ? successorPosition : successorPosition - 1;
+  }
+
+  RemoveStop(search, position);
+  NSUInteger bestPosition = position;
+  double bestGain = kMinimumSaving;
+  for (NSUInteger newPosition = earliest; newPosition <= latest; newPosition++) {
+    if (newPosition == position) {
+      continue;
+    }
+    double gain = removalGain - InsertionCost(search, stop, newPosition);
+    if (gain > bestGain && CanMove(search, stop, position, newPosition)) {
+      bestGain = gain;
+      bestPosition = newPosition;
+    }
+  }
+  InsertStop(search, stop, bestPosition);
+  if (bestPosition == position) {
+    return NO;
+  }
+  UpdatePositionsAndLoads(search);
+  return YES;
+}
+
+/** Moves single stops to where they shorten the route most, until no move does or time runs out. */
+static void RelocateStops(GRSDStopSequenceSearch *search, NSTimeInterval deadline) {
+  BOOL isImproved = YES;
+  while (isImproved) {
+    isImproved = NO;
+    for (NSUInteger stop = 0; stop < search->count; stop++) {
+      if (search->positions[stop] == 0) {
+        continue;
+      }
+      if (NSProcessInfo.processInfo.systemUptime > deadline) {
+        return;
+      }
+      isImproved = RelocateStop(search, stop) || isImproved;
+    }
+  }
+}
+
+@implementation GRSDStopSequenceProposal
+
+- (instancetype)initWithWaypoints:(NSArray<GMTSTripWaypoint *> *)waypoints
+                         distance:(double)distance
+                 originalDistance:(double)originalDistance
+                        reordered:(BOOL)reordered {
+  self = [super init];
+  if (self) {
+    _waypoints = [waypoints copy];
+    _distance = distance;
+    _originalDistance = originalDistance;
+    _reordered = reordered;
+  }
+  return self;
+}
+
+@end
+
+@implementation GRSDStopSequenceOptimizer
+
+- (instancetype)initWithMaximumCapacity:(NSUInteger)maximumCapacity {
+  self = [super init];
+  if (self) {
+    _maximumCapacity = maximumCapacity;
+    _timeBudget = kDefaultTimeBudget;
+  }
+  return self;
+}
+
+- (GRSDStopSequenceProposal *)proposalForWaypoints:(NSArray<GMTSTripWaypoint *> *)waypoints {
+  NSTimeInterval deadline = NSProcessInfo.processInfo.systemUptime + _timeBudget;
+  NSUInteger count = waypoints.count;
+  if (count == 0) {
+    return [[GRSDStopSequenceProposal alloc] initWithWaypoints:waypoints
+                                                      distance:0
+                                              originalDistance:0
+                                                     reordered:NO];
+  }
+
+  GRSDStopSequenceSearch search = {
+      .count = count,
+      .capacity = _maximumCapacity,
+      .predecessors = malloc(count * sizeof(NSInteger)),
+      .successors = malloc(count * sizeof(NSInteger)),
+      .loadDeltas = calloc(count, sizeof(NSInteger)),
+      .distances = calloc(count * count, sizeof(double)),
+      .order = malloc(count * sizeof(NSUInteger)),
+      .positions = malloc(count * sizeof(NSUInteger)),
+      .loads = malloc(count * sizeof(NSInteger)),
+  };
+  NSArray<NSArray<NSNumber *> *> *tripStops = [self tripStopsForWaypoints:waypoints
+                                                                   search:&search];
+  CLLocationCoordinate2D *coordinates = malloc(count * sizeof(CLLocationCoordinate2D));
+  for (NSUInteger index = 0; index < count; index++) {
+    GMTSLatLng *point = waypoints[index].location.point;
+    coordinates[index] = point ? CLLocationCoordinate2DMake(point.latitude, point.longitude)
+                               : kCLLocationCoordinate2DInvalid;
+  }
+  for (NSUInteger from = 0; from < count; from++) {
+    for (NSUInteger to = from + 1; to < count; to++) {
+      double distance = GreatCircleDistance(coordinates[from], coordinates[to]);
+      search.distances[from * count + to] = distance;
+      search.distances[to * count + from] = distance;
+    }
+  }
+  free(coordinates);
+
+  NSUInteger *originalOrder = malloc(count * sizeof(NSUInteger));
+  for (NSUInteger index = 0; index < count; index++) {
+    originalOrder[index] = index;
+  }
+  double originalDistance = RouteDistance(&search, originalOrder, count);
+  free(originalOrder);
+
+  InsertStops(&search, tripStops);
+  RelocateStops(&search, deadline);
+
+  double distance = RouteDistance(&search, search.order, count);
+  GRSDStopSequenceProposal *proposal;
+  if (distance < originalDistance - kMinimumSaving && IsFeasible(&search, search.order)) {
+    NSMutableArray<GMTSTripWaypoint *> *orderedWaypoints =
+        [[NSMutableArray alloc] initWithCapacity:count];
+    for (NSUInteger position = 0; position < count; position++) {
+      [orderedWaypoints addObject:waypoints[search.order[position]]];
+    }
+    proposal = [[GRSDStopSequenceProposal alloc] initWithWaypoints:orderedWaypoints
+                                                          distance:distance
+                                                  originalDistance:originalDistance
+                                                         reordered:YES];
+  } else {
+    proposal = [[GRSDStopSequenceProposal alloc] initWithWaypoints:waypoints
+                                                          distance:originalDistance
+                                                  originalDistance:originalDistance
+                                                         reordered:NO];
+  }
+
+  free(search.predecessors);
+  free(search.successors);
+  free(search.loadDeltas);
+  free(search.distances);
+  free(search.order);
+  free(search.positions);
+  free(search.loads);
+  return proposal;
+}
+
+#pragma mark - Private
+
+/**
+ * Fills in the trip constraints of the search, and returns each trip's stops in the order they are
+ * inserted.
+ *
+ * The first stop's trip goes first, then the trips already on board, whose dropoffs free capacity
+ * for the others.
+ */
+- (NSArray<NSArray<NSNumber *> *> *)tripStopsForWaypoints:(NSArray<GMTSTripWaypoint *> *)waypoints
+                                                   search:(GRSDStopSequenceSearch *)search {
+  NSMutableDictionary<NSString *, NSMutableArray<NSNumber *> *> *stopsByTripID =
+      [[NSMutableDictionary alloc] init];
+  NSMutableSet<NSString *> *pickedUpTripIDs = [[NSMutableSet alloc] init];
+  NSMutableArray<NSMutableArray<NSNumber *> *> *tripStops = [[NSMutableArray alloc] init];
+  for (NSUInteger index = 0; index < waypoints.count; index++) {
+    GMTSTripWaypoint *waypoint = waypoints[index];
+    // Stops without a trip are kept in place relative to each other.
+    NSString *tripID = waypoint.tripID ?: @"";
+    NSMutableArray<NSNumber *> *stops = stopsByTripID[tripID];
+    search->predecessors[index] = -1;
+    search->successors[index] = -1;
+    if (stops) {
+      NSUInteger previous = stops.lastObject.unsignedIntegerValue;
+      search->predecessors[index] = (NSInteger)previous;
+      search->successors[previous] = (NSInteger)index;
+    } else {
+      stops = [[NSMutableArray alloc] init];
+      stopsByTripID[tripID] = stops;
+      [tripStops addObject:stops];
+    }
+    [stops addObject:@(index)];
+
+    if (waypoint.waypointType == GMTSTripWaypointTypePickUp) {
+      search->loadDeltas[index] = 1;
+      [pickedUpTripIDs addObject:tripID];
+    } else if (waypoint.waypointType == GMTSTripWaypointTypeDropOff) {
+      search->loadDeltas[index] = -1;
+      // A dropoff whose pickup is not among the stops is for a trip already on board.
+      if (![pickedUpTripIDs containsObject:tripID]) {
+        search->initialLoad++;
+      }
+    }
+  }
+
+  NSMutableArray<NSArray<NSNumber *> *> *orderedTripStops =
+      [[NSMutableArray alloc] initWithObjects:tripStops[0], nil];
+  for (NSArray<NSNumber *> *stops in tripStops) {
+    if (stops != tripStops[0] && search->loadDeltas[stops[0].unsignedIntegerValue] <= 0) {
+      [orderedTripStops addObject:stops];
+    }
+  }
+  for (NSArray<NSNumber *> *stops in tripStops) {
+    if (stops != tripStops[0] && search->loadDeltas[stops[0].unsignedIntegerValue] > 0) {
+      [orderedTripStops addObject:stops];
+    }
+  }
+  return orderedTripStops;
+}
+
+@end
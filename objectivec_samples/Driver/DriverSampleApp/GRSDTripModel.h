@@ -0,0 +1,52 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import <GoogleRidesharingConsumer/GoogleRidesharingConsumer.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * Class used to represent a trip as returned by the provider.
+ */
+@interface GRSDTripModel : NSObject
+
+/** The ID of the trip. */
+@property(nonatomic, readonly) NSString *tripID;
+
+/** The current status of the trip. */
+@property(nonatomic, readonly) GMTSTripStatus tripStatus;
+
+/** The remaining waypoints of the trip. */
+@property(nonatomic, readonly) NSArray<GMTSTripWaypoint *> *waypoints;
+
+/**
+ * Initializes an instance of this class.
+ *
+ * @param tripID The ID of the trip.
+ * @param tripStatus The current status of the trip.
+ * @param waypoints The remaining waypoints of the trip.
+ */
+- (instancetype)initWithTripID:(NSString *)tripID
+                    tripStatus:(GMTSTripStatus)tripStatus
+                     waypoints:(NSArray<GMTSTripWaypoint *> *)waypoints NS_DESIGNATED_INITIALIZER;
+
+/** Use the designated initializer instead. */
+- (null_unspecified instancetype)init NS_UNAVAILABLE;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,54 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#import "GRSDTripModel.h"
+
+@implementation GRSDTripModel
+
+- (instancetype)initWithTripID:(NSString *)tripID
+                    tripStatus:(GMTSTripStatus)tripStatus
+                     waypoints:(NSArray<GMTSTripWaypoint *> *)waypoints {
+  self = [super init];
+  if (self) {
+    _tripID = [tripID copy];
+    _tripStatus = tripStatus;
+    _waypoints = [waypoints copy];
+  }
+  return self;
+}
+
+- (BOOL)isEqual:(id)other {
+  if (!other || ![other isKindOfClass:[GRSDTripModel class]]) {
+    return NO;
+  }
+  if (self == other) {
+    return YES;
+  }
+
+  GRSDTripModel *otherTripModel = (GRSDTripModel *)other;
+  return [otherTripModel.tripID isEqualToString:_tripID] &&
+         otherTripModel.tripStatus == _tripStatus &&
+         [otherTripModel.waypoints isEqualToArray:_waypoints];
+}
+
+- (NSUInteger)hash {
+  NSUInteger basePrime = 31;
+  NSUInteger result = [_tripID hash];
+  result = (result * basePrime) + [@(_tripStatus) hash];
+  result = (result * basePrime) + _waypoints.count;
+  return result;
+}
+
+@end
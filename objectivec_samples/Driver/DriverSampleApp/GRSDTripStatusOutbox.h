@@ -0,0 +1,148 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#import <Foundation/Foundation.h>
+
+#import <GoogleRidesharingDriver/GoogleRidesharingDriver.h>
+
+#import "GRSDClock.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class GRSDProviderService;
+@class GRSDTripStatusOutbox;
+
+/** A trip status update waiting to be sent to the provider. */
+@interface GRSDTripStatusUpdate : NSObject
+
+@property(nonatomic, copy, readonly) NSString *tripID;
+@property(nonatomic, readonly) GMTSTripStatus status;
+@property(nonatomic, strong, readonly, nullable) NSNumber *intermediateDestinationIndex;
+/** Identifies the update to the provider, so that it is applied only once. */
+@property(nonatomic, copy, readonly) NSString *idempotencyKey;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@end
+
+/**
+ * Block definition that sends an update to the provider and calls @c completion exactly once, with
+ * nil if the update was applied.
+ *
+ * @param update The update to send.
+ * @param completion The block to call once the provider has answered or could not be reached.
+ */
+typedef void (^GRSDTripStatusUpdateSender)(GRSDTripStatusUpdate *update,
+                                           void (^completion)(NSError *_Nullable error));
+
+/** Receives the updates of a @c GRSDTripStatusOutbox that the provider rejected. */
+@protocol GRSDTripStatusOutboxDelegate <NSObject>
+
+/**
+ * Called on the main queue when the provider rejects an update. The later updates for the same
+ * trip have been dropped along with it, so the delegate should roll back its local state.
+ *
+ * @param outbox The outbox that sent the update.
+ * @param update The rejected update.
+ * @param error The error returned by the provider.
+ */
+- (void)tripStatusOutbox:(GRSDTripStatusOutbox *)outbox
+         didRejectUpdate:(GRSDTripStatusUpdate *)update
+                   error:(NSError *)error;
+
+@end
+
+/**
+ * A durable, ordered queue of trip status updates waiting to be sent to the provider.
+ *
+ * Callers apply a status transition to their local state as soon as the driver makes it, and
+ * enqueue the update here instead of waiting for the provider. Updates are written to disk in the
+ * background in the order they were made, so that updates made before the app is killed are sent
+ * on the next launch without the caller waiting for the disk. They are sent one at a time in the
+ * order they were made, each with an idempotency key so that the provider applies an update only
+ * once even if it is sent again after a lost response.
+ *
+ * Updates that fail are retried with exponential backoff. Those that fail because the provider
+ * can't be reached are retried until it can, so that they outlast network outages, while those
+ * that fail for any other reason, such as server errors, are dropped and logged after
+ * @c maximumAttemptCount attempts. If the provider rejects an update, it is dropped along with the
+ * later updates for the same trip, which build on it, and the delegate is told so that it can roll
+ * back.
+ */
+@interface GRSDTripStatusOutbox : NSObject
+
+/** The delegate that is told about rejected updates. */
+@property(nonatomic, weak, nullable) id<GRSDTripStatusOutboxDelegate> delegate;
+
+/** The updates that have not been sent yet, oldest first. */
+@property(nonatomic, readonly) NSArray<GRSDTripStatusUpdate *> *pendingUpdates;
+
+/**
+ * The delay, in seconds, before the first retry of an update that could not be sent. Later retries
+ * double it, up to 30 seconds. Defaults to 1 second.
+ */
+@property(nonatomic) NSTimeInterval retryInterval;
+
+/**
+ * The number of attempts to send an update that fail for a reason other than the provider being
+ * unreachable, after which the update is dropped. Defaults to 10.
+ */
+@property(nonatomic) NSUInteger maximumAttemptCount;
+
+/**
+ * The clock that retries are scheduled on. Defaults to the system clock, or to the provider
+ * service's clock for an outbox that sends updates with one.
+ */
+@property(nonatomic) id<GRSDClock> clock;
+
+/**
+ * Initializes an instance of this class, restoring the updates persisted by a previous launch and
+ * starting to send them.
+ *
+ * @param fileURL The file that pending updates are persisted to and restored from, or nil to keep
+ * them in memory only.
+ * @param sender The block that sends an update to the provider.
+ */
+- (instancetype)initWithFileURL:(nullable NSURL *)fileURL
+                         sender:(GRSDTripStatusUpdateSender)sender NS_DESIGNATED_INITIALIZER;
+
+/**
+ * Initializes an instance of this class that sends updates with the given provider service.
+ *
+ * @param providerService The service to send updates with.
+ * @param fileURL The file that pending updates are persisted to and restored from.
+ */
+- (instancetype)initWithProviderService:(GRSDProviderService *)providerService
+                                fileURL:(nullable NSURL *)fileURL;
+
+/**
+ * Use @c initWithFileURL:sender: instead.
+ */
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Persists an update and sends it after the updates enqueued before it.
+ *
+ * @param status The new status of the trip.
+ * @param tripID The ID of the trip to update.
+ * @param intermediateDestinationIndex The index for the intermediate destination being updated.
+ * It is nil if no intermediate destinations are being updated.
+ */
+- (GRSDTripStatusUpdate *)enqueueUpdateWithStatus:(GMTSTripStatus)status
+                                           tripID:(NSString *)tripID
+                     intermediateDestinationIndex:(nullable NSNumber *)intermediateDestinationIndex;
+
+@end
+
+NS_ASSUME_NONNULL_END
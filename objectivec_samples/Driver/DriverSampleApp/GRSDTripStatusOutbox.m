@@ -0,0 +1,338 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#import "GRSDTripStatusOutbox.h"
+
+#import <os/log.h>
+
+#import "GRSDProviderService.h"
+
+static const NSTimeInterval kDefaultRetryInterval = 1;
+static const NSTimeInterval kMaximumRetryInterval = 30;
+static const NSUInteger kDefaultMaximumAttemptCount = 10;
+
+// Keys of the updates persisted to disk.
+static NSString *const kPersistedTripIDKey = @"tripID";
+static NSString *const kPersistedStatusKey = @"status";
+static NSString *const kPersistedIntermediateDestinationIndexKey = @"intermediateDestinationIndex";
+static NSString *const kPersistedIdempotencyKeyKey = @"idempotencyKey";
+
+/** Returns whether an update failed because the provider could not be reached. */
+static BOOL IsUnreachableError(NSError *error) {
+  return [error.domain isEqualToString:NSURLErrorDomain];
+}
+
+/** Returns whether the provider may accept a failed update if it is sent again. */
+static BOOL IsTransientError(NSError *error) {
+  if ([error.domain isEqualToString:NSURLErrorDomain]) {
+    return YES;
+  }
+  NSInteger statusCode = [error.userInfo[GRSDProviderHTTPStatusCodeErrorKey] integerValue];
+  return statusCode >= 500 || statusCode == 408 || statusCode == 429;
+}
+
+/** Returns whether the provider refused an update, which must not be sent again. */
+static BOOL IsRejectionError(NSError *error) {
+  NSInteger statusCode = [error.userInfo[GRSDProviderHTTPStatusCodeErrorKey] integerValue];
+  return statusCode >= 400 && statusCode < 500 && !IsTransientError(error);
+}
+
+/** Returns the log that dropped updates are recorded to. */
+static os_log_t GetTripStatusOutboxLog(void) {
+  static os_log_t log;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    log = os_log_create("com.google.DriverSampleApp", "TripStatus");
+  });
+  return log;
+}
+
+/**
+ * Returns the queue that serializes reads and writes of the persisted updates, including those of
+ * outboxes created for the same file after a relaunch.
+ */
+static dispatch_queue_t GetFileQueue(void) {
+  static dispatch_queue_t queue;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    queue = dispatch_queue_create("com.google.DriverSampleApp.TripStatusOutbox",
+                                  DISPATCH_QUEUE_SERIAL);
+  });
+  return queue;
+}
+
+@interface GRSDTripStatusUpdate ()
+
+- (instancetype)initWithTripID:(NSString *)tripID
+                        status:(GMTSTripStatus)status
+    intermediateDestinationIndex:(nullable NSNumber *)intermediateDestinationIndex
+                  idempotencyKey:(NSString *)idempotencyKey NS_DESIGNATED_INITIALIZER;
+
+@end
+
+@implementation GRSDTripStatusUpdate
+
+- (instancetype)initWithTripID:(NSString *)tripID
+                        status:(GMTSTripStatus)status
+    intermediateDestinationIndex:(nullable NSNumber *)intermediateDestinationIndex
+                  idempotencyKey:(NSString *)idempotencyKey {
+  self = [super init];
+  if (self) {
+    _tripID = [tripID copy];
+    _status = status;
+    _intermediateDestinationIndex = intermediateDestinationIndex;
+    _idempotencyKey = [idempotencyKey copy];
+  }
+  return self;
+}
+
+@end
+
+@implementation GRSDTripStatusOutbox {
+  GRSDTripStatusUpdateSender _sender;
+  NSMutableArray<GRSDTripStatusUpdate *> *_pendingUpdates;
+  /** Whether the oldest pending update is being sent. */
+  BOOL _isSending;
+  /** The number of times in a row that the oldest pending update could not be sent. */
+  NSUInteger _failureCount;
+  /**
+   * The number of times in a row that the oldest pending update could not be sent for a reason
+   * other than the provider being unreachable.
+   */
+  NSUInteger _failedAttemptCount;
+  NSURL *_fileURL;
+}
+
+- (instancetype)initWithFileURL:(nullable NSURL *)fileURL
+                         sender:(GRSDTripStatusUpdateSender)sender {
+  self = [super init];
+  if (self) {
+    _sender = [sender copy];
+    _pendingUpdates = [[NSMutableArray alloc] init];
+    _retryInterval = kDefaultRetryInterval;
+    _maximumAttemptCount = kDefaultMaximumAttemptCount;
+    _clock = [GRSDSystemClock sharedClock];
+    _fileURL = [fileURL copy];
+    if (_fileURL) {
+      [self loadPersistedUpdates];
+    }
+    [self sendNextUpdate];
+  }
+  return self;
+}
+
+- (instancetype)initWithProviderService:(GRSDProviderService *)providerService
+                                fileURL:(nullable NSURL *)fileURL {
+  self = [self initWithFileURL:fileURL
+                        sender:^(GRSDTripStatusUpdate *update,
+                                 void (^completion)(NSError *_Nullable error)) {
+                          [providerService updateTripWithStatus:update.status
+                                                         tripID:update.tripID
+                                   intermediateDestinationIndex:update.intermediateDestinationIndex
+                                                 idempotencyKey:update.idempotencyKey
+                                                     completion:^(NSString *_Nullable tripID,
+                                                                  NSError *_Nullable error) {
+                                                       completion(error);
+                                                     }];
+                        }];
+  if (self) {
+    self.clock = providerService.clock;
+  }
+  return self;
+}
+
+- (NSArray<GRSDTripStatusUpdate *> *)pendingUpdates {
+  @synchronized(self) {
+    return [_pendingUpdates copy];
+  }
+}
+
+- (GRSDTripStatusUpdate *)enqueueUpdateWithStatus:(GMTSTripStatus)status
+                                           tripID:(NSString *)tripID
+                     intermediateDestinationIndex:
+                         (nullable NSNumber *)intermediateDestinationIndex {
+  GRSDTripStatusUpdate *update =
+      [[GRSDTripStatusUpdate alloc] initWithTripID:tripID
+                                            status:status
+                      intermediateDestinationIndex:intermediateDestinationIndex
+                                    idempotencyKey:[NSUUID UUID].UUIDString];
+  @synchronized(self) {
+    [_pendingUpdates addObject:update];
+    [self persistUpdates];
+  }
+  [self sendNextUpdate];
+  return update;
+}
+
+#pragma mark - Private
+
+/** Sends the oldest pending update unless it is already being sent. */
+- (void)sendNextUpdate {
+  GRSDTripStatusUpdate *update;
+  @synchronized(self) {
+    if (_isSending || !_pendingUpdates.count) {
+      return;
+    }
+    _isSending = YES;
+    update = _pendingUpdates.firstObject;
+  }
+
+  // Capture self strongly so that the pending updates are sent even if the owner lets go.
+  _sender(update, ^(NSError *_Nullable error) {
+    [self finishSendingUpdate:update error:error];
+  });
+}
+
+- (void)finishSendingUpdate:(GRSDTripStatusUpdate *)update error:(nullable NSError *)error {
+  BOOL isRejected = error && IsRejectionError(error);
+  if (error && !isRejected) {
+    BOOL isDropped;
+    NSUInteger failedAttemptCount;
+    NSTimeInterval retryDelay = 0;
+    id<GRSDClock> clock;
+    @synchronized(self) {
+      // Attempts that don't reach the provider are not counted, so that updates are kept through
+      // outages.
+      if (!IsUnreachableError(error)) {
+        _failedAttemptCount++;
+      }
+      failedAttemptCount = _failedAttemptCount;
+      isDropped = _failedAttemptCount >= MAX(_maximumAttemptCount, 1);
+      if (!isDropped) {
+        _isSending = NO;
+        retryDelay = MIN(_retryInterval * pow(2, _failureCount), kMaximumRetryInterval);
+        _failureCount++;
+        clock = _clock;
+      }
+    }
+    if (!isDropped) {
+      [clock scheduleTimerWithInterval:retryDelay
+                               repeats:NO
+                                 block:^{
+                                   [self sendNextUpdate];
+                                 }];
+      return;
+    }
+    os_log_error(GetTripStatusOutboxLog(),
+                 "Dropped update %{public}@ of trip %{public}@ after %lu failed attempts: "
+                 "%{public}@",
+                 update.idempotencyKey, update.tripID, (unsigned long)failedAttemptCount, error);
+  }
+
+  @synchronized(self) {
+    _isSending = NO;
+    _failureCount = 0;
+    _failedAttemptCount = 0;
+    if (isRejected) {
+      // The later updates for the trip build on the rejected one.
+      NSIndexSet *indexes = [_pendingUpdates
+          indexesOfObjectsPassingTest:^BOOL(GRSDTripStatusUpdate *pendingUpdate, NSUInteger index,
+                                            BOOL *stop) {
+            return [pendingUpdate.tripID isEqualToString:update.tripID];
+          }];
+      [_pendingUpdates removeObjectsAtIndexes:indexes];
+    } else {
+      [_pendingUpdates removeObjectIdenticalTo:update];
+    }
+    [self persistUpdates];
+  }
+
+  if (isRejected) {
+    dispatch_async(dispatch_get_main_queue(), ^{
+      [self.delegate tripStatusOutbox:self didRejectUpdate:update error:error];
+    });
+  }
+  [self sendNextUpdate];
+}
+
+/** Restores the updates persisted by a previous launch, once its queued writes have finished. */
+- (void)loadPersistedUpdates {
+  __block NSData *data;
+  NSURL *fileURL = _fileURL;
+  dispatch_sync(GetFileQueue(), ^{
+    data = [NSData dataWithContentsOfURL:fileURL];
+  });
+  if (!data) {
+    return;
+  }
+  NSArray *persistedUpdates = [NSPropertyListSerialization propertyListWithData:data
+                                                                        options:0
+                                                                         format:nil
+                                                                          error:nil];
+  if (![persistedUpdates isKindOfClass:[NSArray class]]) {
+    return;
+  }
+
+  for (NSDictionary *persistedUpdate in persistedUpdates) {
+    if (![persistedUpdate isKindOfClass:[NSDictionary class]]) {
+      continue;
+    }
+    NSString *tripID = persistedUpdate[kPersistedTripIDKey];
+    NSNumber *status = persistedUpdate[kPersistedStatusKey];
+    NSNumber *intermediateDestinationIndex =
+        persistedUpdate[kPersistedIntermediateDestinationIndexKey];
+    NSString *idempotencyKey = persistedUpdate[kPersistedIdempotencyKeyKey];
+    if (![tripID isKindOfClass:[NSString class]] || ![status isKindOfClass:[NSNumber class]] ||
+        ![idempotencyKey isKindOfClass:[NSString class]] ||
+        (intermediateDestinationIndex &&
+         ![intermediateDestinationIndex isKindOfClass:[NSNumber class]])) {
+      continue;
+    }
+    [_pendingUpdates
+        addObject:[[GRSDTripStatusUpdate alloc] initWithTripID:tripID
+                                                        status:status.integerValue
+                                  intermediateDestinationIndex:intermediateDestinationIndex
+                                                idempotencyKey:idempotencyKey]];
+  }
+}
+
+/**
+ * Writes the pending updates to disk in the background, after the writes queued before. Must be
+ * called while synchronized on self, so that writes are queued in the order the updates changed.
+ */
+- (void)persistUpdates {
+  if (!_fileURL) {
+    return;
+  }
+  NSMutableArray<NSDictionary *> *persistedUpdates =
+      [[NSMutableArray alloc] initWithCapacity:_pendingUpdates.count];
+  for (GRSDTripStatusUpdate *update in _pendingUpdates) {
+    NSMutableDictionary *persistedUpdate = [@{
+      kPersistedTripIDKey : update.tripID,
+      kPersistedStatusKey : @(update.status),
+      kPersistedIdempotencyKeyKey : update.idempotencyKey,
+    } mutableCopy];
+    persistedUpdate[kPersistedIntermediateDestinationIndexKey] =
+        update.intermediateDestinationIndex;
+    [persistedUpdates addObject:persistedUpdate];
+  }
+
+  NSURL *fileURL = _fileURL;
+  dispatch_async(GetFileQueue(), ^{
+    NSData *data =
+        [NSPropertyListSerialization dataWithPropertyList:persistedUpdates
+                                                   format:NSPropertyListBinaryFormat_v1_0
+                                                  options:0
+                                                    error:nil];
+    [[NSFileManager defaultManager] createDirectoryAtURL:fileURL.URLByDeletingLastPathComponent
+                             withIntermediateDirectories:YES
+                                              attributes:nil
+                                                   error:nil];
+    [data writeToURL:fileURL
+             options:NSDataWritingAtomic | NSDataWritingFileProtectionComplete
+               error:nil];
+  });
+}
+
+@end
@@ -0,0 +1,278 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#import "GRSDTripTracer.h"
+
+#import <CommonCrypto/CommonDigest.h>
+#import <QuartzCore/QuartzCore.h>
+
+NSString *const GRSDTripTraceHeaderField = @"traceparent";
+
+static NSString *const kSharedTracerSource = @"driver";
+static NSString *const kSharedTracerFileName = @"GRSDTripTrace.jsonl";
+
+/** The size above which the trace file is started over when a tracer opens it. */
+static const unsigned long long kMaximumFileSize = 8 * 1024 * 1024;
+
+/** The number of trips whose last started span is remembered as the parent of their requests. */
+static const NSUInteger kMaximumTracedTripCount = 64;
+
+// Keys of the exported spans.
+static NSString *const kExportedSourceKey = @"source";
+static NSString *const kExportedNameKey = @"name";
+static NSString *const kExportedTripIDKey = @"trip";
+static NSString *const kExportedTraceIDKey = @"trace";
+static NSString *const kExportedSpanIDKey = @"span";
+static NSString *const kExportedStartKey = @"start";
+static NSString *const kExportedDurationKey = @"duration";
+static NSString *const kExportedAttributesKey = @"attributes";
+
+static NSString *const kTripStatusAttributeKey = @"status";
+
+/** Returns the hexadecimal representation of the given bytes. */
+static NSString *GetHexString(const uint8_t *bytes, size_t length) {
+  NSMutableString *string = [[NSMutableString alloc] initWithCapacity:length * 2];
+  for (size_t i = 0; i < length; i++) {
+    [string appendFormat:@"%02x", bytes[i]];
+  }
+  return string;
+}
+
+/** Returns the 128-bit trace ID of a trip, which is the start of the SHA-256 of its ID. */
+static NSString *GetTraceIDForTripID(NSString *tripID) {
+  NSData *tripIDData = [tripID dataUsingEncoding:NSUTF8StringEncoding];
+  uint8_t digest[CC_SHA256_DIGEST_LENGTH];
+  CC_SHA256(tripIDData.bytes, (CC_LONG)tripIDData.length, digest);
+  return GetHexString(digest, 16);
+}
+
+/** Returns a random 64-bit span ID. */
+static NSString *GenerateSpanID(void) {
+  uint8_t bytes[8];
+  arc4random_buf(bytes, sizeof(bytes));
+  return GetHexString(bytes, sizeof(bytes));
+}
+
+/** Returns the provider's name of a trip status, which both apps export. */
+static NSString *GetTripStatusName(GMTSTripStatus tripStatus) {
+  switch (tripStatus) {
+    case GMTSTripStatusNew:
+      return @"NEW";
+    case GMTSTripStatusEnrouteToPickup:
+      return @"ENROUTE_TO_PICKUP";
+    case GMTSTripStatusArrivedAtPickup:
+      return @"ARRIVED_AT_PICKUP";
+    case GMTSTripStatusEnrouteToIntermediateDestination:
+      return @"ENROUTE_TO_INTERMEDIATE_DESTINATION";
+    case GMTSTripStatusArrivedAtIntermediateDestination:
+      return @"ARRIVED_AT_INTERMEDIATE_DESTINATION";
+    case GMTSTripStatusEnrouteToDropoff:
+      return @"ENROUTE_TO_DROPOFF";
+    case GMTSTripStatusComplete:
+      return @"COMPLETE";
+    case GMTSTripStatusCanceled:
+      return @"CANCELED";
+    case GMTSTripStatusUnknown:
+      return @"UNKNOWN";
+  }
+}
+
+/** Returns the file in the caches directory that the shared tracer exports spans to. */
+static NSURL *_Nullable GetSharedTracerFileURL(void) {
+  NSURL *cachesURL = [NSFileManager.defaultManager URLsForDirectory:NSCachesDirectory
+                                                          inDomains:NSUserDomainMask]
+                         .firstObject;
+  return [cachesURL URLByAppendingPathComponent:kSharedTracerFileName];
+}
+
+@interface GRSDTripTracer ()
+
+/** Exports an ended span. */
+- (void)exportSpan:(GRSDTripSpan *)span
+         startDate:(NSDate *)startDate
+          duration:(NSTimeInterval)duration
+        attributes:(NSDictionary<NSString *, NSString *> *)attributes;
+
+@end
+
+@interface GRSDTripSpan ()
+
+- (instancetype)initWithName:(NSString *)name
+                      tripID:(nullable NSString *)tripID
+                      tracer:(GRSDTripTracer *)tracer NS_DESIGNATED_INITIALIZER;
+
+@end
+
+@implementation GRSDTripSpan {
+  __weak GRSDTripTracer *_tracer;
+  NSDate *_startDate;
+  CFTimeInterval _startTime;
+  NSMutableDictionary<NSString *, NSString *> *_attributes;
+  BOOL _isEnded;
+}
+
+- (instancetype)initWithName:(NSString *)name
+                      tripID:(nullable NSString *)tripID
+                      tracer:(GRSDTripTracer *)tracer {
+  self = [super init];
+  if (self) {
+    _name = [name copy];
+    _tripID = [tripID copy];
+    _spanID = GenerateSpanID();
+    _tracer = tracer;
+    _attributes = [[NSMutableDictionary alloc] init];
+    _startDate = [NSDate date];
+    _startTime = CACurrentMediaTime();
+  }
+  return self;
+}
+
+- (void)setAttribute:(NSString *)value forKey:(NSString *)key {
+  @synchronized(self) {
+    _attributes[key] = [value copy];
+  }
+}
+
+- (void)setTripStatus:(GMTSTripStatus)tripStatus {
+  [self setAttribute:GetTripStatusName(tripStatus) forKey:kTripStatusAttributeKey];
+}
+
+- (void)end {
+  NSTimeInterval duration = CACurrentMediaTime() - _startTime;
+  NSDictionary<NSString *, NSString *> *attributes;
+  @synchronized(self) {
+    if (_isEnded) {
+      return;
+    }
+    _isEnded = YES;
+    attributes = [_attributes copy];
+  }
+  [_tracer exportSpan:self startDate:_startDate duration:duration attributes:attributes];
+}
+
+@end
+
+@implementation GRSDTripTracer {
+  NSString *_source;
+  /** The ID of the span last started for each trip, which is the parent of its requests. */
+  NSMutableDictionary<NSString *, NSString *> *_lastSpanIDByTripID;
+  /** Serializes writes to the trace file. */
+  dispatch_queue_t _fileQueue;
+  /** The handle of the trace file, which is opened with the first exported span. */
+  NSFileHandle *_fileHandle;
+}
+
++ (instancetype)sharedTracer {
+  static GRSDTripTracer *sharedTracer;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    sharedTracer = [[GRSDTripTracer alloc] initWithSource:kSharedTracerSource
+                                                  fileURL:GetSharedTracerFileURL()];
+  });
+  return sharedTracer;
+}
+
+- (instancetype)initWithSource:(NSString *)source fileURL:(nullable NSURL *)fileURL {
+  self = [super init];
+  if (self) {
+    _source = [source copy];
+    _fileURL = [fileURL copy];
+    _lastSpanIDByTripID = [[NSMutableDictionary alloc] init];
+    _fileQueue = dispatch_queue_create("com.google.DriverSampleApp.TripTracer",
+                                       DISPATCH_QUEUE_SERIAL);
+  }
+  return self;
+}
+
+- (GRSDTripSpan *)startSpanWithName:(NSString *)name tripID:(nullable NSString *)tripID {
+  GRSDTripSpan *span = [[GRSDTripSpan alloc] initWithName:name tripID:tripID tracer:self];
+  if (tripID) {
+    @synchronized(self) {
+      if (!_lastSpanIDByTripID[tripID] && _lastSpanIDByTripID.count >= kMaximumTracedTripCount) {
+        [_lastSpanIDByTripID removeAllObjects];
+      }
+      _lastSpanIDByTripID[tripID] = span.spanID;
+    }
+  }
+  return span;
+}
+
+- (void)recordEventWithName:(NSString *)name tripID:(NSString *)tripID {
+  [[self startSpanWithName:name tripID:tripID] end];
+}
+
+- (void)recordEventWithName:(NSString *)name
+                     tripID:(NSString *)tripID
+                 tripStatus:(GMTSTripStatus)tripStatus {
+  GRSDTripSpan *span = [self startSpanWithName:name tripID:tripID];
+  [span setTripStatus:tripStatus];
+  [span end];
+}
+
+- (NSString *)traceHeaderValueForTripID:(NSString *)tripID {
+  NSString *parentSpanID;
+  @synchronized(self) {
+    parentSpanID = _lastSpanIDByTripID[tripID];
+  }
+  // A request made outside of any span is the root of its own span.
+  return [NSString stringWithFormat:@"00-%@-%@-01", GetTraceIDForTripID(tripID),
+                                    parentSpanID ?: GenerateSpanID()];
+}
+
+#pragma mark - Private
+
+- (void)exportSpan:(GRSDTripSpan *)span
+         startDate:(NSDate *)startDate
+          duration:(NSTimeInterval)duration
+        attributes:(NSDictionary<NSString *, NSString *> *)attributes {
+  NSString *tripID = span.tripID;
+  if (!tripID || !_fileURL) {
+    return;
+  }
+  NSDictionary<NSString *, id> *exportedSpan = @{
+    kExportedSourceKey : _source,
+    kExportedNameKey : span.name,
+    kExportedTripIDKey : tripID,
+    kExportedTraceIDKey : GetTraceIDForTripID(tripID),
+    kExportedSpanIDKey : span.spanID,
+    kExportedStartKey : @(startDate.timeIntervalSince1970),
+    kExportedDurationKey : @(duration),
+    kExportedAttributesKey : attributes,
+  };
+  dispatch_async(_fileQueue, ^{
+    NSMutableData *line = [[NSJSONSerialization dataWithJSONObject:exportedSpan
+                                                           options:0
+                                                             error:nil] mutableCopy];
+    [line appendBytes:"\n" length:1];
+    [[self fileHandle] writeData:line error:nil];
+  });
+}
+
+/** Returns the handle of the trace file, opening it if needed. Must be called on the file queue. */
+- (nullable NSFileHandle *)fileHandle {
+  if (_fileHandle) {
+    return _fileHandle;
+  }
+  NSFileManager *fileManager = NSFileManager.defaultManager;
+  NSDictionary<NSFileAttributeKey, id> *fileAttributes =
+      [fileManager attributesOfItemAtPath:_fileURL.path error:nil];
+  if (!fileAttributes || fileAttributes.fileSize > kMaximumFileSize) {
+    [fileManager createFileAtPath:_fileURL.path contents:nil attributes:nil];
+  }
+  _fileHandle = [NSFileHandle fileHandleForWritingToURL:_fileURL error:nil];
+  [_fileHandle seekToEndReturningOffset:nil error:nil];
+  return _fileHandle;
+}
+
+@end
@@ -18,11 +18,15 @@
 
 #import <GoogleRidesharingDriver/GoogleRidesharingDriver.h>
 #import "GRSDEditVehicleTableViewController.h"
+#import "GRSDNextTripPrefetcher.h"
+#import "GRSDTripStatusOutbox.h"
 
 @interface GRSDViewController : UIViewController <GMTDVehicleReporterListener,
                                                   GMSMapViewDelegate,
                                                   GMSNavigatorListener,
                                                   GMSRoadSnappedLocationProviderListener,
-                                                  GRSDEditVehicleTableViewControllerDelegate>
+                                                  GRSDEditVehicleTableViewControllerDelegate,
+                                                  GRSDNextTripPrefetcherDelegate,
+                                                  GRSDTripStatusOutboxDelegate>
 
 @end
@@ -16,12 +16,23 @@
 #import "GRSDViewController.h"
 
 #import <CoreLocation/CoreLocation.h>
+#import <os/signpost.h>
 
 #import <GoogleRidesharingDriver/GoogleRidesharingDriver.h>
 #import "GRSDAPIConstants.h"
 #import "GRSDBottomPanelView.h"
+#import "GRSDClock.h"
+#import "GRSDDriverStartup.h"
+#import "GRSDLocationTraceRecorder.h"
+#import "GRSDProviderRetryPolicy.h"
 #import "GRSDProviderService.h"
+#import "GRSDRoutePlanner.h"
+#import "GRSDStopSequenceOptimizer.h"
+#import "GRSDTripModel.h"
+#import "GRSDTripStatusOutbox.h"
+#import "GRSDTripTracer.h"
 #import "GRSDVehicleModel.h"
+#import "GRSDWaypointStore.h"
 
 /** Coordinates to be used for setting driver location when in simulator. */
 static const CLLocationCoordinate2D kSanFranciscoCoordinates = {37.7749295, -122.4194155};
@@ -50,6 +61,48 @@ static const CGFloat kDefaultErrorMessageCornerRadius = 8.0f;
 static const float kDefaultErrorMessageLabelInitialAlpha = 1.0;
 static const float kDefaultErrorMessageAutoFadeOutDuration = 10.0;
 
+/** How often to poll for vehicle details when pushed vehicle updates are unavailable. */
+static const NSTimeInterval kPollFetchVehicleInterval = 2;
+
+/** How long to wait before retrying pushed vehicle updates after they fail. */
+static const NSTimeInterval kVehicleUpdatesRetryInterval = 30;
+
+/** File in Application Support that trip status updates are persisted to until they are sent. */
+static NSString *const kTripStatusOutboxFileName = @"GRSDTripStatusOutbox.plist";
+
+// Names of the traced steps of a trip's lifecycle, whose latencies tools/stitch_trip_traces.py
+// summarizes.
+static NSString *const kTripMatchedSpanName = @"driver.tripMatched";
+static NSString *const kFetchTripStatusSpanName = @"driver.fetchTripStatus";
+static NSString *const kRouteSpanName = @"driver.route";
+static NSString *const kStatusTapSpanName = @"driver.statusTap";
+static NSString *const kHandoffSpanName = @"driver.handoff";
+
+/** Key of the span attribute holding the status with which a route was generated. */
+static NSString *const kRouteStatusAttributeKey = @"routeStatus";
+
+/** Key of the span attribute recording whether the next trip was loaded before the handoff. */
+static NSString *const kPrefetchedAttributeKey = @"prefetched";
+
+/** Returns the log that trip status taps are recorded to as signpost intervals. */
+static os_log_t GetTripStatusLog(void) {
+  static os_log_t log;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    log = os_log_create("com.google.DriverSampleApp", "TripStatus");
+  });
+  return log;
+}
+
+/** Returns the file that pending trip status updates are persisted to between launches. */
+static NSURL *_Nullable GetTripStatusOutboxFileURL(void) {
+  NSURL *applicationSupportURL =
+      [NSFileManager.defaultManager URLsForDirectory:NSApplicationSupportDirectory
+                                           inDomains:NSUserDomainMask]
+          .firstObject;
+  return [applicationSupportURL URLByAppendingPathComponent:kTripStatusOutboxFileName];
+}
+
 /** Returns a styled message label. */
 static UILabel *CreateErrorMessageLabel(void) {
   UILabel *messageLabel = [[UILabel alloc] init];
@@ -122,10 +175,34 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
   /** Panel view used to control driver actions. */
   GRSDBottomPanelView *_bottomPanel;
   GRSDProviderService *_providerService;
+  /** Resumes or creates the vehicle while the terms dialog is shown, and times startup. */
+  GRSDDriverStartup *_driverStartup;
+  /** The clock that the trip flow's timers are scheduled on, which is the provider service's. */
+  id<GRSDClock> _clock;
+  /** Sends trip status updates after they have been applied locally. */
+  GRSDTripStatusOutbox *_tripStatusOutbox;
+  /** Records the steps of each trip's lifecycle. */
+  GRSDTripTracer *_tripTracer;
+  /** The IDs of the matched trips whose match has been traced. */
+  NSMutableSet<NSString *> *_tracedMatchedTripIDs;
+  /** Records the road-snapped locations of the session, for auditing and replaying the shift. */
+  GRSDLocationTraceRecorder *_locationTraceRecorder;
   GMTDVehicleReporter *_vehicleReporter;
-  NSTimer *_pollFetchVehicleTimer;
-  BOOL _isFetchVehicleInProgress;
-  NSArray<GMTSTripWaypoint *> *_waypoints;
+  id<GRSDClockTimer> _pollFetchVehicleTimer;
+  /** Whether the controller is listening for pushed vehicle updates from the provider. */
+  BOOL _isSubscribedToVehicleUpdates;
+  /** Retries pushed vehicle updates after they failed. */
+  id<GRSDClockTimer> _vehicleUpdatesRetryTimer;
+  /** The waypoints of the matched trips, indexed by trip. */
+  GRSDWaypointStore *_waypointStore;
+  /** Plans the navigator's route through the next waypoints of the matched trips. */
+  GRSDRoutePlanner *_routePlanner;
+  /** Loads the next back-to-back trip while the current one is in progress. */
+  GRSDNextTripPrefetcher *_nextTripPrefetcher;
+  /** The trips that were completed and handed off before the provider stopped matching them. */
+  NSMutableSet<NSString *> *_handedOffTripIDs;
+  /** The span of the handoff to the current trip, which ends once the trip is routed to. */
+  GRSDTripSpan *_handoffSpan;
   NSString *_currentTripID;
   GMTSTripStatus _currentTripStatus;
   BOOL _isVehicleOnline;
@@ -146,7 +223,34 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
   [_locationManager requestAlwaysAuthorization];
 
   _providerService = [[GRSDProviderService alloc] init];
-
+  _clock = _providerService.clock;
+  // Send a second request for vehicle and trip fetches that are slower than usual, so that a slow
+  // response doesn't hold up trip assignment.
+  _providerService.retryPolicy.hedgingEnabled = YES;
+  _tripStatusOutbox =
+      [[GRSDTripStatusOutbox alloc] initWithProviderService:_providerService
+                                                    fileURL:GetTripStatusOutboxFileURL()];
+  _tripStatusOutbox.delegate = self;
+  _tripTracer = _providerService.tripTracer;
+  _tracedMatchedTripIDs = [[NSMutableSet alloc] init];
+  _locationTraceRecorder =
+      [[GRSDLocationTraceRecorder alloc] initWithFileURL:GRSDLocationTraceRecorder.defaultFileURL];
+  [NSNotificationCenter.defaultCenter addObserver:self
+                                         selector:@selector(applicationDidEnterBackground:)
+                                             name:UIApplicationDidEnterBackgroundNotification
+                                           object:nil];
+
+  // The vehicle doesn't depend on the terms, so it is made ready while the dialog is shown.
+  _driverStartup =
+      [[GRSDDriverStartup alloc] initWithProviderService:_providerService
+                                                 fileURL:GRSDDriverStartup.defaultFileURL];
+  [_driverStartup prepareVehicle];
+
+  _waypointStore = [[GRSDWaypointStore alloc] init];
+  _routePlanner = [[GRSDRoutePlanner alloc] init];
+  _nextTripPrefetcher = [[GRSDNextTripPrefetcher alloc] initWithProviderService:_providerService];
+  _nextTripPrefetcher.delegate = self;
+  _handedOffTripIDs = [[NSMutableSet alloc] init];
   _tripIDToCurrentIntermediateDestinationIndex = [[NSMutableDictionary alloc] init];
   _shouldAutoDrive = NO;
 
@@ -161,18 +265,12 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
 
 - (void)viewDidDisappear:(BOOL)animated {
   [super viewDidDisappear:animated];
-  if (_pollFetchVehicleTimer) {
-    [_pollFetchVehicleTimer invalidate];
-    _pollFetchVehicleTimer = nil;
-  }
+  [self stopVehicleUpdates];
 }
 
 - (void)didReceiveMemoryWarning {
   [super didReceiveMemoryWarning];
-  if (_pollFetchVehicleTimer) {
-    [_pollFetchVehicleTimer invalidate];
-    _pollFetchVehicleTimer = nil;
-  }
+  [self stopVehicleUpdates];
 }
 
 #pragma mark - Error message functions
@@ -209,6 +307,11 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
 
 #pragma mark - Private helpers
 
+/** Writes the recorded trace to disk, since the app may be suspended or terminated. */
+- (void)applicationDidEnterBackground:(NSNotification *)notification {
+  [_locationTraceRecorder flush];
+}
+
 - (void)setUpNavigationBar {
   [self.navigationController.navigationBar setTitleTextAttributes:@{
     NSFontAttributeName : [UIFont fontWithName:kDefaultFontName size:kDefaultFontSize],
@@ -285,6 +388,7 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
 - (void)showTermsAndConditionsAndSetUpDriver {
   // Show the dialog for the Terms and Conditions and only enable navigation after the user’s
   // acceptance.
+  [_driverStartup beginStage:GRSDDriverStartupStageTerms];
   __weak typeof(self) weakSelf = self;
 
   GMSTermsResponseCallback termsAndConditionsCallback = ^(BOOL termsAccepted) {
@@ -296,6 +400,7 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
       [strongSelf showTermsAndConditionsDeniedAlert];
       return;
     }
+    [strongSelf->_driverStartup endStage:GRSDDriverStartupStageTerms];
     GMSMapView *mapView = strongSelf->_mapView;
     // Enable navigation only after the user has accepted the Terms and Conditions.
     // Both navigator and roadSnappedLocationProvider return nil if the user has not
@@ -307,6 +412,7 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
 
     [mapView.roadSnappedLocationProvider addListener:strongSelf];
     [mapView.navigator addListener:strongSelf];
+    strongSelf->_routePlanner.navigator = mapView.navigator;
     mapView.roadSnappedLocationProvider.allowsBackgroundLocationUpdates = YES;
 
     [strongSelf setUpDriver];
@@ -353,7 +459,14 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
       // Enable location tracking for the driver.
       strongSelf->_vehicleReporter.locationTrackingEnabled = YES;
       // Set driver to be online so that it is visible for consumers.
+      [strongSelf->_driverStartup beginStage:GRSDDriverStartupStageOnline];
       [strongSelf->_vehicleReporter updateVehicleState:GMTDVehicleStateOnline];
+
+      // Listen for trip matches pushed by the provider right away, rather than waiting for Fleet
+      // Engine to acknowledge the vehicle.
+      if (!strongSelf->_isSubscribedToVehicleUpdates) {
+        [strongSelf subscribeToVehicleUpdates];
+      }
     } else {
       [strongSelf promptToRetryDriverSetup];
     }
@@ -379,23 +492,26 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
 
 - (void)createDriver:(GRSDCreateDriverHandler)completion {
   __weak typeof(self) weakSelf = self;
-  NSString *randomVehicleID = [NSString stringWithFormat:@"iOS-%@", [NSUUID UUID].UUIDString];
-  // Create a vehicle with b2b support enabled by default.
-  [_providerService
-      createVehicleWithID:randomVehicleID
-      isBackToBackEnabled:YES
-               completion:^(GRSDVehicleModel *_Nullable vehicleModel, NSError *_Nullable error) {
-                 [weakSelf handleCreateVehicleWithModel:vehicleModel
-                                                  error:error
-                                             completion:completion];
-               }];
-}
-
-- (void)handleCreateVehicleWithModel:(GRSDVehicleModel *)vehicleModel
-                               error:(NSError *)error
-                          completion:(GRSDCreateDriverHandler)completion {
+  // Wait for the vehicle that startup resumes or creates, which is usually ready by now.
+  [_driverStartup waitForVehicleWithCompletion:^(GRSDVehicleModel *_Nullable vehicleModel,
+                                                 NSArray<NSString *> *_Nullable matchedTripIDs,
+                                                 NSArray<GMTSTripWaypoint *> *_Nullable waypoints,
+                                                 NSError *_Nullable error) {
+    [weakSelf handleVehicleReadyWithModel:vehicleModel
+                           matchedTripIDs:matchedTripIDs
+                                waypoints:waypoints
+                                    error:error
+                               completion:completion];
+  }];
+}
+
+- (void)handleVehicleReadyWithModel:(GRSDVehicleModel *)vehicleModel
+                     matchedTripIDs:(NSArray<NSString *> *)matchedTripIDs
+                          waypoints:(NSArray<GMTSTripWaypoint *> *)waypoints
+                              error:(NSError *)error
+                         completion:(GRSDCreateDriverHandler)completion {
   if (error) {
-    NSLog(@"Failed to create vehicle: %@", error.localizedDescription);
+    NSLog(@"Failed to set up vehicle: %@", error.localizedDescription);
     completion(NO);
     return;
   }
@@ -415,6 +531,7 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
     return;
   }
 
+  [_driverStartup beginStage:GRSDDriverStartupStageDriverContext];
   GMTDDriverContext *driverContext =
       [[GMTDDriverContext alloc] initWithAccessTokenProvider:providerService
                                                   providerID:kProviderID
@@ -428,10 +545,19 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
 
   // Set VehicleReporter as a listener to Navigation SDK updates.
   [_mapView.roadSnappedLocationProvider addListener:_vehicleReporter];
+  [_mapView.roadSnappedLocationProvider addListener:_locationTraceRecorder];
 
   // Start location updates so the GMTDFleetEngine starts to receive location updates.
   [_mapView.roadSnappedLocationProvider stopUpdatingLocation];
   [_mapView.roadSnappedLocationProvider startUpdatingLocation];
+  [_driverStartup endStage:GRSDDriverStartupStageDriverContext];
+
+  // Pick up the trips still matched with a resumed vehicle.
+  if (matchedTripIDs.count) {
+    [self handleFetchVehicleResponseWithMatchedTripIds:matchedTripIDs
+                                             waypoints:waypoints
+                                                 error:nil];
+  }
   completion(YES);
 }
 
@@ -448,27 +574,112 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
                       return;
                     }
                     _currentVehicleModel = vehicleModel;
+                    [_driverStartup persistVehicleModel:vehicleModel];
                   }];
 }
 
-/* Starts polling for vehicle details. */
-- (void)pollFetchVehicle {
-  _pollFetchVehicleTimer = [NSTimer scheduledTimerWithTimeInterval:2
-                                                            target:self
-                                                          selector:@selector(fetchVehicle)
-                                                          userInfo:nil
-                                                           repeats:YES];
+/* Starts listening for vehicle details pushed by the provider. */
+- (void)subscribeToVehicleUpdates {
+  _isSubscribedToVehicleUpdates = YES;
+  [self stopVehicleUpdatesRetry];
+  [self waitForVehicleUpdate];
 }
 
-/* Fetches details for the current vehicle ID. */
-- (void)fetchVehicle {
-  // If there's a fetch vehicle request in flight, cancel this one.
-  if (_isFetchVehicleInProgress) {
+/* Stops both pushed vehicle updates and polling. */
+- (void)stopVehicleUpdates {
+  _isSubscribedToVehicleUpdates = NO;
+  [self stopVehicleUpdatesRetry];
+  [self stopPollingFetchVehicle];
+}
+
+/* Waits for pushed vehicle updates again after they failed, unless they were stopped since. */
+- (void)retryVehicleUpdates {
+  _vehicleUpdatesRetryTimer = nil;
+  if (!_isSubscribedToVehicleUpdates) {
+    return;
+  }
+  [self waitForVehicleUpdate];
+}
+
+/* Cancels the pending retry of pushed vehicle updates, if any. */
+- (void)stopVehicleUpdatesRetry {
+  [_vehicleUpdatesRetryTimer invalidate];
+  _vehicleUpdatesRetryTimer = nil;
+}
+
+/* Waits for the provider to push the next change to the current vehicle. */
+- (void)waitForVehicleUpdate {
+  if (!_isSubscribedToVehicleUpdates) {
+    return;
+  }
+
+  __weak typeof(self) weakSelf = self;
+  [_providerService
+      waitForVehicleUpdateWithID:_currentVehicleModel.vehicleID
+                      completion:^(NSArray<NSString *> *_Nullable matchedTripIds,
+                                   NSArray<GMTSTripWaypoint *> *_Nullable waypoints,
+                                   NSError *_Nullable error) {
+                        [weakSelf handleVehicleUpdateWithMatchedTripIds:matchedTripIds
+                                                              waypoints:waypoints
+                                                                  error:error];
+                      }];
+}
+
+/* Handles a pushed vehicle update, falling back to polling if the update channel failed. */
+- (void)handleVehicleUpdateWithMatchedTripIds:(NSArray<NSString *> *)matchedTripIDs
+                                    waypoints:(NSArray<GMTSTripWaypoint *> *)waypoints
+                                        error:(NSError *)error {
+  if (!_isSubscribedToVehicleUpdates) {
     return;
   }
 
-  _isFetchVehicleInProgress = YES;
+  if (error) {
+    NSLog(@"Vehicle updates unavailable, polling instead: %@", error.localizedDescription);
+    if (!_pollFetchVehicleTimer) {
+      [self pollFetchVehicle];
+    }
+    [self stopVehicleUpdatesRetry];
+    __weak typeof(self) weakSelf = self;
+    _vehicleUpdatesRetryTimer = [_clock scheduleTimerWithInterval:kVehicleUpdatesRetryInterval
+                                                          repeats:NO
+                                                            block:^{
+                                                              [weakSelf retryVehicleUpdates];
+                                                            }];
+    return;
+  }
 
+  // Updates are being delivered again, so polling is no longer needed.
+  [self stopPollingFetchVehicle];
+
+  // No trip IDs means the provider's long-poll window elapsed without a change.
+  if (matchedTripIDs) {
+    [self handleFetchVehicleResponseWithMatchedTripIds:matchedTripIDs
+                                             waypoints:waypoints
+                                                 error:nil];
+  }
+  [self waitForVehicleUpdate];
+}
+
+/* Starts polling for vehicle details. */
+- (void)pollFetchVehicle {
+  __weak typeof(self) weakSelf = self;
+  _pollFetchVehicleTimer = [_clock scheduleTimerWithInterval:kPollFetchVehicleInterval
+                                                     repeats:YES
+                                                       block:^{
+                                                         [weakSelf fetchVehicle];
+                                                       }];
+}
+
+/* Stops polling for vehicle details. */
+- (void)stopPollingFetchVehicle {
+  if (_pollFetchVehicleTimer) {
+    [_pollFetchVehicleTimer invalidate];
+    _pollFetchVehicleTimer = nil;
+  }
+}
+
+/* Fetches details for the current vehicle ID, superseding any fetch still in flight. */
+- (void)fetchVehicle {
   __weak typeof(self) weakSelf = self;
   [_providerService fetchVehicleWithID:_currentVehicleModel.vehicleID
                             completion:^(NSArray<NSString *> *_Nullable matchedTripIds,
@@ -484,24 +695,53 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
 - (void)handleFetchVehicleResponseWithMatchedTripIds:(NSArray<NSString *> *)matchedTripIDs
                                            waypoints:(NSArray<GMTSTripWaypoint *> *)waypoints
                                                error:(NSError *)error {
-  _isFetchVehicleInProgress = NO;
-  if (error || !matchedTripIDs || !matchedTripIDs.count || !waypoints.count) {
+  if ([error.domain isEqualToString:NSURLErrorDomain] && error.code == NSURLErrorCancelled) {
+    // A newer fetch superseded this one.
+    return;
+  }
+  if (error) {
+    // Keep the waypoints of a failed fetch, so that the route isn't planned again once fetches
+    // succeed.
+    _matchedTripIDs = nil;
+    return;
+  }
+  // Leave out the trips that were completed and handed off, in case the update was sent before the
+  // provider applied their completion.
+  [_handedOffTripIDs intersectSet:[NSSet setWithArray:matchedTripIDs ?: @[]]];
+  if (_handedOffTripIDs.count) {
+    NSPredicate *isNotHandedOff = [NSPredicate predicateWithBlock:^BOOL(id object, id bindings) {
+      NSString *tripID =
+          [object isKindOfClass:[GMTSTripWaypoint class]] ? [object tripID] : object;
+      return ![self->_handedOffTripIDs containsObject:tripID];
+    }];
+    matchedTripIDs = [matchedTripIDs filteredArrayUsingPredicate:isNotHandedOff];
+    waypoints = [waypoints filteredArrayUsingPredicate:isNotHandedOff];
+  }
+  if (!matchedTripIDs || !matchedTripIDs.count || !waypoints.count) {
     _matchedTripIDs = nil;
-    _waypoints = nil;
+    [_waypointStore removeAllWaypoints];
+    [_nextTripPrefetcher cancel];
     return;
   }
+  [self traceNewlyMatchedTripIDs:matchedTripIDs];
 
+  // Waypoints inserted, removed or reordered further along the route don't change where the driver
+  // is heading, so only plan a new route when the first waypoint changes. The route planner
+  // continues along the navigator's route if it still leads through the remaining waypoints.
   GMTSTripWaypoint *firstWaypoint = waypoints[0];
-  if (![_waypoints[0] isEqual:firstWaypoint]) {
-    _waypoints = waypoints;
-    [self stopNavigation];
+  GRSDWaypointDiff *waypointDiff = [_waypointStore updateWithWaypoints:waypoints];
+  if (waypointDiff.headChanged) {
     [self setNextWaypointAsTheDestination];
   }
+  if (!waypointDiff.empty && matchedTripIDs.count > 1) {
+    [self logStopSequenceProposalForWaypoints:waypoints];
+  }
 
   if (![_currentTripID isEqualToString:firstWaypoint.tripID]) {
     _currentTripID = firstWaypoint.tripID;
     __weak typeof(self) weakSelf = self;
-    [self fetchStatusForCurrentTripWithCompletion:^(GMTSTripStatus tripStatus) {
+    [self fetchStatusForCurrentTripWithMatchedTripIDs:matchedTripIDs
+                                           completion:^(GMTSTripStatus tripStatus) {
       typeof(self) strongSelf = weakSelf;
       if (!strongSelf) {
         return;
@@ -510,8 +750,8 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
         _currentTripStatus = tripStatus;
         if (_currentTripStatus == GMTSTripStatusNew) {
           // Guard against action button being clicked before destination is reached for SHARED
-          // pool.
-          [self stopNavigation];
+          // pool. The route planned for the new waypoints is kept, so that it isn't computed again.
+          strongSelf->_mapView.locationSimulator.paused = YES;
           strongSelf->_shouldAutoDrive = NO;
         } else if (_currentTripStatus == GMTSTripStatusEnrouteToDropoff) {
           strongSelf->_shouldAutoDrive = YES;
@@ -521,6 +761,14 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
     }];
   }
 
+  // Load the trip that follows the current one while the current one is in progress.
+  NSString *nextTripID = [self nextTripID];
+  if (nextTripID) {
+    [_nextTripPrefetcher prefetchTripWithID:nextTripID];
+  } else {
+    [_nextTripPrefetcher cancel];
+  }
+
   // Update bottom panel if other trips are assigned to this vehicle.
   _matchedTripIDs = matchedTripIDs;
   if (matchedTripIDs.count > 1) {
@@ -533,40 +781,91 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
   }
 }
 
-/** Fetches the latest status for the current trip. */
-- (void)fetchStatusForCurrentTripWithCompletion:(GRSDFetchTripStatusHandler)completion {
+/** Records the match of each trip that was not matched with the vehicle before. */
+- (void)traceNewlyMatchedTripIDs:(NSArray<NSString *> *)matchedTripIDs {
+  for (NSString *tripID in matchedTripIDs) {
+    if (![_tracedMatchedTripIDs containsObject:tripID]) {
+      [_tracedMatchedTripIDs addObject:tripID];
+      [_tripTracer recordEventWithName:kTripMatchedSpanName tripID:tripID];
+    }
+  }
+  // Forget trips that are no longer matched, which are complete or canceled.
+  [_tracedMatchedTripIDs intersectSet:[NSSet setWithArray:matchedTripIDs]];
+}
+
+/**
+ * Logs a shorter order for the waypoints of a shared vehicle, if there is one. The provider decides
+ * the order of the waypoints, so the proposal is only reported for it to adopt.
+ */
+- (void)logStopSequenceProposalForWaypoints:(NSArray<GMTSTripWaypoint *> *)waypoints {
+  GRSDStopSequenceOptimizer *optimizer = [[GRSDStopSequenceOptimizer alloc]
+      initWithMaximumCapacity:MAX(_currentVehicleModel.maximumCapacity, 1)];
+  GRSDStopSequenceProposal *proposal = [optimizer proposalForWaypoints:waypoints];
+  if (proposal.reordered) {
+    NSLog(@"A reordered route through %lu waypoints is %.0f m shorter (%.0f m instead of %.0f m)",
+          (unsigned long)waypoints.count, proposal.originalDistance - proposal.distance,
+          proposal.distance, proposal.originalDistance);
+  }
+}
+
+/**
+ * Fetches the latest status for the current trip. The other trips matched with the vehicle are
+ * fetched along with it so that their intermediate destinations are known before they start,
+ * except for the next trip, which the next trip prefetcher loads.
+ */
+- (void)fetchStatusForCurrentTripWithMatchedTripIDs:(NSArray<NSString *> *)matchedTripIDs
+                                         completion:(GRSDFetchTripStatusHandler)completion {
+  NSString *currentTripID = _currentTripID;
+  NSMutableArray<NSString *> *tripIDs = [NSMutableArray arrayWithObject:currentTripID];
+  [tripIDs addObjectsFromArray:matchedTripIDs];
+  // Fetching the next trip here as well would supersede the prefetcher's request for it.
+  NSString *nextTripID = [self nextTripID];
+  if (nextTripID) {
+    [tripIDs removeObject:nextTripID];
+  }
+  GRSDTripSpan *span = [_tripTracer startSpanWithName:kFetchTripStatusSpanName
+                                               tripID:currentTripID];
+
   __weak typeof(self) weakSelf = self;
   [_providerService
-      fetchTripWithID:_currentTripID
-           completion:^(NSString *_Nullable tripID, GMTSTripStatus tripStatus,
-                        NSArray<GMTSTripWaypoint *> *_Nullable waypoints,
-                        NSError *_Nullable error) {
-             typeof(self) strongSelf = weakSelf;
-             if (!strongSelf) {
-               return;
-             }
-             if (error) {
-               NSLog(@"Failed to get trip details with error: %@", error);
-               completion(GMTSTripStatusUnknown);
-               return;
-             }
-
-             // Process intermediate destinations if trip has them and has not been seen before.
-             if (![strongSelf->_tripIDToCurrentIntermediateDestinationIndex objectForKey:tripID] &&
-                 waypoints.count > 2) {
-               [strongSelf->_tripIDToCurrentIntermediateDestinationIndex
-                   setObject:[NSNumber numberWithInt:0]
-                      forKey:tripID];
-             }
-             completion(tripStatus);
-           }];
-}
-
-/** Updates the UI to reflect a trip with status NEW. */
+      fetchTripsWithIDs:tripIDs
+             completion:^(NSDictionary<NSString *, GRSDTripModel *> *trips,
+                          NSError *_Nullable error) {
+               typeof(self) strongSelf = weakSelf;
+               if (!strongSelf) {
+                 return;
+               }
+               if (error) {
+                 NSLog(@"Failed to get trip details with error: %@", error);
+               }
+
+               // Process intermediate destinations if a trip has them and has not been seen before.
+               for (GRSDTripModel *trip in trips.allValues) {
+                 if (![strongSelf->_tripIDToCurrentIntermediateDestinationIndex
+                         objectForKey:trip.tripID] &&
+                     trip.waypoints.count > 2) {
+                   [strongSelf->_tripIDToCurrentIntermediateDestinationIndex
+                       setObject:[NSNumber numberWithInt:0]
+                          forKey:trip.tripID];
+                 }
+               }
+
+               GRSDTripModel *currentTrip = trips[currentTripID];
+               GMTSTripStatus tripStatus =
+                   currentTrip ? currentTrip.tripStatus : GMTSTripStatusUnknown;
+               [span setTripStatus:tripStatus];
+               [span end];
+               completion(tripStatus);
+             }];
+}
+
+/**
+ * Updates the UI to reflect a trip with status NEW. The route to the trip is planned once its
+ * waypoints arrive or it is handed off to, not again here.
+ */
 - (void)displayNewTripStatus {
   _bottomPanel.titleLabel.text = kNewTripPanelTitle;
   [_bottomPanel.actionButton setTitle:kNewTripButtonTitle forState:UIControlStateNormal];
-  [self setNextWaypointAsTheDestination];
 }
 
 /** Updates the UI to reflect a trip with status ENROUTE_TO_PICKUP. */
@@ -685,35 +984,79 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
 
 /** Returns the next waypoint for the current trip. */
 - (GMTSTripWaypoint *)nextWaypointForCurrentTrip {
-  BOOL foundFirstWaypoint = NO;
-  for (GMTSTripWaypoint *tripWaypoint in _waypoints) {
-    if ([_currentTripID isEqualToString:tripWaypoint.tripID]) {
-      if (foundFirstWaypoint) {
-        return tripWaypoint;
-      }
-      foundFirstWaypoint = YES;
+  return _currentTripID ? [_waypointStore nextWaypointForTripID:_currentTripID] : nil;
+}
+
+/**
+ * Returns the ID of the trip that the vehicle heads to once the current trip is complete, which is
+ * the trip of the first waypoint of another trip.
+ */
+- (nullable NSString *)nextTripID {
+  for (GMTSTripWaypoint *waypoint in _waypointStore.waypoints) {
+    if (![waypoint.tripID isEqualToString:_currentTripID]) {
+      return waypoint.tripID;
     }
   }
   return nil;
 }
 
-/** Sets the next navigation destination to the first available waypoint. */
+/**
+ * Routes the navigator through the remaining waypoints, continuing along the current route if it
+ * still leads through them.
+ */
 - (void)setNextWaypointAsTheDestination {
-  if (!_waypoints || !_waypoints.count) {
+  GMTSTripWaypoint *tripWaypoint = _waypointStore.firstWaypoint;
+  if (!tripWaypoint) {
     return;
   }
 
-  GMTSTripWaypoint *tripWaypoint = [_waypoints firstObject];
-  GMSNavigationWaypoint *navWaypoint =
-      [[GMSNavigationWaypoint alloc] initWithLocation:tripWaypoint.location.point.coordinate
-                                                title:@""];
-  NSArray<GMSNavigationWaypoint *> *destination = @[ navWaypoint ];
-
+  GRSDTripSpan *span = [_tripTracer startSpanWithName:kRouteSpanName tripID:tripWaypoint.tripID];
   __weak typeof(self) weakSelf = self;
-  [_mapView.navigator setDestinations:destination
-                             callback:^(GMSRouteStatus routeStatus) {
-                               [weakSelf handleSetDestinationsResponseWithRouteStatus:routeStatus];
-                             }];
+  [_routePlanner planRouteThroughWaypoints:_waypointStore.waypoints
+                                completion:^(GMSRouteStatus routeStatus) {
+                                  [span setAttribute:routeStatus == GMSRouteStatusOK
+                                                         ? @"OK"
+                                                         : [@(routeStatus) stringValue]
+                                              forKey:kRouteStatusAttributeKey];
+                                  [span end];
+                                  [weakSelf endHandoffSpanForTripID:tripWaypoint.tripID
+                                                        routeStatus:routeStatus];
+                                  [weakSelf
+                                      handleSetDestinationsResponseWithRouteStatus:routeStatus];
+                                }];
+}
+
+/**
+ * Computes the legs into the next trip while the driver is still on the current one, so that the
+ * next trip can be started as soon as the current one completes.
+ */
+- (void)extendRouteIntoNextTrip {
+  GMTSTripWaypoint *tripWaypoint = _waypointStore.firstWaypoint;
+  // Only a route that the driver is following is extended.
+  if (!tripWaypoint || !_routePlanner.plannedWaypoints.count) {
+    return;
+  }
+
+  GRSDTripSpan *span = [_tripTracer startSpanWithName:kRouteSpanName tripID:tripWaypoint.tripID];
+  [_routePlanner extendRouteThroughWaypoints:_waypointStore.waypoints
+                                  completion:^(GMSRouteStatus routeStatus) {
+                                    [span setAttribute:routeStatus == GMSRouteStatusOK
+                                                           ? @"OK"
+                                                           : [@(routeStatus) stringValue]
+                                                forKey:kRouteStatusAttributeKey];
+                                    [span end];
+                                  }];
+}
+
+/** Ends the span of the handoff to a trip once the route to the trip is ready. */
+- (void)endHandoffSpanForTripID:(NSString *)tripID routeStatus:(GMSRouteStatus)routeStatus {
+  if (![_handoffSpan.tripID isEqualToString:tripID]) {
+    return;
+  }
+  [_handoffSpan setAttribute:routeStatus == GMSRouteStatusOK ? @"OK" : [@(routeStatus) stringValue]
+                      forKey:kRouteStatusAttributeKey];
+  [_handoffSpan end];
+  _handoffSpan = nil;
 }
 
 - (void)handleSetDestinationsResponseWithRouteStatus:(GMSRouteStatus)routeStatus {
@@ -734,50 +1077,101 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
   }
 }
 
+/**
+ * Applies a new status to the current trip right away, and leaves sending it to the provider to the
+ * trip status outbox.
+ */
 - (void)updateTripWithStatus:(GMTSTripStatus)newStatus
     intermediateDestinationIndex:(NSNumber *)intermediateDestinationIndex {
-  __weak typeof(self) weakSelf = self;
-  [_providerService updateTripWithStatus:newStatus
-                                  tripID:_currentTripID
-            intermediateDestinationIndex:intermediateDestinationIndex
-                              completion:^(NSString *tripID, NSError *error) {
-                                [weakSelf handleUpdateTripResponseWithStatus:newStatus
-                                                                      tripID:tripID
-                                                                       error:error];
-                              }];
+  [_tripStatusOutbox enqueueUpdateWithStatus:newStatus
+                                      tripID:_currentTripID
+                intermediateDestinationIndex:intermediateDestinationIndex];
+  [self applyTripStatus:newStatus];
 }
 
 - (void)stopNavigation {
   _mapView.locationSimulator.paused = YES;
-  [_mapView.navigator clearDestinations];
+  [_routePlanner clearRoute];
 }
 
-- (void)handleUpdateTripResponseWithStatus:(GMTSTripStatus)newStatus
-                                    tripID:(NSString *)tripID
-                                     error:(NSError *)error {
-  if (error) {
-    [self displayAutoFadeOutErrorMessage:[NSString
-                                             stringWithFormat:@"Handle Update Trip Response With "
-                                                              @"Status - Update Failed:  Error: %@",
-                                                              error.localizedDescription]];
-    return;
-  }
-
-  if (![tripID isEqual:_currentTripID]) {
+/** Updates the local state and the UI to reflect a new status of the current trip. */
+- (void)applyTripStatus:(GMTSTripStatus)newStatus {
+  _currentTripStatus = newStatus;
+  if (_currentTripStatus == GMTSTripStatusComplete && [self handOffToNextTrip]) {
     return;
   }
-
-  _currentTripStatus = newStatus;
   if (_currentTripStatus == GMTSTripStatusComplete) {
     [self stopNavigation];
     // Note: This timer is optional and it's used in this app for demonstration purposes.
-    [NSTimer scheduledTimerWithTimeInterval:5
-                                     target:self
-                                   selector:@selector(endCurrentVehicleSession)
-                                   userInfo:nil
-                                    repeats:NO];
+    __weak typeof(self) weakSelf = self;
+    [_clock scheduleTimerWithInterval:5
+                              repeats:NO
+                                block:^{
+                                  [weakSelf endCurrentVehicleSession];
+                                }];
+  }
+  [self updateViewsForCurrentTripStatus];
+}
+
+/**
+ * Switches to the next trip once the current one is complete, if it was loaded while the current
+ * trip was in progress. The navigator's route already leads on into it, so the driver can start it
+ * as soon as the provider has confirmed the loaded trip. Returns NO if the next trip isn't loaded,
+ * in which case the vehicle's next update switches to it.
+ */
+- (BOOL)handOffToNextTrip {
+  NSString *nextTripID = [self nextTripID];
+  if (!nextTripID) {
+    return NO;
+  }
+  _handoffSpan = [_tripTracer startSpanWithName:kHandoffSpanName tripID:nextTripID];
+  NSString *completedTripID = _currentTripID;
+  __weak typeof(self) weakSelf = self;
+  BOOL isPrefetched = [_nextTripPrefetcher handOffTripWithID:nextTripID
+                                                  completion:^(GRSDTripModel *nextTrip) {
+                                                    [weakSelf switchFromTripWithID:completedTripID
+                                                                        toNextTrip:nextTrip];
+                                                  }];
+  [_handoffSpan setAttribute:isPrefetched ? @"true" : @"false" forKey:kPrefetchedAttributeKey];
+  if (isPrefetched) {
+    // Keep the completed trip from being updated again while the next one is confirmed.
+    _bottomPanel.actionButton.enabled = NO;
+    _bottomPanel.actionButton.backgroundColor = UIColor.grayColor;
+  }
+  return isPrefetched;
+}
+
+/** Switches from a completed trip to the next one, once the loaded next trip is confirmed. */
+- (void)switchFromTripWithID:(NSString *)completedTripID toNextTrip:(GRSDTripModel *)nextTrip {
+  // A vehicle update may have switched to the next trip while it was being confirmed.
+  if (![_currentTripID isEqualToString:completedTripID]) {
+    return;
+  }
+  NSString *nextTripID = nextTrip.tripID;
+
+  // Drop the completed trip's waypoints ahead of the provider, so that the route continues from
+  // the next trip's first waypoint.
+  [_handedOffTripIDs addObject:completedTripID];
+  NSMutableArray<GMTSTripWaypoint *> *remainingWaypoints = [[NSMutableArray alloc] init];
+  for (GMTSTripWaypoint *waypoint in _waypointStore.waypoints) {
+    if (![waypoint.tripID isEqualToString:completedTripID]) {
+      [remainingWaypoints addObject:waypoint];
+    }
+  }
+  [_waypointStore updateWithWaypoints:remainingWaypoints];
+  NSMutableArray<NSString *> *matchedTripIDs = [_matchedTripIDs mutableCopy];
+  [matchedTripIDs removeObject:completedTripID];
+  _matchedTripIDs = matchedTripIDs;
+  if (!_tripIDToCurrentIntermediateDestinationIndex[nextTripID] && nextTrip.waypoints.count > 2) {
+    _tripIDToCurrentIntermediateDestinationIndex[nextTripID] = @0;
   }
+
+  _currentTripID = nextTripID;
+  _currentTripStatus = nextTrip.tripStatus;
+  _shouldAutoDrive = NO;
+  _mapView.locationSimulator.paused = YES;
   [self updateViewsForCurrentTripStatus];
+  [self setNextWaypointAsTheDestination];
 }
 
 - (void)endCurrentVehicleSession {
@@ -819,12 +1213,19 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
 }
 
 - (void)didTapUpdateTripStatusButton:(UIButton *)sender {
+  os_log_t log = GetTripStatusLog();
+  os_signpost_id_t signpostID = os_signpost_id_generate(log);
+  os_signpost_interval_begin(log, signpostID, "TapToUI");
   GMTSTripStatus nextTripStatus = [self nextStatusForCurrentTrip];
+  // Started before the update is enqueued, so that the update is sent as part of this span.
+  GRSDTripSpan *span = [_tripTracer startSpanWithName:kStatusTapSpanName tripID:_currentTripID];
+  [span setTripStatus:nextTripStatus];
   _shouldAutoDrive = NO;
 
   if (nextTripStatus == GMTSTripStatusEnrouteToIntermediateDestination ||
       nextTripStatus == GMTSTripStatusEnrouteToDropoff) {
-    [_mapView.navigator clearDestinations];
+    // The navigator keeps its route to the next stops, and driving starts once the provider's
+    // waypoints lead on from the reached one.
     _shouldAutoDrive = YES;
     _bottomPanel.actionButton.enabled = NO;
     _bottomPanel.actionButton.backgroundColor = UIColor.grayColor;
@@ -837,6 +1238,41 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
       [self processIntermediateDestinationIndexForStatus:nextTripStatus];
   [self updateTripWithStatus:nextTripStatus
       intermediateDestinationIndex:intermediateDestinationIndex];
+  [span end];
+  os_signpost_interval_end(log, signpostID, "TapToUI");
+}
+
+#pragma mark - GRSDTripStatusOutboxDelegate
+
+- (void)tripStatusOutbox:(GRSDTripStatusOutbox *)outbox
+         didRejectUpdate:(GRSDTripStatusUpdate *)update
+                   error:(NSError *)error {
+  [self displayAutoFadeOutErrorMessage:[NSString
+                                           stringWithFormat:@"Trip Status Update Rejected:  "
+                                                            @"Error: %@",
+                                                            error.localizedDescription]];
+  if (![update.tripID isEqualToString:_currentTripID]) {
+    return;
+  }
+
+  // Roll back to the status the provider has for the trip.
+  __weak typeof(self) weakSelf = self;
+  [self fetchStatusForCurrentTripWithMatchedTripIDs:_matchedTripIDs ?: @[]
+                                         completion:^(GMTSTripStatus tripStatus) {
+    typeof(self) strongSelf = weakSelf;
+    if (!strongSelf || tripStatus == GMTSTripStatusUnknown ||
+        ![update.tripID isEqualToString:strongSelf->_currentTripID]) {
+      return;
+    }
+    strongSelf->_currentTripStatus = tripStatus;
+    [strongSelf updateViewsForCurrentTripStatus];
+  }];
+}
+
+#pragma mark - GRSDNextTripPrefetcherDelegate
+
+- (void)nextTripPrefetcher:(GRSDNextTripPrefetcher *)prefetcher didLoadTrip:(GRSDTripModel *)trip {
+  [self extendRouteIntoNextTrip];
 }
 
 #pragma mark - GMSRoadSnappedLocationProviderListener
@@ -856,9 +1292,7 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
     NSLog(@"Vehicle is online");
     if (!_isVehicleOnline) {
       _isVehicleOnline = YES;
-
-      // Poll the provider to fetch a trip match.
-      [self pollFetchVehicle];
+      [_driverStartup endStage:GRSDDriverStartupStageOnline];
     }
   } else {
     NSLog(@"Vehicle is offline");
@@ -885,6 +1319,8 @@ static NSString *const kDriverCreationFailedAlertRetryTitle = @"Retry";
 - (void)navigator:(GMSNavigator *)navigator didArriveAtWaypoint:(GMSNavigationWaypoint *)waypoint {
   NSLog(@"GMSNavigatorListener - didArriveAtWaypoint: Latitude %f, Longitude %f",
         waypoint.coordinate.latitude, waypoint.coordinate.longitude);
+  // Head on to the next stop along the route the navigator already has.
+  [_routePlanner didArrive];
 }
 
 #pragma mark - GRSDEditVehicleTableViewControllerDelegate
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** How long a vehicle takes to drive a leg and serve a stop. */
+typedef struct {
+  /** The average speed of the vehicle along roads, in meters per second. */
+  double averageSpeed;
+  /** How much longer the road route of a leg is than its great-circle distance. */
+  double detourFactor;
+  /** How long the vehicle stays at a waypoint before leaving for the next one, in seconds. */
+  NSTimeInterval stopDuration;
+} GRSDSpeedModel;
+
+/** An urban vehicle averaging 30 km/h. */
+FOUNDATION_EXTERN const GRSDSpeedModel GRSDDefaultSpeedModel;
+
+/**
+ * Computes the great-circle distance, in meters, from each point of a route to the one before it.
+ * The first point's distance is 0.
+ *
+ * The coordinates are passed as separate latitude and longitude arrays, so that the haversine
+ * formula is evaluated for every leg at once with vectorized Accelerate calls instead of once per
+ * waypoint.
+ *
+ * @param latitudes The latitudes of the points, in degrees.
+ * @param longitudes The longitudes of the points, in degrees, in the same order.
+ * @param count The number of points.
+ * @param legDistances The array of @c count distances to fill in.
+ */
+void GRSDComputeLegDistances(const double *latitudes, const double *longitudes, NSUInteger count,
+                             double *legDistances);
+
+/**
+ * Computes the estimated arrival time at each point of a route, for a vehicle that is at the first
+ * point at @c departureTime.
+ *
+ * @param legDistances The distance from each point to the one before it, in meters.
+ * @param count The number of points.
+ * @param departureTime The time the vehicle is at the first point, in seconds since 1970.
+ * @param speedModel How long the vehicle takes to drive each leg and serve each stop.
+ * @param arrivalTimes The array of @c count arrival times to fill in, in seconds since 1970.
+ */
+void GRSDComputeArrivalTimes(const double *legDistances, NSUInteger count,
+                             NSTimeInterval departureTime, GRSDSpeedModel speedModel,
+                             NSTimeInterval *arrivalTimes);
+
+NS_ASSUME_NONNULL_END
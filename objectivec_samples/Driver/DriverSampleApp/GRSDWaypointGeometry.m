@@ -0,0 +1,101 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#import "GRSDWaypointGeometry.h"
+
+#import <Accelerate/Accelerate.h>
+
+/** The mean radius of the Earth, in meters. */
+static const double kEarthRadiusInMeters = 6371008.8;
+
+const GRSDSpeedModel GRSDDefaultSpeedModel = {
+    .averageSpeed = 8.3,
+    .detourFactor = 1.3,
+    .stopDuration = 60,
+};
+
+/** Replaces each of the first @c count angles, in radians, with the sine of half of it, squared. */
+static void ComputeSquaredHalfSines(double *angles, vDSP_Length count) {
+  const double half = 0.5;
+  int vectorCount = (int)count;
+  vDSP_vsmulD(angles, 1, &half, angles, 1, count);
+  vvsin(angles, angles, &vectorCount);
+  vDSP_vsqD(angles, 1, angles, 1, count);
+}
+
+void GRSDComputeLegDistances(const double *latitudes, const double *longitudes, NSUInteger count,
+                             double *legDistances) {
+  if (count == 0) {
+    return;
+  }
+  legDistances[0] = 0;
+  if (count == 1) {
+    return;
+  }
+  vDSP_Length legCount = count - 1;
+  int vectorCount = (int)count;
+  int vectorLegCount = (int)legCount;
+  const double degreesToRadians = M_PI / 180;
+  double *latitudeRadians = malloc(count * sizeof(double));
+  double *longitudeRadians = malloc(count * sizeof(double));
+  double *latitudeCosines = malloc(count * sizeof(double));
+  double *latitudeTerms = malloc(legCount * sizeof(double));
+  double *longitudeTerms = malloc(legCount * sizeof(double));
+  // The haversines are computed in place of the distances that they are turned into.
+  double *haversines = &legDistances[1];
+
+  vDSP_vsmulD(latitudes, 1, &degreesToRadians, latitudeRadians, 1, count);
+  vDSP_vsmulD(longitudes, 1, &degreesToRadians, longitudeRadians, 1, count);
+  vDSP_vsubD(latitudeRadians, 1, &latitudeRadians[1], 1, latitudeTerms, 1, legCount);
+  vDSP_vsubD(longitudeRadians, 1, &longitudeRadians[1], 1, longitudeTerms, 1, legCount);
+  ComputeSquaredHalfSines(latitudeTerms, legCount);
+  ComputeSquaredHalfSines(longitudeTerms, legCount);
+  vvcos(latitudeCosines, latitudeRadians, &vectorCount);
+
+  // hav(θ) = sin²(Δφ/2) + cos φ₁ cos φ₂ sin²(Δλ/2), clamped against rounding above 1.
+  const double minimumHaversine = 0;
+  const double maximumHaversine = 1;
+  vDSP_vmulD(latitudeCosines, 1, &latitudeCosines[1], 1, haversines, 1, legCount);
+  vDSP_vmaD(haversines, 1, longitudeTerms, 1, latitudeTerms, 1, haversines, 1, legCount);
+  vDSP_vclipD(haversines, 1, &minimumHaversine, &maximumHaversine, haversines, 1, legCount);
+
+  // d = 2r asin(√hav(θ))
+  const double diameter = 2 * kEarthRadiusInMeters;
+  vvsqrt(haversines, haversines, &vectorLegCount);
+  vvasin(haversines, haversines, &vectorLegCount);
+  vDSP_vsmulD(haversines, 1, &diameter, haversines, 1, legCount);
+
+  free(latitudeRadians);
+  free(longitudeRadians);
+  free(latitudeCosines);
+  free(latitudeTerms);
+  free(longitudeTerms);
+}
+
+void GRSDComputeArrivalTimes(const double *legDistances, NSUInteger count,
+                             NSTimeInterval departureTime, GRSDSpeedModel speedModel,
+                             NSTimeInterval *arrivalTimes) {
+  if (count == 0) {
+    return;
+  }
+  // Each leg takes its driving time plus the stop at the point it leaves from. The durations are
+  // computed in place of the arrival times that they add up to.
+  const double secondsPerMeter = speedModel.detourFactor / speedModel.averageSpeed;
+  vDSP_vsmsaD(legDistances, 1, &secondsPerMeter, &speedModel.stopDuration, arrivalTimes, 1,
+              count);
+  arrivalTimes[0] = departureTime;
+  for (NSUInteger index = 1; index < count; index++) {
+    arrivalTimes[index] += arrivalTimes[index - 1];
+  }
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import <GoogleRidesharingDriver/GoogleRidesharingDriver.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * How the waypoints of a route changed between two updates.
+ *
+ * A waypoint that is in both lists is unchanged if it keeps its order relative to the other
+ * unchanged waypoints, and reordered otherwise. The unchanged waypoints are the longest run of
+ * waypoints that kept their relative order, so that a waypoint inserted or removed early in the
+ * route doesn't count every later waypoint as reordered.
+ */
+@interface GRSDWaypointDiff : NSObject
+
+/** The indexes in the new list of the waypoints that were inserted. */
+@property(nonatomic, readonly) NSIndexSet *insertedIndexes;
+
+/** The indexes in the old list of the waypoints that were removed. */
+@property(nonatomic, readonly) NSIndexSet *removedIndexes;
+
+/** The indexes in the new list of the waypoints that moved relative to the others. */
+@property(nonatomic, readonly) NSIndexSet *reorderedIndexes;
+
+/** The number of waypoints that kept their place in the route. */
+@property(nonatomic, readonly) NSUInteger unchangedCount;
+
+/**
+ * Whether the first waypoint, which the route leads to, changed. The route only needs to be planned
+ * again when it did.
+ */
+@property(nonatomic, readonly, getter=isHeadChanged) BOOL headChanged;
+
+/** Whether the lists have the same waypoints in the same order. */
+@property(nonatomic, readonly, getter=isEmpty) BOOL empty;
+
+/** Returns the difference between two lists of waypoints. Takes O(n log n) time. */
++ (instancetype)diffFromWaypoints:(NSArray<GMTSTripWaypoint *> *)oldWaypoints
+                      toWaypoints:(NSArray<GMTSTripWaypoint *> *)newWaypoints;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@end
+
+/**
+ * The waypoints of a route, indexed by trip.
+ *
+ * Updating the store with each new list of waypoints returns how the route changed, and the next
+ * waypoint of a trip is looked up in constant time.
+ */
+@interface GRSDWaypointStore : NSObject
+
+/** The waypoints of the route, in the order they are visited. */
+@property(nonatomic, readonly) NSArray<GMTSTripWaypoint *> *waypoints;
+
+/** The first waypoint of the route, which is the current destination. */
+@property(nonatomic, readonly, nullable) GMTSTripWaypoint *firstWaypoint;
+
+/**
+ * Replaces the waypoints of the route.
+ *
+ * @param waypoints The new waypoints of the route.
+ * @return How the waypoints changed.
+ */
+- (GRSDWaypointDiff *)updateWithWaypoints:(NSArray<GMTSTripWaypoint *> *)waypoints;
+
+/** Removes all the waypoints of the route. */
+- (void)removeAllWaypoints;
+
+/**
+ * Returns the waypoint of a trip that follows its first one in the route.
+ *
+ * @param tripID The ID of the trip.
+ * @return The waypoint, or nil if the trip has no other waypoint.
+ */
+- (nullable GMTSTripWaypoint *)nextWaypointForTripID:(NSString *)tripID;
+
+@end
+
+NS_ASSUME_NONNULL_END
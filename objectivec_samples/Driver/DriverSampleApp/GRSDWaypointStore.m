@@ -0,0 +1,203 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#import "GRSDWaypointStore.h"
+
+/** Returns the fields that identify a waypoint within a route. */
+static NSString *GetWaypointKey(GMTSTripWaypoint *waypoint) {
+  CLLocationCoordinate2D coordinate = waypoint.location.point.coordinate;
+  return [NSString stringWithFormat:@"%@|%ld|%.9g,%.9g", waypoint.tripID,
+                                    (long)waypoint.waypointType, coordinate.latitude,
+                                    coordinate.longitude];
+}
+
+/**
+ * Marks which of the @c count values are part of a longest strictly increasing subsequence, found
+ * by patience sorting.
+ */
+static void MarkLongestIncreasingSubsequence(const NSUInteger *values, NSUInteger count,
+                                             BOOL *isInSubsequence) {
+  if (count == 0) {
+    return;
+  }
+  // The index of the value that ends the smallest-tailed increasing subsequence of each length.
+  NSUInteger *tailIndexes = malloc(count * sizeof(NSUInteger));
+  NSInteger *predecessors = malloc(count * sizeof(NSInteger));
+  NSUInteger length = 0;
+  for (NSUInteger index = 0; index < count; index++) {
+    NSUInteger low = 0;
+    NSUInteger high = length;
+    while (low < high) {
+      NSUInteger middle = (low + high) / 2;
+      if (values[tailIndexes[middle]] < values[index]) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    predecessors[index] = low > 0 ? (NSInteger)tailIndexes[low - 1] : -1;
+    tailIndexes[low] = index;
+    if (low == length) {
+      length++;
+    }
+  }
+
+  for (NSInteger index = (NSInteger)tailIndexes[length - 1]; index >= 0;
+       index = predecessors[index]) {
+    isInSubsequence[index] = YES;
+  }
+  free(tailIndexes);
+  free(predecessors);
+}
+
+@implementation GRSDWaypointDiff
+
+- (instancetype)initWithInsertedIndexes:(NSIndexSet *)insertedIndexes
+                         removedIndexes:(NSIndexSet *)removedIndexes
+                       reorderedIndexes:(NSIndexSet *)reorderedIndexes
+                         unchangedCount:(NSUInteger)unchangedCount
+                            headChanged:(BOOL)headChanged {
+  self = [super init];
+  if (self) {
+    _insertedIndexes = [insertedIndexes copy];
+    _removedIndexes = [removedIndexes copy];
+    _reorderedIndexes = [reorderedIndexes copy];
+    _unchangedCount = unchangedCount;
+    _headChanged = headChanged;
+  }
+  return self;
+}
+
++ (instancetype)diffFromWaypoints:(NSArray<GMTSTripWaypoint *> *)oldWaypoints
+                      toWaypoints:(NSArray<GMTSTripWaypoint *> *)newWaypoints {
+  NSUInteger oldCount = oldWaypoints.count;
+  NSUInteger newCount = newWaypoints.count;
+  BOOL headChanged = (oldCount == 0) != (newCount == 0) ||
+                     (oldCount > 0 && ![GetWaypointKey(oldWaypoints[0])
+                                          isEqualToString:GetWaypointKey(newWaypoints[0])]);
+
+  // Match each new waypoint with the first unmatched old waypoint that is equal to it.
+  NSMutableDictionary<NSString *, NSMutableArray<NSNumber *> *> *oldIndexesByKey =
+      [NSMutableDictionary dictionaryWithCapacity:oldCount];
+  [oldWaypoints enumerateObjectsUsingBlock:^(GMTSTripWaypoint *waypoint, NSUInteger index,
+                                             BOOL *stop) {
+    NSString *key = GetWaypointKey(waypoint);
+    NSMutableArray<NSNumber *> *oldIndexes = oldIndexesByKey[key];
+    if (!oldIndexes) {
+      oldIndexes = [NSMutableArray array];
+      oldIndexesByKey[key] = oldIndexes;
+    }
+    [oldIndexes addObject:@(index)];
+  }];
+
+  NSMutableIndexSet *insertedIndexes = [NSMutableIndexSet indexSet];
+  NSMutableIndexSet *removedIndexes =
+      [NSMutableIndexSet indexSetWithIndexesInRange:NSMakeRange(0, oldCount)];
+  NSUInteger *matchedOldIndexes = malloc(MAX(newCount, 1) * sizeof(NSUInteger));
+  NSUInteger *matchedNewIndexes = malloc(MAX(newCount, 1) * sizeof(NSUInteger));
+  NSUInteger matchedCount = 0;
+  for (NSUInteger newIndex = 0; newIndex < newCount; newIndex++) {
+    NSString *key = GetWaypointKey(newWaypoints[newIndex]);
+    NSMutableArray<NSNumber *> *oldIndexes = oldIndexesByKey[key];
+    if (!oldIndexes.count) {
+      [insertedIndexes addIndex:newIndex];
+      continue;
+    }
+    NSUInteger oldIndex = oldIndexes[0].unsignedIntegerValue;
+    [oldIndexes removeObjectAtIndex:0];
+    [removedIndexes removeIndex:oldIndex];
+    matchedOldIndexes[matchedCount] = oldIndex;
+    matchedNewIndexes[matchedCount] = newIndex;
+    matchedCount++;
+  }
+
+  BOOL *isUnchanged = calloc(MAX(matchedCount, 1), sizeof(BOOL));
+  MarkLongestIncreasingSubsequence(matchedOldIndexes, matchedCount, isUnchanged);
+  NSMutableIndexSet *reorderedIndexes = [NSMutableIndexSet indexSet];
+  NSUInteger unchangedCount = 0;
+  for (NSUInteger index = 0; index < matchedCount; index++) {
+    if (isUnchanged[index]) {
+      unchangedCount++;
+    } else {
+      [reorderedIndexes addIndex:matchedNewIndexes[index]];
+    }
+  }
+  free(isUnchanged);
+  free(matchedOldIndexes);
+  free(matchedNewIndexes);
+
+  return [[self alloc] initWithInsertedIndexes:insertedIndexes
+                                removedIndexes:removedIndexes
+                              reorderedIndexes:reorderedIndexes
+                                unchangedCount:unchangedCount
+                                   headChanged:headChanged];
+}
+
+- (BOOL)isEmpty {
+  return !_insertedIndexes.count && !_removedIndexes.count && !_reorderedIndexes.count;
+}
+
+@end
+
+@implementation GRSDWaypointStore {
+  /** The waypoints of each trip, in the order they are visited. */
+  NSDictionary<NSString *, NSArray<GMTSTripWaypoint *> *> *_waypointsByTripID;
+}
+
+- (instancetype)init {
+  self = [super init];
+  if (self) {
+    _waypoints = @[];
+    _waypointsByTripID = @{};
+  }
+  return self;
+}
+
+- (nullable GMTSTripWaypoint *)firstWaypoint {
+  return _waypoints.firstObject;
+}
+
+- (GRSDWaypointDiff *)updateWithWaypoints:(NSArray<GMTSTripWaypoint *> *)waypoints {
+  GRSDWaypointDiff *diff = [GRSDWaypointDiff diffFromWaypoints:_waypoints toWaypoints:waypoints];
+  _waypoints = [waypoints copy];
+
+  NSMutableDictionary<NSString *, NSMutableArray<GMTSTripWaypoint *> *> *waypointsByTripID =
+      [NSMutableDictionary dictionary];
+  for (GMTSTripWaypoint *waypoint in _waypoints) {
+    if (!waypoint.tripID) {
+      continue;
+    }
+    NSMutableArray<GMTSTripWaypoint *> *tripWaypoints = waypointsByTripID[waypoint.tripID];
+    if (!tripWaypoints) {
+      tripWaypoints = [NSMutableArray array];
+      waypointsByTripID[waypoint.tripID] = tripWaypoints;
+    }
+    [tripWaypoints addObject:waypoint];
+  }
+  _waypointsByTripID = waypointsByTripID;
+  return diff;
+}
+
+- (void)removeAllWaypoints {
+  _waypoints = @[];
+  _waypointsByTripID = @{};
+}
+
+- (nullable GMTSTripWaypoint *)nextWaypointForTripID:(NSString *)tripID {
+  NSArray<GMTSTripWaypoint *> *tripWaypoints = _waypointsByTripID[tripID];
+  return tripWaypoints.count > 1 ? tripWaypoints[1] : nil;
+}
+
+@end
@@ -0,0 +1,212 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+import Foundation
+
+/// A thread-safe cache of auth tokens, keyed by the ID the token was issued for.
+///
+/// Requests for a key that arrive while its token is being fetched wait for that fetch instead of
+/// starting another one. Once only `refreshAheadFraction` of a token's lifetime remains, the next
+/// request still returns the cached token but also starts fetching a new one, so callers only wait
+/// on the network when a token has expired.
+///
+/// Once more than `capacity` keys are cached, the tokens closest to expiring are evicted first.
+/// Tokens can also be persisted to a file, so that a relaunch within their lifetime doesn't wait
+/// for a token to be fetched. The file is written with complete file protection and excluded from
+/// backups. Tokens are short-lived and fetched again when missing, so they aren't worth keeping in
+/// the Keychain, but they must not outlive the device in a backup.
+class AuthTokenCache {
+
+  /// A token fetched from the provider.
+  struct Token: Codable {
+    let token: String
+
+    /// The time, in seconds since 1970, at which the token expires.
+    let expiration: TimeInterval
+  }
+
+  /// Fetches a new token for a key and calls the completion exactly once.
+  typealias Fetcher = (
+    _ key: String, _ completion: @escaping (Result<Token, Swift.Error>) -> Void
+  ) -> Void
+
+  typealias Completion = (Result<String, Swift.Error>) -> Void
+
+  static let defaultCapacity = 16
+  static let defaultRefreshAheadFraction = 0.2
+
+  private struct PersistedToken: Codable {
+    let token: Token
+    let refreshTime: TimeInterval
+  }
+
+  private struct Entry {
+    var token: Token?
+
+    /// The time after which the token is refreshed ahead of its expiration.
+    var refreshTime: TimeInterval = 0
+
+    /// Completions waiting for the token being fetched, or `nil` if no fetch is in flight.
+    var pendingCompletions: [Completion]?
+  }
+
+  /// The maximum number of tokens held by the cache.
+  let capacity: Int
+
+  /// The fraction of a token's lifetime, between 0 and 1, that remains when the token is refreshed.
+  let refreshAheadFraction: Double
+
+  /// The file that tokens are persisted to and restored from, or `nil` to keep tokens in memory.
+  let fileURL: URL?
+
+  /// The clock that tokens expire on.
+  let clock: AppClock
+
+  private let fetcher: Fetcher
+  private let lock = NSLock()
+  private var entries: [String: Entry] = [:]
+
+  /// Serializes writes of the persisted tokens.
+  private let fileQueue = DispatchQueue(label: "com.google.ConsumerSampleApp.AuthTokenCache")
+
+  init(
+    capacity: Int = defaultCapacity, fileURL: URL? = nil,
+    refreshAheadFraction: Double = defaultRefreshAheadFraction,
+    clock: AppClock = SystemClock.shared, fetcher: @escaping Fetcher
+  ) {
+    self.capacity = max(capacity, 1)
+    self.fileURL = fileURL
+    self.clock = clock
+    self.refreshAheadFraction = refreshAheadFraction
+    self.fetcher = fetcher
+    loadPersistedTokens()
+  }
+
+  /// Returns a valid token for the key, fetching one if none is cached. Cached tokens are delivered
+  /// before this method returns.
+  func token(forKey key: String, completion: @escaping Completion) {
+    lock.lock()
+    var entry = entries[key] ?? Entry()
+    let now = clock.now
+    var cachedToken: String?
+    var shouldFetch = false
+    if let token = entry.token, now < token.expiration {
+      cachedToken = token.token
+      shouldFetch = entry.pendingCompletions == nil && now >= entry.refreshTime
+      if shouldFetch {
+        entry.pendingCompletions = []
+      }
+    } else {
+      if entry.pendingCompletions == nil {
+        entry.pendingCompletions = []
+        shouldFetch = true
+      }
+      entry.pendingCompletions?.append(completion)
+    }
+    entries[key] = entry
+    lock.unlock()
+
+    if let cachedToken = cachedToken {
+      completion(.success(cachedToken))
+    }
+    if shouldFetch {
+      refreshToken(forKey: key)
+    }
+  }
+
+  /// Fetches a new token for the key and delivers it to the requests waiting for it.
+  private func refreshToken(forKey key: String) {
+    let fetchTime = clock.now
+    // Capture self strongly so that waiting requests are always completed.
+    fetcher(key) { result in
+      self.lock.lock()
+      let completions = self.entries[key]?.pendingCompletions ?? []
+      self.entries[key]?.pendingCompletions = nil
+      // Keep the current token if the refresh failed, so that it is retried on the next request.
+      if case .success(let token) = result, token.expiration > fetchTime {
+        let lifetime = token.expiration - fetchTime
+        self.entries[key]?.token = token
+        self.entries[key]?.refreshTime = token.expiration - lifetime * self.refreshAheadFraction
+        self.evictEntriesIfNeeded(keeping: key)
+        self.persistTokens()
+      }
+      self.lock.unlock()
+
+      let tokenResult = result.map { $0.token }
+      for completion in completions {
+        completion(tokenResult)
+      }
+    }
+  }
+
+  /// Evicts expired tokens, and then the tokens closest to expiring until at most `capacity`
+  /// remain. Keys with a fetch in flight and `keptKey`, whose token is being returned, are kept.
+  /// Must be called with the lock held.
+  private func evictEntriesIfNeeded(keeping keptKey: String? = nil) {
+    let now = clock.now
+    let evictableKeys = entries.filter { $0.value.pendingCompletions == nil && $0.key != keptKey }
+      .sorted { ($0.value.token?.expiration ?? 0) < ($1.value.token?.expiration ?? 0) }
+      .map { $0.key }
+    for key in evictableKeys {
+      if entries.count <= capacity, let expiration = entries[key]?.token?.expiration,
+        expiration > now
+      {
+        break
+      }
+      entries[key] = nil
+    }
+  }
+
+  /// Restores the unexpired tokens persisted by a previous launch.
+  private func loadPersistedTokens() {
+    guard let fileURL = fileURL, let data = try? Data(contentsOf: fileURL),
+      let persistedTokens = try? PropertyListDecoder().decode(
+        [String: PersistedToken].self, from: data)
+    else {
+      return
+    }
+    let now = clock.now
+    for (key, persistedToken) in persistedTokens where persistedToken.token.expiration > now {
+      entries[key] = Entry(token: persistedToken.token, refreshTime: persistedToken.refreshTime)
+    }
+    evictEntriesIfNeeded()
+  }
+
+  /// Writes the cached tokens to disk in the background. Must be called with the lock held.
+  private func persistTokens() {
+    guard let fileURL = fileURL else {
+      return
+    }
+    let persistedTokens = entries.compactMapValues { entry in
+      entry.token.map { PersistedToken(token: $0, refreshTime: entry.refreshTime) }
+    }
+    fileQueue.async {
+      let encoder = PropertyListEncoder()
+      encoder.outputFormat = .binary
+      guard let data = try? encoder.encode(persistedTokens) else {
+        return
+      }
+      guard (try? data.write(to: fileURL, options: [.atomic, .completeFileProtection])) != nil
+      else {
+        return
+      }
+      // The atomic write replaces the file, so its backup exclusion is set again each time.
+      var resourceValues = URLResourceValues()
+      resourceValues.isExcludedFromBackup = true
+      var excludedFileURL = fileURL
+      try? excludedFileURL.setResourceValues(resourceValues)
+    }
+  }
+}
@@ -19,12 +19,6 @@ import GoogleRidesharingConsumer
 /// Provides a service that sends request and receives response from provider server.
 class AuthTokenProvider: NSObject, GMTCAuthorization {
 
-  private struct AuthToken {
-    let token: String
-    let expiration: TimeInterval
-    let tripID: String
-  }
-
   private enum AccessTokenError: Error {
     case missingAuthorizationContext
     case missingData
@@ -35,8 +29,27 @@ class AuthTokenProvider: NSObject, GMTCAuthorization {
   private static let tokenKey = "jwt"
   private static let tokenExpirationKey = "expirationTimestamp"
 
-  /// Cached token.
-  private var authToken: AuthToken?
+  /// The file that tokens are persisted to between launches.
+  static let defaultTokenCacheFileURL = FileManager.default.urls(
+    for: .cachesDirectory, in: .userDomainMask
+  ).first?.appendingPathComponent("AuthTokens.plist")
+
+  /// Cached tokens, keyed by trip ID.
+  private let tokenCache: AuthTokenCache
+
+  init(
+    session: URLSession = .shared, tokenCacheFileURL: URL? = defaultTokenCacheFileURL,
+    refreshAheadFraction: Double = AuthTokenCache.defaultRefreshAheadFraction,
+    metrics: ProviderMetrics = .shared, clock: AppClock = SystemClock.shared
+  ) {
+    tokenCache = AuthTokenCache(
+      fileURL: tokenCacheFileURL, refreshAheadFraction: refreshAheadFraction, clock: clock
+    ) { tripID, completion in
+      AuthTokenProvider.fetchToken(
+        tripID: tripID, session: session, metrics: metrics, completion: completion)
+    }
+    super.init()
+  }
 
   func fetchToken(
     with authorizationContext: GMTCAuthorizationContext?,
@@ -46,39 +59,62 @@ class AuthTokenProvider: NSObject, GMTCAuthorization {
       completion(nil, AccessTokenError.missingAuthorizationContext)
       return
     }
-    let tripID = authorizationContext.tripID
+    fetchToken(tripID: authorizationContext.tripID, completion: completion)
+  }
 
-    // Check if a token is cached and is valid.
-    if let authToken = authToken,
-      authToken.expiration > Date().timeIntervalSince1970 && authToken.tripID == tripID
-    {
-      completion(authToken.token, nil)
-      return
+  /// Returns a token for a trip, waiting for one to be fetched if none is cached.
+  func fetchToken(tripID: String, completion: @escaping GMTCAuthTokenFetchCompletionHandler) {
+    tokenCache.token(forKey: tripID) { result in
+      switch result {
+      case .success(let token):
+        completion(token, nil)
+      case .failure(let error):
+        completion(nil, error)
+      }
     }
+  }
 
-    let tokenURL = ProviderUtils.providerURL(path: Self.tokenPath)
+  /// Fetches a new token for a trip from the provider.
+  private static func fetchToken(
+    tripID: String, session: URLSession, metrics: ProviderMetrics,
+    completion: @escaping (Result<AuthTokenCache.Token, Error>) -> Void
+  ) {
+    var timer = metrics.startTimer(for: #function)
+    let tokenURL = ProviderUtils.providerURL(path: tokenPath)
     guard let tokenURLWithTripID = URL(string: tripID, relativeTo: tokenURL) else {
-      completion(nil, AccessTokenError.missingURL)
+      completion(.failure(AccessTokenError.missingURL))
       return
     }
 
-    let request = URLRequest(url: tokenURLWithTripID)
-    let task = URLSession.shared.dataTask(with: request) { [weak self] data, _, error in
-      guard let strongSelf = self else { return }
+    let request = ProviderUtils.providerRequest(
+      url: tokenURLWithTripID, method: RPCConstants.httpMethodGET)
+    let endpointSet = ProviderEndpointSet.shared
+    let routedRequest = endpointSet.route(request)
+    timer.endPhase(.build)
+    metrics.recordAttempt(request, isRetry: false, for: timer.call)
+    let task = session.dataTask(with: routedRequest.request) { [timer] data, response, error in
+      var timer = timer
+      endpointSet.finish(routedRequest, response: response, error: error)
+      metrics.recordResponse(response, data: data, error: error, to: request, for: timer.call)
+      timer.endPhase(.network)
+      if let error = error {
+        completion(.failure(error))
+        return
+      }
       guard let data = data,
-        let fetchData = try? JSONSerialization.jsonObject(with: data) as? [String: Any],
-        let token = fetchData[Self.tokenKey] as? String,
-        let expirationInMilliseconds = fetchData[Self.tokenExpirationKey] as? Int
+        let fetchData = ProviderUtils.dictionary(fromResponseData: data, response: response),
+        let token = fetchData[tokenKey] as? String,
+        let expirationInMilliseconds = fetchData[tokenExpirationKey] as? Int
       else {
-        completion(nil, AccessTokenError.missingData)
+        completion(.failure(AccessTokenError.missingData))
         return
       }
+      timer.endPhase(.decode)
 
-      strongSelf.authToken = AuthToken(
-        token: token,
-        expiration: Double(expirationInMilliseconds) / 1000.0,
-        tripID: tripID)
-      completion(token, nil)
+      completion(
+        .success(
+          AuthTokenCache.Token(
+            token: token, expiration: Double(expirationInMilliseconds) / 1000.0)))
     }
     task.resume()
   }
@@ -37,8 +37,13 @@ enum RPCConstants {
   static let tripStatusCanceled = "CANCELED"
 
   /// HTTP constants.
+  static let httpAcceptHeaderField = "Accept"
   static let httpContentTypeHeaderField = "Content-Type"
   static let httpJSONContentType = "application/json"
+  static let httpPropertyListContentType = "application/x-plist"
+  /// Prefers binary property list responses, which providers without support for them ignore.
+  static let httpAcceptedContentTypes = "application/x-plist, application/json;q=0.9"
+  static let httpMethodGET = "GET"
   static let httpMethodPOST = "POST"
   static let httpMethodPUT = "PUT"
 }
@@ -53,8 +58,32 @@ class ProviderService {
 
   private let session: URLSession
 
-  init(session: URLSession = .shared) {
+  /// Policy that retries failed requests. Trip cancellations are retried, while trip creation is
+  /// sent only once since a retry could create a second trip.
+  let retryPolicy: ProviderRetryPolicy
+
+  /// The provider replicas that requests are routed to.
+  let endpointSet: ProviderEndpointSet
+
+  /// Latency histograms and counters of provider calls, keyed by the name of the call. The build,
+  /// network and decode phases of every call are timed, and every attempt's bytes and status code
+  /// are counted.
+  let metrics: ProviderMetrics
+
+  /// Tracer whose trace context is sent with trip cancellations, so that the provider can attribute
+  /// them to the step of the trip that made them.
+  let tripTracer: TripTracer
+
+  init(
+    session: URLSession = .shared, retryPolicy: ProviderRetryPolicy = .shared,
+    endpointSet: ProviderEndpointSet = .shared, metrics: ProviderMetrics = .shared,
+    tripTracer: TripTracer = .shared
+  ) {
     self.session = session
+    self.retryPolicy = retryPolicy
+    self.endpointSet = endpointSet
+    self.metrics = metrics
+    self.tripTracer = tripTracer
   }
 
   /// Creates an exclusive trip and returns the trip name.
@@ -62,6 +91,7 @@ class ProviderService {
     pickupLocation: GMTSTerminalLocation, dropoffLocation: GMTSTerminalLocation,
     intermediateDestinations: [GMTSTerminalLocation]
   ) async throws -> String {
+    var timer = metrics.startTimer(for: #function)
     let requestURL = ProviderUtils.providerURL(path: RPCConstants.providerCreateTripURLPath)
     let payloadDict =
       [
@@ -76,20 +106,24 @@ class ProviderService {
             locations: intermediateDestinations),
       ] as [String: Any]
 
-    let request = getJSONRequest(
-      url: requestURL, payloadDict: payloadDict, method: RPCConstants.httpMethodPOST)
-    let (data, _) = try await session.data(for: request, delegate: nil)
+    let request = ProviderUtils.providerRequest(
+      url: requestURL, method: RPCConstants.httpMethodPOST, payloadDict: payloadDict)
+    timer.endPhase(.build)
+    let (data, response) = try await send(request, call: timer.call)
+    timer.endPhase(.network)
     guard
-      let parsedDictionary = try? JSONSerialization.jsonObject(with: data) as? [String: Any],
+      let parsedDictionary = ProviderUtils.dictionary(fromResponseData: data, response: response),
       let tripName = parsedDictionary[RPCConstants.tripNameKey] as? String
     else {
       throw Error.missingData
     }
+    timer.endPhase(.decode)
     return tripName
   }
 
   /// Cancels an existing trip.
   func cancelTrip(tripID: String) async throws {
+    var timer = metrics.startTimer(for: #function)
     guard let requestURL = getProviderUpdateTripStatusURL(tripID: tripID) else {
       throw Error.missingURL
     }
@@ -97,19 +131,34 @@ class ProviderService {
       [
         RPCConstants.statusKey: RPCConstants.tripStatusCanceled
       ] as [String: Any]
-    let request = getJSONRequest(
-      url: requestURL, payloadDict: payloadDict, method: RPCConstants.httpMethodPUT)
-    let _ = try await session.data(for: request, delegate: nil)
+    var request = ProviderUtils.providerRequest(
+      url: requestURL, method: RPCConstants.httpMethodPUT, payloadDict: payloadDict)
+    request.setValue(
+      tripTracer.traceHeaderValue(tripID: tripID), forHTTPHeaderField: TripTracer.traceHeaderField)
+    timer.endPhase(.build)
+    let call = timer.call
+    let _ = try await retryPolicy.data { isFirstAttempt in
+      try await self.send(request, call: call, isRetry: !isFirstAttempt)
+    }
+    timer.endPhase(.network)
   }
 
-  private func getJSONRequest(url: URL, payloadDict: [String: Any], method: String) -> URLRequest {
-    let serializedPayload = try! JSONSerialization.data(withJSONObject: payloadDict)
-    var request = URLRequest(url: url)
-    request.httpMethod = method
-    request.setValue(
-      RPCConstants.httpJSONContentType, forHTTPHeaderField: RPCConstants.httpContentTypeHeaderField)
-    request.httpBody = serializedPayload
-    return request
+  /// Sends one attempt at a call's request to the replica it is routed to, counting it and its
+  /// outcome in `metrics`.
+  private func send(_ request: URLRequest, call: String, isRetry: Bool = false) async throws
+    -> (Data, URLResponse)
+  {
+    metrics.recordAttempt(request, isRetry: isRetry, for: call)
+    do {
+      let (data, response) = try await endpointSet.data(for: request) { routedRequest in
+        try await self.session.data(for: routedRequest, delegate: nil)
+      }
+      metrics.recordResponse(response, data: data, error: nil, to: request, for: call)
+      return (data, response)
+    } catch {
+      metrics.recordResponse(nil, data: nil, error: error, to: request, for: call)
+      throw error
+    }
   }
 
   private func getProviderUpdateTripStatusURL(tripID: String) -> URL? {
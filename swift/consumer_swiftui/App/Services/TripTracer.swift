@@ -0,0 +1,231 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import CryptoKit
+import Foundation
+
+/// Records timestamped spans for the steps of trip lifecycles, keyed by trip ID, and exports them
+/// to a local file.
+///
+/// Each ended span is appended to the file as one line of JSON, with its start as wall-clock time
+/// so that traces from the driver and consumer apps can be stitched into a timeline per trip by
+/// tools/stitch_trip_traces.py. All spans of a trip share a trace ID derived from the trip ID, so
+/// both apps and the provider agree on it without coordinating.
+final class TripTracer {
+
+  /// A timed step in the lifecycle of a trip, which is exported by its tracer once it ends.
+  final class Span {
+    /// The name of the step.
+    let name: String
+
+    /// Identifies the span within the trace of its trip.
+    let spanID: String
+
+    private weak var tracer: TripTracer?
+    private let startDate = Date()
+    private let startTime = ProcessInfo.processInfo.systemUptime
+    private let lock = NSLock()
+    private var _tripID: String?
+    private var attributes: [String: String] = [:]
+    private var isEnded = false
+
+    fileprivate init(name: String, tripID: String?, tracer: TripTracer) {
+      self.name = name
+      self._tripID = tripID
+      self.spanID = TripTracer.makeSpanID()
+      self.tracer = tracer
+    }
+
+    /// The ID of the trip that the step belongs to. It can be set until the span ends, for steps
+    /// that only learn the trip ID along the way, such as creating a trip. Spans that end without a
+    /// trip ID are dropped.
+    var tripID: String? {
+      get {
+        lock.lock()
+        defer { lock.unlock() }
+        return _tripID
+      }
+      set {
+        lock.lock()
+        defer { lock.unlock() }
+        _tripID = newValue
+      }
+    }
+
+    /// Sets an attribute that is exported with the span.
+    func setAttribute(_ value: String, forKey key: String) {
+      lock.lock()
+      defer { lock.unlock() }
+      attributes[key] = value
+    }
+
+    /// Ends the span and exports it. Ending a span again has no effect.
+    func end() {
+      let duration = ProcessInfo.processInfo.systemUptime - startTime
+      lock.lock()
+      guard !isEnded else {
+        lock.unlock()
+        return
+      }
+      isEnded = true
+      let tripID = _tripID
+      let attributes = self.attributes
+      lock.unlock()
+
+      guard let tripID = tripID, let tracer = tracer else { return }
+      tracer.export(
+        ExportedSpan(
+          source: tracer.source, name: name, trip: tripID,
+          trace: TripTracer.traceID(tripID: tripID), span: spanID,
+          start: startDate.timeIntervalSince1970, duration: duration, attributes: attributes))
+    }
+  }
+
+  /// The line of the trace file that a span is exported as.
+  private struct ExportedSpan: Encodable {
+    let source: String
+    let name: String
+    let trip: String
+    let trace: String
+    let span: String
+    let start: TimeInterval
+    let duration: TimeInterval
+    let attributes: [String: String]
+  }
+
+  /// The HTTP header field that carries the trace context of a trip on provider requests, in the
+  /// W3C Trace Context format.
+  static let traceHeaderField = "traceparent"
+
+  /// The key of the attribute holding the provider's name of the status that a trip reached.
+  static let tripStatusAttributeKey = "status"
+
+  /// The size above which the trace file is started over when a tracer opens it.
+  private static let maximumFileSize = 8 * 1024 * 1024
+
+  /// The number of trips whose last started span is remembered as the parent of their requests.
+  private static let maximumTracedTripCount = 64
+
+  /// The tracer shared by the app, which exports spans to a file in the caches directory.
+  static let shared = TripTracer(
+    source: "consumer",
+    fileURL: FileManager.default.urls(for: .cachesDirectory, in: .userDomainMask).first?
+      .appendingPathComponent("TripTrace.jsonl"))
+
+  /// The name of the app that the spans are recorded by.
+  let source: String
+
+  /// The file that spans are appended to, or `nil` if spans are not exported.
+  let fileURL: URL?
+
+  private let lock = NSLock()
+
+  /// The ID of the span last started for each trip, which is the parent of its requests.
+  private var lastSpanIDByTripID: [String: String] = [:]
+
+  /// Serializes writes to the trace file.
+  private let fileQueue = DispatchQueue(label: "com.google.ConsumerSampleApp.TripTracer")
+
+  /// The handle of the trace file, which is opened with the first exported span. Only accessed on
+  /// `fileQueue`.
+  private var fileHandle: FileHandle?
+
+  /// Creates a tracer that appends spans to `fileURL`, or drops them if it is `nil`. The file is
+  /// started over if it has grown larger than 8 MB.
+  init(source: String, fileURL: URL?) {
+    self.source = source
+    self.fileURL = fileURL
+  }
+
+  /// Starts a span, which becomes the parent of provider requests for its trip until another span
+  /// of the trip is started. `tripID` may be `nil` if it is not known yet.
+  func startSpan(_ name: String, tripID: String?) -> Span {
+    let span = Span(name: name, tripID: tripID, tracer: self)
+    if let tripID = tripID {
+      lock.lock()
+      defer { lock.unlock() }
+      if lastSpanIDByTripID[tripID] == nil
+        && lastSpanIDByTripID.count >= Self.maximumTracedTripCount
+      {
+        lastSpanIDByTripID.removeAll()
+      }
+      lastSpanIDByTripID[tripID] = span.spanID
+    }
+    return span
+  }
+
+  /// Records an instantaneous step of a trip.
+  func recordEvent(_ name: String, tripID: String, attributes: [String: String] = [:]) {
+    let span = startSpan(name, tripID: tripID)
+    for (key, value) in attributes {
+      span.setAttribute(value, forKey: key)
+    }
+    span.end()
+  }
+
+  /// Returns the value of the `traceHeaderField` header for a provider request about a trip, whose
+  /// parent is the span last started for the trip.
+  func traceHeaderValue(tripID: String) -> String {
+    lock.lock()
+    let parentSpanID = lastSpanIDByTripID[tripID]
+    lock.unlock()
+    // A request made outside of any span is the root of its own span.
+    return "00-\(Self.traceID(tripID: tripID))-\(parentSpanID ?? Self.makeSpanID())-01"
+  }
+
+  /// Waits until the spans that have ended have been written to the file.
+  func waitUntilExported() {
+    fileQueue.sync {}
+  }
+
+  /// Returns the 128-bit trace ID of a trip, which is the start of the SHA-256 of its ID.
+  static func traceID(tripID: String) -> String {
+    hexString(SHA256.hash(data: Data(tripID.utf8)).prefix(16))
+  }
+
+  private static func makeSpanID() -> String {
+    hexString((0..<8).map { _ in UInt8.random(in: .min ... .max) })
+  }
+
+  private static func hexString<Bytes: Sequence>(_ bytes: Bytes) -> String
+  where Bytes.Element == UInt8 {
+    bytes.map { String(format: "%02x", $0) }.joined()
+  }
+
+  private func export(_ span: ExportedSpan) {
+    guard fileURL != nil else { return }
+    fileQueue.async {
+      guard var line = try? JSONEncoder().encode(span), let fileHandle = self.openFileHandle()
+      else { return }
+      line.append(UInt8(ascii: "\n"))
+      try? fileHandle.write(contentsOf: line)
+    }
+  }
+
+  /// Returns the handle of the trace file, opening it if needed. Must be called on `fileQueue`.
+  private func openFileHandle() -> FileHandle? {
+    if let fileHandle = fileHandle {
+      return fileHandle
+    }
+    guard let fileURL = fileURL else { return nil }
+    // A missing file is created, and one that has grown too large is started over.
+    let attributes = try? FileManager.default.attributesOfItem(atPath: fileURL.path)
+    if attributes?[.size] as? Int ?? .max > Self.maximumFileSize {
+      FileManager.default.createFile(atPath: fileURL.path, contents: nil)
+    }
+    fileHandle = try? FileHandle(forWritingTo: fileURL)
+    _ = try? fileHandle?.seekToEnd()
+    return fileHandle
+  }
+}
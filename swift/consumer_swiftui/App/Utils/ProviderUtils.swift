@@ -19,12 +19,72 @@ import GoogleRidesharingConsumer
 /// Helper methods for `ProviderService` and `AuthTokenProvider`.
 enum ProviderUtils {
 
-  /// Base provider URL Strings.
-  private static let baseProviderURLString = "http://localhost:8080"
+  /// Base URLs of the provider replicas, which `ProviderEndpointSet.shared` spreads requests
+  /// across.
+  static let baseProviderURLStrings = ["http://localhost:8080"]
 
+  /// Returns the URL of a provider path. Requests for it are routed to a replica when sent.
   static func providerURL(path: String) -> URL {
-    let baseProviderURL = URL(string: baseProviderURLString)
-    return URL(string: path, relativeTo: baseProviderURL)!
+    ProviderEndpointSet.shared.url(path: path)
+  }
+
+  private static let payloadFormatLock = NSLock()
+  private static var _providerAcceptsPropertyList = false
+
+  /// Whether the provider has answered with a property list, and so also accepts property list
+  /// request bodies. Until then request bodies are sent as JSON.
+  private static var providerAcceptsPropertyList: Bool {
+    get {
+      payloadFormatLock.lock()
+      defer { payloadFormatLock.unlock() }
+      return _providerAcceptsPropertyList
+    }
+    set {
+      payloadFormatLock.lock()
+      defer { payloadFormatLock.unlock() }
+      _providerAcceptsPropertyList = newValue
+    }
+  }
+
+  /// Creates a provider request that accepts property list as well as JSON responses.
+  ///
+  /// The body is encoded as a binary property list if the provider has sent one, and as JSON
+  /// otherwise, so that providers which only speak JSON keep working.
+  static func providerRequest(url: URL, method: String, payloadDict: [String: Any]? = nil)
+    -> URLRequest
+  {
+    var request = URLRequest(url: url)
+    request.httpMethod = method
+    request.setValue(
+      RPCConstants.httpAcceptedContentTypes, forHTTPHeaderField: RPCConstants.httpAcceptHeaderField)
+    guard let payloadDict = payloadDict else {
+      return request
+    }
+    if providerAcceptsPropertyList {
+      request.setValue(
+        RPCConstants.httpPropertyListContentType,
+        forHTTPHeaderField: RPCConstants.httpContentTypeHeaderField)
+      request.httpBody = try! PropertyListSerialization.data(
+        fromPropertyList: payloadDict, format: .binary, options: 0)
+    } else {
+      request.setValue(
+        RPCConstants.httpJSONContentType,
+        forHTTPHeaderField: RPCConstants.httpContentTypeHeaderField)
+      request.httpBody = try! JSONSerialization.data(withJSONObject: payloadDict)
+    }
+    return request
+  }
+
+  /// Decodes the dictionary of a provider response, which is a property list or JSON depending on
+  /// its MIME type.
+  static func dictionary(fromResponseData data: Data, response: URLResponse?) -> [String: Any]? {
+    guard response?.mimeType == RPCConstants.httpPropertyListContentType else {
+      return try? JSONSerialization.jsonObject(with: data) as? [String: Any]
+    }
+    if !providerAcceptsPropertyList {
+      providerAcceptsPropertyList = true
+    }
+    return try? PropertyListSerialization.propertyList(from: data, format: nil) as? [String: Any]
   }
 
   /// Format terminal location to dictionary.
@@ -44,9 +44,20 @@ class MapViewController: UIViewController, GMTCMapViewDelegate, GMTCTripModelSub
   /// The name for intermediate destination marker.
   static let intermediateDestinationMarkerIconName = "gmtc_ic_multidestination_point"
 
+  // Names of the traced steps of a trip's lifecycle, whose latencies tools/stitch_trip_traces.py
+  // summarizes.
+  private static let createTripSpanName = "consumer.createTrip"
+  private static let tripStatusSpanName = "consumer.tripStatus"
+
+  /// Records the steps of each trip's lifecycle.
+  private let tripTracer = TripTracer.shared
+
   /// The `ModelData` containing the primary state of the application.
   private let modelData: ModelData
 
+  /// The clock that the end of completed trips and ETAs are timed on.
+  private let clock: AppClock
+
   // MARK: - MapView variables
 
   var mapView: GMTCMapView {
@@ -78,8 +89,9 @@ class MapViewController: UIViewController, GMTCMapViewDelegate, GMTCTripModelSub
 
   private var tripName: String = ""
 
-  init(modelData: ModelData) {
+  init(modelData: ModelData, clock: AppClock = SystemClock.shared) {
     self.modelData = modelData
+    self.clock = clock
     super.init(nibName: nil, bundle: nil)
     NotificationCenter.default.addObserver(
       self, selector: #selector(consumerStateUpdate), name: .stateDidChange, object: nil)
@@ -120,13 +132,17 @@ class MapViewController: UIViewController, GMTCMapViewDelegate, GMTCTripModelSub
   /// Creates a new trip when receiving "Book Trip" notification.
   private func bookTrip() {
     Task {
-      let providerService = ProviderService()
-      guard
-        let tripName = try? await providerService.createTrip(
-          pickupLocation: modelData.pickupLocation, dropoffLocation: modelData.dropoffLocation,
-          intermediateDestinations: modelData.intermediateDestinations
-        )
-      else {
+      let providerService = ProviderService(tripTracer: tripTracer)
+      // The trip ID is only known once the trip has been created.
+      let span = tripTracer.startSpan(Self.createTripSpanName, tripID: nil)
+      let tripName = try? await providerService.createTrip(
+        pickupLocation: modelData.pickupLocation, dropoffLocation: modelData.dropoffLocation,
+        intermediateDestinations: modelData.intermediateDestinations
+      )
+      // Trip names end with the trip ID.
+      span.tripID = tripName?.components(separatedBy: "/").last
+      span.end()
+      guard let tripName = tripName else {
         return
       }
       modelData.customerState = .booking
@@ -138,7 +154,7 @@ class MapViewController: UIViewController, GMTCMapViewDelegate, GMTCTripModelSub
   /// Cancels a trip when receiving "Cancel Trip" notification.
   private func cancelTrip() {
     Task {
-      let providerService = ProviderService()
+      let providerService = ProviderService(tripTracer: tripTracer)
       do {
         try await providerService.cancelTrip(tripID: modelData.tripID)
       } catch {
@@ -243,6 +259,11 @@ class MapViewController: UIViewController, GMTCMapViewDelegate, GMTCTripModelSub
   // MARK: - GMTCTripModelSubscriber
 
   func tripModel(_ tripModel: GMTCTripModel, didUpdate tripStatus: GMTSTripStatus) {
+    if let tripID = tripModel.currentTrip?.tripID() {
+      tripTracer.recordEvent(
+        Self.tripStatusSpanName, tripID: tripID,
+        attributes: [TripTracer.tripStatusAttributeKey: Self.providerName(of: tripStatus)])
+    }
     switch tripStatus {
     case .new:
       resetMarkers()
@@ -272,7 +293,7 @@ class MapViewController: UIViewController, GMTCMapViewDelegate, GMTCTripModelSub
       modelData.controlButtonLabel = ""
       resetMarkers()
       let waitSeconds = 4.0
-      DispatchQueue.main.asyncAfter(deadline: .now() + waitSeconds) { [weak self] in
+      clock.scheduleTimer(interval: waitSeconds, repeats: false) { [weak self] in
         guard let strongSelf = self else { return }
         let tripService = GMTCServices.shared().tripService
         let tripModel = tripService.tripModel(forTripName: strongSelf.tripName)
@@ -292,6 +313,32 @@ class MapViewController: UIViewController, GMTCMapViewDelegate, GMTCTripModelSub
     }
   }
 
+  /// Returns the provider's name of a trip status, which the driver app also traces.
+  private static func providerName(of tripStatus: GMTSTripStatus) -> String {
+    switch tripStatus {
+    case .new:
+      return "NEW"
+    case .enrouteToPickup:
+      return "ENROUTE_TO_PICKUP"
+    case .arrivedAtPickup:
+      return "ARRIVED_AT_PICKUP"
+    case .enrouteToIntermediateDestination:
+      return "ENROUTE_TO_INTERMEDIATE_DESTINATION"
+    case .arrivedAtIntermediateDestination:
+      return "ARRIVED_AT_INTERMEDIATE_DESTINATION"
+    case .enrouteToDropoff:
+      return "ENROUTE_TO_DROPOFF"
+    case .complete:
+      return "COMPLETE"
+    case .canceled:
+      return "CANCELED"
+    case .unknown:
+      return "UNKNOWN"
+    @unknown default:
+      return "UNKNOWN"
+    }
+  }
+
   func tripModel(
     _ tripModel: GMTCTripModel,
     didUpdateActiveRouteRemainingDistance activeRouteRemainingDistance: Int32
@@ -303,7 +350,7 @@ class MapViewController: UIViewController, GMTCMapViewDelegate, GMTCTripModelSub
   func tripModel(
     _ tripModel: GMTCTripModel, didUpdateETAToNextWaypoint nextWaypointETA: TimeInterval
   ) {
-    let delta = nextWaypointETA - Date().timeIntervalSince1970
+    let delta = nextWaypointETA - clock.now
     modelData.timeToWaypoint = delta / MapViewController.secondsPerMinute
   }
 
@@ -15,13 +15,33 @@
 
 import Foundation
 
+#if canImport(FoundationNetworking)
+  import FoundationNetworking
+#endif
+
 /// A Mock URLProtocol class that help serve the preserved response data to
 /// URLRequest during testing.
 class MockURLProtocol: URLProtocol {
 
+  /// The size of the pieces that a response body is delivered in when its bandwidth is capped.
+  private static let bodyChunkSize = 4096
+
   /// Handler to test the request and return mock response
   static var requestHandler: ((URLRequest) throws -> (HTTPURLResponse, Data?))?
 
+  /// Returns how long to wait before responding to a request, to simulate a slow endpoint. The
+  /// wait does not block other requests, and a request cancelled during it gets no response.
+  static var responseDelayHandler: ((URLRequest) -> TimeInterval)?
+
+  /// Emulates the conditions of the network that requests are sent over. Its latency is added to
+  /// that of `responseDelayHandler`. Without one, responses arrive in full as soon as they are
+  /// delayed.
+  static var networkEmulator: NetworkEmulator?
+
+  private let pendingResponseLock = NSLock()
+  private var pendingResponse: DispatchWorkItem?
+  private var isStopped = false
+
   override class func canInit(with request: URLRequest) -> Bool {
     /// Handle all types of requests
     return true
@@ -33,6 +53,27 @@ class MockURLProtocol: URLProtocol {
   }
 
   override func startLoading() {
+    let plan = MockURLProtocol.networkEmulator?.plan(for: request) ?? .immediate
+    switch plan.outcome {
+    case .outage:
+      client?.urlProtocol(self, didFailWithError: URLError(.notConnectedToInternet))
+      return
+    case .lose(let timeout):
+      schedule(after: timeout) { $0.client?.urlProtocol($0, didFailWithError: URLError(.timedOut)) }
+      return
+    case .respond, .reset:
+      break
+    }
+
+    let delay = (MockURLProtocol.responseDelayHandler?(request) ?? 0) + plan.latency
+    guard delay > 0 else {
+      respond(plan: plan)
+      return
+    }
+    schedule(after: delay) { $0.respond(plan: plan) }
+  }
+
+  private func respond(plan: NetworkEmulator.Plan) {
     guard let handler = MockURLProtocol.requestHandler else {
       fatalError("Handler is unavailable.")
     }
@@ -44,20 +85,62 @@ class MockURLProtocol: URLProtocol {
       // 3. Send received response to the client.
       client?.urlProtocol(self, didReceive: response, cacheStoragePolicy: .notAllowed)
 
-      if let data = data {
-        // 4. Send received data to the client.
-        client?.urlProtocol(self, didLoad: data)
+      // 4. Send received data to the client, and notify that the request has been finished.
+      var resetOffset: Int?
+      if case .reset(let fraction) = plan.outcome {
+        resetOffset = Int(Double(data?.count ?? 0) * fraction)
       }
-
-      // 5. Notify request has been finished.
-      client?.urlProtocolDidFinishLoading(self)
+      deliverBody(
+        data ?? Data(), from: 0, bytesPerSecond: plan.bytesPerSecond, resetOffset: resetOffset)
     } catch {
-      // 6. Notify received error.
+      // 5. Notify received error.
       client?.urlProtocol(self, didFailWithError: error)
     }
   }
+
+  /// Sends the body from `offset` on to the client, a chunk at a time if its bandwidth is capped,
+  /// and finishes loading, or fails as if the connection was reset once `resetOffset` is reached.
+  private func deliverBody(
+    _ body: Data, from offset: Int, bytesPerSecond: Double?, resetOffset: Int?
+  ) {
+    let end = min(resetOffset ?? body.count, body.count)
+    let chunkEnd = bytesPerSecond == nil ? end : min(offset + Self.bodyChunkSize, end)
+    if chunkEnd > offset {
+      client?.urlProtocol(self, didLoad: body.subdata(in: offset..<chunkEnd))
+    }
+    guard chunkEnd < end else {
+      if resetOffset != nil {
+        client?.urlProtocol(self, didFailWithError: URLError(.networkConnectionLost))
+      } else {
+        client?.urlProtocolDidFinishLoading(self)
+      }
+      return
+    }
+    let interval = Double(chunkEnd - offset) / max(bytesPerSecond ?? .infinity, 1)
+    schedule(after: interval) {
+      $0.deliverBody(
+        body, from: chunkEnd, bytesPerSecond: bytesPerSecond, resetOffset: resetOffset)
+    }
+  }
+
+  /// Runs `step` after `delay` without blocking other requests, unless loading is stopped first.
+  private func schedule(after delay: TimeInterval, _ step: @escaping (MockURLProtocol) -> Void) {
+    let pendingResponse = DispatchWorkItem { [weak self] in
+      guard let self = self else { return }
+      step(self)
+    }
+    pendingResponseLock.lock()
+    defer { pendingResponseLock.unlock() }
+    guard !isStopped else { return }
+    self.pendingResponse = pendingResponse
+    DispatchQueue.global().asyncAfter(deadline: .now() + delay, execute: pendingResponse)
+  }
+
   override func stopLoading() {
-    /// Required to be implemented. Do nothing here.
+    pendingResponseLock.lock()
+    defer { pendingResponseLock.unlock() }
+    isStopped = true
+    pendingResponse?.cancel()
   }
 }
 
@@ -65,6 +148,24 @@ extension URLRequest {
 
   func bodyStreamAsJSON() -> Any? {
 
+    guard let dat = bodyStreamData() else { return nil }
+
+    do {
+      return try JSONSerialization.jsonObject(
+        with: dat, options: JSONSerialization.ReadingOptions.allowFragments)
+    } catch {
+      print(error.localizedDescription)
+      return nil
+    }
+  }
+
+  func bodyStreamAsPropertyList() -> Any? {
+    guard let dat = bodyStreamData() else { return nil }
+    return try? PropertyListSerialization.propertyList(from: dat, format: nil)
+  }
+
+  private func bodyStreamData() -> Data? {
+
     guard let bodyStream = self.httpBodyStream else { return nil }
     bodyStream.open()
 
@@ -81,12 +182,6 @@ extension URLRequest {
     buffer.deallocate()
     bodyStream.close()
 
-    do {
-      return try JSONSerialization.jsonObject(
-        with: dat, options: JSONSerialization.ReadingOptions.allowFragments)
-    } catch {
-      print(error.localizedDescription)
-      return nil
-    }
+    return dat
   }
 }
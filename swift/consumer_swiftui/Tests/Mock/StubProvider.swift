@@ -0,0 +1,116 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+import Foundation
+
+/// An in-memory provider backend that serves the sample apps' requests through `MockURLProtocol`.
+///
+/// It implements the vehicle, trip and token endpoints of the sample provider closely enough for
+/// the apps' provider clients to run their whole flow against it: creating a vehicle matches a new
+/// trip with it, as if a consumer had booked one, and trips move through the statuses they are
+/// updated to. Endpoints it doesn't implement, such as batch trip fetches and vehicle updates,
+/// answer 404 so that clients fall back to the endpoints every provider has.
+final class StubProvider {
+  private static let providerName = "providers/stub-provider"
+  private static let tokenLifetime: TimeInterval = 3600
+
+  /// How long every response is delayed, to stand in for the network and the provider.
+  let responseDelay: TimeInterval
+
+  private let lock = NSLock()
+  private var tripStatusByTripID: [String: String] = [:]
+  private var matchedTripIDsByVehicleID: [String: [String]] = [:]
+  private var _requestCount = 0
+
+  init(responseDelay: TimeInterval = 0) {
+    self.responseDelay = responseDelay
+  }
+
+  /// The number of requests served.
+  var requestCount: Int {
+    lock.lock()
+    defer { lock.unlock() }
+    return _requestCount
+  }
+
+  /// The current status of every trip, keyed by trip ID.
+  var tripStatuses: [String: String] {
+    lock.lock()
+    defer { lock.unlock() }
+    return tripStatusByTripID
+  }
+
+  /// Serves all requests made through `MockURLProtocol` until another handler is installed.
+  func install() {
+    let responseDelay = self.responseDelay
+    MockURLProtocol.responseDelayHandler = { _ in responseDelay }
+    MockURLProtocol.requestHandler = { [self] request in
+      let (statusCode, jsonObject) = respond(to: request)
+      let response = HTTPURLResponse(
+        url: request.url!, statusCode: statusCode, httpVersion: nil,
+        headerFields: ["Content-Type": "application/json"])!
+      return (response, try JSONSerialization.data(withJSONObject: jsonObject))
+    }
+  }
+
+  private func respond(to request: URLRequest) -> (Int, Any) {
+    let pathComponents = request.url?.pathComponents.filter { $0 != "/" } ?? []
+    let body = request.bodyStreamAsJSON() as? [String: Any]
+
+    lock.lock()
+    defer { lock.unlock() }
+    _requestCount += 1
+    switch (request.httpMethod ?? "GET", pathComponents.first, pathComponents.dropFirst().first) {
+    case ("POST", "vehicle", "new"):
+      guard let vehicleID = body?["vehicleId"] as? String else { return (400, [:]) }
+      let tripID = makeTrip()
+      matchedTripIDsByVehicleID[vehicleID] = [tripID]
+      return (200, ["name": "\(Self.providerName)/vehicles/\(vehicleID)"])
+    case ("GET", "vehicle", let vehicleID?) where pathComponents.count == 2:
+      guard let matchedTripIDs = matchedTripIDsByVehicleID[vehicleID] else { return (404, [:]) }
+      return (200, ["currentTripsIds": matchedTripIDs])
+    case ("POST", "trip", "new"):
+      return (200, ["name": "\(Self.providerName)/trips/\(makeTrip())"])
+    case ("GET", "trip", let tripID?):
+      guard let tripStatus = tripStatusByTripID[tripID] else { return (404, [:]) }
+      return (
+        200,
+        [
+          "trip": [
+            "name": "\(Self.providerName)/trips/\(tripID)", "tripStatus": tripStatus,
+            "waypoints": [],
+          ]
+        ]
+      )
+    case ("PUT", "trip", let tripID?):
+      guard tripStatusByTripID[tripID] != nil, let tripStatus = body?["status"] as? String else {
+        return (404, [:])
+      }
+      tripStatusByTripID[tripID] = tripStatus
+      return (200, [:])
+    case ("GET", "token", _):
+      let expiration = Date().timeIntervalSince1970 + Self.tokenLifetime
+      return (200, ["jwt": UUID().uuidString, "expirationTimestamp": Int(expiration * 1000)])
+    default:
+      return (404, [:])
+    }
+  }
+
+  private func makeTrip() -> String {
+    let tripID = UUID().uuidString
+    tripStatusByTripID[tripID] = "NEW"
+    return tripID
+  }
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+import Foundation
+import XCTest
+
+@testable import ConsumerSampleApp
+
+class AuthTokenProviderTests: XCTestCase {
+
+  func testConcurrentFetchesShareOneRequestPerTrip() {
+    let requestCountsLock = NSLock()
+    var requestCounts: [String: Int] = [:]
+    MockURLProtocol.requestHandler = { request in
+      let tripID = request.url!.lastPathComponent
+      requestCountsLock.lock()
+      requestCounts[tripID, default: 0] += 1
+      requestCountsLock.unlock()
+
+      let expiration = Date().timeIntervalSince1970 + 3600
+      let data = try JSONSerialization.data(withJSONObject: [
+        "jwt": "\(tripID)-token", "expirationTimestamp": Int(expiration * 1000),
+      ])
+      let response = HTTPURLResponse(
+        url: request.url!, statusCode: 200, httpVersion: nil, headerFields: nil)!
+      return (response, data)
+    }
+    let configuration = URLSessionConfiguration.ephemeral
+    configuration.protocolClasses = [MockURLProtocol.self]
+    let authTokenProvider = AuthTokenProvider(
+      session: URLSession(configuration: configuration), tokenCacheFileURL: nil)
+    let tripIDs = ["test-trip1", "test-trip2"]
+    let fetchCount = 200
+
+    let fetched = expectation(description: "All tokens fetched")
+    fetched.expectedFulfillmentCount = fetchCount
+    DispatchQueue.concurrentPerform(iterations: fetchCount) { index in
+      let tripID = tripIDs[index % tripIDs.count]
+      authTokenProvider.fetchToken(tripID: tripID) { token, _ in
+        XCTAssertEqual(token, "\(tripID)-token")
+        fetched.fulfill()
+      }
+    }
+    wait(for: [fetched], timeout: 5)
+
+    XCTAssertEqual(requestCounts, ["test-trip1": 1, "test-trip2": 1])
+  }
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+import Foundation
+import GoogleRidesharingConsumer
+import XCTest
+
+@testable import ConsumerSampleApp
+
+/// Runs many simulated consumers against a stub provider, to catch regressions in the throughput,
+/// latency and resource use of the provider client. See `ProviderLoadGenerator` for how to change
+/// the scale of the run.
+class ProviderLoadTests: XCTestCase {
+  private static let location = GMTSTerminalLocation(
+    point: ProviderTestConstants.latlng, label: nil, description: nil, placeID: nil,
+    generatedID: nil, accessPointID: nil)
+
+  private var urlSession: URLSession!
+
+  override func setUp() {
+    let configuration = URLSessionConfiguration.ephemeral
+    configuration.protocolClasses = [MockURLProtocol.self]
+    urlSession = URLSession(configuration: configuration)
+  }
+
+  override func tearDown() {
+    MockURLProtocol.responseDelayHandler = nil
+  }
+
+  func testConsumersBookAndCancelTrips() async {
+    let generator = ProviderLoadGenerator()
+    let stubProvider = StubProvider(responseDelay: generator.configuration.responseDelay)
+    stubProvider.install()
+
+    let report = await runConsumers(generator)
+    print("Consumer load (\(generator.configuration.clientCount) consumers):\n\(report)")
+    add(XCTAttachment(string: report.description))
+
+    XCTAssertEqual(report.failureCount, 0)
+    XCTAssertEqual(
+      stubProvider.tripStatuses.count,
+      generator.configuration.clientCount * generator.configuration.iterationCount)
+    XCTAssertEqual(
+      stubProvider.tripStatuses.values.filter { $0 != RPCConstants.tripStatusCanceled }, [])
+  }
+
+  func testConsumerFlowPerformance() {
+    let configuration = ProviderLoadGenerator.Configuration(clientCount: 20, responseDelay: 0)
+    measure(metrics: [XCTClockMetric(), XCTCPUMetric(), XCTMemoryMetric()]) {
+      StubProvider().install()
+      let finished = expectation(description: "All consumers finished")
+      Task {
+        let report = await runConsumers(ProviderLoadGenerator(configuration: configuration))
+        XCTAssertEqual(report.failureCount, 0)
+        finished.fulfill()
+      }
+      wait(for: [finished], timeout: 60)
+    }
+  }
+
+  /// Runs the whole consumer flow for every client of the generator: booking a trip, fetching a
+  /// token to follow it and cancelling it.
+  private func runConsumers(_ generator: ProviderLoadGenerator) async
+    -> ProviderLoadGenerator.Report
+  {
+    let urlSession = self.urlSession!
+    let metrics = ProviderMetrics()
+    let tripTracer = TripTracer(source: "consumer", fileURL: nil)
+    return await generator.run { _, recorder in
+      // Every consumer has its own service, as it would on its own device.
+      let providerService = ProviderService(
+        session: urlSession, metrics: metrics, tripTracer: tripTracer)
+      let authTokenProvider = AuthTokenProvider(
+        session: urlSession, tokenCacheFileURL: nil, metrics: metrics)
+
+      let tripName = try await recorder.measure("createTrip") {
+        try await providerService.createTrip(
+          pickupLocation: Self.location, dropoffLocation: Self.location,
+          intermediateDestinations: [])
+      }
+      let tripID = tripName.components(separatedBy: "/").last ?? tripName
+      // Following a trip makes the Consumer SDK fetch a token for it.
+      try await recorder.measure("fetchToken") {
+        try await withCheckedThrowingContinuation {
+          (continuation: CheckedContinuation<Void, Error>) in
+          authTokenProvider.fetchToken(tripID: tripID) { _, error in
+            if let error = error {
+              continuation.resume(throwing: error)
+            } else {
+              continuation.resume()
+            }
+          }
+        }
+      }
+      try await recorder.measure("cancelTrip") {
+        try await providerService.cancelTrip(tripID: tripID)
+      }
+    }
+  }
+}
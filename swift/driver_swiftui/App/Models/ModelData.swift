@@ -57,7 +57,7 @@ final class ModelData: ObservableObject {
   @Published var nextTripID: String?
 
   /// Waypoints of the current trip.
-  @Published var waypoints: [GMTSTripWaypoint]?
+  @Published var waypoints = WaypointStore()
 
   /// The current driver state.
   @Published var driverState: DriverState = .idle
@@ -0,0 +1,188 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import Foundation
+import GoogleRidesharingDriver
+
+/// How the waypoints of a route changed between two updates.
+///
+/// A waypoint that is in both lists is unchanged if it keeps its order relative to the other
+/// unchanged waypoints, and reordered otherwise. The unchanged waypoints are the longest run of
+/// waypoints that kept their relative order, so that a waypoint inserted or removed early in the
+/// route doesn't count every later waypoint as reordered.
+struct WaypointDiff: Equatable {
+  /// The indices in the new list of the waypoints that were inserted.
+  var insertedIndices: [Int] = []
+
+  /// The indices in the old list of the waypoints that were removed.
+  var removedIndices: [Int] = []
+
+  /// The indices in the new list of the waypoints that moved relative to the others.
+  var reorderedIndices: [Int] = []
+
+  /// The number of waypoints that kept their place in the route.
+  var unchangedCount = 0
+
+  /// Whether the first waypoint, which the route leads to, changed. The route only needs to be
+  /// planned again when it did.
+  var isHeadChanged = false
+
+  /// Whether the lists have the same waypoints in the same order.
+  var isEmpty: Bool {
+    insertedIndices.isEmpty && removedIndices.isEmpty && reorderedIndices.isEmpty
+  }
+
+  /// Returns the difference between two lists of waypoints. Takes O(n log n) time.
+  static func between(_ oldWaypoints: [GMTSTripWaypoint], _ newWaypoints: [GMTSTripWaypoint])
+    -> WaypointDiff
+  {
+    var diff = WaypointDiff()
+    diff.isHeadChanged =
+      oldWaypoints.first.map(WaypointKey.init) != newWaypoints.first.map(WaypointKey.init)
+
+    // Match each new waypoint with the first unmatched old waypoint that is equal to it.
+    var oldIndicesByKey: [WaypointKey: ArraySlice<Int>] = [:]
+    oldIndicesByKey.reserveCapacity(oldWaypoints.count)
+    for (index, waypoint) in oldWaypoints.enumerated() {
+      oldIndicesByKey[WaypointKey(waypoint), default: []].append(index)
+    }
+    var matchedOldIndices: [Int] = []
+    var matchedNewIndices: [Int] = []
+    var isOldIndexMatched = [Bool](repeating: false, count: oldWaypoints.count)
+    for (newIndex, waypoint) in newWaypoints.enumerated() {
+      let key = WaypointKey(waypoint)
+      guard let oldIndex = oldIndicesByKey[key]?.popFirst() else {
+        diff.insertedIndices.append(newIndex)
+        continue
+      }
+      isOldIndexMatched[oldIndex] = true
+      matchedOldIndices.append(oldIndex)
+      matchedNewIndices.append(newIndex)
+    }
+    diff.removedIndices = isOldIndexMatched.indices.filter { !isOldIndexMatched[$0] }
+
+    let isUnchanged = longestIncreasingSubsequence(of: matchedOldIndices)
+    diff.unchangedCount = isUnchanged.lazy.filter { $0 }.count
+    diff.reorderedIndices = matchedNewIndices.indices.compactMap {
+      isUnchanged[$0] ? nil : matchedNewIndices[$0]
+    }
+    return diff
+  }
+
+  /// Returns which elements of `values` are part of a longest strictly increasing subsequence,
+  /// found by patience sorting.
+  private static func longestIncreasingSubsequence(of values: [Int]) -> [Bool] {
+    // The index of the element that ends the smallest-tailed increasing subsequence of each length.
+    var tailIndices: [Int] = []
+    var predecessors = [Int](repeating: -1, count: values.count)
+    for (index, value) in values.enumerated() {
+      var low = 0
+      var high = tailIndices.count
+      while low < high {
+        let middle = (low + high) / 2
+        if values[tailIndices[middle]] < value {
+          low = middle + 1
+        } else {
+          high = middle
+        }
+      }
+      if low > 0 {
+        predecessors[index] = tailIndices[low - 1]
+      }
+      if low == tailIndices.count {
+        tailIndices.append(index)
+      } else {
+        tailIndices[low] = index
+      }
+    }
+
+    var isInSubsequence = [Bool](repeating: false, count: values.count)
+    var index = tailIndices.last ?? -1
+    while index >= 0 {
+      isInSubsequence[index] = true
+      index = predecessors[index]
+    }
+    return isInSubsequence
+  }
+}
+
+/// The waypoints of a route, indexed by trip.
+///
+/// Updating the store with each new list of waypoints returns how the route changed, and the next
+/// waypoint of a trip is looked up in constant time.
+struct WaypointStore {
+
+  /// The waypoints of the route, in the order they are visited.
+  private(set) var waypoints: ArraySlice<GMTSTripWaypoint> = []
+
+  /// The remaining waypoints of each trip, in the order they are visited.
+  private var waypointsByTripID: [String: ArraySlice<GMTSTripWaypoint>] = [:]
+
+  /// The first waypoint of the route, which is the current destination.
+  var first: GMTSTripWaypoint? { waypoints.first }
+
+  var isEmpty: Bool { waypoints.isEmpty }
+
+  /// Replaces the waypoints of the route, and returns how they changed.
+  @discardableResult
+  mutating func update(_ newWaypoints: [GMTSTripWaypoint]) -> WaypointDiff {
+    let diff = WaypointDiff.between(Array(waypoints), newWaypoints)
+    waypoints = newWaypoints[...]
+    waypointsByTripID = [:]
+    for waypoint in newWaypoints {
+      if let tripID = waypoint.tripID as String? {
+        waypointsByTripID[tripID, default: []].append(waypoint)
+      }
+    }
+    return diff
+  }
+
+  /// Removes the first waypoint of the route once it is reached.
+  @discardableResult
+  mutating func removeFirst() -> GMTSTripWaypoint? {
+    guard let waypoint = waypoints.popFirst() else { return nil }
+    if let tripID = waypoint.tripID as String? {
+      // The first waypoint of the route is the current waypoint of its trip.
+      waypointsByTripID[tripID]?.removeFirst()
+      if waypointsByTripID[tripID]?.isEmpty == true {
+        waypointsByTripID[tripID] = nil
+      }
+    }
+    return waypoint
+  }
+
+  /// Returns the waypoint of a trip that follows its current one, or `nil` if it has none.
+  func nextWaypoint(forTripID tripID: String) -> GMTSTripWaypoint? {
+    guard let tripWaypoints = waypointsByTripID[tripID], tripWaypoints.count > 1 else {
+      return nil
+    }
+    return tripWaypoints[tripWaypoints.startIndex + 1]
+  }
+}
+
+/// The fields that identify a waypoint within a route.
+private struct WaypointKey: Hashable {
+  let tripID: String?
+  let waypointType: Int
+  let latitude: Double?
+  let longitude: Double?
+
+  init(_ waypoint: GMTSTripWaypoint) {
+    tripID = waypoint.tripID
+    waypointType = waypoint.waypointType.rawValue
+    let coordinate = waypoint.location?.point?.coordinate()
+    latitude = coordinate?.latitude
+    longitude = coordinate?.longitude
+  }
+}
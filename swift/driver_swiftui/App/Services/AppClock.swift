@@ -0,0 +1,218 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+import Foundation
+
+/// A timer scheduled on an `AppClock`.
+protocol AppClockTimer: AnyObject {
+  /// Stops the timer from firing again.
+  func invalidate()
+}
+
+/// The source of the current time and of timers for trip flows and token caches.
+///
+/// The app uses `SystemClock.shared`. Tests can use a `VirtualClock` instead, whose time only moves
+/// when it is advanced, so that hours of polling, retries and token lifetimes pass in milliseconds.
+protocol AppClock: AnyObject {
+  /// The current time, in seconds since 1970.
+  var now: TimeInterval { get }
+
+  /// Calls `action` on the main queue once `interval` has passed, and then every `interval` if
+  /// `repeats` is true, until the returned timer is invalidated.
+  @discardableResult
+  func scheduleTimer(
+    interval: TimeInterval, repeats: Bool, action: @escaping () -> Void
+  ) -> AppClockTimer
+
+  /// Suspends the calling task until `interval` has passed. Throws `CancellationError` if the task
+  /// is cancelled first.
+  func sleep(for interval: TimeInterval) async throws
+}
+
+/// The wall clock.
+final class SystemClock: AppClock {
+  private final class Timer: AppClockTimer {
+    let source: DispatchSourceTimer
+
+    init(source: DispatchSourceTimer) {
+      self.source = source
+    }
+
+    func invalidate() {
+      source.cancel()
+    }
+  }
+
+  static let shared = SystemClock()
+
+  var now: TimeInterval { Date().timeIntervalSince1970 }
+
+  @discardableResult
+  func scheduleTimer(
+    interval: TimeInterval, repeats: Bool, action: @escaping () -> Void
+  ) -> AppClockTimer {
+    let source = DispatchSource.makeTimerSource(queue: .main)
+    let interval = max(interval, 0)
+    let repeating: DispatchTimeInterval = repeats ? .milliseconds(Int(interval * 1000)) : .never
+    source.schedule(deadline: .now() + interval, repeating: repeating)
+    // The handler keeps the source alive until it is cancelled, as a run loop does for a Timer.
+    source.setEventHandler {
+      action()
+      if !repeats {
+        source.cancel()
+      }
+    }
+    source.resume()
+    return Timer(source: source)
+  }
+
+  func sleep(for interval: TimeInterval) async throws {
+    try await Task.sleep(nanoseconds: UInt64(max(interval, 0) * 1e9))
+  }
+}
+
+/// A clock whose time only moves when it is advanced, for tests.
+///
+/// Advancing the clock fires the timers that come due, in order, on the calling thread, with `now`
+/// set to the time each one was due. Tasks sleeping on the clock are resumed at the same point, but
+/// continue on their own executors, so a test should yield before checking their effects.
+final class VirtualClock: AppClock {
+  private final class Timer: AppClockTimer {
+    let interval: TimeInterval
+    let repeats: Bool
+    let action: () -> Void
+    weak var clock: VirtualClock?
+    var fireTime: TimeInterval
+    var isValid = true
+
+    init(
+      fireTime: TimeInterval, interval: TimeInterval, repeats: Bool, action: @escaping () -> Void
+    ) {
+      self.fireTime = fireTime
+      self.interval = interval
+      self.repeats = repeats
+      self.action = action
+    }
+
+    func invalidate() {
+      clock?.invalidate(self)
+    }
+  }
+
+  private let lock = NSLock()
+  private var _now: TimeInterval
+  private var timers: [Timer] = []
+
+  /// Creates a clock that starts at the given time, in seconds since 1970.
+  init(now: TimeInterval = Date().timeIntervalSince1970) {
+    _now = now
+  }
+
+  var now: TimeInterval {
+    lock.lock()
+    defer { lock.unlock() }
+    return _now
+  }
+
+  /// The number of timers and sleeping tasks that are waiting for the clock.
+  var pendingTimerCount: Int {
+    lock.lock()
+    defer { lock.unlock() }
+    return timers.filter { $0.isValid }.count
+  }
+
+  @discardableResult
+  func scheduleTimer(
+    interval: TimeInterval, repeats: Bool, action: @escaping () -> Void
+  ) -> AppClockTimer {
+    lock.lock()
+    defer { lock.unlock() }
+    // A repeating timer with no interval would fire forever without time passing.
+    let interval = repeats ? max(interval, 0.001) : max(interval, 0)
+    let timer = Timer(
+      fireTime: _now + interval, interval: interval, repeats: repeats, action: action)
+    timer.clock = self
+    timers.append(timer)
+    return timer
+  }
+
+  func sleep(for interval: TimeInterval) async throws {
+    let timerLock = NSLock()
+    var timer: AppClockTimer?
+    var continuation: CheckedContinuation<Void, Swift.Error>?
+    var isCancelled = false
+
+    try await withTaskCancellationHandler {
+      try await withCheckedThrowingContinuation {
+        (newContinuation: CheckedContinuation<Void, Swift.Error>) in
+        timerLock.lock()
+        defer { timerLock.unlock() }
+        guard !isCancelled else {
+          newContinuation.resume(throwing: CancellationError())
+          return
+        }
+        continuation = newContinuation
+        timer = scheduleTimer(interval: interval, repeats: false) {
+          timerLock.lock()
+          let resumedContinuation = continuation
+          continuation = nil
+          timerLock.unlock()
+          resumedContinuation?.resume()
+        }
+      }
+    } onCancel: {
+      timerLock.lock()
+      isCancelled = true
+      timer?.invalidate()
+      let cancelledContinuation = continuation
+      continuation = nil
+      timerLock.unlock()
+      cancelledContinuation?.resume(throwing: CancellationError())
+    }
+  }
+
+  /// Moves the clock forward by `interval`, firing the timers that come due on the way.
+  func advance(by interval: TimeInterval) {
+    lock.lock()
+    let endTime = _now + max(interval, 0)
+    while let timer = nextDueTimer(before: endTime) {
+      _now = max(_now, timer.fireTime)
+      if timer.repeats {
+        timer.fireTime += timer.interval
+      } else {
+        timer.isValid = false
+      }
+      // Timers may read the clock or schedule other timers, so they are fired without the lock.
+      lock.unlock()
+      timer.action()
+      lock.lock()
+    }
+    timers.removeAll { !$0.isValid }
+    _now = endTime
+    lock.unlock()
+  }
+
+  private func invalidate(_ timer: Timer) {
+    lock.lock()
+    defer { lock.unlock() }
+    timer.isValid = false
+  }
+
+  /// Returns the valid timer that is due first, at or before `endTime`. Must be called with the
+  /// lock held.
+  private func nextDueTimer(before endTime: TimeInterval) -> Timer? {
+    timers.filter { $0.isValid && $0.fireTime <= endTime }.min { $0.fireTime < $1.fireTime }
+  }
+}
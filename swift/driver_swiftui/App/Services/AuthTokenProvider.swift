@@ -18,24 +18,36 @@ import GoogleRidesharingDriver
 
 /// Provides auth tokens to the Driver SDK to communicate with Fleet Engine.
 class AuthTokenProvider: NSObject, GMTDAuthorization {
-  private struct AuthToken {
-    let token: String
-    let expiration: TimeInterval
-    let vehicleID: String
-  }
-
   private enum Error: Swift.Error {
     case missingAuthorizationContext
     case missingData
     case missingURL
   }
 
-  private static let tokenPath = "token/driver/"
   private static let tokenKey = "jwt"
   private static let tokenExpirationKey = "expirationTimestamp"
 
-  /// Cached token.
-  private var authToken: AuthToken?
+  /// The file that tokens are persisted to between launches.
+  static let defaultTokenCacheFileURL = FileManager.default.urls(
+    for: .cachesDirectory, in: .userDomainMask
+  ).first?.appendingPathComponent("AuthTokens.plist")
+
+  /// Cached tokens, keyed by vehicle ID.
+  private let tokenCache: AuthTokenCache
+
+  init(
+    session: URLSession = .shared, tokenCacheFileURL: URL? = defaultTokenCacheFileURL,
+    refreshAheadFraction: Double = AuthTokenCache.defaultRefreshAheadFraction,
+    metrics: ProviderMetrics = .shared, clock: AppClock = SystemClock.shared
+  ) {
+    tokenCache = AuthTokenCache(
+      fileURL: tokenCacheFileURL, refreshAheadFraction: refreshAheadFraction, clock: clock
+    ) { vehicleID, completion in
+      AuthTokenProvider.fetchToken(
+        vehicleID: vehicleID, session: session, metrics: metrics, completion: completion)
+    }
+    super.init()
+  }
 
   func fetchToken(
     with authorizationContext: GMTDAuthorizationContext?,
@@ -45,43 +57,64 @@ class AuthTokenProvider: NSObject, GMTDAuthorization {
       completion(nil, Error.missingAuthorizationContext)
       return
     }
-    let vehicleID = authorizationContext.vehicleID
 
-    // Check if a token is cached and is valid.
-    if let authToken = authToken,
-      authToken.expiration > Date().timeIntervalSince1970 && authToken.vehicleID == vehicleID
-    {
-      completion(authToken.token, nil)
-      return
+    fetchToken(vehicleID: authorizationContext.vehicleID, completion: completion)
+  }
+
+  /// Returns a token for a vehicle, waiting for one to be fetched if none is cached.
+  func fetchToken(vehicleID: String, completion: @escaping GMTDAuthTokenFetchCompletionHandler) {
+    tokenCache.token(forKey: vehicleID) { result in
+      switch result {
+      case .success(let token):
+        completion(token, nil)
+      case .failure(let error):
+        completion(nil, error)
+      }
     }
+  }
 
-    let tokenURL = ProviderUtils.providerURL(path: Self.tokenPath)
-    guard let tokenURLWithVehicleID = URL(string: vehicleID, relativeTo: tokenURL) else {
-      completion(nil, Error.missingURL)
+  /// Fetches a new token for a vehicle from the provider.
+  private static func fetchToken(
+    vehicleID: String, session: URLSession, metrics: ProviderMetrics,
+    completion: @escaping (Result<AuthTokenCache.Token, Swift.Error>) -> Void
+  ) {
+    var timer = metrics.startTimer(for: #function)
+    guard
+      let tokenURLWithVehicleID = ProviderRoutes.driverToken(
+        vehicleID: vehicleID, relativeTo: ProviderUtils.providerBaseURL)
+    else {
+      completion(.failure(Error.missingURL))
       return
     }
 
+    let endpointSet = ProviderEndpointSet.shared
     let request = URLRequest(url: tokenURLWithVehicleID)
-    let task = URLSession.shared.dataTask(with: request) { [weak self] data, _, error in
-      guard let strongSelf = self else { return }
-      guard error == nil else {
-        completion(nil, error)
+    let routedRequest = endpointSet.route(request)
+    timer.endPhase(.build)
+    metrics.recordAttempt(request, isRetry: false, for: timer.call)
+    let task = session.dataTask(with: routedRequest.request) { [timer] data, response, error in
+      var timer = timer
+      endpointSet.finish(routedRequest, response: response, error: error)
+      metrics.recordResponse(response, data: data, error: error, to: request, for: timer.call)
+      timer.endPhase(.network)
+      if let error = error {
+        completion(.failure(error))
         return
       }
       guard let data = data,
         let fetchData = try? JSONSerialization.jsonObject(with: data) as? [String: Any],
-        let token = fetchData[Self.tokenKey] as? String,
-        let expirationInMilliseconds = fetchData[Self.tokenExpirationKey] as? Int
+        let token = fetchData[tokenKey] as? String,
+        let expirationInMilliseconds = fetchData[tokenExpirationKey] as? Int
       else {
-        completion(nil, Error.missingData)
+        completion(.failure(Error.missingData))
         return
       }
+      timer.endPhase(.decode)
 
-      strongSelf.authToken = AuthToken(
-        token: token,
-        expiration: Double(expirationInMilliseconds) / 1000.0,
-        vehicleID: vehicleID)
-      completion(token, nil)
+      completion(
+        .success(
+          AuthTokenCache.Token(
+            token: token, expiration: Double(expirationInMilliseconds) / 1000.0)))
     }
     task.resume()
   }
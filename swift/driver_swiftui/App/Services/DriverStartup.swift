@@ -0,0 +1,292 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import Foundation
+import os
+
+/// Brings the driver's vehicle online at launch, reusing the vehicle of the previous launch.
+///
+/// The vehicle that a launch creates is persisted, and later launches resume it with a vehicle
+/// fetch instead of creating another one. Resuming or creating the vehicle, and fetching its first
+/// driver token, start as soon as the app launches and run while the terms and conditions dialog is
+/// shown, so that by the time the driver accepts the terms the vehicle and token are usually ready.
+///
+/// Each stage of startup is timed from the launch, and the breakdown is logged once the vehicle is
+/// online, along with whether the launch created a vehicle (cold) or resumed one (warm).
+final class DriverStartup {
+
+  /// A stage of startup, which is timed separately.
+  enum Stage: String, CaseIterable {
+    /// Showing the terms and conditions dialog until the driver accepts it.
+    case terms
+
+    /// Resuming the vehicle of the previous launch, or creating a new one.
+    case vehicle
+
+    /// Fetching the first driver token for the vehicle.
+    case token
+
+    /// Creating the driver context and vehicle reporter for the vehicle.
+    case driverContext
+
+    /// Reporting the vehicle online, until Fleet Engine acknowledges it.
+    case online
+  }
+
+  /// Whether a launch resumed the vehicle of a previous launch.
+  enum Launch: String {
+    /// The launch created a new vehicle.
+    case cold
+
+    /// The launch resumed the vehicle of a previous launch.
+    case warm
+  }
+
+  /// The vehicle that the driver works in, which later launches resume.
+  struct VehicleSession: Codable, Equatable {
+    let vehicleID: String
+    let isBackToBackEnabled: Bool
+  }
+
+  /// A vehicle that is ready for the driver.
+  struct Vehicle {
+    let session: VehicleSession
+    let launch: Launch
+
+    /// The trips matched with a resumed vehicle, which are empty for a new vehicle.
+    let matchedTripIDs: [String]
+  }
+
+  /// When a stage started and ended, in seconds since the launch.
+  struct StageTiming: Equatable {
+    let start: TimeInterval
+    let end: TimeInterval
+
+    var duration: TimeInterval { end - start }
+  }
+
+  /// Returns the trips matched with an existing vehicle. Throws
+  /// `ProviderService.Error.vehicleNotFound` if the provider no longer has the vehicle.
+  typealias VehicleFetcher = (_ vehicleID: String) async throws -> [String]
+
+  /// Creates a vehicle, and returns the ID the provider created it under.
+  typealias VehicleCreator = (_ vehicleID: String, _ isBackToBackEnabled: Bool) async throws
+    -> String
+
+  /// Fetches a driver token for a vehicle, so that it is cached by the time the driver context asks
+  /// for one.
+  typealias TokenFetcher = (_ vehicleID: String) async throws -> Void
+
+  static let defaultFileURL = FileManager.default.urls(
+    for: .applicationSupportDirectory, in: .userDomainMask
+  ).first?.appendingPathComponent("VehicleSession.plist")
+
+  private static let log = Logger(subsystem: "com.google.DriverSampleApp", category: "Startup")
+
+  /// The file that the vehicle session is persisted to, or `nil` to create a vehicle on every
+  /// launch.
+  let fileURL: URL?
+
+  /// The clock that stages are timed on.
+  let clock: AppClock
+
+  /// When the launch started, in seconds since 1970.
+  let launchTime: TimeInterval
+
+  private let fetchVehicle: VehicleFetcher
+  private let createVehicle: VehicleCreator
+  private let fetchToken: TokenFetcher
+
+  private let lock = NSLock()
+  private var vehicleTask: Task<Vehicle, Swift.Error>?
+  private var stageStartTimes: [Stage: TimeInterval] = [:]
+  private var _timings: [Stage: StageTiming] = [:]
+  private var _launch: Launch?
+
+  /// Creates a startup that begins timing its stages now.
+  init(
+    fileURL: URL? = nil, clock: AppClock = SystemClock.shared,
+    fetchVehicle: @escaping VehicleFetcher, createVehicle: @escaping VehicleCreator,
+    fetchToken: @escaping TokenFetcher
+  ) {
+    self.fileURL = fileURL
+    self.clock = clock
+    self.fetchVehicle = fetchVehicle
+    self.createVehicle = createVehicle
+    self.fetchToken = fetchToken
+    launchTime = clock.now
+  }
+
+  /// Creates a startup that resumes and creates vehicles with the given provider service, and
+  /// caches the first token in the given token provider.
+  convenience init(
+    providerService: ProviderService, authTokenProvider: AuthTokenProvider,
+    fileURL: URL? = defaultFileURL, clock: AppClock = SystemClock.shared
+  ) {
+    self.init(
+      fileURL: fileURL, clock: clock,
+      fetchVehicle: { vehicleID in try await providerService.getVehicle(vehicleID: vehicleID) },
+      createVehicle: { vehicleID, isBackToBackEnabled in
+        try await providerService.createVehicle(
+          vehicleID: vehicleID, isBackToBackEnabled: isBackToBackEnabled)
+      },
+      fetchToken: { vehicleID in
+        try await withCheckedThrowingContinuation { continuation in
+          authTokenProvider.fetchToken(vehicleID: vehicleID) { _, error in
+            if let error = error {
+              continuation.resume(throwing: error)
+            } else {
+              continuation.resume()
+            }
+          }
+        }
+      })
+  }
+
+  /// Whether this launch resumed a vehicle, or `nil` until the vehicle is ready.
+  var launch: Launch? {
+    lock.lock()
+    defer { lock.unlock() }
+    return _launch
+  }
+
+  /// The timings of the stages that have ended.
+  var timings: [Stage: StageTiming] {
+    lock.lock()
+    defer { lock.unlock() }
+    return _timings
+  }
+
+  /// Starts resuming or creating the vehicle, and fetching its first token, unless that is already
+  /// under way or done. Call this as early in the launch as possible.
+  func prepareVehicle() {
+    lock.lock()
+    defer { lock.unlock() }
+    guard vehicleTask == nil else { return }
+    vehicleTask = Task { try await self.resumeOrCreateVehicle() }
+  }
+
+  /// Returns the vehicle once it is ready, preparing it if it isn't being prepared. If preparing
+  /// the vehicle fails, the next call starts over.
+  func vehicle() async throws -> Vehicle {
+    prepareVehicle()
+    lock.lock()
+    let task = vehicleTask!
+    lock.unlock()
+    do {
+      return try await task.value
+    } catch {
+      lock.lock()
+      if vehicleTask == task {
+        vehicleTask = nil
+      }
+      lock.unlock()
+      throw error
+    }
+  }
+
+  /// Records that a stage started. A stage that starts again is timed from its latest start.
+  func begin(_ stage: Stage) {
+    let now = clock.now - launchTime
+    lock.lock()
+    defer { lock.unlock() }
+    stageStartTimes[stage] = now
+  }
+
+  /// Records that a stage ended. Ending a stage that hasn't started has no effect. Once the vehicle
+  /// is online, the timings of all stages are logged.
+  func end(_ stage: Stage) {
+    let now = clock.now - launchTime
+    lock.lock()
+    guard let start = stageStartTimes.removeValue(forKey: stage) else {
+      lock.unlock()
+      return
+    }
+    _timings[stage] = StageTiming(start: start, end: now)
+    lock.unlock()
+    if stage == .online {
+      Self.log.info("\(self.report(), privacy: .public)")
+    }
+  }
+
+  /// Returns a table of when each stage that has ended started and how long it took.
+  func report() -> String {
+    let timings = self.timings
+    var report = "\(launch?.rawValue ?? "unknown") launch\n"
+    report += "stage            start   duration\n"
+    for stage in Stage.allCases {
+      guard let timing = timings[stage] else { continue }
+      report +=
+        stage.rawValue.padding(toLength: 13, withPad: " ", startingAt: 0)
+        + String(format: " %5.0f ms  %6.0f ms\n", timing.start * 1000, timing.duration * 1000)
+    }
+    return report
+  }
+
+  private func resumeOrCreateVehicle() async throws -> Vehicle {
+    begin(.vehicle)
+    if let session = loadSession() {
+      prefetchToken(vehicleID: session.vehicleID)
+      do {
+        let matchedTripIDs = try await fetchVehicle(session.vehicleID)
+        return finishVehicle(
+          Vehicle(session: session, launch: .warm, matchedTripIDs: matchedTripIDs))
+      } catch ProviderService.Error.vehicleNotFound {
+        // The provider no longer has the vehicle, so create another one. Any other error is
+        // thrown, so that a provider that fails to answer doesn't cost the driver their vehicle.
+      }
+    }
+
+    let vehicleID = try await createVehicle("iOS-\(UUID().uuidString)", true)
+    let session = VehicleSession(vehicleID: vehicleID, isBackToBackEnabled: true)
+    persistSession(session)
+    prefetchToken(vehicleID: vehicleID)
+    return finishVehicle(Vehicle(session: session, launch: .cold, matchedTripIDs: []))
+  }
+
+  private func finishVehicle(_ vehicle: Vehicle) -> Vehicle {
+    lock.lock()
+    _launch = vehicle.launch
+    lock.unlock()
+    end(.vehicle)
+    return vehicle
+  }
+
+  /// Fetches the first token of a vehicle in the background. A token that fails to be fetched is
+  /// fetched again when the driver context asks for it.
+  private func prefetchToken(vehicleID: String) {
+    begin(.token)
+    let fetchToken = self.fetchToken
+    Task {
+      guard (try? await fetchToken(vehicleID)) != nil else { return }
+      self.end(.token)
+    }
+  }
+
+  /// Returns the vehicle session persisted by a previous launch.
+  private func loadSession() -> VehicleSession? {
+    guard let fileURL = fileURL, let data = try? Data(contentsOf: fileURL) else { return nil }
+    return try? PropertyListDecoder().decode(VehicleSession.self, from: data)
+  }
+
+  private func persistSession(_ session: VehicleSession) {
+    guard let fileURL = fileURL else { return }
+    let encoder = PropertyListEncoder()
+    encoder.outputFormat = .binary
+    guard let data = try? encoder.encode(session) else { return }
+    try? FileManager.default.createDirectory(
+      at: fileURL.deletingLastPathComponent(), withIntermediateDirectories: true)
+    try? data.write(to: fileURL, options: .atomic)
+  }
+}
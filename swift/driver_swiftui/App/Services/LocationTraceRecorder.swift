@@ -0,0 +1,497 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import CoreLocation
+import Foundation
+import GoogleMaps
+
+/// Records the road-snapped locations of a driving session compactly, so that a shift can be
+/// audited or replayed.
+///
+/// Fixes are simplified as they arrive. A fix is dropped if the trace, rebuilt by interpolating
+/// between the kept fixes at each fix's time, stays within `tolerance` of it. This is the
+/// Douglas–Peucker test, applied to an opening window of the fixes since the last kept one. The
+/// window holds at most `maximumWindowCount` fixes, so each fix takes bounded time.
+///
+/// Kept fixes are quantized to milliseconds and millionths of a degree. Each one is stored as the
+/// zigzag varint deltas from the fix before it. The deltas go into fixed-size blocks, and each
+/// block starts from zero so that it can be decoded on its own. The blocks form a ring of
+/// `blockCount` blocks in fixed memory. When the ring is full, its sealed blocks are appended to
+/// `fileURL` in one write. Without a file, the oldest block is overwritten instead.
+///
+/// Once a write would take the file past `maximumFileSize`, the file is moved to `rotatedFileURL`,
+/// replacing the one rotated before, and a new file is started. The trace on disk is therefore
+/// bounded at about twice `maximumFileSize`, and always holds the most recent fixes.
+final class LocationTraceRecorder: NSObject {
+
+  /// A recorded location.
+  struct Fix: Equatable {
+    /// The time of the fix, in seconds since 1970.
+    var timestamp: TimeInterval
+    var latitude: CLLocationDegrees
+    var longitude: CLLocationDegrees
+  }
+
+  enum Error: Swift.Error {
+    /// The trace ends in the middle of a block or a fix.
+    case truncatedTrace
+  }
+
+  /// The file in the application support directory that the app's trace is appended to.
+  static let defaultFileURL = FileManager.default.urls(
+    for: .applicationSupportDirectory, in: .userDomainMask
+  ).first?.appendingPathComponent("LocationTrace.bin")
+
+  /// The file that full blocks are appended to, or `nil` to overwrite the oldest block instead.
+  let fileURL: URL?
+
+  /// The size, in bytes, past which the file is rotated.
+  let maximumFileSize: Int
+
+  /// The file that the previous part of the trace is moved to when the file is rotated. Its fixes
+  /// precede those of `fileURL`.
+  var rotatedFileURL: URL? { fileURL?.appendingPathExtension("1") }
+
+  /// How far, in meters, the rebuilt trace may stray from a dropped fix at the fix's time.
+  let tolerance: Double
+
+  /// The most fixes that are considered for dropping at once.
+  let maximumWindowCount: Int
+
+  /// The size of a block of encoded fixes, in bytes.
+  let blockSize: Int
+
+  /// The number of blocks kept in memory.
+  let blockCount: Int
+
+  private let lock = NSLock()
+  private var simplifier: Simplifier
+
+  /// The blocks of encoded fixes, `blockSize` bytes each.
+  private var ring: [UInt8]
+
+  /// The number of bytes used in each block.
+  private var blockLengths: [Int]
+
+  /// The oldest sealed block, which is followed by the other sealed blocks and then the open one.
+  private var oldestBlock = 0
+  private var sealedBlockCount = 0
+
+  /// The fix that the next fix in the open block is encoded relative to.
+  private var previousFix = QuantizedFix.zero
+
+  /// Reused to encode each fix.
+  private var encodedFix: [UInt8] = []
+
+  private var _recordedFixCount = 0
+  private var _keptFixCount = 0
+  private var _droppedBlockCount = 0
+
+  /// Serializes writes to the trace file.
+  private let fileQueue = DispatchQueue(label: "com.google.DriverSampleApp.LocationTraceRecorder")
+
+  /// The handle of the trace file, which is opened with the first spilled block. Only accessed on
+  /// `fileQueue`.
+  private var fileHandle: FileHandle?
+
+  /// The size of the trace file once `fileHandle` is open. Only accessed on `fileQueue`.
+  private var fileSize = 0
+
+  /// Creates a recorder that keeps `blockCount` blocks of `blockSize` bytes in memory, and appends
+  /// them to `fileURL` when they are full. The file is rotated once it would grow past
+  /// `maximumFileSize`.
+  init(
+    fileURL: URL? = nil, maximumFileSize: Int = 16 << 20, tolerance: Double = 2,
+    maximumWindowCount: Int = 64, blockSize: Int = 4096, blockCount: Int = 8
+  ) {
+    precondition(blockSize >= QuantizedFix.maximumEncodedSize && blockCount > 1)
+    self.fileURL = fileURL
+    self.maximumFileSize = maximumFileSize
+    self.tolerance = tolerance
+    self.maximumWindowCount = maximumWindowCount
+    self.blockSize = blockSize
+    self.blockCount = blockCount
+    simplifier = Simplifier(tolerance: tolerance, maximumWindowCount: maximumWindowCount)
+    ring = [UInt8](repeating: 0, count: blockSize * blockCount)
+    blockLengths = [Int](repeating: 0, count: blockCount)
+    encodedFix.reserveCapacity(QuantizedFix.maximumEncodedSize)
+  }
+
+  /// The number of fixes recorded.
+  var recordedFixCount: Int {
+    lock.lock()
+    defer { lock.unlock() }
+    return _recordedFixCount
+  }
+
+  /// The number of recorded fixes that were kept by the simplification.
+  var keptFixCount: Int {
+    lock.lock()
+    defer { lock.unlock() }
+    return _keptFixCount
+  }
+
+  /// The number of blocks overwritten because there was no file to spill them to.
+  var droppedBlockCount: Int {
+    lock.lock()
+    defer { lock.unlock() }
+    return _droppedBlockCount
+  }
+
+  /// Records a fix.
+  func record(_ fix: Fix) {
+    lock.lock()
+    defer { lock.unlock() }
+    _recordedFixCount += 1
+    if let keptFix = simplifier.add(fix) {
+      append(keptFix)
+    }
+  }
+
+  /// Keeps the last recorded fix, and appends the blocks in memory to the file. Called at the end
+  /// of a shift, or when the app may be suspended.
+  func flush() {
+    lock.lock()
+    defer { lock.unlock() }
+    if let pendingFix = simplifier.finish() {
+      append(pendingFix)
+    }
+    sealOpenBlock()
+    if fileURL != nil {
+      spillSealedBlocks()
+    }
+  }
+
+  /// Waits until the spilled blocks have been written to the file.
+  func waitUntilSpilled() {
+    fileQueue.sync {}
+  }
+
+  /// Returns the fixes that are still in memory, including the last recorded fix even if it may
+  /// still be dropped.
+  func bufferedFixes() -> [Fix] {
+    lock.lock()
+    defer { lock.unlock() }
+    var fixes: [Fix] = []
+    for offset in 0...sealedBlockCount {
+      let block = (oldestBlock + offset) % blockCount
+      let start = block * blockSize
+      // Blocks are only written by this recorder, so they are never truncated.
+      fixes += (try? Self.decodeBlock(ring[start..<(start + blockLengths[block])])) ?? []
+    }
+    if let pendingFix = simplifier.pendingFix {
+      fixes.append(pendingFix)
+    }
+    return fixes
+  }
+
+  /// Decodes the fixes of a trace file.
+  static func decodeFixes(from data: Data) throws -> [Fix] {
+    let bytes = [UInt8](data)
+    var reader = ByteReader(bytes: bytes[...])
+    var fixes: [Fix] = []
+    while !reader.isAtEnd {
+      let length = Int(try reader.readVarint())
+      guard length <= reader.remainingCount else { throw Error.truncatedTrace }
+      fixes += try decodeBlock(reader.read(count: length))
+    }
+    return fixes
+  }
+
+  // MARK: - Blocks
+
+  private var openBlock: Int {
+    (oldestBlock + sealedBlockCount) % blockCount
+  }
+
+  /// Appends a kept fix to the open block, sealing it first if the fix doesn't fit.
+  private func append(_ fix: Fix) {
+    _keptFixCount += 1
+    let quantizedFix = QuantizedFix(fix)
+    encodedFix.removeAll(keepingCapacity: true)
+    quantizedFix.encode(after: previousFix, into: &encodedFix)
+    if blockLengths[openBlock] + encodedFix.count > blockSize {
+      sealOpenBlock()
+      encodedFix.removeAll(keepingCapacity: true)
+      quantizedFix.encode(after: .zero, into: &encodedFix)
+    }
+    let block = openBlock
+    let start = block * blockSize + blockLengths[block]
+    ring.replaceSubrange(start..<(start + encodedFix.count), with: encodedFix)
+    blockLengths[block] += encodedFix.count
+    previousFix = quantizedFix
+  }
+
+  /// Seals the open block, if it has any fixes, and makes room for the next one.
+  private func sealOpenBlock() {
+    guard blockLengths[openBlock] > 0 else { return }
+    sealedBlockCount += 1
+    previousFix = .zero
+    guard sealedBlockCount == blockCount else { return }
+    if fileURL != nil {
+      spillSealedBlocks()
+    } else {
+      blockLengths[oldestBlock] = 0
+      oldestBlock = (oldestBlock + 1) % blockCount
+      sealedBlockCount -= 1
+      _droppedBlockCount += 1
+    }
+  }
+
+  /// Appends the sealed blocks to the file, each prefixed with its length, and frees them.
+  private func spillSealedBlocks() {
+    guard sealedBlockCount > 0 else { return }
+    var data = Data()
+    for offset in 0..<sealedBlockCount {
+      let block = (oldestBlock + offset) % blockCount
+      let start = block * blockSize
+      var length: [UInt8] = []
+      appendVarint(UInt64(blockLengths[block]), to: &length)
+      data.append(contentsOf: length)
+      data.append(contentsOf: ring[start..<(start + blockLengths[block])])
+      blockLengths[block] = 0
+    }
+    oldestBlock = (oldestBlock + sealedBlockCount) % blockCount
+    sealedBlockCount = 0
+    fileQueue.async {
+      self.rotateFileIfNeeded(appendingCount: data.count)
+      guard (try? self.openFileHandle()?.write(contentsOf: data)) != nil else { return }
+      self.fileSize += data.count
+    }
+  }
+
+  /// Moves the trace file to `rotatedFileURL` if appending `count` bytes would take it past
+  /// `maximumFileSize`, so that the next write starts a new file. Must be called on `fileQueue`.
+  private func rotateFileIfNeeded(appendingCount count: Int) {
+    guard let fileURL = fileURL, let rotatedFileURL = rotatedFileURL, openFileHandle() != nil,
+      fileSize > 0, fileSize + count > maximumFileSize
+    else {
+      return
+    }
+    try? fileHandle?.close()
+    fileHandle = nil
+    try? FileManager.default.removeItem(at: rotatedFileURL)
+    try? FileManager.default.moveItem(at: fileURL, to: rotatedFileURL)
+  }
+
+  /// Returns the handle of the trace file, opening it if needed. Must be called on `fileQueue`.
+  private func openFileHandle() -> FileHandle? {
+    if let fileHandle = fileHandle {
+      return fileHandle
+    }
+    guard let fileURL = fileURL else { return nil }
+    if !FileManager.default.fileExists(atPath: fileURL.path) {
+      FileManager.default.createFile(atPath: fileURL.path, contents: nil)
+    }
+    fileHandle = try? FileHandle(forWritingTo: fileURL)
+    fileSize = Int((try? fileHandle?.seekToEnd()) ?? 0)
+    return fileHandle
+  }
+
+  private static func decodeBlock(_ bytes: ArraySlice<UInt8>) throws -> [Fix] {
+    var reader = ByteReader(bytes: bytes)
+    var previousFix = QuantizedFix.zero
+    var fixes: [Fix] = []
+    while !reader.isAtEnd {
+      previousFix = try QuantizedFix(decodingAfter: previousFix, from: &reader)
+      fixes.append(previousFix.fix)
+    }
+    return fixes
+  }
+}
+
+extension LocationTraceRecorder: GMSRoadSnappedLocationProviderListener {
+  func locationProvider(
+    _ locationProvider: GMSRoadSnappedLocationProvider, didUpdate location: CLLocation
+  ) {
+    record(
+      Fix(
+        timestamp: location.timestamp.timeIntervalSince1970,
+        latitude: location.coordinate.latitude, longitude: location.coordinate.longitude))
+  }
+}
+
+// MARK: - Simplification
+
+/// Decides which fixes to keep, one fix at a time.
+private struct Simplifier {
+  let tolerance: Double
+  let maximumWindowCount: Int
+
+  /// The last kept fix.
+  private var anchor: LocationTraceRecorder.Fix?
+
+  /// The fixes since the anchor, none of which is kept yet.
+  private var window: [LocationTraceRecorder.Fix] = []
+
+  init(tolerance: Double, maximumWindowCount: Int) {
+    self.tolerance = tolerance
+    self.maximumWindowCount = max(maximumWindowCount, 1)
+    window.reserveCapacity(self.maximumWindowCount)
+  }
+
+  /// The last fix added, if it isn't kept yet.
+  var pendingFix: LocationTraceRecorder.Fix? { window.last }
+
+  /// Adds a fix, and returns the fix that it causes to be kept, if any.
+  ///
+  /// The fixes in the window can be dropped as long as the segment from the anchor to the new fix
+  /// passes within `tolerance` of each of them. Once it doesn't, the fix before the new one is kept
+  /// and becomes the anchor, since the segment to it passed the same test when it was added.
+  mutating func add(_ fix: LocationTraceRecorder.Fix) -> LocationTraceRecorder.Fix? {
+    guard let anchor = anchor else {
+      self.anchor = fix
+      return fix
+    }
+    let isWithinTolerance = window.allSatisfy {
+      Self.synchronizedDistance(of: $0, from: anchor, to: fix) <= tolerance
+    }
+    guard isWithinTolerance && window.count < maximumWindowCount else {
+      let keptFix = window[window.count - 1]
+      self.anchor = keptFix
+      window.removeAll(keepingCapacity: true)
+      window.append(fix)
+      return keptFix
+    }
+    window.append(fix)
+    return nil
+  }
+
+  /// Keeps the pending fix, if any, and returns it.
+  mutating func finish() -> LocationTraceRecorder.Fix? {
+    guard let pendingFix = window.last else { return nil }
+    anchor = pendingFix
+    window.removeAll(keepingCapacity: true)
+    return pendingFix
+  }
+
+  /// Returns the distance, in meters, between a fix and the point on a segment where the vehicle
+  /// would be at the fix's time, moving at a constant speed.
+  static func synchronizedDistance(
+    of fix: LocationTraceRecorder.Fix, from start: LocationTraceRecorder.Fix,
+    to end: LocationTraceRecorder.Fix
+  ) -> Double {
+    let duration = end.timestamp - start.timestamp
+    let fraction = duration > 0 ? min(max((fix.timestamp - start.timestamp) / duration, 0), 1) : 1
+    let latitude = start.latitude + (end.latitude - start.latitude) * fraction
+    let longitude = start.longitude + (end.longitude - start.longitude) * fraction
+    // Over the length of a window, an equirectangular projection is accurate to well under a
+    // millimeter.
+    let metersPerDegree = 111_319.49
+    let northing = (fix.latitude - latitude) * metersPerDegree
+    let easting =
+      (fix.longitude - longitude) * metersPerDegree * cos(start.latitude * .pi / 180)
+    return (northing * northing + easting * easting).squareRoot()
+  }
+}
+
+// MARK: - Encoding
+
+/// A fix in milliseconds and millionths of a degree.
+private struct QuantizedFix {
+  static let zero = QuantizedFix(time: 0, latitude: 0, longitude: 0)
+
+  /// The most bytes that a fix is encoded in: three 64-bit varints.
+  static let maximumEncodedSize = 30
+
+  let time: Int64
+  let latitude: Int64
+  let longitude: Int64
+
+  init(time: Int64, latitude: Int64, longitude: Int64) {
+    self.time = time
+    self.latitude = latitude
+    self.longitude = longitude
+  }
+
+  init(_ fix: LocationTraceRecorder.Fix) {
+    time = Int64((fix.timestamp * 1e3).rounded())
+    latitude = Int64((fix.latitude * 1e6).rounded())
+    longitude = Int64((fix.longitude * 1e6).rounded())
+  }
+
+  init(decodingAfter previousFix: QuantizedFix, from reader: inout ByteReader) throws {
+    time = previousFix.time &+ unzigzag(try reader.readVarint())
+    latitude = previousFix.latitude &+ unzigzag(try reader.readVarint())
+    longitude = previousFix.longitude &+ unzigzag(try reader.readVarint())
+  }
+
+  var fix: LocationTraceRecorder.Fix {
+    LocationTraceRecorder.Fix(
+      timestamp: Double(time) / 1e3, latitude: Double(latitude) / 1e6,
+      longitude: Double(longitude) / 1e6)
+  }
+
+  /// Appends the deltas from the previous fix.
+  func encode(after previousFix: QuantizedFix, into bytes: inout [UInt8]) {
+    appendVarint(zigzag(time &- previousFix.time), to: &bytes)
+    appendVarint(zigzag(latitude &- previousFix.latitude), to: &bytes)
+    appendVarint(zigzag(longitude &- previousFix.longitude), to: &bytes)
+  }
+}
+
+/// Reads varints from encoded fixes.
+private struct ByteReader {
+  let bytes: ArraySlice<UInt8>
+  private var index: Int
+
+  init(bytes: ArraySlice<UInt8>) {
+    self.bytes = bytes
+    index = bytes.startIndex
+  }
+
+  var isAtEnd: Bool { index == bytes.endIndex }
+
+  var remainingCount: Int { bytes.endIndex - index }
+
+  mutating func read(count: Int) -> ArraySlice<UInt8> {
+    defer { index += count }
+    return bytes[index..<(index + count)]
+  }
+
+  mutating func readVarint() throws -> UInt64 {
+    var value: UInt64 = 0
+    var shift: UInt64 = 0
+    while index < bytes.endIndex && shift < 64 {
+      let byte = bytes[index]
+      index += 1
+      value |= UInt64(byte & 0x7f) << shift
+      if byte & 0x80 == 0 {
+        return value
+      }
+      shift += 7
+    }
+    throw LocationTraceRecorder.Error.truncatedTrace
+  }
+}
+
+/// Maps signed values to unsigned ones, so that small negative deltas have short varints.
+private func zigzag(_ value: Int64) -> UInt64 {
+  UInt64(bitPattern: (value << 1) ^ (value >> 63))
+}
+
+private func unzigzag(_ value: UInt64) -> Int64 {
+  Int64(bitPattern: value >> 1) ^ -Int64(bitPattern: value & 1)
+}
+
+/// Appends a value seven bits at a time, least significant first, with the high bit of each byte
+/// set if more bytes follow.
+private func appendVarint(_ value: UInt64, to bytes: inout [UInt8]) {
+  var value = value
+  while value >= 0x80 {
+    bytes.append(UInt8(truncatingIfNeeded: value) | 0x80)
+    value >>= 7
+  }
+  bytes.append(UInt8(value))
+}
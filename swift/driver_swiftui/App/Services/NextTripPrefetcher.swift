@@ -0,0 +1,128 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import Foundation
+import GoogleRidesharingDriver
+
+/// Loads the next back-to-back trip of the vehicle while the current trip is in progress, so that
+/// the driver can start it as soon as the current trip completes.
+///
+/// Once a next trip is matched, its status and waypoints are fetched in the background. Callers
+/// append its waypoints to the current trip's remaining ones, so that the navigator's route already
+/// leads on to its pickup. When the current trip completes, `handOff(tripID:)` returns the loaded
+/// trip once the provider has confirmed that it is still current, and the app switches to it
+/// without waiting for a full fetch or a new route.
+final class NextTripPrefetcher {
+
+  /// A loaded trip.
+  struct Trip {
+    let tripID: String
+    let status: ProviderTripStatus
+    let waypoints: [GMTSTripWaypoint]
+  }
+
+  /// Fetches the status and waypoints of a trip.
+  typealias Loader = (_ tripID: String) async throws -> (ProviderTripStatus, [GMTSTripWaypoint])
+
+  /// Called on the main actor with each next trip once it is loaded.
+  var onLoad: ((Trip) -> Void)?
+
+  private let loader: Loader
+  private let lock = NSLock()
+
+  /// The ID of the trip being loaded or loaded, or `nil` if there is none.
+  private var tripID: String?
+  private var _trip: Trip?
+  private var loadTask: Task<Void, Never>?
+
+  init(loader: @escaping Loader) {
+    self.loader = loader
+  }
+
+  /// Creates a prefetcher that fetches trips with the given provider service.
+  convenience init(providerService: ProviderService) {
+    self.init { tripID in try await providerService.getTrip(tripID: tripID) }
+  }
+
+  /// The next trip, once it is loaded.
+  var trip: Trip? {
+    lock.lock()
+    defer { lock.unlock() }
+    return _trip
+  }
+
+  /// Starts loading a trip as the next one, unless it is already loaded or being loaded. Loading a
+  /// trip that failed to load starts over.
+  func prefetch(tripID: String) {
+    lock.lock()
+    defer { lock.unlock() }
+    guard tripID != self.tripID else { return }
+    loadTask?.cancel()
+    self.tripID = tripID
+    _trip = nil
+    let loader = self.loader
+    loadTask = Task { [weak self] in
+      let loadedTrip = try? await loader(tripID)
+      guard !Task.isCancelled, let self = self else { return }
+      let trip = loadedTrip.map { Trip(tripID: tripID, status: $0.0, waypoints: $0.1) }
+      guard self.finishLoading(trip, tripID: tripID), let trip = trip else { return }
+      await MainActor.run { self.onLoad?(trip) }
+    }
+  }
+
+  /// Returns the next trip as the current trip completes, if it is the loaded one, and forgets it.
+  /// Returns `nil` if the trip isn't loaded yet, in which case it has to be fetched as usual.
+  ///
+  /// The loaded trip is fetched again first, so that changes made to it since it was loaded are not
+  /// lost. The fetch is a conditional request, which the provider answers without resending the
+  /// trip if it hasn't changed. If the trip can't be fetched, the loaded trip is returned as it is.
+  func handOff(tripID: String) async -> Trip? {
+    lock.lock()
+    let loadedTrip = tripID == _trip?.tripID ? _trip : nil
+    reset()
+    lock.unlock()
+    guard let loadedTrip = loadedTrip else { return nil }
+    guard let (status, waypoints) = try? await loader(tripID) else { return loadedTrip }
+    return Trip(tripID: tripID, status: status, waypoints: waypoints)
+  }
+
+  /// Forgets the next trip, and stops loading it.
+  func cancel() {
+    lock.lock()
+    defer { lock.unlock() }
+    reset()
+  }
+
+  /// Stores a loaded trip, unless another trip was prefetched since. Returns whether it was stored.
+  private func finishLoading(_ trip: Trip?, tripID: String) -> Bool {
+    lock.lock()
+    defer { lock.unlock() }
+    guard tripID == self.tripID else { return false }
+    loadTask = nil
+    _trip = trip
+    if trip == nil {
+      // Let the next prefetch retry.
+      self.tripID = nil
+    }
+    return true
+  }
+
+  /// Must be called with the lock held.
+  private func reset() {
+    loadTask?.cancel()
+    loadTask = nil
+    tripID = nil
+    _trip = nil
+  }
+}
@@ -0,0 +1,235 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import Foundation
+
+/// A set of provider replicas that requests are spread across, preferring the replicas that are
+/// currently fastest and failing least.
+///
+/// URLs are built against `canonicalBaseURL`, the first replica, so that caches and request keys
+/// don't depend on which replica serves a request, and are routed to a replica when they are sent.
+/// A routed URL keeps its path relative to the canonical base URL, so replicas may serve the
+/// provider API under different base paths.
+///
+/// Each request goes to the cheaper of two replicas picked at random ("power of two choices"). A
+/// replica's cost is its exponentially weighted moving average (EWMA) latency, scaled up by the
+/// number of its requests in flight and by its EWMA error rate, so that load shifts away from a
+/// replica as soon as it slows down. A replica that fails `ejectionFailureCount` requests in a row
+/// is ejected for `ejectionInterval`, after which it is given traffic again. If every replica is
+/// ejected, requests are spread across all of them.
+///
+/// Long-polls, which are held open by the replica until it has something to report, say nothing
+/// about how fast it answers. They don't count towards a replica's latency or requests in flight,
+/// only towards its error rate.
+final class ProviderEndpointSet {
+
+  /// A request routed to a replica, which must be passed to `finish` once it completes.
+  struct RoutedRequest {
+    let request: URLRequest
+    /// Whether the request is a long-poll.
+    let isLongPoll: Bool
+    fileprivate let endpoint: Endpoint
+    fileprivate let startTime: TimeInterval
+  }
+
+  /// The state of one replica.
+  fileprivate final class Endpoint {
+    let baseURL: URL
+    var latency: TimeInterval?
+    var errorRate = 0.0
+    var inFlightCount = 0
+    var consecutiveFailureCount = 0
+    var ejectedUntil: TimeInterval = 0
+
+    init(baseURL: URL) {
+      self.baseURL = baseURL
+    }
+  }
+
+  /// The replicas used by provider services that aren't given an endpoint set.
+  static let shared = ProviderEndpointSet(
+    baseURLs: ProviderUtils.baseProviderURLStrings.compactMap { URL(string: $0) })
+
+  /// The weight of the most recent request in the EWMA latency and error rate.
+  let decay: Double
+
+  /// The number of consecutive failures after which a replica is ejected.
+  let ejectionFailureCount: Int
+
+  /// How long an ejected replica is left without traffic.
+  let ejectionInterval: TimeInterval
+
+  /// The base URL that provider URLs are built against.
+  var canonicalBaseURL: URL { endpoints[0].baseURL }
+
+  private let endpoints: [Endpoint]
+  private let lock = NSLock()
+
+  init(
+    baseURLs: [URL], decay: Double = 0.3, ejectionFailureCount: Int = 5,
+    ejectionInterval: TimeInterval = 30
+  ) {
+    precondition(!baseURLs.isEmpty, "An endpoint set needs at least one replica.")
+    self.endpoints = baseURLs.map { Endpoint(baseURL: $0) }
+    self.decay = decay
+    self.ejectionFailureCount = max(ejectionFailureCount, 1)
+    self.ejectionInterval = ejectionInterval
+  }
+
+  /// Returns the URL of a provider path, built against the canonical replica.
+  func url(path: String) -> URL {
+    URL(string: path, relativeTo: canonicalBaseURL)!
+  }
+
+  /// Returns whether a replica is currently ejected.
+  func isEjected(baseURL: URL) -> Bool {
+    let now = ProcessInfo.processInfo.systemUptime
+    lock.lock()
+    defer { lock.unlock() }
+    return endpoints.contains { $0.baseURL == baseURL && $0.ejectedUntil > now }
+  }
+
+  /// Returns the EWMA latency of a replica, or `nil` until it has answered a request.
+  func latency(baseURL: URL) -> TimeInterval? {
+    lock.lock()
+    defer { lock.unlock() }
+    return endpoints.first { $0.baseURL == baseURL }?.latency
+  }
+
+  /// Picks a replica for a request, and points the request at it.
+  func route(_ request: URLRequest, isLongPoll: Bool = false) -> RoutedRequest {
+    let now = ProcessInfo.processInfo.systemUptime
+    lock.lock()
+    let endpoint = selectEndpoint(now: now)
+    if !isLongPoll {
+      endpoint.inFlightCount += 1
+    }
+    lock.unlock()
+
+    var routedRequest = request
+    if let url = request.url,
+      var components = URLComponents(url: url, resolvingAgainstBaseURL: true)
+    {
+      components.scheme = endpoint.baseURL.scheme
+      components.host = endpoint.baseURL.host
+      components.port = endpoint.baseURL.port
+      components.percentEncodedPath = rebasedPath(components.percentEncodedPath, onto: endpoint)
+      routedRequest.url = components.url ?? url
+    }
+    return RoutedRequest(
+      request: routedRequest, isLongPoll: isLongPoll, endpoint: endpoint, startTime: now)
+  }
+
+  /// Moves a path from under the canonical base URL's path to under the base URL path of
+  /// `endpoint`. Paths outside the canonical base URL are returned unchanged.
+  private func rebasedPath(_ path: String, onto endpoint: Endpoint) -> String {
+    let canonicalPathPrefix = Self.pathPrefix(of: canonicalBaseURL)
+    guard path.hasPrefix(canonicalPathPrefix) else {
+      return path
+    }
+    return Self.pathPrefix(of: endpoint.baseURL) + path.dropFirst(canonicalPathPrefix.count)
+  }
+
+  /// Returns the percent-encoded path of a base URL, ending with a slash.
+  private static func pathPrefix(of baseURL: URL) -> String {
+    let path = URLComponents(url: baseURL, resolvingAgainstBaseURL: true)?.percentEncodedPath ?? ""
+    return path.hasSuffix("/") ? path : path + "/"
+  }
+
+  /// Records the outcome of a routed request. Requests that were cancelled don't count towards
+  /// their replica's latency or error rate, and long-polls don't count towards its latency.
+  func finish(_ routedRequest: RoutedRequest, response: URLResponse?, error: Swift.Error?) {
+    let now = ProcessInfo.processInfo.systemUptime
+    let endpoint = routedRequest.endpoint
+    lock.lock()
+    defer { lock.unlock() }
+    if !routedRequest.isLongPoll {
+      endpoint.inFlightCount -= 1
+    }
+    if Self.isCancellation(error) {
+      return
+    }
+
+    let isFailure: Bool
+    if let error = error {
+      isFailure = error is URLError
+    } else {
+      isFailure = ((response as? HTTPURLResponse)?.statusCode ?? 0) >= 500
+    }
+    if !routedRequest.isLongPoll {
+      let latency = now - routedRequest.startTime
+      endpoint.latency = endpoint.latency.map { decay * latency + (1 - decay) * $0 } ?? latency
+    }
+    endpoint.errorRate = decay * (isFailure ? 1 : 0) + (1 - decay) * endpoint.errorRate
+    if !isFailure {
+      endpoint.consecutiveFailureCount = 0
+      return
+    }
+    endpoint.consecutiveFailureCount += 1
+    if endpoint.consecutiveFailureCount >= ejectionFailureCount {
+      endpoint.ejectedUntil = now + ejectionInterval
+      // Give the replica a clean slate once it is given traffic again.
+      endpoint.consecutiveFailureCount = 0
+      endpoint.errorRate = 0
+    }
+  }
+
+  /// Loads a request through the replica it is routed to.
+  func data(
+    for request: URLRequest, isLongPoll: Bool = false,
+    load: (URLRequest) async throws -> (Data, URLResponse)
+  ) async throws -> (Data, URLResponse) {
+    let routedRequest = route(request, isLongPoll: isLongPoll)
+    do {
+      let (data, response) = try await load(routedRequest.request)
+      finish(routedRequest, response: response, error: nil)
+      return (data, response)
+    } catch {
+      finish(routedRequest, response: nil, error: error)
+      throw error
+    }
+  }
+
+  /// Picks the cheaper of two random replicas that aren't ejected. Must be called with `lock` held.
+  private func selectEndpoint(now: TimeInterval) -> Endpoint {
+    var candidates = endpoints.filter { $0.ejectedUntil <= now }
+    if candidates.isEmpty {
+      candidates = endpoints
+    }
+    guard candidates.count > 1 else { return candidates[0] }
+
+    let firstIndex = Int.random(in: 0..<candidates.count)
+    var secondIndex = Int.random(in: 0..<(candidates.count - 1))
+    if secondIndex >= firstIndex {
+      secondIndex += 1
+    }
+    let first = candidates[firstIndex]
+    let second = candidates[secondIndex]
+    return Self.cost(of: first) <= Self.cost(of: second) ? first : second
+  }
+
+  /// The cost of sending a request to a replica. A replica that has not answered yet costs
+  /// nothing, so that it is tried.
+  private static func cost(of endpoint: Endpoint) -> Double {
+    guard let latency = endpoint.latency else { return 0 }
+    return latency * Double(endpoint.inFlightCount + 1) / max(1 - endpoint.errorRate, 0.01)
+  }
+
+  private static func isCancellation(_ error: Swift.Error?) -> Bool {
+    if error is CancellationError {
+      return true
+    }
+    return (error as? URLError)?.code == .cancelled
+  }
+}
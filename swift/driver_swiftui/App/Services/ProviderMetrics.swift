@@ -0,0 +1,293 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import Foundation
+
+/// A histogram of durations, in the style of an HDR histogram.
+///
+/// Durations are counted in microseconds in log-linear buckets: every power of two is split into 16
+/// buckets, so that percentiles are accurate to within about 3% from a microsecond to several days.
+/// Recording a duration only increments a bucket, and histograms are merged by adding up their
+/// buckets.
+struct LatencyHistogram {
+  private static let subBucketBits = 4
+  private static let subBucketCount = 1 << subBucketBits
+  private static let maximumValueBits = 40
+  private static let bucketCount = subBucketCount * (maximumValueBits - subBucketBits + 1)
+
+  private var bucketCounts = [UInt64](repeating: 0, count: LatencyHistogram.bucketCount)
+
+  /// The number of durations recorded.
+  private(set) var count: UInt64 = 0
+
+  /// The sum of the durations recorded.
+  private(set) var totalDuration: TimeInterval = 0
+
+  /// The longest duration recorded.
+  private(set) var maximumDuration: TimeInterval = 0
+
+  /// Records a duration.
+  mutating func record(_ duration: TimeInterval) {
+    let duration = max(duration, 0)
+    // Durations beyond the last bucket are counted in it, so there is no need to convert them.
+    let microseconds = UInt64(min(duration * 1_000_000, Double(1 << Self.maximumValueBits)))
+    bucketCounts[Self.bucketIndex(microseconds: microseconds)] += 1
+    count += 1
+    totalDuration += duration
+    maximumDuration = max(maximumDuration, duration)
+  }
+
+  /// Adds the durations recorded by another histogram to this one.
+  mutating func merge(_ other: LatencyHistogram) {
+    for index in bucketCounts.indices {
+      bucketCounts[index] += other.bucketCounts[index]
+    }
+    count += other.count
+    totalDuration += other.totalDuration
+    maximumDuration = max(maximumDuration, other.maximumDuration)
+  }
+
+  /// Returns the duration that the given percentage of recorded durations are at most, or 0 if no
+  /// durations have been recorded.
+  func duration(atPercentile percentile: Double) -> TimeInterval {
+    guard count > 0 else { return 0 }
+    let rank = max(UInt64((min(max(percentile, 0), 100) / 100 * Double(count)).rounded(.up)), 1)
+    var cumulativeCount: UInt64 = 0
+    for (index, bucketCount) in bucketCounts.enumerated() {
+      cumulativeCount += bucketCount
+      if cumulativeCount >= rank {
+        return min(Double(Self.bucketMidpoint(index: index)) / 1_000_000, maximumDuration)
+      }
+    }
+    return maximumDuration
+  }
+
+  private static func bucketIndex(microseconds: UInt64) -> Int {
+    if microseconds < subBucketCount {
+      return Int(microseconds)
+    }
+    let microseconds = min(microseconds, (1 << maximumValueBits) - 1)
+    let exponent = UInt64.bitWidth - 1 - microseconds.leadingZeroBitCount
+    let subBucket = Int(microseconds >> (exponent - subBucketBits)) & (subBucketCount - 1)
+    return subBucketCount * (exponent - subBucketBits + 1) + subBucket
+  }
+
+  private static func bucketMidpoint(index: Int) -> UInt64 {
+    if index < subBucketCount {
+      return UInt64(index)
+    }
+    let shift = index / subBucketCount - 1
+    let lowerBound = UInt64(subBucketCount + index % subBucketCount) << shift
+    return lowerBound + ((1 << shift) - 1) / 2
+  }
+}
+
+/// A destination for provider metrics, such as a log or an analytics backend.
+protocol ProviderMetricsSink: AnyObject {
+  /// Called with the metrics recorded since the previous flush, keyed by the name of the call.
+  func providerMetrics(
+    _ metrics: ProviderMetrics, didFlush snapshot: [String: ProviderMetrics.CallMetrics])
+}
+
+/// Latency histograms and counters for provider calls, keyed by the name of the call.
+///
+/// Recording is cheap enough to be done on every call: it takes a lock, looks up the call and
+/// increments a few integers, without allocating once the call has been seen. Use `snapshot()` to
+/// inspect the metrics, or add a sink and call `flush()` to hand them off periodically.
+///
+/// Async calls return on their caller's executor, so unlike completion handlers they have no
+/// dispatch phase to time.
+final class ProviderMetrics {
+
+  /// A phase of a provider call, which is timed separately.
+  enum Phase: Int, CaseIterable {
+    /// From the call until its request is handed to the network.
+    case build
+    /// From when the request is handed to the network until its response arrives, with retries.
+    case network
+    /// Decoding the response.
+    case decode
+  }
+
+  /// The latencies and counters recorded for one provider call.
+  struct CallMetrics {
+    private var histograms = [LatencyHistogram](
+      repeating: LatencyHistogram(), count: Phase.allCases.count)
+
+    /// The number of calls made, which is the number of build phases recorded.
+    var callCount: UInt64 { histograms[Phase.build.rawValue].count }
+
+    /// The number of requests sent, including retries and hedges.
+    fileprivate(set) var attemptCount: UInt64 = 0
+
+    /// The number of requests sent as retries or hedges of an earlier request.
+    fileprivate(set) var retryCount: UInt64 = 0
+
+    /// The number of requests that failed without a response.
+    fileprivate(set) var errorCount: UInt64 = 0
+
+    /// The number of conditional requests answered with 304 Not Modified.
+    fileprivate(set) var cacheHitCount: UInt64 = 0
+
+    /// The number of request body bytes sent.
+    fileprivate(set) var bytesSent: UInt64 = 0
+
+    /// The number of response body bytes received.
+    fileprivate(set) var bytesReceived: UInt64 = 0
+
+    /// The number of responses received, keyed by HTTP status code.
+    fileprivate(set) var statusCodeCounts: [Int: UInt64] = [:]
+
+    /// Returns the latencies recorded for a phase of the call.
+    func histogram(for phase: Phase) -> LatencyHistogram {
+      histograms[phase.rawValue]
+    }
+
+    /// Adds the latencies and counters recorded by other metrics to these ones.
+    mutating func merge(_ other: CallMetrics) {
+      for index in histograms.indices {
+        histograms[index].merge(other.histograms[index])
+      }
+      attemptCount += other.attemptCount
+      retryCount += other.retryCount
+      errorCount += other.errorCount
+      cacheHitCount += other.cacheHitCount
+      bytesSent += other.bytesSent
+      bytesReceived += other.bytesReceived
+      statusCodeCounts.merge(other.statusCodeCounts, uniquingKeysWith: +)
+    }
+
+    fileprivate mutating func record(_ duration: TimeInterval, of phase: Phase) {
+      histograms[phase.rawValue].record(duration)
+    }
+  }
+
+  /// Times the phases of one call, each starting where the previous one ended.
+  struct CallTimer {
+    /// The name of the call.
+    let call: String
+
+    private let metrics: ProviderMetrics
+    private var phaseStartTime: TimeInterval
+
+    fileprivate init(metrics: ProviderMetrics, call: String) {
+      self.metrics = metrics
+      self.call = call
+      self.phaseStartTime = ProcessInfo.processInfo.systemUptime
+    }
+
+    /// Records the time since the previous phase ended as the duration of `phase`.
+    mutating func endPhase(_ phase: Phase) {
+      let now = ProcessInfo.processInfo.systemUptime
+      metrics.record(now - phaseStartTime, of: phase, for: call)
+      phaseStartTime = now
+    }
+  }
+
+  private struct WeakSink {
+    weak var sink: ProviderMetricsSink?
+  }
+
+  private static let httpStatusNotModified = 304
+  private static let conditionalHeaderFields = ["If-None-Match", "If-Modified-Since"]
+
+  /// The metrics shared by the provider service and auth token provider.
+  static let shared = ProviderMetrics()
+
+  private let lock = NSLock()
+  private var metricsByCall: [String: CallMetrics] = [:]
+  private var sinks: [WeakSink] = []
+
+  /// Adds a sink that is handed the metrics on every flush. Sinks are held weakly.
+  func add(_ sink: ProviderMetricsSink) {
+    lock.lock()
+    defer { lock.unlock() }
+    sinks.append(WeakSink(sink: sink))
+  }
+
+  /// Removes a sink added with `add(_:)`.
+  func remove(_ sink: ProviderMetricsSink) {
+    lock.lock()
+    defer { lock.unlock() }
+    sinks.removeAll { $0.sink == nil || $0.sink === sink }
+  }
+
+  /// Returns the metrics recorded since the last flush, keyed by the name of the call.
+  func snapshot() -> [String: CallMetrics] {
+    lock.lock()
+    defer { lock.unlock() }
+    return metricsByCall
+  }
+
+  /// Hands the metrics recorded since the last flush to the sinks, and starts over.
+  func flush() {
+    lock.lock()
+    let snapshot = metricsByCall
+    metricsByCall.removeAll()
+    sinks.removeAll { $0.sink == nil }
+    let sinks = self.sinks.compactMap { $0.sink }
+    lock.unlock()
+
+    for sink in sinks {
+      sink.providerMetrics(self, didFlush: snapshot)
+    }
+  }
+
+  /// Starts timing the phases of a call.
+  func startTimer(for call: String) -> CallTimer {
+    CallTimer(metrics: self, call: call)
+  }
+
+  /// Records how long a phase of a call took.
+  func record(_ duration: TimeInterval, of phase: Phase, for call: String) {
+    lock.lock()
+    defer { lock.unlock() }
+    metricsByCall[call, default: CallMetrics()].record(duration, of: phase)
+  }
+
+  /// Records that a request was sent for a call, as a retry or hedge if `isRetry`.
+  func recordAttempt(_ request: URLRequest, isRetry: Bool, for call: String) {
+    let bytesSent = UInt64(request.httpBody?.count ?? 0)
+    lock.lock()
+    defer { lock.unlock() }
+    metricsByCall[call, default: CallMetrics()].attemptCount += 1
+    if isRetry {
+      metricsByCall[call]?.retryCount += 1
+    }
+    metricsByCall[call]?.bytesSent += bytesSent
+  }
+
+  /// Records the outcome of a request sent for a call.
+  func recordResponse(
+    _ response: URLResponse?, data: Data?, error: Swift.Error?, to request: URLRequest,
+    for call: String
+  ) {
+    let bytesReceived = UInt64(data?.count ?? 0)
+    let statusCode = (response as? HTTPURLResponse)?.statusCode
+    let isCacheHit =
+      statusCode == Self.httpStatusNotModified
+      && Self.conditionalHeaderFields.contains { request.value(forHTTPHeaderField: $0) != nil }
+    lock.lock()
+    defer { lock.unlock() }
+    metricsByCall[call, default: CallMetrics()].bytesReceived += bytesReceived
+    if let statusCode = statusCode {
+      metricsByCall[call]?.statusCodeCounts[statusCode, default: 0] += 1
+    } else if error != nil {
+      metricsByCall[call]?.errorCount += 1
+    }
+    if isCacheHit {
+      metricsByCall[call]?.cacheHitCount += 1
+    }
+  }
+}
@@ -0,0 +1,523 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+import Foundation
+import GoogleRidesharingConsumer
+
+/// Decodes provider responses by scanning their bytes once.
+///
+/// Unlike `JSONSerialization`, this doesn't build a tree of dictionaries, arrays and boxed numbers.
+/// The fields that the app reads are filled in directly, and all other members are skipped.
+/// Missing and `null` members, and members of an unexpected type, are decoded as `nil`, as they are
+/// from property lists.
+///
+/// Providers that support it answer with a binary property list instead, which is smaller than
+/// JSON and stores numbers in binary. Those responses are decoded with `PropertyListSerialization`.
+struct ProviderPayloadDecoder {
+
+  enum Error: Swift.Error {
+    case malformedPayload(offset: Int)
+  }
+
+  /// The encodings of a provider response.
+  enum Format {
+    case json
+    case propertyList
+
+    /// The MIME type of property list responses.
+    static let propertyListMIMEType = "application/x-plist"
+
+    /// The format of a response with the given MIME type. Responses that aren't property lists are
+    /// decoded as JSON.
+    init(mimeType: String?) {
+      self = mimeType == Self.propertyListMIMEType ? .propertyList : .json
+    }
+  }
+
+  /// A waypoint of a provider response.
+  struct Waypoint {
+    var latitude: Double?
+    var longitude: Double?
+    var waypointType: GMTSTripWaypointType?
+  }
+
+  /// A trip object of a provider response.
+  struct Trip {
+    var name: String?
+    var tripStatus: String?
+    var waypoints: [Waypoint]?
+  }
+
+  /// The fields of a vehicle response.
+  struct Vehicle {
+    var name: String?
+    var matchedTripIDs: [String]?
+  }
+
+  /// A string of the payload, referenced by the range of bytes between its quotes.
+  private struct StringToken {
+    let range: Range<Int>
+    let hasEscapes: Bool
+  }
+
+  private enum Keys {
+    static let name: StaticString = "name"
+    static let currentTripsIDs: StaticString = "currentTripsIds"
+    static let trip: StaticString = "trip"
+    static let trips: StaticString = "trips"
+    static let tripStatus: StaticString = "tripStatus"
+    static let waypoints: StaticString = "waypoints"
+    static let location: StaticString = "location"
+    static let point: StaticString = "point"
+    static let latitude: StaticString = "latitude"
+    static let longitude: StaticString = "longitude"
+    static let waypointType: StaticString = "waypointType"
+  }
+
+  private let bytes: UnsafeBufferPointer<UInt8>
+  private var position = 0
+
+  private init(bytes: UnsafeBufferPointer<UInt8>) {
+    self.bytes = bytes
+  }
+
+  /// Decodes a get vehicle or vehicle updates response.
+  static func decodeVehicle(from data: Data, format: Format = .json) throws -> Vehicle {
+    if format == .propertyList {
+      let propertyList = try decodePropertyList(data)
+      return Vehicle(
+        name: propertyList[Keys.name.description] as? String,
+        matchedTripIDs: propertyList[Keys.currentTripsIDs.description] as? [String])
+    }
+    return try decode(data) { decoder in
+      var vehicle = Vehicle()
+      try decoder.decodeObject { decoder, key in
+        if decoder.token(key, equals: Keys.name) {
+          vehicle.name = try decoder.decodeString()
+        } else if decoder.token(key, equals: Keys.currentTripsIDs) {
+          vehicle.matchedTripIDs = try decoder.decodeStringArray()
+        } else {
+          try decoder.skipValue()
+        }
+      }
+      return vehicle
+    }
+  }
+
+  /// Decodes the trip of a get trip response.
+  static func decodeTripResponse(from data: Data, format: Format = .json) throws -> Trip? {
+    if format == .propertyList {
+      return makeTrip(propertyList: try decodePropertyList(data)[Keys.trip.description])
+    }
+    return try decode(data) { decoder in
+      var trip: Trip?
+      try decoder.decodeObject { decoder, key in
+        if decoder.token(key, equals: Keys.trip) {
+          trip = try decoder.decodeTrip()
+        } else {
+          try decoder.skipValue()
+        }
+      }
+      return trip
+    }
+  }
+
+  /// Decodes the trips of a batch get trips response.
+  static func decodeTripsResponse(from data: Data, format: Format = .json) throws -> [Trip]? {
+    if format == .propertyList {
+      let trips = try decodePropertyList(data)[Keys.trips.description] as? [Any]
+      return trips?.compactMap(makeTrip(propertyList:))
+    }
+    return try decode(data) { decoder in
+      var trips: [Trip]?
+      try decoder.decodeObject { decoder, key in
+        if decoder.token(key, equals: Keys.trips) {
+          var decodedTrips: [Trip] = []
+          try decoder.decodeArray { decoder in
+            if let trip = try decoder.decodeTrip() {
+              decodedTrips.append(trip)
+            }
+          }
+          trips = decodedTrips
+        } else {
+          try decoder.skipValue()
+        }
+      }
+      return trips
+    }
+  }
+
+  private static func decode<Value>(
+    _ data: Data, body: (inout ProviderPayloadDecoder) throws -> Value
+  ) throws -> Value {
+    return try data.withUnsafeBytes { rawBuffer in
+      var decoder = ProviderPayloadDecoder(bytes: rawBuffer.bindMemory(to: UInt8.self))
+      let value = try body(&decoder)
+      decoder.skipWhitespace()
+      guard decoder.position == decoder.bytes.count else {
+        throw decoder.malformedPayload()
+      }
+      return value
+    }
+  }
+
+  // MARK: - Schema
+
+  private mutating func decodeTrip() throws -> Trip? {
+    if try skipValue(unlessStartedBy: Self.startsObject) {
+      return nil
+    }
+    var trip = Trip()
+    try decodeObject { decoder, key in
+      if decoder.token(key, equals: Keys.name) {
+        trip.name = try decoder.decodeString()
+      } else if decoder.token(key, equals: Keys.tripStatus) {
+        trip.tripStatus = try decoder.decodeString()
+      } else if decoder.token(key, equals: Keys.waypoints) {
+        trip.waypoints = try decoder.decodeWaypoints()
+      } else {
+        try decoder.skipValue()
+      }
+    }
+    return trip
+  }
+
+  private mutating func decodeWaypoints() throws -> [Waypoint]? {
+    if try skipValue(unlessStartedBy: Self.startsArray) {
+      return nil
+    }
+    var waypoints: [Waypoint] = []
+    try decodeArray { decoder in
+      var waypoint = Waypoint()
+      // An element that isn't an object is kept as a waypoint without any fields.
+      if try decoder.skipValue(unlessStartedBy: Self.startsObject) {
+        waypoints.append(waypoint)
+        return
+      }
+      try decoder.decodeObject { decoder, key in
+        if decoder.token(key, equals: Keys.location) {
+          try decoder.decodeLocation(into: &waypoint)
+        } else if decoder.token(key, equals: Keys.waypointType) {
+          waypoint.waypointType = try decoder.decodeWaypointType()
+        } else {
+          try decoder.skipValue()
+        }
+      }
+      waypoints.append(waypoint)
+    }
+    return waypoints
+  }
+
+  private mutating func decodeLocation(into waypoint: inout Waypoint) throws {
+    if try skipValue(unlessStartedBy: Self.startsObject) {
+      return
+    }
+    try decodeObject { decoder, key in
+      guard decoder.token(key, equals: Keys.point) else {
+        try decoder.skipValue()
+        return
+      }
+      if try decoder.skipValue(unlessStartedBy: Self.startsObject) {
+        return
+      }
+      try decoder.decodeObject { decoder, key in
+        if decoder.token(key, equals: Keys.latitude) {
+          waypoint.latitude = try decoder.decodeNumber()
+        } else if decoder.token(key, equals: Keys.longitude) {
+          waypoint.longitude = try decoder.decodeNumber()
+        } else {
+          try decoder.skipValue()
+        }
+      }
+    }
+  }
+
+  private mutating func decodeWaypointType() throws -> GMTSTripWaypointType? {
+    if try skipValue(unlessStartedBy: Self.startsString) {
+      return nil
+    }
+    let token = try scanString()
+    guard !token.hasEscapes else {
+      return .unknown
+    }
+    return ProviderWaypointType.tripWaypointType(
+      providerBytes: UnsafeRawBufferPointer(rebasing: bytes[token.range]))
+  }
+
+  // MARK: - Property lists
+
+  private static func decodePropertyList(_ data: Data) throws -> [String: Any] {
+    let propertyList = try PropertyListSerialization.propertyList(from: data, format: nil)
+    guard let dictionary = propertyList as? [String: Any] else {
+      throw Error.malformedPayload(offset: 0)
+    }
+    return dictionary
+  }
+
+  private static func makeTrip(propertyList: Any?) -> Trip? {
+    guard let dictionary = propertyList as? [String: Any] else {
+      return nil
+    }
+    let waypoints = dictionary[Keys.waypoints.description] as? [Any]
+    return Trip(
+      name: dictionary[Keys.name.description] as? String,
+      tripStatus: dictionary[Keys.tripStatus.description] as? String,
+      waypoints: waypoints?.map { makeWaypoint(propertyList: $0 as? [String: Any] ?? [:]) })
+  }
+
+  private static func makeWaypoint(propertyList: [String: Any]) -> Waypoint {
+    let location = propertyList[Keys.location.description] as? [String: Any]
+    let point = location?[Keys.point.description] as? [String: Any]
+    var waypoint = Waypoint()
+    waypoint.latitude = (point?[Keys.latitude.description] as? NSNumber)?.doubleValue
+    waypoint.longitude = (point?[Keys.longitude.description] as? NSNumber)?.doubleValue
+    if let waypointType = propertyList[Keys.waypointType.description] as? String {
+      waypoint.waypointType = ProviderWaypointType.tripWaypointType(providerString: waypointType)
+    }
+    return waypoint
+  }
+
+  // MARK: - Scanning
+
+  private func malformedPayload() -> Error {
+    return .malformedPayload(offset: position)
+  }
+
+  private mutating func skipWhitespace() {
+    while position < bytes.count {
+      switch bytes[position] {
+      case UInt8(ascii: " "), UInt8(ascii: "\n"), UInt8(ascii: "\r"), UInt8(ascii: "\t"):
+        position += 1
+      default:
+        return
+      }
+    }
+  }
+
+  /// Consumes the given character if it is next after any whitespace.
+  private mutating func consume(_ character: Unicode.Scalar) -> Bool {
+    skipWhitespace()
+    guard position < bytes.count, bytes[position] == UInt8(ascii: character) else {
+      return false
+    }
+    position += 1
+    return true
+  }
+
+  private mutating func expect(_ character: Unicode.Scalar) throws {
+    guard consume(character) else {
+      throw malformedPayload()
+    }
+  }
+
+  /// Consumes the given literal, such as `true` or `null`, if it is next after any whitespace.
+  private mutating func consumeLiteral(_ literal: StaticString) -> Bool {
+    skipWhitespace()
+    let length = literal.utf8CodeUnitCount
+    guard bytes.count - position >= length,
+      memcmp(bytes.baseAddress! + position, literal.utf8Start, length) == 0
+    else {
+      return false
+    }
+    position += length
+    return true
+  }
+
+  /// Decodes the members of an object, passing the key of each member to `decodeMember`, which
+  /// must decode or skip the member's value.
+  private mutating func decodeObject(
+    _ decodeMember: (inout ProviderPayloadDecoder, StringToken) throws -> Void
+  ) throws {
+    try expect("{")
+    if consume("}") {
+      return
+    }
+    repeat {
+      let key = try scanString()
+      try expect(":")
+      try decodeMember(&self, key)
+    } while consume(",")
+    try expect("}")
+  }
+
+  /// Decodes the elements of an array with `decodeElement`.
+  private mutating func decodeArray(_ decodeElement: (inout ProviderPayloadDecoder) throws -> Void)
+    throws
+  {
+    try expect("[")
+    if consume("]") {
+      return
+    }
+    repeat {
+      try decodeElement(&self)
+    } while consume(",")
+    try expect("]")
+  }
+
+  /// Scans a string, recording its range instead of copying it.
+  private mutating func scanString() throws -> StringToken {
+    try expect("\"")
+    let start = position
+    var hasEscapes = false
+    while position < bytes.count {
+      let byte = bytes[position]
+      if byte == UInt8(ascii: "\"") {
+        let token = StringToken(range: start..<position, hasEscapes: hasEscapes)
+        position += 1
+        return token
+      }
+      guard byte >= 0x20 else {
+        throw malformedPayload()
+      }
+      if byte == UInt8(ascii: "\\") {
+        // Skip the escaped character so that an escaped quote doesn't end the string.
+        hasEscapes = true
+        position += 1
+      }
+      position += 1
+    }
+    throw malformedPayload()
+  }
+
+  /// Returns whether an unescaped string token has the same bytes as `string`.
+  private func token(_ token: StringToken, equals string: StaticString) -> Bool {
+    let length = string.utf8CodeUnitCount
+    return !token.hasEscapes && token.range.count == length
+      && memcmp(bytes.baseAddress! + token.range.lowerBound, string.utf8Start, length) == 0
+  }
+
+  private func string(from token: StringToken) -> String? {
+    guard token.hasEscapes else {
+      return String(decoding: UnsafeBufferPointer(rebasing: bytes[token.range]), as: UTF8.self)
+    }
+    // Escaped strings are rare in provider responses, so let JSONSerialization unescape the quoted
+    // literal.
+    let literal = Data(bytes[(token.range.lowerBound - 1)..<(token.range.upperBound + 1)])
+    return try? JSONSerialization.jsonObject(with: literal, options: .fragmentsAllowed) as? String
+  }
+
+  private mutating func decodeString() throws -> String? {
+    if try skipValue(unlessStartedBy: Self.startsString) {
+      return nil
+    }
+    return string(from: try scanString())
+  }
+
+  private mutating func decodeStringArray() throws -> [String]? {
+    if try skipValue(unlessStartedBy: Self.startsArray) {
+      return nil
+    }
+    var strings: [String] = []
+    try decodeArray { decoder in
+      // Elements that aren't strings are skipped.
+      if try decoder.skipValue(unlessStartedBy: Self.startsString) {
+        return
+      }
+      if let string = decoder.string(from: try decoder.scanString()) {
+        strings.append(string)
+      }
+    }
+    return strings
+  }
+
+  private mutating func decodeNumber() throws -> Double? {
+    if try skipValue(unlessStartedBy: Self.startsNumber) {
+      return nil
+    }
+    let start = position
+    scanNumber: while position < bytes.count {
+      switch bytes[position] {
+      case UInt8(ascii: "0")...UInt8(ascii: "9"), UInt8(ascii: "-"), UInt8(ascii: "+"),
+        UInt8(ascii: "."), UInt8(ascii: "e"), UInt8(ascii: "E"):
+        position += 1
+      default:
+        break scanNumber
+      }
+    }
+
+    // The payload isn't terminated, so `strtod` is only used when a delimiter follows the number,
+    // which is always the case inside an object or array.
+    guard position > start, position < bytes.count else {
+      throw malformedPayload()
+    }
+    let numberStart = UnsafeRawPointer(bytes.baseAddress! + start).assumingMemoryBound(
+      to: CChar.self)
+    var numberEnd: UnsafeMutablePointer<CChar>?
+    let number = strtod(numberStart, &numberEnd)
+    guard let numberEnd = numberEnd, UnsafePointer(numberEnd) == numberStart + (position - start)
+    else {
+      throw malformedPayload()
+    }
+    return number
+  }
+
+  private static func startsObject(_ byte: UInt8) -> Bool { byte == UInt8(ascii: "{") }
+  private static func startsArray(_ byte: UInt8) -> Bool { byte == UInt8(ascii: "[") }
+  private static func startsString(_ byte: UInt8) -> Bool { byte == UInt8(ascii: "\"") }
+
+  private static func startsNumber(_ byte: UInt8) -> Bool {
+    byte == UInt8(ascii: "-") || (UInt8(ascii: "0")...UInt8(ascii: "9")).contains(byte)
+  }
+
+  /// Skips the next value if it is `null` or of another type than the one whose first byte
+  /// satisfies `startsValue`, and returns whether it was skipped. A member whose value is skipped
+  /// is decoded as `nil`.
+  private mutating func skipValue(unlessStartedBy startsValue: (UInt8) -> Bool) throws -> Bool {
+    skipWhitespace()
+    guard position < bytes.count, !startsValue(bytes[position]) else {
+      return false
+    }
+    try skipValue()
+    return true
+  }
+
+  /// Skips a value of any type. Nested objects and arrays are skipped by tracking their depth,
+  /// without validating their members.
+  private mutating func skipValue() throws {
+    skipWhitespace()
+    guard position < bytes.count else {
+      throw malformedPayload()
+    }
+    switch bytes[position] {
+    case UInt8(ascii: "\""):
+      _ = try scanString()
+    case UInt8(ascii: "{"), UInt8(ascii: "["):
+      var depth = 0
+      while position < bytes.count {
+        switch bytes[position] {
+        case UInt8(ascii: "\""):
+          _ = try scanString()
+          continue
+        case UInt8(ascii: "{"), UInt8(ascii: "["):
+          depth += 1
+        case UInt8(ascii: "}"), UInt8(ascii: "]"):
+          depth -= 1
+        default:
+          break
+        }
+        position += 1
+        if depth == 0 {
+          return
+        }
+      }
+      throw malformedPayload()
+    default:
+      if consumeLiteral("true") || consumeLiteral("false") || consumeLiteral("null") {
+        return
+      }
+      _ = try decodeNumber()
+    }
+  }
+}
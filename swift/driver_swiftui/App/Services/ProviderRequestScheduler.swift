@@ -0,0 +1,262 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import Foundation
+
+/// Schedules provider requests so that interactive requests are never held up by background
+/// traffic.
+///
+/// Interactive requests, such as trip status updates made when the driver taps a button, start as
+/// soon as they are scheduled. Background requests, such as vehicle polls and trip fetches, are
+/// limited to `maximumConcurrentBackgroundRequests` in flight and wait while any interactive
+/// request is in flight. A request scheduled with a resource key supersedes the pending or
+/// in-flight request for the same key, which then throws `CancellationError`, and so does an
+/// operation that sends several requests for a resource, such as the attempts of a retried request.
+/// Requests are sent to the provider replica that `endpointSet` routes them to.
+final class ProviderRequestScheduler {
+
+  enum Priority {
+    /// A request the user is waiting on.
+    case interactive
+
+    /// A request made on behalf of polling or prefetching.
+    case background
+  }
+
+  /// A request along with the state needed to start, supersede or complete it.
+  private final class ScheduledRequest {
+    let request: URLRequest
+    let priority: Priority
+    let resourceKey: String?
+    let isLongPoll: Bool
+    var continuation: CheckedContinuation<(Data, URLResponse), Swift.Error>?
+    var task: URLSessionDataTask?
+    var isCancelled = false
+
+    init(request: URLRequest, priority: Priority, resourceKey: String?, isLongPoll: Bool) {
+      self.request = request
+      self.priority = priority
+      self.resourceKey = resourceKey
+      self.isLongPoll = isLongPoll
+    }
+  }
+
+  /// An operation that sends requests for a resource, which a newer one for the same resource
+  /// supersedes.
+  private final class SupersedableOperation {
+    let cancel: () -> Void
+    var isSuperseded = false
+
+    init(cancel: @escaping () -> Void) {
+      self.cancel = cancel
+    }
+  }
+
+  /// The maximum number of background requests in flight.
+  let maximumConcurrentBackgroundRequests: Int
+
+  private let session: URLSession
+  private let endpointSet: ProviderEndpointSet
+  private let lock = NSLock()
+  private var interactiveRequestCount = 0
+  private var backgroundRequestCount = 0
+  /// Background requests waiting to start, in the order they were scheduled.
+  private var pendingBackgroundRequests: [ScheduledRequest] = []
+  /// The most recently scheduled request for each resource key.
+  private var requestsByResourceKey: [String: ScheduledRequest] = [:]
+  /// The most recently started operation for each resource key.
+  private var operationsByResourceKey: [String: SupersedableOperation] = [:]
+
+  init(
+    session: URLSession, maximumConcurrentBackgroundRequests: Int = 4,
+    endpointSet: ProviderEndpointSet = .shared
+  ) {
+    self.session = session
+    self.endpointSet = endpointSet
+    self.maximumConcurrentBackgroundRequests = max(maximumConcurrentBackgroundRequests, 1)
+  }
+
+  /// Loads the request once its priority allows it to start.
+  ///
+  /// Throws `CancellationError` if the calling task is cancelled, or if a newer request with the
+  /// same `resourceKey` is scheduled before this one completes. `isLongPoll` keeps a request that
+  /// the provider holds open from counting towards its replica's latency.
+  func data(
+    for request: URLRequest, priority: Priority, resourceKey: String? = nil,
+    isLongPoll: Bool = false
+  ) async throws -> (Data, URLResponse) {
+    let scheduledRequest = ScheduledRequest(
+      request: request, priority: priority, resourceKey: resourceKey, isLongPoll: isLongPoll)
+    return try await withTaskCancellationHandler {
+      try await withCheckedThrowingContinuation { continuation in
+        schedule(scheduledRequest, continuation: continuation)
+      }
+    } onCancel: {
+      cancel(scheduledRequest)
+    }
+  }
+
+  /// Runs an operation that sends requests for a resource, such as every attempt of a retried and
+  /// hedged request, and supersedes the operation still running for the same `resourceKey`.
+  ///
+  /// A superseded operation is cancelled, along with the retry delay it is waiting out and the
+  /// requests it has in flight, and throws `CancellationError` even if it completed in the
+  /// meantime. The requests of an operation should not have resource keys of their own.
+  func superseding<Value>(
+    resourceKey: String, operation: @escaping () async throws -> Value
+  ) async throws -> Value {
+    let task = Task { try await operation() }
+    let supersedableOperation = SupersedableOperation(cancel: task.cancel)
+    lock.lock()
+    let supersededOperation = operationsByResourceKey[resourceKey]
+    supersededOperation?.isSuperseded = true
+    operationsByResourceKey[resourceKey] = supersedableOperation
+    lock.unlock()
+    supersededOperation?.cancel()
+
+    let result = await withTaskCancellationHandler {
+      await task.result
+    } onCancel: {
+      task.cancel()
+    }
+    lock.lock()
+    let isSuperseded = supersedableOperation.isSuperseded
+    if operationsByResourceKey[resourceKey] === supersedableOperation {
+      operationsByResourceKey.removeValue(forKey: resourceKey)
+    }
+    lock.unlock()
+    if isSuperseded {
+      throw CancellationError()
+    }
+    return try result.get()
+  }
+
+  private func schedule(
+    _ scheduledRequest: ScheduledRequest,
+    continuation: CheckedContinuation<(Data, URLResponse), Swift.Error>
+  ) {
+    lock.lock()
+    guard !scheduledRequest.isCancelled else {
+      lock.unlock()
+      continuation.resume(throwing: CancellationError())
+      return
+    }
+    scheduledRequest.continuation = continuation
+    var supersededRequest: ScheduledRequest?
+    if let resourceKey = scheduledRequest.resourceKey {
+      supersededRequest = requestsByResourceKey[resourceKey]
+      requestsByResourceKey[resourceKey] = scheduledRequest
+    }
+    switch scheduledRequest.priority {
+    case .interactive:
+      start(scheduledRequest)
+    case .background:
+      pendingBackgroundRequests.append(scheduledRequest)
+      startPendingBackgroundRequests()
+    }
+    lock.unlock()
+
+    if let supersededRequest = supersededRequest {
+      cancel(supersededRequest)
+    }
+  }
+
+  /// Cancels a request, which throws `CancellationError` once it has been cancelled.
+  private func cancel(_ scheduledRequest: ScheduledRequest) {
+    lock.lock()
+    guard !scheduledRequest.isCancelled else {
+      lock.unlock()
+      return
+    }
+    scheduledRequest.isCancelled = true
+    if let task = scheduledRequest.task {
+      lock.unlock()
+      // The task's completion handler resumes the continuation.
+      task.cancel()
+      return
+    }
+    // A request that has not started is still pending, or has not been scheduled yet.
+    pendingBackgroundRequests.removeAll { $0 === scheduledRequest }
+    removeResourceKey(of: scheduledRequest)
+    let continuation = scheduledRequest.continuation
+    scheduledRequest.continuation = nil
+    lock.unlock()
+    continuation?.resume(throwing: CancellationError())
+  }
+
+  /// Starts a request. Must be called with `lock` held.
+  private func start(_ scheduledRequest: ScheduledRequest) {
+    switch scheduledRequest.priority {
+    case .interactive:
+      interactiveRequestCount += 1
+    case .background:
+      backgroundRequestCount += 1
+    }
+    let routedRequest = endpointSet.route(
+      scheduledRequest.request, isLongPoll: scheduledRequest.isLongPoll)
+    let task = session.dataTask(with: routedRequest.request) { data, response, error in
+      self.endpointSet.finish(routedRequest, response: response, error: error)
+      self.finish(scheduledRequest, data: data, response: response, error: error)
+    }
+    scheduledRequest.task = task
+    task.resume()
+  }
+
+  private func finish(
+    _ scheduledRequest: ScheduledRequest, data: Data?, response: URLResponse?,
+    error: Swift.Error?
+  ) {
+    lock.lock()
+    switch scheduledRequest.priority {
+    case .interactive:
+      interactiveRequestCount -= 1
+    case .background:
+      backgroundRequestCount -= 1
+    }
+    removeResourceKey(of: scheduledRequest)
+    let isCancelled = scheduledRequest.isCancelled
+    let continuation = scheduledRequest.continuation
+    scheduledRequest.continuation = nil
+    startPendingBackgroundRequests()
+    lock.unlock()
+
+    if isCancelled {
+      continuation?.resume(throwing: CancellationError())
+    } else if let data = data, let response = response {
+      continuation?.resume(returning: (data, response))
+    } else {
+      continuation?.resume(throwing: error ?? URLError(.unknown))
+    }
+  }
+
+  /// Starts pending background requests while no interactive request is in flight and the
+  /// background limit allows. Must be called with `lock` held.
+  private func startPendingBackgroundRequests() {
+    while interactiveRequestCount == 0,
+      backgroundRequestCount < maximumConcurrentBackgroundRequests,
+      !pendingBackgroundRequests.isEmpty
+    {
+      start(pendingBackgroundRequests.removeFirst())
+    }
+  }
+
+  /// Forgets the request's resource key unless a newer request has taken it over. Must be called
+  /// with `lock` held.
+  private func removeResourceKey(of scheduledRequest: ScheduledRequest) {
+    guard let resourceKey = scheduledRequest.resourceKey,
+      requestsByResourceKey[resourceKey] === scheduledRequest
+    else { return }
+    requestsByResourceKey.removeValue(forKey: resourceKey)
+  }
+}
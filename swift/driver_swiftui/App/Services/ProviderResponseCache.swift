@@ -0,0 +1,129 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+import Foundation
+
+/// A bounded in-memory cache of provider responses, keyed by request URL.
+///
+/// The cache keeps the validators (ETag and Last-Modified) returned with each response so that
+/// later requests for the same URL can be made conditional. When the provider answers one of those
+/// with 304 Not Modified, the previously received body is reused without downloading it again.
+/// Bodies are cached rather than the values decoded from them, because decoding derives values
+/// that are relative to the time of decoding, such as the waypoints' ETAs, which must be derived
+/// again for the current time. Once the cache is full, the least recently used response is
+/// evicted.
+final class ProviderResponseCache {
+
+  /// Counts of how requests were served, for measuring the cache's effectiveness.
+  struct Statistics: Equatable {
+    /// Number of requests that were made conditional using a cached response.
+    var hitCount = 0
+
+    /// Number of requests sent unconditionally because no response was cached for the URL.
+    var missCount = 0
+
+    /// Number of 304 responses that were served from the cache.
+    var notModifiedCount = 0
+  }
+
+  private enum Constants {
+    static let etagHeaderField = "ETag"
+    static let lastModifiedHeaderField = "Last-Modified"
+    static let ifNoneMatchHeaderField = "If-None-Match"
+    static let ifModifiedSinceHeaderField = "If-Modified-Since"
+  }
+
+  private struct Entry {
+    let etag: String?
+    let lastModified: String?
+    let body: Data
+    let response: HTTPURLResponse
+  }
+
+  /// The maximum number of responses held by the cache.
+  let capacity: Int
+
+  private let lock = NSLock()
+  private var entries: [String: Entry] = [:]
+  /// Keys of the cached responses, from least to most recently used.
+  private var keysByRecentUse: [String] = []
+  private var _statistics = Statistics()
+
+  init(capacity: Int = 32) {
+    self.capacity = max(capacity, 1)
+  }
+
+  /// A snapshot of the cache's counters.
+  var statistics: Statistics {
+    lock.lock()
+    defer { lock.unlock() }
+    return _statistics
+  }
+
+  /// Adds the validators of the response cached for the request's URL, if any, so that the
+  /// provider can answer with 304 Not Modified.
+  func addValidators(to request: inout URLRequest) {
+    guard let key = request.url?.absoluteString else { return }
+    lock.lock()
+    defer { lock.unlock() }
+    guard let entry = entries[key] else {
+      _statistics.missCount += 1
+      return
+    }
+    _statistics.hitCount += 1
+    request.setValue(entry.etag, forHTTPHeaderField: Constants.ifNoneMatchHeaderField)
+    request.setValue(entry.lastModified, forHTTPHeaderField: Constants.ifModifiedSinceHeaderField)
+  }
+
+  /// Returns the body and the response cached for a URL, or `nil` if it has been evicted. Call this
+  /// when the provider answers with 304 Not Modified, and decode the body again.
+  func cachedResponse(forNotModifiedResponseTo url: URL)
+    -> (body: Data, response: HTTPURLResponse)?
+  {
+    let key = url.absoluteString
+    lock.lock()
+    defer { lock.unlock() }
+    guard let entry = entries[key] else { return nil }
+    _statistics.notModifiedCount += 1
+    markAsMostRecentlyUsed(key: key)
+    return (entry.body, entry.response)
+  }
+
+  /// Stores the body of a response, replacing any response previously cached for the URL.
+  /// Responses without validators are not cached since they can't be revalidated.
+  func store(_ body: Data, for response: HTTPURLResponse, url: URL) {
+    let key = url.absoluteString
+    let etag = response.value(forHTTPHeaderField: Constants.etagHeaderField)
+    let lastModified = response.value(forHTTPHeaderField: Constants.lastModifiedHeaderField)
+    lock.lock()
+    defer { lock.unlock() }
+    guard etag != nil || lastModified != nil else {
+      entries[key] = nil
+      keysByRecentUse.removeAll { $0 == key }
+      return
+    }
+
+    entries[key] = Entry(etag: etag, lastModified: lastModified, body: body, response: response)
+    markAsMostRecentlyUsed(key: key)
+    while keysByRecentUse.count > capacity {
+      entries[keysByRecentUse.removeFirst()] = nil
+    }
+  }
+
+  private func markAsMostRecentlyUsed(key: String) {
+    keysByRecentUse.removeAll { $0 == key }
+    keysByRecentUse.append(key)
+  }
+}
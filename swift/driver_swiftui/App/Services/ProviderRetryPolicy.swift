@@ -0,0 +1,291 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import Foundation
+
+/// Retries failed provider requests with jittered exponential backoff, and hedges slow ones.
+///
+/// A request is retried when it fails with a transient network error, or when the provider answers
+/// with a 408, 429, 500, 502, 503 or 504 status, up to `maximumAttempts` attempts in total. Before
+/// each retry the policy waits for a random delay of up to `baseRetryDelay`, doubled for every
+/// earlier retry and capped at `maximumRetryDelay`, so that clients that failed together don't
+/// retry together.
+///
+/// Retries and hedges are paid for from a retry budget, which each request adds `retryBudgetRatio`
+/// to, so that they add at most that fraction of extra requests while the provider is failing
+/// instead of multiplying its load.
+///
+/// A hedged request is sent again once its first attempt has been in flight for longer than the
+/// 95th percentile latency of recent requests with the same hedge key, such as the name of the
+/// call, since calls differ widely in how long they take. The first of the two attempts to succeed
+/// is used, and the other one is cancelled. The request only fails once both attempts have failed.
+final class ProviderRetryPolicy {
+
+  /// The policy shared by provider services that aren't given one. It doesn't hedge requests.
+  static let shared = ProviderRetryPolicy()
+
+  /// The number of recent attempt latencies of each hedge key that its hedge delay is computed
+  /// from.
+  private static let latencySampleCapacity = 128
+
+  /// The number of latencies of a hedge key that must be observed before its requests are hedged.
+  private static let minimumLatencySampleCount = 20
+
+  private static let hedgeLatencyPercentile = 0.95
+
+  private static let retryableURLErrorCodes: Set<URLError.Code> = [
+    .timedOut, .cannotFindHost, .cannotConnectToHost, .networkConnectionLost, .dnsLookupFailed,
+    .notConnectedToInternet,
+  ]
+
+  private static let retryableStatusCodes: Set<Int> = [408, 429, 500, 502, 503, 504]
+
+  /// An event of a hedged pair of attempts.
+  private enum HedgeEvent {
+    /// An attempt finished with the given outcome.
+    case finished(Result<(Data, URLResponse), Swift.Error>)
+
+    /// The first attempt has been in flight for the hedge delay.
+    case hedgeDue
+
+    /// The hedge delay was cancelled because the pair is done.
+    case hedgeCancelled
+  }
+
+  /// A ring buffer of the latencies of recent successful attempts.
+  private struct LatencySamples {
+    var latencies: [TimeInterval] = []
+    var nextIndex = 0
+
+    mutating func record(_ latency: TimeInterval) {
+      if latencies.count < ProviderRetryPolicy.latencySampleCapacity {
+        latencies.append(latency)
+      } else {
+        latencies[nextIndex] = latency
+      }
+      nextIndex = (nextIndex + 1) % ProviderRetryPolicy.latencySampleCapacity
+    }
+  }
+
+  /// The maximum number of attempts at a request, including the first one.
+  let maximumAttempts: Int
+
+  /// The maximum delay before the first retry.
+  let baseRetryDelay: TimeInterval
+
+  /// The maximum delay before any retry.
+  let maximumRetryDelay: TimeInterval
+
+  /// The number of retries that each request adds to the retry budget.
+  let retryBudgetRatio: Double
+
+  /// The maximum number of retries that the retry budget can hold.
+  let maximumRetryBudget: Double
+
+  /// Whether hedgeable requests are hedged.
+  let isHedgingEnabled: Bool
+
+  /// The clock that retry and hedge delays are waited on.
+  let clock: AppClock
+
+  private let lock = NSLock()
+  private var retryBudget: Double
+  private var latencySamplesByHedgeKey: [String: LatencySamples] = [:]
+
+  init(
+    maximumAttempts: Int = 3, baseRetryDelay: TimeInterval = 0.1,
+    maximumRetryDelay: TimeInterval = 2, retryBudgetRatio: Double = 0.2,
+    maximumRetryBudget: Double = 10, isHedgingEnabled: Bool = false,
+    clock: AppClock = SystemClock.shared
+  ) {
+    self.maximumAttempts = max(maximumAttempts, 1)
+    self.baseRetryDelay = baseRetryDelay
+    self.maximumRetryDelay = maximumRetryDelay
+    self.retryBudgetRatio = retryBudgetRatio
+    self.maximumRetryBudget = maximumRetryBudget
+    self.isHedgingEnabled = isHedgingEnabled
+    self.clock = clock
+    self.retryBudget = maximumRetryBudget
+  }
+
+  /// The delay after which a request with the given hedge key is sent again. It is the 95th
+  /// percentile latency of recent successful attempts with that key, or `nil` until enough of them
+  /// have been observed.
+  func hedgeDelay(for hedgeKey: String) -> TimeInterval? {
+    lock.lock()
+    let latencies = latencySamplesByHedgeKey[hedgeKey]?.latencies ?? []
+    lock.unlock()
+    guard latencies.count >= Self.minimumLatencySampleCount else { return nil }
+    let sortedLatencies = latencies.sorted()
+    let index = Int((Double(sortedLatencies.count - 1) * Self.hedgeLatencyPercentile).rounded(.up))
+    return sortedLatencies[index]
+  }
+
+  /// Loads a request, retrying it and, if it has a `hedgeKey`, hedging it. Requests with the same
+  /// hedge key share the latencies that their hedge delay is computed from.
+  ///
+  /// `load` sends one attempt at the request, and is told whether it is the first attempt. Attempts
+  /// must not supersede each other; a caller that supersedes stale requests should supersede the
+  /// whole load instead, so that a stale request's retries and hedges are cancelled too. Returns
+  /// the result of the attempt that is used, which for a request that could not be sent is the
+  /// result of its last attempt.
+  func data(
+    hedgeKey: String? = nil,
+    load: @escaping (_ isFirstAttempt: Bool) async throws -> (Data, URLResponse)
+  ) async throws -> (Data, URLResponse) {
+    lock.lock()
+    retryBudget = min(retryBudget + retryBudgetRatio, maximumRetryBudget)
+    lock.unlock()
+
+    var attemptCount = 1
+    while true {
+      let outcome: Result<(Data, URLResponse), Swift.Error>
+      if isHedgingEnabled, let hedgeKey = hedgeKey, let hedgeDelay = hedgeDelay(for: hedgeKey) {
+        outcome = await hedgedLoad(
+          isFirstAttempt: attemptCount == 1, hedgeKey: hedgeKey, hedgeDelay: hedgeDelay,
+          load: load)
+      } else {
+        outcome = await timedLoad(isFirstAttempt: attemptCount == 1, hedgeKey: hedgeKey, load: load)
+      }
+      guard Self.isRetryable(outcome), attemptCount < maximumAttempts, withdrawRetryBudget()
+      else {
+        return try outcome.get()
+      }
+      try await clock.sleep(for: retryDelay(afterAttemptCount: attemptCount))
+      attemptCount += 1
+    }
+  }
+
+  /// Loads one attempt, and a hedge if the attempt is still in flight after `hedgeDelay`.
+  ///
+  /// Returns the first outcome that isn't a failure, and cancels the other attempt. A failure is
+  /// only returned once no attempt is left in flight, preferring one that isn't retryable, unless
+  /// the attempt was cancelled, such as by a newer request for the same resource.
+  private func hedgedLoad(
+    isFirstAttempt: Bool, hedgeKey: String, hedgeDelay: TimeInterval,
+    load: @escaping (Bool) async throws -> (Data, URLResponse)
+  ) async -> Result<(Data, URLResponse), Swift.Error> {
+    await withTaskGroup(of: HedgeEvent.self) { group in
+      group.addTask {
+        .finished(
+          await self.timedLoad(isFirstAttempt: isFirstAttempt, hedgeKey: hedgeKey, load: load))
+      }
+      group.addTask {
+        (try? await self.clock.sleep(for: hedgeDelay)) != nil ? .hedgeDue : .hedgeCancelled
+      }
+
+      var inFlightCount = 1
+      var failure: Result<(Data, URLResponse), Swift.Error>?
+      while let event = await group.next() {
+        switch event {
+        case .hedgeDue:
+          // Only hedge an attempt that is still in flight.
+          guard inFlightCount == 1, withdrawRetryBudget() else { continue }
+          inFlightCount += 1
+          group.addTask {
+            .finished(await self.timedLoad(isFirstAttempt: false, hedgeKey: hedgeKey, load: load))
+          }
+        case .hedgeCancelled:
+          continue
+        case .finished(let outcome):
+          inFlightCount -= 1
+          var result = outcome
+          if Self.isFailure(outcome), !Self.isCancellation(outcome) {
+            if let earlierFailure = failure, !Self.isRetryable(earlierFailure) {
+              result = earlierFailure
+            }
+            failure = result
+            if inFlightCount > 0 {
+              // Wait for the other attempt in flight.
+              continue
+            }
+          }
+          // The other attempt and a hedge that is yet to be sent are no longer needed.
+          group.cancelAll()
+          return result
+        }
+      }
+      return failure ?? .failure(CancellationError())
+    }
+  }
+
+  /// Loads one attempt, recording its latency under `hedgeKey` if it succeeds.
+  private func timedLoad(
+    isFirstAttempt: Bool, hedgeKey: String?, load: (Bool) async throws -> (Data, URLResponse)
+  ) async -> Result<(Data, URLResponse), Swift.Error> {
+    let startTime = DispatchTime.now().uptimeNanoseconds
+    do {
+      let result = try await load(isFirstAttempt)
+      if let hedgeKey = hedgeKey, !Self.isRetryable(response: result.1) {
+        recordLatency(
+          TimeInterval(DispatchTime.now().uptimeNanoseconds - startTime) / 1e9, for: hedgeKey)
+      }
+      return .success(result)
+    } catch {
+      return .failure(error)
+    }
+  }
+
+  /// Returns a random delay before the retry that follows the given number of attempts.
+  private func retryDelay(afterAttemptCount attemptCount: Int) -> TimeInterval {
+    let maximumDelay = min(baseRetryDelay * pow(2, Double(attemptCount - 1)), maximumRetryDelay)
+    return Double.random(in: 0...maximumDelay)
+  }
+
+  /// Takes a retry out of the retry budget. Returns `false` if the budget is exhausted.
+  private func withdrawRetryBudget() -> Bool {
+    lock.lock()
+    defer { lock.unlock() }
+    guard retryBudget >= 1 else { return false }
+    retryBudget -= 1
+    return true
+  }
+
+  private func recordLatency(_ latency: TimeInterval, for hedgeKey: String) {
+    lock.lock()
+    defer { lock.unlock() }
+    latencySamplesByHedgeKey[hedgeKey, default: LatencySamples()].record(latency)
+  }
+
+  private static func isRetryable(_ outcome: Result<(Data, URLResponse), Swift.Error>) -> Bool {
+    switch outcome {
+    case .success((_, let response)):
+      return isRetryable(response: response)
+    case .failure(let error):
+      guard let urlError = error as? URLError else { return false }
+      return retryableURLErrorCodes.contains(urlError.code)
+    }
+  }
+
+  /// Returns whether an attempt failed, either with an error or with a status that a later
+  /// attempt may not get.
+  private static func isFailure(_ outcome: Result<(Data, URLResponse), Swift.Error>) -> Bool {
+    switch outcome {
+    case .success((_, let response)):
+      return isRetryable(response: response)
+    case .failure:
+      return true
+    }
+  }
+
+  private static func isCancellation(_ outcome: Result<(Data, URLResponse), Swift.Error>) -> Bool {
+    guard case .failure(let error) = outcome else { return false }
+    return error is CancellationError || (error as? URLError)?.code == .cancelled
+  }
+
+  private static func isRetryable(response: URLResponse) -> Bool {
+    guard let httpResponse = response as? HTTPURLResponse else { return false }
+    return retryableStatusCodes.contains(httpResponse.statusCode)
+  }
+}
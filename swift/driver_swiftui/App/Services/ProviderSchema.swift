@@ -0,0 +1,174 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Generated by tools/generate_provider_schema.py from tools/provider_schema.json. Do not edit.
+
+import Foundation
+import GoogleRidesharingDriver
+
+/// The status of a trip.
+enum ProviderTripStatus: String, Codable, CaseIterable {
+  case new = "NEW"
+  case enrouteToPickup = "ENROUTE_TO_PICKUP"
+  case arrivedAtPickup = "ARRIVED_AT_PICKUP"
+  case enrouteToIntermediateDestination = "ENROUTE_TO_INTERMEDIATE_DESTINATION"
+  case arrivedAtIntermediateDestination = "ARRIVED_AT_INTERMEDIATE_DESTINATION"
+  case enrouteToDropoff = "ENROUTE_TO_DROPOFF"
+  case complete = "COMPLETE"
+
+  private static let casesByRawValue = Dictionary(
+    uniqueKeysWithValues: allCases.map { ($0.rawValue, $0) })
+
+  /// Looks the raw value up in a hash table, instead of comparing it with every case.
+  init?(rawValue: String) {
+    guard let value = Self.casesByRawValue[rawValue] else { return nil }
+    self = value
+  }
+}
+
+/// The type of a trip waypoint. Decodes the provider strings to `GMTSTripWaypointType`.
+enum ProviderWaypointType {
+
+  private static let tripWaypointTypesByProviderString: [String: GMTSTripWaypointType] = [
+    "PICKUP_WAYPOINT_TYPE": .pickUp,
+    "DROP_OFF_WAYPOINT_TYPE": .dropOff,
+    "INTERMEDIATE_DESTINATION_WAYPOINT_TYPE": .intermediateDestination,
+  ]
+
+  /// Returns the value of a provider string, or `.unknown` if the string is not known.
+  static func tripWaypointType(providerString: String) -> GMTSTripWaypointType {
+    tripWaypointTypesByProviderString[providerString] ?? .unknown
+  }
+
+  /// Returns the value of a provider string given as its UTF-8 bytes, without escapes, or
+  /// `.unknown` if the string is not known.
+  static func tripWaypointType(providerBytes bytes: UnsafeRawBufferPointer)
+    -> GMTSTripWaypointType
+  {
+    switch bytes.count {
+    case 20:
+      return bytes.equals("PICKUP_WAYPOINT_TYPE") ? .pickUp : .unknown
+    case 22:
+      return bytes.equals("DROP_OFF_WAYPOINT_TYPE") ? .dropOff : .unknown
+    case 38:
+      return bytes.equals("INTERMEDIATE_DESTINATION_WAYPOINT_TYPE")
+        ? .intermediateDestination : .unknown
+    default:
+      return .unknown
+    }
+  }
+}
+
+/// URLs of the provider's endpoints, relative to the base URL of a provider replica.
+///
+/// Each URL is built by filling its path template in and resolving it in a single step.
+enum ProviderRoutes {
+
+  /// The characters that can be left unescaped in a query item value.
+  private static let urlQueryValueAllowed = CharacterSet.urlQueryAllowed.subtracting(
+    CharacterSet(charactersIn: "&=+"))
+
+  /// The token of a vehicle.
+  static func driverToken(vehicleID: String, relativeTo baseURL: URL) -> URL? {
+    guard
+      let vehicleID = vehicleID.addingPercentEncoding(withAllowedCharacters: .urlPathAllowed)
+    else {
+      return nil
+    }
+    return URL(string: "/token/driver/\(vehicleID)", relativeTo: baseURL)
+  }
+
+  /// Creates a vehicle.
+  static func createVehicle(relativeTo baseURL: URL) -> URL? {
+    URL(string: "/vehicle/new", relativeTo: baseURL)
+  }
+
+  /// Gets or updates a vehicle.
+  static func vehicle(vehicleID: String, relativeTo baseURL: URL) -> URL? {
+    guard
+      let vehicleID = vehicleID.addingPercentEncoding(withAllowedCharacters: .urlPathAllowed)
+    else {
+      return nil
+    }
+    return URL(string: "/vehicle/\(vehicleID)", relativeTo: baseURL)
+  }
+
+  /// Waits for the matched trips or waypoints of a vehicle to change.
+  static func vehicleUpdates(vehicleID: String, relativeTo baseURL: URL) -> URL? {
+    guard
+      let vehicleID = vehicleID.addingPercentEncoding(withAllowedCharacters: .urlPathAllowed)
+    else {
+      return nil
+    }
+    return URL(string: "/vehicle/\(vehicleID)/events", relativeTo: baseURL)
+  }
+
+  /// Gets or updates a trip.
+  static func trip(tripID: String, relativeTo baseURL: URL) -> URL? {
+    guard let tripID = tripID.addingPercentEncoding(withAllowedCharacters: .urlPathAllowed) else {
+      return nil
+    }
+    return URL(string: "/trip/\(tripID)", relativeTo: baseURL)
+  }
+
+  /// Gets several trips, whose comma-separated IDs are passed in tripIDs.
+  static func batchGetTrips(tripIDs: String, relativeTo baseURL: URL) -> URL? {
+    guard
+      let tripIDs = tripIDs.addingPercentEncoding(withAllowedCharacters: urlQueryValueAllowed)
+    else {
+      return nil
+    }
+    return URL(string: "/trips?tripIds=\(tripIDs)", relativeTo: baseURL)
+  }
+}
+
+/// The body of a create vehicle request.
+struct ProviderCreateVehicleRequest {
+  var vehicleID: String
+  var backToBackEnabled: Bool
+
+  /// The body of the request, keyed as the provider expects.
+  var payload: [String: Any] {
+    [
+      "vehicleId": vehicleID,
+      "backToBackEnabled": backToBackEnabled,
+    ]
+  }
+}
+
+/// The body of an update trip request.
+struct ProviderUpdateTripRequest {
+  var status: ProviderTripStatus
+  var intermediateDestinationIndex: Int?
+
+  /// The body of the request, keyed as the provider expects.
+  var payload: [String: Any] {
+    var payload: [String: Any] = [
+      "status": status.rawValue,
+    ]
+    if let intermediateDestinationIndex = intermediateDestinationIndex {
+      payload["intermediateDestinationIndex"] = intermediateDestinationIndex
+    }
+    return payload
+  }
+}
+
+extension UnsafeRawBufferPointer {
+  /// Returns whether the bytes are the UTF-8 bytes of a string.
+  fileprivate func equals(_ string: StaticString) -> Bool {
+    count == string.utf8CodeUnitCount
+      && memcmp(baseAddress!, string.utf8Start, count) == 0
+  }
+}
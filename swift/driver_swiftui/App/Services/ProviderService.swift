@@ -18,53 +18,32 @@ import GoogleRidesharingConsumer
 import GoogleRidesharingDriver
 
 private enum RPCConstants {
-  /// URL path strings.
-  static let providerCreateVehicleURLPath = "/vehicle/new"
-  static let providerGetVehicleURLPath = "/vehicle/"
-  static let providerGetTripURLPath = "/trip/"
-
-  /// Request parameter keys.
-  static let vehicleIDKey = "vehicleId"
-  static let backToBackEnabledKey = "backToBackEnabled"
-  static let statusKey = "status"
-  static let intermediateDestinationIndexKey = "intermediateDestinationIndex"
-
-  /// Response parameter keys.
-  static let nameKey = "name"
-  static let currentTripsIDsKey = "currentTripsIds"
-  static let tripKey = "trip"
-  static let tripStatusKey = "tripStatus"
-
-  static let waypointsKey = "waypoints"
-  static let locationKey = "location"
-  static let pointKey = "point"
-  static let latitudeKey = "latitude"
-  static let longitudeKey = "longitude"
-  static let tripIDKey = "tripId"
-  static let waypointTypeKey = "waypointType"
-
-  static let waypointTypePickup = "PICKUP_WAYPOINT_TYPE"
-  static let waypointTypeDropoff = "DROP_OFF_WAYPOINT_TYPE"
-  static let waypointTypeIntermediateDestination = "INTERMEDIATE_DESTINATION_WAYPOINT_TYPE"
+  /// How long a vehicle updates request may stay open. The provider completes long-poll requests
+  /// before this elapses, so reaching it means the connection was lost.
+  static let vehicleUpdatesTimeoutInterval: TimeInterval = 60
 
   /// HTTP constants.
+  static let httpAcceptHeaderField = "Accept"
   static let httpContentTypeHeaderField = "Content-Type"
+  static let httpETagHeaderField = "ETag"
+  static let httpIdempotencyKeyHeaderField = "Idempotency-Key"
+  static let httpIfNoneMatchHeaderField = "If-None-Match"
+  static let httpStatusOK = 200
+  static let httpStatusNotModified = 304
+  static let httpStatusClientErrors = 400..<500
+  /// Client errors that are worth retrying.
+  static let httpStatusRetryableClientErrors: Set<Int> = [408, 429]
+  static let httpStatusNotFound = 404
+  static let httpStatusMethodNotAllowed = 405
+  static let httpStatusNotImplemented = 501
   static let httpJSONContentType = "application/json"
+  static let httpPropertyListContentType = ProviderPayloadDecoder.Format.propertyListMIMEType
+  /// Prefers binary property list responses, which providers without support for them ignore.
+  static let httpAcceptedContentTypes = "application/x-plist, application/json;q=0.9"
   static let httpMethodPOST = "POST"
   static let httpMethodPUT = "PUT"
 }
 
-/// Provider-supported trip statuses.
-enum ProviderTripStatus: String {
-  case new = "NEW"
-  case enrouteToPickup = "ENROUTE_TO_PICKUP"
-  case arrivedAtPickup = "ARRIVED_AT_PICKUP"
-  case enrouteToIntermediateDestination = "ENROUTE_TO_INTERMEDIATE_DESTINATION"
-  case arrivedAtIntermediateDestination = "ARRIVED_AT_INTERMEDIATE_DESTINATION"
-  case enrouteToDropoff = "ENROUTE_TO_DROPOFF"
-  case complete = "COMPLETE"
-}
-
 /// A service that sends requests and receives responses from the provider backend.
 class ProviderService {
 
@@ -72,28 +51,131 @@ class ProviderService {
     case missingData
     case missingURL
     case invalidVehicleName
+    case invalidResponse
+    /// The provider has no vehicle with the requested ID.
+    case vehicleNotFound
+    /// The provider refused the request, which should not be retried.
+    case rejected(statusCode: Int)
+    /// The provider answered with a status other than the expected ones, such as a server error
+    /// that outlasted the retries.
+    case unexpectedStatus(statusCode: Int)
   }
 
-  private let session: URLSession
+  /// The trip status and waypoints of a trip, or the error fetching it.
+  typealias TripResult = Result<(ProviderTripStatus, [GMTSTripWaypoint]), Swift.Error>
 
-  init(session: URLSession = .shared) {
-    self.session = session
+  /// A change to the trips matched with a vehicle, pushed by the provider backend.
+  struct VehicleUpdate {
+    /// The current trip IDs that are matched with the vehicle.
+    let matchedTripIDs: [String]
+
+    /// An opaque tag identifying this vehicle state, passed to the next `waitForVehicleUpdate`.
+    let tag: String?
+  }
+
+  private let scheduler: ProviderRequestScheduler
+
+  /// Policy that retries failed requests. Idempotent calls are retried, and vehicle and trip
+  /// fetches are also hedged if the policy hedges. Trip status updates are retried by
+  /// `TripStatusOutbox` instead, and vehicle update long-polls are not retried.
+  let retryPolicy: ProviderRetryPolicy
+
+  /// Cache of decoded GET responses, which can be inspected for its hit, miss and 304 counts.
+  let responseCache: ProviderResponseCache
+
+  /// Latency histograms and counters of provider calls, keyed by the name of the call. The build,
+  /// network and decode phases of every call are timed, and every attempt's bytes and status code
+  /// are counted.
+  let metrics: ProviderMetrics
+
+  /// Tracer whose trace context is sent with trip fetches and updates, so that the provider can
+  /// attribute them to the step of the trip that made them.
+  let tripTracer: TripTracer
+
+  /// The clock that decoded waypoints' ETAs are estimated from.
+  let clock: AppClock
+
+  /// The maximum number of trip requests in flight when `getTrips(tripIDs:)` has to fetch trips
+  /// one at a time.
+  let maximumConcurrentTripFetches: Int
+
+  private let batchGetTripsLock = NSLock()
+  private var _isBatchGetTripsUnsupported = false
+
+  private let payloadFormatLock = NSLock()
+  private var _providerAcceptsPropertyList = false
+
+  /// Whether the provider has answered with a property list, and so also accepts property list
+  /// request bodies. Until then request bodies are sent as JSON.
+  private var providerAcceptsPropertyList: Bool {
+    get {
+      payloadFormatLock.lock()
+      defer { payloadFormatLock.unlock() }
+      return _providerAcceptsPropertyList
+    }
+    set {
+      payloadFormatLock.lock()
+      defer { payloadFormatLock.unlock() }
+      _providerAcceptsPropertyList = newValue
+    }
+  }
+
+  /// Whether the provider has reported that it has no batch get trips endpoint.
+  private var isBatchGetTripsUnsupported: Bool {
+    get {
+      batchGetTripsLock.lock()
+      defer { batchGetTripsLock.unlock() }
+      return _isBatchGetTripsUnsupported
+    }
+    set {
+      batchGetTripsLock.lock()
+      defer { batchGetTripsLock.unlock() }
+      _isBatchGetTripsUnsupported = newValue
+    }
+  }
+
+  init(
+    session: URLSession = .shared, responseCache: ProviderResponseCache = ProviderResponseCache(),
+    maximumConcurrentTripFetches: Int = 4, maximumConcurrentBackgroundRequests: Int = 4,
+    retryPolicy: ProviderRetryPolicy = .shared, endpointSet: ProviderEndpointSet = .shared,
+    metrics: ProviderMetrics = .shared, tripTracer: TripTracer = .shared,
+    clock: AppClock = SystemClock.shared
+  ) {
+    self.scheduler = ProviderRequestScheduler(
+      session: session, maximumConcurrentBackgroundRequests: maximumConcurrentBackgroundRequests,
+      endpointSet: endpointSet)
+    self.retryPolicy = retryPolicy
+    self.responseCache = responseCache
+    self.metrics = metrics
+    self.tripTracer = tripTracer
+    self.clock = clock
+    self.maximumConcurrentTripFetches = max(maximumConcurrentTripFetches, 1)
   }
 
   /// Creates a vehicle with the specified back-to-back option.
   func createVehicle(vehicleID: String, isBackToBackEnabled: Bool) async throws -> String {
-    let requestURL = ProviderUtils.providerURL(path: RPCConstants.providerCreateVehicleURLPath)
-    let payloadDict: [String: Any] =
-      [
-        RPCConstants.vehicleIDKey: vehicleID,
-        RPCConstants.backToBackEnabledKey: isBackToBackEnabled,
-      ]
-
-    let request = Self.makeJSONRequest(
+    var timer = metrics.startTimer(for: #function)
+    guard let requestURL = Self.makeCreateVehicleURL() else {
+      throw Error.missingURL
+    }
+    let payloadDict = ProviderCreateVehicleRequest(
+      vehicleID: vehicleID, backToBackEnabled: isBackToBackEnabled
+    ).payload
+
+    let request = makeRequest(
       url: requestURL, payloadDict: payloadDict, method: RPCConstants.httpMethodPOST)
-    let (data, _) = try await session.data(for: request, delegate: nil)
-    guard let parsedDictionary = try? JSONSerialization.jsonObject(with: data) as? [String: Any],
-      let vehicleName = parsedDictionary[RPCConstants.nameKey] as? String
+    timer.endPhase(.build)
+    // The provider creates the vehicle under the given ID, so a retry after a lost response finds
+    // it already created rather than creating another one.
+    let call = timer.call
+    let (data, response) = try await retryPolicy.data { isFirstAttempt in
+      try await self.send(request, call: call, isRetry: !isFirstAttempt, priority: .interactive)
+    }
+    timer.endPhase(.network)
+    let format = payloadFormat(of: response)
+    guard
+      let vehicleName = (try? ProviderPayloadDecoder.decodeVehicle(from: data, format: format))?
+        .name
     else {
       throw Error.missingData
     }
@@ -103,122 +185,442 @@ class ProviderService {
     guard let vehicleID = vehicleName.components(separatedBy: "/").last else {
       throw Error.invalidVehicleName
     }
+    timer.endPhase(.decode)
 
     return vehicleID
   }
 
-  /// Returns the current trip IDs that are matched with a vehicle.
+  /// Returns the current trip IDs that are matched with a vehicle. Throws `Error.vehicleNotFound`
+  /// if the provider has no vehicle with this ID, and `Error.unexpectedStatus` if it fails to
+  /// answer, in which case the vehicle may still exist.
   func getVehicle(vehicleID: String) async throws -> [String] {
+    var timer = metrics.startTimer(for: #function)
     guard let requestURL = Self.makeGetVehicleURL(vehicleID: vehicleID) else {
       throw Error.missingURL
     }
-    let (data, _) = try await session.data(from: requestURL, delegate: nil)
+    return try await conditionalGet(
+      url: requestURL, notFoundError: Error.vehicleNotFound, timer: &timer
+    ) { data, format in
+      // The provider answers with an empty vehicle if it doesn't have this one.
+      guard !data.isEmpty else {
+        throw Error.vehicleNotFound
+      }
+      guard let vehicle = try? ProviderPayloadDecoder.decodeVehicle(from: data, format: format)
+      else {
+        throw Error.missingData
+      }
+      guard let currentTripsIDs = vehicle.matchedTripIDs else {
+        throw vehicle.name == nil ? Error.vehicleNotFound : Error.missingData
+      }
+      return currentTripsIDs
+    }
+  }
 
-    guard let parsedDictionary = try? JSONSerialization.jsonObject(with: data) as? [String: Any],
-      let currentTripsIDs = parsedDictionary[RPCConstants.currentTripsIDsKey] as? [String]
-    else {
-      throw Error.missingData
+  /// Waits for the trips matched with a vehicle to differ from the state identified by `lastTag`.
+  ///
+  /// The provider holds the request open until the vehicle changes or its long-poll window
+  /// elapses, in which case this returns `nil`. Passing a `nil` tag returns the current state
+  /// immediately. Throws if the provider does not support vehicle updates, in which case callers
+  /// should fall back to polling `getVehicle(vehicleID:)`.
+  func waitForVehicleUpdate(vehicleID: String, lastTag: String?) async throws -> VehicleUpdate? {
+    var timer = metrics.startTimer(for: #function)
+    guard let requestURL = Self.makeVehicleUpdatesURL(vehicleID: vehicleID) else {
+      throw Error.missingURL
+    }
+    var request = Self.makeGetRequest(
+      url: requestURL, timeoutInterval: RPCConstants.vehicleUpdatesTimeoutInterval)
+    request.setValue(lastTag, forHTTPHeaderField: RPCConstants.httpIfNoneMatchHeaderField)
+    timer.endPhase(.build)
+    let (data, response) = try await send(
+      request, call: timer.call, priority: .background, resourceKey: requestURL.absoluteString,
+      isLongPoll: true)
+    timer.endPhase(.network)
+
+    guard let httpResponse = response as? HTTPURLResponse else {
+      throw Error.invalidResponse
+    }
+    switch httpResponse.statusCode {
+    case RPCConstants.httpStatusNotModified:
+      return nil
+    case RPCConstants.httpStatusOK:
+      let format = payloadFormat(of: httpResponse)
+      guard
+        let currentTripsIDs =
+          (try? ProviderPayloadDecoder.decodeVehicle(from: data, format: format))?.matchedTripIDs
+      else {
+        throw Error.missingData
+      }
+      let tag = httpResponse.value(forHTTPHeaderField: RPCConstants.httpETagHeaderField)
+      timer.endPhase(.decode)
+      return VehicleUpdate(matchedTripIDs: currentTripsIDs, tag: tag)
+    default:
+      throw Error.invalidResponse
     }
-    return currentTripsIDs
   }
 
   /// Returns the trip status and waypoints of a trip.
   func getTrip(tripID: String) async throws -> (ProviderTripStatus, [GMTSTripWaypoint]) {
+    var timer = metrics.startTimer(for: #function)
     guard let requestURL = Self.makeGetTripURL(tripID: tripID) else {
       throw Error.missingURL
     }
-    let (data, _) = try await session.data(from: requestURL)
+    let clock = self.clock
+    return try await conditionalGet(url: requestURL, tripID: tripID, timer: &timer) {
+      data, format in
+      try Self.decodeTrip(from: data, tripID: tripID, format: format, currentTime: clock.now)
+    }
+  }
+
+  /// Decodes the trip status and waypoints of a get trip response. The waypoints' ETAs are
+  /// estimated from `currentTime`, in seconds since 1970.
+  static func decodeTrip(
+    from data: Data, tripID: String, format: ProviderPayloadDecoder.Format = .json,
+    currentTime: TimeInterval
+  ) throws -> (ProviderTripStatus, [GMTSTripWaypoint]) {
+    guard let trip = try? ProviderPayloadDecoder.decodeTripResponse(from: data, format: format)
+    else {
+      throw Error.missingData
+    }
+    return try makeTrip(trip, tripID: tripID, currentTime: currentTime)
+  }
+
+  /// Returns the trip status and waypoints of several trips, or the error fetching each trip,
+  /// keyed by trip ID. A trip that can't be fetched doesn't keep the others from being returned.
+  ///
+  /// Uses the provider's batch endpoint when it is available, and otherwise fetches the trips
+  /// concurrently with at most `maximumConcurrentTripFetches` requests in flight.
+  func getTrips(tripIDs: [String]) async -> [String: TripResult] {
+    var seenTripIDs = Set<String>()
+    let uniqueTripIDs = tripIDs.filter { seenTripIDs.insert($0).inserted }
+    if uniqueTripIDs.count > 1, !isBatchGetTripsUnsupported {
+      do {
+        if let trips = try await batchGetTrips(tripIDs: uniqueTripIDs) {
+          return trips
+        }
+      } catch {
+        // The batch request failed as a whole, so every trip in it failed.
+        return Dictionary(uniqueKeysWithValues: uniqueTripIDs.map { ($0, .failure(error)) })
+      }
+    }
+
+    return await withTaskGroup(of: (String, TripResult).self) { group in
+      var remainingTripIDs = uniqueTripIDs.makeIterator()
+      for _ in 0..<maximumConcurrentTripFetches {
+        guard let tripID = remainingTripIDs.next() else { break }
+        group.addTask { (tripID, await self.getTripResult(tripID: tripID)) }
+      }
+
+      var trips: [String: TripResult] = [:]
+      while let (tripID, trip) = await group.next() {
+        trips[tripID] = trip
+        if let nextTripID = remainingTripIDs.next() {
+          group.addTask { (nextTripID, await self.getTripResult(tripID: nextTripID)) }
+        }
+      }
+      return trips
+    }
+  }
+
+  /// Returns the trip status and waypoints of a trip, or the error fetching it.
+  private func getTripResult(tripID: String) async -> TripResult {
+    do {
+      return .success(try await getTrip(tripID: tripID))
+    } catch {
+      return .failure(error)
+    }
+  }
+
+  /// Fetches several trips with a single request. Returns `nil` if the provider has no batch
+  /// endpoint. Throws if the request fails as a whole; a trip that is missing from the response or
+  /// can't be decoded fails on its own.
+  private func batchGetTrips(tripIDs: [String]) async throws -> [String: TripResult]? {
+    var timer = metrics.startTimer(for: #function)
+    guard let requestURL = Self.makeBatchGetTripsURL(tripIDs: tripIDs) else {
+      throw Error.missingURL
+    }
+    var request = Self.makeGetRequest(url: requestURL)
+    // A request carries a single trace context, so a batch is traced as part of its first trip.
+    if let tripID = tripIDs.first {
+      request.setValue(
+        tripTracer.traceHeaderValue(tripID: tripID),
+        forHTTPHeaderField: TripTracer.traceHeaderField)
+    }
+    timer.endPhase(.build)
+    let (data, response) = try await backgroundData(
+      for: request, resourceKey: requestURL, call: timer.call)
+    timer.endPhase(.network)
+
+    let statusCode = (response as? HTTPURLResponse)?.statusCode
+    switch statusCode {
+    case RPCConstants.httpStatusNotFound, RPCConstants.httpStatusMethodNotAllowed,
+      RPCConstants.httpStatusNotImplemented:
+      isBatchGetTripsUnsupported = true
+      return nil
+    case RPCConstants.httpStatusOK:
+      break
+    default:
+      throw Error.invalidResponse
+    }
+
+    let format = payloadFormat(of: response)
     guard
-      let parsedDictionary = try? JSONSerialization.jsonObject(with: data) as? [String: Any],
-      let tripJSON = parsedDictionary[RPCConstants.tripKey] as? [String: Any],
-      let tripStatusString = tripJSON[RPCConstants.tripStatusKey] as? String,
-      let tripStatus = ProviderTripStatus(rawValue: tripStatusString),
-      let waypointsJSON = tripJSON[RPCConstants.waypointsKey] as? [[String: Any]],
-      let waypoints =
-        try? waypointsJSON.map({ try Self.makeWaypoint(waypointJSON: $0, tripID: tripID) })
+      let decodedTrips = try? ProviderPayloadDecoder.decodeTripsResponse(from: data, format: format)
     else {
       throw Error.missingData
     }
-    return (tripStatus, waypoints)
+    var trips: [String: TripResult] = [:]
+    let currentTime = clock.now
+    for trip in decodedTrips {
+      // Provider returns fully qualified trip name in this form:
+      // 'providers/providerID/trips/tripID'. So strip the prefix from it. A trip without a name
+      // can't be matched to a requested ID, so it is left out.
+      guard let tripID = trip.name?.components(separatedBy: "/").last else { continue }
+      trips[tripID] = Result { try Self.makeTrip(trip, tripID: tripID, currentTime: currentTime) }
+    }
+    for tripID in tripIDs where trips[tripID] == nil {
+      trips[tripID] = .failure(Error.missingData)
+    }
+    timer.endPhase(.decode)
+    return trips
   }
 
   /// Updates the trip status and optionally the intermediate destination index of a trip.
+  ///
+  /// Requests with the same `idempotencyKey` are applied by the provider only once, so an update
+  /// can be safely sent again when its response was lost. Throws `Error.rejected` if the provider
+  /// refuses the update.
   func updateTrip(
-    tripID: String, status: ProviderTripStatus, intermediateDestinationIndex: Int?
+    tripID: String, status: ProviderTripStatus, intermediateDestinationIndex: Int?,
+    idempotencyKey: String? = nil
   ) async throws {
+    var timer = metrics.startTimer(for: #function)
     guard let requestURL = Self.makeUpdateTripURL(tripID: tripID) else {
       throw Error.missingURL
     }
-    var payloadDict: [String: Any] = [RPCConstants.statusKey: status.rawValue]
-    if let intermediateDestinationIndex = intermediateDestinationIndex {
-      payloadDict[RPCConstants.intermediateDestinationIndexKey] = intermediateDestinationIndex
-    }
+    let payloadDict = ProviderUpdateTripRequest(
+      status: status, intermediateDestinationIndex: intermediateDestinationIndex
+    ).payload
 
-    let request = Self.makeJSONRequest(
+    var request = makeRequest(
       url: requestURL, payloadDict: payloadDict, method: RPCConstants.httpMethodPUT)
+    request.setValue(
+      idempotencyKey, forHTTPHeaderField: RPCConstants.httpIdempotencyKeyHeaderField)
+    request.setValue(
+      tripTracer.traceHeaderValue(tripID: tripID), forHTTPHeaderField: TripTracer.traceHeaderField)
+    timer.endPhase(.build)
+
+    let (_, response) = try await send(request, call: timer.call, priority: .interactive)
+    timer.endPhase(.network)
+    if let statusCode = (response as? HTTPURLResponse)?.statusCode {
+      if RPCConstants.httpStatusClientErrors.contains(statusCode)
+        && !RPCConstants.httpStatusRetryableClientErrors.contains(statusCode)
+      {
+        throw Error.rejected(statusCode: statusCode)
+      } else if statusCode != RPCConstants.httpStatusOK {
+        throw Error.invalidResponse
+      }
+    }
+  }
+
+  /// Sends a GET request that the provider may answer with 304 Not Modified, in which case the
+  /// cached body is decoded again instead of downloading a new one, so that values derived from
+  /// the current time, such as ETAs, are up to date. The request is sent in the background and
+  /// supersedes any request for the same URL still in flight. Its phases are timed with `timer`,
+  /// and it carries the trace context of `tripID` if it is about a trip.
+  ///
+  /// Only 200 and 304 responses are decoded. A 404 throws `notFoundError`, and any other status
+  /// throws `Error.unexpectedStatus`.
+  private func conditionalGet<Value>(
+    url: URL, tripID: String? = nil, notFoundError: Swift.Error = Error.missingData,
+    timer: inout ProviderMetrics.CallTimer,
+    decode: (Data, ProviderPayloadDecoder.Format) throws -> Value
+  ) async throws -> Value {
+    var request = Self.makeGetRequest(url: url)
+    if let tripID = tripID {
+      request.setValue(
+        tripTracer.traceHeaderValue(tripID: tripID),
+        forHTTPHeaderField: TripTracer.traceHeaderField)
+    }
+    responseCache.addValidators(to: &request)
+    timer.endPhase(.build)
+    let (data, response) = try await backgroundData(
+      for: request, resourceKey: url, call: timer.call)
+    timer.endPhase(.network)
+    guard let httpResponse = response as? HTTPURLResponse else {
+      let value = try decode(data, payloadFormat(of: response))
+      timer.endPhase(.decode)
+      return value
+    }
 
-    let _ = try await session.data(for: request, delegate: nil)
+    switch httpResponse.statusCode {
+    case RPCConstants.httpStatusOK:
+      let value = try decode(data, payloadFormat(of: httpResponse))
+      responseCache.store(data, for: httpResponse, url: url)
+      timer.endPhase(.decode)
+      return value
+    case RPCConstants.httpStatusNotModified:
+      guard let cached = responseCache.cachedResponse(forNotModifiedResponseTo: url) else {
+        throw Error.missingData
+      }
+      let value = try decode(cached.body, payloadFormat(of: cached.response))
+      timer.endPhase(.decode)
+      return value
+    case RPCConstants.httpStatusNotFound:
+      throw notFoundError
+    default:
+      throw Error.unexpectedStatus(statusCode: httpResponse.statusCode)
+    }
   }
 
-  /// Creates a `GMTSTripWaypoint` from a waypoint JSON returned by the provider backend.
-  private static func makeWaypoint(waypointJSON: [String: Any], tripID: String) throws
-    -> GMTSTripWaypoint
+  /// Sends a background GET request, which is retried, and hedged once it takes longer than `call`
+  /// usually does. The request as a whole, including a retry that is waiting out its delay,
+  /// supersedes earlier requests for the same resource.
+  private func backgroundData(for request: URLRequest, resourceKey: URL, call: String)
+    async throws -> (Data, URLResponse)
   {
-    guard let locationJSON = waypointJSON[RPCConstants.locationKey] as? [String: Any],
-      let pointJSON = locationJSON[RPCConstants.pointKey] as? [String: Any],
-      let latitude = pointJSON[RPCConstants.latitudeKey] as? Double,
-      let longitude = pointJSON[RPCConstants.longitudeKey] as? Double,
-      let waypointTypeString = waypointJSON[RPCConstants.waypointTypeKey] as? String
+    try await scheduler.superseding(resourceKey: resourceKey.absoluteString) {
+      try await self.retryPolicy.data(hedgeKey: call) { isFirstAttempt in
+        try await self.send(request, call: call, isRetry: !isFirstAttempt, priority: .background)
+      }
+    }
+  }
+
+  /// Sends one attempt at a call's request through the scheduler, counting it and its outcome in
+  /// `metrics`.
+  private func send(
+    _ request: URLRequest, call: String, isRetry: Bool = false,
+    priority: ProviderRequestScheduler.Priority, resourceKey: String? = nil,
+    isLongPoll: Bool = false
+  ) async throws -> (Data, URLResponse) {
+    metrics.recordAttempt(request, isRetry: isRetry, for: call)
+    do {
+      let (data, response) = try await scheduler.data(
+        for: request, priority: priority, resourceKey: resourceKey, isLongPoll: isLongPoll)
+      metrics.recordResponse(response, data: data, error: nil, to: request, for: call)
+      return (data, response)
+    } catch {
+      metrics.recordResponse(nil, data: nil, error: error, to: request, for: call)
+      throw error
+    }
+  }
+
+  /// Creates the trip status and waypoints from a trip returned by the provider backend.
+  private static func makeTrip(
+    _ trip: ProviderPayloadDecoder.Trip, tripID: String, currentTime: TimeInterval
+  ) throws -> (ProviderTripStatus, [GMTSTripWaypoint]) {
+    guard let tripStatusString = trip.tripStatus,
+      let tripStatus = ProviderTripStatus(rawValue: tripStatusString),
+      let waypoints = trip.waypoints
     else {
       throw Error.missingData
     }
+    return (
+      tripStatus, try makeWaypoints(waypoints, tripID: tripID, currentTime: currentTime)
+    )
+  }
 
-    let latLng = GMTSLatLng(latitude: latitude, longitude: longitude)
-    let terminalLocation = GMTSTerminalLocation(
-      point: latLng, label: nil, description: nil, placeID: nil, generatedID: nil,
-      accessPointID: nil)
+  /// Creates `GMTSTripWaypoint`s from the waypoints of a trip returned by the provider backend.
+  ///
+  /// The response doesn't include the leg distances and ETAs, so they are estimated for all the
+  /// waypoints at once. The vehicle's position isn't known here, so the first waypoint is treated
+  /// as reached at `currentTime`, and each later one as reached along great-circle legs.
+  private static func makeWaypoints(
+    _ waypoints: [ProviderPayloadDecoder.Waypoint], tripID: String, currentTime: TimeInterval
+  ) throws -> [GMTSTripWaypoint] {
+    var latitudes: [Double] = []
+    var longitudes: [Double] = []
+    var waypointTypes: [GMTSTripWaypointType] = []
+    latitudes.reserveCapacity(waypoints.count)
+    longitudes.reserveCapacity(waypoints.count)
+    waypointTypes.reserveCapacity(waypoints.count)
+    for waypoint in waypoints {
+      guard let latitude = waypoint.latitude,
+        let longitude = waypoint.longitude,
+        let waypointType = waypoint.waypointType
+      else {
+        throw Error.missingData
+      }
+      latitudes.append(latitude)
+      longitudes.append(longitude)
+      waypointTypes.append(waypointType)
+    }
 
-    let waypointType: GMTSTripWaypointType
-    switch waypointTypeString {
-    case RPCConstants.waypointTypePickup:
-      waypointType = .pickUp
-    case RPCConstants.waypointTypeDropoff:
-      waypointType = .dropOff
-    case RPCConstants.waypointTypeIntermediateDestination:
-      waypointType = .intermediateDestination
-    default:
-      waypointType = .unknown
+    let legDistances = WaypointGeometry.legDistances(latitudes: latitudes, longitudes: longitudes)
+    let arrivalTimes = WaypointGeometry.arrivalTimes(
+      legDistances: legDistances, departureTime: currentTime)
+    return waypoints.indices.map { index in
+      let latLng = GMTSLatLng(latitude: latitudes[index], longitude: longitudes[index])
+      let terminalLocation = GMTSTerminalLocation(
+        point: latLng, label: nil, description: nil, placeID: nil, generatedID: nil,
+        accessPointID: nil)
+      return GMTSTripWaypoint(
+        location: terminalLocation, tripID: tripID, waypointType: waypointTypes[index],
+        distanceToPreviousWaypointInMeters: legDistances[index], eta: arrivalTimes[index])
     }
+  }
 
-    return GMTSTripWaypoint(
-      location: terminalLocation, tripID: tripID, waypointType: waypointType,
-      distanceToPreviousWaypointInMeters: 0, eta: 0)
+  /// Returns the format of a provider response, and notes whether the provider speaks property
+  /// lists so that later request bodies can be sent as one.
+  private func payloadFormat(of response: URLResponse) -> ProviderPayloadDecoder.Format {
+    let format = ProviderPayloadDecoder.Format(mimeType: response.mimeType)
+    if format == .propertyList && !providerAcceptsPropertyList {
+      providerAcceptsPropertyList = true
+    }
+    return format
   }
 
-  private static func makeJSONRequest(url: URL, payloadDict: [String: Any], method: String)
-    -> URLRequest
-  {
-    let serializedPayload = try! JSONSerialization.data(withJSONObject: payloadDict)
+  /// Creates a request with a body, encoded as a binary property list if the provider has sent one
+  /// and as JSON otherwise.
+  private func makeRequest(url: URL, payloadDict: [String: Any], method: String) -> URLRequest {
     var request = URLRequest(url: url)
     request.httpMethod = method
     request.setValue(
-      RPCConstants.httpJSONContentType, forHTTPHeaderField: RPCConstants.httpContentTypeHeaderField)
-    request.httpBody = serializedPayload
+      RPCConstants.httpAcceptedContentTypes, forHTTPHeaderField: RPCConstants.httpAcceptHeaderField)
+    if providerAcceptsPropertyList {
+      request.setValue(
+        RPCConstants.httpPropertyListContentType,
+        forHTTPHeaderField: RPCConstants.httpContentTypeHeaderField)
+      request.httpBody = try! PropertyListSerialization.data(
+        fromPropertyList: payloadDict, format: .binary, options: 0)
+    } else {
+      request.setValue(
+        RPCConstants.httpJSONContentType,
+        forHTTPHeaderField: RPCConstants.httpContentTypeHeaderField)
+      request.httpBody = try! JSONSerialization.data(withJSONObject: payloadDict)
+    }
+    return request
+  }
+
+  private static func makeGetRequest(url: URL, timeoutInterval: TimeInterval = 60) -> URLRequest {
+    var request = URLRequest(
+      url: url, cachePolicy: .reloadIgnoringLocalCacheData, timeoutInterval: timeoutInterval)
+    request.setValue(
+      RPCConstants.httpAcceptedContentTypes, forHTTPHeaderField: RPCConstants.httpAcceptHeaderField)
     return request
   }
 
+  private static func makeCreateVehicleURL() -> URL? {
+    ProviderRoutes.createVehicle(relativeTo: ProviderUtils.providerBaseURL)
+  }
+
   private static func makeGetVehicleURL(vehicleID: String) -> URL? {
-    let providerURL = ProviderUtils.providerURL(path: RPCConstants.providerGetVehicleURLPath)
-    return URL(string: vehicleID, relativeTo: providerURL)
+    ProviderRoutes.vehicle(vehicleID: vehicleID, relativeTo: ProviderUtils.providerBaseURL)
+  }
+
+  private static func makeVehicleUpdatesURL(vehicleID: String) -> URL? {
+    ProviderRoutes.vehicleUpdates(vehicleID: vehicleID, relativeTo: ProviderUtils.providerBaseURL)
   }
 
   private static func makeGetTripURL(tripID: String) -> URL? {
-    let providerURL = ProviderUtils.providerURL(path: RPCConstants.providerGetTripURLPath)
-    return URL(string: tripID, relativeTo: providerURL)
+    ProviderRoutes.trip(tripID: tripID, relativeTo: ProviderUtils.providerBaseURL)
+  }
+
+  private static func makeBatchGetTripsURL(tripIDs: [String]) -> URL? {
+    ProviderRoutes.batchGetTrips(
+      tripIDs: tripIDs.joined(separator: ","), relativeTo: ProviderUtils.providerBaseURL)
   }
 
   private static func makeUpdateTripURL(tripID: String) -> URL? {
-    let providerURL = ProviderUtils.providerURL(path: RPCConstants.providerGetTripURLPath)
-    return URL(string: tripID, relativeTo: providerURL)
+    ProviderRoutes.trip(tripID: tripID, relativeTo: ProviderUtils.providerBaseURL)
   }
 }
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import Foundation
+import GoogleMaps
+import GoogleRidesharingDriver
+
+/// The navigation calls that `RoutePlanner` makes, which `GMSNavigator` implements.
+protocol RouteNavigator: AnyObject {
+  func setDestinations(
+    _ destinations: [GMSNavigationWaypoint], callback: @escaping GMSRouteStatusCallback)
+
+  @discardableResult
+  func continueToNextDestination() -> GMSNavigationWaypoint?
+
+  func clearDestinations()
+}
+
+extension GMSNavigator: RouteNavigator {}
+
+/// Plans the navigator's route through the remaining waypoints of the current trips.
+///
+/// The navigator is given up to `maximumDestinationCount` waypoints at a time, so that one route is
+/// computed for several stops instead of one per stop. When a stop is reached the navigator
+/// continues along the route it already has, and a new route is only computed once the planned
+/// waypoints run out or the remaining waypoints no longer start with them.
+final class RoutePlanner {
+
+  /// The number of waypoints the navigator is given at a time by default.
+  static let defaultMaximumDestinationCount = 5
+
+  /// The navigator that routes are planned for, which is `nil` until navigation is enabled.
+  weak var navigator: RouteNavigator?
+
+  /// The maximum number of waypoints the navigator is given at a time.
+  let maximumDestinationCount: Int
+
+  /// The waypoints that the navigator's destinations lead to, in order.
+  private(set) var plannedWaypoints: [GMTSTripWaypoint] = []
+
+  /// The number of routes that have been computed.
+  private(set) var routeComputationCount = 0
+
+  /// The completions waiting for the route being computed, or `nil` if it is ready.
+  private var pendingCompletions: [GMSRouteStatusCallback]?
+
+  /// Incremented for each route, so that the callback of a superseded route is ignored.
+  private var routeGeneration = 0
+
+  init(
+    navigator: RouteNavigator? = nil,
+    maximumDestinationCount: Int = RoutePlanner.defaultMaximumDestinationCount
+  ) {
+    self.navigator = navigator
+    self.maximumDestinationCount = max(maximumDestinationCount, 1)
+  }
+
+  /// Routes the navigator to the first of the remaining waypoints, and through as many of the
+  /// next ones as it is given at a time.
+  ///
+  /// `completion` is called once with the status of the route when it is ready, which is right away
+  /// if the navigator's route still leads through the first waypoints. It is called with
+  /// `.canceled` if the route is superseded or cleared before then, and with `.waypointError` if a
+  /// waypoint has no location.
+  func planRoute(
+    through waypoints: [GMTSTripWaypoint], completion: @escaping GMSRouteStatusCallback
+  ) {
+    planRoute(through: waypoints, minimumPlannedCount: 1, completion: completion)
+  }
+
+  /// Routes the navigator through as many of the remaining waypoints as it is given at a time, even
+  /// if its route already leads to the first of them.
+  ///
+  /// Used when waypoints are appended past the end of the planned route, such as those of the next
+  /// back-to-back trip, so that the legs to them are computed before the driver needs them. A new
+  /// route is only computed if the planned one stops short of them.
+  func extendRoute(
+    through waypoints: [GMTSTripWaypoint], completion: @escaping GMSRouteStatusCallback
+  ) {
+    planRoute(
+      through: waypoints, minimumPlannedCount: min(waypoints.count, maximumDestinationCount),
+      completion: completion)
+  }
+
+  private func planRoute(
+    through waypoints: [GMTSTripWaypoint], minimumPlannedCount: Int,
+    completion: @escaping GMSRouteStatusCallback
+  ) {
+    guard let navigator = navigator else {
+      completion(.canceled)
+      return
+    }
+    guard !waypoints.isEmpty else {
+      completion(.noWaypointsError)
+      return
+    }
+
+    if pendingCompletions == nil, plannedWaypoints.count > 1,
+      !Self.waypoints(waypoints, startWith: plannedWaypoints),
+      Self.waypoints(waypoints, startWith: plannedWaypoints.dropFirst())
+    {
+      // The first planned waypoint was reached without the navigator arriving at it.
+      plannedWaypoints.removeFirst()
+      navigator.continueToNextDestination()
+    }
+    if plannedWaypoints.count >= minimumPlannedCount
+      && Self.waypoints(waypoints, startWith: plannedWaypoints)
+    {
+      if pendingCompletions != nil {
+        pendingCompletions?.append(completion)
+      } else {
+        completion(.OK)
+      }
+      return
+    }
+
+    let destinations = waypoints.prefix(maximumDestinationCount)
+    let navigationWaypoints = destinations.compactMap { waypoint -> GMSNavigationWaypoint? in
+      guard let coordinate = waypoint.location?.point?.coordinate() else { return nil }
+      return GMSNavigationWaypoint(location: coordinate, title: "")
+    }
+    guard navigationWaypoints.count == destinations.count else {
+      completion(.waypointError)
+      return
+    }
+
+    // A route that is extended still leads through the waypoints that the route being computed
+    // was waited for. Any other route being computed is superseded.
+    let isExtendingRoute = Self.waypoints(Array(destinations), startWith: plannedWaypoints)
+    let extendedCompletions = isExtendingRoute ? pendingCompletions ?? [] : []
+    let supersededCompletions = isExtendingRoute ? [] : pendingCompletions ?? []
+    routeGeneration += 1
+    let generation = routeGeneration
+    plannedWaypoints = Array(destinations)
+    pendingCompletions = extendedCompletions + [completion]
+    routeComputationCount += 1
+    navigator.setDestinations(navigationWaypoints) { [weak self] routeStatus in
+      guard let self = self, generation == self.routeGeneration else { return }
+      if routeStatus != .OK {
+        self.plannedWaypoints = []
+      }
+      let completions = self.pendingCompletions ?? []
+      self.pendingCompletions = nil
+      for completion in completions {
+        completion(routeStatus)
+      }
+    }
+    for supersededCompletion in supersededCompletions {
+      supersededCompletion(.canceled)
+    }
+  }
+
+  /// Continues along the planned route once the navigator arrives at its first waypoint, without
+  /// computing a new route.
+  func didArrive() {
+    guard pendingCompletions == nil, !plannedWaypoints.isEmpty else { return }
+    plannedWaypoints.removeFirst()
+    if !plannedWaypoints.isEmpty {
+      navigator?.continueToNextDestination()
+    }
+  }
+
+  /// Clears the navigator's route, cancelling the route being computed.
+  func clearRoute() {
+    let cancelledCompletions = pendingCompletions ?? []
+    routeGeneration += 1
+    plannedWaypoints = []
+    pendingCompletions = nil
+    navigator?.clearDestinations()
+    for cancelledCompletion in cancelledCompletions {
+      cancelledCompletion(.canceled)
+    }
+  }
+
+  /// Returns whether `waypoints` start with the same waypoints as `prefix`.
+  private static func waypoints<Prefix: Collection>(
+    _ waypoints: [GMTSTripWaypoint], startWith prefix: Prefix
+  ) -> Bool where Prefix.Element == GMTSTripWaypoint {
+    guard prefix.count <= waypoints.count else { return false }
+    return WaypointDiff.between(Array(waypoints.prefix(prefix.count)), Array(prefix)).isEmpty
+  }
+}
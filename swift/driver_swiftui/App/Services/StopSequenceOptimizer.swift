@@ -0,0 +1,346 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import CoreLocation
+import Foundation
+import GoogleRidesharingDriver
+
+/// Proposes a shorter order for the remaining stops of a vehicle's matched trips.
+///
+/// The provider decides the order in which a shared or back-to-back vehicle visits its stops, and
+/// the driver apps follow it. The optimizer looks for a shorter order that the provider could
+/// adopt. Each trip's stops keep their order, so pickups stay before intermediate destinations and
+/// dropoffs, and the vehicle never carries more than `maximumCapacity` trips at once. The first
+/// stop stays first, since the vehicle is already heading to it.
+///
+/// Stops are inserted trip by trip at their cheapest feasible position, and the order is then
+/// improved by moving one stop at a time until no move shortens it or `timeBudget` runs out. Legs
+/// are measured as great-circle distances.
+struct StopSequenceOptimizer {
+
+  /// A proposed order for the stops.
+  struct Proposal {
+    /// The stops in the proposed order.
+    let waypoints: [GMTSTripWaypoint]
+
+    /// The length of the route in the proposed order, in meters.
+    let distance: Double
+
+    /// The length of the route in the original order, in meters.
+    let originalDistance: Double
+
+    /// Whether the proposed order differs from the original one.
+    let isReordered: Bool
+  }
+
+  /// The most trips the vehicle can carry at once.
+  var maximumCapacity: Int
+
+  /// How long the local search may run for, after the stops are inserted.
+  var timeBudget: TimeInterval
+
+  init(maximumCapacity: Int, timeBudget: TimeInterval = 0.05) {
+    self.maximumCapacity = maximumCapacity
+    self.timeBudget = timeBudget
+  }
+
+  /// Returns the shortest order found for the stops. The original order is kept if no shorter
+  /// feasible order is found.
+  func propose(for waypoints: [GMTSTripWaypoint]) -> Proposal {
+    let deadline = ProcessInfo.processInfo.systemUptime + timeBudget
+    let instance = Instance(waypoints: waypoints)
+    let originalOrder = Array(waypoints.indices)
+    let originalDistance = instance.distance(of: originalOrder)
+
+    var search = Search(instance: instance, capacity: maximumCapacity)
+    search.insertStops()
+    search.relocateStops(until: deadline)
+
+    let distance = instance.distance(of: search.order)
+    guard search.order != originalOrder, distance < originalDistance,
+      instance.isFeasible(search.order, capacity: maximumCapacity)
+    else {
+      return Proposal(
+        waypoints: waypoints, distance: originalDistance, originalDistance: originalDistance,
+        isReordered: false)
+    }
+    return Proposal(
+      waypoints: search.order.map { waypoints[$0] }, distance: distance,
+      originalDistance: originalDistance, isReordered: true)
+  }
+}
+
+/// The stops to order, and the constraints on their order.
+private struct Instance {
+  let count: Int
+
+  /// The previous stop of each stop's trip, or -1 for its first stop.
+  let predecessors: [Int]
+
+  /// The next stop of each stop's trip, or -1 for its last stop.
+  let successors: [Int]
+
+  /// How many trips the vehicle carries more after each stop.
+  let loadDeltas: [Int]
+
+  /// The number of trips on board before the first stop, whose pickups are behind the vehicle.
+  let initialLoad: Int
+
+  /// The trips' stops in the order they are inserted, one array per trip.
+  let tripStops: [[Int]]
+
+  /// The distance between every two stops, in meters, row by row.
+  private let distances: [Double]
+
+  init(waypoints: [GMTSTripWaypoint]) {
+    count = waypoints.count
+    var predecessors = [Int](repeating: -1, count: count)
+    var successors = [Int](repeating: -1, count: count)
+    var loadDeltas = [Int](repeating: 0, count: count)
+    var tripIndexByTripID: [String: Int] = [:]
+    var pickedUpTripIDs: Set<String> = []
+    var tripStops: [[Int]] = []
+    var initialLoad = 0
+    for (index, waypoint) in waypoints.enumerated() {
+      // Stops without a trip are kept in place relative to each other.
+      let tripID = (waypoint.tripID as String?) ?? ""
+      if let tripIndex = tripIndexByTripID[tripID], let previous = tripStops[tripIndex].last {
+        predecessors[index] = previous
+        successors[previous] = index
+        tripStops[tripIndex].append(index)
+      } else {
+        tripIndexByTripID[tripID] = tripStops.count
+        tripStops.append([index])
+      }
+
+      switch waypoint.waypointType {
+      case .pickUp:
+        loadDeltas[index] = 1
+        pickedUpTripIDs.insert(tripID)
+      case .dropOff:
+        loadDeltas[index] = -1
+        // A dropoff whose pickup is not among the stops is for a trip already on board.
+        if !pickedUpTripIDs.contains(tripID) {
+          initialLoad += 1
+        }
+      default:
+        break
+      }
+    }
+    self.predecessors = predecessors
+    self.successors = successors
+    self.loadDeltas = loadDeltas
+    self.initialLoad = initialLoad
+
+    // The first stop's trip goes first, then the trips already on board, whose dropoffs free
+    // capacity for the others.
+    let otherTripStops = tripStops.dropFirst()
+    self.tripStops =
+      Array(tripStops.prefix(1)) + otherTripStops.filter { loadDeltas[$0[0]] <= 0 }
+      + otherTripStops.filter { loadDeltas[$0[0]] > 0 }
+
+    let coordinates = waypoints.map { waypoint -> CLLocationCoordinate2D in
+      waypoint.location?.point?.coordinate() ?? kCLLocationCoordinate2DInvalid
+    }
+    var distances = [Double](repeating: 0, count: count * count)
+    for from in 0..<count {
+      for to in (from + 1)..<count {
+        let distance = Self.greatCircleDistance(coordinates[from], coordinates[to])
+        distances[from * count + to] = distance
+        distances[to * count + from] = distance
+      }
+    }
+    self.distances = distances
+  }
+
+  func distance(_ from: Int, _ to: Int) -> Double {
+    distances[from * count + to]
+  }
+
+  func distance(of order: [Int]) -> Double {
+    zip(order, order.dropFirst()).reduce(0) { $0 + distance($1.0, $1.1) }
+  }
+
+  /// Returns whether an order visits every trip's stops in order without exceeding `capacity`.
+  func isFeasible(_ order: [Int], capacity: Int) -> Bool {
+    var positions = [Int](repeating: -1, count: count)
+    var load = initialLoad
+    for (position, stop) in order.enumerated() {
+      positions[stop] = position
+      let predecessor = predecessors[stop]
+      if predecessor >= 0 && positions[predecessor] < 0 {
+        return false
+      }
+      load += loadDeltas[stop]
+      if loadDeltas[stop] > 0 && load > capacity {
+        return false
+      }
+    }
+    return order.count == count
+  }
+
+  /// Returns the great-circle distance between two coordinates, in meters.
+  static func greatCircleDistance(_ from: CLLocationCoordinate2D, _ to: CLLocationCoordinate2D)
+    -> Double
+  {
+    let earthRadius = 6_371_008.8
+    let degreesToRadians = Double.pi / 180
+    let latitudeDelta = (to.latitude - from.latitude) * degreesToRadians
+    let longitudeDelta = (to.longitude - from.longitude) * degreesToRadians
+    let a =
+      pow(sin(latitudeDelta / 2), 2)
+      + cos(from.latitude * degreesToRadians) * cos(to.latitude * degreesToRadians)
+      * pow(sin(longitudeDelta / 2), 2)
+    return 2 * earthRadius * asin(min(1, sqrt(a)))
+  }
+}
+
+/// An order being improved, with each stop's position and the load after each position.
+private struct Search {
+  let instance: Instance
+  let capacity: Int
+  private(set) var order: [Int] = []
+  private var positions: [Int]
+  private var loads: [Int] = []
+
+  init(instance: Instance, capacity: Int) {
+    self.instance = instance
+    self.capacity = capacity
+    positions = [Int](repeating: -1, count: instance.count)
+  }
+
+  /// Builds an order by inserting each trip's stops, in turn, where they lengthen the route least.
+  ///
+  /// A trip's stops are inserted one after another, so a pickup is placed while its trip's
+  /// dropoff is still missing. Its load is counted up to the end of the route until then, which
+  /// keeps every partial order feasible once its trips are complete.
+  mutating func insertStops() {
+    guard instance.count > 0 else { return }
+    order = [0]
+    updatePositionsAndLoads()
+    for stops in instance.tripStops {
+      for stop in stops where stop != 0 {
+        let predecessor = instance.predecessors[stop]
+        let earliest = predecessor >= 0 ? max(positions[predecessor] + 1, 1) : 1
+        var bestPosition = order.count
+        var bestCost = Double.infinity
+        for position in earliest...order.count where canInsert(stop, at: position) {
+          let cost = insertionCost(of: stop, at: position, in: order)
+          if cost < bestCost {
+            bestCost = cost
+            bestPosition = position
+          }
+        }
+        order.insert(stop, at: bestPosition)
+        updatePositionsAndLoads()
+      }
+    }
+  }
+
+  /// Moves single stops to where they shorten the route most, until no move does or `deadline`
+  /// passes.
+  mutating func relocateStops(until deadline: TimeInterval) {
+    var isImproved = true
+    while isImproved {
+      isImproved = false
+      for stop in 0..<instance.count where positions[stop] > 0 {
+        if ProcessInfo.processInfo.systemUptime > deadline {
+          return
+        }
+        if relocate(stop) {
+          isImproved = true
+        }
+      }
+    }
+  }
+
+  /// Moves a stop to the feasible position that shortens the route most. Returns whether it moved.
+  private mutating func relocate(_ stop: Int) -> Bool {
+    let position = positions[stop]
+    var remaining = order
+    remaining.remove(at: position)
+    let removalGain =
+      instance.distance(order[position - 1], stop)
+      + (position + 1 < order.count
+        ? instance.distance(stop, order[position + 1])
+          - instance.distance(order[position - 1], order[position + 1]) : 0)
+
+    // Positions in `remaining` between the stop's neighbors in its trip.
+    func remainingPosition(_ other: Int) -> Int {
+      positions[other] < position ? positions[other] : positions[other] - 1
+    }
+    let predecessor = instance.predecessors[stop]
+    let successor = instance.successors[stop]
+    let earliest = predecessor >= 0 ? max(remainingPosition(predecessor) + 1, 1) : 1
+    let latest = successor >= 0 ? remainingPosition(successor) : remaining.count
+
+    var bestPosition = position
+    var bestGain = 1e-6
+    if earliest <= latest {
+      for newPosition in earliest...latest where newPosition != position {
+        let gain = removalGain - insertionCost(of: stop, at: newPosition, in: remaining)
+        if gain > bestGain && canMove(stop, from: position, to: newPosition) {
+          bestGain = gain
+          bestPosition = newPosition
+        }
+      }
+    }
+    guard bestPosition != position else { return false }
+    remaining.insert(stop, at: bestPosition)
+    order = remaining
+    updatePositionsAndLoads()
+    return true
+  }
+
+  /// Returns how much inserting a stop before `position` lengthens a route.
+  private func insertionCost(of stop: Int, at position: Int, in route: [Int]) -> Double {
+    let previous = route[position - 1]
+    guard position < route.count else { return instance.distance(previous, stop) }
+    let next = route[position]
+    return instance.distance(previous, stop) + instance.distance(stop, next)
+      - instance.distance(previous, next)
+  }
+
+  /// Returns whether inserting a stop before `position` keeps the loads within capacity, counting
+  /// a pickup's load up to the end of the route.
+  private func canInsert(_ stop: Int, at position: Int) -> Bool {
+    let delta = instance.loadDeltas[stop]
+    guard delta > 0 else { return true }
+    return loads[(position - 1)...].allSatisfy { $0 + delta <= capacity }
+  }
+
+  /// Returns whether moving a stop keeps the loads within capacity. Only the loads between its old
+  /// and new positions change.
+  private func canMove(_ stop: Int, from position: Int, to newPosition: Int) -> Bool {
+    let delta = instance.loadDeltas[stop]
+    if newPosition < position {
+      // The stops it now precedes carry its load change earlier.
+      return delta <= 0 || loads[(newPosition - 1)..<position].allSatisfy { $0 + delta <= capacity }
+    } else {
+      // The stops it now follows no longer carry its load change.
+      return delta >= 0 || loads[(position + 1)...newPosition].allSatisfy { $0 - delta <= capacity }
+    }
+  }
+
+  private mutating func updatePositionsAndLoads() {
+    loads = []
+    loads.reserveCapacity(order.count)
+    var load = instance.initialLoad
+    for (position, stop) in order.enumerated() {
+      positions[stop] = position
+      load += instance.loadDeltas[stop]
+      loads.append(load)
+    }
+  }
+}
@@ -0,0 +1,240 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import Foundation
+import os
+
+/// A durable, ordered queue of trip status updates waiting to be sent to the provider.
+///
+/// Callers apply a status transition to their local state as soon as the driver makes it, and
+/// enqueue the update here instead of waiting for the provider. Updates are written to disk in the
+/// background in the order they were made, so that updates made before the app is killed are sent
+/// on the next launch without the caller waiting for the disk. They are sent one at a time in the
+/// order they were made, each with an idempotency key so that the provider applies an update only
+/// once even if it is sent again after a lost response.
+///
+/// Updates that fail are retried with exponential backoff. Those that fail because the provider
+/// can't be reached are retried until it can, so that they outlast network outages, while those
+/// that fail for any other reason, such as server errors, are dropped and logged after
+/// `maximumAttemptCount` attempts. If the provider rejects an update, it is dropped along with the
+/// later updates for the same trip, which build on it, and `onRejection` is called so that the
+/// caller can roll back its local state.
+final class TripStatusOutbox {
+
+  /// A trip status update waiting to be sent.
+  struct Update: Codable, Equatable {
+    let tripID: String
+    let status: ProviderTripStatus
+    let intermediateDestinationIndex: Int?
+
+    /// Identifies the update to the provider, so that it is applied only once.
+    let idempotencyKey: String
+  }
+
+  /// Sends an update to the provider. Throws `ProviderService.Error.rejected` if the provider
+  /// rejects the update, and any other error if it should be retried.
+  typealias Sender = (Update) async throws -> Void
+
+  /// The number of failed attempts after which an update is dropped by default.
+  static let defaultMaximumAttemptCount = 10
+
+  private static let log = Logger(subsystem: "com.google.DriverSampleApp", category: "TripStatus")
+
+  /// Serializes reads and writes of the persisted updates, including those of outboxes created
+  /// for the same file after a relaunch.
+  private static let fileQueue = DispatchQueue(
+    label: "com.google.DriverSampleApp.TripStatusOutbox")
+
+  static let defaultFileURL = FileManager.default.urls(
+    for: .applicationSupportDirectory, in: .userDomainMask
+  ).first?.appendingPathComponent("TripStatusOutbox.plist")
+
+  /// The file that pending updates are persisted to and restored from, or `nil` to keep them in
+  /// memory.
+  let fileURL: URL?
+
+  /// The delay before the first retry of an update that could not be sent. Later retries double
+  /// it, up to `maximumRetryInterval`.
+  let retryInterval: TimeInterval
+
+  /// The longest delay between retries.
+  let maximumRetryInterval: TimeInterval
+
+  /// The number of attempts to send an update that fail for a reason other than the provider being
+  /// unreachable, after which the update is dropped.
+  let maximumAttemptCount: Int
+
+  /// The clock that retry delays are waited on.
+  let clock: AppClock
+
+  /// Called on the main actor with each rejected update and the error the provider returned.
+  var onRejection: ((Update, Swift.Error) -> Void)?
+
+  private let sender: Sender
+  private let lock = NSLock()
+  private var _pendingUpdates: [Update] = []
+  private var isSending = false
+
+  /// Creates an outbox, restoring the updates persisted by a previous launch and starting to send
+  /// them.
+  init(
+    fileURL: URL? = nil, retryInterval: TimeInterval = 1, maximumRetryInterval: TimeInterval = 30,
+    maximumAttemptCount: Int = defaultMaximumAttemptCount, clock: AppClock = SystemClock.shared,
+    sender: @escaping Sender
+  ) {
+    self.fileURL = fileURL
+    self.retryInterval = retryInterval
+    self.maximumRetryInterval = max(maximumRetryInterval, retryInterval)
+    self.maximumAttemptCount = max(maximumAttemptCount, 1)
+    self.clock = clock
+    self.sender = sender
+    loadPersistedUpdates()
+    sendPendingUpdates()
+  }
+
+  /// Creates an outbox that sends updates with the given provider service.
+  convenience init(
+    providerService: ProviderService, fileURL: URL? = defaultFileURL,
+    retryInterval: TimeInterval = 1, maximumAttemptCount: Int = defaultMaximumAttemptCount,
+    clock: AppClock = SystemClock.shared
+  ) {
+    self.init(
+      fileURL: fileURL, retryInterval: retryInterval, maximumAttemptCount: maximumAttemptCount,
+      clock: clock
+    ) { update in
+      try await providerService.updateTrip(
+        tripID: update.tripID, status: update.status,
+        intermediateDestinationIndex: update.intermediateDestinationIndex,
+        idempotencyKey: update.idempotencyKey)
+    }
+  }
+
+  /// The updates that have not been sent yet, oldest first.
+  var pendingUpdates: [Update] {
+    lock.lock()
+    defer { lock.unlock() }
+    return _pendingUpdates
+  }
+
+  /// Persists an update and sends it after the updates enqueued before it.
+  @discardableResult
+  func enqueue(tripID: String, status: ProviderTripStatus, intermediateDestinationIndex: Int? = nil)
+    -> Update
+  {
+    let update = Update(
+      tripID: tripID, status: status, intermediateDestinationIndex: intermediateDestinationIndex,
+      idempotencyKey: UUID().uuidString)
+    lock.lock()
+    _pendingUpdates.append(update)
+    persistUpdates()
+    lock.unlock()
+    sendPendingUpdates()
+    return update
+  }
+
+  /// Starts sending the pending updates unless they are already being sent.
+  private func sendPendingUpdates() {
+    lock.lock()
+    guard !isSending, !_pendingUpdates.isEmpty else {
+      lock.unlock()
+      return
+    }
+    isSending = true
+    lock.unlock()
+
+    // Capture self strongly so that the pending updates are sent even if the caller lets go.
+    Task {
+      var nextRetryInterval = retryInterval
+      var failedAttemptCount = 0
+      while let update = nextUpdate() {
+        do {
+          try await sender(update)
+          removeUpdates { $0 == update }
+        } catch {
+          if case ProviderService.Error.rejected = error {
+            removeUpdates { $0.tripID == update.tripID }
+            await MainActor.run { onRejection?(update, error) }
+          } else {
+            // Attempts that don't reach the provider are not counted, so that updates are kept
+            // through outages.
+            if !(error is URLError) {
+              failedAttemptCount += 1
+            }
+            if failedAttemptCount < maximumAttemptCount {
+              try? await clock.sleep(for: nextRetryInterval)
+              nextRetryInterval = min(nextRetryInterval * 2, maximumRetryInterval)
+              continue
+            }
+            let droppedUpdate = "\(update.status.rawValue) update of trip \(update.tripID)"
+            let reason = "\(failedAttemptCount) attempts failed, last with \(error)"
+            Self.log.error(
+              "Dropped \(droppedUpdate, privacy: .public): \(reason, privacy: .public)")
+            removeUpdates { $0 == update }
+          }
+        }
+        nextRetryInterval = retryInterval
+        failedAttemptCount = 0
+      }
+    }
+  }
+
+  /// Returns the oldest pending update, or marks sending as finished if there is none.
+  private func nextUpdate() -> Update? {
+    lock.lock()
+    defer { lock.unlock() }
+    guard let update = _pendingUpdates.first else {
+      isSending = false
+      return nil
+    }
+    return update
+  }
+
+  private func removeUpdates(where shouldBeRemoved: (Update) -> Bool) {
+    lock.lock()
+    defer { lock.unlock() }
+    _pendingUpdates.removeAll(where: shouldBeRemoved)
+    persistUpdates()
+  }
+
+  /// Restores the updates persisted by a previous launch, once the writes still queued by it have
+  /// finished.
+  private func loadPersistedUpdates() {
+    guard let fileURL = fileURL,
+      let data = Self.fileQueue.sync(execute: { try? Data(contentsOf: fileURL) }),
+      let persistedUpdates = try? PropertyListDecoder().decode([Update].self, from: data)
+    else {
+      return
+    }
+    _pendingUpdates = persistedUpdates
+  }
+
+  /// Writes the pending updates to disk in the background, after the writes queued before. Must be
+  /// called with the lock held, so that writes are queued in the order the updates changed.
+  private func persistUpdates() {
+    guard let fileURL = fileURL else {
+      return
+    }
+    let pendingUpdates = _pendingUpdates
+    Self.fileQueue.async {
+      let encoder = PropertyListEncoder()
+      encoder.outputFormat = .binary
+      guard let data = try? encoder.encode(pendingUpdates) else {
+        return
+      }
+      try? FileManager.default.createDirectory(
+        at: fileURL.deletingLastPathComponent(), withIntermediateDirectories: true)
+      try? data.write(to: fileURL, options: [.atomic, .completeFileProtection])
+    }
+  }
+}
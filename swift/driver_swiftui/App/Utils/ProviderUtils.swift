@@ -17,10 +17,13 @@ import Foundation
 
 /// Helper methods for `ProviderService` and `AuthTokenProvider`.
 enum ProviderUtils {
-  private static let baseProviderURLString = "http://localhost:8080"
+  /// Base URLs of the provider replicas, which `ProviderEndpointSet.shared` spreads requests
+  /// across.
+  static let baseProviderURLStrings = ["http://localhost:8080"]
 
-  static func providerURL(path: String) -> URL {
-    let baseProviderURL = URL(string: baseProviderURLString)
-    return URL(string: path, relativeTo: baseProviderURL)!
+  /// The base URL that `ProviderRoutes` builds provider URLs against. Requests for them are routed
+  /// to a replica when sent.
+  static var providerBaseURL: URL {
+    ProviderEndpointSet.shared.canonicalBaseURL
   }
 }
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import Accelerate
+import Foundation
+
+/// Great-circle leg distances and estimated arrival times for the waypoints of a route.
+///
+/// A route's coordinates are kept as separate latitude and longitude arrays, so that the haversine
+/// formula is evaluated for every leg at once with vectorized Accelerate calls instead of once per
+/// waypoint.
+enum WaypointGeometry {
+
+  /// How long a vehicle takes to drive a leg and serve a stop.
+  struct SpeedModel {
+    /// The average speed of the vehicle along roads, in meters per second.
+    var averageSpeed: Double = 8.3
+
+    /// How much longer the road route of a leg is than its great-circle distance.
+    var detourFactor: Double = 1.3
+
+    /// How long the vehicle stays at a waypoint before leaving for the next one, in seconds.
+    var stopDuration: TimeInterval = 60
+
+    /// An urban vehicle averaging 30 km/h.
+    static let `default` = SpeedModel()
+  }
+
+  /// The mean radius of the Earth, in meters.
+  static let earthRadius = 6_371_008.8
+
+  private static let degreesToRadians = Double.pi / 180
+
+  /// Returns the great-circle distance, in meters, from each point to the one before it. The first
+  /// point's distance is 0.
+  ///
+  /// - Parameters:
+  ///   - latitudes: The latitudes of the points, in degrees.
+  ///   - longitudes: The longitudes of the points, in degrees, in the same order.
+  static func legDistances(latitudes: [Double], longitudes: [Double]) -> [Double] {
+    precondition(latitudes.count == longitudes.count)
+    let count = latitudes.count
+    guard count > 1 else { return [Double](repeating: 0, count: count) }
+
+    let latitudeRadians = vDSP.multiply(degreesToRadians, latitudes)
+    let longitudeRadians = vDSP.multiply(degreesToRadians, longitudes)
+    let legCount = count - 1
+    let halfLatitudeSines = vForce.sin(
+      vDSP.multiply(0.5, vDSP.subtract(latitudeRadians[1...], latitudeRadians[..<legCount])))
+    let halfLongitudeSines = vForce.sin(
+      vDSP.multiply(0.5, vDSP.subtract(longitudeRadians[1...], longitudeRadians[..<legCount])))
+    let latitudeCosines = vForce.cos(latitudeRadians)
+    let latitudeCosineProducts = vDSP.multiply(
+      latitudeCosines[1...], latitudeCosines[..<legCount])
+
+    // The haversine of each leg's central angle, clamped against rounding above 1.
+    let haversines = vDSP.clip(
+      vDSP.add(
+        multiplication: (latitudeCosineProducts, vDSP.square(halfLongitudeSines)),
+        vDSP.square(halfLatitudeSines)),
+      to: 0...1)
+    let centralAngles = vForce.asin(vForce.sqrt(haversines))
+    return [0] + vDSP.multiply(2 * earthRadius, centralAngles)
+  }
+
+  /// Returns the estimated arrival time at each point of a route, for a vehicle that is at the
+  /// first point at `departureTime`.
+  ///
+  /// - Parameters:
+  ///   - legDistances: The distance from each point to the one before it, in meters.
+  ///   - departureTime: The time the vehicle is at the first point, in seconds since 1970.
+  ///   - speedModel: How long the vehicle takes to drive each leg and serve each stop.
+  /// - Returns: The arrival times, in seconds since 1970.
+  static func arrivalTimes(
+    legDistances: [Double], departureTime: TimeInterval, speedModel: SpeedModel = .default
+  ) -> [TimeInterval] {
+    guard !legDistances.isEmpty else { return [] }
+    // Each leg takes its driving time plus the stop at the point it leaves from.
+    let legDurations = vDSP.add(
+      speedModel.stopDuration,
+      vDSP.multiply(speedModel.detourFactor / speedModel.averageSpeed, legDistances))
+    var arrivalTimes = [TimeInterval](repeating: departureTime, count: legDistances.count)
+    for index in 1..<arrivalTimes.count {
+      arrivalTimes[index] = arrivalTimes[index - 1] + legDurations[index]
+    }
+    return arrivalTimes
+  }
+}
@@ -36,7 +36,7 @@ struct ControlPanelView: View {
           .foregroundColor(Style.textColor)
           .frame(height: Style.mediumFrameHeight, alignment: .topLeading)
       }
-      if let waypoints = modelData.waypoints, !waypoints.isEmpty {
+      if !modelData.waypoints.isEmpty {
         Button(action: tapButtonAction) {
           Text(buttonText())
         }
@@ -74,7 +74,7 @@ struct ControlPanelView: View {
 
   /// Text for the button in the control panel.
   private func buttonText() -> String {
-    guard let waypoint = modelData.waypoints?.first else { return "" }
+    guard let waypoint = modelData.waypoints.first else { return "" }
     if modelData.isEnrouteToWaypoint {
       switch waypoint.waypointType {
       case .pickUp:
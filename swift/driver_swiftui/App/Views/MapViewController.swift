@@ -27,14 +27,51 @@ class MapViewController: UIViewController, CLLocationManagerDelegate, GMSNavigat
   private static let sanFranciscoCoordinates = CLLocationCoordinate2D(
     latitude: 37.7749295, longitude: -122.4194155)
 
-  /// How often to fetch vehicle data from the provider backend in seconds.
+  /// How often to fetch vehicle data from the provider backend in seconds, when pushed vehicle
+  /// updates are unavailable.
   private static let pollFetchVehicleTimeInterval: TimeInterval = 2
 
+  /// How long to wait before retrying pushed vehicle updates after they fail, in seconds.
+  private static let vehicleUpdatesRetryTimeInterval: TimeInterval = 30
+
+  /// How long to wait after a trip completes before polling for a new trip, in seconds.
+  private static let startPollingForTripTimeInterval: TimeInterval = 5
+
+  // Names of the traced steps of a trip's lifecycle, whose latencies tools/stitch_trip_traces.py
+  // summarizes.
+  private static let tripMatchedSpanName = "driver.tripMatched"
+  private static let fetchTripStatusSpanName = "driver.fetchTripStatus"
+  private static let routeSpanName = "driver.route"
+  private static let statusTapSpanName = "driver.statusTap"
+  private static let handoffSpanName = "driver.handoff"
+
+  /// The key of the span attribute holding the status with which a route was generated.
+  private static let routeStatusAttributeKey = "routeStatus"
+
+  /// The key of the span attribute recording whether the next trip was loaded before the handoff.
+  private static let prefetchedAttributeKey = "prefetched"
+
   /// The `ModelData` containing the primary state of the application.
   private let modelData: ModelData
 
-  /// A service that sends requests and receives responses from the provider backend.
-  private let providerService = ProviderService()
+  /// The clock that polling, retries and token expiry are timed on.
+  private let clock: AppClock
+
+  /// A service that sends requests and receives responses from the provider backend. It hedges
+  /// vehicle and trip fetches that are slower than usual, so that a slow response doesn't hold up
+  /// trip assignment.
+  private let providerService: ProviderService
+
+  /// Trip status updates waiting to be sent to the provider, including those left over from a
+  /// previous launch.
+  private let tripStatusOutbox: TripStatusOutbox
+
+  /// Provides the driver tokens of the vehicle, starting with the one fetched during startup.
+  private let authTokenProvider: AuthTokenProvider
+
+  /// Resumes or creates the vehicle while the terms dialog is shown, and times the stages of
+  /// startup.
+  private let driverStartup: DriverStartup
 
   /// A `locationManager` for checking the user's location permission status.
   private lazy var locationManager = CLLocationManager()
@@ -45,11 +82,34 @@ class MapViewController: UIViewController, CLLocationManagerDelegate, GMSNavigat
   /// A boolean indicating whether the vehicle is online and tracked by Fleet Engine.
   private var isVehicleOnline = false
 
-  /// A `Timer` that periodically fetches the vehicle data from the provider backend.
-  private var pollFetchVehicleTimer: Timer?
+  /// A timer that periodically fetches the vehicle data from the provider backend.
+  private var pollFetchVehicleTimer: AppClockTimer?
+
+  /// A timer that starts polling for a new trip a while after the last one completes.
+  private var startPollingForTripTimer: AppClockTimer?
 
-  /// A boolean indicating whether there's a fetch vehicle request in progress.
-  private var isFetchVehicleInProgress = false
+  /// A task that listens for vehicle updates pushed by the provider backend.
+  private var vehicleUpdatesTask: Task<Void, Never>?
+
+  /// Records the steps of each trip's lifecycle.
+  private var tripTracer: TripTracer { providerService.tripTracer }
+
+  /// The IDs of the matched trips whose match has been traced.
+  private var tracedMatchedTripIDs = Set<String>()
+
+  /// Plans the navigator's route through the next waypoints of the current trip.
+  private let routePlanner = RoutePlanner()
+
+  /// Loads the next back-to-back trip while the current one is in progress.
+  private let nextTripPrefetcher: NextTripPrefetcher
+
+  /// The span of the status tap being handled, which records the status that the tap updates the
+  /// trip to.
+  private var statusTapSpan: TripTracer.Span?
+
+  /// Records the road-snapped locations of the session, for auditing and replaying the shift.
+  private let locationTraceRecorder = LocationTraceRecorder(
+    fileURL: LocationTraceRecorder.defaultFileURL)
 
   private lazy var mapView: GMSMapView = {
     let mapView = GMSMapView(frame: CGRect.zero)
@@ -58,19 +118,45 @@ class MapViewController: UIViewController, CLLocationManagerDelegate, GMSNavigat
     return mapView
   }()
 
-  init(modelData: ModelData) {
+  init(modelData: ModelData, clock: AppClock = SystemClock.shared) {
     self.modelData = modelData
+    self.clock = clock
+    providerService = ProviderService(
+      retryPolicy: ProviderRetryPolicy(isHedgingEnabled: true, clock: clock), clock: clock)
+    tripStatusOutbox = TripStatusOutbox(providerService: providerService, clock: clock)
+    nextTripPrefetcher = NextTripPrefetcher(providerService: providerService)
+    authTokenProvider = AuthTokenProvider(clock: clock)
+    driverStartup = DriverStartup(
+      providerService: providerService, authTokenProvider: authTokenProvider, clock: clock)
     super.init(nibName: nil, bundle: nil)
 
+    nextTripPrefetcher.onLoad = { [weak self] trip in
+      // Compute the legs into the next trip while the driver is still on the current one. A trip
+      // that was handed off before this was called is already routed to.
+      guard let self = self, trip.tripID == self.modelData.nextTripID else { return }
+      self.setNextWaypointAsTheDestination(extendingRoute: true)
+    }
+
+    tripStatusOutbox.onRejection = { [weak self] update, _ in
+      self?.reconcileTrip(tripID: update.tripID)
+    }
+
     NotificationCenter.default.addObserver(
       self, selector: #selector(didTapControlPanelButton), name: .didTapControlPanelButton,
       object: nil)
+    NotificationCenter.default.addObserver(
+      self, selector: #selector(didEnterBackground),
+      name: UIApplication.didEnterBackgroundNotification, object: nil)
   }
 
   required init?(coder: NSCoder) {
     fatalError("init(coder:) has not been implemented")
   }
 
+  deinit {
+    startPollingForTripTimer?.invalidate()
+  }
+
   override func loadView() {
     super.loadView()
     view = mapView
@@ -78,11 +164,14 @@ class MapViewController: UIViewController, CLLocationManagerDelegate, GMSNavigat
 
   override func viewDidLoad() {
     super.viewDidLoad()
+    // The vehicle doesn't depend on the terms, so it is made ready while the dialog is shown.
+    driverStartup.prepareVehicle()
     showTermsAndConditions()
   }
 
   /// Shows the dialog for the Nav SDK terms and conditions to the user.
   private func showTermsAndConditions() {
+    driverStartup.begin(.terms)
     GMSNavigationServices.showTermsAndConditionsDialogIfNeeded(
       withCompanyName: Strings.companyName
     ) { [weak self] termsAccepted in
@@ -90,6 +179,7 @@ class MapViewController: UIViewController, CLLocationManagerDelegate, GMSNavigat
       // Both navigator and roadSnappedLocationProvider return nil if the user has not
       // accepted the Terms and Conditions dialog.
       if termsAccepted {
+        self?.driverStartup.end(.terms)
         self?.setUpDriver()
       } else {
         self?.showTermsAndConditionsDeniedAlert()
@@ -117,6 +207,7 @@ class MapViewController: UIViewController, CLLocationManagerDelegate, GMSNavigat
     mapView.cameraMode = .following
     mapView.navigator?.sendsBackgroundNotifications = true
     mapView.navigator?.add(self)
+    routePlanner.navigator = mapView.navigator
     mapView.roadSnappedLocationProvider?.allowsBackgroundLocationUpdates = true
 
     // Simulate the driver location at a fixed coordinate.
@@ -124,7 +215,7 @@ class MapViewController: UIViewController, CLLocationManagerDelegate, GMSNavigat
     // and references to it should be removed before testing this app in the real world.
     mapView.locationSimulator?.simulateLocation(at: MapViewController.sanFranciscoCoordinates)
 
-    createVehicle()
+    setUpVehicle()
   }
 
   private func checkLocationPermission() {
@@ -144,17 +235,14 @@ class MapViewController: UIViewController, CLLocationManagerDelegate, GMSNavigat
     }
   }
 
-  private func createVehicle() {
+  /// Sets up the driver once the vehicle that startup resumes or creates is ready.
+  private func setUpVehicle() {
     Task {
-      let randomVehicleID = String(format: "iOS-%@", UUID().uuidString)
-      guard
-        let vehicleID = try? await providerService.createVehicle(
-          vehicleID: randomVehicleID, isBackToBackEnabled: true)
-      else {
+      guard let vehicle = try? await driverStartup.vehicle() else {
         showCreateVehicleFailureAlert()
         return
       }
-      handleCreateVehicle(vehicleID: vehicleID)
+      handleVehicleReady(vehicle)
     }
   }
 
@@ -165,15 +253,17 @@ class MapViewController: UIViewController, CLLocationManagerDelegate, GMSNavigat
       preferredStyle: .alert)
     alert.addAction(
       UIAlertAction(title: Strings.okButtonText, style: .default) { [weak self] _ in
-        self?.createVehicle()
+        self?.setUpVehicle()
       })
     present(alert, animated: true, completion: nil)
   }
 
-  private func handleCreateVehicle(vehicleID: String) {
+  private func handleVehicleReady(_ vehicle: DriverStartup.Vehicle) {
     guard let navigator = mapView.navigator else { return }
+    let vehicleID = vehicle.session.vehicleID
+    driverStartup.begin(.driverContext)
     let driverContext = GMTDDriverContext(
-      accessTokenProvider: AuthTokenProvider(), providerID: APIConstants.providerID,
+      accessTokenProvider: authTokenProvider, providerID: APIConstants.providerID,
       vehicleID: vehicleID, navigator: navigator)
     guard let driverAPI = GMTDRidesharingDriverAPI(driverContext: driverContext) else { return }
 
@@ -184,6 +274,7 @@ class MapViewController: UIViewController, CLLocationManagerDelegate, GMSNavigat
     if let roadSnappedLocationProvider = mapView.roadSnappedLocationProvider {
       // Set VehicleReporter as a listener to Navigation SDK updates.
       roadSnappedLocationProvider.add(vehicleReporter)
+      roadSnappedLocationProvider.add(locationTraceRecorder)
 
       // Start location updates so the Fleet Engine starts to receive location updates.
       roadSnappedLocationProvider.stopUpdatingLocation()
@@ -192,77 +283,154 @@ class MapViewController: UIViewController, CLLocationManagerDelegate, GMSNavigat
 
     // Enable location tracking for the driver.
     vehicleReporter.locationTrackingEnabled = true
+    driverStartup.end(.driverContext)
 
     // Set the vehicle to be online so that it is visible for consumers.
+    driverStartup.begin(.online)
     vehicleReporter.update(.online)
     self.vehicleReporter = vehicleReporter
+
+    // Listen for trip matches from the provider right away, starting with the trips still matched
+    // with a resumed vehicle, rather than waiting for Fleet Engine to acknowledge the vehicle.
+    if !vehicle.matchedTripIDs.isEmpty {
+      handleFetchVehicle(matchedTripIDs: vehicle.matchedTripIDs)
+    }
+    startVehicleUpdates()
+  }
+
+  /// Starts listening for vehicle updates pushed by the provider backend, falling back to polling
+  /// while they are unavailable. Restarting delivers the current vehicle state immediately.
+  private func startVehicleUpdates() {
+    vehicleUpdatesTask?.cancel()
+    let clock = self.clock
+    vehicleUpdatesTask = Task { [weak self] in
+      var lastTag: String?
+      while !Task.isCancelled, let providerService = self?.providerService,
+        let vehicleID = self?.modelData.vehicleID
+      {
+        do {
+          // A nil update means the provider's long-poll window elapsed without a change.
+          guard
+            let update = try await providerService.waitForVehicleUpdate(
+              vehicleID: vehicleID, lastTag: lastTag)
+          else { continue }
+          guard !Task.isCancelled else { return }
+          lastTag = update.tag
+          self?.stopPollingFetchVehicle()
+          self?.handleFetchVehicle(matchedTripIDs: update.matchedTripIDs)
+        } catch {
+          guard !Task.isCancelled else { return }
+          if self?.pollFetchVehicleTimer == nil {
+            self?.pollFetchVehicle()
+          }
+          try? await clock.sleep(for: Self.vehicleUpdatesRetryTimeInterval)
+          lastTag = nil
+        }
+      }
+    }
   }
 
   private func pollFetchVehicle() {
-    pollFetchVehicleTimer = Timer.scheduledTimer(
-      timeInterval: Self.pollFetchVehicleTimeInterval, target: self,
-      selector: #selector(fetchVehicle), userInfo: nil, repeats: true)
+    pollFetchVehicleTimer = clock.scheduleTimer(
+      interval: Self.pollFetchVehicleTimeInterval, repeats: true
+    ) { [weak self] in
+      self?.fetchVehicle()
+    }
   }
 
-  @objc private func fetchVehicle() {
-    guard let vehicleID = modelData.vehicleID else { return }
+  private func stopPollingFetchVehicle() {
+    pollFetchVehicleTimer?.invalidate()
+    pollFetchVehicleTimer = nil
+  }
 
-    // If there's a fetch vehicle request in progress, cancel this one.
-    guard !isFetchVehicleInProgress else { return }
+  private func fetchVehicle() {
+    guard let vehicleID = modelData.vehicleID else { return }
 
     // Stop polling if there's already a current and next trip assigned.
     if modelData.tripID != nil && modelData.nextTripID != nil {
-      pollFetchVehicleTimer?.invalidate()
-      pollFetchVehicleTimer = nil
+      stopPollingFetchVehicle()
       return
     }
 
-    isFetchVehicleInProgress = true
+    // A fetch still in flight is superseded by this one, and returns no trips.
     Task {
       guard let matchedTripIDs = try? await providerService.getVehicle(vehicleID: vehicleID)
-      else {
-        isFetchVehicleInProgress = false
-        return
-      }
-      isFetchVehicleInProgress = false
+      else { return }
       handleFetchVehicle(matchedTripIDs: matchedTripIDs)
     }
   }
 
   private func handleFetchVehicle(matchedTripIDs: [String]) {
+    traceNewlyMatchedTrips(matchedTripIDs: matchedTripIDs)
+
     // Keep polling if there are no trips found for this vehicle.
     guard !matchedTripIDs.isEmpty else { return }
 
     // Stop polling as trip data has been found for this vehicle.
-    pollFetchVehicleTimer?.invalidate()
-    pollFetchVehicleTimer = nil
+    stopPollingFetchVehicle()
 
+    if matchedTripIDs.count >= 2, matchedTripIDs[1] != modelData.tripID {
+      modelData.nextTripID = matchedTripIDs[1]
+      nextTripPrefetcher.prefetch(tripID: matchedTripIDs[1])
+    }
     // Update current trip ID to the first trip ID in the assigned trips list.
     if modelData.tripID == nil {
       modelData.driverState = .new
       modelData.tripID = matchedTripIDs[0]
       handleNewTrip()
     }
-    if matchedTripIDs.count >= 2 {
-      modelData.nextTripID = matchedTripIDs[1]
+  }
+
+  /// Records the match of each trip that was not matched with the vehicle before.
+  private func traceNewlyMatchedTrips(matchedTripIDs: [String]) {
+    for tripID in matchedTripIDs where !tracedMatchedTripIDs.contains(tripID) {
+      tracedMatchedTripIDs.insert(tripID)
+      tripTracer.recordEvent(Self.tripMatchedSpanName, tripID: tripID)
     }
+    // Forget trips that are no longer matched, which are complete or canceled.
+    tracedMatchedTripIDs.formIntersection(matchedTripIDs)
   }
 
-  private func handleNewTrip() {
+  /// Fetches the current trip and routes to it. `handoffSpan` is ended once the route is ready, if
+  /// the trip follows a completed one.
+  private func handleNewTrip(handoffSpan: TripTracer.Span? = nil) {
     guard let tripID = modelData.tripID else { return }
 
     Task {
-      // Fetch trip details for the current trip ID.
-      guard let (_, waypoints) = try? await providerService.getTrip(tripID: tripID) else { return }
-      modelData.waypoints = waypoints
-      setNextWaypointAsTheDestination()
+      // Fetch trip details for the current trip ID only. The next matched trip is loaded by the
+      // prefetcher, and fetching it here as well would supersede the prefetcher's request.
+      let span = tripTracer.startSpan(Self.fetchTripStatusSpanName, tripID: tripID)
+      let trip = try? await providerService.getTrip(tripID: tripID)
+      if let (status, _) = trip {
+        span.setAttribute(status.rawValue, forKey: TripTracer.tripStatusAttributeKey)
+      }
+      span.end()
+      guard let (_, waypoints) = trip else {
+        handoffSpan?.end()
+        return
+      }
+      // The destinations were cleared when the previous trip ended, so route to the new trip even
+      // if its first waypoint was already known.
+      modelData.waypoints.update(waypoints)
+      setNextWaypointAsTheDestination(handoffSpan: handoffSpan)
 
       // Reset intermediate destinations index.
       modelData.intermediateDestinationIndex = 0
     }
   }
 
+  /// Writes the recorded trace to disk, since the app may be suspended or terminated.
+  @objc private func didEnterBackground() {
+    locationTraceRecorder.flush()
+  }
+
   @objc private func didTapControlPanelButton(notification: Notification) {
+    // Started before the update is enqueued, so that the update is sent as part of this span.
+    statusTapSpan = tripTracer.startSpan(Self.statusTapSpanName, tripID: modelData.tripID)
+    defer {
+      statusTapSpan?.end()
+      statusTapSpan = nil
+    }
     if modelData.isEnrouteToWaypoint {
       updateTripStatusToArrivedAtWaypoint()
     } else {
@@ -271,11 +439,11 @@ class MapViewController: UIViewController, CLLocationManagerDelegate, GMSNavigat
   }
 
   private func updateTripStatusToArrivedAtWaypoint() {
-    guard let waypoint = modelData.waypoints?.first else { return }
+    guard let waypoint = modelData.waypoints.first else { return }
     modelData.isEnrouteToWaypoint = false
 
     // Upon arrival, remove the first waypoint from the list.
-    modelData.waypoints?.removeFirst()
+    modelData.waypoints.removeFirst()
 
     mapView.locationSimulator?.isPaused = true
     switch waypoint.waypointType {
@@ -291,27 +459,58 @@ class MapViewController: UIViewController, CLLocationManagerDelegate, GMSNavigat
     case .dropOff:
       updateTrip(status: .complete)
       mapView.locationSimulator?.stopSimulation()
-      mapView.navigator?.clearDestinations()
 
       // If a next trip is available, switch to that trip.
       if let nextTripID = modelData.nextTripID {
-        modelData.driverState = .new
-        modelData.tripID = nextTripID
-        modelData.nextTripID = nil
-        handleNewTrip()
+        handOff(to: nextTripID)
       } else {
+        routePlanner.clearRoute()
+        nextTripPrefetcher.cancel()
         modelData.driverState = .tripComplete
         // Wait 5 seconds to start polling for a new trip.
         // Note: This timer is optional and it's used in this app for demonstration purposes.
-        perform(#selector(startPollingForTrip), with: nil, afterDelay: 5)
+        startPollingForTripTimer?.invalidate()
+        startPollingForTripTimer = clock.scheduleTimer(
+          interval: Self.startPollingForTripTimeInterval, repeats: false
+        ) { [weak self] in
+          self?.startPollingForTrip()
+        }
       }
     default:
       break
     }
   }
 
+  /// Switches to the next trip once the current one is complete. If the next trip was loaded while
+  /// the current one was in progress, the navigator's route already leads on into it, so the
+  /// driver can start it as soon as the provider has confirmed the loaded trip. Otherwise it is
+  /// fetched and routed to first. Either way, the route to it is planned once.
+  private func handOff(to nextTripID: String) {
+    let span = tripTracer.startSpan(Self.handoffSpanName, tripID: nextTripID)
+    modelData.tripID = nextTripID
+    modelData.nextTripID = nil
+    modelData.intermediateDestinationIndex = 0
+    Task {
+      guard let nextTrip = await nextTripPrefetcher.handOff(tripID: nextTripID) else {
+        span.setAttribute("false", forKey: Self.prefetchedAttributeKey)
+        modelData.driverState = .new
+        routePlanner.clearRoute()
+        handleNewTrip(handoffSpan: span)
+        return
+      }
+      span.setAttribute("true", forKey: Self.prefetchedAttributeKey)
+      guard modelData.tripID == nextTripID else {
+        span.end()
+        return
+      }
+      modelData.driverState = Self.driverState(for: nextTrip.status)
+      modelData.waypoints.update(nextTrip.waypoints)
+      setNextWaypointAsTheDestination(handoffSpan: span)
+    }
+  }
+
   private func updateTripStatusToEnrouteToWaypoint() {
-    guard let waypoint = modelData.waypoints?.first else { return }
+    guard let waypoint = modelData.waypoints.first else { return }
     modelData.isEnrouteToWaypoint = true
 
     startNavigation()
@@ -328,38 +527,97 @@ class MapViewController: UIViewController, CLLocationManagerDelegate, GMSNavigat
       updateTrip(status: .enrouteToDropoff)
       modelData.driverState = .enrouteToDropoff
 
-      // Start polling for new trips as the vehicle is back-to-back enabled.
-      pollFetchVehicle()
+      // Look for new trips as the vehicle is back-to-back enabled.
+      startVehicleUpdates()
     default:
       break
     }
   }
 
+  /// Sends a status update for the current trip, whose transition has already been applied to
+  /// `modelData` so that the driver doesn't wait on the provider.
   private func updateTrip(status: ProviderTripStatus, intermediateDestinationIndex: Int? = nil) {
+    guard let tripID = modelData.tripID else { return }
+    statusTapSpan?.setAttribute(status.rawValue, forKey: TripTracer.tripStatusAttributeKey)
+    tripStatusOutbox.enqueue(
+      tripID: tripID, status: status, intermediateDestinationIndex: intermediateDestinationIndex)
+  }
+
+  /// Restores the provider's state of a trip whose status update was rejected, undoing the
+  /// transitions that were applied locally.
+  private func reconcileTrip(tripID: String) {
+    guard tripID == modelData.tripID else { return }
     Task {
-      guard let tripID = modelData.tripID else { return }
-      try? await providerService.updateTrip(
-        tripID: tripID, status: status, intermediateDestinationIndex: intermediateDestinationIndex
-      )
+      guard let (status, waypoints) = try? await providerService.getTrip(tripID: tripID),
+        tripID == modelData.tripID
+      else { return }
+      modelData.driverState = Self.driverState(for: status)
+      modelData.isEnrouteToWaypoint = [
+        .enrouteToPickup, .enrouteToIntermediateDestination, .enrouteToDropoff,
+      ].contains(status)
+      // Only plan a new route if the rollback changed the waypoint that the driver is heading to.
+      if modelData.waypoints.update(waypoints).isHeadChanged {
+        setNextWaypointAsTheDestination()
+      }
     }
   }
 
-  @objc private func startPollingForTrip() {
+  private static func driverState(for status: ProviderTripStatus) -> ModelData.DriverState {
+    switch status {
+    case .new:
+      return .new
+    case .enrouteToPickup:
+      return .enrouteToPickup
+    case .arrivedAtPickup:
+      return .arrivedAtPickup
+    case .enrouteToIntermediateDestination:
+      return .enrouteToIntermediateDestination
+    case .arrivedAtIntermediateDestination:
+      return .arrivedAtIntermediateDestination
+    case .enrouteToDropoff:
+      return .enrouteToDropoff
+    case .complete:
+      return .tripComplete
+    }
+  }
+
+  private func startPollingForTrip() {
+    startPollingForTripTimer = nil
     modelData.driverState = .idle
     modelData.tripID = nil
     modelData.nextTripID = nil
 
-    // Poll the provider to fetch the current vehicle state.
-    pollFetchVehicle()
+    // Fetch the current vehicle state from the provider.
+    startVehicleUpdates()
   }
 
-  private func setNextWaypointAsTheDestination() {
-    guard let coordinate = modelData.waypoints?.first?.location?.point?.coordinate(),
-      let navWaypoint = GMSNavigationWaypoint(location: coordinate, title: "")
-    else {
+  /// Routes the navigator through the remaining waypoints, continuing along the current route if it
+  /// still leads through them. Once the next trip is loaded, the route leads on through its
+  /// waypoints, and `extendingRoute` computes the legs to them if the route stops short of them.
+  /// `handoffSpan` is ended along with the route's span.
+  private func setNextWaypointAsTheDestination(
+    extendingRoute: Bool = false, handoffSpan: TripTracer.Span? = nil
+  ) {
+    guard let waypoint = modelData.waypoints.first else {
+      handoffSpan?.end()
       return
     }
-    mapView.navigator?.setDestinations([navWaypoint]) { _ in
+    var waypoints = Array(modelData.waypoints.waypoints)
+    if let nextTrip = nextTripPrefetcher.trip, nextTrip.tripID == modelData.nextTripID {
+      waypoints += nextTrip.waypoints
+    }
+    let span = tripTracer.startSpan(Self.routeSpanName, tripID: waypoint.tripID)
+    let completion: GMSRouteStatusCallback = { routeStatus in
+      let routeStatusValue = routeStatus == .OK ? "OK" : String(routeStatus.rawValue)
+      span.setAttribute(routeStatusValue, forKey: Self.routeStatusAttributeKey)
+      span.end()
+      handoffSpan?.setAttribute(routeStatusValue, forKey: Self.routeStatusAttributeKey)
+      handoffSpan?.end()
+    }
+    if extendingRoute {
+      routePlanner.extendRoute(through: waypoints, completion: completion)
+    } else {
+      routePlanner.planRoute(through: waypoints, completion: completion)
     }
   }
 
@@ -386,7 +644,8 @@ class MapViewController: UIViewController, CLLocationManagerDelegate, GMSNavigat
   // MARK: - GMSNavigatorListener
 
   func navigator(_ navigator: GMSNavigator, didArriveAt waypoint: GMSNavigationWaypoint) {
-    // Handle the driver did arrive at a waypoint.
+    // Head on to the next stop along the route the navigator already has.
+    routePlanner.didArrive()
   }
 
   // MARK: - GMTDVehicleReporterListener
@@ -399,9 +658,7 @@ class MapViewController: UIViewController, CLLocationManagerDelegate, GMSNavigat
     if vehicleUpdate.vehicleState == .online {
       if !isVehicleOnline {
         isVehicleOnline = true
-
-        // Poll the provider to fetch a trip match.
-        pollFetchVehicle()
+        driverStartup.end(.online)
       }
     }
   }
@@ -0,0 +1,230 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+import Foundation
+
+#if canImport(FoundationNetworking)
+  import FoundationNetworking
+#endif
+
+/// A random number generator that produces the same sequence for the same seed (SplitMix64).
+struct SeededRandomNumberGenerator: RandomNumberGenerator {
+  private var state: UInt64
+
+  init(seed: UInt64) {
+    state = seed
+  }
+
+  mutating func next() -> UInt64 {
+    state &+= 0x9E37_79B9_7F4A_7C15
+    var value = state
+    value = (value ^ (value >> 30)) &* 0xBF58_476D_1CE4_E5B9
+    value = (value ^ (value >> 27)) &* 0x94D0_49BB_1331_11EB
+    return value ^ (value >> 31)
+  }
+}
+
+/// Emulates the network between the apps and the provider for requests served by
+/// `MockURLProtocol`: latency, bandwidth, lost requests, connections reset partway through a
+/// response body and outages.
+///
+/// The fate of a request is decided by the seed, its method and URL, and how many requests with
+/// the same method and URL came before it, so a test sees the same conditions on every run no
+/// matter how its concurrent requests interleave. Outages are scheduled on `clock`, which tests can
+/// replace to script them without waiting.
+final class NetworkEmulator {
+
+  /// A distribution that the latency of requests is drawn from.
+  enum LatencyDistribution {
+    /// Every request takes the same time.
+    case constant(TimeInterval)
+    /// Latencies are spread evenly over a range.
+    case uniform(ClosedRange<TimeInterval>)
+    /// Latencies cluster around a median with a long tail, like those of mobile networks. `sigma`
+    /// is the standard deviation of the logarithm of the latency.
+    case logNormal(median: TimeInterval, sigma: Double)
+
+    func sample<Generator: RandomNumberGenerator>(using generator: inout Generator)
+      -> TimeInterval
+    {
+      switch self {
+      case .constant(let latency):
+        return max(latency, 0)
+      case .uniform(let range):
+        return max(TimeInterval.random(in: range, using: &generator), 0)
+      case .logNormal(let median, let sigma):
+        // Box-Muller transform of two uniform samples into a standard normal one.
+        let u1 = Double.random(in: Double.leastNonzeroMagnitude..<1, using: &generator)
+        let u2 = Double.random(in: 0..<1, using: &generator)
+        let normal = (-2 * log(u1)).squareRoot() * cos(2 * .pi * u2)
+        return max(median, 0) * exp(sigma * normal)
+      }
+    }
+  }
+
+  /// The conditions that requests to a route are sent under.
+  struct Conditions {
+    /// The time until the first byte of the response arrives.
+    var latency: LatencyDistribution = .constant(0)
+
+    /// The rate at which response bodies arrive, in bytes per second, or `nil` for no limit.
+    var bytesPerSecond: Double?
+
+    /// The fraction of requests that are lost, and time out after `lossTimeout`.
+    var lossRate: Double = 0
+
+    /// How long a lost request takes to time out, unless the request's own timeout is shorter.
+    var lossTimeout: TimeInterval = 1
+
+    /// The fraction of responses whose connection is reset partway through the body.
+    var resetRate: Double = 0
+
+    init(
+      latency: LatencyDistribution = .constant(0), bytesPerSecond: Double? = nil,
+      lossRate: Double = 0, lossTimeout: TimeInterval = 1, resetRate: Double = 0
+    ) {
+      self.latency = latency
+      self.bytesPerSecond = bytesPerSecond
+      self.lossRate = lossRate
+      self.lossTimeout = lossTimeout
+      self.resetRate = resetRate
+    }
+  }
+
+  /// What happens to one request.
+  struct Plan {
+    enum Outcome: Equatable {
+      /// The response arrives in full.
+      case respond
+      /// The request fails at once because the network is down.
+      case outage
+      /// The request is lost and times out.
+      case lose(timeout: TimeInterval)
+      /// The connection is reset once the given fraction of the response body has arrived.
+      case reset(afterFraction: Double)
+    }
+
+    /// A plan that responds at once, as `MockURLProtocol` does without an emulator.
+    static let immediate = Plan(latency: 0, bytesPerSecond: nil, outcome: .respond)
+
+    /// The time until the first byte of the response arrives.
+    let latency: TimeInterval
+
+    /// The rate at which the response body arrives, or `nil` for all at once.
+    let bytesPerSecond: Double?
+
+    let outcome: Outcome
+  }
+
+  private struct Route {
+    let method: String?
+    let pathPrefix: String
+    let conditions: Conditions
+  }
+
+  private struct Outage {
+    let window: Range<TimeInterval>
+    let pathPrefix: String?
+  }
+
+  let seed: UInt64
+
+  /// The conditions of requests that match no route.
+  let defaultConditions: Conditions
+
+  /// Returns the current time that outage windows are measured against.
+  let clock: () -> TimeInterval
+
+  /// The time of `clock` when the emulator was created, from which outage windows start.
+  let startTime: TimeInterval
+
+  private let lock = NSLock()
+  private var routes: [Route] = []
+  private var outages: [Outage] = []
+  private var requestCountsByKey: [String: UInt64] = [:]
+
+  init(
+    seed: UInt64, defaultConditions: Conditions = Conditions(),
+    clock: @escaping () -> TimeInterval = { ProcessInfo.processInfo.systemUptime }
+  ) {
+    self.seed = seed
+    self.defaultConditions = defaultConditions
+    self.clock = clock
+    self.startTime = clock()
+  }
+
+  /// Sends requests whose path starts with `pathPrefix`, and whose method is `method` if it is not
+  /// `nil`, under `conditions`. Routes are matched in the order they were added.
+  func addRoute(pathPrefix: String, method: String? = nil, conditions: Conditions) {
+    lock.lock()
+    defer { lock.unlock() }
+    routes.append(Route(method: method, pathPrefix: pathPrefix, conditions: conditions))
+  }
+
+  /// Fails every request sent from `start` seconds after the emulator was created for `duration`
+  /// seconds, or only those whose path starts with `pathPrefix` if it is not `nil`.
+  func addOutage(start: TimeInterval, duration: TimeInterval, pathPrefix: String? = nil) {
+    lock.lock()
+    defer { lock.unlock() }
+    outages.append(
+      Outage(window: start..<(start + max(duration, 0)), pathPrefix: pathPrefix))
+  }
+
+  /// Decides what happens to a request. Every call counts as a new request.
+  func plan(for request: URLRequest) -> Plan {
+    let method = request.httpMethod ?? "GET"
+    let path = request.url?.path ?? ""
+    let key = "\(method) \(request.url?.absoluteString ?? "")"
+    let elapsedTime = clock() - startTime
+
+    lock.lock()
+    let occurrence = requestCountsByKey[key, default: 0]
+    requestCountsByKey[key] = occurrence + 1
+    let conditions =
+      routes.first { route in
+        path.hasPrefix(route.pathPrefix) && (route.method == nil || route.method == method)
+      }?.conditions ?? defaultConditions
+    let isInOutage = outages.contains { outage in
+      outage.window.contains(elapsedTime)
+        && (outage.pathPrefix.map { path.hasPrefix($0) } ?? true)
+    }
+    lock.unlock()
+
+    if isInOutage {
+      return Plan(latency: 0, bytesPerSecond: nil, outcome: .outage)
+    }
+    var generator = SeededRandomNumberGenerator(
+      seed: (seed ^ Self.stableHash(key)) &+ occurrence &* 0x2545_F491_4F6C_DD1D)
+    let latency = conditions.latency.sample(using: &generator)
+    let outcome: Plan.Outcome
+    if Double.random(in: 0..<1, using: &generator) < conditions.lossRate {
+      outcome = .lose(timeout: min(conditions.lossTimeout, request.timeoutInterval))
+    } else if Double.random(in: 0..<1, using: &generator) < conditions.resetRate {
+      outcome = .reset(afterFraction: Double.random(in: 0..<1, using: &generator))
+    } else {
+      outcome = .respond
+    }
+    return Plan(latency: latency, bytesPerSecond: conditions.bytesPerSecond, outcome: outcome)
+  }
+
+  /// A hash of a string that, unlike `Hasher`, is the same in every process (FNV-1a).
+  private static func stableHash(_ string: String) -> UInt64 {
+    var hash: UInt64 = 0xCBF2_9CE4_8422_2325
+    for byte in string.utf8 {
+      hash = (hash ^ UInt64(byte)) &* 0x100_0000_01B3
+    }
+    return hash
+  }
+}
@@ -0,0 +1,225 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+import Darwin
+import Foundation
+
+@testable import DriverSampleApp
+
+/// Runs many simulated clients of the provider concurrently, and reports the throughput and
+/// per-operation latencies they saw along with the CPU time and memory the run took.
+///
+/// The scale of a run is read from the environment, so that it can be changed without rebuilding,
+/// for example with `xcodebuild test TEST_RUNNER_PROVIDER_LOAD_CLIENTS=500`:
+///
+///   PROVIDER_LOAD_CLIENTS          the number of concurrent clients (default 50)
+///   PROVIDER_LOAD_ITERATIONS       the number of times every client runs its flow (default 1)
+///   PROVIDER_LOAD_RESPONSE_DELAY   how long the stub provider takes to respond, in milliseconds
+///                                  (default 20)
+final class ProviderLoadGenerator {
+
+  /// The scale of a load run.
+  struct Configuration {
+    /// The number of clients that run concurrently.
+    var clientCount = 50
+
+    /// The number of times every client runs its flow.
+    var iterationCount = 1
+
+    /// How long the stub provider takes to respond.
+    var responseDelay: TimeInterval = 0.02
+
+    /// The configuration given by the environment, with defaults for what it doesn't set.
+    static func fromEnvironment(
+      _ environment: [String: String] = ProcessInfo.processInfo.environment
+    ) -> Configuration {
+      var configuration = Configuration()
+      if let clientCount = environment["PROVIDER_LOAD_CLIENTS"].flatMap(Int.init) {
+        configuration.clientCount = max(clientCount, 1)
+      }
+      if let iterationCount = environment["PROVIDER_LOAD_ITERATIONS"].flatMap(Int.init) {
+        configuration.iterationCount = max(iterationCount, 1)
+      }
+      if let delay = environment["PROVIDER_LOAD_RESPONSE_DELAY"].flatMap(Double.init) {
+        configuration.responseDelay = max(delay, 0) / 1000
+      }
+      return configuration
+    }
+  }
+
+  /// The outcome of a load run.
+  struct Report: CustomStringConvertible {
+    /// The wall clock time the run took.
+    let duration: TimeInterval
+
+    /// The latencies of the operations that succeeded, keyed by the name of the operation.
+    let latencies: [String: LatencyHistogram]
+
+    /// The number of operations that failed, keyed by the name of the operation.
+    let failureCounts: [String: Int]
+
+    /// The CPU time, user and system, that the process spent during the run.
+    let cpuTime: TimeInterval
+
+    /// How much the process's memory footprint grew during the run, in bytes.
+    let memoryGrowth: Int64
+
+    /// The largest resident size the process has had, in bytes.
+    let peakResidentSize: UInt64
+
+    /// The number of operations that succeeded.
+    var operationCount: UInt64 { latencies.values.reduce(0) { $0 + $1.count } }
+
+    /// The number of operations that failed.
+    var failureCount: Int { failureCounts.values.reduce(0, +) }
+
+    /// Operations completed per second of the run.
+    var throughput: Double { duration > 0 ? Double(operationCount) / duration : 0 }
+
+    var description: String {
+      var lines = [
+        String(
+          format: "%llu operations in %.2f s (%.1f/s), %d failed", operationCount, duration,
+          throughput, failureCount),
+        String(
+          format: "CPU %.2f s (%.0f%% of one core), memory +%.1f MB, peak resident %.1f MB",
+          cpuTime, duration > 0 ? cpuTime / duration * 100 : 0, Double(memoryGrowth) / 1_048_576,
+          Double(peakResidentSize) / 1_048_576),
+      ]
+      for (operation, histogram) in latencies.sorted(by: { $0.key < $1.key }) {
+        let failureCount = failureCounts[operation] ?? 0
+        lines.append(
+          String(
+            format: "%@: n=%llu p50=%.1fms p90=%.1fms p99=%.1fms max=%.1fms%@", operation,
+            histogram.count, histogram.duration(atPercentile: 50) * 1000,
+            histogram.duration(atPercentile: 90) * 1000,
+            histogram.duration(atPercentile: 99) * 1000, histogram.maximumDuration * 1000,
+            failureCount > 0 ? " failed=\(failureCount)" : ""))
+      }
+      return lines.joined(separator: "\n")
+    }
+  }
+
+  /// Records the operations of the clients of one run.
+  final class Recorder {
+    private let lock = NSLock()
+    private var latencies: [String: LatencyHistogram] = [:]
+    private var failureCounts: [String: Int] = [:]
+
+    fileprivate init() {}
+
+    /// Runs an operation, recording how long it took if it succeeds or that it failed if it throws.
+    @discardableResult
+    func measure<Value>(_ operation: String, _ body: () async throws -> Value) async throws
+      -> Value
+    {
+      let startTime = ProcessInfo.processInfo.systemUptime
+      do {
+        let value = try await body()
+        let duration = ProcessInfo.processInfo.systemUptime - startTime
+        lock.lock()
+        defer { lock.unlock() }
+        latencies[operation, default: LatencyHistogram()].record(duration)
+        return value
+      } catch {
+        lock.lock()
+        defer { lock.unlock() }
+        failureCounts[operation, default: 0] += 1
+        throw error
+      }
+    }
+
+    fileprivate func results() -> ([String: LatencyHistogram], [String: Int]) {
+      lock.lock()
+      defer { lock.unlock() }
+      return (latencies, failureCounts)
+    }
+  }
+
+  let configuration: Configuration
+
+  init(configuration: Configuration = .fromEnvironment()) {
+    self.configuration = configuration
+  }
+
+  /// Runs `client` concurrently for every client of the configuration, as many times as it has
+  /// iterations, and reports on the run once all of them are done. A client that throws stops its
+  /// remaining iterations, but not the other clients.
+  func run(client: @escaping (_ clientIndex: Int, Recorder) async throws -> Void) async -> Report {
+    let recorder = Recorder()
+    let iterationCount = configuration.iterationCount
+    let startMemoryFootprint = Self.memoryFootprint()
+    let startCPUTime = Self.cpuTime()
+    let startTime = ProcessInfo.processInfo.systemUptime
+
+    await withTaskGroup(of: Void.self) { group in
+      for clientIndex in 0..<configuration.clientCount {
+        group.addTask {
+          for _ in 0..<iterationCount {
+            do {
+              try await client(clientIndex, recorder)
+            } catch {
+              return
+            }
+          }
+        }
+      }
+    }
+
+    let duration = ProcessInfo.processInfo.systemUptime - startTime
+    let (latencies, failureCounts) = recorder.results()
+    return Report(
+      duration: duration, latencies: latencies, failureCounts: failureCounts,
+      cpuTime: Self.cpuTime() - startCPUTime,
+      memoryGrowth: Int64(Self.memoryFootprint()) - Int64(startMemoryFootprint),
+      peakResidentSize: Self.peakResidentSize())
+  }
+
+  /// The user and system CPU time that the process has spent.
+  private static func cpuTime() -> TimeInterval {
+    var usage = rusage()
+    getrusage(RUSAGE_SELF, &usage)
+    func seconds(_ time: timeval) -> TimeInterval {
+      TimeInterval(time.tv_sec) + TimeInterval(time.tv_usec) / 1_000_000
+    }
+    return seconds(usage.ru_utime) + seconds(usage.ru_stime)
+  }
+
+  /// The memory that the process is charged for, as shown by Xcode's memory gauge.
+  private static func memoryFootprint() -> UInt64 {
+    var info = task_vm_info_data_t()
+    var count = mach_msg_type_number_t(
+      MemoryLayout<task_vm_info_data_t>.size / MemoryLayout<integer_t>.size)
+    let result = withUnsafeMutablePointer(to: &info) {
+      $0.withMemoryRebound(to: integer_t.self, capacity: Int(count)) {
+        task_info(mach_task_self_, task_flavor_t(TASK_VM_INFO), $0, &count)
+      }
+    }
+    return result == KERN_SUCCESS ? info.phys_footprint : 0
+  }
+
+  /// The largest resident size that the process has had.
+  private static func peakResidentSize() -> UInt64 {
+    var info = mach_task_basic_info()
+    var count = mach_msg_type_number_t(
+      MemoryLayout<mach_task_basic_info>.size / MemoryLayout<integer_t>.size)
+    let result = withUnsafeMutablePointer(to: &info) {
+      $0.withMemoryRebound(to: integer_t.self, capacity: Int(count)) {
+        task_info(mach_task_self_, task_flavor_t(MACH_TASK_BASIC_INFO), $0, &count)
+      }
+    }
+    return result == KERN_SUCCESS ? info.resident_size_max : 0
+  }
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import Foundation
+import GoogleMaps
+
+@testable import DriverSampleApp
+
+/// A navigator that computes routes on a virtual clock, and counts them.
+///
+/// Each route takes `routeComputationDelay` to compute, plus `delayPerDestination` for every
+/// destination after the first, and is reported ready with `routeStatus`.
+final class StubNavigator: RouteNavigator {
+  let clock: VirtualClock
+  let routeComputationDelay: TimeInterval
+  let delayPerDestination: TimeInterval
+
+  /// The status that routes are computed with.
+  var routeStatus = GMSRouteStatus.OK
+
+  /// The destinations of the current route that haven't been reached yet.
+  private(set) var destinations: [GMSNavigationWaypoint] = []
+
+  /// The number of routes that have been computed.
+  private(set) var routeComputationCount = 0
+
+  /// The number of times the navigator continued to its next destination.
+  private(set) var continueCount = 0
+
+  private var routeTimer: AppClockTimer?
+
+  init(
+    clock: VirtualClock, routeComputationDelay: TimeInterval = 1,
+    delayPerDestination: TimeInterval = 0.1
+  ) {
+    self.clock = clock
+    self.routeComputationDelay = routeComputationDelay
+    self.delayPerDestination = delayPerDestination
+  }
+
+  func setDestinations(
+    _ destinations: [GMSNavigationWaypoint], callback: @escaping GMSRouteStatusCallback
+  ) {
+    routeTimer?.invalidate()
+    routeComputationCount += 1
+    let delay = routeComputationDelay + delayPerDestination * Double(destinations.count - 1)
+    routeTimer = clock.scheduleTimer(interval: delay, repeats: false) { [weak self] in
+      guard let self = self else { return }
+      self.destinations = self.routeStatus == .OK ? destinations : []
+      callback(self.routeStatus)
+    }
+  }
+
+  @discardableResult
+  func continueToNextDestination() -> GMSNavigationWaypoint? {
+    guard !destinations.isEmpty else { return nil }
+    continueCount += 1
+    destinations.removeFirst()
+    return destinations.first
+  }
+
+  func clearDestinations() {
+    routeTimer?.invalidate()
+    destinations = []
+  }
+}
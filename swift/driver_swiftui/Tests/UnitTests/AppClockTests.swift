@@ -0,0 +1,136 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+import XCTest
+
+@testable import DriverSampleApp
+
+class AppClockTests: XCTestCase {
+  private let clock = VirtualClock(now: 1_000_000)
+
+  /// Advances the clock a second at a time whenever something is waiting on it, until `condition`
+  /// holds. Tasks that sleep on the clock are given the chance to run between steps.
+  private func advanceClock(
+    until condition: () -> Bool, maximumInterval: TimeInterval = 3600
+  ) async throws {
+    let endTime = clock.now + maximumInterval
+    while !condition() {
+      guard clock.now < endTime else {
+        XCTFail("Condition not met within \(maximumInterval) s of clock time")
+        return
+      }
+      if clock.pendingTimerCount > 0 {
+        clock.advance(by: 1)
+      }
+      try await Task.sleep(nanoseconds: 1_000_000)
+    }
+  }
+
+  func testVirtualClockFiresTimersInOrder() {
+    var firedTimers: [String] = []
+    let pollTimer = clock.scheduleTimer(interval: 2, repeats: true) { firedTimers.append("poll") }
+    clock.scheduleTimer(interval: 5, repeats: false) { firedTimers.append("endSession") }
+    let cancelledTimer = clock.scheduleTimer(interval: 3, repeats: false) {
+      firedTimers.append("cancelled")
+    }
+    cancelledTimer.invalidate()
+
+    clock.advance(by: 6)
+    XCTAssertEqual(firedTimers, ["poll", "poll", "endSession", "poll"])
+
+    pollTimer.invalidate()
+    clock.advance(by: 10)
+    XCTAssertEqual(firedTimers.count, 4)
+    XCTAssertEqual(clock.pendingTimerCount, 0)
+  }
+
+  func testDayOfPollingRunsInVirtualTime() {
+    var pollCount = 0
+    clock.scheduleTimer(interval: 2, repeats: true) { pollCount += 1 }
+
+    clock.advance(by: 24 * 60 * 60)
+    XCTAssertEqual(pollCount, 43_200)
+  }
+
+  func testSleepEndsWhenClockPassesIt() async throws {
+    let sleeper = Task { try await clock.sleep(for: 30) }
+    try await advanceClock(until: { clock.pendingTimerCount > 0 })
+    clock.advance(by: 29)
+    clock.advance(by: 1)
+    try await sleeper.value
+
+    let cancelledSleeper = Task { try await clock.sleep(for: 30) }
+    cancelledSleeper.cancel()
+    do {
+      try await cancelledSleeper.value
+      XCTFail()
+    } catch {
+      XCTAssertTrue(error is CancellationError)
+    }
+  }
+
+  /// Walks a trip with an intermediate destination through every status, with every update first
+  /// failing and then being retried, and the driver's token refreshed as the trip goes on.
+  func testMultiStopTripWithTokenRefreshRunsInVirtualTime() async throws {
+    let tokenLifetime: TimeInterval = 700
+    let fetchLock = NSLock()
+    var tokenFetchCount = 0
+    let tokenCache = AuthTokenCache(clock: clock) { [clock] _, completion in
+      fetchLock.lock()
+      tokenFetchCount += 1
+      let token = "token-\(tokenFetchCount)"
+      fetchLock.unlock()
+      completion(
+        .success(AuthTokenCache.Token(token: token, expiration: clock.now + tokenLifetime)))
+    }
+
+    let sendLock = NSLock()
+    var attemptedUpdates = Set<String>()
+    var sentStatuses: [ProviderTripStatus] = []
+    let outbox = TripStatusOutbox(retryInterval: 5, clock: clock) { update in
+      sendLock.lock()
+      defer { sendLock.unlock() }
+      if attemptedUpdates.insert(update.idempotencyKey).inserted {
+        throw URLError(.networkConnectionLost)
+      }
+      sentStatuses.append(update.status)
+    }
+
+    let stops: [(ProviderTripStatus, Int?)] = [
+      (.enrouteToPickup, nil), (.arrivedAtPickup, nil), (.enrouteToIntermediateDestination, 0),
+      (.arrivedAtIntermediateDestination, 0), (.enrouteToDropoff, nil), (.complete, nil),
+    ]
+    var usedTokens = Set<String>()
+    for (status, intermediateDestinationIndex) in stops {
+      // Drive to the next stop.
+      clock.advance(by: 300)
+      tokenCache.token(forKey: "test-vehicle") { result in
+        if case .success(let token) = result {
+          usedTokens.insert(token)
+        }
+      }
+      outbox.enqueue(
+        tripID: "test-trip", status: status,
+        intermediateDestinationIndex: intermediateDestinationIndex)
+      try await advanceClock(until: { outbox.pendingUpdates.isEmpty })
+    }
+
+    XCTAssertEqual(sentStatuses, stops.map { $0.0 })
+    // Tokens are refreshed ahead of expiring once 80% of their lifetime has passed, which the
+    // drive to every other stop crosses, so no stop waits for a token.
+    XCTAssertEqual(tokenFetchCount, 3)
+    XCTAssertEqual(usedTokens, ["token-1", "token-2", "token-3"])
+  }
+}
@@ -0,0 +1,259 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+import Foundation
+import XCTest
+
+@testable import DriverSampleApp
+
+class AuthTokenProviderTests: XCTestCase {
+  private var urlSession: URLSession!
+  private var tokenCacheFileURL: URL!
+  private let requestCountsLock = NSLock()
+  private var requestCounts: [String: Int] = [:]
+
+  override func setUp() {
+    let configuration = URLSessionConfiguration.ephemeral
+    configuration.protocolClasses = [MockURLProtocol.self]
+    urlSession = URLSession(configuration: configuration)
+    tokenCacheFileURL = FileManager.default.temporaryDirectory.appendingPathComponent(
+      "AuthTokenProviderTests-\(UUID().uuidString).plist")
+    requestCounts = [:]
+  }
+
+  override func tearDown() {
+    MockURLProtocol.networkEmulator = nil
+    try? FileManager.default.removeItem(at: tokenCacheFileURL)
+  }
+
+  /// Serves tokens like the provider, counting the token requests made for each vehicle ID. Tokens
+  /// expire `lifetime` seconds after the time of `clock`.
+  private func setTokenResponse(
+    lifetime: TimeInterval, latency: TimeInterval = 0, clock: AppClock = SystemClock.shared,
+    onRequest: ((Int) -> Void)? = nil
+  ) {
+    MockURLProtocol.requestHandler = { request in
+      let vehicleID = request.url!.lastPathComponent
+      self.requestCountsLock.lock()
+      self.requestCounts[vehicleID, default: 0] += 1
+      let requestCount = self.requestCounts[vehicleID]!
+      self.requestCountsLock.unlock()
+      onRequest?(requestCount)
+      Thread.sleep(forTimeInterval: latency)
+
+      let expiration = clock.now + lifetime
+      let data = try JSONSerialization.data(withJSONObject: [
+        "jwt": "\(vehicleID)-token\(requestCount)",
+        "expirationTimestamp": Int(expiration * 1000),
+      ])
+      let response = HTTPURLResponse(
+        url: request.url!, statusCode: 200, httpVersion: nil, headerFields: nil)!
+      return (response, data)
+    }
+  }
+
+  func testConcurrentFetchesShareOneRequestPerVehicle() {
+    setTokenResponse(lifetime: 3600)
+    let authTokenProvider = AuthTokenProvider(session: urlSession, tokenCacheFileURL: nil)
+    let vehicleIDs = ["test-vehicle1", "test-vehicle2", "test-vehicle3"]
+    let fetchCount = 300
+
+    let fetched = expectation(description: "All tokens fetched")
+    fetched.expectedFulfillmentCount = fetchCount
+    DispatchQueue.concurrentPerform(iterations: fetchCount) { index in
+      let vehicleID = vehicleIDs[index % vehicleIDs.count]
+      authTokenProvider.fetchToken(vehicleID: vehicleID) { token, _ in
+        XCTAssertEqual(token, "\(vehicleID)-token1")
+        fetched.fulfill()
+      }
+    }
+    wait(for: [fetched], timeout: 5)
+
+    XCTAssertEqual(
+      requestCounts, ["test-vehicle1": 1, "test-vehicle2": 1, "test-vehicle3": 1])
+  }
+
+  func testRefreshesTokenAheadOfExpiration() {
+    let refreshed = expectation(description: "Token refreshed")
+    setTokenResponse(lifetime: 3600) { requestCount in
+      if requestCount == 2 {
+        refreshed.fulfill()
+      }
+    }
+    // Refresh as soon as a token has been fetched.
+    let authTokenProvider = AuthTokenProvider(
+      session: urlSession, tokenCacheFileURL: nil, refreshAheadFraction: 1)
+
+    let fetched = expectation(description: "Token fetched")
+    authTokenProvider.fetchToken(vehicleID: "test-vehicle") { token, _ in
+      XCTAssertEqual(token, "test-vehicle-token1")
+      fetched.fulfill()
+    }
+    wait(for: [fetched], timeout: 5)
+
+    // The cached token is returned without waiting, while a new one is fetched.
+    var cachedToken: String?
+    authTokenProvider.fetchToken(vehicleID: "test-vehicle") { token, _ in
+      cachedToken = token
+    }
+    XCTAssertEqual(cachedToken, "test-vehicle-token1")
+    wait(for: [refreshed], timeout: 5)
+  }
+
+  func testEvictsTokensClosestToExpiring() {
+    var fetchedKeys: [String] = []
+    let now = Date().timeIntervalSince1970
+    let lifetimes = ["test-vehicle1": 300.0, "test-vehicle2": 100.0, "test-vehicle3": 200.0]
+    let tokenCache = AuthTokenCache(capacity: 2) { key, completion in
+      fetchedKeys.append(key)
+      completion(.success(AuthTokenCache.Token(token: key, expiration: now + lifetimes[key]!)))
+    }
+
+    // The second vehicle's token expires first, so it is evicted to make room for the third.
+    let keys = ["test-vehicle1", "test-vehicle2", "test-vehicle3", "test-vehicle1", "test-vehicle2"]
+    for key in keys {
+      tokenCache.token(forKey: key) { _ in }
+    }
+    XCTAssertEqual(
+      fetchedKeys, ["test-vehicle1", "test-vehicle2", "test-vehicle3", "test-vehicle2"])
+  }
+
+  func testKeepsTokenBeingReturnedEvenIfItExpiresFirst() {
+    var fetchedKeys: [String] = []
+    let now = Date().timeIntervalSince1970
+    let lifetimes = ["test-vehicle1": 300.0, "test-vehicle2": 100.0]
+    let tokenCache = AuthTokenCache(capacity: 1) { key, completion in
+      fetchedKeys.append(key)
+      completion(.success(AuthTokenCache.Token(token: key, expiration: now + lifetimes[key]!)))
+    }
+
+    // The second vehicle's token expires first, but it is the one just fetched, so the first
+    // vehicle's token is evicted instead.
+    for key in ["test-vehicle1", "test-vehicle2", "test-vehicle2"] {
+      tokenCache.token(forKey: key) { _ in }
+    }
+    XCTAssertEqual(fetchedKeys, ["test-vehicle1", "test-vehicle2"])
+  }
+
+  /// Fetches a token with a new provider, as the SDK does right after the app is launched.
+  private func fetchFirstToken() {
+    let authTokenProvider = AuthTokenProvider(
+      session: urlSession, tokenCacheFileURL: tokenCacheFileURL)
+    let fetched = expectation(description: "Token fetched")
+    authTokenProvider.fetchToken(vehicleID: "test-vehicle") { token, _ in
+      XCTAssertNotNil(token)
+      fetched.fulfill()
+    }
+    wait(for: [fetched], timeout: 5)
+  }
+
+  /// Waits for the tokens of a provider to have been persisted.
+  private func waitForPersistedTokens() {
+    let persisted = expectation(
+      for: NSPredicate { _, _ in
+        FileManager.default.fileExists(atPath: self.tokenCacheFileURL.path)
+      }, evaluatedWith: nil)
+    wait(for: [persisted], timeout: 5)
+  }
+
+  func testRestoresPersistedTokensAfterRelaunch() {
+    setTokenResponse(lifetime: 3600)
+    fetchFirstToken()
+    waitForPersistedTokens()
+
+    fetchFirstToken()
+    XCTAssertEqual(requestCounts, ["test-vehicle": 1])
+  }
+
+  func testPersistedTokensAreExcludedFromBackup() {
+    setTokenResponse(lifetime: 3600)
+    fetchFirstToken()
+
+    // Read the file's resource values afresh each time, since URLs cache them.
+    let excluded = expectation(
+      for: NSPredicate { _, _ in
+        let fileURL = URL(fileURLWithPath: self.tokenCacheFileURL.path)
+        let resourceValues = try? fileURL.resourceValues(forKeys: [.isExcludedFromBackupKey])
+        return resourceValues?.isExcludedFromBackup == true
+      }, evaluatedWith: nil)
+    wait(for: [excluded], timeout: 5)
+  }
+
+  // MARK: - Emulated network
+
+  func testTokenExpiringWhileItsRefreshIsInFlightIsFetchedOnce() {
+    let clock = VirtualClock(now: 1_000_000)
+    setTokenResponse(lifetime: 100, clock: clock)
+    // Token requests take a mobile round trip, so the token can expire while one is in flight.
+    let networkEmulator = NetworkEmulator(seed: 1)
+    networkEmulator.addRoute(
+      pathPrefix: "/token/", conditions: NetworkEmulator.Conditions(latency: .constant(0.2)))
+    MockURLProtocol.networkEmulator = networkEmulator
+    let authTokenProvider = AuthTokenProvider(
+      session: urlSession, tokenCacheFileURL: nil, refreshAheadFraction: 0.2, clock: clock)
+
+    let fetched = expectation(description: "Token fetched")
+    authTokenProvider.fetchToken(vehicleID: "test-vehicle") { token, _ in
+      XCTAssertEqual(token, "test-vehicle-token1")
+      fetched.fulfill()
+    }
+    wait(for: [fetched], timeout: 5)
+
+    // Within the refresh window, the cached token is returned at once and a refresh is sent.
+    clock.advance(by: 90)
+    var cachedToken: String?
+    authTokenProvider.fetchToken(vehicleID: "test-vehicle") { token, _ in
+      cachedToken = token
+    }
+    XCTAssertEqual(cachedToken, "test-vehicle-token1")
+
+    // Once the token has expired, callers wait for the refresh in flight instead of being handed
+    // the expired token or sending requests of their own.
+    clock.advance(by: 20)
+    let fetchCount = 20
+    let refreshed = expectation(description: "Refreshed token fetched")
+    refreshed.expectedFulfillmentCount = fetchCount
+    DispatchQueue.concurrentPerform(iterations: fetchCount) { _ in
+      authTokenProvider.fetchToken(vehicleID: "test-vehicle") { token, _ in
+        XCTAssertEqual(token, "test-vehicle-token2")
+        refreshed.fulfill()
+      }
+    }
+    wait(for: [refreshed], timeout: 5)
+    XCTAssertEqual(requestCounts, ["test-vehicle": 2])
+  }
+
+  // MARK: - Performance
+
+  /// The round trip time of the stub provider.
+  private static let providerLatency: TimeInterval = 0.05
+
+  func testTimeToFirstTokenOnColdStart() {
+    setTokenResponse(lifetime: 3600, latency: Self.providerLatency)
+    measure(metrics: [XCTClockMetric()]) {
+      try? FileManager.default.removeItem(at: tokenCacheFileURL)
+      fetchFirstToken()
+    }
+  }
+
+  func testTimeToFirstTokenOnWarmStart() {
+    setTokenResponse(lifetime: 3600, latency: Self.providerLatency)
+    fetchFirstToken()
+    waitForPersistedTokens()
+    measure(metrics: [XCTClockMetric()]) {
+      fetchFirstToken()
+    }
+  }
+}
@@ -0,0 +1,309 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import Foundation
+import XCTest
+
+@testable import DriverSampleApp
+
+class DriverStartupTests: XCTestCase {
+  /// The time each provider call takes in the simulated launches.
+  private static let roundTripTime: TimeInterval = 0.3
+
+  /// Fetches each vehicle's token once, taking a round trip, like the auth token cache.
+  private final class StubTokenCache {
+    private let clock: AppClock
+    private let lock = NSLock()
+    private var fetches: [String: Task<Void, Error>] = [:]
+
+    init(clock: AppClock) {
+      self.clock = clock
+    }
+
+    func fetchToken(vehicleID: String) async throws {
+      lock.lock()
+      let fetch =
+        fetches[vehicleID]
+        ?? Task { [clock] in try await clock.sleep(for: DriverStartupTests.roundTripTime) }
+      fetches[vehicleID] = fetch
+      lock.unlock()
+      try await fetch.value
+    }
+  }
+
+  /// When a simulated launch reached its milestones, in seconds since the launch.
+  private struct LaunchMilestones {
+    /// When Fleet Engine acknowledged the vehicle online.
+    let online: TimeInterval
+
+    /// When the trips matched with the vehicle were first known.
+    let firstVehicleState: TimeInterval
+  }
+
+  private var urlSession: URLSession!
+  private var sessionFileURL: URL!
+  private var clock: VirtualClock!
+
+  override func setUp() {
+    super.setUp()
+    let configuration = URLSessionConfiguration.ephemeral
+    configuration.protocolClasses = [MockURLProtocol.self]
+    urlSession = URLSession(configuration: configuration)
+    sessionFileURL = FileManager.default.temporaryDirectory.appendingPathComponent(
+      "DriverStartupTests-\(UUID().uuidString).plist")
+    clock = VirtualClock(now: 0)
+  }
+
+  override func tearDown() {
+    MockURLProtocol.responseDelayHandler = nil
+    try? FileManager.default.removeItem(at: sessionFileURL)
+    super.tearDown()
+  }
+
+  private func makeStartup() -> DriverStartup {
+    DriverStartup(
+      providerService: ProviderService(session: urlSession),
+      authTokenProvider: AuthTokenProvider(session: urlSession, tokenCacheFileURL: nil),
+      fileURL: sessionFileURL)
+  }
+
+  /// Runs `operation` while advancing the clock in small steps whenever something is waiting on
+  /// it, and returns its result.
+  private func runAdvancingClock<Value>(_ operation: @escaping () async throws -> Value)
+    async throws -> Value
+  {
+    let lock = NSLock()
+    var isFinished = false
+    let task = Task { () async throws -> Value in
+      defer {
+        lock.lock()
+        isFinished = true
+        lock.unlock()
+      }
+      return try await operation()
+    }
+    let endTime = clock.now + 60
+    while true {
+      lock.lock()
+      let isTaskFinished = isFinished
+      lock.unlock()
+      if isTaskFinished {
+        break
+      }
+      guard clock.now < endTime else {
+        XCTFail("Operation did not finish within 60 s of clock time")
+        task.cancel()
+        break
+      }
+      if clock.pendingTimerCount > 0 {
+        clock.advance(by: 0.01)
+      }
+      try await Task.sleep(nanoseconds: 1_000_000)
+    }
+    return try await task.value
+  }
+
+  private func sleep(for interval: TimeInterval) async throws {
+    if interval > 0 {
+      try await clock.sleep(for: interval)
+    }
+  }
+
+  /// Simulates a launch through `DriverStartup`, which prepares the vehicle and its token during
+  /// the terms dialog, and starts vehicle updates as soon as the driver context is set up.
+  private func simulatePipelinedLaunch(termsDuration: TimeInterval) async throws -> (
+    LaunchMilestones, DriverStartup
+  ) {
+    let clock = self.clock!
+    let tokenCache = StubTokenCache(clock: clock)
+    let startup = DriverStartup(
+      fileURL: sessionFileURL, clock: clock,
+      fetchVehicle: { _ in
+        try await clock.sleep(for: Self.roundTripTime)
+        return ["matched-trip"]
+      },
+      createVehicle: { vehicleID, _ in
+        try await clock.sleep(for: Self.roundTripTime)
+        return vehicleID
+      },
+      fetchToken: { vehicleID in try await tokenCache.fetchToken(vehicleID: vehicleID) })
+
+    startup.prepareVehicle()
+    startup.begin(.terms)
+    try await sleep(for: termsDuration)
+    startup.end(.terms)
+    let vehicle = try await startup.vehicle()
+    startup.begin(.driverContext)
+    startup.end(.driverContext)
+
+    // Fleet Engine acknowledges the vehicle online once the driver SDK has a token to send with
+    // the update.
+    func reportOnline() async throws -> TimeInterval {
+      try await tokenCache.fetchToken(vehicleID: vehicle.session.vehicleID)
+      try await clock.sleep(for: Self.roundTripTime)
+      startup.end(.online)
+      return clock.now - startup.launchTime
+    }
+    startup.begin(.online)
+    async let online = reportOnline()
+    if vehicle.matchedTripIDs.isEmpty {
+      try await clock.sleep(for: Self.roundTripTime)
+    }
+    let firstVehicleState = clock.now - startup.launchTime
+    return (
+      LaunchMilestones(online: try await online, firstVehicleState: firstVehicleState), startup
+    )
+  }
+
+  // MARK: - Tests
+
+  func testResumesVehicleOfPreviousLaunch() async throws {
+    let stubProvider = StubProvider()
+    stubProvider.install()
+
+    let coldVehicle = try await makeStartup().vehicle()
+    let warmStartup = makeStartup()
+    let warmVehicle = try await warmStartup.vehicle()
+
+    XCTAssertEqual(coldVehicle.launch, .cold)
+    XCTAssertTrue(coldVehicle.matchedTripIDs.isEmpty)
+    XCTAssertEqual(warmVehicle.launch, .warm)
+    XCTAssertEqual(warmStartup.launch, .warm)
+    XCTAssertEqual(warmVehicle.session, coldVehicle.session)
+    // The stub provider matches a trip with every vehicle it creates.
+    XCTAssertEqual(warmVehicle.matchedTripIDs.count, 1)
+    XCTAssertEqual(stubProvider.tripStatuses.count, 1)
+  }
+
+  func testCreatesVehicleIfProviderNoLongerHasIt() async throws {
+    let encoder = PropertyListEncoder()
+    try encoder.encode(
+      DriverStartup.VehicleSession(vehicleID: "dropped-vehicle", isBackToBackEnabled: true)
+    ).write(to: sessionFileURL)
+    StubProvider().install()
+
+    let vehicle = try await makeStartup().vehicle()
+    let resumedVehicle = try await makeStartup().vehicle()
+
+    XCTAssertEqual(vehicle.launch, .cold)
+    XCTAssertNotEqual(vehicle.session.vehicleID, "dropped-vehicle")
+    XCTAssertEqual(resumedVehicle.session, vehicle.session)
+  }
+
+  func testKeepsVehicleIfProviderFailsToAnswer() async throws {
+    try PropertyListEncoder().encode(
+      DriverStartup.VehicleSession(vehicleID: "resumed-vehicle", isBackToBackEnabled: true)
+    ).write(to: sessionFileURL)
+    let lock = NSLock()
+    var isProviderUp = false
+    var createdVehicleCount = 0
+    MockURLProtocol.requestHandler = { request in
+      lock.lock()
+      defer { lock.unlock() }
+      if request.httpMethod == "POST" {
+        createdVehicleCount += 1
+      }
+      let response = HTTPURLResponse(
+        url: request.url!, statusCode: isProviderUp ? 200 : 503, httpVersion: nil,
+        headerFields: ["Content-Type": "application/json"])!
+      let jsonObject: [String: Any] = isProviderUp ? ["currentTripsIds": ["matched-trip"]] : [:]
+      return (response, try JSONSerialization.data(withJSONObject: jsonObject))
+    }
+    let startup = makeStartup()
+
+    do {
+      _ = try await startup.vehicle()
+      XCTFail("Expected resuming the vehicle to fail")
+    } catch ProviderService.Error.unexpectedStatus(let statusCode) {
+      XCTAssertEqual(statusCode, 503)
+    }
+    lock.lock()
+    isProviderUp = true
+    lock.unlock()
+    let vehicle = try await startup.vehicle()
+
+    XCTAssertEqual(vehicle.launch, .warm)
+    XCTAssertEqual(vehicle.session.vehicleID, "resumed-vehicle")
+    XCTAssertEqual(vehicle.matchedTripIDs, ["matched-trip"])
+    lock.lock()
+    defer { lock.unlock() }
+    XCTAssertEqual(createdVehicleCount, 0)
+  }
+
+  func testFailedPreparationStartsOver() async throws {
+    var creationCount = 0
+    let startup = DriverStartup(
+      fetchVehicle: { _ in [] },
+      createVehicle: { vehicleID, _ in
+        creationCount += 1
+        guard creationCount > 1 else { throw URLError(.notConnectedToInternet) }
+        return vehicleID
+      },
+      fetchToken: { _ in })
+
+    do {
+      _ = try await startup.vehicle()
+      XCTFail("Expected preparing the vehicle to fail")
+    } catch {
+    }
+    let vehicle = try await startup.vehicle()
+
+    XCTAssertEqual(vehicle.launch, .cold)
+    XCTAssertEqual(creationCount, 2)
+  }
+
+  func testTokenIsFetchedWhileVehicleIsResumed() async throws {
+    _ = try await runAdvancingClock { try await self.simulatePipelinedLaunch(termsDuration: 0) }
+
+    let (_, startup) = try await runAdvancingClock {
+      try await self.simulatePipelinedLaunch(termsDuration: 0)
+    }
+
+    let timings = startup.timings
+    XCTAssertEqual(startup.launch, .warm)
+    XCTAssertEqual(try XCTUnwrap(timings[.vehicle]).start, 0, accuracy: 0.02)
+    XCTAssertEqual(try XCTUnwrap(timings[.token]).start, 0, accuracy: 0.02)
+    XCTAssertEqual(try XCTUnwrap(timings[.online]).end, 2 * Self.roundTripTime, accuracy: 0.05)
+  }
+
+  func testVehicleAndTokenArePreparedDuringTermsOnColdLaunch() async throws {
+    let termsDuration: TimeInterval = 2
+    let (milestones, startup) = try await runAdvancingClock {
+      try await self.simulatePipelinedLaunch(termsDuration: termsDuration)
+    }
+
+    // The vehicle is created and its token fetched while the terms are shown, so the vehicle is
+    // online a single round trip after they are accepted.
+    let timings = startup.timings
+    XCTAssertEqual(startup.launch, .cold)
+    XCTAssertLessThan(try XCTUnwrap(timings[.vehicle]).end, try XCTUnwrap(timings[.terms]).end)
+    XCTAssertLessThan(try XCTUnwrap(timings[.token]).end, try XCTUnwrap(timings[.terms]).end)
+    XCTAssertEqual(milestones.online, termsDuration + Self.roundTripTime, accuracy: 0.05)
+    XCTAssertEqual(milestones.firstVehicleState, termsDuration + Self.roundTripTime, accuracy: 0.05)
+  }
+
+  func testResumedVehicleBringsItsMatchedTrips() async throws {
+    _ = try await runAdvancingClock { try await self.simulatePipelinedLaunch(termsDuration: 0) }
+
+    let (milestones, startup) = try await runAdvancingClock {
+      try await self.simulatePipelinedLaunch(termsDuration: 0)
+    }
+
+    // The trips matched with a resumed vehicle are known as soon as it is fetched, before it is
+    // reported online.
+    XCTAssertEqual(startup.launch, .warm)
+    XCTAssertEqual(milestones.firstVehicleState, Self.roundTripTime, accuracy: 0.05)
+    XCTAssertLessThan(milestones.firstVehicleState, milestones.online)
+  }
+}
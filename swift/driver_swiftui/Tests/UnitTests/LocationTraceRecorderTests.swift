@@ -0,0 +1,251 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import Foundation
+import XCTest
+
+@testable import DriverSampleApp
+
+class LocationTraceRecorderTests: XCTestCase {
+  private typealias Fix = LocationTraceRecorder.Fix
+
+  private var fileURL: URL!
+
+  override func setUp() {
+    fileURL = FileManager.default.temporaryDirectory.appendingPathComponent(
+      "LocationTraceRecorderTests-\(UUID().uuidString).bin")
+  }
+
+  override func tearDown() {
+    try? FileManager.default.removeItem(at: fileURL)
+    try? FileManager.default.removeItem(at: fileURL.appendingPathExtension("1"))
+  }
+
+  /// Returns `duration` seconds of city driving with one fix per second. The vehicle drives blocks
+  /// of 80 to 400 meters, turns or goes straight at each intersection, sometimes stops at one, and
+  /// changes speed between blocks.
+  private static func makeDrivingTrace(duration: Int, seed: UInt64 = 1) -> [Fix] {
+    var generator = SeededRandomNumberGenerator(seed: seed)
+    let metersPerDegree = 111_319.49
+    var latitude = 37.7749
+    var longitude = -122.4194
+    var heading = 0.0
+    var speed = 0.0
+    var targetSpeed = 12.0
+    var remainingBlockLength = 200.0
+    var remainingStopDuration = 0
+    var fixes: [Fix] = []
+    fixes.reserveCapacity(duration)
+    for second in 0..<duration {
+      if remainingStopDuration > 0 {
+        remainingStopDuration -= 1
+        speed = 0
+      } else {
+        speed += min(max(targetSpeed - speed, -3), 2)
+      }
+      latitude += speed * cos(heading) / metersPerDegree
+      longitude += speed * sin(heading) / (metersPerDegree * cos(latitude * .pi / 180))
+      remainingBlockLength -= speed
+      if remainingBlockLength <= 0 {
+        heading += [0, .pi / 2, -.pi / 2].randomElement(using: &generator)!
+        remainingBlockLength = Double.random(in: 80...400, using: &generator)
+        targetSpeed = Double.random(in: 6...15, using: &generator)
+        if Double.random(in: 0..<1, using: &generator) < 0.3 {
+          remainingStopDuration = Int.random(in: 10...60, using: &generator)
+        }
+      }
+      // Road-snapped locations still wander a little across the lane.
+      let jitter = Double.random(in: -0.5...0.5, using: &generator) / metersPerDegree
+      fixes.append(
+        Fix(
+          timestamp: 1_700_000_000 + Double(second), latitude: latitude + jitter,
+          longitude: longitude))
+    }
+    return fixes
+  }
+
+  /// Returns the mean and maximum distance, in meters, between each fix and where the trace
+  /// rebuilt from `keptFixes` puts the vehicle at the fix's time.
+  private static func reconstructionError(of fixes: [Fix], keptFixes: [Fix]) -> (
+    mean: Double, maximum: Double
+  ) {
+    var segment = 0
+    var totalError = 0.0
+    var maximumError = 0.0
+    for fix in fixes {
+      while segment + 2 < keptFixes.count && keptFixes[segment + 1].timestamp < fix.timestamp {
+        segment += 1
+      }
+      let start = keptFixes[segment]
+      let end = keptFixes[min(segment + 1, keptFixes.count - 1)]
+      let duration = end.timestamp - start.timestamp
+      let fraction = duration > 0 ? (fix.timestamp - start.timestamp) / duration : 0
+      let northing = (fix.latitude - start.latitude - (end.latitude - start.latitude) * fraction)
+      let easting =
+        (fix.longitude - start.longitude - (end.longitude - start.longitude) * fraction)
+        * cos(fix.latitude * .pi / 180)
+      let error = (northing * northing + easting * easting).squareRoot() * 111_319.49
+      totalError += error
+      maximumError = max(maximumError, error)
+    }
+    return (totalError / Double(fixes.count), maximumError)
+  }
+
+  private func spilledFixes(of recorder: LocationTraceRecorder) throws -> [Fix] {
+    recorder.flush()
+    recorder.waitUntilSpilled()
+    return try LocationTraceRecorder.decodeFixes(from: Data(contentsOf: fileURL))
+  }
+
+  // MARK: - Tests
+
+  func testKeepsEveryFixWithZeroTolerance() {
+    let fixes = Self.makeDrivingTrace(duration: 300)
+    let recorder = LocationTraceRecorder(tolerance: 0)
+    fixes.forEach(recorder.record)
+    recorder.flush()
+
+    let bufferedFixes = recorder.bufferedFixes()
+
+    XCTAssertEqual(bufferedFixes.count, fixes.count)
+    for (bufferedFix, fix) in zip(bufferedFixes, fixes) {
+      XCTAssertEqual(bufferedFix.timestamp, fix.timestamp, accuracy: 1e-3)
+      XCTAssertEqual(bufferedFix.latitude, fix.latitude, accuracy: 1e-6)
+      XCTAssertEqual(bufferedFix.longitude, fix.longitude, accuracy: 1e-6)
+    }
+  }
+
+  func testRebuiltTraceStaysWithinTolerance() throws {
+    let fixes = Self.makeDrivingTrace(duration: 3_600)
+    let recorder = LocationTraceRecorder(fileURL: fileURL, tolerance: 5)
+    fixes.forEach(recorder.record)
+
+    let keptFixes = try spilledFixes(of: recorder)
+
+    XCTAssertEqual(recorder.recordedFixCount, fixes.count)
+    XCTAssertEqual(keptFixes.count, recorder.keptFixCount)
+    XCTAssertLessThan(keptFixes.count, fixes.count / 3)
+    XCTAssertEqual(keptFixes.first?.timestamp, fixes.first?.timestamp)
+    XCTAssertEqual(keptFixes.last?.timestamp, fixes.last?.timestamp)
+    // Quantization adds up to a tenth of a meter.
+    XCTAssertLessThanOrEqual(
+      Self.reconstructionError(of: fixes, keptFixes: keptFixes).maximum, 5.1)
+  }
+
+  func testSpillsFullRingToFile() throws {
+    let fixes = Self.makeDrivingTrace(duration: 600)
+    let recorder = LocationTraceRecorder(
+      fileURL: fileURL, tolerance: 0, blockSize: 64, blockCount: 2)
+    fixes.forEach(recorder.record)
+
+    let keptFixes = try spilledFixes(of: recorder)
+
+    XCTAssertEqual(recorder.droppedBlockCount, 0)
+    XCTAssertEqual(keptFixes.count, fixes.count)
+    XCTAssertEqual(recorder.bufferedFixes(), [])
+  }
+
+  func testAppendsToExistingFile() throws {
+    let fixes = Self.makeDrivingTrace(duration: 600)
+    let firstRecorder = LocationTraceRecorder(fileURL: fileURL, tolerance: 0)
+    fixes[..<300].forEach(firstRecorder.record)
+    _ = try spilledFixes(of: firstRecorder)
+    let secondRecorder = LocationTraceRecorder(fileURL: fileURL, tolerance: 0)
+    fixes[300...].forEach(secondRecorder.record)
+
+    let keptFixes = try spilledFixes(of: secondRecorder)
+
+    XCTAssertEqual(keptFixes.map(\.timestamp), fixes.map(\.timestamp))
+  }
+
+  func testRotatesFilePastMaximumSize() throws {
+    let fixes = Self.makeDrivingTrace(duration: 600)
+    let recorder = LocationTraceRecorder(
+      fileURL: fileURL, maximumFileSize: 512, tolerance: 0, blockSize: 64, blockCount: 2)
+    fixes.forEach(recorder.record)
+
+    let keptFixes = try spilledFixes(of: recorder)
+    let rotatedFileURL = try XCTUnwrap(recorder.rotatedFileURL)
+    let rotatedFixes = try LocationTraceRecorder.decodeFixes(
+      from: Data(contentsOf: rotatedFileURL))
+
+    XCTAssertLessThanOrEqual(try Data(contentsOf: fileURL).count, 512)
+    XCTAssertLessThanOrEqual(try Data(contentsOf: rotatedFileURL).count, 512)
+    // Only the two most recent files are kept, and together they end with the latest fixes.
+    let recentFixes = rotatedFixes + keptFixes
+    XCTAssertLessThan(recentFixes.count, fixes.count)
+    XCTAssertEqual(
+      recentFixes.map(\.timestamp), fixes.suffix(recentFixes.count).map(\.timestamp))
+  }
+
+  func testOverwritesOldestBlockWithoutFile() {
+    let fixes = Self.makeDrivingTrace(duration: 600)
+    let recorder = LocationTraceRecorder(tolerance: 0, blockSize: 64, blockCount: 2)
+    fixes.forEach(recorder.record)
+
+    let bufferedFixes = recorder.bufferedFixes()
+
+    XCTAssertGreaterThan(recorder.droppedBlockCount, 0)
+    XCTAssertLessThan(bufferedFixes.count, fixes.count)
+    XCTAssertEqual(
+      bufferedFixes.map(\.timestamp), fixes.suffix(bufferedFixes.count).map(\.timestamp))
+  }
+
+  func testDecodingTruncatedTraceThrows() throws {
+    let recorder = LocationTraceRecorder(fileURL: fileURL, tolerance: 0)
+    Self.makeDrivingTrace(duration: 60).forEach(recorder.record)
+    _ = try spilledFixes(of: recorder)
+    let data = try Data(contentsOf: fileURL)
+
+    XCTAssertThrowsError(try LocationTraceRecorder.decodeFixes(from: data.dropLast()))
+    XCTAssertThrowsError(try LocationTraceRecorder.decodeFixes(from: data.prefix(1)))
+  }
+
+  // MARK: - Performance
+
+  /// Reports the size of an hour of driving, the time to record each fix, and the error of the
+  /// rebuilt trace for several tolerances. Unsimplified fixes of three doubles take 24 bytes each,
+  /// or 86,400 bytes an hour at one fix per second.
+  func testSizeAndErrorPerTolerance() throws {
+    let fixes = Self.makeDrivingTrace(duration: 3_600)
+    var report = "tolerance(m)  bytes/hour  kept(%)  bytes/fix  record(ns/fix)  mean(m)  max(m)\n"
+    for tolerance in [0.0, 1, 2, 5, 10] {
+      try? FileManager.default.removeItem(at: fileURL)
+      let recorder = LocationTraceRecorder(fileURL: fileURL, tolerance: tolerance)
+
+      let start = ProcessInfo.processInfo.systemUptime
+      fixes.forEach(recorder.record)
+      let recordingTime = ProcessInfo.processInfo.systemUptime - start
+
+      let keptFixes = try spilledFixes(of: recorder)
+      let size = try Data(contentsOf: fileURL).count
+      let error = Self.reconstructionError(of: fixes, keptFixes: keptFixes)
+      report += String(
+        format: "%12.0f  %10d  %7.1f  %9.2f  %14.0f  %7.2f  %6.2f\n", tolerance, size,
+        Double(keptFixes.count) / Double(fixes.count) * 100, Double(size) / Double(keptFixes.count),
+        recordingTime / Double(fixes.count) * 1e9, error.mean, error.maximum)
+    }
+    print("Location trace (an hour at 1 Hz, 86,400 bytes unsimplified):\n\(report)")
+    add(XCTAttachment(string: report))
+  }
+
+  func testRecordingPerformanceForAnHour() {
+    let fixes = Self.makeDrivingTrace(duration: 3_600)
+    measure(metrics: [XCTClockMetric(), XCTCPUMetric()]) {
+      let recorder = LocationTraceRecorder()
+      fixes.forEach(recorder.record)
+      recorder.flush()
+    }
+  }
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+import Foundation
+import XCTest
+
+class NetworkEmulatorTests: XCTestCase {
+  private let url = URL(string: "http://localhost:8080/vehicle/test-vehicle")!
+  private var urlSession: URLSession!
+
+  override func setUp() {
+    let configuration = URLSessionConfiguration.ephemeral
+    configuration.protocolClasses = [MockURLProtocol.self]
+    urlSession = URLSession(configuration: configuration)
+  }
+
+  override func tearDown() {
+    MockURLProtocol.networkEmulator = nil
+  }
+
+  private func setProviderResponse(bodySize: Int = 16) {
+    MockURLProtocol.requestHandler = { request in
+      let response = HTTPURLResponse(
+        url: request.url!, statusCode: 200, httpVersion: nil, headerFields: nil)!
+      return (response, Data(repeating: 0x61, count: bodySize))
+    }
+  }
+
+  /// Returns the latency and outcome of 100 requests to two URLs.
+  private func plans(seed: UInt64) -> [String] {
+    let emulator = NetworkEmulator(
+      seed: seed,
+      defaultConditions: NetworkEmulator.Conditions(
+        latency: .logNormal(median: 0.1, sigma: 1), lossRate: 0.2, resetRate: 0.2))
+    let requests = [
+      URLRequest(url: url), URLRequest(url: URL(string: "http://localhost:8080/trip/test-trip")!),
+    ]
+    return (0..<100).map { index in
+      let plan = emulator.plan(for: requests[index % requests.count])
+      return "\(plan.latency) \(plan.outcome)"
+    }
+  }
+
+  func testSameSeedPlansSameConditions() {
+    XCTAssertEqual(plans(seed: 42), plans(seed: 42))
+    XCTAssertNotEqual(plans(seed: 42), plans(seed: 43))
+  }
+
+  func testRoutesOverrideDefaultConditions() {
+    let emulator = NetworkEmulator(
+      seed: 1, defaultConditions: NetworkEmulator.Conditions(latency: .constant(0.5)))
+    emulator.addRoute(
+      pathPrefix: "/vehicle/", method: "GET",
+      conditions: NetworkEmulator.Conditions(latency: .uniform(0.01...0.02), lossRate: 1))
+
+    let vehiclePlan = emulator.plan(for: URLRequest(url: url))
+    XCTAssertEqual(vehiclePlan.outcome, .lose(timeout: 1))
+    XCTAssertLessThanOrEqual(vehiclePlan.latency, 0.02)
+    var putRequest = URLRequest(url: url)
+    putRequest.httpMethod = "PUT"
+    XCTAssertEqual(emulator.plan(for: putRequest).latency, 0.5)
+  }
+
+  func testOutageFailsRequestsWithinItsWindow() async throws {
+    var now: TimeInterval = 100
+    let emulator = NetworkEmulator(seed: 1, clock: { now })
+    emulator.addOutage(start: 10, duration: 5, pathPrefix: "/vehicle/")
+    MockURLProtocol.networkEmulator = emulator
+    setProviderResponse()
+
+    now = 111
+    do {
+      let _ = try await urlSession.data(from: url)
+      XCTFail()
+    } catch let error as URLError {
+      XCTAssertEqual(error.code, .notConnectedToInternet)
+    }
+    let (_, tripResponse) = try await urlSession.data(
+      from: URL(string: "http://localhost:8080/trip/test-trip")!)
+    XCTAssertEqual((tripResponse as? HTTPURLResponse)?.statusCode, 200)
+
+    now = 115
+    let (_, response) = try await urlSession.data(from: url)
+    XCTAssertEqual((response as? HTTPURLResponse)?.statusCode, 200)
+  }
+
+  func testResetFailsPartwayThroughBody() async {
+    MockURLProtocol.networkEmulator = NetworkEmulator(
+      seed: 1,
+      defaultConditions: NetworkEmulator.Conditions(bytesPerSecond: 1_000_000, resetRate: 1))
+    setProviderResponse(bodySize: 64 * 1024)
+
+    do {
+      let _ = try await urlSession.data(from: url)
+      XCTFail()
+    } catch let error as URLError {
+      XCTAssertEqual(error.code, .networkConnectionLost)
+    } catch {
+      XCTFail()
+    }
+  }
+
+  func testBandwidthCapSlowsDownBody() async throws {
+    MockURLProtocol.networkEmulator = NetworkEmulator(
+      seed: 1, defaultConditions: NetworkEmulator.Conditions(bytesPerSecond: 200_000))
+    setProviderResponse(bodySize: 40_000)
+
+    let startTime = ProcessInfo.processInfo.systemUptime
+    let (data, _) = try await urlSession.data(from: url)
+    XCTAssertEqual(data.count, 40_000)
+    XCTAssertGreaterThanOrEqual(ProcessInfo.processInfo.systemUptime - startTime, 0.15)
+  }
+}
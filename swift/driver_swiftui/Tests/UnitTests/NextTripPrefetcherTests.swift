@@ -0,0 +1,289 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import Foundation
+import GoogleMaps
+import GoogleRidesharingDriver
+import XCTest
+
+@testable import DriverSampleApp
+
+class NextTripPrefetcherTests: XCTestCase {
+  private var clock: VirtualClock!
+  private var navigator: StubNavigator!
+
+  private let loadLock = NSLock()
+  private var loadedTripIDs: [String] = []
+
+  override func setUp() {
+    super.setUp()
+    clock = VirtualClock(now: 0)
+    navigator = StubNavigator(clock: clock)
+    loadedTripIDs = []
+  }
+
+  /// Returns the waypoints of a trip with a pickup and a dropoff, `offset` hundredths of a degree
+  /// north of the others.
+  private static func makeTripWaypoints(tripID: String, offset: Int) -> [GMTSTripWaypoint] {
+    [GMTSTripWaypointType.pickUp, .dropOff].enumerated().map { index, waypointType in
+      GMTSTripWaypoint(
+        location: GMTSTerminalLocation(
+          point: GMTSLatLng(latitude: 37 + Double(offset + index) / 100, longitude: -122),
+          label: nil, description: nil, placeID: nil, generatedID: nil, accessPointID: nil),
+        tripID: tripID, waypointType: waypointType, distanceToPreviousWaypointInMeters: 0,
+        eta: 0)
+    }
+  }
+
+  /// Returns a prefetcher whose trips take `latency` of clock time to load, and fail to load while
+  /// `shouldFail` returns true. Trips have the status returned by `status` when they are loaded.
+  private func makePrefetcher(
+    latency: TimeInterval = 0, shouldFail: @escaping () -> Bool = { false },
+    status: @escaping () -> ProviderTripStatus = { .new }
+  ) -> NextTripPrefetcher {
+    NextTripPrefetcher { [self, clock] tripID in
+      if latency > 0 {
+        try await clock!.sleep(for: latency)
+      }
+      loadLock.lock()
+      loadedTripIDs.append(tripID)
+      loadLock.unlock()
+      if shouldFail() {
+        throw URLError(.networkConnectionLost)
+      }
+      return (status(), Self.makeTripWaypoints(tripID: tripID, offset: 10))
+    }
+  }
+
+  private var loadCount: Int {
+    loadLock.lock()
+    defer { loadLock.unlock() }
+    return loadedTripIDs.count
+  }
+
+  /// Advances the clock in small steps whenever something is waiting on it, until `condition`
+  /// holds. Tasks that sleep on the clock are given the chance to run between steps.
+  private func advanceClock(until condition: () -> Bool) async throws {
+    let endTime = clock.now + 60
+    while !condition() {
+      guard clock.now < endTime else {
+        XCTFail("Condition not met within 60 s of clock time")
+        return
+      }
+      if clock.pendingTimerCount > 0 {
+        clock.advance(by: 0.01)
+      }
+      try await Task.sleep(nanoseconds: 1_000_000)
+    }
+  }
+
+  // MARK: - Tests
+
+  func testHandsOffLoadedTripOnce() async throws {
+    let prefetcher = makePrefetcher()
+    prefetcher.prefetch(tripID: "next-trip")
+    prefetcher.prefetch(tripID: "next-trip")
+    try await advanceClock(until: { prefetcher.trip != nil })
+    prefetcher.prefetch(tripID: "next-trip")
+
+    let trip = await prefetcher.handOff(tripID: "next-trip")
+
+    // The trip is loaded once ahead of the handoff, and revalidated once at the handoff.
+    XCTAssertEqual(loadCount, 2)
+    XCTAssertEqual(trip?.status, .new)
+    XCTAssertEqual(trip?.waypoints.count, 2)
+    XCTAssertNil(prefetcher.trip)
+    let secondHandOff = await prefetcher.handOff(tripID: "next-trip")
+    XCTAssertNil(secondHandOff)
+    XCTAssertEqual(loadCount, 2)
+  }
+
+  func testHandOffRevalidatesLoadedTrip() async throws {
+    var status = ProviderTripStatus.new
+    let prefetcher = makePrefetcher(status: { status })
+    prefetcher.prefetch(tripID: "next-trip")
+    try await advanceClock(until: { prefetcher.trip != nil })
+
+    // The rider cancelled and rebooked the trip, which the provider reports as already underway.
+    status = .enrouteToPickup
+    let trip = await prefetcher.handOff(tripID: "next-trip")
+
+    XCTAssertEqual(trip?.status, .enrouteToPickup)
+  }
+
+  func testHandOffKeepsLoadedTripIfRevalidationFails() async throws {
+    var isProviderReachable = true
+    let prefetcher = makePrefetcher(shouldFail: { !isProviderReachable })
+    prefetcher.prefetch(tripID: "next-trip")
+    try await advanceClock(until: { prefetcher.trip != nil })
+
+    isProviderReachable = false
+    let trip = await prefetcher.handOff(tripID: "next-trip")
+
+    XCTAssertEqual(trip?.tripID, "next-trip")
+    XCTAssertEqual(trip?.status, .new)
+  }
+
+  func testHandOffOfOtherTripReturnsNothing() async throws {
+    let prefetcher = makePrefetcher()
+    prefetcher.prefetch(tripID: "next-trip")
+    try await advanceClock(until: { prefetcher.trip != nil })
+
+    let trip = await prefetcher.handOff(tripID: "other-trip")
+    XCTAssertNil(trip)
+    XCTAssertNil(prefetcher.trip)
+  }
+
+  func testFailedLoadIsRetried() async throws {
+    var failureCount = 0
+    let prefetcher = makePrefetcher(shouldFail: {
+      failureCount += 1
+      return failureCount == 1
+    })
+
+    try await advanceClock(until: {
+      // Polling the vehicle prefetches its next trip again on every update.
+      prefetcher.prefetch(tripID: "next-trip")
+      return prefetcher.trip != nil
+    })
+
+    XCTAssertEqual(loadCount, 2)
+  }
+
+  func testPrefetchingAnotherTripReplacesIt() async throws {
+    let prefetcher = makePrefetcher(latency: 1)
+    var loadedTrips: [String] = []
+    prefetcher.onLoad = { loadedTrips.append($0.tripID) }
+    prefetcher.prefetch(tripID: "unmatched-trip")
+    prefetcher.prefetch(tripID: "next-trip")
+
+    try await advanceClock(until: { !loadedTrips.isEmpty })
+
+    XCTAssertEqual(loadedTrips, ["next-trip"])
+    XCTAssertEqual(prefetcher.trip?.tripID, "next-trip")
+  }
+
+  func testPrefetchAndCurrentTripFetchDoNotSupersedeEachOther() async throws {
+    // A provider without a batch endpoint, so that trips are fetched one per request.
+    MockURLProtocol.requestHandler = { request in
+      let isBatchRequest = request.url!.path == "/trips"
+      let response = HTTPURLResponse(
+        url: request.url!, statusCode: isBatchRequest ? 404 : 200, httpVersion: nil,
+        headerFields: nil)!
+      let data = try JSONSerialization.data(withJSONObject: [
+        "trip": ["tripStatus": "NEW", "waypoints": []]
+      ])
+      return (response, isBatchRequest ? nil : data)
+    }
+    // Keeps the requests in flight together.
+    MockURLProtocol.responseDelayHandler = { _ in 0.05 }
+    defer { MockURLProtocol.responseDelayHandler = nil }
+    let configuration = URLSessionConfiguration.ephemeral
+    configuration.protocolClasses = [MockURLProtocol.self]
+    let providerService = ProviderService(session: URLSession(configuration: configuration))
+    _ = await providerService.getTrips(tripIDs: ["previous-trip", "current-trip"])
+
+    // A newly matched vehicle prefetches its next trip and fetches its current one, as
+    // `MapViewController` does.
+    let prefetcher = NextTripPrefetcher(providerService: providerService)
+    prefetcher.prefetch(tripID: "next-trip")
+    let currentTrip = try await providerService.getTrip(tripID: "current-trip")
+
+    let deadline = Date(timeIntervalSinceNow: 5)
+    while prefetcher.trip == nil, Date() < deadline {
+      try await Task.sleep(nanoseconds: 1_000_000)
+    }
+    XCTAssertEqual(currentTrip.0, .new)
+    XCTAssertEqual(prefetcher.trip?.tripID, "next-trip")
+  }
+
+  // MARK: - Performance
+
+  /// Drives a trip to its dropoff and hands off to the next back-to-back trip the way
+  /// `MapViewController` does, and returns the clock time from the current trip's completion to
+  /// the next trip's route being ready.
+  ///
+  /// With `prefetching`, the next trip is loaded and the route extended into it while the current
+  /// trip is in progress, and only revalidated at the handoff. Without it, the next trip is fetched
+  /// and routed once the current trip is complete, as the app did before prefetching.
+  private func handoffGap(fetchLatency: TimeInterval, prefetching: Bool) async throws
+    -> TimeInterval
+  {
+    let planner = RoutePlanner(navigator: navigator)
+    let prefetcher = makePrefetcher(latency: fetchLatency)
+    let currentTrip = Self.makeTripWaypoints(tripID: "current-trip", offset: 0)
+    var routeStatus: GMSRouteStatus?
+    planner.planRoute(through: currentTrip) { routeStatus = $0 }
+    try await advanceClock(until: { routeStatus != nil })
+
+    if prefetching {
+      prefetcher.prefetch(tripID: "next-trip")
+      try await advanceClock(until: { prefetcher.trip != nil })
+      routeStatus = nil
+      planner.extendRoute(through: currentTrip + prefetcher.trip!.waypoints) { routeStatus = $0 }
+      try await advanceClock(until: { routeStatus != nil })
+    }
+    // Drive through the pickup to the dropoff.
+    clock.advance(by: 600)
+    planner.didArrive()
+    planner.didArrive()
+
+    let completionTime = clock.now
+    let loadCountBeforeHandOff = loadCount
+    let handOff = Task { await prefetcher.handOff(tripID: "next-trip") }
+    let nextTripWaypoints: [GMTSTripWaypoint]
+    if prefetching {
+      // The trip is handed off once the round trip that revalidates it is over.
+      try await advanceClock(until: { loadCount > loadCountBeforeHandOff })
+      let nextTrip = await handOff.value
+      nextTripWaypoints = try XCTUnwrap(nextTrip).waypoints
+    } else {
+      // Fetched once the current trip is complete, as `MapViewController` does.
+      let nextTrip = await handOff.value
+      XCTAssertNil(nextTrip)
+      planner.clearRoute()
+      let fetch = Task { [clock] () -> [GMTSTripWaypoint] in
+        try await clock!.sleep(for: fetchLatency)
+        return Self.makeTripWaypoints(tripID: "next-trip", offset: 10)
+      }
+      try await advanceClock(until: { clock.now >= completionTime + fetchLatency })
+      nextTripWaypoints = try await fetch.value
+    }
+    var readyTime: TimeInterval?
+    planner.planRoute(through: nextTripWaypoints) { [clock] status in
+      XCTAssertEqual(status, .OK)
+      readyTime = clock!.now
+    }
+    try await advanceClock(until: { readyTime != nil })
+    return readyTime! - completionTime
+  }
+
+  /// Reports the gap between a trip's completion and the next back-to-back trip being route-ready,
+  /// with and without prefetching, for several provider latencies. Routes take 1 s to compute, plus
+  /// 0.1 s for every destination after the first. A prefetched trip only waits for the round trip
+  /// that revalidates it.
+  func testHandoffGapWithPrefetching() async throws {
+    var report = "fetch(s)  fetched(s)  prefetched(s)\n"
+    for fetchLatency in [0.2, 0.5, 1, 2] {
+      let fetchedGap = try await handoffGap(fetchLatency: fetchLatency, prefetching: false)
+      let prefetchedGap = try await handoffGap(fetchLatency: fetchLatency, prefetching: true)
+
+      XCTAssertEqual(fetchedGap, fetchLatency + 1.1, accuracy: 0.05)
+      XCTAssertEqual(prefetchedGap, fetchLatency, accuracy: 0.05)
+      report += String(format: "%8.1f  %10.2f  %13.2f\n", fetchLatency, fetchedGap, prefetchedGap)
+    }
+    print("Back-to-back trip handoff:\n\(report)")
+    add(XCTAttachment(string: report))
+  }
+}
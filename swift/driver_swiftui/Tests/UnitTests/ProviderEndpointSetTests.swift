@@ -0,0 +1,165 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import Foundation
+import XCTest
+
+@testable import DriverSampleApp
+
+class ProviderEndpointSetTests: XCTestCase {
+  private var urlSession: URLSession!
+  private let requestCountLock = NSLock()
+  private var requestCountByPort: [Int: Int] = [:]
+
+  private let baseURLs = [
+    URL(string: "http://localhost:8081")!,
+    URL(string: "http://localhost:8082")!,
+    URL(string: "http://localhost:8083")!,
+  ]
+
+  override func setUp() {
+    let configuration = URLSessionConfiguration.ephemeral
+    configuration.protocolClasses = [MockURLProtocol.self]
+    urlSession = URLSession(configuration: configuration)
+    requestCountByPort = [:]
+  }
+
+  override func tearDown() {
+    MockURLProtocol.responseDelayHandler = nil
+  }
+
+  /// Answers get vehicle requests with the status code returned by `statusCode` for the port of
+  /// the replica the request was routed to, after the delay returned by `delay` for that port.
+  private func setGetVehicleResponse(
+    delay: @escaping (Int) -> TimeInterval = { _ in 0 },
+    statusCode: @escaping (Int) -> Int = { _ in 200 }
+  ) {
+    let responseData = try! JSONSerialization.data(withJSONObject: [
+      "currentTripsIds": ["test-trip1"]
+    ])
+    MockURLProtocol.responseDelayHandler = { request in delay(request.url?.port ?? 0) }
+    MockURLProtocol.requestHandler = { request in
+      let port = request.url?.port ?? 0
+      self.requestCountLock.lock()
+      self.requestCountByPort[port, default: 0] += 1
+      self.requestCountLock.unlock()
+      let response = HTTPURLResponse(
+        url: request.url!, statusCode: statusCode(port), httpVersion: nil, headerFields: nil)!
+      return (response, responseData)
+    }
+  }
+
+  private func makeProviderService(endpointSet: ProviderEndpointSet) -> ProviderService {
+    ProviderService(
+      session: urlSession, retryPolicy: ProviderRetryPolicy(maximumAttempts: 1),
+      endpointSet: endpointSet)
+  }
+
+  func testBuildsURLsAgainstCanonicalReplica() {
+    let endpointSet = ProviderEndpointSet(baseURLs: baseURLs)
+
+    XCTAssertEqual(
+      endpointSet.url(path: "vehicle/test-vehicle").absoluteString,
+      "http://localhost:8081/vehicle/test-vehicle")
+  }
+
+  func testRoutesURLsUnderEachReplicasBasePath() {
+    let endpointSet = ProviderEndpointSet(baseURLs: [
+      URL(string: "http://localhost:8081/provider/")!,
+      URL(string: "http://localhost:8082")!,
+    ])
+    let request = URLRequest(url: endpointSet.url(path: "vehicle/test-vehicle?etag=1"))
+
+    var routedURLs: Set<String> = []
+    for _ in 0..<20 {
+      let routedRequest = endpointSet.route(request)
+      routedURLs.insert(routedRequest.request.url!.absoluteString)
+      endpointSet.finish(routedRequest, response: nil, error: CancellationError())
+    }
+    XCTAssertEqual(
+      routedURLs,
+      [
+        "http://localhost:8081/provider/vehicle/test-vehicle?etag=1",
+        "http://localhost:8082/vehicle/test-vehicle?etag=1",
+      ])
+  }
+
+  func testShiftsTrafficToFastestReplica() async throws {
+    let delayByPort = [8081: 0.15, 8082: 0.01, 8083: 0.08]
+    setGetVehicleResponse(delay: { delayByPort[$0] ?? 0 })
+
+    let providerService = makeProviderService(
+      endpointSet: ProviderEndpointSet(baseURLs: baseURLs))
+    for _ in 0..<40 {
+      _ = try await providerService.getVehicle(vehicleID: "test-vehicle")
+    }
+
+    // Each replica is tried once, after which requests mostly go to the fastest one.
+    XCTAssertGreaterThan(requestCountByPort[8082, default: 0], 18)
+    XCTAssertLessThan(requestCountByPort[8081, default: 0], 8)
+  }
+
+  func testEjectsFailingReplicaUntilEjectionIntervalElapses() async throws {
+    setGetVehicleResponse(statusCode: { $0 == 8083 ? 503 : 200 })
+
+    let endpointSet = ProviderEndpointSet(
+      baseURLs: baseURLs, ejectionFailureCount: 2, ejectionInterval: 1)
+    let providerService = makeProviderService(endpointSet: endpointSet)
+    for _ in 0..<30 {
+      _ = try? await providerService.getVehicle(vehicleID: "test-vehicle")
+    }
+
+    XCTAssertTrue(endpointSet.isEjected(baseURL: baseURLs[2]))
+    XCTAssertFalse(endpointSet.isEjected(baseURL: baseURLs[0]))
+    let failedRequestCount = requestCountByPort[8083, default: 0]
+    XCTAssertLessThan(failedRequestCount, 10)
+
+    try await Task.sleep(nanoseconds: 1_100_000_000)
+    XCTAssertFalse(endpointSet.isEjected(baseURL: baseURLs[2]))
+  }
+
+  func testLongPollsDoNotCountTowardsLatency() async throws {
+    let endpointSet = ProviderEndpointSet(baseURLs: [baseURLs[0]])
+    let response = HTTPURLResponse(
+      url: baseURLs[0], statusCode: 200, httpVersion: nil, headerFields: nil)
+    let longPoll = endpointSet.route(
+      URLRequest(url: endpointSet.url(path: "vehicle/test-vehicle/events")), isLongPoll: true)
+
+    // Short requests are answered while the long-poll is held open.
+    for _ in 0..<5 {
+      let routedRequest = endpointSet.route(
+        URLRequest(url: endpointSet.url(path: "vehicle/test-vehicle")))
+      endpointSet.finish(routedRequest, response: response, error: nil)
+    }
+    let shortLatency = try XCTUnwrap(endpointSet.latency(baseURL: baseURLs[0]))
+    try await Task.sleep(nanoseconds: 200_000_000)
+    endpointSet.finish(longPoll, response: response, error: nil)
+
+    XCTAssertEqual(endpointSet.latency(baseURL: baseURLs[0]), shortLatency)
+  }
+
+  func testSpreadsRequestsAcrossAllReplicasWhenAllAreEjected() {
+    let endpointSet = ProviderEndpointSet(
+      baseURLs: baseURLs, ejectionFailureCount: 1, ejectionInterval: 60)
+    let request = URLRequest(url: endpointSet.url(path: "vehicle/test-vehicle"))
+    while !baseURLs.allSatisfy({ endpointSet.isEjected(baseURL: $0) }) {
+      let routedRequest = endpointSet.route(request)
+      endpointSet.finish(routedRequest, response: nil, error: URLError(.cannotConnectToHost))
+    }
+
+    let routedRequest = endpointSet.route(request)
+    XCTAssertEqual(routedRequest.request.url?.path, "/vehicle/test-vehicle")
+    XCTAssertNotNil(routedRequest.request.url?.port)
+  }
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+import Foundation
+import GoogleRidesharingDriver
+import XCTest
+
+@testable import DriverSampleApp
+
+/// Runs many simulated drivers against a stub provider, to catch regressions in the throughput,
+/// latency and resource use of the provider client. See `ProviderLoadGenerator` for how to change
+/// the scale of the run.
+class ProviderLoadTests: XCTestCase {
+  /// The statuses a driver walks a trip through, in order.
+  private static let tripStatuses: [ProviderTripStatus] = [
+    .enrouteToPickup, .arrivedAtPickup, .enrouteToDropoff, .complete,
+  ]
+
+  private var urlSession: URLSession!
+
+  override func setUp() {
+    let configuration = URLSessionConfiguration.ephemeral
+    configuration.protocolClasses = [MockURLProtocol.self]
+    urlSession = URLSession(configuration: configuration)
+  }
+
+  override func tearDown() {
+    MockURLProtocol.responseDelayHandler = nil
+  }
+
+  func testDriversWalkTripsThroughEveryStatus() async {
+    let generator = ProviderLoadGenerator()
+    let stubProvider = StubProvider(responseDelay: generator.configuration.responseDelay)
+    stubProvider.install()
+
+    let report = await runDrivers(generator)
+    print("Driver load (\(generator.configuration.clientCount) drivers):\n\(report)")
+    add(XCTAttachment(string: report.description))
+
+    XCTAssertEqual(report.failureCount, 0)
+    XCTAssertEqual(
+      stubProvider.tripStatuses.values.filter { $0 != ProviderTripStatus.complete.rawValue }, [])
+  }
+
+  func testDriverFlowPerformance() {
+    let configuration = ProviderLoadGenerator.Configuration(clientCount: 20, responseDelay: 0)
+    measure(metrics: [XCTClockMetric(), XCTCPUMetric(), XCTMemoryMetric()]) {
+      StubProvider().install()
+      let finished = expectation(description: "All drivers finished")
+      Task {
+        let report = await runDrivers(ProviderLoadGenerator(configuration: configuration))
+        XCTAssertEqual(report.failureCount, 0)
+        finished.fulfill()
+      }
+      wait(for: [finished], timeout: 60)
+    }
+  }
+
+  /// Runs the whole driver flow for every client of the generator: creating a vehicle, going
+  /// online, polling for the matched trip and walking it through every status.
+  private func runDrivers(_ generator: ProviderLoadGenerator) async
+    -> ProviderLoadGenerator.Report
+  {
+    let urlSession = self.urlSession!
+    let metrics = ProviderMetrics()
+    let tripTracer = TripTracer(source: "driver", fileURL: nil)
+    return await generator.run { clientIndex, recorder in
+      // Every driver has its own service, as it would on its own device.
+      let providerService = ProviderService(
+        session: urlSession, metrics: metrics, tripTracer: tripTracer)
+      let authTokenProvider = AuthTokenProvider(
+        session: urlSession, tokenCacheFileURL: nil, metrics: metrics)
+
+      let vehicleID = try await recorder.measure("createVehicle") {
+        try await providerService.createVehicle(
+          vehicleID: "load-vehicle-\(clientIndex)", isBackToBackEnabled: false)
+      }
+      // Going online makes the Driver SDK fetch a token for the vehicle.
+      try await recorder.measure("fetchToken") {
+        try await withCheckedThrowingContinuation {
+          (continuation: CheckedContinuation<Void, Error>) in
+          authTokenProvider.fetchToken(vehicleID: vehicleID) { _, error in
+            if let error = error {
+              continuation.resume(throwing: error)
+            } else {
+              continuation.resume()
+            }
+          }
+        }
+      }
+      var matchedTripIDs: [String] = []
+      while matchedTripIDs.isEmpty {
+        matchedTripIDs = try await recorder.measure("getVehicle") {
+          try await providerService.getVehicle(vehicleID: vehicleID)
+        }
+      }
+      let tripID = matchedTripIDs[0]
+      for tripStatus in Self.tripStatuses {
+        try await recorder.measure("updateTrip") {
+          try await providerService.updateTrip(
+            tripID: tripID, status: tripStatus, intermediateDestinationIndex: nil,
+            idempotencyKey: UUID().uuidString)
+        }
+        let (fetchedTripStatus, _) = try await recorder.measure("getTrip") {
+          try await providerService.getTrip(tripID: tripID)
+        }
+        XCTAssertEqual(fetchedTripStatus, tripStatus)
+      }
+    }
+  }
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import Foundation
+import XCTest
+
+@testable import DriverSampleApp
+
+class ProviderMetricsTests: XCTestCase {
+  private var urlSession: URLSession!
+
+  override func setUp() {
+    let configuration = URLSessionConfiguration.ephemeral
+    configuration.protocolClasses = [MockURLProtocol.self]
+    urlSession = URLSession(configuration: configuration)
+  }
+
+  private final class RecordingSink: ProviderMetricsSink {
+    var snapshots: [[String: ProviderMetrics.CallMetrics]] = []
+
+    func providerMetrics(
+      _ metrics: ProviderMetrics, didFlush snapshot: [String: ProviderMetrics.CallMetrics]
+    ) {
+      snapshots.append(snapshot)
+    }
+  }
+
+  func testHistogramPercentilesAreWithinBucketPrecision() {
+    var histogram = LatencyHistogram()
+    // 0.1 ms to 1 s in 0.1 ms steps.
+    for step in 1...10_000 {
+      histogram.record(TimeInterval(step) / 10_000)
+    }
+
+    XCTAssertEqual(histogram.count, 10_000)
+    XCTAssertEqual(histogram.maximumDuration, 1)
+    XCTAssertEqual(histogram.duration(atPercentile: 50), 0.5, accuracy: 0.5 * 0.04)
+    XCTAssertEqual(histogram.duration(atPercentile: 99), 0.99, accuracy: 0.99 * 0.04)
+    XCTAssertEqual(histogram.duration(atPercentile: 100), 1)
+    XCTAssertEqual(LatencyHistogram().duration(atPercentile: 50), 0)
+  }
+
+  func testMergedHistogramsMatchCombinedRecording() {
+    var fast = LatencyHistogram()
+    var slow = LatencyHistogram()
+    var combined = LatencyHistogram()
+    for step in 1...100 {
+      fast.record(TimeInterval(step) / 1_000)
+      slow.record(TimeInterval(step) / 10)
+      combined.record(TimeInterval(step) / 1_000)
+      combined.record(TimeInterval(step) / 10)
+    }
+
+    fast.merge(slow)
+    XCTAssertEqual(fast.count, combined.count)
+    XCTAssertEqual(fast.totalDuration, combined.totalDuration, accuracy: 1e-9)
+    for percentile in [50.0, 90, 99, 99.9] {
+      XCTAssertEqual(
+        fast.duration(atPercentile: percentile), combined.duration(atPercentile: percentile))
+    }
+  }
+
+  func testRecordsPhasesAndCountersOfVehicleFetches() async throws {
+    let responseData = try JSONSerialization.data(withJSONObject: [
+      "currentTripsIds": ["test-trip1"]
+    ])
+    MockURLProtocol.requestHandler = { request in
+      let isUnchanged = request.value(forHTTPHeaderField: "If-None-Match") == "\"v1\""
+      let response = HTTPURLResponse(
+        url: request.url!, statusCode: isUnchanged ? 304 : 200, httpVersion: nil,
+        headerFields: ["ETag": "\"v1\""])!
+      return (response, isUnchanged ? nil : responseData)
+    }
+
+    let metrics = ProviderMetrics()
+    let providerService = ProviderService(session: urlSession, metrics: metrics)
+    let _ = try await providerService.getVehicle(vehicleID: "test-vehicle")
+    let _ = try await providerService.getVehicle(vehicleID: "test-vehicle")
+
+    let callMetrics = try XCTUnwrap(metrics.snapshot()["getVehicle(vehicleID:)"])
+    XCTAssertEqual(callMetrics.callCount, 2)
+    XCTAssertEqual(callMetrics.histogram(for: .network).count, 2)
+    XCTAssertEqual(callMetrics.histogram(for: .decode).count, 2)
+    XCTAssertEqual(callMetrics.attemptCount, 2)
+    XCTAssertEqual(callMetrics.retryCount, 0)
+    XCTAssertEqual(callMetrics.errorCount, 0)
+    XCTAssertEqual(callMetrics.statusCodeCounts, [200: 1, 304: 1])
+    XCTAssertEqual(callMetrics.cacheHitCount, 1)
+    XCTAssertEqual(callMetrics.bytesReceived, UInt64(responseData.count))
+  }
+
+  func testFlushHandsMetricsToSinksAndStartsOver() {
+    let metrics = ProviderMetrics()
+    let sink = RecordingSink()
+    metrics.add(sink)
+    metrics.record(0.01, of: .network, for: "getTrip(tripID:)")
+
+    metrics.flush()
+    metrics.flush()
+
+    XCTAssertEqual(sink.snapshots.count, 2)
+    XCTAssertEqual(sink.snapshots[0]["getTrip(tripID:)"]?.histogram(for: .network).count, 1)
+    XCTAssertTrue(sink.snapshots[1].isEmpty)
+    XCTAssertTrue(metrics.snapshot().isEmpty)
+  }
+
+  /// Measures what instrumenting a vehicle fetch costs: timing its three phases and counting its
+  /// attempt and response.
+  func testInstrumentationOverheadPerVehicleFetch() {
+    let metrics = ProviderMetrics()
+    let request = URLRequest(url: URL(string: "http://localhost:8080/vehicle/test-vehicle")!)
+    let response = HTTPURLResponse(
+      url: request.url!, statusCode: 200, httpVersion: nil, headerFields: nil)
+    let data = Data(count: 128)
+    let callCount = 100_000
+
+    let startTime = DispatchTime.now().uptimeNanoseconds
+    for _ in 0..<callCount {
+      var timer = metrics.startTimer(for: "getVehicle(vehicleID:)")
+      timer.endPhase(.build)
+      metrics.recordAttempt(request, isRetry: false, for: timer.call)
+      metrics.recordResponse(response, data: data, error: nil, to: request, for: timer.call)
+      timer.endPhase(.network)
+      timer.endPhase(.decode)
+    }
+    let overhead =
+      TimeInterval(DispatchTime.now().uptimeNanoseconds - startTime) / 1e9 / Double(callCount)
+
+    print(String(format: "Instrumentation overhead per vehicle fetch: %.0f ns.", overhead * 1e9))
+    XCTAssertEqual(metrics.snapshot()["getVehicle(vehicleID:)"]?.callCount, UInt64(callCount))
+    // Unoptimized builds skip inlining and specialization, so only optimized builds are held to
+    // the microsecond budget.
+    #if DEBUG
+      XCTAssertLessThan(overhead, 5e-6)
+    #else
+      XCTAssertLessThan(overhead, 1e-6)
+    #endif
+  }
+}
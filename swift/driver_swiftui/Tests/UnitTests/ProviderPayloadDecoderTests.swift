@@ -0,0 +1,278 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+import Foundation
+import GoogleRidesharingConsumer
+import GoogleRidesharingDriver
+import XCTest
+
+@testable import DriverSampleApp
+
+class ProviderPayloadDecoderTests: XCTestCase {
+
+  private static let tripID = "test-trip"
+
+  /// Creates a get trip response with the given number of waypoints, alternating their types.
+  private static func makeTripResponseData(
+    waypointCount: Int, format: ProviderPayloadDecoder.Format = .json
+  ) -> Data {
+    let waypointTypes = [
+      "PICKUP_WAYPOINT_TYPE", "INTERMEDIATE_DESTINATION_WAYPOINT_TYPE", "DROP_OFF_WAYPOINT_TYPE",
+    ]
+    let waypoints: [[String: Any]] = (0..<waypointCount).map { index in
+      [
+        "location": [
+          "point": ["latitude": 37.0 + Double(index) / 1000, "longitude": -122.0]
+        ],
+        "tripId": tripID,
+        "waypointType": waypointTypes[index % waypointTypes.count],
+      ]
+    }
+    let response: [String: Any] = [
+      "trip": [
+        "name": "providers/test-provider/trips/\(tripID)",
+        "tripStatus": "ENROUTE_TO_PICKUP",
+        "waypoints": waypoints,
+      ]
+    ]
+    switch format {
+    case .json:
+      return try! JSONSerialization.data(withJSONObject: response)
+    case .propertyList:
+      return try! PropertyListSerialization.data(
+        fromPropertyList: response, format: .binary, options: 0)
+    }
+  }
+
+  /// Decodes a get trip response by walking a `JSONSerialization` object graph, which is how
+  /// responses were decoded before `ProviderPayloadDecoder`. The leg distances and ETAs are
+  /// estimated one waypoint at a time.
+  private static func decodeTripWithJSONSerialization(
+    from data: Data, currentTime: TimeInterval = 0
+  ) throws -> [GMTSTripWaypoint] {
+    guard let parsedDictionary = try JSONSerialization.jsonObject(with: data) as? [String: Any],
+      let tripJSON = parsedDictionary["trip"] as? [String: Any],
+      let waypointsJSON = tripJSON["waypoints"] as? [[String: Any]]
+    else {
+      throw ProviderService.Error.missingData
+    }
+    var previousPoint: GMTSLatLng?
+    var eta = currentTime
+    return try waypointsJSON.map { waypointJSON in
+      guard let locationJSON = waypointJSON["location"] as? [String: Any],
+        let pointJSON = locationJSON["point"] as? [String: Any],
+        let latitude = pointJSON["latitude"] as? Double,
+        let longitude = pointJSON["longitude"] as? Double,
+        let waypointTypeString = waypointJSON["waypointType"] as? String
+      else {
+        throw ProviderService.Error.missingData
+      }
+      let waypointType: GMTSTripWaypointType
+      switch waypointTypeString {
+      case "PICKUP_WAYPOINT_TYPE":
+        waypointType = .pickUp
+      case "DROP_OFF_WAYPOINT_TYPE":
+        waypointType = .dropOff
+      case "INTERMEDIATE_DESTINATION_WAYPOINT_TYPE":
+        waypointType = .intermediateDestination
+      default:
+        waypointType = .unknown
+      }
+      let point = GMTSLatLng(latitude: latitude, longitude: longitude)
+      let distance = previousPoint.map { WaypointGeometryTests.haversineDistance($0, point) } ?? 0
+      if previousPoint != nil {
+        let speedModel = WaypointGeometry.SpeedModel.default
+        eta += speedModel.stopDuration
+          + distance * speedModel.detourFactor / speedModel.averageSpeed
+      }
+      previousPoint = point
+      return GMTSTripWaypoint(
+        location: GMTSTerminalLocation(
+          point: point, label: nil, description: nil, placeID: nil, generatedID: nil,
+          accessPointID: nil),
+        tripID: tripID, waypointType: waypointType, distanceToPreviousWaypointInMeters: distance,
+        eta: eta)
+    }
+  }
+
+  func testDecodeTripResponse() throws {
+    let data = Data(
+      """
+      {
+        "unknown": {"nested": [1, {"skipped": "value with \\" quote"}], "flag": true},
+        "trip": {
+          "name": "providers/test-provider/trips/test\\/trip",
+          "tripStatus": "NEW",
+          "route": null,
+          "waypoints": [
+            {"location": {"point": {"latitude": 1.5, "longitude": -2e1}},
+             "waypointType": "PICKUP_WAYPOINT_TYPE"},
+            {"location": {"point": {"latitude": 0, "longitude": 0}}, "waypointType": "OTHER"}
+          ]
+        }
+      }
+      """.utf8)
+
+    let trip = try XCTUnwrap(ProviderPayloadDecoder.decodeTripResponse(from: data))
+    XCTAssertEqual(trip.name, "providers/test-provider/trips/test/trip")
+    XCTAssertEqual(trip.tripStatus, "NEW")
+    let waypoints = try XCTUnwrap(trip.waypoints)
+    XCTAssertEqual(waypoints.count, 2)
+    XCTAssertEqual(waypoints[0].latitude, 1.5)
+    XCTAssertEqual(waypoints[0].longitude, -20)
+    XCTAssertEqual(waypoints[0].waypointType, .pickUp)
+    XCTAssertEqual(waypoints[1].waypointType, .unknown)
+  }
+
+  func testDecodeMembersOfUnexpectedTypeAsNil() throws {
+    let data = Data(
+      """
+      {
+        "trip": {
+          "name": 42,
+          "tripStatus": "NEW",
+          "waypoints": [
+            {"location": {"point": {"latitude": "1.5", "longitude": 2}}, "waypointType": 3},
+            "not a waypoint"
+          ]
+        }
+      }
+      """.utf8)
+
+    let trip = try XCTUnwrap(ProviderPayloadDecoder.decodeTripResponse(from: data))
+    XCTAssertNil(trip.name)
+    XCTAssertEqual(trip.tripStatus, "NEW")
+    let waypoints = try XCTUnwrap(trip.waypoints)
+    XCTAssertEqual(waypoints.count, 2)
+    XCTAssertNil(waypoints[0].latitude)
+    XCTAssertEqual(waypoints[0].longitude, 2)
+    XCTAssertNil(waypoints[0].waypointType)
+    XCTAssertNil(waypoints[1].latitude)
+
+    let vehicle = try ProviderPayloadDecoder.decodeVehicle(
+      from: Data(#"{"name": ["x"], "currentTripsIds": ["test-trip1", 2, null]}"#.utf8))
+    XCTAssertNil(vehicle.name)
+    XCTAssertEqual(vehicle.matchedTripIDs, ["test-trip1"])
+  }
+
+  func testDecodeMalformedPayload() {
+    for payload in ["", "{", "{\"trip\": }", "{\"trip\": {\"waypoints\": [}}", "{} {}"] {
+      XCTAssertThrowsError(
+        try ProviderPayloadDecoder.decodeTripResponse(from: Data(payload.utf8)), payload)
+    }
+  }
+
+  func testDecoderMatchesJSONSerialization() throws {
+    let data = Self.makeTripResponseData(waypointCount: 100)
+    let (_, waypoints) = try ProviderService.decodeTrip(
+      from: data, tripID: Self.tripID, currentTime: 0)
+    let expectedWaypoints = try Self.decodeTripWithJSONSerialization(from: data)
+    XCTAssertEqual(waypoints.count, expectedWaypoints.count)
+    for (waypoint, expectedWaypoint) in zip(waypoints, expectedWaypoints) {
+      XCTAssertEqual(waypoint.location, expectedWaypoint.location)
+      XCTAssertEqual(waypoint.tripID, expectedWaypoint.tripID)
+      XCTAssertEqual(waypoint.waypointType, expectedWaypoint.waypointType)
+      XCTAssertEqual(
+        waypoint.distanceToPreviousWaypointInMeters,
+        expectedWaypoint.distanceToPreviousWaypointInMeters, accuracy: 1e-6)
+      XCTAssertEqual(waypoint.eta, expectedWaypoint.eta, accuracy: 1e-6)
+    }
+  }
+
+  func testDecodePropertyListVehicle() throws {
+    let data = try PropertyListSerialization.data(
+      fromPropertyList: [
+        "name": "providers/test-provider/vehicles/test-vehicle",
+        "currentTripsIds": ["test-trip1", "test-trip2"],
+      ], format: .binary, options: 0)
+
+    let vehicle = try ProviderPayloadDecoder.decodeVehicle(from: data, format: .propertyList)
+    XCTAssertEqual(vehicle.name, "providers/test-provider/vehicles/test-vehicle")
+    XCTAssertEqual(vehicle.matchedTripIDs, ["test-trip1", "test-trip2"])
+  }
+
+  func testPropertyListMatchesJSON() throws {
+    let jsonData = Self.makeTripResponseData(waypointCount: 100)
+    let propertyListData = Self.makeTripResponseData(waypointCount: 100, format: .propertyList)
+    let (_, propertyListWaypoints) = try ProviderService.decodeTrip(
+      from: propertyListData, tripID: Self.tripID, format: .propertyList, currentTime: 0)
+    let (_, jsonWaypoints) = try ProviderService.decodeTrip(
+      from: jsonData, tripID: Self.tripID, currentTime: 0)
+    XCTAssertEqual(propertyListWaypoints, jsonWaypoints)
+
+    // Repeated keys and strings are stored once, and numbers in binary.
+    XCTAssertLessThan(propertyListData.count, jsonData.count)
+  }
+
+  // MARK: - Performance
+
+  private func measureDecoder(waypointCount: Int) {
+    let data = Self.makeTripResponseData(waypointCount: waypointCount)
+    measure(metrics: [XCTClockMetric(), XCTMemoryMetric()]) {
+      _ = try! ProviderService.decodeTrip(from: data, tripID: Self.tripID, currentTime: 0)
+    }
+  }
+
+  private func measureJSONSerialization(waypointCount: Int) {
+    let data = Self.makeTripResponseData(waypointCount: waypointCount)
+    measure(metrics: [XCTClockMetric(), XCTMemoryMetric()]) {
+      _ = try! Self.decodeTripWithJSONSerialization(from: data)
+    }
+  }
+
+  private func measurePropertyList(waypointCount: Int) {
+    let data = Self.makeTripResponseData(waypointCount: waypointCount, format: .propertyList)
+    measure(metrics: [XCTClockMetric(), XCTMemoryMetric()]) {
+      _ = try! ProviderService.decodeTrip(
+        from: data, tripID: Self.tripID, format: .propertyList, currentTime: 0)
+    }
+  }
+
+  func testDecoderPerformanceWith10Waypoints() {
+    measureDecoder(waypointCount: 10)
+  }
+
+  func testJSONSerializationPerformanceWith10Waypoints() {
+    measureJSONSerialization(waypointCount: 10)
+  }
+
+  func testPropertyListPerformanceWith10Waypoints() {
+    measurePropertyList(waypointCount: 10)
+  }
+
+  func testDecoderPerformanceWith1000Waypoints() {
+    measureDecoder(waypointCount: 1000)
+  }
+
+  func testJSONSerializationPerformanceWith1000Waypoints() {
+    measureJSONSerialization(waypointCount: 1000)
+  }
+
+  func testPropertyListPerformanceWith1000Waypoints() {
+    measurePropertyList(waypointCount: 1000)
+  }
+
+  func testDecoderPerformanceWith10000Waypoints() {
+    measureDecoder(waypointCount: 10000)
+  }
+
+  func testJSONSerializationPerformanceWith10000Waypoints() {
+    measureJSONSerialization(waypointCount: 10000)
+  }
+
+  func testPropertyListPerformanceWith10000Waypoints() {
+    measurePropertyList(waypointCount: 10000)
+  }
+}
@@ -0,0 +1,261 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import Foundation
+import XCTest
+
+@testable import DriverSampleApp
+
+class ProviderRetryPolicyTests: XCTestCase {
+  private var urlSession: URLSession!
+  private let requestCountLock = NSLock()
+  private var requestCount = 0
+
+  override func setUp() {
+    let configuration = URLSessionConfiguration.ephemeral
+    configuration.protocolClasses = [MockURLProtocol.self]
+    urlSession = URLSession(configuration: configuration)
+    requestCount = 0
+  }
+
+  override func tearDown() {
+    MockURLProtocol.responseDelayHandler = nil
+  }
+
+  /// Answers get vehicle requests with the status code returned by `statusCode`, which is passed
+  /// the number of requests received so far.
+  private func setGetVehicleResponse(statusCode: @escaping (Int) -> Int = { _ in 200 }) {
+    let responseData = try! JSONSerialization.data(withJSONObject: [
+      "currentTripsIds": ["test-trip1"]
+    ])
+    MockURLProtocol.requestHandler = { request in
+      self.requestCountLock.lock()
+      let previousRequestCount = self.requestCount
+      self.requestCount += 1
+      self.requestCountLock.unlock()
+      let response = HTTPURLResponse(
+        url: request.url!, statusCode: statusCode(previousRequestCount), httpVersion: nil,
+        headerFields: nil)!
+      return (response, responseData)
+    }
+  }
+
+  func testRetriesTransientFailures() async throws {
+    setGetVehicleResponse { previousRequestCount in previousRequestCount < 2 ? 503 : 200 }
+
+    let providerService = ProviderService(
+      session: urlSession, retryPolicy: ProviderRetryPolicy(baseRetryDelay: 0.01))
+    let matchedTripIDs = try await providerService.getVehicle(vehicleID: "test-vehicle")
+
+    XCTAssertEqual(matchedTripIDs, ["test-trip1"])
+    XCTAssertEqual(requestCount, 3)
+  }
+
+  func testDoesNotRetryClientErrors() async {
+    setGetVehicleResponse { _ in 404 }
+
+    let providerService = ProviderService(
+      session: urlSession, retryPolicy: ProviderRetryPolicy(baseRetryDelay: 0.01))
+    let _ = try? await providerService.getVehicle(vehicleID: "test-vehicle")
+    XCTAssertEqual(requestCount, 1)
+  }
+
+  func testRetryBudgetLimitsRetriesWhileProviderIsFailing() async {
+    setGetVehicleResponse { _ in 503 }
+
+    let providerService = ProviderService(
+      session: urlSession,
+      retryPolicy: ProviderRetryPolicy(baseRetryDelay: 0.01, maximumRetryBudget: 2))
+    for _ in 0..<5 {
+      let _ = try? await providerService.getVehicle(vehicleID: "test-vehicle")
+    }
+
+    // The budget pays for two retries, after which each request adds a fifth of a retry.
+    XCTAssertEqual(requestCount, 5 + 2)
+  }
+
+  /// Returns a policy that hedges attempts at most `maximumAttempts` times, once it has observed
+  /// enough fast attempts to hedge any attempt that takes more than a few milliseconds.
+  private func makeWarmHedgingPolicy(maximumAttempts: Int = 1) async throws
+    -> ProviderRetryPolicy
+  {
+    let retryPolicy = ProviderRetryPolicy(
+      maximumAttempts: maximumAttempts, maximumRetryBudget: 1_000, isHedgingEnabled: true)
+    let response = HTTPURLResponse(
+      url: URL(string: "http://localhost:8080")!, statusCode: 200, httpVersion: nil,
+      headerFields: nil)!
+    for _ in 0..<20 {
+      _ = try await retryPolicy.data(hedgeKey: "getVehicle") { _ in (Data(), response) }
+    }
+    return retryPolicy
+  }
+
+  func testHedgeCancelsTheSlowerAttempt() async throws {
+    let retryPolicy = try await makeWarmHedgingPolicy()
+    let response = HTTPURLResponse(
+      url: URL(string: "http://localhost:8080")!, statusCode: 200, httpVersion: nil,
+      headerFields: nil)!
+    let cancellationLock = NSLock()
+    var isFirstAttemptCancelled = false
+
+    let (data, _) = try await retryPolicy.data(hedgeKey: "getVehicle") { isFirstAttempt in
+      guard isFirstAttempt else { return (Data("hedge".utf8), response) }
+      do {
+        try await Task.sleep(nanoseconds: 5_000_000_000)
+      } catch {
+        cancellationLock.lock()
+        isFirstAttemptCancelled = true
+        cancellationLock.unlock()
+        throw error
+      }
+      return (Data("first".utf8), response)
+    }
+
+    // The hedged pair only completes once both attempts have, so the first one was cancelled
+    // rather than left to run.
+    XCTAssertEqual(data, Data("hedge".utf8))
+    cancellationLock.lock()
+    XCTAssertTrue(isFirstAttemptCancelled)
+    cancellationLock.unlock()
+  }
+
+  func testHedgedRequestFailsOnlyOnceBothAttemptsFail() async throws {
+    let retryPolicy = try await makeWarmHedgingPolicy()
+    let response = HTTPURLResponse(
+      url: URL(string: "http://localhost:8080")!, statusCode: 200, httpVersion: nil,
+      headerFields: nil)!
+
+    // The first attempt fails with an error that isn't retried while the hedge is in flight.
+    let (data, _) = try await retryPolicy.data(hedgeKey: "getVehicle") { isFirstAttempt in
+      if isFirstAttempt {
+        try await Task.sleep(nanoseconds: 50_000_000)
+        throw URLError(.badServerResponse)
+      }
+      try await Task.sleep(nanoseconds: 100_000_000)
+      return (Data("hedge".utf8), response)
+    }
+    XCTAssertEqual(data, Data("hedge".utf8))
+
+    do {
+      _ = try await retryPolicy.data(hedgeKey: "getVehicle") { isFirstAttempt in
+        try await Task.sleep(nanoseconds: isFirstAttempt ? 50_000_000 : 100_000_000)
+        throw isFirstAttempt ? URLError(.badServerResponse) : URLError(.timedOut)
+      }
+      XCTFail("Expected both attempts to fail")
+    } catch {
+      // The failure that isn't retryable is reported.
+      XCTAssertEqual((error as? URLError)?.code, .badServerResponse)
+    }
+  }
+
+  func testHedgeDelayIsKeptPerHedgeKey() async throws {
+    let retryPolicy = ProviderRetryPolicy(maximumRetryBudget: 1_000, isHedgingEnabled: true)
+    let response = HTTPURLResponse(
+      url: URL(string: "http://localhost:8080")!, statusCode: 200, httpVersion: nil,
+      headerFields: nil)!
+    for _ in 0..<20 {
+      _ = try await retryPolicy.data(hedgeKey: "fast") { _ in (Data(), response) }
+      _ = try await retryPolicy.data(hedgeKey: "slow") { _ in
+        try await Task.sleep(nanoseconds: 20_000_000)
+        return (Data(), response)
+      }
+    }
+    _ = try await retryPolicy.data { _ in (Data(), response) }
+
+    // Slow calls don't delay the hedges of fast ones, and a call that hasn't been observed isn't
+    // hedged at all.
+    let fastHedgeDelay = try XCTUnwrap(retryPolicy.hedgeDelay(for: "fast"))
+    let slowHedgeDelay = try XCTUnwrap(retryPolicy.hedgeDelay(for: "slow"))
+    XCTAssertGreaterThanOrEqual(slowHedgeDelay, 0.02)
+    XCTAssertLessThan(fastHedgeDelay, slowHedgeDelay)
+    XCTAssertNil(retryPolicy.hedgeDelay(for: "unobserved"))
+  }
+
+  /// Compares the latency of vehicle fetches against a provider with a heavy-tailed latency
+  /// distribution, with and without hedging, and reports their p50 and p99 latencies.
+  func testHedgingReducesTailLatency() async throws {
+    setGetVehicleResponse()
+    // Pareto distributed latencies with a 10 ms minimum and a shape of 1.5, so that 5% of
+    // requests take longer than 74 ms and 1% longer than 215 ms.
+    var generator = SeededGenerator(seed: 42)
+    let generatorLock = NSLock()
+    MockURLProtocol.responseDelayHandler = { _ in
+      generatorLock.lock()
+      defer { generatorLock.unlock() }
+      let uniform = Double.random(in: Double.ulpOfOne..<1, using: &generator)
+      return min(0.01 / pow(uniform, 1 / 1.5), 1)
+    }
+
+    let requestsPerRun = 200
+    let baselineLatencies = try await measureGetVehicleLatencies(
+      count: requestsPerRun, retryPolicy: ProviderRetryPolicy(maximumRetryBudget: 1_000))
+    let hedgedLatencies = try await measureGetVehicleLatencies(
+      count: requestsPerRun,
+      retryPolicy: ProviderRetryPolicy(maximumRetryBudget: 1_000, isHedgingEnabled: true))
+
+    let baselineP50 = Self.percentile(0.5, of: baselineLatencies)
+    let baselineP99 = Self.percentile(0.99, of: baselineLatencies)
+    let hedgedP50 = Self.percentile(0.5, of: hedgedLatencies)
+    let hedgedP99 = Self.percentile(0.99, of: hedgedLatencies)
+    print(
+      String(
+        format: "Get vehicle latency without hedging: p50 %.0f ms, p99 %.0f ms. "
+          + "With hedging: p50 %.0f ms, p99 %.0f ms.",
+        baselineP50 * 1000, baselineP99 * 1000, hedgedP50 * 1000, hedgedP99 * 1000))
+    XCTAssertLessThan(hedgedP99, baselineP99)
+  }
+
+  /// Fetches a vehicle `count` times in a row, and returns the latency of each fetch after the
+  /// policy has observed enough latencies to hedge.
+  private func measureGetVehicleLatencies(count: Int, retryPolicy: ProviderRetryPolicy)
+    async throws -> [TimeInterval]
+  {
+    let providerService = ProviderService(session: urlSession, retryPolicy: retryPolicy)
+    for _ in 0..<20 {
+      let _ = try await providerService.getVehicle(vehicleID: "test-vehicle")
+    }
+
+    var latencies: [TimeInterval] = []
+    for _ in 0..<count {
+      let startTime = DispatchTime.now().uptimeNanoseconds
+      let _ = try await providerService.getVehicle(vehicleID: "test-vehicle")
+      latencies.append(TimeInterval(DispatchTime.now().uptimeNanoseconds - startTime) / 1e9)
+    }
+    return latencies
+  }
+
+  private static func percentile(_ percentile: Double, of values: [TimeInterval]) -> TimeInterval {
+    let sortedValues = values.sorted()
+    return sortedValues[Int((Double(sortedValues.count - 1) * percentile).rounded(.up))]
+  }
+}
+
+/// A random number generator that produces the same sequence for the same seed, so that benchmark
+/// runs are comparable.
+private struct SeededGenerator: RandomNumberGenerator {
+  private var state: UInt64
+
+  init(seed: UInt64) {
+    state = seed
+  }
+
+  mutating func next() -> UInt64 {
+    // SplitMix64.
+    state &+= 0x9E37_79B9_7F4A_7C15
+    var value = state
+    value = (value ^ (value >> 30)) &* 0xBF58_476D_1CE4_E5B9
+    value = (value ^ (value >> 27)) &* 0x94D0_49BB_1331_11EB
+    return value ^ (value >> 31)
+  }
+}
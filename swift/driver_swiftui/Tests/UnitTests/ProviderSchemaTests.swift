@@ -0,0 +1,192 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+import Foundation
+import GoogleRidesharingDriver
+import XCTest
+
+@testable import DriverSampleApp
+
+class ProviderSchemaTests: XCTestCase {
+
+  private static let baseURL = URL(string: "http://localhost:8080")!
+
+  private static let waypointTypesByProviderString: [String: GMTSTripWaypointType] = [
+    "PICKUP_WAYPOINT_TYPE": .pickUp,
+    "DROP_OFF_WAYPOINT_TYPE": .dropOff,
+    "INTERMEDIATE_DESTINATION_WAYPOINT_TYPE": .intermediateDestination,
+  ]
+
+  /// Decodes a waypoint type by comparing it with every provider string in turn, which is how
+  /// waypoint types were decoded before they were generated from the schema.
+  private static func decodeWaypointTypeByComparison(_ string: String) -> GMTSTripWaypointType {
+    if string == "PICKUP_WAYPOINT_TYPE" {
+      return .pickUp
+    } else if string == "DROP_OFF_WAYPOINT_TYPE" {
+      return .dropOff
+    } else if string == "INTERMEDIATE_DESTINATION_WAYPOINT_TYPE" {
+      return .intermediateDestination
+    } else {
+      return .unknown
+    }
+  }
+
+  /// Builds a trip URL by resolving the route's prefix and then the trip ID, which is how provider
+  /// URLs were built before they were generated from the schema.
+  private static func makeTripURLInTwoSteps(tripID: String) -> URL? {
+    let tripURL = URL(string: "/trip/", relativeTo: baseURL)!
+    return URL(string: tripID, relativeTo: tripURL)
+  }
+
+  func testTripStatusRoundTrips() {
+    for status in ProviderTripStatus.allCases {
+      XCTAssertEqual(ProviderTripStatus(rawValue: status.rawValue), status)
+    }
+    XCTAssertEqual(ProviderTripStatus(rawValue: "ENROUTE_TO_DROPOFF"), .enrouteToDropoff)
+    XCTAssertNil(ProviderTripStatus(rawValue: "CANCELED"))
+    XCTAssertNil(ProviderTripStatus(rawValue: "new"))
+  }
+
+  func testTripStatusCodable() throws {
+    let data = try JSONEncoder().encode([ProviderTripStatus.arrivedAtPickup])
+    XCTAssertEqual(String(decoding: data, as: UTF8.self), "[\"ARRIVED_AT_PICKUP\"]")
+    XCTAssertEqual(
+      try JSONDecoder().decode([ProviderTripStatus].self, from: data), [.arrivedAtPickup])
+  }
+
+  func testWaypointTypeFromStringAndBytes() {
+    let strings = Array(Self.waypointTypesByProviderString.keys) + [
+      "", "OTHER", "PICKUP_WAYPOINT_TYPF", "pickup_waypoint_type",
+    ]
+    for string in strings {
+      let expectedType = Self.waypointTypesByProviderString[string] ?? .unknown
+      XCTAssertEqual(ProviderWaypointType.tripWaypointType(providerString: string), expectedType)
+      let typeFromBytes = Array(string.utf8).withUnsafeBytes { bytes in
+        ProviderWaypointType.tripWaypointType(providerBytes: bytes)
+      }
+      XCTAssertEqual(typeFromBytes, expectedType, string)
+    }
+  }
+
+  func testRoutes() {
+    let baseURL = Self.baseURL
+    XCTAssertEqual(
+      ProviderRoutes.driverToken(vehicleID: "vehicle-1", relativeTo: baseURL)?.absoluteString,
+      "http://localhost:8080/token/driver/vehicle-1")
+    XCTAssertEqual(
+      ProviderRoutes.createVehicle(relativeTo: baseURL)?.absoluteString,
+      "http://localhost:8080/vehicle/new")
+    XCTAssertEqual(
+      ProviderRoutes.vehicleUpdates(vehicleID: "vehicle-1", relativeTo: baseURL)?.absoluteString,
+      "http://localhost:8080/vehicle/vehicle-1/events")
+    XCTAssertEqual(
+      ProviderRoutes.trip(tripID: "trip 1", relativeTo: baseURL)?.absoluteString,
+      "http://localhost:8080/trip/trip%201")
+    XCTAssertEqual(
+      ProviderRoutes.batchGetTrips(tripIDs: "trip-1,trip&2", relativeTo: baseURL)?.absoluteString,
+      "http://localhost:8080/trips?tripIds=trip-1,trip%262")
+  }
+
+  func testRoutesMatchTwoStepResolution() {
+    for tripID in ["trip-1", "test-trip", "0123456789abcdef"] {
+      XCTAssertEqual(
+        ProviderRoutes.trip(tripID: tripID, relativeTo: Self.baseURL)?.absoluteURL,
+        Self.makeTripURLInTwoSteps(tripID: tripID)?.absoluteURL)
+    }
+  }
+
+  func testRequestPayloads() {
+    let createVehicle = ProviderCreateVehicleRequest(
+      vehicleID: "vehicle-1", backToBackEnabled: true
+    ).payload
+    XCTAssertEqual(createVehicle["vehicleId"] as? String, "vehicle-1")
+    XCTAssertEqual(createVehicle["backToBackEnabled"] as? Bool, true)
+
+    let updateTrip = ProviderUpdateTripRequest(status: .complete, intermediateDestinationIndex: nil)
+      .payload
+    XCTAssertEqual(updateTrip["status"] as? String, "COMPLETE")
+    XCTAssertNil(updateTrip["intermediateDestinationIndex"])
+
+    let updateTripWithIndex = ProviderUpdateTripRequest(
+      status: .enrouteToIntermediateDestination, intermediateDestinationIndex: 2
+    ).payload
+    XCTAssertEqual(updateTripWithIndex["intermediateDestinationIndex"] as? Int, 2)
+  }
+
+  // MARK: - Performance
+
+  private static let benchmarkIterationCount = 100_000
+
+  private static let benchmarkWaypointTypeStrings = (0..<benchmarkIterationCount).map { index in
+    [
+      "PICKUP_WAYPOINT_TYPE", "INTERMEDIATE_DESTINATION_WAYPOINT_TYPE", "DROP_OFF_WAYPOINT_TYPE",
+    ][index % 3]
+  }
+
+  func testGeneratedWaypointTypeDecodingPerformance() {
+    let strings = Self.benchmarkWaypointTypeStrings
+    measure(metrics: [XCTClockMetric()]) {
+      var count = 0
+      for string in strings {
+        var string = string
+        let type = string.withUTF8 { utf8 in
+          ProviderWaypointType.tripWaypointType(providerBytes: UnsafeRawBufferPointer(utf8))
+        }
+        count += type == .dropOff ? 1 : 0
+      }
+      XCTAssertEqual(count, Self.benchmarkIterationCount / 3)
+    }
+  }
+
+  func testComparisonWaypointTypeDecodingPerformance() {
+    let strings = Self.benchmarkWaypointTypeStrings
+    measure(metrics: [XCTClockMetric()]) {
+      var count = 0
+      for string in strings {
+        count += Self.decodeWaypointTypeByComparison(string) == .dropOff ? 1 : 0
+      }
+      XCTAssertEqual(count, Self.benchmarkIterationCount / 3)
+    }
+  }
+
+  func testGeneratedTripStatusDecodingPerformance() {
+    let rawValues = (0..<Self.benchmarkIterationCount).map {
+      ProviderTripStatus.allCases[$0 % ProviderTripStatus.allCases.count].rawValue
+    }
+    measure(metrics: [XCTClockMetric()]) {
+      var count = 0
+      for rawValue in rawValues where ProviderTripStatus(rawValue: rawValue) == .complete {
+        count += 1
+      }
+      XCTAssertGreaterThan(count, 0)
+    }
+  }
+
+  func testGeneratedRoutePerformance() {
+    measure(metrics: [XCTClockMetric()]) {
+      for index in 0..<10_000 {
+        _ = ProviderRoutes.trip(tripID: "trip-\(index)", relativeTo: Self.baseURL)
+      }
+    }
+  }
+
+  func testTwoStepRoutePerformance() {
+    measure(metrics: [XCTClockMetric()]) {
+      for index in 0..<10_000 {
+        _ = Self.makeTripURLInTwoSteps(tripID: "trip-\(index)")
+      }
+    }
+  }
+}
@@ -30,12 +30,20 @@ class ProviderServiceTests: XCTestCase {
     urlSession = URLSession(configuration: configuration)
   }
 
-  private func setProviderResponse(jsonObject: Any) {
+  override func tearDown() {
+    MockURLProtocol.responseDelayHandler = nil
+    MockURLProtocol.networkEmulator = nil
+  }
+
+  private func setProviderResponse(
+    jsonObject: Any, statusCode: Int = 200, headerFields: [String: String]? = nil
+  ) {
     let responseData = try! JSONSerialization.data(withJSONObject: jsonObject)
     MockURLProtocol.requestHandler = { request in
       self.mostRecentRequest = request
       let response = HTTPURLResponse(
-        url: URL(string: "fakeURL")!, statusCode: 200, httpVersion: nil, headerFields: nil)!
+        url: URL(string: "fakeURL")!, statusCode: statusCode, httpVersion: nil,
+        headerFields: headerFields)!
       return (response, responseData)
     }
   }
@@ -88,6 +96,71 @@ class ProviderServiceTests: XCTestCase {
     XCTAssertEqual(request.httpMethod, "GET")
   }
 
+  func testGetVehicleRevalidatesCachedResponse() async throws {
+    let responseData = try JSONSerialization.data(withJSONObject: [
+      "currentTripsIds": ["test-trip1", "test-trip2"]
+    ])
+    var responseBytes: [Int] = []
+    MockURLProtocol.requestHandler = { request in
+      self.mostRecentRequest = request
+      let isUnchanged = request.value(forHTTPHeaderField: "If-None-Match") == "\"v1\""
+      let response = HTTPURLResponse(
+        url: request.url!, statusCode: isUnchanged ? 304 : 200, httpVersion: nil,
+        headerFields: ["ETag": "\"v1\""])!
+      let data = isUnchanged ? nil : responseData
+      responseBytes.append(data?.count ?? 0)
+      return (response, data)
+    }
+
+    let providerService = ProviderService(session: urlSession)
+    let firstTripIDs = try await providerService.getVehicle(vehicleID: "test-vehicle")
+    let secondTripIDs = try await providerService.getVehicle(vehicleID: "test-vehicle")
+    XCTAssertEqual(firstTripIDs, ["test-trip1", "test-trip2"])
+    XCTAssertEqual(secondTripIDs, firstTripIDs)
+
+    // The second response carries no body and is served from the cached one.
+    XCTAssertEqual(responseBytes, [responseData.count, 0])
+    XCTAssertEqual(
+      providerService.responseCache.statistics,
+      ProviderResponseCache.Statistics(hitCount: 1, missCount: 1, notModifiedCount: 1))
+  }
+
+  func testWaitForVehicleUpdate() async throws {
+    setProviderResponse(
+      jsonObject: ["currentTripsIds": ["test-trip1"]], headerFields: ["ETag": "\"v2\""])
+
+    let providerService = ProviderService(session: urlSession)
+    let update = try await providerService.waitForVehicleUpdate(
+      vehicleID: "test-vehicle", lastTag: "\"v1\"")
+    XCTAssertEqual(update?.matchedTripIDs, ["test-trip1"])
+    XCTAssertEqual(update?.tag, "\"v2\"")
+
+    let request = try XCTUnwrap(mostRecentRequest)
+    XCTAssertEqual(request.url, URL(string: "http://localhost:8080/vehicle/test-vehicle/events"))
+    XCTAssertEqual(request.httpMethod, "GET")
+    XCTAssertEqual(request.value(forHTTPHeaderField: "If-None-Match"), "\"v1\"")
+  }
+
+  func testWaitForVehicleUpdateWithoutChange() async throws {
+    setProviderResponse(jsonObject: [:], statusCode: 304)
+
+    let providerService = ProviderService(session: urlSession)
+    let update = try await providerService.waitForVehicleUpdate(
+      vehicleID: "test-vehicle", lastTag: "\"v1\"")
+    XCTAssertNil(update)
+  }
+
+  func testWaitForVehicleUpdateUnsupported() async {
+    setProviderResponse(jsonObject: [:], statusCode: 404)
+
+    let providerService = ProviderService(session: urlSession)
+    do {
+      let _ = try await providerService.waitForVehicleUpdate(vehicleID: "test-vehicle", lastTag: nil)
+      XCTFail()
+    } catch {
+    }
+  }
+
   func testGetTrip() async throws {
     setProviderResponse(jsonObject: [
       "trip": [
@@ -154,6 +227,194 @@ class ProviderServiceTests: XCTestCase {
     XCTAssertEqual(request.httpMethod, "GET")
   }
 
+  func testGetTripEstimatesETAsFromTheServiceClock() async throws {
+    setProviderResponse(jsonObject: [
+      "trip": [
+        "tripStatus": "ENROUTE_TO_PICKUP",
+        "waypoints": [
+          [
+            "location": ["point": ["latitude": 1, "longitude": 2]],
+            "waypointType": "PICKUP_WAYPOINT_TYPE",
+          ]
+        ],
+      ]
+    ])
+
+    let clock = VirtualClock(now: 1_000)
+    let providerService = ProviderService(session: urlSession, clock: clock)
+    let (_, waypoints) = try await providerService.getTrip(tripID: "test-trip")
+    XCTAssertEqual(waypoints.first?.eta, 1_000)
+  }
+
+  func testNotModifiedTripHasETAsOfTheCurrentTime() async throws {
+    let responseData = try JSONSerialization.data(withJSONObject: [
+      "trip": [
+        "tripStatus": "ENROUTE_TO_PICKUP",
+        "waypoints": [
+          [
+            "location": ["point": ["latitude": 1, "longitude": 2]],
+            "waypointType": "PICKUP_WAYPOINT_TYPE",
+          ]
+        ],
+      ]
+    ])
+    MockURLProtocol.requestHandler = { request in
+      let isUnchanged = request.value(forHTTPHeaderField: "If-None-Match") == "\"v1\""
+      let response = HTTPURLResponse(
+        url: request.url!, statusCode: isUnchanged ? 304 : 200, httpVersion: nil,
+        headerFields: ["ETag": "\"v1\""])!
+      return (response, isUnchanged ? nil : responseData)
+    }
+
+    let clock = VirtualClock(now: 1_000)
+    let providerService = ProviderService(session: urlSession, clock: clock)
+    _ = try await providerService.getTrip(tripID: "test-trip")
+    clock.advance(by: 60)
+    let (_, waypoints) = try await providerService.getTrip(tripID: "test-trip")
+
+    // The unchanged trip is decoded again, rather than replaying the ETAs of the first fetch.
+    XCTAssertEqual(providerService.responseCache.statistics.notModifiedCount, 1)
+    XCTAssertEqual(waypoints.first?.eta, 1_060)
+  }
+
+  func testGetTripsWithBatchRequest() async throws {
+    setProviderResponse(jsonObject: [
+      "trips": [
+        ["name": "providers/test-provider/trips/test-trip1", "tripStatus": "NEW", "waypoints": []],
+        [
+          "name": "providers/test-provider/trips/test-trip2", "tripStatus": "ENROUTE_TO_DROPOFF",
+          "waypoints": [],
+        ],
+      ]
+    ])
+
+    let providerService = ProviderService(session: urlSession)
+    let trips = await providerService.getTrips(tripIDs: ["test-trip1", "test-trip2"])
+    XCTAssertEqual(try trips["test-trip1"]?.get().0, .new)
+    XCTAssertEqual(try trips["test-trip2"]?.get().0, .enrouteToDropoff)
+
+    let request = try XCTUnwrap(mostRecentRequest)
+    XCTAssertEqual(
+      request.url, URL(string: "http://localhost:8080/trips?tripIds=test-trip1,test-trip2"))
+    XCTAssertEqual(request.httpMethod, "GET")
+  }
+
+  func testGetTripsFallsBackToConcurrentRequests() async throws {
+    let requestedPathsLock = NSLock()
+    var requestedPaths: [String] = []
+    MockURLProtocol.requestHandler = { request in
+      let path = request.url!.path
+      requestedPathsLock.lock()
+      requestedPaths.append(path)
+      requestedPathsLock.unlock()
+      let isBatchRequest = path == "/trips"
+      let response = HTTPURLResponse(
+        url: request.url!, statusCode: isBatchRequest ? 404 : 200, httpVersion: nil,
+        headerFields: nil)!
+      let tripStatus = path.hasSuffix("test-trip1") ? "NEW" : "COMPLETE"
+      let data = try JSONSerialization.data(withJSONObject: [
+        "trip": ["tripStatus": tripStatus, "waypoints": []]
+      ])
+      return (response, isBatchRequest ? nil : data)
+    }
+
+    let providerService = ProviderService(session: urlSession, maximumConcurrentTripFetches: 2)
+    let trips = await providerService.getTrips(
+      tripIDs: ["test-trip1", "test-trip2", "test-trip3", "test-trip1"])
+    XCTAssertEqual(Set(trips.keys), ["test-trip1", "test-trip2", "test-trip3"])
+    XCTAssertEqual(try trips["test-trip1"]?.get().0, .new)
+    XCTAssertEqual(try trips["test-trip3"]?.get().0, .complete)
+
+    // The unsupported batch endpoint is remembered and not requested again.
+    let _ = await providerService.getTrips(tripIDs: ["test-trip1", "test-trip2"])
+    requestedPathsLock.lock()
+    defer { requestedPathsLock.unlock() }
+    XCTAssertEqual(requestedPaths.filter { $0 == "/trips" }.count, 1)
+    XCTAssertEqual(requestedPaths.count, 6)
+  }
+
+  func testGetTripsReturnsTheTripsThatLoadWhenABatchedTripIsMissing() async throws {
+    setProviderResponse(jsonObject: [
+      "trips": [
+        ["name": "providers/test-provider/trips/test-trip1", "tripStatus": "NEW", "waypoints": []],
+        ["tripStatus": "ENROUTE_TO_DROPOFF", "waypoints": []],
+      ]
+    ])
+
+    let providerService = ProviderService(session: urlSession)
+    let trips = await providerService.getTrips(tripIDs: ["test-trip1", "test-trip2"])
+    XCTAssertEqual(try trips["test-trip1"]?.get().0, .new)
+    XCTAssertThrowsError(try trips["test-trip2"]?.get())
+  }
+
+  func testGetTripsReturnsTheTripsThatLoadWhenAFetchFails() async throws {
+    MockURLProtocol.requestHandler = { request in
+      let path = request.url!.path
+      let statusCode: Int
+      switch path {
+      case "/trips": statusCode = 404
+      case "/trip/test-trip2": statusCode = 500
+      default: statusCode = 200
+      }
+      let response = HTTPURLResponse(
+        url: request.url!, statusCode: statusCode, httpVersion: nil, headerFields: nil)!
+      let data = try JSONSerialization.data(withJSONObject: [
+        "trip": ["tripStatus": "NEW", "waypoints": []]
+      ])
+      return (response, statusCode == 200 ? data : nil)
+    }
+
+    let retryPolicy = ProviderRetryPolicy(maximumAttempts: 1)
+    let providerService = ProviderService(session: urlSession, retryPolicy: retryPolicy)
+    let trips = await providerService.getTrips(tripIDs: ["test-trip1", "test-trip2"])
+    XCTAssertEqual(try trips["test-trip1"]?.get().0, .new)
+    XCTAssertThrowsError(try trips["test-trip2"]?.get())
+  }
+
+  func testNegotiatesPropertyListPayloads() async throws {
+    // Serves property lists to clients that accept them, like a provider that supports them.
+    MockURLProtocol.requestHandler = { request in
+      self.mostRecentRequest = request
+      let accept = request.value(forHTTPHeaderField: "Accept") ?? ""
+      let payload: [String: Any] = [
+        "trip": [
+          "tripStatus": "ENROUTE_TO_PICKUP",
+          "waypoints": [
+            [
+              "location": ["point": ["latitude": 37.4, "longitude": -122.1]],
+              "waypointType": "PICKUP_WAYPOINT_TYPE",
+            ]
+          ],
+        ]
+      ]
+      let isPropertyList = accept.contains("application/x-plist")
+      let data =
+        isPropertyList
+        ? try PropertyListSerialization.data(fromPropertyList: payload, format: .binary, options: 0)
+        : try JSONSerialization.data(withJSONObject: payload)
+      let contentType = isPropertyList ? "application/x-plist" : "application/json"
+      let response = HTTPURLResponse(
+        url: request.url!, statusCode: 200, httpVersion: nil,
+        headerFields: ["Content-Type": contentType])!
+      return (response, data)
+    }
+
+    let providerService = ProviderService(session: urlSession)
+    let (tripStatus, waypoints) = try await providerService.getTrip(tripID: "test-trip")
+    XCTAssertEqual(tripStatus, .enrouteToPickup)
+    XCTAssertEqual(waypoints.count, 1)
+    XCTAssertEqual(waypoints.first?.waypointType, .pickUp)
+    XCTAssertEqual(waypoints.first?.location?.point?.latitude, 37.4)
+
+    // Once the provider has answered with a property list, request bodies are sent as one too.
+    try await providerService.updateTrip(
+      tripID: "test-trip", status: .arrivedAtPickup, intermediateDestinationIndex: nil)
+    let request = try XCTUnwrap(mostRecentRequest)
+    XCTAssertEqual(request.value(forHTTPHeaderField: "Content-Type"), "application/x-plist")
+    let requestHTTPBody = try XCTUnwrap(request.bodyStreamAsPropertyList() as? NSDictionary)
+    XCTAssertEqual(requestHTTPBody, ["status": "ARRIVED_AT_PICKUP"] as NSDictionary)
+  }
+
   func testUpdateTrip() async throws {
     setProviderResponse(jsonObject: [:])
 
@@ -165,7 +426,227 @@ class ProviderServiceTests: XCTestCase {
     let request = try XCTUnwrap(mostRecentRequest)
     XCTAssertEqual(request.url, URL(string: "http://localhost:8080/trip/test-trip"))
     XCTAssertEqual(request.httpMethod, "PUT")
+    XCTAssertEqual(request.value(forHTTPHeaderField: "Content-Type"), "application/json")
     let requestHTTPBody = try XCTUnwrap(request.bodyStreamAsJSON() as? NSDictionary)
     XCTAssertEqual(requestHTTPBody, ["status": "ENROUTE_TO_PICKUP"] as NSDictionary)
   }
+
+  // MARK: - Scheduling
+
+  /// How long the stub provider takes to answer vehicle polls and trip fetches.
+  private static let slowEndpointLatency: TimeInterval = 1
+
+  /// Serves vehicles and trips after `latency` and trip updates immediately. Reports the number of
+  /// background requests in flight whenever one starts, and calls `onBackgroundResponse` whenever
+  /// one is answered.
+  private func setSlowBackgroundResponses(
+    latency: TimeInterval = ProviderServiceTests.slowEndpointLatency,
+    onBackgroundRequest: @escaping (Int) -> Void,
+    onBackgroundResponse: @escaping () -> Void = {}
+  ) {
+    let lock = NSLock()
+    var backgroundRequestCount = 0
+    MockURLProtocol.responseDelayHandler = { request in
+      guard request.httpMethod == "GET" else { return 0 }
+      lock.lock()
+      backgroundRequestCount += 1
+      onBackgroundRequest(backgroundRequestCount)
+      lock.unlock()
+      return latency
+    }
+    MockURLProtocol.requestHandler = { request in
+      if request.httpMethod == "GET" {
+        lock.lock()
+        backgroundRequestCount -= 1
+        onBackgroundResponse()
+        lock.unlock()
+      }
+      let payload: [String: Any] = [
+        "currentTripsIds": ["test-trip"],
+        "trip": ["tripStatus": "NEW", "waypoints": []],
+      ]
+      let data = try JSONSerialization.data(withJSONObject: payload)
+      let response = HTTPURLResponse(
+        url: request.url!, statusCode: 200, httpVersion: nil, headerFields: nil)!
+      return (response, data)
+    }
+  }
+
+  /// Waits until `condition` holds, yielding to the requests in flight in between.
+  private func wait(until condition: () -> Bool) async throws {
+    let deadline = Date(timeIntervalSinceNow: 5)
+    while !condition() {
+      guard Date() < deadline else {
+        XCTFail("Condition not met within 5 s")
+        return
+      }
+      try await Task.sleep(nanoseconds: 1_000_000)
+    }
+  }
+
+  func testTripUpdateIsNotDelayedBySlowBackgroundRequests() async throws {
+    let lock = NSLock()
+    var backgroundRequestCount = 0
+    var maximumBackgroundRequestCount = 0
+    var answeredBackgroundRequestCount = 0
+    // Background requests are not answered for the duration of the test, so the update can only
+    // complete if it doesn't wait for them.
+    setSlowBackgroundResponses(
+      latency: 60,
+      onBackgroundRequest: { count in
+        lock.lock()
+        backgroundRequestCount = count
+        maximumBackgroundRequestCount = max(maximumBackgroundRequestCount, count)
+        lock.unlock()
+      },
+      onBackgroundResponse: {
+        lock.lock()
+        answeredBackgroundRequestCount += 1
+        lock.unlock()
+      })
+    let providerService = ProviderService(
+      session: urlSession, maximumConcurrentBackgroundRequests: 2)
+
+    let backgroundTraffic = Task {
+      try await withThrowingTaskGroup(of: Void.self) { group in
+        for index in 0..<6 {
+          group.addTask { _ = try await providerService.getTrip(tripID: "trip-\(index)") }
+        }
+        try await group.waitForAll()
+      }
+    }
+    try await wait(until: {
+      lock.lock()
+      defer { lock.unlock() }
+      return backgroundRequestCount == 2
+    })
+
+    try await providerService.updateTrip(
+      tripID: "test-trip", status: .arrivedAtPickup, intermediateDestinationIndex: nil)
+    backgroundTraffic.cancel()
+
+    lock.lock()
+    defer { lock.unlock() }
+    XCTAssertEqual(answeredBackgroundRequestCount, 0)
+    XCTAssertEqual(maximumBackgroundRequestCount, 2)
+  }
+
+  func testNewerPollSupersedesStalePoll() async throws {
+    let lock = NSLock()
+    var backgroundRequestCount = 0
+    setSlowBackgroundResponses(onBackgroundRequest: { count in
+      lock.lock()
+      backgroundRequestCount = count
+      lock.unlock()
+    })
+    let providerService = ProviderService(session: urlSession)
+
+    let stalePoll = Task { try await providerService.getVehicle(vehicleID: "test-vehicle") }
+    try await wait(until: {
+      lock.lock()
+      defer { lock.unlock() }
+      return backgroundRequestCount == 1
+    })
+    let matchedTripIDs = try await providerService.getVehicle(vehicleID: "test-vehicle")
+    XCTAssertEqual(matchedTripIDs, ["test-trip"])
+
+    do {
+      _ = try await stalePoll.value
+      XCTFail("The stale poll should have been cancelled.")
+    } catch {
+      XCTAssertTrue(error is CancellationError)
+    }
+  }
+
+  func testNewerPollSupersedesStalePollWaitingToRetry() async throws {
+    let lock = NSLock()
+    var requestCount = 0
+    MockURLProtocol.requestHandler = { request in
+      lock.lock()
+      requestCount += 1
+      let isFirstRequest = requestCount == 1
+      lock.unlock()
+      let response = HTTPURLResponse(
+        url: request.url!, statusCode: isFirstRequest ? 503 : 200, httpVersion: nil,
+        headerFields: nil)!
+      let jsonObject: [String: Any] = ["currentTripsIds": [isFirstRequest ? "stale" : "current"]]
+      return (response, try JSONSerialization.data(withJSONObject: jsonObject))
+    }
+    let clock = VirtualClock(now: 0)
+    let retryPolicy = ProviderRetryPolicy(baseRetryDelay: 10, maximumRetryDelay: 10, clock: clock)
+    let providerService = ProviderService(session: urlSession, retryPolicy: retryPolicy)
+
+    let stalePoll = Task { try await providerService.getVehicle(vehicleID: "test-vehicle") }
+    // The stale poll's first attempt fails, and it waits on the clock before retrying.
+    try await wait(until: { clock.pendingTimerCount == 1 })
+    let matchedTripIDs = try await providerService.getVehicle(vehicleID: "test-vehicle")
+    XCTAssertEqual(matchedTripIDs, ["current"])
+
+    // A retry that was not cancelled would be sent now, and answered after the newer poll.
+    clock.advance(by: 10)
+    do {
+      _ = try await stalePoll.value
+      XCTFail("The stale poll should have been cancelled.")
+    } catch {
+      XCTAssertTrue(error is CancellationError)
+    }
+    lock.lock()
+    defer { lock.unlock() }
+    XCTAssertEqual(requestCount, 2)
+  }
+
+  // MARK: - Emulated network
+
+  func testOverlappingPollsOnSlowNetworkOnlyDeliverTheNewest() async throws {
+    let networkEmulator = NetworkEmulator(seed: 7)
+    networkEmulator.addRoute(
+      pathPrefix: "/vehicle/", method: "GET",
+      conditions: NetworkEmulator.Conditions(latency: .uniform(0.2...0.5)))
+    MockURLProtocol.networkEmulator = networkEmulator
+    let lock = NSLock()
+    var sentPollCount = 0
+    var answeredPollCount = 0
+    MockURLProtocol.responseDelayHandler = { _ in
+      lock.lock()
+      sentPollCount += 1
+      lock.unlock()
+      return 0
+    }
+    MockURLProtocol.requestHandler = { request in
+      lock.lock()
+      answeredPollCount += 1
+      let pollNumber = answeredPollCount
+      lock.unlock()
+      let response = HTTPURLResponse(
+        url: request.url!, statusCode: 200, httpVersion: nil, headerFields: nil)!
+      let jsonObject: [String: Any] = ["currentTripsIds": ["poll-\(pollNumber)"]]
+      return (response, try JSONSerialization.data(withJSONObject: jsonObject))
+    }
+    let providerService = ProviderService(session: urlSession)
+
+    // Each poll is sent while the ones before it are still crossing the network.
+    var stalePolls: [Task<[String], Swift.Error>] = []
+    for pollIndex in 0..<4 {
+      stalePolls.append(Task { try await providerService.getVehicle(vehicleID: "test-vehicle") })
+      try await wait(until: {
+        lock.lock()
+        defer { lock.unlock() }
+        return sentPollCount == pollIndex + 1
+      })
+    }
+    let matchedTripIDs = try await providerService.getVehicle(vehicleID: "test-vehicle")
+    XCTAssertEqual(matchedTripIDs, ["poll-1"])
+
+    for stalePoll in stalePolls {
+      do {
+        _ = try await stalePoll.value
+        XCTFail("The stale poll should have been cancelled.")
+      } catch {
+        XCTAssertTrue(error is CancellationError)
+      }
+    }
+    lock.lock()
+    defer { lock.unlock() }
+    XCTAssertEqual(answeredPollCount, 1)
+  }
 }
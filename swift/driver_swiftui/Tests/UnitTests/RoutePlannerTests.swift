@@ -0,0 +1,242 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+import Foundation
+import GoogleMaps
+import GoogleRidesharingDriver
+import XCTest
+
+@testable import DriverSampleApp
+
+class RoutePlannerTests: XCTestCase {
+
+  /// The route computations and the time spent waiting for routes while driving a trip.
+  private struct TripRouting {
+    var routeComputationCount = 0
+    var timeToRouteReady: TimeInterval = 0
+  }
+
+  private var clock: VirtualClock!
+  private var navigator: StubNavigator!
+
+  override func setUp() {
+    super.setUp()
+    clock = VirtualClock(now: 0)
+    navigator = StubNavigator(clock: clock)
+  }
+
+  /// Returns the waypoints of a trip with a pickup, `intermediateDestinationCount` intermediate
+  /// destinations and a dropoff.
+  private static func makeTripWaypoints(tripID: String, intermediateDestinationCount: Int)
+    -> [GMTSTripWaypoint]
+  {
+    let waypointTypes: [GMTSTripWaypointType] =
+      [.pickUp]
+      + Array(repeating: .intermediateDestination, count: intermediateDestinationCount)
+      + [.dropOff]
+    return waypointTypes.enumerated().map { index, waypointType in
+      GMTSTripWaypoint(
+        location: GMTSTerminalLocation(
+          point: GMTSLatLng(latitude: 37 + Double(index) / 100, longitude: -122),
+          label: nil, description: nil, placeID: nil, generatedID: nil, accessPointID: nil),
+        tripID: tripID, waypointType: waypointType, distanceToPreviousWaypointInMeters: 0,
+        eta: 0)
+    }
+  }
+
+  /// Plans a route through the remaining waypoints, and returns how long it took to be ready.
+  private func planRoute(through waypoints: [GMTSTripWaypoint], with planner: RoutePlanner)
+    -> TimeInterval
+  {
+    let startTime = clock.now
+    var readyTime: TimeInterval?
+    planner.planRoute(through: waypoints) { [clock] routeStatus in
+      XCTAssertEqual(routeStatus, .OK)
+      readyTime = clock!.now
+    }
+    while readyTime == nil {
+      clock.advance(by: 0.1)
+    }
+    return readyTime! - startTime
+  }
+
+  /// Drives a trip the way `MapViewController` does: the route is planned when the trip starts
+  /// and again after each stop is reached, once the navigator has arrived at it.
+  private func driveTrip(_ waypoints: [GMTSTripWaypoint], with planner: RoutePlanner)
+    -> TripRouting
+  {
+    let initialComputationCount = navigator.routeComputationCount
+    var routing = TripRouting()
+    var remainingWaypoints = waypoints
+    routing.timeToRouteReady += planRoute(through: remainingWaypoints, with: planner)
+    while !remainingWaypoints.isEmpty {
+      planner.didArrive()
+      remainingWaypoints.removeFirst()
+      guard !remainingWaypoints.isEmpty else { break }
+      routing.timeToRouteReady += planRoute(through: remainingWaypoints, with: planner)
+    }
+    routing.routeComputationCount = navigator.routeComputationCount - initialComputationCount
+    return routing
+  }
+
+  func testMultiDestinationTripIsRoutedOnce() {
+    let planner = RoutePlanner(navigator: navigator)
+    let waypoints = Self.makeTripWaypoints(tripID: "test-trip", intermediateDestinationCount: 3)
+
+    let routing = driveTrip(waypoints, with: planner)
+
+    XCTAssertEqual(routing.routeComputationCount, 1)
+    XCTAssertEqual(navigator.continueCount, 4)
+    // Only the first route is waited for, which is computed through all five stops.
+    XCTAssertEqual(routing.timeToRouteReady, 1.4, accuracy: 0.01)
+  }
+
+  func testSingleDestinationRoutesEveryStop() {
+    let planner = RoutePlanner(navigator: navigator, maximumDestinationCount: 1)
+    let waypoints = Self.makeTripWaypoints(tripID: "test-trip", intermediateDestinationCount: 3)
+
+    let routing = driveTrip(waypoints, with: planner)
+
+    XCTAssertEqual(routing.routeComputationCount, 5)
+    XCTAssertEqual(routing.timeToRouteReady, 5, accuracy: 0.01)
+  }
+
+  func testLookAheadBoundsDestinations() {
+    let planner = RoutePlanner(navigator: navigator, maximumDestinationCount: 3)
+    let waypoints = Self.makeTripWaypoints(tripID: "test-trip", intermediateDestinationCount: 6)
+
+    let routing = driveTrip(waypoints, with: planner)
+
+    // Eight stops are routed three at a time.
+    XCTAssertEqual(routing.routeComputationCount, 3)
+  }
+
+  func testReachingStopBeforeArrivalContinues() {
+    let planner = RoutePlanner(navigator: navigator)
+    let waypoints = Self.makeTripWaypoints(tripID: "test-trip", intermediateDestinationCount: 1)
+    _ = planRoute(through: waypoints, with: planner)
+
+    // The driver reports reaching the pickup before the navigator arrives at it.
+    XCTAssertEqual(planRoute(through: Array(waypoints.dropFirst()), with: planner), 0)
+    XCTAssertEqual(navigator.routeComputationCount, 1)
+    XCTAssertEqual(navigator.continueCount, 1)
+    XCTAssertEqual(navigator.destinations.count, 2)
+  }
+
+  func testChangedWaypointsAreRoutedAgain() {
+    let planner = RoutePlanner(navigator: navigator)
+    let waypoints = Self.makeTripWaypoints(tripID: "test-trip", intermediateDestinationCount: 1)
+    _ = planRoute(through: waypoints, with: planner)
+
+    let otherTrip = Self.makeTripWaypoints(tripID: "test-trip2", intermediateDestinationCount: 0)
+    _ = planRoute(through: [waypoints[0], otherTrip[0]] + waypoints.dropFirst(), with: planner)
+    XCTAssertEqual(navigator.routeComputationCount, 2)
+
+    // Waypoints added after the planned ones don't change the route.
+    _ = planRoute(through: planner.plannedWaypoints + [otherTrip[1]], with: planner)
+    XCTAssertEqual(navigator.routeComputationCount, 2)
+  }
+
+  func testFailedRouteIsComputedAgain() {
+    let planner = RoutePlanner(navigator: navigator)
+    let waypoints = Self.makeTripWaypoints(tripID: "test-trip", intermediateDestinationCount: 0)
+    navigator.routeStatus = .noRouteFound
+    var routeStatus: GMSRouteStatus?
+    planner.planRoute(through: waypoints) { routeStatus = $0 }
+    clock.advance(by: 2)
+    XCTAssertEqual(routeStatus, .noRouteFound)
+    XCTAssertTrue(planner.plannedWaypoints.isEmpty)
+
+    navigator.routeStatus = .OK
+    XCTAssertEqual(planRoute(through: waypoints, with: planner), 1.1, accuracy: 0.01)
+    XCTAssertEqual(navigator.routeComputationCount, 2)
+  }
+
+  func testRequestsWaitForRouteBeingComputed() {
+    let planner = RoutePlanner(navigator: navigator)
+    let waypoints = Self.makeTripWaypoints(tripID: "test-trip", intermediateDestinationCount: 0)
+    var readyCount = 0
+    planner.planRoute(through: waypoints) { _ in readyCount += 1 }
+    planner.planRoute(through: waypoints) { _ in readyCount += 1 }
+    XCTAssertEqual(readyCount, 0)
+
+    clock.advance(by: 2)
+    XCTAssertEqual(readyCount, 2)
+    XCTAssertEqual(navigator.routeComputationCount, 1)
+  }
+
+  func testExtendingRouteComputesLegsIntoNextTrip() {
+    let planner = RoutePlanner(navigator: navigator)
+    let waypoints = Self.makeTripWaypoints(tripID: "test-trip", intermediateDestinationCount: 0)
+    let nextTrip = Self.makeTripWaypoints(tripID: "test-trip2", intermediateDestinationCount: 0)
+    _ = planRoute(through: waypoints, with: planner)
+
+    var routeStatus: GMSRouteStatus?
+    planner.extendRoute(through: waypoints + nextTrip) { routeStatus = $0 }
+    clock.advance(by: 2)
+    XCTAssertEqual(routeStatus, .OK)
+    XCTAssertEqual(navigator.routeComputationCount, 2)
+    XCTAssertEqual(planner.plannedWaypoints.count, 4)
+
+    // Once the current trip is complete, the next one is routed right away.
+    planner.didArrive()
+    planner.didArrive()
+    XCTAssertEqual(planRoute(through: nextTrip, with: planner), 0)
+    planner.extendRoute(through: nextTrip) { _ in }
+    XCTAssertEqual(navigator.routeComputationCount, 2)
+  }
+
+  func testExtendingRouteServesRequestsWaitingForIt() {
+    let planner = RoutePlanner(navigator: navigator)
+    let waypoints = Self.makeTripWaypoints(tripID: "test-trip", intermediateDestinationCount: 0)
+    let nextTrip = Self.makeTripWaypoints(tripID: "test-trip2", intermediateDestinationCount: 0)
+    var readyCount = 0
+    planner.planRoute(through: waypoints) { _ in readyCount += 1 }
+    planner.extendRoute(through: waypoints + nextTrip) { _ in readyCount += 1 }
+
+    clock.advance(by: 2)
+    XCTAssertEqual(readyCount, 2)
+    XCTAssertEqual(navigator.routeComputationCount, 2)
+  }
+
+  func testSupersededRouteCompletesWaitingRequests() {
+    let planner = RoutePlanner(navigator: navigator)
+    let waypoints = Self.makeTripWaypoints(tripID: "test-trip", intermediateDestinationCount: 0)
+    let otherTrip = Self.makeTripWaypoints(tripID: "test-trip2", intermediateDestinationCount: 0)
+    var routeStatuses: [GMSRouteStatus] = []
+    planner.planRoute(through: waypoints) { routeStatuses.append($0) }
+    planner.planRoute(through: otherTrip) { routeStatuses.append($0) }
+    XCTAssertEqual(routeStatuses, [.canceled])
+
+    clock.advance(by: 2)
+    XCTAssertEqual(routeStatuses, [.canceled, .OK])
+
+    planner.planRoute(through: waypoints) { routeStatuses.append($0) }
+    planner.clearRoute()
+    XCTAssertEqual(routeStatuses, [.canceled, .OK, .canceled])
+  }
+
+  func testWaypointWithoutLocationFailsRoute() {
+    let planner = RoutePlanner(navigator: navigator)
+    let waypoints = Self.makeTripWaypoints(tripID: "test-trip", intermediateDestinationCount: 0)
+    let waypointWithoutLocation = GMTSTripWaypoint(
+      location: nil, tripID: "test-trip", waypointType: .dropOff,
+      distanceToPreviousWaypointInMeters: 0, eta: 0)
+    var routeStatus: GMSRouteStatus?
+    planner.planRoute(through: [waypoints[0], waypointWithoutLocation]) { routeStatus = $0 }
+    XCTAssertEqual(routeStatus, .waypointError)
+    XCTAssertEqual(navigator.routeComputationCount, 0)
+  }
+}
@@ -0,0 +1,222 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import Foundation
+import GoogleRidesharingDriver
+import XCTest
+
+@testable import DriverSampleApp
+
+class StopSequenceOptimizerTests: XCTestCase {
+
+  private static func makeWaypoint(
+    tripID: String, type: GMTSTripWaypointType, using generator: inout SeededRandomNumberGenerator
+  ) -> GMTSTripWaypoint {
+    // Stops spread over about 10 km around San Francisco.
+    let latitude = 37.72 + Double.random(in: 0..<0.09, using: &generator)
+    let longitude = -122.50 + Double.random(in: 0..<0.12, using: &generator)
+    return GMTSTripWaypoint(
+      location: GMTSTerminalLocation(
+        point: GMTSLatLng(latitude: latitude, longitude: longitude),
+        label: nil, description: nil, placeID: nil, generatedID: nil, accessPointID: nil),
+      tripID: tripID, waypointType: type, distanceToPreviousWaypointInMeters: 0, eta: 0)
+  }
+
+  /// Returns the stops of a shared vehicle with about `stopCount` stops, in a feasible order that
+  /// serves the trips one after another. The first trip is already on board, and one trip in three
+  /// has an intermediate destination.
+  private static func makeStops(count stopCount: Int, seed: UInt64) -> [GMTSTripWaypoint] {
+    var generator = SeededRandomNumberGenerator(seed: seed)
+    var onBoardStops: [GMTSTripWaypoint] = []
+    var stops: [GMTSTripWaypoint] = []
+    var tripIndex = 0
+    while onBoardStops.count + stops.count < stopCount {
+      let tripID = "trip-\(tripIndex)"
+      if tripIndex == 0 {
+        onBoardStops.append(makeWaypoint(tripID: tripID, type: .dropOff, using: &generator))
+      } else {
+        stops.append(makeWaypoint(tripID: tripID, type: .pickUp, using: &generator))
+        if tripIndex % 3 == 2 {
+          stops.append(
+            makeWaypoint(tripID: tripID, type: .intermediateDestination, using: &generator))
+        }
+        stops.append(makeWaypoint(tripID: tripID, type: .dropOff, using: &generator))
+      }
+      tripIndex += 1
+    }
+    return onBoardStops + stops
+  }
+
+  /// Returns whether the stops visit each trip's stops in the given order without carrying more
+  /// than `capacity` trips.
+  private static func isFeasible(
+    _ waypoints: [GMTSTripWaypoint], comparedTo original: [GMTSTripWaypoint], capacity: Int
+  ) -> Bool {
+    func tripOrder(_ waypoints: [GMTSTripWaypoint]) -> [String: [ObjectIdentifier]] {
+      var order: [String: [ObjectIdentifier]] = [:]
+      for waypoint in waypoints {
+        order[(waypoint.tripID as String?) ?? "", default: []].append(ObjectIdentifier(waypoint))
+      }
+      return order
+    }
+    guard waypoints.count == original.count, tripOrder(waypoints) == tripOrder(original) else {
+      return false
+    }
+    let tripIDs = Set(original.map { $0.tripID as String? })
+    let pickedUpTripIDs = Set(
+      original.filter { $0.waypointType == .pickUp }.map { $0.tripID as String? })
+    var load = tripIDs.subtracting(pickedUpTripIDs).count
+    for waypoint in waypoints {
+      switch waypoint.waypointType {
+      case .pickUp: load += 1
+      case .dropOff: load -= 1
+      default: break
+      }
+      if load > capacity {
+        return false
+      }
+    }
+    return true
+  }
+
+  private static func distance(of waypoints: [GMTSTripWaypoint]) -> Double {
+    StopSequenceOptimizer(maximumCapacity: .max, timeBudget: 0).propose(for: waypoints)
+      .originalDistance
+  }
+
+  /// Returns the length of the shortest feasible order that keeps the first stop first.
+  private static func shortestDistance(of waypoints: [GMTSTripWaypoint], capacity: Int) -> Double {
+    var shortest = Double.infinity
+    func permute(_ prefix: [GMTSTripWaypoint], _ rest: [GMTSTripWaypoint]) {
+      guard !rest.isEmpty else {
+        if isFeasible(prefix, comparedTo: waypoints, capacity: capacity) {
+          shortest = min(shortest, distance(of: prefix))
+        }
+        return
+      }
+      for index in rest.indices {
+        var remaining = rest
+        let next = remaining.remove(at: index)
+        permute(prefix + [next], remaining)
+      }
+    }
+    permute([waypoints[0]], Array(waypoints.dropFirst()))
+    return shortest
+  }
+
+  func testKeepsTheOrderOfATripsStops() {
+    var generator = SeededRandomNumberGenerator(seed: 1)
+    let waypoints = [GMTSTripWaypointType.pickUp, .intermediateDestination, .dropOff].map {
+      Self.makeWaypoint(tripID: "trip", type: $0, using: &generator)
+    }
+
+    let proposal = StopSequenceOptimizer(maximumCapacity: 1).propose(for: waypoints)
+
+    XCTAssertFalse(proposal.isReordered)
+    XCTAssertEqual(
+      proposal.waypoints.map(ObjectIdentifier.init), waypoints.map(ObjectIdentifier.init))
+    XCTAssertEqual(proposal.distance, proposal.originalDistance)
+  }
+
+  func testProposesAShorterFeasibleOrder() {
+    for seed in 1...20 as ClosedRange<UInt64> {
+      let waypoints = Self.makeStops(count: 30, seed: seed)
+
+      let proposal = StopSequenceOptimizer(maximumCapacity: 3, timeBudget: 1)
+        .propose(for: waypoints)
+
+      XCTAssertTrue(
+        Self.isFeasible(proposal.waypoints, comparedTo: waypoints, capacity: 3), "seed \(seed)")
+      XCTAssertTrue(proposal.waypoints.first === waypoints.first)
+      XCTAssertTrue(proposal.isReordered, "seed \(seed)")
+      XCTAssertLessThan(proposal.distance, proposal.originalDistance)
+      XCTAssertEqual(proposal.distance, Self.distance(of: proposal.waypoints), accuracy: 1e-6)
+    }
+  }
+
+  func testRespectsTheCapacityOfTheVehicle() {
+    for seed in 1...20 as ClosedRange<UInt64> {
+      let waypoints = Self.makeStops(count: 20, seed: seed)
+
+      let proposal = StopSequenceOptimizer(maximumCapacity: 1, timeBudget: 1)
+        .propose(for: waypoints)
+
+      // With one seat, each trip is dropped off before the next is picked up.
+      XCTAssertTrue(
+        Self.isFeasible(proposal.waypoints, comparedTo: waypoints, capacity: 1), "seed \(seed)")
+    }
+  }
+
+  func testIsCloseToTheShortestOrderForSmallInstances() {
+    var totalDistance = 0.0
+    var totalShortestDistance = 0.0
+    for seed in 1...10 as ClosedRange<UInt64> {
+      let waypoints = Self.makeStops(count: 7, seed: seed)
+
+      let proposal = StopSequenceOptimizer(maximumCapacity: 2, timeBudget: 1)
+        .propose(for: waypoints)
+      let shortestDistance = Self.shortestDistance(of: waypoints, capacity: 2)
+
+      XCTAssertGreaterThanOrEqual(proposal.distance, shortestDistance - 1e-6)
+      totalDistance += proposal.distance
+      totalShortestDistance += shortestDistance
+    }
+    XCTAssertLessThan(totalDistance / totalShortestDistance, 1.1)
+  }
+
+  /// Reports the saving over the provider's order, and the gap to a long search, for a range of
+  /// instance sizes and time budgets.
+  func testSolutionQualityVersusRuntime() {
+    let stopCounts = [5, 10, 20, 50, 100, 200]
+    let timeBudgets: [TimeInterval] = [0, 0.001, 0.01, 0.1]
+    let seeds: [UInt64] = [1, 2, 3]
+    var report = "stops  budget(ms)  runtime(ms)  saving(%)  gap(%)\n"
+    for stopCount in stopCounts {
+      let instances = seeds.map { Self.makeStops(count: stopCount, seed: $0) }
+      let referenceDistances = instances.map {
+        StopSequenceOptimizer(maximumCapacity: 3, timeBudget: 2).propose(for: $0).distance
+      }
+      for timeBudget in timeBudgets {
+        var runtime: TimeInterval = 0
+        var saving = 0.0
+        var gap = 0.0
+        for (waypoints, referenceDistance) in zip(instances, referenceDistances) {
+          let optimizer = StopSequenceOptimizer(maximumCapacity: 3, timeBudget: timeBudget)
+          let start = ProcessInfo.processInfo.systemUptime
+          let proposal = optimizer.propose(for: waypoints)
+          runtime += ProcessInfo.processInfo.systemUptime - start
+
+          XCTAssertTrue(Self.isFeasible(proposal.waypoints, comparedTo: waypoints, capacity: 3))
+          saving += 1 - proposal.distance / proposal.originalDistance
+          gap += proposal.distance / referenceDistance - 1
+        }
+        let count = Double(seeds.count)
+        report += String(
+          format: "%5d  %10.0f  %11.2f  %9.1f  %6.1f\n", stopCount, timeBudget * 1000,
+          runtime / count * 1000, saving / count * 100, gap / count * 100)
+      }
+    }
+    print("Stop sequence optimizer (capacity 3):\n\(report)")
+    add(XCTAttachment(string: report))
+  }
+
+  func testPerformanceOf200Stops() {
+    let waypoints = Self.makeStops(count: 200, seed: 1)
+    let optimizer = StopSequenceOptimizer(maximumCapacity: 3, timeBudget: 0.05)
+
+    measure(metrics: [XCTClockMetric(), XCTCPUMetric()]) {
+      _ = optimizer.propose(for: waypoints)
+    }
+  }
+}
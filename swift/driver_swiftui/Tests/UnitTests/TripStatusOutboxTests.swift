@@ -0,0 +1,230 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import Foundation
+import XCTest
+
+@testable import DriverSampleApp
+
+class TripStatusOutboxTests: XCTestCase {
+  /// A trip status update as received by the stub provider.
+  private struct ReceivedUpdate: Equatable {
+    let tripID: String
+    let status: String
+    let idempotencyKey: String?
+  }
+
+  private var urlSession: URLSession!
+  private var outboxFileURL: URL!
+  private let receivedUpdatesLock = NSLock()
+  private var receivedUpdates: [ReceivedUpdate] = []
+
+  override func setUp() {
+    let configuration = URLSessionConfiguration.ephemeral
+    configuration.protocolClasses = [MockURLProtocol.self]
+    urlSession = URLSession(configuration: configuration)
+    outboxFileURL = FileManager.default.temporaryDirectory.appendingPathComponent(
+      "TripStatusOutboxTests-\(UUID().uuidString).plist")
+    receivedUpdates = []
+  }
+
+  override func tearDown() {
+    MockURLProtocol.responseDelayHandler = nil
+    MockURLProtocol.networkEmulator = nil
+    try? FileManager.default.removeItem(at: outboxFileURL)
+  }
+
+  /// Serves trip updates like the provider, answering each with the status code returned by
+  /// `statusCode`, or failing it like a lost connection if that throws.
+  private func setUpdateTripResponse(
+    statusCode: @escaping (ReceivedUpdate) throws -> Int = { _ in 200 }
+  ) {
+    MockURLProtocol.requestHandler = { request in
+      let body = request.bodyStreamAsJSON() as? [String: Any]
+      let update = ReceivedUpdate(
+        tripID: request.url!.lastPathComponent, status: body?["status"] as? String ?? "",
+        idempotencyKey: request.value(forHTTPHeaderField: "Idempotency-Key"))
+      let code = try statusCode(update)
+      self.receivedUpdatesLock.lock()
+      self.receivedUpdates.append(update)
+      self.receivedUpdatesLock.unlock()
+      let response = HTTPURLResponse(
+        url: request.url!, statusCode: code, httpVersion: nil, headerFields: nil)!
+      return (response, Data())
+    }
+  }
+
+  private func makeOutbox() -> TripStatusOutbox {
+    TripStatusOutbox(
+      providerService: ProviderService(session: urlSession), fileURL: outboxFileURL,
+      retryInterval: 0.01)
+  }
+
+  /// Waits for an outbox to have sent or dropped all of its updates.
+  private func waitForEmptyOutbox(_ outbox: TripStatusOutbox) {
+    let sent = expectation(
+      for: NSPredicate { _, _ in outbox.pendingUpdates.isEmpty }, evaluatedWith: nil)
+    wait(for: [sent], timeout: 5)
+  }
+
+  private func expectedUpdates(_ updates: [TripStatusOutbox.Update]) -> [ReceivedUpdate] {
+    updates.map {
+      ReceivedUpdate(
+        tripID: $0.tripID, status: $0.status.rawValue, idempotencyKey: $0.idempotencyKey)
+    }
+  }
+
+  func testSendsUpdatesInOrderWithIdempotencyKeys() {
+    setUpdateTripResponse()
+    let outbox = makeOutbox()
+    let updates = [
+      outbox.enqueue(tripID: "test-trip", status: .enrouteToPickup),
+      outbox.enqueue(tripID: "test-trip", status: .arrivedAtPickup),
+      outbox.enqueue(tripID: "test-trip", status: .enrouteToDropoff),
+    ]
+    waitForEmptyOutbox(outbox)
+
+    XCTAssertEqual(receivedUpdates, expectedUpdates(updates))
+    XCTAssertEqual(Set(updates.map { $0.idempotencyKey }).count, updates.count)
+  }
+
+  func testRetriesUpdatesThroughNetworkOutage() {
+    var failedRequestCount = 0
+    setUpdateTripResponse { _ in
+      if failedRequestCount < 3 {
+        failedRequestCount += 1
+        throw URLError(.notConnectedToInternet)
+      }
+      return 200
+    }
+    let outbox = makeOutbox()
+    let updates = [
+      outbox.enqueue(tripID: "test-trip", status: .enrouteToPickup),
+      outbox.enqueue(tripID: "test-trip", status: .arrivedAtPickup),
+    ]
+    waitForEmptyOutbox(outbox)
+
+    XCTAssertEqual(failedRequestCount, 3)
+    XCTAssertEqual(receivedUpdates, expectedUpdates(updates))
+  }
+
+  func testReplaysPersistedUpdatesAfterProcessKill() {
+    // The provider is unreachable until the app is relaunched.
+    var isProviderReachable = false
+    setUpdateTripResponse { _ in
+      guard isProviderReachable else { throw URLError(.notConnectedToInternet) }
+      return 200
+    }
+    let killedOutbox = TripStatusOutbox(fileURL: outboxFileURL) { _ in
+      throw URLError(.notConnectedToInternet)
+    }
+    let updates = [
+      killedOutbox.enqueue(tripID: "test-trip", status: .enrouteToPickup),
+      killedOutbox.enqueue(tripID: "test-trip", status: .arrivedAtPickup),
+    ]
+
+    isProviderReachable = true
+    let relaunchedOutbox = makeOutbox()
+    XCTAssertEqual(relaunchedOutbox.pendingUpdates, updates)
+    waitForEmptyOutbox(relaunchedOutbox)
+
+    // The relaunched outbox sends the same updates with the same idempotency keys.
+    XCTAssertEqual(receivedUpdates, expectedUpdates(updates))
+  }
+
+  func testRejectedUpdateDropsLaterUpdatesForTheSameTrip() {
+    setUpdateTripResponse { update in
+      update.status == ProviderTripStatus.arrivedAtPickup.rawValue ? 409 : 200
+    }
+    // Keep the updates pending until all of them have been enqueued.
+    MockURLProtocol.responseDelayHandler = { _ in 0.1 }
+    let outbox = makeOutbox()
+    let rejected = expectation(description: "Update rejected")
+    var rejectedUpdate: TripStatusOutbox.Update?
+    outbox.onRejection = { update, error in
+      rejectedUpdate = update
+      XCTAssertTrue(error is ProviderService.Error)
+      rejected.fulfill()
+    }
+
+    let sentUpdate = outbox.enqueue(tripID: "test-trip1", status: .enrouteToPickup)
+    let updateToReject = outbox.enqueue(tripID: "test-trip1", status: .arrivedAtPickup)
+    outbox.enqueue(tripID: "test-trip1", status: .enrouteToDropoff)
+    let otherTripUpdate = outbox.enqueue(tripID: "test-trip2", status: .enrouteToPickup)
+    wait(for: [rejected], timeout: 5)
+    waitForEmptyOutbox(outbox)
+
+    XCTAssertEqual(rejectedUpdate, updateToReject)
+    XCTAssertEqual(
+      receivedUpdates.filter { $0.status != ProviderTripStatus.arrivedAtPickup.rawValue },
+      expectedUpdates([sentUpdate, otherTripUpdate]))
+  }
+
+  func testDropsUpdateThatKeepsFailingAfterMaximumAttempts() {
+    setUpdateTripResponse { update in
+      update.status == ProviderTripStatus.enrouteToPickup.rawValue ? 500 : 200
+    }
+    let outbox = TripStatusOutbox(
+      providerService: ProviderService(session: urlSession), fileURL: outboxFileURL,
+      retryInterval: 0.01, maximumAttemptCount: 3)
+    let droppedUpdate = outbox.enqueue(tripID: "test-trip", status: .enrouteToPickup)
+    let sentUpdate = outbox.enqueue(tripID: "test-trip", status: .arrivedAtPickup)
+    waitForEmptyOutbox(outbox)
+
+    XCTAssertEqual(
+      receivedUpdates,
+      expectedUpdates([droppedUpdate, droppedUpdate, droppedUpdate, sentUpdate]))
+  }
+
+  // MARK: - Emulated network
+
+  func testSlowUpdatesOverLossyNetworkAreAppliedOnceInOrder() {
+    setUpdateTripResponse()
+    // Updates are slow to arrive, some are lost and time out, and some are applied by the provider
+    // but have their response cut off, so the outbox resends them.
+    let networkEmulator = NetworkEmulator(seed: 3)
+    networkEmulator.addRoute(
+      pathPrefix: "/trip/", method: "PUT",
+      conditions: NetworkEmulator.Conditions(
+        latency: .uniform(0.05...0.2), lossRate: 0.2, lossTimeout: 0.1, resetRate: 0.2))
+    MockURLProtocol.networkEmulator = networkEmulator
+    let outbox = makeOutbox()
+    let updates = [
+      outbox.enqueue(tripID: "test-trip", status: .enrouteToPickup),
+      outbox.enqueue(tripID: "test-trip", status: .arrivedAtPickup),
+      outbox.enqueue(tripID: "test-trip", status: .enrouteToDropoff),
+    ]
+    waitForEmptyOutbox(outbox)
+
+    // Resent updates keep their idempotency key, so the provider applies each of them once.
+    var appliedIdempotencyKeys = Set<String?>()
+    let appliedUpdates = receivedUpdates.filter {
+      appliedIdempotencyKeys.insert($0.idempotencyKey).inserted
+    }
+    XCTAssertEqual(appliedUpdates, expectedUpdates(updates))
+  }
+
+  // MARK: - Performance
+
+  /// Measures the time from a status tap until the transition can be shown, which no longer
+  /// includes the provider round trip.
+  func testTapToUILatencyWithSlowProvider() {
+    setUpdateTripResponse()
+    MockURLProtocol.responseDelayHandler = { _ in 1 }
+    let outbox = makeOutbox()
+    measure(metrics: [XCTClockMetric()]) {
+      outbox.enqueue(tripID: "test-trip", status: .enrouteToPickup)
+    }
+  }
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import Foundation
+import XCTest
+
+@testable import DriverSampleApp
+
+class TripTracerTests: XCTestCase {
+  private var fileURL: URL!
+  private var tracer: TripTracer!
+
+  override func setUp() {
+    fileURL = FileManager.default.temporaryDirectory.appendingPathComponent(
+      "TripTracerTests-\(UUID().uuidString).jsonl")
+    tracer = TripTracer(source: "driver", fileURL: fileURL)
+  }
+
+  override func tearDown() {
+    try? FileManager.default.removeItem(at: fileURL)
+  }
+
+  /// Returns the spans that have been exported to the trace file.
+  private func exportedSpans() throws -> [[String: Any]] {
+    tracer.waitUntilExported()
+    let lines = try String(contentsOf: fileURL).split(separator: "\n")
+    return try lines.map {
+      try XCTUnwrap(JSONSerialization.jsonObject(with: Data($0.utf8)) as? [String: Any])
+    }
+  }
+
+  func testExportsEndedSpansWithTheirTripTrace() throws {
+    let span = tracer.startSpan("driver.statusTap", tripID: "test-trip")
+    span.setAttribute("ENROUTE_TO_PICKUP", forKey: TripTracer.tripStatusAttributeKey)
+    let startDate = Date()
+    span.end()
+    span.end()
+    tracer.recordEvent("driver.tripMatched", tripID: "test-trip")
+
+    let spans = try exportedSpans()
+    XCTAssertEqual(spans.count, 2)
+    XCTAssertEqual(spans[0]["source"] as? String, "driver")
+    XCTAssertEqual(spans[0]["name"] as? String, "driver.statusTap")
+    XCTAssertEqual(spans[0]["trip"] as? String, "test-trip")
+    XCTAssertEqual(spans[0]["span"] as? String, span.spanID)
+    XCTAssertEqual(
+      spans[0]["attributes"] as? [String: String], ["status": "ENROUTE_TO_PICKUP"])
+    let start = try XCTUnwrap(spans[0]["start"] as? TimeInterval)
+    XCTAssertEqual(start, startDate.timeIntervalSince1970, accuracy: 1)
+    XCTAssertGreaterThanOrEqual(try XCTUnwrap(spans[0]["duration"] as? TimeInterval), 0)
+    XCTAssertEqual(spans[1]["name"] as? String, "driver.tripMatched")
+
+    // Both spans of the trip belong to the same trace, which is derived from the trip ID.
+    let traceID = try XCTUnwrap(spans[0]["trace"] as? String)
+    XCTAssertEqual(traceID.count, 32)
+    XCTAssertEqual(spans[1]["trace"] as? String, traceID)
+    XCTAssertEqual(TripTracer.traceID(tripID: "test-trip"), traceID)
+    XCTAssertNotEqual(TripTracer.traceID(tripID: "other-trip"), traceID)
+  }
+
+  func testDropsSpansThatEndWithoutTrip() throws {
+    tracer.startSpan("consumer.createTrip", tripID: nil).end()
+    let span = tracer.startSpan("consumer.createTrip", tripID: nil)
+    span.tripID = "test-trip"
+    span.end()
+
+    let spans = try exportedSpans()
+    XCTAssertEqual(spans.count, 1)
+    XCTAssertEqual(spans.first?["trip"] as? String, "test-trip")
+  }
+
+  func testTraceHeaderIsParentedByLastStartedSpanOfTrip() {
+    let traceID = TripTracer.traceID(tripID: "test-trip")
+    let rootHeader = tracer.traceHeaderValue(tripID: "test-trip")
+    XCTAssertTrue(rootHeader.hasPrefix("00-\(traceID)-"))
+    XCTAssertTrue(rootHeader.hasSuffix("-01"))
+
+    let span = tracer.startSpan("driver.statusTap", tripID: "test-trip")
+    tracer.startSpan("driver.route", tripID: "other-trip").end()
+    XCTAssertEqual(
+      tracer.traceHeaderValue(tripID: "test-trip"), "00-\(traceID)-\(span.spanID)-01")
+  }
+
+  func testTripUpdatesCarryTraceHeader() async throws {
+    var traceHeader: String?
+    MockURLProtocol.requestHandler = { request in
+      traceHeader = request.value(forHTTPHeaderField: TripTracer.traceHeaderField)
+      let response = HTTPURLResponse(
+        url: request.url!, statusCode: 200, httpVersion: nil, headerFields: nil)!
+      return (response, Data("{}".utf8))
+    }
+    let configuration = URLSessionConfiguration.ephemeral
+    configuration.protocolClasses = [MockURLProtocol.self]
+    let providerService = ProviderService(
+      session: URLSession(configuration: configuration), tripTracer: tracer)
+
+    let span = tracer.startSpan("driver.statusTap", tripID: "test-trip")
+    try await providerService.updateTrip(
+      tripID: "test-trip", status: .enrouteToPickup, intermediateDestinationIndex: nil)
+    span.end()
+
+    XCTAssertEqual(
+      traceHeader,
+      "00-\(TripTracer.traceID(tripID: "test-trip"))-\(span.spanID)-01")
+  }
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+import Foundation
+import GoogleRidesharingDriver
+import XCTest
+
+@testable import DriverSampleApp
+
+class WaypointGeometryTests: XCTestCase {
+
+  /// Returns the great-circle distance between two points, in meters, one pair at a time.
+  static func haversineDistance(_ from: GMTSLatLng, _ to: GMTSLatLng) -> Double {
+    haversineDistance(
+      fromLatitude: from.latitude, fromLongitude: from.longitude, toLatitude: to.latitude,
+      toLongitude: to.longitude)
+  }
+
+  private static func haversineDistance(
+    fromLatitude: Double, fromLongitude: Double, toLatitude: Double, toLongitude: Double
+  ) -> Double {
+    let degreesToRadians = Double.pi / 180
+    let latitudeDelta = (toLatitude - fromLatitude) * degreesToRadians
+    let longitudeDelta = (toLongitude - fromLongitude) * degreesToRadians
+    let haversine =
+      pow(sin(latitudeDelta / 2), 2)
+      + cos(fromLatitude * degreesToRadians) * cos(toLatitude * degreesToRadians)
+      * pow(sin(longitudeDelta / 2), 2)
+    return 2 * WaypointGeometry.earthRadius * asin(min(1, sqrt(haversine)))
+  }
+
+  /// Computes the leg distances and arrival times one waypoint at a time, as a reference for the
+  /// vectorized kernel.
+  private static func scalarLegDistancesAndArrivalTimes(
+    latitudes: [Double], longitudes: [Double], departureTime: TimeInterval
+  ) -> ([Double], [TimeInterval]) {
+    let speedModel = WaypointGeometry.SpeedModel.default
+    var legDistances = [Double](repeating: 0, count: latitudes.count)
+    var arrivalTimes = [TimeInterval](repeating: departureTime, count: latitudes.count)
+    for index in latitudes.indices.dropFirst() {
+      legDistances[index] = haversineDistance(
+        fromLatitude: latitudes[index - 1], fromLongitude: longitudes[index - 1],
+        toLatitude: latitudes[index], toLongitude: longitudes[index])
+      arrivalTimes[index] =
+        arrivalTimes[index - 1] + speedModel.stopDuration
+        + legDistances[index] * speedModel.detourFactor / speedModel.averageSpeed
+    }
+    return (legDistances, arrivalTimes)
+  }
+
+  /// Returns the coordinates of a route of `count` points spread over the San Francisco area.
+  private static func makeRoute(count: Int) -> (latitudes: [Double], longitudes: [Double]) {
+    let latitudes = (0..<count).map { 37.7 + 0.1 * sin(Double($0) * 0.37) }
+    let longitudes = (0..<count).map { -122.4 + 0.1 * cos(Double($0) * 0.91) }
+    return (latitudes, longitudes)
+  }
+
+  func testLegDistanceOfOneDegreeAtTheEquator() {
+    let legDistances = WaypointGeometry.legDistances(latitudes: [0, 0, 1], longitudes: [0, 1, 1])
+
+    XCTAssertEqual(legDistances[0], 0)
+    XCTAssertEqual(legDistances[1], 111_195.08, accuracy: 0.01)
+    XCTAssertEqual(legDistances[2], 111_195.08, accuracy: 0.01)
+  }
+
+  func testEmptyAndSinglePointRoutes() {
+    XCTAssertEqual(WaypointGeometry.legDistances(latitudes: [], longitudes: []), [])
+    XCTAssertEqual(WaypointGeometry.legDistances(latitudes: [37], longitudes: [-122]), [0])
+    XCTAssertEqual(WaypointGeometry.arrivalTimes(legDistances: [], departureTime: 100), [])
+    XCTAssertEqual(WaypointGeometry.arrivalTimes(legDistances: [0], departureTime: 100), [100])
+  }
+
+  func testArrivalTimesAddTheStopAndDrivingTimeOfEachLeg() {
+    let speedModel = WaypointGeometry.SpeedModel(
+      averageSpeed: 10, detourFactor: 1.5, stopDuration: 30)
+
+    let arrivalTimes = WaypointGeometry.arrivalTimes(
+      legDistances: [0, 1000, 200], departureTime: 100, speedModel: speedModel)
+
+    XCTAssertEqual(arrivalTimes.count, 3)
+    XCTAssertEqual(arrivalTimes[0], 100)
+    XCTAssertEqual(arrivalTimes[1], 280, accuracy: 1e-9)
+    XCTAssertEqual(arrivalTimes[2], 340, accuracy: 1e-9)
+  }
+
+  func testVectorizedKernelMatchesScalarImplementation() {
+    let route = Self.makeRoute(count: 1001)
+
+    let legDistances = WaypointGeometry.legDistances(
+      latitudes: route.latitudes, longitudes: route.longitudes)
+    let arrivalTimes = WaypointGeometry.arrivalTimes(
+      legDistances: legDistances, departureTime: 1_000_000)
+    let (expectedLegDistances, expectedArrivalTimes) = Self.scalarLegDistancesAndArrivalTimes(
+      latitudes: route.latitudes, longitudes: route.longitudes, departureTime: 1_000_000)
+
+    for index in route.latitudes.indices {
+      XCTAssertEqual(legDistances[index], expectedLegDistances[index], accuracy: 1e-6)
+      XCTAssertEqual(arrivalTimes[index], expectedArrivalTimes[index], accuracy: 1e-6)
+    }
+  }
+
+  // MARK: - Performance
+
+  /// Reports the time per waypoint of the vectorized kernel and of the scalar implementation for
+  /// routes of 10 to 100,000 points.
+  func testVectorizedVersusScalarThroughput() {
+    var report = "points  scalar(ns/pt)  vectorized(ns/pt)  speedup\n"
+    for count in [10, 100, 1_000, 10_000, 100_000] {
+      let route = Self.makeRoute(count: count)
+      let repetitions = max(1, 1_000_000 / count)
+
+      let scalarStart = ProcessInfo.processInfo.systemUptime
+      for _ in 0..<repetitions {
+        _ = Self.scalarLegDistancesAndArrivalTimes(
+          latitudes: route.latitudes, longitudes: route.longitudes, departureTime: 0)
+      }
+      let scalarTime = ProcessInfo.processInfo.systemUptime - scalarStart
+
+      let vectorizedStart = ProcessInfo.processInfo.systemUptime
+      for _ in 0..<repetitions {
+        let legDistances = WaypointGeometry.legDistances(
+          latitudes: route.latitudes, longitudes: route.longitudes)
+        _ = WaypointGeometry.arrivalTimes(legDistances: legDistances, departureTime: 0)
+      }
+      let vectorizedTime = ProcessInfo.processInfo.systemUptime - vectorizedStart
+
+      let pointCount = Double(count * repetitions)
+      report += String(
+        format: "%6d  %13.1f  %17.1f  %7.2fx\n", count, scalarTime / pointCount * 1e9,
+        vectorizedTime / pointCount * 1e9, scalarTime / vectorizedTime)
+    }
+    print("Waypoint geometry:\n\(report)")
+    add(XCTAttachment(string: report))
+  }
+
+  func testVectorizedPerformanceWith100000Points() {
+    let route = Self.makeRoute(count: 100_000)
+    measure(metrics: [XCTClockMetric(), XCTMemoryMetric()]) {
+      let legDistances = WaypointGeometry.legDistances(
+        latitudes: route.latitudes, longitudes: route.longitudes)
+      _ = WaypointGeometry.arrivalTimes(legDistances: legDistances, departureTime: 0)
+    }
+  }
+
+  func testScalarPerformanceWith100000Points() {
+    let route = Self.makeRoute(count: 100_000)
+    measure(metrics: [XCTClockMetric(), XCTMemoryMetric()]) {
+      _ = Self.scalarLegDistancesAndArrivalTimes(
+        latitudes: route.latitudes, longitudes: route.longitudes, departureTime: 0)
+    }
+  }
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright 2022 Google LLC. All rights reserved.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+ * file except in compliance with the License. You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under
+ * the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ * ANY KIND, either express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+import Foundation
+import GoogleRidesharingDriver
+import XCTest
+
+@testable import DriverSampleApp
+
+class WaypointStoreTests: XCTestCase {
+
+  private static func makeWaypoint(
+    tripID: String, waypointType: GMTSTripWaypointType, latitude: Double = 37
+  ) -> GMTSTripWaypoint {
+    GMTSTripWaypoint(
+      location: GMTSTerminalLocation(
+        point: GMTSLatLng(latitude: latitude, longitude: -122),
+        label: nil, description: nil, placeID: nil, generatedID: nil, accessPointID: nil),
+      tripID: tripID, waypointType: waypointType, distanceToPreviousWaypointInMeters: 0, eta: 0)
+  }
+
+  private static func makeTripWaypoints(tripIndex: Int) -> [GMTSTripWaypoint] {
+    let tripID = "test-trip\(tripIndex)"
+    let latitude = 37 + Double(tripIndex) / 1000
+    return [
+      makeWaypoint(tripID: tripID, waypointType: .pickUp, latitude: latitude),
+      makeWaypoint(tripID: tripID, waypointType: .dropOff, latitude: latitude + 0.0005),
+    ]
+  }
+
+  /// Returns the routes that a vehicle is polled with while it serves the given number of trips,
+  /// each route repeated for `pollsPerRoute` polls.
+  ///
+  /// A back-to-back vehicle is matched with each trip while it drives the previous one, which adds
+  /// the trip's waypoints to the end of its route. A shared vehicle is matched with each trip while
+  /// it drives the previous ones, and picks the new rider up next.
+  private static func makePolledRoutes(tripCount: Int, isShared: Bool, pollsPerRoute: Int = 3)
+    -> [[GMTSTripWaypoint]]
+  {
+    var route = makeTripWaypoints(tripIndex: 0)
+    var routes = [route]
+    for tripIndex in 1..<tripCount {
+      let tripWaypoints = makeTripWaypoints(tripIndex: tripIndex)
+      if isShared {
+        route.insert(tripWaypoints[0], at: min(1, route.count))
+        route.append(tripWaypoints[1])
+      } else {
+        route.append(contentsOf: tripWaypoints)
+      }
+      routes.append(route)
+      // Reach the first waypoint of the route before the next trip is matched.
+      route.removeFirst()
+      routes.append(route)
+    }
+    while !route.isEmpty {
+      route.removeFirst()
+      routes.append(route)
+    }
+    return routes.flatMap { Array(repeating: $0, count: pollsPerRoute) }
+  }
+
+  /// Returns the number of routes planned for the given polls, when a route is planned for every
+  /// change to the waypoints and when it is only planned for a change to the first one.
+  private static func countReroutes(_ polledRoutes: [[GMTSTripWaypoint]]) -> (
+    onAnyChange: Int, onHeadChange: Int
+  ) {
+    var store = WaypointStore()
+    var onAnyChange = 0
+    var onHeadChange = 0
+    for route in polledRoutes {
+      let diff = store.update(route)
+      onAnyChange += diff.isEmpty || route.isEmpty ? 0 : 1
+      onHeadChange += diff.isHeadChanged && !route.isEmpty ? 1 : 0
+    }
+    return (onAnyChange, onHeadChange)
+  }
+
+  func testDiffClassifiesChanges() {
+    let waypoints = (0..<5).map {
+      Self.makeWaypoint(
+        tripID: "test-trip", waypointType: .intermediateDestination, latitude: Double($0))
+    }
+    let inserted = Self.makeWaypoint(tripID: "test-trip2", waypointType: .pickUp)
+
+    // 0 1 2 3 4 -> 0 3 1 x 2
+    let diff = WaypointDiff.between(
+      waypoints, [waypoints[0], waypoints[3], waypoints[1], inserted, waypoints[2]])
+    XCTAssertEqual(diff.insertedIndices, [3])
+    XCTAssertEqual(diff.removedIndices, [4])
+    XCTAssertEqual(diff.reorderedIndices, [1])
+    XCTAssertEqual(diff.unchangedCount, 3)
+    XCTAssertFalse(diff.isHeadChanged)
+
+    XCTAssertTrue(WaypointDiff.between(waypoints, waypoints).isEmpty)
+    XCTAssertTrue(WaypointDiff.between(waypoints, Array(waypoints.dropFirst())).isHeadChanged)
+    XCTAssertTrue(WaypointDiff.between([], waypoints).isHeadChanged)
+  }
+
+  func testDiffMatchesEqualWaypointsThatAreDifferentObjects() {
+    let waypoints = Self.makeTripWaypoints(tripIndex: 0)
+    let diff = WaypointDiff.between(waypoints, Self.makeTripWaypoints(tripIndex: 0))
+    XCTAssertTrue(diff.isEmpty)
+    XCTAssertEqual(diff.unchangedCount, 2)
+  }
+
+  func testNextWaypointForTrip() {
+    var store = WaypointStore()
+    let trip0 = Self.makeTripWaypoints(tripIndex: 0)
+    let trip1 = Self.makeTripWaypoints(tripIndex: 1)
+    store.update([trip0[0], trip1[0], trip0[1], trip1[1]])
+
+    XCTAssertEqual(store.nextWaypoint(forTripID: "test-trip0"), trip0[1])
+    XCTAssertEqual(store.nextWaypoint(forTripID: "test-trip1"), trip1[1])
+    XCTAssertNil(store.nextWaypoint(forTripID: "test-trip2"))
+
+    XCTAssertEqual(store.removeFirst(), trip0[0])
+    XCTAssertEqual(store.first, trip1[0])
+    XCTAssertNil(store.nextWaypoint(forTripID: "test-trip0"))
+    XCTAssertEqual(store.nextWaypoint(forTripID: "test-trip1"), trip1[1])
+  }
+
+  func testBackToBackReroutesOnlyForNewDestinations() {
+    let tripCount = 20
+    let reroutes = Self.countReroutes(Self.makePolledRoutes(tripCount: tripCount, isShared: false))
+    // A route is planned to each pickup and dropoff, and not when a later trip is matched.
+    XCTAssertEqual(reroutes.onHeadChange, 2 * tripCount)
+    XCTAssertEqual(reroutes.onAnyChange, 3 * tripCount - 1)
+  }
+
+  func testSharedPoolReroutesOnlyForNewDestinations() {
+    let tripCount = 20
+    let reroutes = Self.countReroutes(Self.makePolledRoutes(tripCount: tripCount, isShared: true))
+    XCTAssertEqual(reroutes.onHeadChange, 2 * tripCount)
+    XCTAssertEqual(reroutes.onAnyChange, 3 * tripCount - 1)
+  }
+
+  // MARK: - Performance
+
+  /// Measures diffing a route with the given number of trips against the route after another trip
+  /// is matched.
+  private func measureDiff(tripCount: Int, isShared: Bool) {
+    let oldRoute = (0..<tripCount).flatMap { Self.makeTripWaypoints(tripIndex: $0) }
+    let newTrip = Self.makeTripWaypoints(tripIndex: tripCount)
+    var newRoute = oldRoute
+    if isShared {
+      newRoute.insert(newTrip[0], at: 1)
+      newRoute.append(newTrip[1])
+    } else {
+      newRoute.append(contentsOf: newTrip)
+    }
+    measure(metrics: [XCTClockMetric(), XCTMemoryMetric()]) {
+      XCTAssertFalse(WaypointDiff.between(oldRoute, newRoute).isHeadChanged)
+    }
+  }
+
+  func testDiffPerformanceWithBackToBack5000Trips() {
+    measureDiff(tripCount: 5000, isShared: false)
+  }
+
+  func testDiffPerformanceWithSharedPool5000Trips() {
+    measureDiff(tripCount: 5000, isShared: true)
+  }
+
+  /// Diffs a route whose waypoints were all reordered, which is the most expensive diff.
+  func testDiffPerformanceWithShuffled10000Waypoints() {
+    let oldRoute = (0..<5000).flatMap { Self.makeTripWaypoints(tripIndex: $0) }
+    var generator = SystemRandomNumberGenerator()
+    let newRoute = oldRoute.shuffled(using: &generator)
+    measure(metrics: [XCTClockMetric()]) {
+      _ = WaypointDiff.between(oldRoute, newRoute)
+    }
+  }
+
+  /// Diffs the same shared-pool routes as `testDiffPerformanceWithSharedPool500Trips` with the
+  /// standard library's `CollectionDifference`, for comparison.
+  func testCollectionDifferencePerformanceWithSharedPool500Trips() {
+    let oldRoute = (0..<500).flatMap { Self.makeTripWaypoints(tripIndex: $0) }
+    let newTrip = Self.makeTripWaypoints(tripIndex: 500)
+    var newRoute = oldRoute
+    newRoute.insert(newTrip[0], at: 1)
+    newRoute.append(newTrip[1])
+    measure(metrics: [XCTClockMetric()]) {
+      _ = newRoute.difference(from: oldRoute).inferringMoves()
+    }
+  }
+
+  func testDiffPerformanceWithSharedPool500Trips() {
+    measureDiff(tripCount: 500, isShared: true)
+  }
+
+  func testNextWaypointPerformanceWith5000Trips() {
+    var store = WaypointStore()
+    store.update((0..<5000).flatMap { Self.makeTripWaypoints(tripIndex: $0) })
+    measure(metrics: [XCTClockMetric()]) {
+      for tripIndex in 0..<5000 {
+        XCTAssertNotNil(store.nextWaypoint(forTripID: "test-trip\(tripIndex)"))
+      }
+    }
+  }
+}
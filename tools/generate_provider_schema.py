@@ -0,0 +1,763 @@
+#!/usr/bin/env python3
+# Copyright 2022 Google LLC. All rights reserved.
+#
+#
+# Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+# file except in compliance with the License. You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software distributed under
+# the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+# ANY KIND, either express or implied. See the License for the specific language governing
+# permissions and limitations under the License.
+"""Generates the driver apps' provider API code from tools/provider_schema.json.
+
+The schema describes the enums that the provider sends as strings, the paths of its endpoints and
+the bodies of its requests. This tool writes, for the Objective-C and Swift driver apps:
+
+  enum codecs        string to enum lookups through a hash table, and enum to string lookups
+                     through a switch. Enums that are scanned from raw response bytes also get a
+                     byte decoder, which switches on the length and, where lengths collide, on a
+                     byte that tells the strings apart, so that at most one string is compared.
+  URL templates      one function per endpoint, which fills the path template's parameters in and
+                     resolves it against a replica's base URL in a single step.
+  request bodies     the dictionaries that requests send, keyed as the provider expects.
+
+Edit the schema and run the tool from anywhere:
+
+    tools/generate_provider_schema.py
+
+Pass --check to fail instead of writing if the generated files are out of date.
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+import textwrap
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+SCHEMA_PATH = os.path.join(ROOT, 'tools', 'provider_schema.json')
+OBJC_HEADER_PATH = os.path.join(ROOT, 'objectivec_samples', 'Driver', 'DriverSampleApp',
+                                'GRSDProviderSchema.h')
+OBJC_SOURCE_PATH = os.path.join(ROOT, 'objectivec_samples', 'Driver', 'DriverSampleApp',
+                                'GRSDProviderSchema.m')
+SWIFT_PATH = os.path.join(ROOT, 'swift', 'driver_swiftui', 'App', 'Services',
+                          'ProviderSchema.swift')
+
+OBJC_PREFIX = 'GRSD'
+COLUMN_LIMIT = 100
+
+LICENSE = """Copyright 2022 Google LLC. All rights reserved.
+
+
+Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+file except in compliance with the License. You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software distributed under
+the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+ANY KIND, either express or implied. See the License for the specific language governing
+permissions and limitations under the License."""
+
+GENERATED_NOTICE = ('Generated by tools/generate_provider_schema.py from'
+                    ' tools/provider_schema.json. Do not edit.')
+
+PRIMITIVE_TYPES = ('string', 'bool', 'int')
+
+PARAMETER_PATTERN = re.compile(r'\{(\w+)\}')
+
+
+def license_comment():
+    lines = ['/*'] + [(' * ' + line).rstrip() for line in LICENSE.split('\n')] + [' */']
+    return '\n'.join(lines)
+
+
+def lower_first(name):
+    return name[0].lower() + name[1:]
+
+
+def upper_first(name):
+    return name[0].upper() + name[1:]
+
+
+def objc_string(string):
+    return '@"%s"' % string
+
+
+def wrap_call(head, arguments, tail, indent=''):
+    """Returns head(arguments)tail, wrapping the arguments like clang-format if it is too long."""
+    line = '%s%s(%s)%s' % (indent, head, ', '.join(arguments), tail)
+    if len(line) <= COLUMN_LIMIT:
+        return line
+    prefix = '%s%s(' % (indent, head)
+    if len(arguments) > 1:
+        lines = [prefix + arguments[0] + ',']
+        for argument in arguments[1:-1]:
+            lines.append(' ' * len(prefix) + argument + ',')
+        lines.append(' ' * len(prefix) + arguments[-1] + ')' + tail)
+        if all(len(candidate) <= COLUMN_LIMIT for candidate in lines):
+            return '\n'.join(lines)
+    continuation = indent + '    '
+    packed = '%s%s)%s' % (continuation, ', '.join(arguments), tail)
+    if len(packed) <= COLUMN_LIMIT:
+        return '%s\n%s' % (prefix, packed)
+    return '%s\n%s' % (prefix, (',\n').join(continuation + argument for argument in arguments) +
+                       ')' + tail)
+
+
+def doc_comment(text, indent=''):
+    """Returns a doc comment holding the text, on one line if it fits."""
+    line = '%s/** %s */' % (indent, text)
+    if len(line) <= COLUMN_LIMIT and '\n' not in text:
+        return [line]
+    lines = ['%s/**' % indent]
+    for paragraph in text.split('\n'):
+        if not paragraph:
+            lines.append('%s *' % indent)
+            continue
+        lines.extend(textwrap.wrap(paragraph, COLUMN_LIMIT, initial_indent=indent + ' * ',
+                                   subsequent_indent=indent + ' * ', break_long_words=False,
+                                   break_on_hyphens=False))
+    lines.append('%s */' % indent)
+    return lines
+
+
+def byte_discriminant(strings):
+    """Returns the first index at which all of the strings, which have the same length, differ."""
+    for index in range(len(strings[0])):
+        if len(set(string[index] for string in strings)) == len(strings):
+            return index
+    return None
+
+
+class Schema(object):
+    """The parsed provider schema."""
+
+    def __init__(self, document):
+        self.enums = document.get('enums', [])
+        self.options = document.get('options', [])
+        self.routes = document.get('routes', [])
+        self.requests = document.get('requests', [])
+        self.types = {}
+        for enum in self.enums:
+            self.types[enum['name']] = ('enum', enum)
+        for option in self.options:
+            self.types[option['name']] = ('options', option)
+        self._validate()
+
+    def _validate(self):
+        for group in self.enums + self.options:
+            wires = [value['wire'] for value in group['values']]
+            if len(set(wires)) != len(wires):
+                raise ValueError('%s has duplicate wire values' % group['name'])
+        for request in self.requests:
+            for field in request['fields']:
+                if field['type'] not in PRIMITIVE_TYPES and field['type'] not in self.types:
+                    raise ValueError('%s.%s has unknown type %s' %
+                                     (request['name'], field['name'], field['type']))
+
+    def route_parameters(self, route):
+        return PARAMETER_PATTERN.findall(route['path'])
+
+
+# Objective-C
+
+
+def objc_decode_name(enum):
+    return '%s%sFromProviderString' % (OBJC_PREFIX, enum['objc']['name'])
+
+
+def objc_decode_bytes_name(enum):
+    return '%s%sFromProviderBytes' % (OBJC_PREFIX, enum['objc']['name'])
+
+
+def objc_encode_name(enum):
+    return '%sProviderStringFrom%s' % (OBJC_PREFIX, enum['objc']['name'])
+
+
+def objc_options_decode_name(option):
+    return '%s%sFromProviderStrings' % (OBJC_PREFIX, option['objc']['name'])
+
+
+def objc_options_encode_name(option):
+    return '%sProviderStringsFrom%s' % (OBJC_PREFIX, option['objc']['name'])
+
+
+def objc_route_name(route):
+    return '%sProvider%sURL' % (OBJC_PREFIX, route['name'])
+
+
+def objc_request_name(request):
+    return '%sProvider%sRequestBody' % (OBJC_PREFIX, request['name'])
+
+
+def objc_route_arguments(schema, route):
+    return ['NSURL *baseURL'] + ['NSString *%s' % name for name in schema.route_parameters(route)]
+
+
+def objc_field_type(schema, field):
+    if field['type'] == 'string':
+        return 'NSString *_Nullable ' if field.get('optional') else 'NSString *'
+    if field['type'] == 'bool':
+        return 'BOOL '
+    if field['type'] == 'int':
+        return 'NSNumber *_Nullable ' if field.get('optional') else 'NSInteger '
+    return schema.types[field['type']][1]['objc']['type'] + ' '
+
+
+def objc_field_value(schema, field):
+    name = field['name']
+    if field['type'] == 'string' or (field['type'] == 'int' and field.get('optional')):
+        return name
+    if field['type'] in PRIMITIVE_TYPES:
+        return '@(%s)' % name
+    kind, group = schema.types[field['type']]
+    if kind == 'enum':
+        return '%s(%s)' % (objc_encode_name(group), name)
+    return '%s(%s)' % (objc_options_encode_name(group), name)
+
+
+def objc_request_arguments(schema, request):
+    return ['%s%s' % (objc_field_type(schema, field), field['name']) for field in request['fields']]
+
+
+def objc_header(schema):
+    out = [license_comment(), '', '// ' + GENERATED_NOTICE, '',
+           '#import <Foundation/Foundation.h>', '',
+           '#import <GoogleRidesharingDriver/GoogleRidesharingDriver.h>', '',
+           'NS_ASSUME_NONNULL_BEGIN', '']
+
+    for option in schema.options:
+        objc = option['objc']
+        out.extend(doc_comment(option['description']))
+        out.append('typedef NS_OPTIONS(NSUInteger, %s) {' % objc['type'])
+        out.append('  %s = 0,' % objc['none'])
+        for bit, value in enumerate(option['values']):
+            out.append('  %s = (1 << %d),' % (value['objc'], bit))
+        out.append('};')
+        out.append('')
+
+    for enum in schema.enums:
+        objc = enum['objc']
+        out.append('#pragma mark - %s' % enum['name'])
+        out.append('')
+        out.extend(doc_comment('Returns the @c %s of a provider string, or @c %s if the string is'
+                               ' not known.' % (objc['type'], objc['unknown'])))
+        out.append('%s %s(NSString *_Nullable string);' % (objc['type'], objc_decode_name(enum)))
+        if objc.get('decodeBytes'):
+            out.append('')
+            out.extend(doc_comment('Returns the @c %s of a provider string given as its UTF-8'
+                                   ' bytes, without escapes, or @c %s if the string is not known.' %
+                                   (objc['type'], objc['unknown'])))
+            out.append(wrap_call('%s %s' % (objc['type'], objc_decode_bytes_name(enum)),
+                                 ['const uint8_t *bytes', 'size_t length'], ';'))
+        if objc.get('encode'):
+            out.append('')
+            out.extend(doc_comment('Returns the provider string of a @c %s.' % objc['type']))
+            out.append('NSString *%s(%s value);' % (objc_encode_name(enum), objc['type']))
+        out.append('')
+
+    for option in schema.options:
+        objc = option['objc']
+        out.append('#pragma mark - %s' % option['name'])
+        out.append('')
+        out.extend(doc_comment('Returns the @c %s named by provider strings. Unknown strings are'
+                               ' ignored.' % objc['type']))
+        out.append(wrap_call('%s %s' % (objc['type'], objc_options_decode_name(option)),
+                             ['NSArray<NSString *> *_Nullable strings'], ';'))
+        out.append('')
+        out.extend(doc_comment('Returns the provider strings of the set @c %s options.' %
+                               objc['type']))
+        out.append(wrap_call('NSArray<NSString *> *%s' % objc_options_encode_name(option),
+                             ['%s options' % objc['type']], ';'))
+        out.append('')
+
+    out.append('#pragma mark - URLs')
+    out.append('')
+    for route in schema.routes:
+        encoding = (', with the parameters percent-encoded,'
+                    if schema.route_parameters(route) else '')
+        out.extend(doc_comment('%s\n\nReturns the URL of @c %s relative to @c baseURL%s or nil if'
+                               ' it is not valid.' %
+                               (route['description'], route['path'], encoding or ',')))
+        out.append(wrap_call('NSURL *_Nullable %s' % objc_route_name(route),
+                             objc_route_arguments(schema, route), ';'))
+        out.append('')
+
+    out.append('#pragma mark - Request bodies')
+    out.append('')
+    for request in schema.requests:
+        out.extend(doc_comment(request['description']))
+        out.append(wrap_call('NSDictionary<NSString *, id> *%s' % objc_request_name(request),
+                             objc_request_arguments(schema, request), ';'))
+        out.append('')
+
+    out.append('NS_ASSUME_NONNULL_END')
+    return '\n'.join(out) + '\n'
+
+
+def objc_bytes_switch(enum, indent):
+    """Returns the body of a byte decoder, which compares at most one string."""
+    objc = enum['objc']
+    values = [value for value in enum['values'] if value.get('decodes', True)]
+    by_length = {}
+    for value in values:
+        by_length.setdefault(len(value['wire'].encode('utf-8')), []).append(value)
+
+    def compare(value, pad):
+        wire = value['wire']
+        return ['%sreturn memcmp(bytes, "%s", %d) == 0 ? %s : %s;' %
+                (pad, wire, len(wire.encode('utf-8')), value['objc'], objc['unknown'])]
+
+    def wrap_return(line, pad):
+        if len(line) <= COLUMN_LIMIT:
+            return [line]
+        head, _, tail = line.partition(' ? ')
+        return [head, '%s           ? %s' % (pad, tail.replace(' : ', '\n%s           : ' % pad))]
+
+    lines = ['%sswitch (length) {' % indent]
+    for length in sorted(by_length):
+        group = by_length[length]
+        lines.append('%s  case %d:' % (indent, length))
+        if len(group) == 1:
+            for line in compare(group[0], indent + '    '):
+                lines.extend(wrap_return(line, indent + '    '))
+            continue
+        index = byte_discriminant([value['wire'] for value in group])
+        if index is None:
+            raise ValueError('%s values of length %d share every byte' % (enum['name'], length))
+        lines.append('%s    switch (bytes[%d]) {' % (indent, index))
+        for value in group:
+            lines.append("%s      case '%s':" % (indent, value['wire'][index]))
+            for line in compare(value, indent + '        '):
+                lines.extend(wrap_return(line, indent + '        '))
+        lines.append('%s      default:' % indent)
+        lines.append('%s        return %s;' % (indent, objc['unknown']))
+        lines.append('%s    }' % indent)
+    lines.append('%s  default:' % indent)
+    lines.append('%s    return %s;' % (indent, objc['unknown']))
+    lines.append('%s}' % indent)
+    return lines
+
+
+def objc_source(schema):
+    out = [license_comment(), '', '// ' + GENERATED_NOTICE, '',
+           '#import "%sProviderSchema.h"' % OBJC_PREFIX, '', '#import <string.h>', '']
+
+    for enum in schema.enums:
+        objc = enum['objc']
+        out.append('#pragma mark - %s' % enum['name'])
+        out.append('')
+        out.append('%s %s(NSString *_Nullable string) {' % (objc['type'], objc_decode_name(enum)))
+        out.append('  static NSDictionary<NSString *, NSNumber *> *valuesByString;')
+        out.append('  static dispatch_once_t onceToken;')
+        out.append('  dispatch_once(&onceToken, ^{')
+        out.append('    valuesByString = @{')
+        for value in enum['values']:
+            if value.get('decodes', True):
+                out.append('      %s : @(%s),' % (objc_string(value['wire']), value['objc']))
+        out.append('    };')
+        out.append('  });')
+        out.append('  NSNumber *value = string ? valuesByString[(NSString *)string] : nil;')
+        out.append('  return value ? (%s)value.integerValue : %s;' %
+                   (objc['type'], objc['unknown']))
+        out.append('}')
+        out.append('')
+        if objc.get('decodeBytes'):
+            out.append(wrap_call('%s %s' % (objc['type'], objc_decode_bytes_name(enum)),
+                                 ['const uint8_t *bytes', 'size_t length'], ' {'))
+            out.extend(objc_bytes_switch(enum, '  '))
+            out.append('}')
+            out.append('')
+        if objc.get('encode'):
+            out.append('NSString *%s(%s value) {' % (objc_encode_name(enum), objc['type']))
+            out.append('  switch (value) {')
+            for value in enum['values']:
+                out.append('    case %s:' % value['objc'])
+                out.append('      return %s;' % objc_string(value['wire']))
+            out.append('  }')
+            out.append('}')
+            out.append('')
+
+    for option in schema.options:
+        objc = option['objc']
+        out.append('#pragma mark - %s' % option['name'])
+        out.append('')
+        out.append(wrap_call('%s %s' % (objc['type'], objc_options_decode_name(option)),
+                             ['NSArray<NSString *> *_Nullable strings'], ' {'))
+        out.append('  static NSDictionary<NSString *, NSNumber *> *optionsByString;')
+        out.append('  static dispatch_once_t onceToken;')
+        out.append('  dispatch_once(&onceToken, ^{')
+        out.append('    optionsByString = @{')
+        for value in option['values']:
+            out.append('      %s : @(%s),' % (objc_string(value['wire']), value['objc']))
+        out.append('    };')
+        out.append('  });')
+        out.append('  %s options = %s;' % (objc['type'], objc['none']))
+        out.append('  for (NSString *string in strings) {')
+        out.append('    options |= optionsByString[string].unsignedIntegerValue;')
+        out.append('  }')
+        out.append('  return options;')
+        out.append('}')
+        out.append('')
+        out.append(wrap_call('NSArray<NSString *> *%s' % objc_options_encode_name(option),
+                             ['%s options' % objc['type']], ' {'))
+        out.append('  NSMutableArray<NSString *> *strings = [[NSMutableArray alloc] init];')
+        for value in option['values']:
+            out.append('  if (options & %s) {' % value['objc'])
+            out.append('    [strings addObject:%s];' % objc_string(value['wire']))
+            out.append('  }')
+        out.append('  return strings;')
+        out.append('}')
+        out.append('')
+
+    out.append('#pragma mark - URLs')
+    out.append('')
+    out.append('/** Percent-encodes a parameter of a URL path. */')
+    out.append('static NSString *_Nullable EscapePathParameter(NSString *parameter) {')
+    out.append('  NSCharacterSet *allowedCharacters = [NSCharacterSet URLPathAllowedCharacterSet];')
+    out.append('  return [parameter stringByAddingPercentEncodingWithAllowedCharacters:'
+               'allowedCharacters];')
+    out.append('}')
+    out.append('')
+    if any('?' in route['path'] for route in schema.routes):
+        out.append('/** Percent-encodes the value of a URL query item. */')
+        out.append('static NSString *_Nullable EscapeQueryValue(NSString *value) {')
+        out.append('  static NSCharacterSet *allowedCharacters;')
+        out.append('  static dispatch_once_t onceToken;')
+        out.append('  dispatch_once(&onceToken, ^{')
+        out.append('    NSMutableCharacterSet *characters =')
+        out.append('        [[NSCharacterSet URLQueryAllowedCharacterSet] mutableCopy];')
+        out.append('    [characters removeCharactersInString:@"&=+"];')
+        out.append('    allowedCharacters = [characters copy];')
+        out.append('  });')
+        out.append('  return [value stringByAddingPercentEncodingWithAllowedCharacters:'
+                   'allowedCharacters];')
+        out.append('}')
+        out.append('')
+    for route in schema.routes:
+        out.append(wrap_call('NSURL *_Nullable %s' % objc_route_name(route),
+                             objc_route_arguments(schema, route), ' {'))
+        parameters = schema.route_parameters(route)
+        if not parameters:
+            out.append('  return [NSURL URLWithString:%s relativeToURL:baseURL];' %
+                       objc_string(route['path']))
+            out.append('}')
+            out.append('')
+            continue
+        query_start = route['path'].find('?')
+        for name in parameters:
+            in_query = query_start >= 0 and route['path'].find('{%s}' % name) > query_start
+            escape = 'EscapeQueryValue' if in_query else 'EscapePathParameter'
+            out.append('  NSString *escaped%s = %s(%s);' % (upper_first(name), escape, name))
+        out.append('  if (%s) {' % ' || '.join('!escaped%s' % upper_first(name)
+                                                for name in parameters))
+        out.append('    return nil;')
+        out.append('  }')
+        template = PARAMETER_PATTERN.sub('%@', route['path'])
+        format_arguments = ', '.join('escaped%s' % upper_first(name) for name in parameters)
+        out.append('  NSString *path = [NSString stringWithFormat:%s, %s];' %
+                   (objc_string(template), format_arguments))
+        out.append('  return [NSURL URLWithString:path relativeToURL:baseURL];')
+        out.append('}')
+        out.append('')
+
+    out.append('#pragma mark - Request bodies')
+    out.append('')
+    for request in schema.requests:
+        out.append(wrap_call('NSDictionary<NSString *, id> *%s' % objc_request_name(request),
+                             objc_request_arguments(schema, request), ' {'))
+        required = [field for field in request['fields'] if not field.get('optional')]
+        optional = [field for field in request['fields'] if field.get('optional')]
+        if not optional:
+            out.append('  return @{')
+            for field in required:
+                out.append('    %s : %s,' % (objc_string(field['key']),
+                                             objc_field_value(schema, field)))
+            out.append('  };')
+        else:
+            out.append('  NSMutableDictionary<NSString *, id> *body = [@{')
+            for field in required:
+                out.append('    %s : %s,' % (objc_string(field['key']),
+                                             objc_field_value(schema, field)))
+            out.append('  } mutableCopy];')
+            for field in optional:
+                out.append('  if (%s) {' % field['name'])
+                out.append('    body[%s] = %s;' % (objc_string(field['key']),
+                                                   objc_field_value(schema, field)))
+                out.append('  }')
+            out.append('  return body;')
+        out.append('}')
+        out.append('')
+
+    return '\n'.join(out).rstrip('\n') + '\n'
+
+
+# Swift
+
+
+def swift_route_name(route):
+    return lower_first(route['name'])
+
+
+def swift_field_type(schema, field):
+    base = {'string': 'String', 'bool': 'Bool', 'int': 'Int'}.get(field['type'])
+    if not base:
+        base = schema.types[field['type']][1]['swift']['type']
+    return base + ('?' if field.get('optional') else '')
+
+
+def swift_field_value(field):
+    if field['type'] in PRIMITIVE_TYPES:
+        return field['name']
+    return '%s.rawValue' % field['name']
+
+
+def swift_is_generated(schema, request):
+    if request.get('swift', True) is False:
+        return False
+    for field in request['fields']:
+        if field['type'] in schema.types and 'swift' not in schema.types[field['type']][1]:
+            return False
+    return True
+
+
+def swift_enum(enum):
+    swift = enum['swift']
+    values = [value for value in enum['values'] if 'swift' in value]
+    out = ['/// %s' % enum['description']]
+    out.append('enum %s: String, Codable, CaseIterable {' % swift['type'])
+    for value in values:
+        out.append('  case %s = "%s"' % (value['swift'], value['wire']))
+    out.append('')
+    out.append('  private static let casesByRawValue = Dictionary(')
+    out.append('    uniqueKeysWithValues: allCases.map { ($0.rawValue, $0) })')
+    out.append('')
+    out.append('  /// Looks the raw value up in a hash table, instead of comparing it with every'
+               ' case.')
+    out.append('  init?(rawValue: String) {')
+    out.append('    guard let value = Self.casesByRawValue[rawValue] else { return nil }')
+    out.append('    self = value')
+    out.append('  }')
+    out.append('}')
+    return out
+
+
+def swift_sdk_enum(enum):
+    swift = enum['swift']
+    values = [value for value in enum['values'] if 'swift' in value]
+    sdk_type = swift['sdkType']
+    function = lower_first(sdk_type[len('GMTS'):]) if sdk_type.startswith('GMTS') else lower_first(
+        sdk_type)
+    dictionary = '%ssByProviderString' % function
+    out = ['/// %s Decodes the provider strings to `%s`.' % (enum['description'], sdk_type)]
+    out.append('enum %s {' % swift['type'])
+    out.append('')
+    out.append('  private static let %s: [String: %s] = [' % (dictionary, sdk_type))
+    for value in values:
+        out.append('    "%s": .%s,' % (value['wire'], value['swift']))
+    out.append('  ]')
+    out.append('')
+    out.append('  /// Returns the value of a provider string, or `.%s` if the string is not'
+               ' known.' % swift['unknown'])
+    out.append('  static func %s(providerString: String) -> %s {' % (function, sdk_type))
+    out.append('    %s[providerString] ?? .%s' % (dictionary, swift['unknown']))
+    out.append('  }')
+    if swift.get('decodeBytes'):
+        by_length = {}
+        for value in values:
+            by_length.setdefault(len(value['wire'].encode('utf-8')), []).append(value)
+        out.append('')
+        out.append('  /// Returns the value of a provider string given as its UTF-8 bytes, without'
+                   ' escapes, or')
+        out.append('  /// `.%s` if the string is not known.' % swift['unknown'])
+        out.append('  static func %s(providerBytes bytes: UnsafeRawBufferPointer)' % function)
+        out.append('    -> %s' % sdk_type)
+        out.append('  {')
+        out.append('    switch bytes.count {')
+        for length in sorted(by_length):
+            group = by_length[length]
+            out.append('    case %d:' % length)
+            if len(group) == 1:
+                out.extend(swift_compare(group[0], swift['unknown'], '      '))
+                continue
+            index = byte_discriminant([value['wire'] for value in group])
+            if index is None:
+                raise ValueError('%s values of length %d share every byte' % (enum['name'], length))
+            out.append('      switch bytes[%d] {' % index)
+            for value in group:
+                out.append('      case UInt8(ascii: "%s"):' % value['wire'][index])
+                out.extend(swift_compare(value, swift['unknown'], '        '))
+            out.append('      default:')
+            out.append('        return .%s' % swift['unknown'])
+            out.append('      }')
+        out.append('    default:')
+        out.append('      return .%s' % swift['unknown'])
+        out.append('    }')
+        out.append('  }')
+    out.append('}')
+    return out
+
+
+def swift_compare(value, unknown, pad):
+    line = '%sreturn bytes.equals("%s") ? .%s : .%s' % (pad, value['wire'], value['swift'], unknown)
+    if len(line) <= COLUMN_LIMIT:
+        return [line]
+    return ['%sreturn bytes.equals("%s")' % (pad, value['wire']),
+            '%s  ? .%s : .%s' % (pad, value['swift'], unknown)]
+
+
+def swift_routes(schema):
+    out = ['/// URLs of the provider\'s endpoints, relative to the base URL of a provider replica.',
+           '///',
+           '/// Each URL is built by filling its path template in and resolving it in a single'
+           ' step.',
+           'enum ProviderRoutes {']
+    has_query = any('?' in route['path'] for route in schema.routes)
+    if has_query:
+        out.append('')
+        out.append('  /// The characters that can be left unescaped in a query item value.')
+        out.append('  private static let urlQueryValueAllowed = CharacterSet.urlQueryAllowed'
+                   '.subtracting(')
+        out.append('    CharacterSet(charactersIn: "&=+"))')
+    for route in schema.routes:
+        parameters = schema.route_parameters(route)
+        out.append('')
+        out.append('  /// %s' % route['description'])
+        arguments = ['%s: String' % name for name in parameters] + ['relativeTo baseURL: URL']
+        signature = '  static func %s(%s) -> URL? {' % (swift_route_name(route),
+                                                       ', '.join(arguments))
+        if len(signature) > COLUMN_LIMIT:
+            signature = '  static func %s(\n    %s\n  ) -> URL? {' % (swift_route_name(route),
+                                                                   ', '.join(arguments))
+        out.append(signature)
+        if not parameters:
+            out.append('    URL(string: "/%s", relativeTo: baseURL)' % route['path'])
+            out.append('  }')
+            continue
+        query_start = route['path'].find('?')
+        guards = []
+        for name in parameters:
+            in_query = query_start >= 0 and route['path'].find('{%s}' % name) > query_start
+            characters = 'urlQueryValueAllowed' if in_query else '.urlPathAllowed'
+            guards.append('let %s = %s.addingPercentEncoding(withAllowedCharacters: %s)' %
+                          (name, name, characters))
+        if len(guards) == 1 and len('    guard %s else {' % guards[0]) <= COLUMN_LIMIT:
+            out.append('    guard %s else {' % guards[0])
+        else:
+            out.append('    guard')
+            for guard in guards[:-1]:
+                out.append('      %s,' % guard)
+            out.append('      %s' % guards[-1])
+            out.append('    else {')
+        out.append('      return nil')
+        out.append('    }')
+        path = PARAMETER_PATTERN.sub(lambda match: '\\(%s)' % match.group(1), route['path'])
+        out.append('    return URL(string: "/%s", relativeTo: baseURL)' % path)
+        out.append('  }')
+    out.append('}')
+    return out
+
+
+def swift_request(schema, request):
+    name = 'Provider%sRequest' % request['name']
+    out = ['/// %s' % request['description'], 'struct %s {' % name]
+    for field in request['fields']:
+        out.append('  var %s: %s' % (field['name'], swift_field_type(schema, field)))
+    out.append('')
+    out.append('  /// The body of the request, keyed as the provider expects.')
+    out.append('  var payload: [String: Any] {')
+    required = [field for field in request['fields'] if not field.get('optional')]
+    optional = [field for field in request['fields'] if field.get('optional')]
+    if not optional:
+        out.append('    [')
+        for field in required:
+            out.append('      "%s": %s,' % (field['key'], swift_field_value(field)))
+        out.append('    ]')
+    else:
+        out.append('    var payload: [String: Any] = [')
+        for field in required:
+            out.append('      "%s": %s,' % (field['key'], swift_field_value(field)))
+        out.append('    ]')
+        for field in optional:
+            out.append('    if let %s = %s {' % (field['name'], field['name']))
+            out.append('      payload["%s"] = %s' % (field['key'],
+                                                     swift_field_value(field)))
+            out.append('    }')
+        out.append('    return payload')
+    out.append('  }')
+    out.append('}')
+    return out
+
+
+def swift_source(schema):
+    out = [license_comment(), '', '// ' + GENERATED_NOTICE, '', 'import Foundation',
+           'import GoogleRidesharingDriver']
+    for enum in schema.enums:
+        if 'swift' not in enum:
+            continue
+        out.append('')
+        if 'sdkType' in enum['swift']:
+            out.extend(swift_sdk_enum(enum))
+        else:
+            out.extend(swift_enum(enum))
+    out.append('')
+    out.extend(swift_routes(schema))
+    for request in schema.requests:
+        if swift_is_generated(schema, request):
+            out.append('')
+            out.extend(swift_request(schema, request))
+    if any(enum.get('swift', {}).get('decodeBytes') for enum in schema.enums):
+        out.append('')
+        out.append('extension UnsafeRawBufferPointer {')
+        out.append('  /// Returns whether the bytes are the UTF-8 bytes of a string.')
+        out.append('  fileprivate func equals(_ string: StaticString) -> Bool {')
+        out.append('    count == string.utf8CodeUnitCount')
+        out.append('      && memcmp(baseAddress!, string.utf8Start, count) == 0')
+        out.append('  }')
+        out.append('}')
+    return '\n'.join(out) + '\n'
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('--check', action='store_true',
+                        help='fail if the generated files are out of date instead of writing them')
+    args = parser.parse_args()
+
+    with open(SCHEMA_PATH) as schema_file:
+        schema = Schema(json.load(schema_file))
+    outputs = {
+        OBJC_HEADER_PATH: objc_header(schema),
+        OBJC_SOURCE_PATH: objc_source(schema),
+        SWIFT_PATH: swift_source(schema),
+    }
+
+    stale = []
+    for path, contents in sorted(outputs.items()):
+        current = None
+        if os.path.exists(path):
+            with open(path) as existing:
+                current = existing.read()
+        if current == contents:
+            continue
+        stale.append(os.path.relpath(path, ROOT))
+        if not args.check:
+            with open(path, 'w') as output:
+                output.write(contents)
+
+    if args.check and stale:
+        sys.stderr.write('Out of date, run tools/generate_provider_schema.py:\n  %s\n' %
+                         '\n  '.join(stale))
+        return 1
+    for path in stale:
+        print('Wrote %s' % path)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
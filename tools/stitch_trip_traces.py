@@ -0,0 +1,215 @@
+#!/usr/bin/env python3
+# Copyright 2022 Google LLC. All rights reserved.
+#
+#
+# Licensed under the Apache License, Version 2.0 (the "License"); you may not use this
+# file except in compliance with the License. You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software distributed under
+# the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF
+# ANY KIND, either express or implied. See the License for the specific language governing
+# permissions and limitations under the License.
+"""Stitches driver and consumer trip traces into per-trip timelines.
+
+The sample apps append a line of JSON to a trace file in their caches directory for every step of
+a trip's lifecycle: GRSDTripTrace.jsonl and GRSCTripTrace.jsonl for the Objective-C apps, and
+TripTrace.jsonl for the Swift apps. Download the files from the driver and consumer devices, for
+example with Xcode's Devices window, and pass them all to this tool:
+
+    tools/stitch_trip_traces.py driver/TripTrace.jsonl consumer/TripTrace.jsonl --timelines
+
+The tool prints percentile summaries of the latencies between steps:
+
+  assignment        the consumer's trip creation returning -> the driver noticing the match
+  match to route    the driver noticing the match -> its route to the trip being generated
+  status to rider   a driver status tap -> the consumer observing that status
+  handoff           the previous back-to-back trip completing -> the driver's route to this trip
+                    being ready, split by whether the trip was prefetched during the previous one
+
+Latencies across the two apps compare wall clocks of different devices, so they are only as
+accurate as the devices' clocks are in sync.
+"""
+
+import argparse
+import collections
+import json
+import math
+import sys
+
+# Names of the spans recorded by the apps.
+CREATE_TRIP = 'consumer.createTrip'
+CONSUMER_TRIP_STATUS = 'consumer.tripStatus'
+TRIP_MATCHED = 'driver.tripMatched'
+ROUTE = 'driver.route'
+STATUS_TAP = 'driver.statusTap'
+HANDOFF = 'driver.handoff'
+
+PERCENTILES = (50, 90, 99)
+
+
+class Span(object):
+    """A step of a trip's lifecycle, as exported by one of the apps."""
+
+    def __init__(self, record):
+        self.source = record.get('source', '?')
+        self.name = record['name']
+        self.trip = record['trip']
+        self.trace = record.get('trace')
+        self.span = record.get('span')
+        self.start = float(record['start'])
+        self.duration = float(record.get('duration', 0))
+        self.attributes = record.get('attributes') or {}
+
+    @property
+    def end(self):
+        return self.start + self.duration
+
+
+def read_spans(paths):
+    """Returns the spans in the given trace files, skipping lines that can't be parsed."""
+    spans = []
+    for path in paths:
+        with open(path) as trace_file:
+            for line_number, line in enumerate(trace_file, 1):
+                line = line.strip()
+                if not line:
+                    continue
+                try:
+                    spans.append(Span(json.loads(line)))
+                except (ValueError, KeyError, TypeError) as error:
+                    print('%s:%d: skipping malformed span (%s)' % (path, line_number, error),
+                          file=sys.stderr)
+    return spans
+
+
+def spans_by_trip(spans):
+    """Groups spans by trip ID, each trip's spans ordered by start time."""
+    trips = collections.defaultdict(list)
+    for span in spans:
+        trips[span.trip].append(span)
+    for trip_spans in trips.values():
+        trip_spans.sort(key=lambda span: span.start)
+    return trips
+
+
+def first(spans, name, predicate=lambda span: True):
+    return next((span for span in spans if span.name == name and predicate(span)), None)
+
+
+def trip_latencies(trip_spans, max_clock_skew):
+    """Returns the latencies between the steps of one trip, keyed by the name of the interval."""
+    latencies = collections.defaultdict(list)
+
+    created = first(trip_spans, CREATE_TRIP)
+    matched = first(trip_spans, TRIP_MATCHED)
+    if created and matched:
+        latencies['assignment'].append(matched.start - created.end)
+    if matched:
+        route = first(trip_spans, ROUTE,
+                      lambda span: span.attributes.get('routeStatus') == 'OK' and
+                      span.end >= matched.start)
+        if route:
+            latencies['match to route'].append(route.end - matched.start)
+
+    for handoff in (span for span in trip_spans if span.name == HANDOFF):
+        if handoff.attributes.get('routeStatus') == 'OK':
+            prefetched = handoff.attributes.get('prefetched') == 'true'
+            latencies['handoff'].append(handoff.duration)
+            latencies['handoff: %s' % ('prefetched' if prefetched else 'fetched')].append(
+                handoff.duration)
+
+    # Pair each status tap with the first consumer update to the same status that follows it,
+    # allowing for the clocks of the two devices to be slightly off.
+    consumer_updates = [span for span in trip_spans if span.name == CONSUMER_TRIP_STATUS]
+    for tap in (span for span in trip_spans if span.name == STATUS_TAP):
+        status = tap.attributes.get('status')
+        update = next((span for span in consumer_updates
+                       if span.attributes.get('status') == status and
+                       span.start >= tap.start - max_clock_skew), None)
+        if update:
+            consumer_updates.remove(update)
+            latencies['status to rider'].append(update.start - tap.start)
+            latencies['status to rider: %s' % status].append(update.start - tap.start)
+    return latencies
+
+
+def percentile(sorted_values, percent):
+    """Returns the nearest-rank percentile of a sorted list of values."""
+    rank = max(int(math.ceil(percent / 100.0 * len(sorted_values))), 1)
+    return sorted_values[rank - 1]
+
+
+def format_seconds(seconds):
+    if abs(seconds) < 1:
+        return '%.0f ms' % (seconds * 1000)
+    return '%.2f s' % seconds
+
+
+def print_summary(title, values_by_name):
+    print(title)
+    header = ['', 'count'] + ['p%d' % p for p in PERCENTILES] + ['max']
+    rows = [header]
+    for name in sorted(values_by_name):
+        values = sorted(values_by_name[name])
+        rows.append([name, str(len(values))] +
+                    [format_seconds(percentile(values, p)) for p in PERCENTILES] +
+                    [format_seconds(values[-1])])
+    widths = [max(len(row[column]) for row in rows) for column in range(len(header))]
+    for row in rows:
+        print('  ' + row[0].ljust(widths[0]) + ''.join(
+            '  ' + cell.rjust(width) for cell, width in zip(row[1:], widths[1:])))
+    print()
+
+
+def print_timeline(trip, trip_spans):
+    origin = trip_spans[0].start
+    print('Trip %s (trace %s)' % (trip, trip_spans[0].trace))
+    for span in trip_spans:
+        attributes = ' '.join('%s=%s' % item for item in sorted(span.attributes.items()))
+        print('  %+10.3f s  %-9s %-24s %10s  %s' % (span.start - origin, span.source, span.name,
+                                                   format_seconds(span.duration), attributes))
+    print()
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('traces', nargs='+', help='trace files exported by the apps')
+    parser.add_argument('--timelines', action='store_true', help='print the timeline of each trip')
+    parser.add_argument('--trip', action='append', help='only include the given trip ID')
+    parser.add_argument('--max-clock-skew', type=float, default=1.0,
+                        help='how far, in seconds, the consumer clock may be behind the driver '
+                        'clock when pairing status taps with status updates (default: 1)')
+    args = parser.parse_args()
+
+    trips = spans_by_trip(read_spans(args.traces))
+    if args.trip:
+        trips = {trip: spans for trip, spans in trips.items() if trip in args.trip}
+    if not trips:
+        print('No trip spans found.', file=sys.stderr)
+        return 1
+
+    latencies = collections.defaultdict(list)
+    durations = collections.defaultdict(list)
+    # Order trips by when they started.
+    for trip, trip_spans in sorted(trips.items(), key=lambda item: item[1][0].start):
+        if args.timelines:
+            print_timeline(trip, trip_spans)
+        for name, values in trip_latencies(trip_spans, args.max_clock_skew).items():
+            latencies[name].extend(values)
+        for span in trip_spans:
+            if span.duration > 0:
+                durations[span.name].append(span.duration)
+
+    print('%d trips\n' % len(trips))
+    if latencies:
+        print_summary('Latencies between steps', latencies)
+    if durations:
+        print_summary('Span durations', durations)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())